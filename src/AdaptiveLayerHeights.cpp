@@ -0,0 +1,163 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "AdaptiveLayerHeights.h"
+
+#include <algorithm> // min, max
+#include <cmath> // abs, sqrt
+
+#include "MeshGroup.h"
+#include "utils/ThreadPool.h"
+
+namespace cura
+{
+
+AdaptiveLayerHeights AdaptiveLayerHeights::uniform(coord_t max_z, coord_t initial_layer_thickness, coord_t layer_thickness)
+{
+    AdaptiveLayerHeights heights;
+    const coord_t initial_slice_z = initial_layer_thickness - layer_thickness / 2;
+    if (max_z < initial_slice_z)
+    { // the meshgroup is shallower than the first layer, so nothing is sliced
+        return heights;
+    }
+    const unsigned int layer_count = (max_z - initial_slice_z) / layer_thickness + 1;
+    heights.slice_z.reserve(layer_count);
+    heights.thicknesses.assign(layer_count, layer_thickness);
+    for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        heights.slice_z.push_back(initial_slice_z + layer_thickness * layer_nr);
+    }
+    heights.thicknesses[0] = initial_layer_thickness;
+    return heights;
+}
+
+AdaptiveLayerHeights AdaptiveLayerHeights::adaptive(const MeshGroup& meshgroup, coord_t initial_layer_thickness, coord_t layer_thickness, coord_t variation, coord_t step, coord_t max_cusp_height)
+{
+    AdaptiveLayerHeights heights;
+    const coord_t max_z = meshgroup.max().z;
+    const coord_t initial_slice_z = initial_layer_thickness - layer_thickness / 2;
+    if (max_z < initial_slice_z)
+    { // the meshgroup is shallower than the first layer, so nothing is sliced
+        return heights;
+    }
+    const coord_t min_thickness = std::max(static_cast<coord_t>(1), layer_thickness - variation);
+    const coord_t max_thickness = std::max(min_thickness, layer_thickness + variation);
+    step = std::max(static_cast<coord_t>(1), step);
+    const coord_t band_height = std::min(step, min_thickness); // the bands must be thinner than the layers to tell them apart
+    const unsigned int band_count = max_z / band_height + 1;
+    const std::vector<coord_t> band_thicknesses = computeBandThicknesses(meshgroup, band_height, band_count, min_thickness, max_thickness, max_cusp_height);
+
+    // the first layer is never adapted, so that it sticks to the build plate as configured
+    heights.slice_z.push_back(initial_slice_z);
+    heights.thicknesses.push_back(initial_layer_thickness);
+    coord_t layer_bottom = initial_layer_thickness;
+    while (true)
+    {
+        // the thickest layer which all bands it covers allow
+        coord_t thickness = max_thickness;
+        while (thickness > min_thickness)
+        {
+            coord_t allowed_thickness = max_thickness;
+            const unsigned int band_end = std::min(band_count, static_cast<unsigned int>((layer_bottom + thickness) / band_height + 1));
+            for (unsigned int band_idx = layer_bottom / band_height; band_idx < band_end; band_idx++)
+            {
+                allowed_thickness = std::min(allowed_thickness, band_thicknesses[band_idx]);
+            }
+            if (thickness <= allowed_thickness)
+            {
+                break;
+            }
+            thickness = std::max(min_thickness, thickness - step);
+        }
+        const coord_t layer_top = layer_bottom + thickness;
+        const coord_t slice_z = layer_top - thickness / 2; // slice in the middle of the layer, as with uniform layers
+        if (slice_z > max_z)
+        {
+            break;
+        }
+        heights.slice_z.push_back(slice_z);
+        heights.thicknesses.push_back(thickness);
+        layer_bottom = layer_top;
+    }
+    return heights;
+}
+
+std::vector<coord_t> AdaptiveLayerHeights::computeBandThicknesses(const MeshGroup& meshgroup, coord_t band_height, unsigned int band_count, coord_t min_thickness, coord_t max_thickness, coord_t max_cusp_height)
+{
+    std::vector<const Mesh*> meshes; // the meshes of which the surface is printed
+    unsigned int face_count = 0;
+    for (const Mesh& mesh : meshgroup.meshes)
+    {
+        if (mesh.getSettingBoolean("support_mesh") || mesh.getSettingBoolean("anti_overhang_mesh") || mesh.getSettingBoolean("cutting_mesh") || mesh.getSettingBoolean("infill_mesh"))
+        { // the surface of helper meshes isn't printed
+            continue;
+        }
+        meshes.push_back(&mesh);
+        face_count += mesh.faces.size();
+    }
+
+    // Divide the faces of all meshes into one range of about equal size per thread, each of which computes the thicknesses for all bands,
+    // so that there are only as many band vectors to combine afterwards as there are threads.
+    const unsigned int chunk_count = std::max(1u, std::min(ThreadPool::getThreadCount(), face_count));
+    std::vector<std::vector<coord_t>> chunk_band_thicknesses(chunk_count);
+    ThreadPool::parallelFor(0, chunk_count, [&](int chunk_idx)
+    {
+        std::vector<coord_t>& band_thicknesses = chunk_band_thicknesses[chunk_idx];
+        band_thicknesses.assign(band_count, max_thickness);
+        const unsigned int chunk_start = static_cast<unsigned long long>(face_count) * chunk_idx / chunk_count;
+        const unsigned int chunk_end = static_cast<unsigned long long>(face_count) * (chunk_idx + 1) / chunk_count;
+        unsigned int mesh_face_start = 0; // the index of the first face of the current mesh among the faces of all meshes
+        for (const Mesh* mesh : meshes)
+        {
+            const unsigned int mesh_face_end = mesh_face_start + mesh->faces.size();
+            for (unsigned int face_idx = std::max(chunk_start, mesh_face_start); face_idx < std::min(chunk_end, mesh_face_end); face_idx++)
+            {
+                const MeshFace& face = mesh->faces[face_idx - mesh_face_start];
+                const Point3& p0 = mesh->vertices[face.vertex_index[0]].p;
+                const Point3& p1 = mesh->vertices[face.vertex_index[1]].p;
+                const Point3& p2 = mesh->vertices[face.vertex_index[2]].p;
+                // the cusp of a layer on a face is its thickness times the vertical component of the unit normal
+                const double ax = p1.x - p0.x, ay = p1.y - p0.y, az = p1.z - p0.z;
+                const double bx = p2.x - p0.x, by = p2.y - p0.y, bz = p2.z - p0.z;
+                const double normal_x = ay * bz - az * by;
+                const double normal_y = az * bx - ax * bz;
+                const double normal_z = ax * by - ay * bx;
+                const double normal_length = std::sqrt(normal_x * normal_x + normal_y * normal_y + normal_z * normal_z);
+                if (normal_length == 0.0)
+                { // degenerate face
+                    continue;
+                }
+                const double normal_z_unit = std::abs(normal_z) / normal_length;
+                if (normal_z_unit * max_thickness <= max_cusp_height)
+                {
+                    continue;
+                }
+                const coord_t face_max_z = std::max(p0.z, std::max(p1.z, p2.z));
+                if (face_max_z < 0)
+                { // below the build plate
+                    continue;
+                }
+                const coord_t thickness = std::max(min_thickness, static_cast<coord_t>(max_cusp_height / normal_z_unit));
+                const coord_t face_min_z = std::max(static_cast<coord_t>(0), static_cast<coord_t>(std::min(p0.z, std::min(p1.z, p2.z))));
+                const unsigned int band_end = std::min(band_count, static_cast<unsigned int>(face_max_z / band_height + 1));
+                for (unsigned int band_idx = face_min_z / band_height; band_idx < band_end; band_idx++)
+                {
+                    band_thicknesses[band_idx] = std::min(band_thicknesses[band_idx], thickness);
+                }
+            }
+            mesh_face_start = mesh_face_end;
+        }
+    });
+
+    std::vector<coord_t> band_thicknesses(band_count, max_thickness);
+    for (const std::vector<coord_t>& chunk_thicknesses : chunk_band_thicknesses)
+    {
+        for (unsigned int band_idx = 0; band_idx < band_count; band_idx++)
+        {
+            band_thicknesses[band_idx] = std::min(band_thicknesses[band_idx], chunk_thicknesses[band_idx]);
+        }
+    }
+    return band_thicknesses;
+}
+
+}//namespace cura
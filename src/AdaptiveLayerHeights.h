@@ -0,0 +1,67 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef ADAPTIVE_LAYER_HEIGHTS_H
+#define ADAPTIVE_LAYER_HEIGHTS_H
+
+#include <vector>
+
+#include "utils/intpoint.h"
+
+namespace cura
+{
+
+class MeshGroup;
+
+/*!
+ * The heights of the layers of a meshgroup: at which height each layer is sliced and how thick it is printed.
+ *
+ * With adaptive layer heights the layers are made thicker where the surface of the model is steep
+ * and thinner where it is shallow, so that the steps between the layers on the surface, the cusps,
+ * are no higher than a threshold while there are as few layers as possible.
+ */
+class AdaptiveLayerHeights
+{
+public:
+    std::vector<int> slice_z; //!< For each layer the height at which the meshes are sliced
+    std::vector<coord_t> thicknesses; //!< For each layer the thickness with which it is printed
+
+    /*!
+     * Make layers which are all equally thick, except for the first one.
+     *
+     * \param max_z The height of the top of the meshgroup
+     * \param initial_layer_thickness The thickness of the first layer
+     * \param layer_thickness The thickness of the other layers
+     */
+    static AdaptiveLayerHeights uniform(coord_t max_z, coord_t initial_layer_thickness, coord_t layer_thickness);
+
+    /*!
+     * Make layers with a thickness adapted to the slope of the surface of the meshes.
+     *
+     * The surface is analysed for bands of \p step high, from the normals of the faces in them.
+     * Each layer is as thick as the bands it covers allow, within the variation from the normal layer thickness.
+     *
+     * \param meshgroup The meshes to slice; the helper meshes, such as support meshes, are ignored
+     * \param initial_layer_thickness The thickness of the first layer, which is never adapted
+     * \param layer_thickness The normal layer thickness, around which the thickness varies
+     * \param variation The maximum difference of the thickness of a layer from \p layer_thickness
+     * \param step The difference between the thicknesses which a layer can get
+     * \param max_cusp_height The maximum height of the step between two layers, measured perpendicular to the surface
+     */
+    static AdaptiveLayerHeights adaptive(const MeshGroup& meshgroup, coord_t initial_layer_thickness, coord_t layer_thickness, coord_t variation, coord_t step, coord_t max_cusp_height);
+
+private:
+    /*!
+     * Compute for each band of \p step high from the bed the maximum layer thickness allowed by the faces in it.
+     *
+     * The faces are processed in parallel, in one chunk per thread, each of which computes the thicknesses for all bands,
+     * which are combined afterwards.
+     *
+     * \return For each band the maximum layer thickness, between \p min_thickness and \p max_thickness
+     */
+    static std::vector<coord_t> computeBandThicknesses(const MeshGroup& meshgroup, coord_t band_height, unsigned int band_count, coord_t min_thickness, coord_t max_thickness, coord_t max_cusp_height);
+};
+
+}//namespace cura
+
+#endif//ADAPTIVE_LAYER_HEIGHTS_H
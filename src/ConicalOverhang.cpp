@@ -1,6 +1,7 @@
 /** Copyright (C) 2016 Tim Kuipers - Released under terms of the AGPLv3 License */
 #include "ConicalOverhang.h"
 
+#include "utils/ThreadPool.h"
 
 namespace cura {
 
@@ -10,26 +11,74 @@ void ConicalOverhang::apply(Slicer* slicer, double angle, int layer_thickness)
     double tanAngle = tan(angle);  // the XY-component of the angle
     int max_dist_from_lower_layer = tanAngle * layer_thickness; // max dist which can be bridged
 
-    for (unsigned int layer_nr = slicer->layers.size() - 2; static_cast<int>(layer_nr) >= 0; layer_nr--)
+    const int layer_count = slicer->layers.size();
+    if (layer_count < 2)
     {
-        SlicerLayer& layer = slicer->layers[layer_nr];
-        SlicerLayer& layer_above = slicer->layers[layer_nr + 1];
-        if (std::abs(max_dist_from_lower_layer) < 5)
-        { // magically nothing happens when max_dist_from_lower_layer == 0
-            // below magic code solves that
-            int safe_dist = 20;
-            Polygons diff = layer_above.polygons.difference(layer.polygons.offset(-safe_dist));
-            layer.polygons = layer.polygons.unionPolygons(diff);
-            layer.polygons = layer.polygons.smooth(safe_dist);
-            layer.polygons.simplify(safe_dist, safe_dist * safe_dist / 4);
-            // somehow layer.polygons get really jagged lines with a lot of vertices
-            // without the above steps slicing goes really slow
+        return;
+    }
+
+    // Each layer depends on the changed layer above, so the layers are divided into chunks which are processed in parallel,
+    // where the top layer of each chunk is computed from the unchanged layer above.
+    // Afterwards the chunks are fixed up from the top down, until a layer comes out the same as in the parallel pass,
+    // from which point on the rest of the chunk doesn't change either.
+    const unsigned int thread_count = ThreadPool::getThreadCount();
+    const int chunk_layer_count = std::max(1, (layer_count - 1) / static_cast<int>(thread_count)); // the top layer itself doesn't change
+    const int chunk_count = (layer_count - 1 + chunk_layer_count - 1) / chunk_layer_count;
+    std::vector<Polygons> changed_polygons(layer_count - 1);
+    const auto get_layer_above_polygons = [slicer, &changed_polygons, layer_count](int layer_nr, bool changed) -> const Polygons&
+    {
+        return (changed && layer_nr + 1 < layer_count - 1)? changed_polygons[layer_nr + 1] : slicer->layers[layer_nr + 1].polygons;
+    };
+    ThreadPool::parallelFor(0, chunk_count, [&](int chunk_idx)
+    {
+        const int chunk_begin = chunk_idx * chunk_layer_count;
+        const int chunk_end = std::min(layer_count - 1, chunk_begin + chunk_layer_count);
+        changed_polygons[chunk_end - 1] = applyToLayer(slicer->layers[chunk_end - 1].polygons, get_layer_above_polygons(chunk_end - 1, false), max_dist_from_lower_layer);
+        for (int layer_nr = chunk_end - 2; layer_nr >= chunk_begin; layer_nr--)
+        {
+            changed_polygons[layer_nr] = applyToLayer(slicer->layers[layer_nr].polygons, changed_polygons[layer_nr + 1], max_dist_from_lower_layer);
         }
-        else
+    });
+    for (int chunk_idx = chunk_count - 2; chunk_idx >= 0; chunk_idx--)
+    {
+        const int chunk_begin = chunk_idx * chunk_layer_count;
+        const int chunk_end = chunk_begin + chunk_layer_count;
+        for (int layer_nr = chunk_end - 1; layer_nr >= chunk_begin; layer_nr--)
         {
-            layer.polygons = layer.polygons.unionPolygons(layer_above.polygons.offset(-max_dist_from_lower_layer));
+            Polygons fixed_polygons = applyToLayer(slicer->layers[layer_nr].polygons, get_layer_above_polygons(layer_nr, true), max_dist_from_lower_layer);
+            if (fixed_polygons.isIdentical(changed_polygons[layer_nr]))
+            {
+                break;
+            }
+            changed_polygons[layer_nr] = std::move(fixed_polygons);
         }
     }
+
+    for (int layer_nr = 0; layer_nr < layer_count - 1; layer_nr++)
+    {
+        slicer->layers[layer_nr].polygons = std::move(changed_polygons[layer_nr]);
+    }
+}
+
+Polygons ConicalOverhang::applyToLayer(const Polygons& layer_polygons, const Polygons& layer_above_polygons, int max_dist_from_lower_layer)
+{
+    Polygons result;
+    if (std::abs(max_dist_from_lower_layer) < 5)
+    { // magically nothing happens when max_dist_from_lower_layer == 0
+        // below magic code solves that
+        int safe_dist = 20;
+        Polygons diff = layer_above_polygons.difference(layer_polygons.offset(-safe_dist));
+        result = layer_polygons.unionPolygons(diff);
+        result = result.smooth(safe_dist);
+        result.simplify(safe_dist, safe_dist * safe_dist / 4);
+        // somehow layer.polygons get really jagged lines with a lot of vertices
+        // without the above steps slicing goes really slow
+    }
+    else
+    {
+        result = layer_polygons.unionPolygons(layer_above_polygons.offset(-max_dist_from_lower_layer));
+    }
+    return result;
 }
 
 }//namespace cura
@@ -23,6 +23,16 @@ public:
      * \param layer_thickness The general layer thickness
      */
     static void apply(Slicer* slicer, double angle, int layer_thickness);
+private:
+    /*!
+     * Compute the outlines of a single layer, given the already changed outlines of the layer above
+     * 
+     * \param layer_polygons The original outlines of the layer
+     * \param layer_above_polygons The changed outlines of the layer above
+     * \param max_dist_from_lower_layer The maximum distance which can be bridged from one layer to the next
+     * \return The changed outlines of the layer
+     */
+    static Polygons applyToLayer(const Polygons& layer_polygons, const Polygons& layer_above_polygons, int max_dist_from_lower_layer);
 };
 
 }//namespace cura
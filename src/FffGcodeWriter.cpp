@@ -3,17 +3,29 @@
 
 #include <list>
 #include <limits> // numeric_limits
+#include <mutex>
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <fcntl.h> // open
+#include <unistd.h> // fsync, close
+#endif
 
 #include "utils/math.h"
+#include "utils/linearAlg2D.h"
 #include "FffGcodeWriter.h"
 #include "FffProcessor.h"
+#include "MemoryReport.h"
 #include "progress/Progress.h"
+#include "settings/SettingsTrace.h"
 #include "wallOverlap.h"
 #include "utils/orderOptimizer.h"
+#include "utils/Profiler.h"
+#include "utils/ThreadPool.h"
 #include "GcodeLayerThreader.h"
+#include "LayerGCodeQueue.h"
 #include "infill/SpaghettiInfillPathGenerator.h"
 
-#define OMP_MAX_ACTIVE_LAYERS_PROCESSED 30 // TODO: hardcoded-value for the max number of layers being in the pipeline while writing away and destroying layers in a multi-threaded context
+#define OMP_MAX_ACTIVE_LAYERS_PROCESSED 30 // TODO: hardcoded-value for the upper limit on the number of layers being in the pipeline while writing away and destroying layers in a multi-threaded context
+#define LAYER_PLAN_MEMORY_KEPT_BYTES 4000000 // the maximum number of bytes of the memory of a written layer plan kept for the next layers
 
 namespace cura
 {
@@ -21,7 +33,15 @@ namespace cura
 FffGcodeWriter::FffGcodeWriter(SettingsBase* settings_)
 : SettingsMessenger(settings_)
 , max_object_height(0)
+, shard_starts_print(true)
+, shard_ends_print(true)
+, layer_plan_memory_pool(OMP_MAX_ACTIVE_LAYERS_PROCESSED, LAYER_PLAN_MEMORY_KEPT_BYTES)
 , layer_plan_buffer(this, gcode)
+, sync_output_to_disk(false)
+, binary_output_requested(false)
+, flush_each_layer(false)
+, header_position(0)
+, header_reserved_size(0)
 {
     for (unsigned int extruder_nr = 0; extruder_nr < MAX_EXTRUDERS; extruder_nr++)
     { // initialize all as max layer_nr, so that they get updated to the lowest layer on which they are used.
@@ -31,6 +51,9 @@ FffGcodeWriter::FffGcodeWriter(SettingsBase* settings_)
 
 void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keeper)
 {
+    Profiler::Zone zone("writeGCode");
+    SettingsTrace::Stage trace_stage("gcode");
+    ThreadPool::ThreadLimit thread_limit(hasSetting("thread_count_gcode")? std::max(0, getSettingAsCount("thread_count_gcode")) : 0); // stages scale differently, so each can be limited to fewer threads
     gcode.preSetup(storage.meshgroup);
     
     if (FffProcessor::getInstance()->getMeshgroupNr() == 0)
@@ -50,18 +73,10 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
 
     setConfigRetraction(storage);
 
+    setConfigPaths(storage);
+
     layer_plan_buffer.setPreheatConfig(*storage.meshgroup);
     
-    if (FffProcessor::getInstance()->getMeshgroupNr() == 0)
-    {
-        unsigned int start_extruder_nr = getStartExtruder(storage);
-        processStartingCode(storage, start_extruder_nr);
-    }
-    else
-    {
-        processNextMeshGroupCode(storage);
-    }
-
     size_t total_layers = 0;
     for (SliceMeshStorage& mesh : storage.meshes)
     {
@@ -69,8 +84,27 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
 
         setInfillAndSkinAngles(mesh);
     }
-    
-    gcode.writeLayerCountComment(total_layers);
+
+    // the range of layers written when the print is sliced in shards, see processShardStartCode
+    const int shard_layer_start = hasSetting("shard_layer_start")? std::max(0, std::min(static_cast<int>(total_layers), getSettingAsCount("shard_layer_start"))) : 0;
+    const int shard_layer_end = hasSetting("shard_layer_end")? std::max(shard_layer_start, std::min(static_cast<int>(total_layers), getSettingAsCount("shard_layer_end"))) : total_layers;
+    shard_starts_print = shard_layer_start == 0;
+    shard_ends_print = shard_layer_end == static_cast<int>(total_layers);
+
+    if (shard_starts_print) // otherwise the previous shard is continued once the extruder order is known
+    {
+        if (FffProcessor::getInstance()->getMeshgroupNr() == 0)
+        {
+            unsigned int start_extruder_nr = getStartExtruder(storage);
+            processStartingCode(storage, start_extruder_nr);
+        }
+        else
+        {
+            processNextMeshGroupCode(storage);
+        }
+
+        gcode.writeLayerCountComment(total_layers);
+    }
 
     { // calculate the mesh order for each extruder
         int extruder_count = storage.meshgroup->getExtruderCount();
@@ -81,6 +115,12 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
         }
     }
     calculateExtruderOrderPerLayer(storage);
+    if (!shard_starts_print)
+    {
+        processShardStartCode(storage, shard_layer_start);
+    }
+
+    generateSupportPatterns(storage);
 
     if (getSettingBoolean("magic_spiralize"))
     {
@@ -88,10 +128,11 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
     }
 
     int process_layer_starting_layer_nr = 0;
+    int raft_layer_count = 0; // the raft layers are planned along with the other layers, before the filler layers
     bool has_raft = getSettingAsPlatformAdhesion("adhesion_type") == EPlatformAdhesion::RAFT;
-    if (has_raft)
+    if (has_raft && shard_starts_print)
     {
-        processRaft(storage);
+        raft_layer_count = 2 + storage.meshgroup->getExtruderTrain(getSettingAsIndex("adhesion_extruder_nr"))->getSettingAsCount("raft_surface_layers"); // 2: 1 base layer, 1 interface layer
         // process filler layers to fill the airgap with helper object (support etc) so that they stick better to the raft.
         // only process the filler layers if there is anything to print in them.
         for (bool extruder_is_used_in_filler_layers : storage.getExtrudersUsed(-1))
@@ -105,37 +146,100 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
     }
 
 
+    // Layer plans which have been written to gcode are deleted by the producing threads,
+    // so that the single thread consuming the layers in order doesn't spend its time freeing them.
+    std::vector<LayerPlan*> written_layer_plans;
+    std::mutex written_layer_plans_mutex;
+    const std::function<void ()> delete_written_layer_plans =
+        [&written_layer_plans, &written_layer_plans_mutex]()
+        {
+            std::vector<LayerPlan*> to_be_deleted;
+            {
+                std::lock_guard<std::mutex> lock(written_layer_plans_mutex);
+                to_be_deleted.swap(written_layer_plans);
+            }
+            for (LayerPlan* layer_plan : to_be_deleted)
+            {
+                MemoryReport::releaseLayerPlan(*layer_plan);
+                delete layer_plan;
+            }
+        };
+    // The raft layers are numbered below the filler layers, which are skipped when they're empty,
+    // so the first items of the threader are shifted onto the raft layers.
+    const int raft_layer_nr_shift = has_raft? -Raft::getFillerLayerCount(storage) - process_layer_starting_layer_nr : 0;
+    // The layers are written in order by the single thread consuming the layers, which keeps track of the state of the printer,
+    // but the numbers of their moves are converted to text by the producing threads, several layers in parallel, and written in order once converted.
+    // The front end receives the gcode of each layer as it's written, so then the layers are written directly.
+    const bool defer_layer_gcode = !CommandSocket::isInstantiated() && ThreadPool::getThreadCount() > 1;
+    LayerGCodeQueue layer_gcode_queue(*gcode.getOutputStream(), flush_each_layer);
     const std::function<LayerPlan* (int)>& produce_item =
-        [&storage, total_layers, this](int layer_nr)
+        [&storage, total_layers, process_layer_starting_layer_nr, raft_layer_nr_shift, &delete_written_layer_plans, &layer_gcode_queue, this](int layer_nr)
         {
-            LayerPlan& gcode_layer = processLayer(storage, layer_nr, total_layers);
+            Profiler::Zone zone("produceLayer");
+            delete_written_layer_plans();
+            layer_gcode_queue.work();
+            storage.decompressLayerGeometry(layer_nr); // the layers may have been compressed once their areas were generated
+            LayerPlan& gcode_layer = (layer_nr < process_layer_starting_layer_nr)? processRaftLayer(storage, layer_nr + raft_layer_nr_shift) : processLayer(storage, layer_nr, total_layers);
+            gcode_layer.precomputeInfillLineMerges();
+            gcode_layer.precomputeCoastingSplits();
+            MemoryReport::trackLayerPlan(gcode_layer);
             return &gcode_layer;
         };
+    // the progress is messaged from a thread of its own, so that the thread writing the layers in order doesn't wait for the front end
+    Progress::StepCounter export_progress(Progress::Stage::EXPORT, static_cast<int>(total_layers) - process_layer_starting_layer_nr + raft_layer_count);
     const std::function<void (LayerPlan*)>& consume_item =
-        [this, total_layers](LayerPlan* gcode_layer)
+        [&storage, &written_layer_plans, &written_layer_plans_mutex, defer_layer_gcode, &layer_gcode_queue, this, &export_progress](LayerPlan* gcode_layer)
         {
-            Progress::messageProgress(Progress::Stage::EXPORT, std::max(0, gcode_layer->getLayerNr()) + 1, total_layers);
+            Profiler::Zone zone("consumeLayer");
+            export_progress.step();
+            // All layers up to this one have been planned and the layers still being planned only look one layer down.
+            // The travel to the start of this layer is still combed in the plan of the layer below it, using the outlines of that layer,
+            // so only the layer below that one isn't needed anymore.
+            storage.releaseLayerGeometry(gcode_layer->getLayerNr() - 2);
             layer_plan_buffer.push(*gcode_layer);
-            LayerPlan* to_be_written = layer_plan_buffer.processBuffer();
-            if (to_be_written)
+            for (LayerPlan* to_be_written = layer_plan_buffer.processBuffer(); to_be_written; to_be_written = layer_plan_buffer.popLayerToWrite())
             {
-                to_be_written->writeGCode(gcode);
-                delete to_be_written;
+                if (defer_layer_gcode)
+                {
+                    std::unique_ptr<DeferredLayerGCode> layer_gcode(new DeferredLayerGCode());
+                    gcode.beginDeferredLayer(*layer_gcode);
+                    to_be_written->writeGCode(gcode);
+                    gcode.endDeferredLayer();
+                    layer_gcode_queue.push(std::move(layer_gcode));
+                }
+                else
+                {
+                    to_be_written->writeGCode(gcode);
+                    if (flush_each_layer)
+                    {
+                        gcode.flushOutputStream();
+                    }
+                }
+                std::lock_guard<std::mutex> lock(written_layer_plans_mutex);
+                written_layer_plans.push_back(to_be_written);
             }
         };
     const unsigned int max_task_count = OMP_MAX_ACTIVE_LAYERS_PROCESSED;
+    // optionally fewer layers are planned ahead when the layer plans waiting to be written take more than this, in megabytes
+    const int layer_plan_memory_budget = hasSetting("layer_plan_memory_budget")? std::max(0, getSettingAsCount("layer_plan_memory_budget")) : 0;
     GcodeLayerThreader<LayerPlan> threader(
-        process_layer_starting_layer_nr
-        , static_cast<int>(total_layers)
+        shard_starts_print? process_layer_starting_layer_nr - raft_layer_count : shard_layer_start
+        , shard_layer_end
         , produce_item
         , consume_item
         , max_task_count
+        , static_cast<size_t>(layer_plan_memory_budget) * 1000000
+        , [](const LayerPlan* layer_plan) { return layer_plan->getMemoryUsage(); }
     );
 
     // process all layers, process buffer for preheating and minimal layer time etc, write layers to gcode:
     threader.run();
+    layer_gcode_queue.flush();
+    export_progress.finish();
+    delete_written_layer_plans();
 
     layer_plan_buffer.flush();
+    MemoryReport::report("writeGCode", storage);
 
     Progress::messageProgressStage(Progress::Stage::FINISH, &time_keeper);
 
@@ -147,7 +251,7 @@ void FffGcodeWriter::writeGCode(SliceDataStorage& storage, TimeKeeper& time_keep
     gcode.writeRetraction(storage.retraction_config_per_extruder[gcode.getExtruderNr()], force); // retract after finishing each meshgroup
 }
 
-unsigned int FffGcodeWriter::findSpiralizedLayerSeamVertexIndex(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const int layer_nr, const int last_layer_nr)
+unsigned int FffGcodeWriter::findSpiralizedLayerSeamVertexIndex(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const int layer_nr, const int last_layer_nr, const PolygonSegmentGrid& wall_grid)
 {
     const SliceLayer& layer = mesh.layers[layer_nr];
 
@@ -162,7 +266,7 @@ unsigned int FffGcodeWriter::findSpiralizedLayerSeamVertexIndex(const SliceDataS
         {
             seam_pos = Point(mesh.getSettingInMicrons("z_seam_x"), mesh.getSettingInMicrons("z_seam_y"));
         }
-        return PolygonUtils::findClosest(seam_pos, layer.parts[0].insets[0][0]).point_idx;
+        return wall_grid.findClosestSegment(seam_pos);
     }
     else
     {
@@ -177,7 +281,7 @@ unsigned int FffGcodeWriter::findSpiralizedLayerSeamVertexIndex(const SliceDataS
         // seam_vertex_idx is going to be the index of the seam vertex in the current wall polygon
         // initially we choose the vertex that is closest to the seam vertex in the last spiralized layer processed
 
-        int seam_vertex_idx = PolygonUtils::findClosest(last_wall_seam_vertex, wall).point_idx;
+        int seam_vertex_idx = wall_grid.findClosestSegment(last_wall_seam_vertex);
 
         // now we check that the vertex following the seam vertex is to the left of the seam vertex in the last layer
         // and if it isn't, we move forward
@@ -216,19 +320,16 @@ void FffGcodeWriter::findLayerSeamsForSpiralize(SliceDataStorage& storage, size_
 
     // we track the seam position for each layer and ensure that the seam position for next layer continues in the right direction
 
-    storage.spiralize_wall_outlines.reserve(total_layers);
-    storage.spiralize_seam_vertex_indices.reserve(total_layers);
-
-    int last_layer_nr = -1; // layer number of the last non-empty layer processed (for any extruder or mesh)
+    // default is no information available
+    storage.spiralize_wall_outlines.assign(total_layers, nullptr);
+    storage.spiralize_seam_vertex_indices.assign(total_layers, 0);
 
+    // first find the wall of each layer, and the mesh it belongs to
+    std::vector<const SliceMeshStorage*> wall_meshes(total_layers, nullptr);
     for (unsigned layer_nr = 0; layer_nr < total_layers; ++layer_nr)
     {
         bool done_this_layer = false;
 
-        // default is no information available
-        storage.spiralize_wall_outlines[layer_nr] = nullptr;
-        storage.spiralize_seam_vertex_indices[layer_nr] = 0;
-
         // iterate through extruders until we find a mesh that has a part with insets
         const std::vector<unsigned int>& extruder_order = extruder_order_per_layer[layer_nr];
         for (unsigned int extruder_idx = 0; !done_this_layer && extruder_idx < extruder_order.size(); ++extruder_idx)
@@ -246,11 +347,9 @@ void FffGcodeWriter::findLayerSeamsForSpiralize(SliceDataStorage& storage, size_
                     // if the first part in the layer (if any) has insets, process it
                     if (layer.parts.size() != 0 && layer.parts[0].insets.size() != 0)
                     {
-                        // save the seam vertex index for this layer as we need it to determine the seam vertex index for the next layer
-                        storage.spiralize_seam_vertex_indices[layer_nr] = findSpiralizedLayerSeamVertexIndex(storage, mesh, layer_nr, last_layer_nr);
                         // save the wall outline for this layer so it can be used in the spiralize interpolation calculation
                         storage.spiralize_wall_outlines[layer_nr] = &layer.parts[0].insets[0];
-                        last_layer_nr = layer_nr;
+                        wall_meshes[layer_nr] = &mesh;
                         // ignore any further meshes/extruders for this layer
                         done_this_layer = true;
                     }
@@ -258,6 +357,34 @@ void FffGcodeWriter::findLayerSeamsForSpiralize(SliceDataStorage& storage, size_
             }
         }
     }
+
+    // The seam of each layer depends on the seam of the layer below, so the seams are found one layer after the other.
+    // What takes the time is going over all vertices of the walls, which is done in parallel by building a grid over
+    // the segments of each wall, a block of layers at a time so that the grids of only one block are in memory.
+    constexpr int block_size = 64;
+    int last_layer_nr = -1; // layer number of the last non-empty layer processed (for any extruder or mesh)
+    for (int block_start = 0; block_start < static_cast<int>(total_layers); block_start += block_size)
+    {
+        const int block_end = std::min(block_start + block_size, static_cast<int>(total_layers));
+        std::vector<std::unique_ptr<PolygonSegmentGrid>> wall_grids(block_end - block_start);
+        ThreadPool::parallelFor(block_start, block_end, [&](int layer_nr)
+        {
+            if (storage.spiralize_wall_outlines[layer_nr])
+            {
+                wall_grids[layer_nr - block_start].reset(new PolygonSegmentGrid((*storage.spiralize_wall_outlines[layer_nr])[0]));
+            }
+        });
+        for (int layer_nr = block_start; layer_nr < block_end; ++layer_nr)
+        {
+            if (!wall_meshes[layer_nr])
+            {
+                continue;
+            }
+            // save the seam vertex index for this layer as we need it to determine the seam vertex index for the next layer
+            storage.spiralize_seam_vertex_indices[layer_nr] = findSpiralizedLayerSeamVertexIndex(storage, *wall_meshes[layer_nr], layer_nr, last_layer_nr, *wall_grids[layer_nr - block_start]);
+            last_layer_nr = layer_nr;
+        }
+    }
 }
 
 void FffGcodeWriter::setConfigFanSpeedLayerTime(SliceDataStorage& storage)
@@ -297,6 +424,13 @@ void FffGcodeWriter::setConfigCoasting(SliceDataStorage& storage)
     }
 }
 
+void FffGcodeWriter::setConfigPaths(SliceDataStorage& storage)
+{
+    // a layer after the initial layers, so that the speeds aren't slowed down yet
+    const int layer_nr = std::max(0, storage.getSettingAsCount("speed_slowdown_layers"));
+    storage.path_configs.reset(new PathConfigStorage(storage, layer_nr, storage.getSettingInMicrons("layer_height")));
+}
+
 void FffGcodeWriter::setConfigRetraction(SliceDataStorage& storage) 
 {
     int extruder_count = storage.meshgroup->getExtruderCount();
@@ -382,7 +516,35 @@ void FffGcodeWriter::processStartingCode(const SliceDataStorage& storage, const
     {
         std::vector<bool> extruder_is_used = storage.getExtrudersUsed();
         std::string prefix = gcode.getFileHeader(extruder_is_used);
-        gcode.writeCode(prefix.c_str());
+        header_reserved_size = 0;
+        if (flush_each_layer && output_file.is_open() && !binary_encoder)
+        { // reserve room for the final estimates, which are longer than the placeholders, if the file is seekable
+            gcode.flushOutputStream(); // so that the file position is where the header starts
+#ifdef GZIP
+            if (gzip_output_buffer)
+            { // the header gets a gzip member of its own
+                gzip_output_buffer->finishMember();
+            }
+#endif
+            header_position = output_file.tellp();
+            if (header_position != std::streampos(-1))
+            {
+                constexpr size_t header_room = 512;
+                prefix = gcode.padFileHeader(prefix, prefix.size() + header_room);
+                header_reserved_size = prefix.size();
+            }
+        }
+        const std::string stored_header = (header_reserved_size > 0)? storedFileHeader(prefix) : std::string();
+        if (!stored_header.empty())
+        { // written to the file directly, as it's overwritten in finalize
+            output_file.write(stored_header.data(), stored_header.size());
+            gcode.writeCode(""); // the new line ending the header
+        }
+        else
+        {
+            header_reserved_size = 0;
+            gcode.writeCode(prefix.c_str());
+        }
     }
 
     gcode.writeComment("Generated with Cura_SteamEngine " VERSION);
@@ -445,6 +607,21 @@ void FffGcodeWriter::processStartingCode(const SliceDataStorage& storage, const
     }
 }
 
+void FffGcodeWriter::processShardStartCode(const SliceDataStorage& storage, int layer_nr)
+{
+    gcode.writeComment("Continuing the shard ending at layer " + std::to_string(layer_nr - 1));
+    const unsigned int extruder_nr = extruder_order_per_layer[layer_nr - 1].back();
+    gcode.startShard(extruder_nr, storage.retraction_config_per_extruder[extruder_nr]);
+    const std::vector<bool> extruder_is_used = storage.getExtrudersUsed();
+    for (int extr_nr = 0; extr_nr < storage.meshgroup->getExtruderCount(); extr_nr++)
+    { // already reached in the previous shards, but written so that the temperature commands of the layers follow on from them
+        if (extruder_is_used[extr_nr])
+        {
+            gcode.writeTemperatureCommand(extr_nr, storage.meshgroup->getExtruderTrain(extr_nr)->getSettingInDegreeCelsius("material_print_temperature"));
+        }
+    }
+}
+
 void FffGcodeWriter::processNextMeshGroupCode(const SliceDataStorage& storage)
 {
     gcode.writeFanCommand(0);
@@ -463,17 +640,13 @@ void FffGcodeWriter::processNextMeshGroupCode(const SliceDataStorage& storage)
     gcode.writeTravel(start_pos, storage.meshgroup->getExtruderTrain(gcode.getExtruderNr())->getSettingInMillimetersPerSecond("speed_travel"));
 }
     
-void FffGcodeWriter::processRaft(const SliceDataStorage& storage)
+LayerPlan& FffGcodeWriter::processRaftLayer(const SliceDataStorage& storage, int layer_nr) const
 {
     int extruder_nr = getSettingAsIndex("adhesion_extruder_nr");
     ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extruder_nr);
     
     CombingMode combing_mode = storage.getSettingAsCombingMode("retraction_combing"); 
 
-    int z = 0;
-    
-
-
     const int initial_raft_layer_nr = -Raft::getTotalExtraLayers(storage);
 
     // some infill config for all lines infill generation below
@@ -482,12 +655,10 @@ void FffGcodeWriter::processRaft(const SliceDataStorage& storage)
     int extra_infill_shift = 0;
     Polygons raft_polygons; // should remain empty, since we only have the lines pattern for the raft...
 
-    unsigned int current_extruder_nr = extruder_nr;
-
+    if (layer_nr == initial_raft_layer_nr)
     { // raft base layer
-        int layer_nr = initial_raft_layer_nr;
         int layer_height = train->getSettingInMicrons("raft_base_thickness");
-        z += layer_height;
+        int z = layer_height;
         int64_t comb_offset = train->getSettingInMicrons("raft_base_line_spacing");
 
         std::vector<FanSpeedLayerTimeSettings> fan_speed_layer_time_settings_per_extruder_raft_base = fan_speed_layer_time_settings_per_extruder; // copy so that we change only the local copy
@@ -498,15 +669,12 @@ void FffGcodeWriter::processRaft(const SliceDataStorage& storage)
             fan_speed_layer_time_settings.cool_fan_speed_0 = regular_fan_speed; // ignore initial layer fan speed stuff
         }
 
-        LayerPlan& gcode_layer = *new LayerPlan(storage, layer_nr, z, layer_height, extruder_nr, fan_speed_layer_time_settings_per_extruder_raft_base, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"));
+        LayerPlan& gcode_layer = *new LayerPlan(storage, layer_nr, z, layer_height, extruder_nr, fan_speed_layer_time_settings_per_extruder_raft_base, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"), layer_plan_memory_pool);
         gcode_layer.setIsInside(true);
 
         gcode_layer.setExtruder(extruder_nr);
 
-        if (CommandSocket::isInstantiated())
-        {
-            CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, z, layer_height);
-        }
+        sendLayerInfo(layer_nr, z, layer_height);
 
         Polygons wall = storage.raftOutline.offset(-gcode_layer.configs_storage.raft_base_config.getLineWidth() / 2);
         gcode_layer.addPolygonsByOptimizer(wall, &gcode_layer.configs_storage.raft_base_config);
@@ -523,16 +691,15 @@ void FffGcodeWriter::processRaft(const SliceDataStorage& storage)
         for (unsigned int to_be_primed_extruder_nr : extruder_order)
         {
             setExtruder_addPrime(storage, gcode_layer, layer_nr, to_be_primed_extruder_nr);
-            current_extruder_nr = to_be_primed_extruder_nr;
         }
 
-        layer_plan_buffer.handle(gcode_layer, gcode);
+        return gcode_layer;
     }
 
+    if (layer_nr == initial_raft_layer_nr + 1)
     { // raft interface layer
-        int layer_nr = initial_raft_layer_nr + 1;
         int layer_height = train->getSettingInMicrons("raft_interface_thickness");
-        z += layer_height;
+        int z = train->getSettingInMicrons("raft_base_thickness") + layer_height;
         int64_t comb_offset = train->getSettingInMicrons("raft_interface_line_spacing");
 
         std::vector<FanSpeedLayerTimeSettings> fan_speed_layer_time_settings_per_extruder_raft_interface = fan_speed_layer_time_settings_per_extruder; // copy so that we change only the local copy
@@ -543,16 +710,16 @@ void FffGcodeWriter::processRaft(const SliceDataStorage& storage)
             fan_speed_layer_time_settings.cool_fan_speed_0 = regular_fan_speed; // ignore initial layer fan speed stuff
         }
 
-        LayerPlan& gcode_layer = *new LayerPlan(storage, layer_nr, z, layer_height, current_extruder_nr, fan_speed_layer_time_settings_per_extruder_raft_interface, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"));
+        // the base layer ends with the last extruder it primed
+        const std::vector<unsigned int> primed_extruder_order = getUsedExtrudersOnLayerExcludingStartingExtruder(storage, extruder_nr, initial_raft_layer_nr);
+        const unsigned int previous_extruder_nr = primed_extruder_order.empty()? extruder_nr : primed_extruder_order.back();
+
+        LayerPlan& gcode_layer = *new LayerPlan(storage, layer_nr, z, layer_height, previous_extruder_nr, fan_speed_layer_time_settings_per_extruder_raft_interface, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"), layer_plan_memory_pool);
         gcode_layer.setIsInside(true);
 
         gcode_layer.setExtruder(extruder_nr); // reset to extruder number, because we might have primed in the last layer
-        current_extruder_nr = extruder_nr;
 
-        if (CommandSocket::isInstantiated())
-        {
-            CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, z, layer_height);
-        }
+        sendLayerInfo(layer_nr, z, layer_height);
 
         Polygons raftLines;
         int offset_from_poly_outline = 0;
@@ -561,15 +728,14 @@ void FffGcodeWriter::processRaft(const SliceDataStorage& storage)
         infill_comp.generate(raft_polygons, raftLines);
         gcode_layer.addLinesByOptimizer(raftLines, &gcode_layer.configs_storage.raft_interface_config, SpaceFillType::Lines);
 
-        layer_plan_buffer.handle(gcode_layer, gcode);
+        return gcode_layer;
     }
     
-    int layer_height = train->getSettingInMicrons("raft_surface_thickness");
-
-    for (int raftSurfaceLayer = 1; raftSurfaceLayer <= train->getSettingAsCount("raft_surface_layers"); raftSurfaceLayer++)
     { // raft surface layers
-        const int layer_nr = initial_raft_layer_nr + 2 + raftSurfaceLayer - 1; // 2: 1 base layer, 1 interface layer
-        z += layer_height;
+        const int raftSurfaceLayer = layer_nr - initial_raft_layer_nr - 1; // 1: 1 base layer, 1 interface layer, and the surface layers are counted from 1
+        assert(raftSurfaceLayer >= 1 && raftSurfaceLayer <= train->getSettingAsCount("raft_surface_layers"));
+        const int layer_height = train->getSettingInMicrons("raft_surface_thickness");
+        const int z = train->getSettingInMicrons("raft_base_thickness") + train->getSettingInMicrons("raft_interface_thickness") + raftSurfaceLayer * layer_height;
         const int64_t comb_offset = train->getSettingInMicrons("raft_surface_line_spacing");
 
         std::vector<FanSpeedLayerTimeSettings> fan_speed_layer_time_settings_per_extruder_raft_surface = fan_speed_layer_time_settings_per_extruder; // copy so that we change only the local copy
@@ -580,17 +746,13 @@ void FffGcodeWriter::processRaft(const SliceDataStorage& storage)
             fan_speed_layer_time_settings.cool_fan_speed_0 = regular_fan_speed; // ignore initial layer fan speed stuff
         }
 
-        LayerPlan& gcode_layer = *new LayerPlan(storage, layer_nr, z, layer_height, extruder_nr, fan_speed_layer_time_settings_per_extruder_raft_surface, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"));
+        LayerPlan& gcode_layer = *new LayerPlan(storage, layer_nr, z, layer_height, extruder_nr, fan_speed_layer_time_settings_per_extruder_raft_surface, combing_mode, comb_offset, train->getSettingBoolean("travel_avoid_other_parts"), train->getSettingInMicrons("travel_avoid_distance"), layer_plan_memory_pool);
         gcode_layer.setIsInside(true);
 
         // make sure that we are using the correct extruder to print raft
         gcode_layer.setExtruder(extruder_nr);
-        current_extruder_nr = extruder_nr;
 
-        if (CommandSocket::isInstantiated())
-        {
-            CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, z, layer_height);
-        }
+        sendLayerInfo(layer_nr, z, layer_height);
         
         Polygons raft_lines;
         int offset_from_poly_outline = 0;
@@ -599,7 +761,17 @@ void FffGcodeWriter::processRaft(const SliceDataStorage& storage)
         infill_comp.generate(raft_polygons, raft_lines);
         gcode_layer.addLinesByOptimizer(raft_lines, &gcode_layer.configs_storage.raft_surface_config, SpaceFillType::Lines);
 
-        layer_plan_buffer.handle(gcode_layer, gcode);
+        return gcode_layer;
+    }
+}
+
+void FffGcodeWriter::sendLayerInfo(int layer_nr, int64_t z, int layer_thickness) const
+{
+    if (CommandSocket::isInstantiated())
+    {
+        static std::mutex send_layer_info_mutex;
+        std::lock_guard<std::mutex> send_layer_info_lock(send_layer_info_mutex);
+        CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, z, layer_thickness);
     }
 }
 
@@ -621,6 +793,10 @@ LayerPlan& FffGcodeWriter::processLayer(const SliceDataStorage& storage, int lay
     }
     else
     {
+        if (layer_nr < static_cast<int>(storage.layer_thicknesses.size()))
+        { // the thickness varies with adaptive layer heights
+            layer_thickness = storage.layer_thicknesses[layer_nr];
+        }
         z = storage.meshes[0].layers[layer_nr].printZ; // stub default
         // find printZ of first actual printed mesh
         for (const SliceMeshStorage& mesh : storage.meshes)
@@ -645,11 +821,7 @@ LayerPlan& FffGcodeWriter::processLayer(const SliceDataStorage& storage, int lay
         }
     }
 
-    if (CommandSocket::isInstantiated())
-    {
-#pragma omp critical
-        CommandSocket::getInstance()->sendOptimizedLayerInfo(layer_nr, z, layer_thickness);
-    }
+    sendLayerInfo(layer_nr, z, layer_thickness);
 
     bool avoid_other_parts = false;
     coord_t avoid_distance = 0; // minimal avoid distance is zero
@@ -682,7 +854,7 @@ LayerPlan& FffGcodeWriter::processLayer(const SliceDataStorage& storage, int lay
         :
         extruder_order_per_layer[layer_nr];
 
-    LayerPlan& gcode_layer = *new LayerPlan(storage, layer_nr, z, layer_thickness, extruder_order.front(), fan_speed_layer_time_settings_per_extruder, getSettingAsCombingMode("retraction_combing"), comb_offset_from_outlines, avoid_other_parts, avoid_distance);
+    LayerPlan& gcode_layer = *new LayerPlan(storage, layer_nr, z, layer_thickness, extruder_order.front(), fan_speed_layer_time_settings_per_extruder, getSettingAsCombingMode("retraction_combing"), comb_offset_from_outlines, avoid_other_parts, avoid_distance, layer_plan_memory_pool);
 
     if (include_helper_parts && layer_nr == 0)
     { // process the skirt or the brim of the starting extruder.
@@ -703,6 +875,8 @@ LayerPlan& FffGcodeWriter::processLayer(const SliceDataStorage& storage, int lay
     const unsigned int support_bottom_extruder_nr = getSettingAsIndex("support_bottom_extruder_nr");
     const unsigned int support_infill_extruder_nr = (layer_nr <= 0)? getSettingAsIndex("support_extruder_nr_layer_0") : getSettingAsIndex("support_infill_extruder_nr");
 
+    const bool optimize_layer_part_order = hasSetting("optimize_layer_part_order") && getSettingBoolean("optimize_layer_part_order");
+
     for (unsigned int extruder_nr : extruder_order)
     {
         if (include_helper_parts
@@ -711,7 +885,11 @@ LayerPlan& FffGcodeWriter::processLayer(const SliceDataStorage& storage, int lay
             addSupportToGCode(storage, gcode_layer, layer_nr, extruder_nr);
         }
 
-        if (layer_nr >= 0)
+        if (layer_nr >= 0 && optimize_layer_part_order)
+        {
+            addMeshLayersToGCodeInTravelOrder(storage, mesh_order_per_extruder[extruder_nr], extruder_nr, gcode_layer, layer_nr);
+        }
+        else if (layer_nr >= 0)
         {
             const std::vector<unsigned int>& mesh_order = mesh_order_per_extruder[extruder_nr];
             for (unsigned int mesh_idx : mesh_order)
@@ -839,21 +1017,72 @@ void FffGcodeWriter::calculateExtruderOrderPerLayer(const SliceDataStorage& stor
     {
         last_extruder = gcode.getExtruderNr();
     }
-    for (int layer_nr = -Raft::getTotalExtraLayers(storage); layer_nr < static_cast<int>(storage.print_layer_count); layer_nr++)
+    const int first_layer_nr = -Raft::getTotalExtraLayers(storage);
+    const unsigned int layer_count = static_cast<int>(storage.print_layer_count) - first_layer_nr;
+    const unsigned int extruder_count = storage.getSettingAsCount("machine_extruder_count");
+    assert(static_cast<int>(extruder_count) > 0);
+    std::vector<std::vector<bool>> extruders_used_per_layer(layer_count);
+    for (unsigned int layer_idx = 0; layer_idx < layer_count; layer_idx++)
     {
+        extruders_used_per_layer[layer_idx] = getExtrudersUsedOnLayer(storage, first_layer_nr + layer_idx);
+    }
+
+    // Each layer starts with the extruder the layer below ended with, so the only choice is which of the other extruders of a layer goes last.
+    // A layer costs an extruder switch fewer when it's started with an extruder used on it,
+    // so going down from the top we compute for each extruder the most layers above which can start with a used extruder
+    // when the layer is started with that extruder, and which extruder to end the layer with to get that.
+    // Ties are broken towards the highest extruder number, which is the one that would go last without looking ahead.
+    std::vector<unsigned int> used_starts_above(extruder_count, 0); //!< Per start extruder of the layer below the current one: the most layers from there up which can start with a used extruder
+    std::vector<std::vector<unsigned int>> best_last_extruder(layer_count, std::vector<unsigned int>(extruder_count)); //!< Per layer and per start extruder of that layer: which extruder to end it with
+    for (unsigned int layer_idx = layer_count; layer_idx-- > 0; )
+    {
+        const std::vector<bool>& used = extruders_used_per_layer[layer_idx];
+        std::vector<unsigned int> used_starts(extruder_count);
+        for (unsigned int start_extruder = 0; start_extruder < extruder_count; start_extruder++)
+        {
+            unsigned int best = start_extruder; // if no other extruder is used, the layer ends with the extruder it started with
+            bool other_used = false;
+            for (unsigned int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
+            {
+                if (extruder_nr != start_extruder && used[extruder_nr] && (!other_used || used_starts_above[extruder_nr] >= used_starts_above[best]))
+                {
+                    best = extruder_nr;
+                    other_used = true;
+                }
+            }
+            best_last_extruder[layer_idx][start_extruder] = best;
+            used_starts[start_extruder] = (used[start_extruder] ? 1 : 0) + used_starts_above[best];
+        }
+        used_starts_above.swap(used_starts);
+    }
+
+    for (unsigned int layer_idx = 0; layer_idx < layer_count; layer_idx++)
+    {
+        const int layer_nr = first_layer_nr + layer_idx;
+        const std::vector<bool>& used = extruders_used_per_layer[layer_idx];
+        const unsigned int end_extruder = best_last_extruder[layer_idx][last_extruder];
+        std::vector<unsigned int> extruder_order;
+        extruder_order.push_back(last_extruder);
+        for (unsigned int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
+        {
+            if (extruder_nr != last_extruder && extruder_nr != end_extruder && used[extruder_nr])
+            {
+                extruder_order.push_back(extruder_nr);
+            }
+        }
+        if (end_extruder != last_extruder)
+        {
+            extruder_order.push_back(end_extruder);
+        }
         std::vector<std::vector<unsigned int>>& extruder_order_per_layer_here = (layer_nr < 0)? extruder_order_per_layer_negative_layers : extruder_order_per_layer;
-        extruder_order_per_layer_here.push_back(getUsedExtrudersOnLayerExcludingStartingExtruder(storage, last_extruder, layer_nr));
-        last_extruder = extruder_order_per_layer_here.back().back();
+        extruder_order_per_layer_here.push_back(extruder_order);
+        last_extruder = end_extruder;
         extruder_prime_layer_nr[last_extruder] = std::min(extruder_prime_layer_nr[last_extruder], layer_nr);
     }
 }
 
-std::vector<unsigned int> FffGcodeWriter::getUsedExtrudersOnLayerExcludingStartingExtruder(const SliceDataStorage& storage, const unsigned int start_extruder, const int layer_nr) const
+std::vector<bool> FffGcodeWriter::getExtrudersUsedOnLayer(const SliceDataStorage& storage, const int layer_nr) const
 {
-    unsigned int extruder_count = storage.getSettingAsCount("machine_extruder_count");
-    assert(static_cast<int>(extruder_count) > 0);
-    std::vector<unsigned int> ret;
-    ret.push_back(start_extruder);
     std::vector<bool> extruder_is_used_on_this_layer = storage.getExtrudersUsed(layer_nr);
     
     // check if we are on the first layer
@@ -869,6 +1098,16 @@ std::vector<unsigned int> FffGcodeWriter::getUsedExtrudersOnLayerExcludingStarti
             }
         }
     }
+    return extruder_is_used_on_this_layer;
+}
+
+std::vector<unsigned int> FffGcodeWriter::getUsedExtrudersOnLayerExcludingStartingExtruder(const SliceDataStorage& storage, const unsigned int start_extruder, const int layer_nr) const
+{
+    unsigned int extruder_count = storage.getSettingAsCount("machine_extruder_count");
+    assert(static_cast<int>(extruder_count) > 0);
+    std::vector<unsigned int> ret;
+    ret.push_back(start_extruder);
+    std::vector<bool> extruder_is_used_on_this_layer = getExtrudersUsedOnLayer(storage, layer_nr);
 
     for (unsigned int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
     {
@@ -1014,6 +1253,11 @@ void FffGcodeWriter::addMeshLayerToGCode(const SliceDataStorage& storage, const
     Point z_seam_pos(mesh->getSettingInMicrons("z_seam_x"), mesh->getSettingInMicrons("z_seam_y"));
     Point layer_start_position = Point(train->getSettingInMicrons("layer_start_x"), train->getSettingInMicrons("layer_start_y"));
     PathOrderOptimizer part_order_optimizer(layer_start_position, z_seam_pos, z_seam_type);
+    part_order_optimizer.random_seed = layer_nr;
+    if (mesh->hasSetting("part_order_two_opt_evaluations"))
+    { // optionally improve the greedy order of layers with many islands, bounded by a number of evaluations so that the order doesn't depend on timing
+        part_order_optimizer.two_opt_max_evaluations = std::max(0, mesh->getSettingAsCount("part_order_two_opt_evaluations"));
+    }
     for(unsigned int partNr=0; partNr<layer->parts.size(); partNr++)
     {
         part_order_optimizer.addPolygon(layer->parts[partNr].insets[0][0]);
@@ -1031,6 +1275,55 @@ void FffGcodeWriter::addMeshLayerToGCode(const SliceDataStorage& storage, const
     }
 }
 
+void FffGcodeWriter::addMeshLayersToGCodeInTravelOrder(const SliceDataStorage& storage, const std::vector<unsigned int>& mesh_order, const int extruder_nr, LayerPlan& gcode_layer, int layer_nr) const
+{
+    constexpr unsigned int two_opt_max_evaluations = 100000; // limits the time spent on improving the order; about one pass for 450 parts
+
+    PathOrderOptimizer part_order_optimizer(gcode_layer.getLastPosition());
+    part_order_optimizer.two_opt_max_evaluations = two_opt_max_evaluations;
+    std::vector<std::pair<unsigned int, unsigned int>> mesh_and_part_indices; // for each polygon in the part_order_optimizer
+    for (unsigned int mesh_idx : mesh_order)
+    {
+        const SliceMeshStorage* mesh = &storage.meshes[mesh_idx];
+        if (mesh->getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::SURFACE)
+        {
+            assert(static_cast<int>(extruder_nr) == mesh->getSettingAsExtruderNr("wall_0_extruder_nr") && "mesh surface mode should always only be printed with the outer wall extruder!");
+            addMeshLayerToGCode_meshSurfaceMode(storage, mesh, gcode_layer.configs_storage.mesh_configs[mesh_idx], gcode_layer, layer_nr);
+            continue;
+        }
+        if (layer_nr > mesh->layer_nr_max_filled_layer || mesh->getSettingBoolean("anti_overhang_mesh") || mesh->getSettingBoolean("support_mesh"))
+        {
+            continue;
+        }
+        const SliceLayer& layer = mesh->layers[layer_nr];
+        for (unsigned int part_idx = 0; part_idx < layer.parts.size(); part_idx++)
+        {
+            part_order_optimizer.addPolygon(layer.parts[part_idx].insets[0][0]);
+            mesh_and_part_indices.emplace_back(mesh_idx, part_idx);
+        }
+    }
+    part_order_optimizer.optimize();
+
+    for (int order_idx : part_order_optimizer.polyOrder)
+    {
+        const unsigned int mesh_idx = mesh_and_part_indices[order_idx].first;
+        const SliceMeshStorage* mesh = &storage.meshes[mesh_idx];
+        const SliceLayerPart& part = mesh->layers[layer_nr].parts[mesh_and_part_indices[order_idx].second];
+        addMeshPartToGCode(storage, mesh, extruder_nr, gcode_layer.configs_storage.mesh_configs[mesh_idx], part, gcode_layer, layer_nr);
+    }
+
+    for (unsigned int mesh_idx : mesh_order)
+    {
+        const SliceMeshStorage* mesh = &storage.meshes[mesh_idx];
+        if (layer_nr <= mesh->layer_nr_max_filled_layer && !mesh->layers[layer_nr].parts.empty()
+            && mesh->getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::BOTH && extruder_nr == mesh->getSettingAsExtruderNr("wall_0_extruder_nr")
+            && !mesh->getSettingBoolean("anti_overhang_mesh") && !mesh->getSettingBoolean("support_mesh"))
+        {
+            addMeshOpenPolyLinesToGCode(mesh, gcode_layer.configs_storage.mesh_configs[mesh_idx], gcode_layer, layer_nr);
+        }
+    }
+}
+
 void FffGcodeWriter::addMeshPartToGCode(const SliceDataStorage& storage, const SliceMeshStorage* mesh, const int extruder_nr, const PathConfigStorage::MeshPathConfigs& mesh_config, const SliceLayerPart& part, LayerPlan& gcode_layer, int layer_nr) const
 {
     bool skin_alternate_rotation = mesh->getSettingBoolean("skin_alternate_rotation") && ( mesh->getSettingAsCount("top_layers") >= 4 || mesh->getSettingAsCount("bottom_layers") >= 4 );
@@ -1038,7 +1331,7 @@ void FffGcodeWriter::addMeshPartToGCode(const SliceDataStorage& storage, const S
     int infill_angle = 45; // original default, this will get updated to an element from mesh->infill_angles
     if (mesh->infill_angles.size() > 0)
     {
-        unsigned int combined_infill_layers = std::max(1U, round_divide(mesh->getSettingInMicrons("infill_sparse_thickness"), std::max(getSettingInMicrons("layer_height"), (coord_t)1)));
+        unsigned int combined_infill_layers = std::max(1U, round_divide(mesh->getSettingInMicrons("infill_sparse_thickness"), storage.getMaxLayerThickness())); // as in SliceMeshStorage::resolveLayerSettings
         infill_angle = mesh->infill_angles.at((layer_nr / combined_infill_layers) % mesh->infill_angles.size());
     }
     
@@ -1073,7 +1366,7 @@ void FffGcodeWriter::addMeshPartToGCode(const SliceDataStorage& storage, const S
     added_something = added_something | processSkinAndPerimeterGaps(storage, gcode_layer, mesh, extruder_nr, mesh_config, part, layer_nr, skin_overlap, skin_angle);
 
     //After a layer part, make sure the nozzle is inside the comb boundary, so we do not retract on the perimeter.
-    if (added_something && (!getSettingBoolean("magic_spiralize") || static_cast<int>(layer_nr) < mesh->getSettingAsCount("bottom_layers")))
+    if (added_something && (!getSettingBoolean("magic_spiralize") || static_cast<int>(layer_nr) < storage.convertLayerCount(mesh->getSettingAsCount("bottom_layers"))))
     {
         gcode_layer.moveInsideCombBoundary(mesh->getSettingInMicrons((mesh->getSettingAsCount("wall_line_count") > 1) ? "wall_line_width_x" : "wall_line_width_0") * 1);
     }
@@ -1261,7 +1554,7 @@ bool FffGcodeWriter::processInsets(const SliceDataStorage& storage, LayerPlan& g
                 // nothing to do
                 return false;
             }
-            const unsigned bottom_layers = mesh->getSettingAsCount("bottom_layers");
+            const unsigned bottom_layers = storage.convertLayerCount(mesh->getSettingAsCount("bottom_layers"));
             if (layer_nr >= bottom_layers)
             {
                 spiralize = true;
@@ -1293,52 +1586,59 @@ bool FffGcodeWriter::processInsets(const SliceDataStorage& storage, LayerPlan& g
         {
             const bool outer_inset_first = mesh->getSettingBoolean("outer_inset_first")
                                             || (layer_nr == 0 && mesh->getSettingAsPlatformAdhesion("adhesion_type") == EPlatformAdhesion::BRIM);
-            int processed_inset_number = -1;
-            for (int inset_number = part.insets.size() - 1; inset_number > -1; inset_number--)
+            // The overlap of the walls is computed over all polygons of an inset, also when these are printed in separate groups.
+            std::vector<std::unique_ptr<WallOverlapComputation>> wall_overlap_computations(part.insets.size());
+            for (unsigned int inset_number = 0; inset_number < part.insets.size(); inset_number++)
             {
-                processed_inset_number = inset_number;
-                if (outer_inset_first)
+                if ((inset_number == 0)? (compensate_overlap_0 && extruder_nr == mesh->getSettingAsExtruderNr("wall_0_extruder_nr")) : (compensate_overlap_x && extruder_nr == mesh->getSettingAsExtruderNr("wall_x_extruder_nr")))
                 {
-                    processed_inset_number = part.insets.size() - 1 - inset_number;
+                    wall_overlap_computations[inset_number].reset(new WallOverlapComputation(part.insets[inset_number], mesh->getSettingInMicrons((inset_number == 0)? "wall_line_width_0" : "wall_line_width_x")));
                 }
-                if (processed_inset_number == 0)
+            }
+            const std::vector<std::vector<Polygons>> insets_per_group = groupInsetsPerOuterWallPolygon(part.insets, mesh->getSettingInMicrons("wall_line_width_0") + static_cast<coord_t>(part.insets.size()) * mesh->getSettingInMicrons("wall_line_width_x"));
+            std::vector<int> group_order(1, 0); // the insets of the part as a whole if there are no groups
+            if (!insets_per_group.empty())
+            { // print the groups in the order of their outer wall polygons
+                PathOrderOptimizer group_order_optimizer(gcode_layer.getLastPosition());
+                for (const std::vector<Polygons>& group_insets : insets_per_group)
                 {
-                    constexpr bool spiralize = false;
-                    constexpr float flow = 1.0;
-                    if (part.insets[0].size() > 0 && extruder_nr == mesh->getSettingAsExtruderNr("wall_0_extruder_nr"))
-                    {
-                        added_something = true;
-                        setExtruder_addPrime(storage, gcode_layer, layer_nr, extruder_nr);
-                        gcode_layer.setIsInside(true); // going to print stuff inside print object
-                        if (!compensate_overlap_0)
-                        {
-                            WallOverlapComputation* wall_overlap_computation(nullptr);
-                            gcode_layer.addPolygonsByOptimizer(part.insets[0], &mesh_config.inset0_config, wall_overlap_computation, z_seam_type, z_seam_pos, mesh->getSettingInMicrons("wall_0_wipe_dist"), spiralize, flow, retract_before_outer_wall);
-                        }
-                        else
-                        {
-                            Polygons outer_wall = part.insets[0];
-                            WallOverlapComputation wall_overlap_computation(outer_wall, mesh->getSettingInMicrons("wall_line_width_0"));
-                            gcode_layer.addPolygonsByOptimizer(outer_wall, &mesh_config.inset0_config, &wall_overlap_computation, z_seam_type, z_seam_pos, mesh->getSettingInMicrons("wall_0_wipe_dist"), spiralize, flow, retract_before_outer_wall);
-                        }
-                    }
+                    group_order_optimizer.addPolygon(group_insets[0][0]);
                 }
-                else
+                group_order_optimizer.optimize();
+                group_order = group_order_optimizer.polyOrder;
+            }
+            for (int group_idx : group_order)
+            {
+                const std::vector<Polygons>& insets = insets_per_group.empty()? part.insets : insets_per_group[group_idx];
+                int processed_inset_number = -1;
+                for (int inset_number = insets.size() - 1; inset_number > -1; inset_number--)
                 {
-                    if (part.insets[processed_inset_number].size() > 0 && extruder_nr == mesh->getSettingAsExtruderNr("wall_x_extruder_nr"))
+                    processed_inset_number = inset_number;
+                    if (outer_inset_first)
+                    {
+                        processed_inset_number = insets.size() - 1 - inset_number;
+                    }
+                    WallOverlapComputation* wall_overlap_computation = wall_overlap_computations[processed_inset_number].get();
+                    if (processed_inset_number == 0)
                     {
-                        added_something = true;
-                        setExtruder_addPrime(storage, gcode_layer, layer_nr, extruder_nr);
-                        gcode_layer.setIsInside(true); // going to print stuff inside print object
-                        if (!compensate_overlap_x)
+                        constexpr bool spiralize = false;
+                        constexpr float flow = 1.0;
+                        if (insets[0].size() > 0 && extruder_nr == mesh->getSettingAsExtruderNr("wall_0_extruder_nr"))
                         {
-                            gcode_layer.addPolygonsByOptimizer(part.insets[processed_inset_number], &mesh_config.insetX_config);
+                            added_something = true;
+                            setExtruder_addPrime(storage, gcode_layer, layer_nr, extruder_nr);
+                            gcode_layer.setIsInside(true); // going to print stuff inside print object
+                            gcode_layer.addPolygonsByOptimizer(insets[0], &mesh_config.inset0_config, wall_overlap_computation, z_seam_type, z_seam_pos, mesh->getSettingInMicrons("wall_0_wipe_dist"), spiralize, flow, retract_before_outer_wall);
                         }
-                        else
+                    }
+                    else
+                    {
+                        if (insets[processed_inset_number].size() > 0 && extruder_nr == mesh->getSettingAsExtruderNr("wall_x_extruder_nr"))
                         {
-                            Polygons outer_wall = part.insets[processed_inset_number];
-                            WallOverlapComputation wall_overlap_computation(outer_wall, mesh->getSettingInMicrons("wall_line_width_x"));
-                            gcode_layer.addPolygonsByOptimizer(outer_wall, &mesh_config.insetX_config, &wall_overlap_computation);
+                            added_something = true;
+                            setExtruder_addPrime(storage, gcode_layer, layer_nr, extruder_nr);
+                            gcode_layer.setIsInside(true); // going to print stuff inside print object
+                            gcode_layer.addPolygonsByOptimizer(insets[processed_inset_number], &mesh_config.insetX_config, wall_overlap_computation);
                         }
                     }
                 }
@@ -1349,6 +1649,58 @@ bool FffGcodeWriter::processInsets(const SliceDataStorage& storage, LayerPlan& g
 }
 
 
+std::vector<std::vector<Polygons>> FffGcodeWriter::groupInsetsPerOuterWallPolygon(const std::vector<Polygons>& insets, coord_t max_wall_distance)
+{
+    std::vector<std::vector<Polygons>> insets_per_group;
+    if (insets.empty() || insets[0].size() <= 1)
+    { // a single group, in which each inset is printed as a whole
+        return insets_per_group;
+    }
+    const Polygons& outer_wall = insets[0];
+    std::vector<AABB> outer_wall_boxes;
+    outer_wall_boxes.reserve(outer_wall.size());
+    for (ConstPolygonRef polygon : outer_wall)
+    {
+        outer_wall_boxes.emplace_back(polygon);
+        outer_wall_boxes.back().expand(max_wall_distance);
+    }
+    insets_per_group.assign(outer_wall.size(), std::vector<Polygons>(insets.size()));
+    for (unsigned int polygon_idx = 0; polygon_idx < outer_wall.size(); polygon_idx++)
+    {
+        insets_per_group[polygon_idx][0].add(outer_wall[polygon_idx]);
+    }
+    for (unsigned int inset_number = 1; inset_number < insets.size(); inset_number++)
+    {
+        for (ConstPolygonRef polygon : insets[inset_number])
+        {
+            if (polygon.size() == 0)
+            {
+                continue;
+            }
+            // An inner wall lies at the distance of the walls in between from the outer wall polygon it was offset from,
+            // and further away from all others, so the closest outer wall polygon is the one it belongs to.
+            const Point& location = polygon[0];
+            unsigned int group_idx = 0;
+            coord_t best_distance2 = std::numeric_limits<coord_t>::max();
+            for (unsigned int candidate_idx = 0; candidate_idx < outer_wall.size(); candidate_idx++)
+            {
+                if (!outer_wall_boxes[candidate_idx].contains(location))
+                {
+                    continue;
+                }
+                const coord_t distance2 = vSize2(PolygonUtils::findClosest(location, outer_wall[candidate_idx]).location - location);
+                if (distance2 < best_distance2)
+                {
+                    best_distance2 = distance2;
+                    group_idx = candidate_idx;
+                }
+            }
+            insets_per_group[group_idx][inset_number].add(polygon);
+        }
+    }
+    return insets_per_group;
+}
+
 bool FffGcodeWriter::processSkinAndPerimeterGaps(const SliceDataStorage& storage, LayerPlan& gcode_layer, const SliceMeshStorage* mesh, const int extruder_nr, const PathConfigStorage::MeshPathConfigs& mesh_config, const SliceLayerPart& part, unsigned int layer_nr, int skin_overlap, int skin_angle) const
 {
     int top_bottom_extruder_nr = mesh->getSettingAsExtruderNr("top_bottom_extruder_nr");
@@ -1427,11 +1779,7 @@ bool FffGcodeWriter::processSkinPart(const SliceDataStorage& storage, LayerPlan&
     EFillMethod pattern = (layer_nr == 0)?
         mesh->getSettingAsFillMethod("top_bottom_pattern_0") :
         mesh->getSettingAsFillMethod("top_bottom_pattern");
-    int bridge = -1;
-    if (layer_nr > 0)
-    {
-        bridge = bridgeAngle(skin_part.outline, &mesh->layers[layer_nr-1]);
-    }
+    const int bridge = skin_part.bridge_angle;
     if (bridge > -1)
     {
         pattern = EFillMethod::LINES;
@@ -1562,56 +1910,57 @@ bool FffGcodeWriter::addSupportToGCode(const SliceDataStorage& storage, LayerPla
     return support_added;
 }
 
-bool FffGcodeWriter::addSupportInfillToGCode(const SliceDataStorage& storage, LayerPlan& gcode_layer, int layer_nr) const
+void FffGcodeWriter::generateSupportPatterns(SliceDataStorage& storage) const
 {
-    const SupportLayer& support_layer = storage.support.supportLayers[std::max(0, layer_nr)]; // account for negative layer numbers for raft filler layers
+    if (!storage.support.generated)
+    {
+        return;
+    }
+    Profiler::Zone zone("generateSupportPatterns");
+    const int layer_count = std::min(storage.support.layer_nr_max_filled_layer + 1, static_cast<int>(storage.support.supportLayers.size()));
+    ThreadPool::parallelFor(0, layer_count, [&](int layer_nr)
+    {
+        SupportLayer& support_layer = storage.support.supportLayers[layer_nr];
+        generateSupportInfillIslands(storage, layer_nr, support_layer.support_infill_islands);
+        generateSupportInterfacePattern(storage, support_layer.support_roof, "support_roof", layer_nr, support_layer.support_roof_polygons, support_layer.support_roof_lines);
+        generateSupportInterfacePattern(storage, support_layer.support_bottom, "support_bottom", layer_nr, support_layer.support_bottom_polygons, support_layer.support_bottom_lines);
+    });
+}
 
-    bool added = false;
-    if (!storage.support.generated 
-        || layer_nr > storage.support.layer_nr_max_filled_layer 
-        || support_layer.supportAreas.size() == 0)
+void FffGcodeWriter::generateSupportInfillIslands(const SliceDataStorage& storage, int layer_nr, std::vector<SupportInfillIsland>& islands) const
+{
+    const SupportLayer& support_layer = storage.support.supportLayers[std::max(0, layer_nr)]; // account for negative layer numbers for raft filler layers
+    islands.clear();
+    if (support_layer.supportAreas.empty())
     {
-        return added;
+        return;
     }
 
     int64_t z = layer_nr * getSettingInMicrons("layer_height");
 
     const ExtruderTrain& infill_extr = *storage.meshgroup->getExtruderTrain(getSettingAsIndex("support_infill_extruder_nr"));
     int support_line_distance = infill_extr.getSettingInMicrons("support_line_distance"); // first layer line distance must be the same as the second layer line distance
-    const int support_line_width = gcode_layer.configs_storage.support_infill_config.getLineWidth();
+    const int support_line_width = infill_extr.getSettingInMicrons("support_line_width");
     EFillMethod support_pattern = infill_extr.getSettingAsFillMethod("support_pattern"); // first layer pattern must be same as other layers
     if (layer_nr <= 0 && (support_pattern == EFillMethod::LINES || support_pattern == EFillMethod::ZIG_ZAG)) { support_pattern = EFillMethod::GRID; }
 
     int infill_extruder_nr_here = (layer_nr <= 0)? getSettingAsIndex("support_extruder_nr_layer_0") : getSettingAsIndex("support_infill_extruder_nr");
     const ExtruderTrain& infill_extr_here = *storage.meshgroup->getExtruderTrain(infill_extruder_nr_here);
 
-    const Polygons& support = support_layer.supportAreas;
-
-    std::vector<PolygonsPart> support_islands = support.splitIntoParts();
-
-    PathOrderOptimizer island_order_optimizer(gcode_layer.getLastPosition());
-    for(unsigned int n=0; n<support_islands.size(); n++)
-    {
-        island_order_optimizer.addPolygon(support_islands[n][0]);
-    }
-    island_order_optimizer.optimize();
-
-    for(unsigned int n=0; n<support_islands.size(); n++)
+    std::vector<PolygonsPart> support_islands = support_layer.supportAreas.splitIntoParts();
+    islands.resize(support_islands.size());
+    for (unsigned int island_idx = 0; island_idx < support_islands.size(); island_idx++)
     {
-        PolygonsPart& island = support_islands[island_order_optimizer.polyOrder[n]];
+        PolygonsPart& island = support_islands[island_idx];
+        SupportInfillIsland& island_infill = islands[island_idx];
+        island_infill.outline.add(island[0]);
 
         int support_infill_overlap = 0; // support infill should not be expanded outward
-        
+
         int offset_from_outline = 0;
         if (support_pattern == EFillMethod::GRID || support_pattern == EFillMethod::TRIANGLES || support_pattern == EFillMethod::CONCENTRIC)
         {
-            Polygons boundary = island.offset(-support_line_width / 2);
-            if (boundary.size() > 0)
-            {
-                setExtruder_addPrime(storage, gcode_layer, layer_nr, infill_extruder_nr_here); // only switch extruder if we're sure we're going to switch
-                gcode_layer.setIsInside(false); // going to print stuff outside print object, i.e. support
-                gcode_layer.addPolygonsByOptimizer(boundary, &gcode_layer.configs_storage.support_infill_config);
-            }
+            island_infill.boundary = island.offset(-support_line_width / 2);
             offset_from_outline = -support_line_width;
             support_infill_overlap = infill_extr_here.getSettingInMicrons("infill_overlap_mm"); // support lines area should be expanded outward to overlap with the boundary polygon
         }
@@ -1621,15 +1970,86 @@ bool FffGcodeWriter::addSupportInfillToGCode(const SliceDataStorage& storage, La
         Polygons* perimeter_gaps = nullptr;
         double fill_angle = 0;
         Infill infill_comp(support_pattern, island, offset_from_outline, support_line_width, support_line_distance, support_infill_overlap, fill_angle, z, extra_infill_shift, perimeter_gaps, infill_extr.getSettingBoolean("support_connect_zigzags"), use_endpieces);
-        Polygons support_polygons;
-        Polygons support_lines;
-        infill_comp.generate(support_polygons, support_lines);
-        if (support_lines.size() > 0 || support_polygons.size() > 0)
+        infill_comp.generate(island_infill.infill_polygons, island_infill.infill_lines);
+    }
+}
+
+void FffGcodeWriter::generateSupportInterfacePattern(const SliceDataStorage& storage, const Polygons& areas, const std::string& interface_name, int layer_nr, Polygons& interface_polygons, Polygons& interface_lines) const
+{
+    interface_polygons.clear();
+    interface_lines.clear();
+    if (areas.empty())
+    {
+        return;
+    }
+
+    const coord_t z = layer_nr * getSettingInMicrons("layer_height");
+
+    const ExtruderTrain& interface_extr = *storage.meshgroup->getExtruderTrain(getSettingAsIndex(interface_name + "_extruder_nr"));
+
+    const EFillMethod pattern = interface_extr.getSettingAsFillMethod(interface_name + "_pattern");
+    const double fill_angle = supportInterfaceFillAngle(storage, pattern, interface_name + "_height", layer_nr);
+    constexpr int support_interface_overlap = 0; // the roofs and bottoms should never be expanded outwards
+    constexpr int outline_offset =  0;
+    constexpr int extra_infill_shift = 0;
+    constexpr Polygons* perimeter_gaps = nullptr;
+    constexpr bool use_endpieces = true;
+    constexpr bool connected_zigzags = false;
+
+    const coord_t line_width = interface_extr.getSettingInMicrons(interface_name + "_line_width");
+    const coord_t line_distance = interface_extr.getSettingInMicrons(interface_name + "_line_distance");
+    Infill interface_computation(pattern, areas, outline_offset, line_width, line_distance, support_interface_overlap, fill_angle, z, extra_infill_shift, perimeter_gaps, connected_zigzags, use_endpieces);
+    interface_computation.generate(interface_polygons, interface_lines);
+}
+
+bool FffGcodeWriter::addSupportInfillToGCode(const SliceDataStorage& storage, LayerPlan& gcode_layer, int layer_nr) const
+{
+    const SupportLayer& support_layer = storage.support.supportLayers[std::max(0, layer_nr)]; // account for negative layer numbers for raft filler layers
+
+    bool added = false;
+    if (!storage.support.generated 
+        || layer_nr > storage.support.layer_nr_max_filled_layer 
+        || support_layer.supportAreas.size() == 0)
+    {
+        return added;
+    }
+
+    // the patterns of the raft filler layers differ from the ones of the first layer, so they are generated here
+    std::vector<SupportInfillIsland> filler_layer_islands;
+    if (layer_nr < 0)
+    {
+        generateSupportInfillIslands(storage, layer_nr, filler_layer_islands);
+    }
+    const std::vector<SupportInfillIsland>& islands = (layer_nr < 0)? filler_layer_islands : support_layer.support_infill_islands;
+
+    const ExtruderTrain& infill_extr = *storage.meshgroup->getExtruderTrain(getSettingAsIndex("support_infill_extruder_nr"));
+    EFillMethod support_pattern = infill_extr.getSettingAsFillMethod("support_pattern");
+    if (layer_nr <= 0 && (support_pattern == EFillMethod::LINES || support_pattern == EFillMethod::ZIG_ZAG)) { support_pattern = EFillMethod::GRID; }
+
+    int infill_extruder_nr_here = (layer_nr <= 0)? getSettingAsIndex("support_extruder_nr_layer_0") : getSettingAsIndex("support_infill_extruder_nr");
+
+    PathOrderOptimizer island_order_optimizer(gcode_layer.getLastPosition());
+    for (const SupportInfillIsland& island : islands)
+    {
+        island_order_optimizer.addPolygon(island.outline[0]);
+    }
+    island_order_optimizer.optimize();
+
+    for (int island_idx : island_order_optimizer.polyOrder)
+    {
+        const SupportInfillIsland& island = islands[island_idx];
+        if (island.boundary.size() > 0)
         {
             setExtruder_addPrime(storage, gcode_layer, layer_nr, infill_extruder_nr_here); // only switch extruder if we're sure we're going to switch
             gcode_layer.setIsInside(false); // going to print stuff outside print object, i.e. support
-            gcode_layer.addPolygonsByOptimizer(support_polygons, &gcode_layer.configs_storage.support_infill_config);
-            gcode_layer.addLinesByOptimizer(support_lines, &gcode_layer.configs_storage.support_infill_config, (support_pattern == EFillMethod::ZIG_ZAG)? SpaceFillType::PolyLines : SpaceFillType::Lines);
+            gcode_layer.addPolygonsByOptimizer(island.boundary, &gcode_layer.configs_storage.support_infill_config);
+        }
+        if (island.infill_lines.size() > 0 || island.infill_polygons.size() > 0)
+        {
+            setExtruder_addPrime(storage, gcode_layer, layer_nr, infill_extruder_nr_here); // only switch extruder if we're sure we're going to switch
+            gcode_layer.setIsInside(false); // going to print stuff outside print object, i.e. support
+            gcode_layer.addPolygonsByOptimizer(island.infill_polygons, &gcode_layer.configs_storage.support_infill_config);
+            gcode_layer.addLinesByOptimizer(island.infill_lines, &gcode_layer.configs_storage.support_infill_config, (support_pattern == EFillMethod::ZIG_ZAG)? SpaceFillType::PolyLines : SpaceFillType::Lines);
             added = true;
         }
     }
@@ -1647,25 +2067,19 @@ bool FffGcodeWriter::addSupportRoofsToGCode(const SliceDataStorage& storage, Lay
         return false; //No need to generate support roof if there's no support.
     }
 
-    const coord_t z = layer_nr * getSettingInMicrons("layer_height");
-
     const int roof_extruder_nr = getSettingAsIndex("support_roof_extruder_nr");
     const ExtruderTrain& roof_extr = *storage.meshgroup->getExtruderTrain(roof_extruder_nr);
-
     const EFillMethod pattern = roof_extr.getSettingAsFillMethod("support_roof_pattern");
-    const double fill_angle = supportInterfaceFillAngle(storage, pattern, "support_roof_height", layer_nr);
-    constexpr int support_roof_overlap = 0; // the roofs should never be expanded outwards
-    constexpr int outline_offset =  0;
-    constexpr int extra_infill_shift = 0;
-    constexpr Polygons* perimeter_gaps = nullptr;
-    constexpr bool use_endpieces = true;
-    constexpr bool connected_zigzags = false;
 
-    const coord_t support_roof_line_distance = roof_extr.getSettingInMicrons("support_roof_line_distance");
-    Infill roof_computation(pattern, support_layer.support_roof, outline_offset, gcode_layer.configs_storage.support_roof_config.getLineWidth(), support_roof_line_distance, support_roof_overlap, fill_angle, z, extra_infill_shift, perimeter_gaps, connected_zigzags, use_endpieces);
-    Polygons roof_polygons;
-    Polygons roof_lines;
-    roof_computation.generate(roof_polygons, roof_lines);
+    // the patterns of the raft filler layers differ from the ones of the first layer, so they are generated here
+    Polygons filler_layer_polygons;
+    Polygons filler_layer_lines;
+    if (layer_nr < 0)
+    {
+        generateSupportInterfacePattern(storage, support_layer.support_roof, "support_roof", layer_nr, filler_layer_polygons, filler_layer_lines);
+    }
+    const Polygons& roof_polygons = (layer_nr < 0)? filler_layer_polygons : support_layer.support_roof_polygons;
+    const Polygons& roof_lines = (layer_nr < 0)? filler_layer_lines : support_layer.support_roof_lines;
     if (roof_polygons.empty() && roof_lines.empty())
     {
         return false; //We didn't create any support roof.
@@ -1688,25 +2102,19 @@ bool FffGcodeWriter::addSupportBottomsToGCode(const SliceDataStorage& storage, L
         return false; //No need to generate support bottoms if there's no support.
     }
 
-    const coord_t z = layer_nr * getSettingInMicrons("layer_height");
-
     const int bottom_extruder_nr = getSettingAsIndex("support_bottom_extruder_nr");
     const ExtruderTrain& bottom_extr = *storage.meshgroup->getExtruderTrain(bottom_extruder_nr);
-
     const EFillMethod pattern = bottom_extr.getSettingAsFillMethod("support_bottom_pattern");
-    const double fill_angle = supportInterfaceFillAngle(storage, pattern, "support_bottom_height", layer_nr);
-    constexpr int support_bottom_overlap = 0; // the bottoms should never be expanded outwards
-    constexpr int outline_offset =  0;
-    constexpr int extra_infill_shift = 0;
-    constexpr Polygons* perimeter_gaps = nullptr;
-    constexpr bool use_endpieces = true;
-    constexpr bool connected_zigzags = false;
 
-    const coord_t support_bottom_line_distance = bottom_extr.getSettingInMicrons("support_bottom_line_distance");
-    Infill bottom_computation(pattern, support_layer.support_bottom, outline_offset, gcode_layer.configs_storage.support_bottom_config.getLineWidth(), support_bottom_line_distance, support_bottom_overlap, fill_angle, z, extra_infill_shift, perimeter_gaps, connected_zigzags, use_endpieces);
-    Polygons bottom_polygons;
-    Polygons bottom_lines;
-    bottom_computation.generate(bottom_polygons, bottom_lines);
+    // the patterns of the raft filler layers differ from the ones of the first layer, so they are generated here
+    Polygons filler_layer_polygons;
+    Polygons filler_layer_lines;
+    if (layer_nr < 0)
+    {
+        generateSupportInterfacePattern(storage, support_layer.support_bottom, "support_bottom", layer_nr, filler_layer_polygons, filler_layer_lines);
+    }
+    const Polygons& bottom_polygons = (layer_nr < 0)? filler_layer_polygons : support_layer.support_bottom_polygons;
+    const Polygons& bottom_lines = (layer_nr < 0)? filler_layer_lines : support_layer.support_bottom_lines;
     if (bottom_polygons.empty() && bottom_lines.empty())
     {
         return false;
@@ -1792,6 +2200,59 @@ void FffGcodeWriter::addPrimeTower(const SliceDataStorage& storage, LayerPlan& g
     storage.primeTower.addToGcode(storage, gcode_layer, gcode, layer_nr, prev_extruder, gcode_layer.getExtruder());
 }
 
+std::string FffGcodeWriter::storedFileHeader(const std::string& padded_header) const
+{
+#ifdef GZIP
+    if (gzip_output_buffer)
+    { // stored without compression, so that the final header has the same size as the one it overwrites
+        return GzipOutputBuffer::compressStored(padded_header);
+    }
+#endif
+    return padded_header;
+}
+
+/*!
+ * Wait until the data written to a file has been written to disk.
+ *
+ * The file is opened anew for this, since the standard streams don't expose their file descriptor,
+ * which works because the data of a file is synced regardless of which descriptor is used.
+ *
+ * \return Whether the file has been synced
+ */
+static bool syncFileToDisk(const std::string& filename)
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    const int file_descriptor = open(filename.c_str(), O_WRONLY);
+    if (file_descriptor < 0)
+    {
+        return false;
+    }
+    const bool success = fsync(file_descriptor) == 0;
+    close(file_descriptor);
+    return success;
+#else
+    return false;
+#endif
+}
+
+void FffGcodeWriter::flushOutputFile()
+{
+    if (output_file.is_open())
+    {
+        gcode.flushOutputStream();
+#ifdef GZIP
+        if (gzip_output_buffer)
+        { // so that the file is complete even if more is written to it afterwards
+            gzip_output_buffer->finishMember();
+        }
+#endif
+        if (sync_output_to_disk && !syncFileToDisk(output_filename))
+        {
+            logWarning("Failed to wait for %s to be written to disk.\n", output_filename.c_str());
+        }
+    }
+}
+
 void FffGcodeWriter::finalize()
 {
     double print_time = gcode.getSumTotalPrintTimes();
@@ -1815,6 +2276,12 @@ void FffGcodeWriter::finalize()
         log(prefix.c_str());
         log("End of gcode header.\n");
     }
+    if (!shard_ends_print)
+    { // the next shard continues from here
+        gcode.writeComment("End of shard");
+        flushOutputFile();
+        return;
+    }
     if (getSettingBoolean("acceleration_enabled"))
     {
         gcode.writeAcceleration(getSettingInMillimetersPerSecond("machine_acceleration"));
@@ -1828,12 +2295,32 @@ void FffGcodeWriter::finalize()
         gcode.writeMaxZFeedrate(getSettingInMillimetersPerSecond("machine_max_feedrate_z"));
     }
     gcode.finalize(getSettingString("machine_end_gcode").c_str());
+    if (!CommandSocket::isInstantiated() && shard_starts_print && flush_each_layer)
+    { // without streaming the output is left as it was, with the placeholders of the header
+        const std::string padded_prefix = gcode.padFileHeader(prefix, header_reserved_size);
+        const std::string stored_header = padded_prefix.empty()? std::string() : storedFileHeader(padded_prefix);
+        if (!stored_header.empty())
+        {
+            gcode.flushOutputStream(); // the file can only be used directly once all gcode written before has reached it
+            const std::streampos end_position = output_file.tellp();
+            output_file.seekp(header_position);
+            output_file.write(stored_header.data(), stored_header.size());
+            output_file.seekp(end_position);
+        }
+        else
+        { // the output can't be overwritten, as when it's streamed to a pipe, or the header has outgrown its room
+            gcode.writeComment("Final values of the header:");
+            gcode.writeCode(prefix.c_str());
+        }
+        gcode.flushOutputStream();
+    }
     for (int e = 0; e < getSettingAsCount("machine_extruder_count"); e++)
     {
         gcode.writeTemperatureCommand(e, 0, false);
     }
 
     gcode.writeComment("End of Gcode");
+    flushOutputFile();
     /*
     the profile string below can be executed since the M25 doesn't end the gcode on an UMO and when printing via USB.
     gcode.writeCode("M25 ;Stop reading from this point on.");
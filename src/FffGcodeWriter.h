@@ -3,14 +3,18 @@
 
 
 #include <fstream>
+#include <memory> // unique_ptr
+#include "utils/AsyncOutputBuffer.h"
+#include "utils/GzipOutputBuffer.h"
+#include "utils/BinaryGcode.h"
 #include "utils/gettime.h"
 #include "utils/logoutput.h"
 #include "utils/NoCopy.h"
 #include "utils/polygonUtils.h"
+#include "utils/PolygonSegmentGrid.h"
 #include "sliceDataStorage.h"
 #include "raft.h"
 #include "infill.h"
-#include "bridge.h"
 #include "pathOrderOptimizer.h"
 #include "LayerPlan.h"
 #include "gcodeExport.h"
@@ -39,6 +43,16 @@ class FffGcodeWriter : public SettingsMessenger, NoCopy
 private:
     int max_object_height; //!< The maximal height of all previously sliced meshgroups, used to avoid collision when moving to the next meshgroup to print.
 
+    bool shard_starts_print; //!< Whether the gcode written starts the print, rather than continuing a previous shard; see \ref FffGcodeWriter::processShardStartCode
+    bool shard_ends_print; //!< Whether the gcode written ends the print, rather than being continued by a next shard
+
+    /*!
+     * The memory of the layer plans which have been written, used again by the plans of the next layers.
+     * 
+     * Mutable, since the const FffGcodeWriter::processLayer takes memory from it. Declared before the buffer, so that it outlives the layer plans.
+     */
+    mutable LayerPlanMemoryPool layer_plan_memory_pool;
+
     /*
      * Buffer for all layer plans (of type LayerPlan)
      * 
@@ -56,9 +70,65 @@ private:
 
     /*!
      * The gcode file to write to when using CuraEngine as command line tool.
+     * 
+     * It is unbuffered, since all gcode is written to it through \ref FffGcodeWriter::async_output_buffer in large blocks.
      */
     std::ofstream output_file;
 
+    std::string output_filename; //!< The name of \ref FffGcodeWriter::output_file
+
+    bool sync_output_to_disk; //!< Whether to wait until the target file is on disk at the end, see \ref FffGcodeWriter::setSyncOutputToDisk
+
+#ifdef GZIP
+    /*!
+     * The buffer compressing the gcode written to \ref FffGcodeWriter::output_file, if its name ends in ".gz".
+     * 
+     * Declared after the file so that the last gzip member is finished before the file is closed.
+     */
+    std::unique_ptr<GzipOutputBuffer> gzip_output_buffer;
+#endif
+
+    /*!
+     * The buffer writing to \ref FffGcodeWriter::output_file on a thread of its own, so that slow storage doesn't stall the gcode generation.
+     * When the file is compressed it writes to \ref FffGcodeWriter::gzip_output_buffer, so that the compression runs on that thread as well.
+     * 
+     * Declared after the file and the compression so that the remaining gcode is written to them before they are closed.
+     */
+    std::unique_ptr<AsyncOutputBuffer> async_output_buffer;
+
+    /*!
+     * The stream writing to \ref FffGcodeWriter::async_output_buffer.
+     */
+    std::unique_ptr<std::ostream> async_output;
+
+    bool binary_output_requested; //!< Whether the target file is to be written in binary format, see \ref FffGcodeWriter::setBinaryOutput
+
+    bool flush_each_layer; //!< Whether to pass each layer on to the target as soon as it's written, see \ref FffGcodeWriter::setStreamingOutput
+
+    /*!
+     * Where the file header starts in \ref FffGcodeWriter::output_file, so that \ref FffGcodeWriter::finalize can overwrite it
+     * with the print time and material estimates, which are only known at the end.
+     */
+    std::streampos header_position;
+
+    /*!
+     * The size of the file header including the room reserved for the final estimates, or zero if the header can't be overwritten.
+     * When streaming, see \ref FffGcodeWriter::flush_each_layer, a header which can't be overwritten is written again at the end as a trailer.
+     */
+    size_t header_reserved_size;
+
+    /*!
+     * The encoder converting the gcode to binary gcode before it's written to \ref FffGcodeWriter::output_file, if binary output is enabled.
+     * 
+     * Declared after the output buffer so that the last line is written to it before it's flushed.
+     */
+    std::unique_ptr<BinaryGcodeEncoder> binary_encoder;
+
+    /*!
+     * The stream writing to \ref FffGcodeWriter::binary_encoder, if binary output is enabled.
+     */
+    std::unique_ptr<std::ostream> binary_output;
+
     /*!
      * For each raft/filler layer, the extruders to be used in that layer in the order in which they are going to be used.
      * The first number is the first raft layer. Indexing is shifted compared to normal negative layer numbers for raft/filler layers.
@@ -93,13 +163,71 @@ public:
      */
     bool setTargetFile(const char* filename)
     {
-        output_file.open(filename);
-        if (output_file.is_open())
+        header_reserved_size = 0;
+        output_file.rdbuf()->pubsetbuf(nullptr, 0); // must be set before opening the file
+        output_file.open(filename, binary_output_requested? std::ios::out | std::ios::binary : std::ios::out);
+        if (!output_file.is_open())
+        {
+            return false;
+        }
+        output_filename = filename;
+        std::streambuf* destination = output_file.rdbuf();
+        const std::string gzip_extension = ".gz";
+        if (output_filename.size() > gzip_extension.size() && output_filename.compare(output_filename.size() - gzip_extension.size(), gzip_extension.size(), gzip_extension) == 0)
         {
-            gcode.setOutputStream(&output_file);
+#ifdef GZIP
+            gzip_output_buffer.reset(new GzipOutputBuffer(destination));
+            destination = gzip_output_buffer.get();
+#else
+            logWarning("CuraEngine is built without gzip support, so %s is written uncompressed.\n", filename);
+#endif
+        }
+        async_output_buffer.reset(new AsyncOutputBuffer(destination));
+        async_output.reset(new std::ostream(async_output_buffer.get()));
+        if (!binary_output_requested)
+        {
+            gcode.setOutputStream(async_output.get());
             return true;
         }
-        return false;
+        binary_encoder.reset(new BinaryGcodeEncoder(*async_output));
+        binary_output.reset(new std::ostream(binary_encoder.get()));
+        gcode.setOutputStream(binary_output.get());
+        return true;
+    }
+
+    /*!
+     * Write the gcode in the binary format of \ref BinaryGcode instead of as text,
+     * to the target file set after this call.
+     * 
+     * Used when CuraEngine is used as command line tool.
+     */
+    void setBinaryOutput()
+    {
+        binary_output_requested = true;
+    }
+
+    /*!
+     * Pass each layer on to the target as soon as it's written instead of in large blocks,
+     * so that a printer can start while the later layers are still being sliced.
+     * The file header, which is written before the print time and material are known, is then filled in with them afterwards:
+     * in place if the output file is seekable, or as a trailer at the end otherwise.
+     * 
+     * Used when CuraEngine is used as command line tool.
+     */
+    void setStreamingOutput()
+    {
+        flush_each_layer = true;
+    }
+
+    /*!
+     * Wait at the end until the target file is written to disk, rather than only handing it over to the operating system,
+     * so that the file is complete once CuraEngine exits, even when the storage is slow to take it.
+     * 
+     * Used when CuraEngine is used as command line tool.
+     */
+    void setSyncOutputToDisk()
+    {
+        sync_output_to_disk = true;
     }
 
     /*!
@@ -168,6 +296,13 @@ private:
      */
     void setConfigRetraction(SliceDataStorage& storage);
 
+    /*!
+     * Create the SliceDataStorage::path_configs from which the line configs of each layer are made.
+     * 
+     * \param[out] storage The data storage to which to save the configurations
+     */
+    void setConfigPaths(SliceDataStorage& storage);
+
     /*!
      * Get the extruder with which to start the print.
      * 
@@ -197,6 +332,22 @@ private:
      */
     void processStartingCode(const SliceDataStorage& storage, const unsigned int start_extruder_nr);
 
+    /*!
+     * Continue the gcode of the previous shard instead of starting the print, when only a range of layers is written.
+     * 
+     * The print can be sliced in shards of layers on separate machines, by giving each the settings shard_layer_start and shard_layer_end.
+     * Each shard still generates the walls and the support of all layers, since the support of a layer depends on all layers above it,
+     * but only the skin and infill of its own layers and the layers around them, see \ref FffPolygonGenerator::getShardSkinLayerRange,
+     * and it only plans and writes the gcode of its own layers.
+     * Only the first shard writes the start gcode, the header and the raft, and only the last writes the end gcode.
+     * Each shard ends retracted, and the next one continues from that with a zeroed E value,
+     * so that the gcode of the shards can be concatenated in order.
+     * 
+     * \param[in] storage where the slice data is stored.
+     * \param layer_nr The first layer of the shard
+     */
+    void processShardStartCode(const SliceDataStorage& storage, int layer_nr);
+
     /*!
      * Move up and over the already printed meshgroups to print the next meshgroup.
      * 
@@ -205,11 +356,22 @@ private:
     void processNextMeshGroupCode(const SliceDataStorage& storage);
     
     /*!
-     * Add raft layer plans onto the FffGcodeWriter::layer_plan_buffer
+     * Plan a layer of the raft: the base layer, the interface layer or one of the surface layers.
      * 
-     * \param[in,out] storage where the slice data is stored.
+     * The raft layers are planned in parallel with the filler layers and the model layers, see \ref FffGcodeWriter::writeGCode
+     * 
+     * \param[in] storage where the slice data is stored.
+     * \param layer_nr The index of the raft layer, from -Raft::getTotalExtraLayers for the base layer up to the first filler layer.
+     * \return The layer plan
      */
-    void processRaft(const SliceDataStorage& storage);
+    LayerPlan& processRaftLayer(const SliceDataStorage& storage, int layer_nr) const;
+
+    /*!
+     * Send the height and thickness of a layer to the front end, if there is one.
+     * 
+     * This function is thread safe.
+     */
+    void sendLayerInfo(int layer_nr, int64_t z, int layer_thickness) const;
 
     /*!
      * Convert the polygon data of a layer into a layer plan on the FffGcodeWriter::layer_plan_buffer
@@ -281,6 +443,10 @@ private:
      * 
      * Only extruders which are (most probably) going to be used are planned
      * 
+     * Each layer starts with the extruder the layer below ended with. Which extruder each layer ends with
+     * is chosen over all layers at once, so that as many layers as possible start with an extruder which is used on them,
+     * which minimizes the number of extruder switches (and with it the use of the prime tower) of the whole print.
+     * 
      * \note At the planning stage we only have information on areas, not how those are filled.
      * If an area is too small to be filled with anything it will still get specified as being used with the extruder for that area.
      * 
@@ -290,6 +456,16 @@ private:
      */
     void calculateExtruderOrderPerLayer(const SliceDataStorage& storage);
 
+    /*!
+     * Gets which extruders are used on the given layer.
+     * When it's on the first layer, the prime blob will also be taken into account.
+     * 
+     * \param[in] storage where the slice data is stored.
+     * \param layer_nr The layer for which to check
+     * \return For each extruder whether it's used on the layer
+     */
+    std::vector<bool> getExtrudersUsedOnLayer(const SliceDataStorage& storage, const int layer_nr) const;
+
     /*!
      * Gets a list of extruders that are used on the given layer, but excluding the given starting extruder.
      * When it's on the first layer, the prime blob will also be taken into account.
@@ -353,6 +529,21 @@ private:
      */
     void addMeshLayerToGCode(const SliceDataStorage& storage, const SliceMeshStorage* mesh, const int extruder_nr, const PathConfigStorage::MeshPathConfigs& mesh_config, LayerPlan& gcode_layer, int layer_nr) const;
 
+    /*!
+     * Add all features of a given extruder from a single layer of all meshes to the layer plan \p gcode_layer,
+     * ordering the parts of all meshes together to minimize the travel between them.
+     * 
+     * Each part is still printed as a whole, with its features in the usual order.
+     * Used instead of \ref FffGcodeWriter::addMeshLayerToGCode for each mesh when the optional setting optimize_layer_part_order is enabled.
+     * 
+     * \param[in] storage where the slice data is stored.
+     * \param mesh_order The indices of the meshes printed with \p extruder_nr
+     * \param extruder_nr The extruder for which to print all features of the meshes which should be printed with this extruder
+     * \param gcode_layer The initial planning of the gcode of the layer.
+     * \param layer_nr The index of the layer to write the gcode of.
+     */
+    void addMeshLayersToGCodeInTravelOrder(const SliceDataStorage& storage, const std::vector<unsigned int>& mesh_order, const int extruder_nr, LayerPlan& gcode_layer, int layer_nr) const;
+
     /*!
      * Add all features of the given extruder from a single part from a given layer of a mesh-volume to the layer plan \p gcode_layer.
      * This only adds the features which are printed with \p extruder_nr.
@@ -431,6 +622,20 @@ private:
      */
     bool processInsets(const SliceDataStorage& storage, LayerPlan& gcodeLayer, const SliceMeshStorage* mesh, const int extruder_nr, const PathConfigStorage::MeshPathConfigs& mesh_config, const SliceLayerPart& part, unsigned int layer_nr, EZSeamType z_seam_type, Point z_seam_pos) const;
     
+    /*!
+     * Divide the insets of a part into groups per polygon of the outer wall: the outline of the part and each of its holes.
+     * Each inner wall polygon goes to the group of the outer wall polygon closest to it, which is the one it was offset from.
+     *
+     * The walls of a group are printed one after the other, so that the nozzle goes around each hole once
+     * rather than going from hole to hole again for each inset.
+     *
+     * \param insets The insets of the part, the outer wall first
+     * \param max_wall_distance The largest distance of an inner wall polygon to the outer wall polygon it belongs to
+     * \return For each group for each inset the polygons of the group, with the outer wall polygon of the group first.
+     * Empty if the part has a single outer wall polygon, in which case the insets are printed as a whole.
+     */
+    static std::vector<std::vector<Polygons>> groupInsetsPerOuterWallPolygon(const std::vector<Polygons>& insets, coord_t max_wall_distance);
+
     /*!
      * Generate the a spiralized wall for a given layer part.
      * \param[in] storage where the slice data is stored.
@@ -488,6 +693,31 @@ private:
      * \return whether any support was added to the layer plan
      */
     bool addSupportToGCode(const SliceDataStorage& storage, LayerPlan& gcodeLayer, int layer_nr, int extruder_nr) const;
+
+    /*!
+     * Generate the patterns of the support infill, roofs and bottoms of all layers in parallel, so that planning the layers only orders them.
+     * \param[in,out] storage where the slice data is stored; the patterns are stored in its support layers.
+     */
+    void generateSupportPatterns(SliceDataStorage& storage) const;
+
+    /*!
+     * Generate the boundary and infill pattern of each island of the support areas of a layer.
+     * \param[in] storage where the slice data is stored.
+     * \param layer_nr The layer of which to fill the support areas, which may be a raft filler layer.
+     * \param[out] islands The outline, boundary and pattern of each island.
+     */
+    void generateSupportInfillIslands(const SliceDataStorage& storage, int layer_nr, std::vector<SupportInfillIsland>& islands) const;
+
+    /*!
+     * Generate the pattern of the support roofs or bottoms of a layer.
+     * \param[in] storage where the slice data is stored.
+     * \param areas The support roof or bottom areas to fill.
+     * \param interface_name The prefix of the settings of the interface, "support_roof" or "support_bottom".
+     * \param layer_nr The layer of which to fill the areas, which may be a raft filler layer.
+     * \param[out] interface_polygons The closed polygons of the pattern.
+     * \param[out] interface_lines The lines of the pattern.
+     */
+    void generateSupportInterfacePattern(const SliceDataStorage& storage, const Polygons& areas, const std::string& interface_name, int layer_nr, Polygons& interface_polygons, Polygons& interface_lines) const;
     /*!
      * Add the support lines/walls to the layer plan \p gcodeLayer of the current layer.
      * \param[in] storage where the slice data is stored.
@@ -559,8 +789,25 @@ private:
      */
     void addPrimeTower(const SliceDataStorage& storage, LayerPlan& gcodeLayer, int layer_nr, int prev_extruder) const;
     
+    /*!
+     * Finish the gcode written to the target file, so that the file is complete on disk if \ref FffGcodeWriter::setSyncOutputToDisk is used.
+     */
+    void flushOutputFile();
+
+    /*!
+     * The bytes with which a file header padded to its reserved size is stored in \ref FffGcodeWriter::output_file:
+     * as is, or as a gzip member of its own if the file is compressed, so that it can be overwritten in place either way.
+     * 
+     * \param padded_header The file header, padded with \ref GCodeExport::padFileHeader
+     * \return The bytes to write, or an empty string if the header couldn't be compressed
+     */
+    std::string storedFileHeader(const std::string& padded_header) const;
+
     /*!
      * Add the end gcode and set all temperatures to zero.
+     *
+     * The file header with the final estimates of the print time and the material overwrites the one written at the start
+     * if the target file is seekable, or is written at the end otherwise.
      */
     void finalize();
 
@@ -577,9 +824,10 @@ private:
      * \param mesh the mesh containing the layer of interest
      * \param layer_nr layer number of the layer whose seam verted index is required
      * \param last_layer_nr layer number of the previous layer
+     * \param wall_grid the grid over the segments of the wall of the layer of interest
      * \return layer seam vertex index
      */
-    unsigned int findSpiralizedLayerSeamVertexIndex(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const int layer_nr, const int last_layer_nr);
+    unsigned int findSpiralizedLayerSeamVertexIndex(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const int layer_nr, const int last_layer_nr, const PolygonSegmentGrid& wall_grid);
 };
 
 }//namespace cura
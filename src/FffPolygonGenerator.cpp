@@ -4,18 +4,25 @@
 #include "FffPolygonGenerator.h"
 
 #include <algorithm>
+#include <chrono> // milliseconds
+#include <condition_variable>
 #include <map> // multimap (ordered map allowing duplicate keys)
-
-#ifdef _OPENMP
-    #include <omp.h>
-#endif // _OPENMP
+#include <memory> // unique_ptr
+#include <mutex> // lock_guard
+#include <random> // mt19937
 
 #include "utils/math.h"
 #include "utils/algorithm.h"
 #include "slicer.h"
 #include "utils/gettime.h"
 #include "utils/logoutput.h"
+#include "utils/Profiler.h"
+#include "utils/ThreadPool.h"
+#include "AdaptiveLayerHeights.h"
+#include "MemoryReport.h"
 #include "MeshGroup.h"
+#include "MeshInstances.h"
+#include "SliceCache.h"
 #include "support.h"
 #include "multiVolumes.h"
 #include "layerPart.h"
@@ -29,9 +36,11 @@
 #include "progress/Progress.h"
 #include "PrintFeature.h"
 #include "ConicalOverhang.h"
+#include "bridge.h"
 #include "progress/ProgressEstimator.h"
 #include "progress/ProgressStageEstimator.h"
 #include "progress/ProgressEstimatorLinear.h"
+#include "settings/SettingsTrace.h"
 
 
 namespace cura
@@ -40,14 +49,94 @@ namespace cura
 
 bool FffPolygonGenerator::generateAreas(SliceDataStorage& storage, MeshGroup* meshgroup, TimeKeeper& timeKeeper)
 {
-    if (!sliceModel(meshgroup, timeKeeper, storage)) 
+    Profiler::Zone zone("generateAreas");
+    if (!sliceModel(meshgroup, timeKeeper, storage) || ThreadPool::isCancelled())
     {
         return false;
     }
     
     slices2polygons(storage, timeKeeper);
     
-    return true;
+    return !ThreadPool::isCancelled(); // the stages skip the rest of their layers once the slicing is cancelled
+}
+
+bool FffPolygonGenerator::generatePreview(SliceDataStorage& storage, MeshGroup* meshgroup, unsigned int layer_stride, TimeKeeper& timeKeeper)
+{
+    Profiler::Zone zone("generatePreview");
+    if (!sliceModel(meshgroup, timeKeeper, storage, std::max(1u, layer_stride)) || ThreadPool::isCancelled())
+    {
+        return false;
+    }
+
+    ThreadPool::ThreadLimit thread_limit(hasSetting("thread_count_areas")? std::max(0, getSettingAsCount("thread_count_areas")) : 0);
+    Progress::messageProgressStage(Progress::Stage::INSET_SKIN, &timeKeeper);
+    for (SliceMeshStorage& mesh : storage.meshes)
+    {
+        if (mesh.getSettingBoolean("infill_mesh") || mesh.getSettingBoolean("anti_overhang_mesh") || mesh.getSettingBoolean("support_mesh"))
+        { // only the meshes which are printed as they are
+            continue;
+        }
+        mesh.resolveLayerSettings(storage);
+        ThreadPool::parallelFor(0, mesh.layers.size(), [&](int layer_nr)
+        {
+            processInsets(mesh, layer_nr);
+        });
+    }
+    return !ThreadPool::isCancelled();
+}
+
+void FffPolygonGenerator::regenerateAreas(SliceDataStorage& storage, TimeKeeper& time_keeper, bool infill_changed, bool support_changed)
+{
+    Profiler::Zone zone("regenerateAreas");
+    ThreadPool::ThreadLimit thread_limit(hasSetting("thread_count_areas")? std::max(0, getSettingAsCount("thread_count_areas")) : 0); // stages scale differently, so each can be limited to fewer threads
+    if (storage.primeTower.enabled)
+    { // the prime tower has been subtracted from the support areas
+        support_changed = true;
+    }
+    storage.clearHelperAreas();
+    storage.decompressAllLayerGeometry(); // the layers outside of the shard which was written are still compressed
+    startSpillingLayerGeometry(storage);
+    for (SliceMeshStorage& mesh : storage.meshes)
+    {
+        mesh.resolveLayerSettings(storage);
+    }
+
+    if (infill_changed)
+    {
+        SettingsTrace::Stage trace_stage("skin");
+        Progress::messageProgressStage(Progress::Stage::INSET_SKIN, &time_keeper);
+        for (unsigned int mesh_idx = 0; mesh_idx < storage.meshes.size(); mesh_idx++)
+        {
+            Profiler::Zone zone("skinInfill");
+            SliceMeshStorage& mesh = storage.meshes[mesh_idx];
+            mesh.clearSkinAndInfillAreas();
+            processSkinsAndInfillOfAllLayers(mesh, mesh.getSettingInMicrons("infill_line_distance") > 0); // there are no infill meshes, see SliceDataCache::canRegenerate
+            Progress::messageProgress(Progress::Stage::INSET_SKIN, mesh_idx + 1, storage.meshes.size());
+        }
+        MemoryReport::report("insetsSkinInfill", storage);
+    }
+    else
+    {
+        for (SliceMeshStorage& mesh : storage.meshes)
+        {
+            if (!mesh.base_subdiv_cube && mesh.getSettingAsFillMethod("infill_pattern") == EFillMethod::CUBICSUBDIV && !mesh.getSettingBoolean("spaghetti_infill_enabled"))
+            { // the octree isn't part of a snapshot of the areas, see SliceDataSnapshot
+                SubDivCube::precomputeOctree(mesh);
+            }
+        }
+    }
+
+    if (support_changed)
+    {
+        storage.clearSupportAreas();
+        processSupport(storage, time_keeper);
+    }
+    if (ThreadPool::isCancelled())
+    {
+        return;
+    }
+
+    processHelpersAndDerivedAreas(storage, infill_changed);
 }
 
 unsigned int FffPolygonGenerator::getDraftShieldLayerCount(const unsigned int total_layers) const
@@ -66,9 +155,13 @@ unsigned int FffPolygonGenerator::getDraftShieldLayerCount(const unsigned int to
     }
 }
 
-bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeeper, SliceDataStorage& storage) /// slices the model
+bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeeper, SliceDataStorage& storage, unsigned int preview_layer_stride) /// slices the model
 {
+    Profiler::Zone zone("slice");
+    SettingsTrace::Stage trace_stage("slicing");
+    ThreadPool::ThreadLimit thread_limit(hasSetting("thread_count_slicing")? std::max(0, getSettingAsCount("thread_count_slicing")) : 0); // stages scale differently, so each can be limited to fewer threads
     Progress::messageProgressStage(Progress::Stage::SLICING, &timeKeeper);
+    MemoryReport::report("load", storage);
     
     storage.model_min = meshgroup->min();
     storage.model_max = meshgroup->max();
@@ -87,54 +180,144 @@ bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeepe
         logError("Layer height %i is disallowed.\n", layer_thickness);
         return false;
     }
-    int initial_slice_z = initial_layer_thickness - layer_thickness / 2;
-    int slice_layer_count = (storage.model_max.z - initial_slice_z) / layer_thickness + 1;
-    if (slice_layer_count <= 0) //Model is shallower than layer_height_0, so not even the first layer is sliced. Return an empty model then.
+    AdaptiveLayerHeights layer_heights = (hasSetting("adaptive_layer_height_enabled") && getSettingBoolean("adaptive_layer_height_enabled"))?
+        AdaptiveLayerHeights::adaptive(*meshgroup, initial_layer_thickness, layer_thickness, getSettingInMicrons("adaptive_layer_height_variation"), getSettingInMicrons("adaptive_layer_height_variation_step"), getSettingInMicrons("adaptive_layer_height_threshold"))
+        : AdaptiveLayerHeights::uniform(storage.model_max.z, initial_layer_thickness, layer_thickness);
+    if (layer_heights.slice_z.empty()) //Model is shallower than layer_height_0, so not even the first layer is sliced. Return an empty model then.
     {
         return true; //This is NOT an error state!
     }
-
-    std::vector<Slicer*> slicerList;
-    for(unsigned int mesh_idx = 0; mesh_idx < meshgroup->meshes.size(); mesh_idx++)
-    {
-        Mesh& mesh = meshgroup->meshes[mesh_idx];
-        Slicer* slicer = new Slicer(&mesh, initial_slice_z, layer_thickness, slice_layer_count, mesh.getSettingBoolean("meshfix_keep_open_polygons"), mesh.getSettingBoolean("meshfix_extensive_stitching"));
-        slicerList.push_back(slicer);
-        /*
-        for(SlicerLayer& layer : slicer->layers)
+    if (preview_layer_stride > 1)
+    { // keep the first layer and every so many layers after it, with their own heights, so that they are printed where they would be in full
+        AdaptiveLayerHeights preview_heights;
+        for (unsigned int layer_nr = 0; layer_nr < layer_heights.slice_z.size(); layer_nr += preview_layer_stride)
         {
-            //Reporting the outline here slows down the engine quite a bit, so only do so when debugging.
-            sendPolygons("outline", layer_nr, layer.z, layer.polygonList);
-            sendPolygons("openoutline", layer_nr, layer.openPolygonList);
+            preview_heights.slice_z.push_back(layer_heights.slice_z[layer_nr]);
+            preview_heights.thicknesses.push_back(layer_heights.thicknesses[layer_nr]);
         }
-        */
-        Progress::messageProgress(Progress::Stage::SLICING, mesh_idx + 1, meshgroup->meshes.size());
+        layer_heights = std::move(preview_heights);
     }
+    storage.layer_thicknesses = layer_heights.thicknesses;
 
-    meshgroup->clear();///Clear the mesh face and vertex data, it is no longer needed after this point, and it saves a lot of memory.
-
+    // copies of the same mesh are only sliced once, see MeshInstances
+    const MeshInstances instances = (hasSetting("instance_identical_meshes") && getSettingBoolean("instance_identical_meshes"))? MeshInstances::find(*meshgroup) : MeshInstances(meshgroup->meshes.size());
+    if (instances.getCopyCount() > 0)
+    {
+        log("Slicing %u meshes as copies of others\n", instances.getCopyCount());
+    }
 
-    Mold::process(storage, slicerList, layer_thickness);
+    // Slice the meshes concurrently, the largest first so that the small ones fill up the threads in the end.
+    // The layers of each mesh are sliced in parallel as well, in tasks nested within the one of the mesh.
+    std::vector<Slicer*> slicerList(meshgroup->meshes.size(), nullptr);
+    std::vector<unsigned int> mesh_order(meshgroup->meshes.size());
+    for (unsigned int mesh_idx = 0; mesh_idx < mesh_order.size(); mesh_idx++)
+    {
+        mesh_order[mesh_idx] = mesh_idx;
+    }
+    std::stable_sort(mesh_order.begin(), mesh_order.end(), [meshgroup](unsigned int a, unsigned int b) { return meshgroup->meshes[a].faces.size() > meshgroup->meshes[b].faces.size(); });
+    {
+        Progress::StepCounter progress(Progress::Stage::SLICING, meshgroup->meshes.size());
+        ThreadPool::parallelFor(0, static_cast<int>(mesh_order.size()), [&](int order_idx)
+        {
+            if (instances.getSourceMeshIdx(mesh_order[order_idx]) >= 0)
+            { // translated from its source mesh below
+                progress.step();
+                return;
+            }
+            Mesh& mesh = meshgroup->meshes[mesh_order[order_idx]];
+            const bool keep_none_closed = mesh.getSettingBoolean("meshfix_keep_open_polygons");
+            const bool extensive_stitching = mesh.getSettingBoolean("meshfix_extensive_stitching");
+            const uint64_t cache_key = SliceCache::getSlicesKey(mesh, layer_heights.slice_z, keep_none_closed, extensive_stitching);
+            Slicer* slicer = SliceCache::loadSlices(cache_key, &mesh);
+            if (!slicer)
+            {
+                slicer = new Slicer(&mesh, layer_heights.slice_z, keep_none_closed, extensive_stitching);
+                if (!ThreadPool::isCancelled())
+                { // otherwise not all layers have been sliced
+                    SliceCache::storeSlices(cache_key, *slicer);
+                }
+            }
+            slicerList[mesh_order[order_idx]] = slicer;
+            /*
+            for(SlicerLayer& layer : slicer->layers)
+            {
+                //Reporting the outline here slows down the engine quite a bit, so only do so when debugging.
+                sendPolygons("outline", layer_nr, layer.z, layer.polygonList);
+                sendPolygons("openoutline", layer_nr, layer.openPolygonList);
+            }
+            */
+            progress.step();
+        });
+    }
 
+    if (preview_layer_stride == 0)
+    {
+        meshgroup->clear();///Clear the mesh face and vertex data, it is no longer needed after this point, and it saves a lot of memory.
+    }
+    if (ThreadPool::isCancelled())
+    { // not all meshes have been sliced
+        for (Slicer* slicer : slicerList)
+        {
+            delete slicer;
+        }
+        return false;
+    }
     for (unsigned int mesh_idx = 0; mesh_idx < slicerList.size(); mesh_idx++)
     {
-        Mesh& mesh = storage.meshgroup->meshes[mesh_idx];
-        if (mesh.getSettingBoolean("conical_overhang_enabled") && !mesh.getSettingBoolean("anti_overhang_mesh"))
+        const int source_mesh_idx = instances.getSourceMeshIdx(mesh_idx);
+        if (source_mesh_idx >= 0)
         {
-            ConicalOverhang::apply(slicerList[mesh_idx], mesh.getSettingInAngleRadians("conical_overhang_angle"), layer_thickness);
+            Mesh& mesh = meshgroup->meshes[mesh_idx];
+            slicerList[mesh_idx] = MeshInstances::translateSlices(*slicerList[source_mesh_idx], &mesh, instances.getOffset(mesh_idx));
+            mesh.expandXY(mesh.getSettingInMicrons("xy_offset")); // like the Slicer does
         }
     }
 
-    MultiVolumes::carveCuttingMeshes(slicerList, storage.meshgroup->meshes);
 
-    Progress::messageProgressStage(Progress::Stage::PARTS, &timeKeeper);
+    if (preview_layer_stride == 0)
+    { // these grow the outlines from layer to layer, which the layers of a preview are too far apart for
+        Mold::process(storage, slicerList, layer_thickness);
 
-    if (storage.getSettingBoolean("carve_multiple_volumes"))
-    {
-        carveMultipleVolumes(slicerList, storage.getSettingBoolean("alternate_carve_order"));
+        for (unsigned int mesh_idx = 0; mesh_idx < slicerList.size(); mesh_idx++)
+        {
+            Mesh& mesh = storage.meshgroup->meshes[mesh_idx];
+            if (mesh.getSettingBoolean("conical_overhang_enabled") && !mesh.getSettingBoolean("anti_overhang_mesh"))
+            {
+                const int source_mesh_idx = instances.getSourceMeshIdx(mesh_idx);
+                if (source_mesh_idx >= 0)
+                { // the source mesh has a lower index, so its overhang has been made printable already
+                    delete slicerList[mesh_idx];
+                    slicerList[mesh_idx] = MeshInstances::translateSlices(*slicerList[source_mesh_idx], &mesh, instances.getOffset(mesh_idx));
+                }
+                else
+                {
+                    ConicalOverhang::apply(slicerList[mesh_idx], mesh.getSettingInAngleRadians("conical_overhang_angle"), layer_thickness);
+                }
+            }
+        }
     }
 
-    generateMultipleVolumesOverlap(slicerList);
+    {
+        Profiler::Zone zone("multiVolumes");
+        MultiVolumes::carveCuttingMeshes(slicerList, storage.meshgroup->meshes);
+
+        Progress::messageProgressStage(Progress::Stage::PARTS, &timeKeeper);
+
+        if (storage.getSettingBoolean("carve_multiple_volumes"))
+        {
+            carveMultipleVolumes(slicerList, storage.getSettingBoolean("alternate_carve_order"));
+        }
+
+        generateMultipleVolumesOverlap(slicerList);
+    }
+    if (ThreadPool::isCancelled())
+    { // not all layers have been carved
+        for (Slicer* slicer : slicerList)
+        {
+            delete slicer;
+        }
+        return false;
+    }
 
     storage.print_layer_count = 0;
     for (unsigned int meshIdx = 0; meshIdx < slicerList.size(); meshIdx++)
@@ -157,12 +340,18 @@ bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeepe
         // always make a new SliceMeshStorage, so that they have the same ordering / indexing as meshgroup.meshes
         storage.meshes.emplace_back(&meshgroup->meshes[meshIdx], slicer->layers.size()); // new mesh in storage had settings from the Mesh
         SliceMeshStorage& meshStorage = storage.meshes.back();
+        if (preview_layer_stride == 0)
+        { // a preview only generates the walls, from the layer parts of each mesh
+            meshStorage.instance_source_mesh_idx = instances.getSourceMeshIdx(meshIdx);
+            meshStorage.instance_offset = instances.getOffset(meshIdx);
+        }
 
         const bool is_support_modifier = AreaSupport::handleSupportModifierMesh(storage, mesh, slicer);
 
         if (!is_support_modifier)
         { // only create layer parts for normal meshes
             createLayerParts(meshStorage, slicer, mesh.getSettingBoolean("meshfix_union_all"), mesh.getSettingBoolean("meshfix_union_all_remove_holes"));
+            simplifyLayerOutlines(meshStorage);
         }
 
         bool has_raft = getSettingAsPlatformAdhesion("adhesion_type") == EPlatformAdhesion::RAFT;
@@ -170,9 +359,8 @@ bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeepe
         for (unsigned int layer_nr = 0; layer_nr < meshStorage.layers.size(); layer_nr++)
         {
             SliceLayer& layer = meshStorage.layers[layer_nr];
-            meshStorage.layers[layer_nr].printZ += 
-                getSettingInMicrons("layer_height_0")
-                - initial_slice_z;
+            // from the height at which the layer is sliced to its top: half a normal layer below the top for the first layer, the middle for the others
+            layer.printZ += (layer_nr == 0)? initial_layer_thickness - layer_heights.slice_z[0] : layer_heights.thicknesses[layer_nr] / 2;
             if (has_raft)
             {
                 ExtruderTrain* train = storage.meshgroup->getExtruderTrain(getSettingAsIndex("adhesion_extruder_nr"));
@@ -191,11 +379,13 @@ bool FffPolygonGenerator::sliceModel(MeshGroup* meshgroup, TimeKeeper& timeKeepe
 
         Progress::messageProgress(Progress::Stage::PARTS, meshIdx + 1, slicerList.size());
     }
+    MemoryReport::report("slice", storage);
     return true;
 }
 
 void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper& time_keeper)
 {
+    ThreadPool::ThreadLimit thread_limit(hasSetting("thread_count_areas")? std::max(0, getSettingAsCount("thread_count_areas")) : 0); // stages scale differently, so each can be limited to fewer threads
     // compute layer count and remove first empty layers
     // there is no separate progress stage for removeEmptyFisrtLayer (TODO)
     unsigned int slice_layer_count = 0;
@@ -207,6 +397,11 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
         }
     }
 
+    for (SliceMeshStorage& mesh : storage.meshes)
+    {
+        mesh.resolveLayerSettings(storage);
+    }
+
     // handle meshes
     std::vector<double> mesh_timings;
     for (unsigned int mesh_idx = 0; mesh_idx < storage.meshes.size(); mesh_idx++)
@@ -215,7 +410,9 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
     }
     ProgressStageEstimator inset_skin_progress_estimate(mesh_timings);
 
+    startSpillingLayerGeometry(storage); // the layers are compressed and spilled as soon as their areas are finished
     Progress::messageProgressStage(Progress::Stage::INSET_SKIN, &time_keeper);
+    SettingsTrace::Stage trace_stage("insets"); // the skin is processed interleaved with the walls, see processBasicWallsSkinInfill
     std::vector<unsigned int> mesh_order;
     { // compute mesh order
         std::multimap<int, unsigned int> order_to_mesh_indices;
@@ -228,26 +425,61 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
             mesh_order.push_back(order_and_mesh_idx.second);
         }
     }
-    for (unsigned int mesh_order_idx(0); mesh_order_idx < mesh_order.size(); ++mesh_order_idx)
+    for (unsigned int mesh_order_idx(0); mesh_order_idx < mesh_order.size() && !ThreadPool::isCancelled(); ++mesh_order_idx)
     {
-        processBasicWallsSkinInfill(storage, mesh_order_idx, mesh_order, inset_skin_progress_estimate);
+        Profiler::Zone zone("insetsSkinInfill");
+        SliceMeshStorage& mesh = storage.meshes[mesh_order[mesh_order_idx]];
+        if (mesh.instance_source_mesh_idx >= 0)
+        { // the source mesh has the same infill mesh order and a lower index, so it has been processed already
+            inset_skin_progress_estimate.nextStage(new ProgressEstimatorLinear(1));
+            MeshInstances::translateAreas(storage.meshes[mesh.instance_source_mesh_idx], mesh);
+        }
+        else
+        {
+            processBasicWallsSkinInfill(storage, mesh_order_idx, mesh_order, inset_skin_progress_estimate);
+        }
         Progress::messageProgress(Progress::Stage::INSET_SKIN, mesh_order_idx + 1, storage.meshes.size());
     }
+    MemoryReport::report("insetsSkinInfill", storage);
+    if (ThreadPool::isCancelled())
+    {
+        return;
+    }
 
     log("Layer count: %i\n", storage.print_layer_count);
 
     //layerparts2HTML(storage, "output/output.html");
 
+    processSupport(storage, time_keeper);
+    if (ThreadPool::isCancelled())
+    {
+        return;
+    }
+
+    processHelpersAndDerivedAreas(storage, true);
+}
+
+void FffPolygonGenerator::processSupport(SliceDataStorage& storage, TimeKeeper& time_keeper)
+{
     Progress::messageProgressStage(Progress::Stage::SUPPORT, &time_keeper);
 
-    AreaSupport::generateSupportAreas(storage, storage.print_layer_count);
+    {
+        Profiler::Zone zone("support");
+        SettingsTrace::Stage trace_stage("support");
+        AreaSupport::generateSupportAreas(storage, storage.print_layer_count);
+    }
+    MemoryReport::report("support", storage);
+}
 
+void FffPolygonGenerator::processHelpersAndDerivedAreas(SliceDataStorage& storage, bool process_perimeter_gaps_and_derived_areas)
+{
+    SettingsTrace::Stage trace_stage("helpers");
     // we need to remove empty layers after we have procesed the insets
     // processInsets might throw away parts if they have no wall at all (cause it doesn't fit)
     // brim depends on the first layer not being empty
     // only remove empty layers if we haven't generate support, because then support was added underneath the model.
     //   for some materials it's better to print on support than on the buildplate.
-    removeEmptyFirstLayers(storage, getSettingInMicrons("layer_height"), storage.print_layer_count); // changes storage.print_layer_count!
+    removeEmptyFirstLayers(storage, storage.print_layer_count); // changes storage.print_layer_count!
     if (storage.print_layer_count == 0)
     {
         log("Stopping process because there are no non-empty layers.\n");
@@ -266,11 +498,13 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
     }
     */
 
+    storage.computeExtrudersUsedPerLayer(); // computed again at the end, once the helpers and the perimeter gaps have been added
     computePrintHeightStatistics(storage);
 
     // handle helpers
     storage.primeTower.generatePaths(storage);
     storage.primeTower.subtractFromSupport(storage);
+    storage.invalidateLayerOutlinesCache(); // the support has been added and the empty first layers have been removed
     
     logDebug("Processing ooze shield\n");
     processOozeShield(storage);
@@ -281,13 +515,24 @@ void FffPolygonGenerator::slices2polygons(SliceDataStorage& storage, TimeKeeper&
     logDebug("Processing platform adhesion\n");
     processPlatformAdhesion(storage);
 
-    processPerimeterGaps(storage);
-
-    // meshes post processing
-    for (SliceMeshStorage& mesh : storage.meshes)
+    if (process_perimeter_gaps_and_derived_areas)
     {
-        processDerivedWallsSkinInfill(mesh);
+        SettingsTrace::Stage trace_stage("infill");
+        processPerimeterGaps(storage);
+
+        // meshes post processing
+        for (SliceMeshStorage& mesh : storage.meshes)
+        {
+            processDerivedWallsSkinInfill(mesh);
+        }
     }
+    // the raft outline has been added and fuzzy skin may have changed the outlines, but from here on the layers don't change anymore
+    storage.precomputeLayerOutlines();
+    storage.computeExtrudersUsedPerLayer();
+    MemoryReport::report("generateAreas", storage);
+
+    // only the layers being planned are kept in full from here on
+    compressLayerGeometry(storage);
 }
 
 void FffPolygonGenerator::processBasicWallsSkinInfill(SliceDataStorage& storage, unsigned int mesh_order_idx, std::vector<unsigned int>& mesh_order, ProgressStageEstimator& inset_skin_progress_estimate)
@@ -300,42 +545,14 @@ void FffPolygonGenerator::processBasicWallsSkinInfill(SliceDataStorage& storage,
         processInfillMesh(storage, mesh_order_idx, mesh_order);
     }
     
-    // TODO: make progress more accurate!!
-    // note: estimated time for     insets : skins = 22.953 : 48.858
-    std::vector<double> walls_vs_skin_timing({22.953, 48.858});
-    ProgressStageEstimator* mesh_inset_skin_progress_estimator = new ProgressStageEstimator(walls_vs_skin_timing);
-    
-    inset_skin_progress_estimate.nextStage(mesh_inset_skin_progress_estimator); // the stage of this function call
-    
-    ProgressEstimatorLinear* inset_estimator = new ProgressEstimatorLinear(mesh_layer_count);
-    mesh_inset_skin_progress_estimator->nextStage(inset_estimator);
-    
-    
-    // walls
-    unsigned int processed_layer_count = 0;
-#pragma omp parallel for default(none) shared(mesh_layer_count, mesh, inset_skin_progress_estimate, processed_layer_count) schedule(dynamic)
-    for (unsigned int layer_number = 0; layer_number < mesh.layers.size(); layer_number++)
-    {
-        logDebug("Processing insets for layer %i of %i\n", layer_number, mesh_layer_count);
-        processInsets(mesh, layer_number);
-#ifdef _OPENMP
-        if (omp_get_thread_num() == 0)
-#endif
-        { // progress estimation is done only in one thread so that no two threads message progress at the same time
-            int _processed_layer_count;
-#pragma omp atomic read
-                _processed_layer_count = processed_layer_count;
-            double progress = inset_skin_progress_estimate.progress(_processed_layer_count);
-            Progress::messageProgress(Progress::Stage::INSET_SKIN, progress * 100, 100);
-        }
-#pragma omp atomic
-        processed_layer_count++;
-    }
-
-    ProgressEstimatorLinear* skin_estimator = new ProgressEstimatorLinear(mesh_layer_count);
-    mesh_inset_skin_progress_estimator->nextStage(skin_estimator);
-
-    bool process_infill = mesh.getSettingInMicrons("infill_line_distance") > 0;
+    ProgressEstimatorLinear* inset_skin_estimator = new ProgressEstimatorLinear(2 * mesh_layer_count); // one step for the walls and one for the skin and infill of each layer
+    inset_skin_progress_estimate.nextStage(inset_skin_estimator); // the stage of this function call
+
+    bool process_infill;
+    {
+        SettingsTrace::ThreadStage trace_stage("skin");
+        process_infill = mesh.getSettingInMicrons("infill_line_distance") > 0;
+    }
     if (!process_infill)
     { // do process infill anyway if it's modified by modifier meshes
         for (unsigned int other_mesh_order_idx(mesh_order_idx + 1); other_mesh_order_idx < mesh_order.size(); ++other_mesh_order_idx)
@@ -353,106 +570,468 @@ void FffPolygonGenerator::processBasicWallsSkinInfill(SliceDataStorage& storage,
             }
         }
     }
-    // skin & infill
-//     Progress::messageProgressStage(Progress::Stage::SKIN, &time_keeper);
+    const bool spiralize = getSettingBoolean("magic_spiralize");
     int mesh_max_bottom_layer_count = 0;
-    if (getSettingBoolean("magic_spiralize"))
+    if (spiralize)
     {
-        mesh_max_bottom_layer_count = std::max(mesh_max_bottom_layer_count, mesh.getSettingAsCount("bottom_layers"));
+        mesh_max_bottom_layer_count = std::max(mesh_max_bottom_layer_count, mesh.layer_settings.bottom_layers);
     }
 
-    processed_layer_count = 0;
-#pragma omp parallel default(none) shared(mesh_layer_count, mesh, mesh_max_bottom_layer_count, process_infill, inset_skin_progress_estimate, processed_layer_count)
+    // walls, skin & infill
+    // The skin of a layer is computed from the walls of the layers from bottom_layers below up to top_layers above it,
+    // so instead of waiting for the walls of all layers the skin of a layer is processed as soon as the walls it depends on are done.
+    // Walls are claimed bottom to top and skins are claimed bottom to top, so the walls below a layer are always done before its skin is claimed.
+    const int layer_count = mesh.layers.size();
+    const int skin_layers_above = std::max(0, mesh.layer_settings.top_layers);
+    std::unique_ptr<SkinLayerWindowIntersections> down_windows;
+    std::unique_ptr<SkinLayerWindowIntersections> up_windows;
+    createSkinLayerWindows(mesh, down_windows, up_windows);
+    const std::vector<int> insets_source_layer_nr = findLayersWithSameInsets(mesh);
+    std::vector<bool> walls_done(layer_count, false);
+    int next_walls_layer_nr = 0; // the lowest layer of which walls processing hasn't started yet
+    int walls_done_layer_count = 0; // the number of layers from the bottom of which the walls are all done
+    int next_skin_layer_nr = 0; // the lowest layer of which skin processing hasn't started yet
+
+    // Where the later stages don't change the layers, the areas of a layer are finished along with its skin and infill,
+    // and the layer is compressed once no other layer reads its walls anymore, so that not all layers are kept in full at once.
+    // The skin layer windows intersect the walls up to twice their size away, the bridge angles read the layer below and copied walls are read from their source layer.
+    // The bottom layers are finished afterwards, since the empty layers below them may still be removed, which changes which layers have gradual infill areas.
+    const bool finish_layers = canFinishLayerAreasAlongWithSkin(storage, mesh);
+    const int bottom_layers = mesh.layer_settings.bottom_layers;
+    std::vector<std::vector<int>> compressed_layers_per_skin_layer(layer_count); // the layers which can be compressed once the skin is done up to each layer
+    if (finish_layers)
     {
-
-#pragma omp for schedule(dynamic)
-        for (unsigned int layer_number = 0; layer_number < mesh.layers.size(); layer_number++)
+        const int walls_read_distance = 2 * std::max(std::max(mesh.layer_settings.bottom_layers, mesh.layer_settings.top_layers), 1);
+        std::vector<int> last_reading_layer_nr(layer_count);
+        for (int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+        {
+            last_reading_layer_nr[layer_nr] = std::min(layer_count - 1, layer_nr + walls_read_distance);
+        }
+        for (int layer_nr = 0; layer_nr < layer_count; layer_nr++)
         {
-            logDebug("Processing skins and infill layer %i of %i\n", layer_number, mesh_layer_count);
-            if (!getSettingBoolean("magic_spiralize") || static_cast<int>(layer_number) < mesh_max_bottom_layer_count)    //Only generate up/downskin and infill for the first X layers when spiralize is choosen.
+            const int source_layer_nr = insets_source_layer_nr[layer_nr];
+            if (source_layer_nr >= 0)
             {
-                processSkinsAndInfill(mesh, layer_number, process_infill);
+                last_reading_layer_nr[source_layer_nr] = std::max(last_reading_layer_nr[source_layer_nr], layer_nr);
             }
-#ifdef _OPENMP
-            if (omp_get_thread_num() == 0)
-#endif
-            { // progress estimation is done only in one thread so that no two threads message progress at the same time
-                int _processed_layer_count;
-#pragma omp atomic read
-                    _processed_layer_count = processed_layer_count;
-                double progress = inset_skin_progress_estimate.progress(_processed_layer_count);
-                Progress::messageProgress(Progress::Stage::INSET_SKIN, progress * 100, 100);
+        }
+        for (int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+        {
+            compressed_layers_per_skin_layer[last_reading_layer_nr[layer_nr]].push_back(layer_nr);
+        }
+    }
+    std::vector<bool> skin_done(layer_count, false);
+    int skin_done_layer_count = 0; // the number of layers from the bottom of which the skin is all done
+    int first_printed_layer_nr = -1; // the lowest layer with walls, once the walls are done up to it
+    const std::function<bool (int)> is_finished_along_with_skin = [&](int layer_nr)
+    { // the empty layers which may be removed are below the first printed layer
+        return finish_layers && first_printed_layer_nr >= 0 && layer_nr >= first_printed_layer_nr + bottom_layers && layer_nr > 0;
+    };
+    int shard_skin_layer_start = 0;
+    int shard_skin_layer_end = layer_count;
+    const bool shard_skin_only = getShardSkinLayerRange(storage, mesh, shard_skin_layer_start, shard_skin_layer_end);
+    const std::function<bool (int)> is_skin_needed = [&](int layer_nr)
+    { // no more empty first layers are removed than there are below the first printed layer, so the shard is at most that many layers higher while slicing
+        return !shard_skin_only || (layer_nr >= shard_skin_layer_start && (first_printed_layer_nr < 0 || layer_nr < shard_skin_layer_end + first_printed_layer_nr));
+    };
+    Progress::StepCounter progress(Progress::Stage::INSET_SKIN, 2 * layer_count, [&inset_skin_progress_estimate](int processed_layer_count) { return inset_skin_progress_estimate.progress(processed_layer_count); });
+    std::mutex claim_mutex; // guards which layers are claimed and which walls are done
+    std::condition_variable walls_done_changed; // notified when the walls of a layer are done
+    constexpr std::chrono::milliseconds cancellation_check_interval(10); // a waiting thread checks for a cancellation now and then, which doesn't notify it
+    const std::function<void ()> process_layers = [&]()
+    {
+        while (!ThreadPool::isCancelled()) // a cancelled slice leaves the layers which haven't been claimed yet
+        {
+            int walls_layer_nr = -1;
+            int skin_layer_nr = -1;
+            bool finish_skin_layer = false; // whether to finish the areas of the skin layer
+            bool skin_needed = true; // whether the skin layer is written, or read by a layer which is
+            bool finished = false;
+            {
+                std::unique_lock<std::mutex> claim_lock(claim_mutex);
+                if (next_skin_layer_nr < layer_count && std::min(layer_count, next_skin_layer_nr + skin_layers_above + 1) <= walls_done_layer_count)
+                {
+                    skin_layer_nr = next_skin_layer_nr++;
+                    finish_skin_layer = is_finished_along_with_skin(skin_layer_nr); // the walls are done up to above it, so the first printed layer is known if it's below
+                    skin_needed = is_skin_needed(skin_layer_nr);
+                }
+                else if (next_walls_layer_nr < layer_count)
+                {
+                    walls_layer_nr = next_walls_layer_nr++;
+                }
+                else if (next_skin_layer_nr == layer_count)
+                {
+                    finished = true;
+                }
+                else
+                { // the skin of the next layer still depends on walls which are being processed by other threads
+                    walls_done_changed.wait_for(claim_lock, cancellation_check_interval);
+                    continue;
+                }
+            }
+            if (finished)
+            {
+                break;
             }
-#pragma omp atomic
-                processed_layer_count++;
+            if (walls_layer_nr >= 0)
+            {
+                Profiler::Zone zone("walls");
+                logDebug("Processing insets for layer %i of %i\n", walls_layer_nr, mesh_layer_count);
+                const int source_layer_nr = insets_source_layer_nr[walls_layer_nr];
+                if (source_layer_nr >= 0)
+                { // the source layer has been claimed before this one, so it is done or being processed by another thread
+                    bool source_done;
+                    {
+                        std::unique_lock<std::mutex> claim_lock(claim_mutex);
+                        while (!walls_done[source_layer_nr] && !ThreadPool::isCancelled())
+                        {
+                            walls_done_changed.wait_for(claim_lock, cancellation_check_interval);
+                        }
+                        source_done = walls_done[source_layer_nr];
+                    }
+                    if (!source_done)
+                    { // cancelled; the source layer may not be finished
+                        break;
+                    }
+                    copyInsets(mesh, source_layer_nr, walls_layer_nr);
+                }
+                else
+                {
+                    processInsets(mesh, walls_layer_nr);
+                }
+                {
+                    std::lock_guard<std::mutex> claim_lock(claim_mutex);
+                    walls_done[walls_layer_nr] = true;
+                    while (walls_done_layer_count < layer_count && walls_done[walls_done_layer_count])
+                    {
+                        if (first_printed_layer_nr < 0)
+                        {
+                            for (const SliceLayerPart& part : mesh.layers[walls_done_layer_count].parts)
+                            {
+                                if (part.print_outline.size() > 0)
+                                {
+                                    first_printed_layer_nr = walls_done_layer_count;
+                                    break;
+                                }
+                            }
+                        }
+                        walls_done_layer_count++;
+                    }
+                }
+                walls_done_changed.notify_all();
+            }
+            else
+            {
+                Profiler::Zone zone("skin");
+                SettingsTrace::ThreadStage trace_stage("skin");
+                logDebug("Processing skins and infill layer %i of %i\n", skin_layer_nr, mesh_layer_count);
+                if (skin_needed && (!spiralize || skin_layer_nr < mesh_max_bottom_layer_count))    //Only generate up/downskin and infill for the first X layers when spiralize is choosen.
+                {
+                    processSkinsAndInfill(mesh, skin_layer_nr, process_infill, down_windows.get(), up_windows.get());
+                }
+                if (finish_skin_layer)
+                {
+                    finishLayerAreas(mesh, skin_layer_nr);
+                }
+                std::vector<int> compressed_layer_nrs;
+                {
+                    std::lock_guard<std::mutex> claim_lock(claim_mutex);
+                    skin_done[skin_layer_nr] = true;
+                    for (; skin_done_layer_count < layer_count && skin_done[skin_done_layer_count]; skin_done_layer_count++)
+                    {
+                        for (int layer_nr : compressed_layers_per_skin_layer[skin_done_layer_count])
+                        {
+                            if (is_finished_along_with_skin(layer_nr))
+                            {
+                                compressed_layer_nrs.push_back(layer_nr);
+                            }
+                        }
+                    }
+                }
+                for (int layer_nr : compressed_layer_nrs)
+                {
+                    storage.compressLayerGeometry(mesh, layer_nr);
+                }
+            }
+            progress.step();
+        }
+    };
+    // Each thread keeps claiming layers until all are done, so the calling thread finishes the work by itself if the other threads are busy elsewhere.
+    ThreadPool::TaskGroup workers;
+    for (unsigned int worker_idx = 1; worker_idx < ThreadPool::getThreadCount(); worker_idx++)
+    {
+        workers.run(process_layers);
+    }
+    process_layers();
+    workers.wait();
+}
+
+bool FffPolygonGenerator::isLayerGeometryCompressed(const SliceDataStorage& storage) const
+{
+    // The layers which don't fit in the memory budget, in megabytes, are moved to a temporary file, so they are compressed too.
+    // Spiralize keeps pointers to the walls of all layers, which compressing them would free.
+    const bool compress_layer_geometry = storage.hasSetting("compress_layer_geometry") && storage.getSettingBoolean("compress_layer_geometry");
+    const bool has_memory_budget = storage.hasSetting("layer_geometry_memory_budget") && storage.getSettingAsCount("layer_geometry_memory_budget") > 0;
+    return (compress_layer_geometry || has_memory_budget) && !getSettingBoolean("magic_spiralize");
+}
+
+bool FffPolygonGenerator::canFinishLayerAreasAlongWithSkin(const SliceDataStorage& storage, const SliceMeshStorage& mesh) const
+{
+    if (!isLayerGeometryCompressed(storage))
+    {
+        return false;
+    }
+    for (const SliceMeshStorage& other_mesh : storage.meshes)
+    {
+        if (other_mesh.getSettingBoolean("infill_mesh") || other_mesh.instance_source_mesh_idx >= 0)
+        { // infill meshes change the areas of the meshes processed before them and instances copy the areas of their source mesh
+            return false;
+        }
+    }
+    if (mesh.getSettingBoolean("support_mesh") || mesh.getSettingBoolean("anti_overhang_mesh")
+        || mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL)
+    {
+        return false;
+    }
+    // spaghetti infill, gradual infill, combined infill layers and the cubic subdivision octree read the areas of several layers,
+    // and fuzzy skin changes the outlines, see processDerivedWallsSkinInfill
+    if (mesh.getSettingBoolean("spaghetti_infill_enabled") || mesh.getSettingAsCount("gradual_infill_steps") > 0 || mesh.layer_settings.combined_infill_layers > 1
+        || mesh.getSettingAsFillMethod("infill_pattern") == EFillMethod::CUBICSUBDIV || mesh.getSettingBoolean("magic_fuzzy_skin_enabled"))
+    {
+        return false;
+    }
+    // support towers are placed where the walls of a layer are too small to be supported, see AreaSupport::detectOverhangPoints
+    if (mesh.getSettingBoolean("support_enable")
+        && storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex("support_infill_extruder_nr"))->getSettingBoolean("support_use_towers"))
+    {
+        return false;
+    }
+    return true;
+}
+
+bool FffPolygonGenerator::getShardSkinLayerRange(const SliceDataStorage& storage, const SliceMeshStorage& mesh, int& layer_start, int& layer_end) const
+{
+    if (!hasSetting("shard_layer_start") && !hasSetting("shard_layer_end"))
+    {
+        return false;
+    }
+    if (getSettingAsCount("machine_extruder_count") > 1)
+    { // the extruders used on all layers determine the order of the extruders and the prime tower on the layers of the shard
+        return false;
+    }
+    for (const SliceMeshStorage& other_mesh : storage.meshes)
+    {
+        if (other_mesh.getSettingBoolean("infill_mesh") || other_mesh.getSettingBoolean("spaghetti_infill_enabled"))
+        { // infill meshes are limited to the infill of the other meshes and the spaghetti infill volumes stack up over any number of layers
+            return false;
         }
+    }
+    // the gradual infill of a layer reads the infill of the layers above and the combined infill the layers around
+    const int halo = std::max(0, mesh.getSettingAsCount("gradual_infill_steps")) * mesh.layer_settings.gradual_infill_step_layer_count + mesh.layer_settings.combined_infill_layers + 1;
+    layer_start = hasSetting("shard_layer_start")? getSettingAsCount("shard_layer_start") - halo : 0;
+    layer_end = hasSetting("shard_layer_end")? getSettingAsCount("shard_layer_end") + halo : mesh.layers.size();
+    return true;
+}
+
+void FffPolygonGenerator::finishLayerAreas(SliceMeshStorage& mesh, unsigned int layer_nr)
+{
+    MeshPerimeterGapSettings perimeter_gap_settings;
+    if (getPerimeterGapSettings(mesh, perimeter_gap_settings))
+    {
+        for (SliceLayerPart& part : mesh.layers[layer_nr].parts)
+        {
+            processPerimeterGaps(part, perimeter_gap_settings);
+        }
+    }
+    // without gradual steps the infill areas of a layer don't depend on the other layers
+    SkinInfillAreaComputation::generateGradualInfill(mesh, mesh.layer_settings.gradual_infill_step_layer_count, 0, layer_nr, layer_nr + 1);
+    if (layer_nr > 0)
+    {
+        computeBridgeAngles(mesh, layer_nr);
+    }
+}
+
+void FffPolygonGenerator::startSpillingLayerGeometry(SliceDataStorage& storage) const
+{
+    if (!isLayerGeometryCompressed(storage))
+    {
+        return;
+    }
+    const int layer_geometry_memory_budget = storage.hasSetting("layer_geometry_memory_budget") ? storage.getSettingAsCount("layer_geometry_memory_budget") : 0;
+    storage.startSpillingLayerGeometry(static_cast<uint64_t>(std::max(0, layer_geometry_memory_budget)) * 1000000);
+}
+
+void FffPolygonGenerator::compressLayerGeometry(SliceDataStorage& storage)
+{
+    if (!isLayerGeometryCompressed(storage))
+    {
+        return;
+    }
+    Profiler::Zone zone("compressLayerGeometry");
+    int layer_count = 0;
+    for (const SliceMeshStorage& mesh : storage.meshes)
+    {
+        layer_count = std::max(layer_count, static_cast<int>(mesh.layers.size()));
+    }
+    ThreadPool::parallelFor(0, layer_count, [&storage](int layer_nr)
+    {
+        storage.compressLayerGeometry(layer_nr); // the layers compressed along with their skin and infill are left as they are
+    });
+    storage.finishSpillingLayerGeometry();
+    MemoryReport::report("compressLayerGeometry", storage);
+}
+
+
+void FffPolygonGenerator::processSkinsAndInfillOfAllLayers(SliceMeshStorage& mesh, bool process_infill)
+{
+    int layer_count = mesh.layers.size();
+    if (getSettingBoolean("magic_spiralize"))
+    { // only generate up/downskin and infill for the bottom layers when spiralizing
+        layer_count = std::min(layer_count, mesh.layer_settings.bottom_layers);
+    }
+    std::unique_ptr<SkinLayerWindowIntersections> down_windows;
+    std::unique_ptr<SkinLayerWindowIntersections> up_windows;
+    createSkinLayerWindows(mesh, down_windows, up_windows);
+    ThreadPool::parallelFor(0, layer_count, [&](int layer_nr)
+    {
+        Profiler::Zone zone("skin");
+        processSkinsAndInfill(mesh, layer_nr, process_infill, down_windows.get(), up_windows.get());
+    });
+}
+
+void FffPolygonGenerator::createSkinLayerWindows(const SliceMeshStorage& mesh, std::unique_ptr<SkinLayerWindowIntersections>& down_windows, std::unique_ptr<SkinLayerWindowIntersections>& up_windows)
+{
+    if (mesh.layer_settings.skin_sliding_window && !mesh.layer_settings.skin_no_small_gaps_heuristic)
+    {
+        if (mesh.layer_settings.bottom_layers > 0)
+        {
+            down_windows.reset(new SkinLayerWindowIntersections(mesh, mesh.layer_settings.bottom_layers, mesh.layer_settings.wall_line_count));
+        }
+        if (mesh.layer_settings.top_layers > 0)
+        {
+            up_windows.reset(new SkinLayerWindowIntersections(mesh, mesh.layer_settings.top_layers, mesh.layer_settings.wall_line_count));
         }
+    }
 }
 
 void FffPolygonGenerator::processPerimeterGaps(SliceDataStorage& storage)
 {
+    Profiler::Zone zone("perimeterGaps");
+    std::vector<MeshPerimeterGapSettings> mesh_settings;
+    // the perimeter gaps of a part only depend on the walls, skin and infill of that same part,
+    // so the parts of all meshes are processed in one parallel loop, rather than in a loop per mesh over its layers
+    std::vector<std::pair<SliceLayerPart*, unsigned int>> parts_and_settings_idx;
     for (SliceMeshStorage& mesh : storage.meshes)
     {
-        constexpr int perimeter_gaps_extra_offset = 15; // extra offset so that the perimeter gaps aren't created everywhere due to rounding errors
-        bool fill_perimeter_gaps = mesh.getSettingAsFillPerimeterGapMode("fill_perimeter_gaps") != FillPerimeterGapMode::NOWHERE
-                                    && !getSettingBoolean("magic_spiralize");
-        if (!fill_perimeter_gaps)
+        MeshPerimeterGapSettings settings;
+        if (!getPerimeterGapSettings(mesh, settings))
         {
             continue;
         }
-        bool fill_gaps_between_inner_wall_and_skin_or_infill =
-            mesh.getSettingInMicrons("infill_line_distance") > 0
-            && !mesh.getSettingBoolean("infill_hollow")
-            && mesh.getSettingInMicrons("infill_overlap_mm") >= 0;
-        coord_t wall_line_width_0 = mesh.getSettingInMicrons("wall_line_width_0");
-        coord_t wall_line_width_x = mesh.getSettingInMicrons("wall_line_width_x");
         for (SliceLayer& layer : mesh.layers)
         {
+            if (layer.geometry_compressed)
+            { // finished along with its skin and infill, see finishLayerAreas
+                continue;
+            }
             for (SliceLayerPart& part : layer.parts)
             {
-                 // handle perimeter gaps of normal insets
-                int line_width = wall_line_width_0;
-                for (unsigned int inset_idx = 0; inset_idx < part.insets.size() - 1; inset_idx++)
-                {
-                    const Polygons outer = part.insets[inset_idx].offset(-1 * line_width / 2 - perimeter_gaps_extra_offset);
-                    line_width = wall_line_width_x;
+                parts_and_settings_idx.emplace_back(&part, mesh_settings.size());
+            }
+        }
+        mesh_settings.push_back(settings);
+    }
 
-                    Polygons inner = part.insets[inset_idx + 1].offset(line_width / 2);
-                    part.perimeter_gaps.add(outer.difference(inner));
-                }
+    const int part_count = parts_and_settings_idx.size();
+    ThreadPool::parallelFor(0, part_count, [&](int part_idx)
+    {
+        processPerimeterGaps(*parts_and_settings_idx[part_idx].first, mesh_settings[parts_and_settings_idx[part_idx].second]);
+    });
+}
 
-                // gap between inner wall and skin/infill
-                if (fill_gaps_between_inner_wall_and_skin_or_infill)
-                {
-                    const Polygons outer = part.insets.back().offset(-1 * line_width / 2 - perimeter_gaps_extra_offset);
+bool FffPolygonGenerator::getPerimeterGapSettings(const SliceMeshStorage& mesh, MeshPerimeterGapSettings& settings) const
+{
+    bool fill_perimeter_gaps = mesh.getSettingAsFillPerimeterGapMode("fill_perimeter_gaps") != FillPerimeterGapMode::NOWHERE
+                                && !getSettingBoolean("magic_spiralize");
+    if (!fill_perimeter_gaps)
+    {
+        return false;
+    }
+    settings.fill_gaps_between_inner_wall_and_skin_or_infill =
+        mesh.getSettingInMicrons("infill_line_distance") > 0
+        && !mesh.getSettingBoolean("infill_hollow")
+        && mesh.getSettingInMicrons("infill_overlap_mm") >= 0;
+    settings.wall_line_width_0 = mesh.getSettingInMicrons("wall_line_width_0");
+    settings.wall_line_width_x = mesh.getSettingInMicrons("wall_line_width_x");
+    return true;
+}
 
-                    Polygons inner = part.infill_area;
-                    for (const SkinPart& skin_part : part.skin_parts)
-                    {
-                        inner.add(skin_part.outline);
-                    }
-                    inner = inner.unionPolygons();
-                    part.perimeter_gaps.add(outer.difference(inner));
-                }
+void FffPolygonGenerator::processPerimeterGaps(SliceLayerPart& part, const MeshPerimeterGapSettings& settings)
+{
+    constexpr int perimeter_gaps_extra_offset = 15; // extra offset so that the perimeter gaps aren't created everywhere due to rounding errors
+    const bool fill_gaps_between_inner_wall_and_skin_or_infill = settings.fill_gaps_between_inner_wall_and_skin_or_infill;
+    const coord_t wall_line_width_0 = settings.wall_line_width_0;
+    const coord_t wall_line_width_x = settings.wall_line_width_x;
+
+    // handle perimeter gaps of normal insets
+    // each wall is offset both outward (the inner side of the gap toward the previous wall)
+    // and inward (the outer side of the gap toward the next wall, skin or infill) in one go
+    Polygons outer; // the inward offset of the previous wall
+    for (unsigned int inset_idx = 0; inset_idx < part.insets.size(); inset_idx++)
+    {
+        const int line_width = (inset_idx == 0)? wall_line_width_0 : wall_line_width_x;
+        const bool has_inner_gap = inset_idx > 0;
+        const bool has_outer_gap = inset_idx + 1 < part.insets.size() || fill_gaps_between_inner_wall_and_skin_or_infill;
+        std::vector<int> offset_distances;
+        if (has_inner_gap)
+        {
+            offset_distances.push_back(line_width / 2);
+        }
+        if (has_outer_gap)
+        {
+            offset_distances.push_back(-1 * line_width / 2 - perimeter_gaps_extra_offset);
+        }
+        std::vector<Polygons> offsetted = part.insets[inset_idx].offsetMulti(offset_distances);
+        if (has_inner_gap)
+        {
+            part.perimeter_gaps.add(outer.difference(offsetted.front()));
+        }
+        if (has_outer_gap)
+        {
+            outer = std::move(offsetted.back());
+        }
+    }
 
-                // add perimeter gaps for skin insets
-                for (SkinPart& skin_part : part.skin_parts)
-                {
-                    if (skin_part.insets.size() > 0)
-                    {
-                        // add perimeter gaps between the outer skin inset and the innermost wall
-                        const Polygons outer = skin_part.outline;
-                        const Polygons inner = skin_part.insets[0].offset(wall_line_width_x / 2 + perimeter_gaps_extra_offset);
-                        skin_part.perimeter_gaps.add(outer.difference(inner));
-
-                        for (unsigned int inset_idx = 1; inset_idx < skin_part.insets.size(); inset_idx++)
-                        { // add perimeter gaps between consecutive skin walls
-                            const Polygons outer = skin_part.insets[inset_idx - 1].offset(-1 * wall_line_width_x / 2 - perimeter_gaps_extra_offset);
-                            const Polygons inner = skin_part.insets[inset_idx].offset(wall_line_width_x / 2);
-                            skin_part.perimeter_gaps.add(outer.difference(inner));
-                        }
-                    }
-                }
+    // gap between inner wall and skin/infill
+    if (fill_gaps_between_inner_wall_and_skin_or_infill && !part.insets.empty())
+    {
+        Polygons inner = part.infill_area;
+        for (const SkinPart& skin_part : part.skin_parts)
+        {
+            inner.add(skin_part.outline);
+        }
+        inner = inner.unionPolygons();
+        part.perimeter_gaps.add(outer.difference(inner));
+    }
+
+    // add perimeter gaps for skin insets
+    for (SkinPart& skin_part : part.skin_parts)
+    {
+        Polygons outer = skin_part.outline; // the outer side of the gap toward the next skin wall
+        for (unsigned int inset_idx = 0; inset_idx < skin_part.insets.size(); inset_idx++)
+        { // add perimeter gaps between the outer skin inset and the innermost wall and between consecutive skin walls
+            const bool has_outer_gap = inset_idx + 1 < skin_part.insets.size();
+            std::vector<int> offset_distances;
+            offset_distances.push_back((inset_idx == 0)? wall_line_width_x / 2 + perimeter_gaps_extra_offset : wall_line_width_x / 2);
+            if (has_outer_gap)
+            {
+                offset_distances.push_back(-1 * wall_line_width_x / 2 - perimeter_gaps_extra_offset);
+            }
+            std::vector<Polygons> offsetted = skin_part.insets[inset_idx].offsetMulti(offset_distances);
+            skin_part.perimeter_gaps.add(outer.difference(offsetted.front()));
+            if (has_outer_gap)
+            {
+                outer = std::move(offsetted.back());
             }
         }
     }
@@ -462,20 +1041,33 @@ void FffPolygonGenerator::processInfillMesh(SliceDataStorage& storage, unsigned
 {
     unsigned int mesh_idx = mesh_order[mesh_order_idx];
     SliceMeshStorage& mesh = storage.meshes[mesh_idx];
-    mesh.layer_nr_max_filled_layer = -1;
-    for (unsigned int layer_idx = 0; layer_idx < mesh.layers.size(); layer_idx++)
+
+    // only the meshes with lower order of which the bounding box overlaps with that of this infill mesh can limit its outline
+    std::vector<unsigned int> other_mesh_indices;
+    const AABB3D aabb = storage.meshgroup->meshes[mesh_idx].getAABB();
+    for (unsigned int other_mesh_idx : mesh_order)
+    {
+        if (other_mesh_idx == mesh_idx)
+        {
+            break; // all previous meshes have been processed
+        }
+        if (aabb.hit(storage.meshgroup->meshes[other_mesh_idx].getAABB()))
+        {
+            other_mesh_indices.push_back(other_mesh_idx);
+        }
+    }
+
+    // each layer only changes the parts of this and the other meshes on that same layer
+    std::vector<uint8_t> layer_is_filled(mesh.layers.size(), false); // not a vector<bool>, of which the layers would share bytes
+    ThreadPool::parallelFor(0, static_cast<int>(mesh.layers.size()), [&](int layer_idx)
     {
         SliceLayer& layer = mesh.layers[layer_idx];
         std::vector<PolygonsPart> new_parts;
 
-        for (unsigned int other_mesh_idx : mesh_order)
+        for (unsigned int other_mesh_idx : other_mesh_indices)
         { // limit the infill mesh's outline to within the infill of all meshes with lower order
-            if (other_mesh_idx == mesh_idx)
-            {
-                break; // all previous meshes have been processed
-            }
             SliceMeshStorage& other_mesh = storage.meshes[other_mesh_idx];
-            if (layer_idx >= other_mesh.layers.size())
+            if (layer_idx >= static_cast<int>(other_mesh.layers.size()))
             { // there can be no interaction between the infill mesh and this other non-infill mesh
                 continue;
             }
@@ -499,12 +1091,16 @@ void FffPolygonGenerator::processInfillMesh(SliceDataStorage& storage, unsigned
                     }
                     else if (new_outline.size() > 1)
                     { // we don't know whether it's a multitude of parts because of newly introduced holes, or because the polygon has been split up
-                        std::vector<PolygonsPart> new_parts_here = new_outline.splitIntoParts();
+                        std::vector<PolygonsPart> new_parts_here = new_outline.splitIntoPartsByContainment();
                         for (PolygonsPart& new_part_here : new_parts_here)
                         {
                             new_parts.push_back(new_part_here);
                         }
                     }
+                    else
+                    { // the outline doesn't reach into the infill of the other part, so it doesn't change that infill either
+                        continue;
+                    }
                     // change the infill area of the non-infill mesh which is to be filled with e.g. lines
                     other_part.infill_area_own = other_part.getOwnInfillArea().difference(part.outline);
                     // note: don't change the part.infill_area, because we change the structure of that area, while the basic area in which infill is printed remains the same
@@ -521,12 +1117,17 @@ void FffPolygonGenerator::processInfillMesh(SliceDataStorage& storage, unsigned
             layer.parts.back().boundaryBox.calculate(part);
         }
 
-        if (layer.parts.size() > 0 || (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL && layer.openPolyLines.size() > 0) )
+        layer_is_filled[layer_idx] = layer.parts.size() > 0 || (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL && layer.openPolyLines.size() > 0);
+    });
+
+    mesh.layer_nr_max_filled_layer = -1;
+    for (unsigned int layer_idx = 0; layer_idx < mesh.layers.size(); layer_idx++)
+    {
+        if (layer_is_filled[layer_idx])
         {
             mesh.layer_nr_max_filled_layer = layer_idx; // last set by the highest non-empty layer
-        } 
+        }
     }
-    
 }
 
 void FffPolygonGenerator::processDerivedWallsSkinInfill(SliceMeshStorage& mesh)
@@ -540,7 +1141,7 @@ void FffPolygonGenerator::processDerivedWallsSkinInfill(SliceMeshStorage& mesh)
     {
 
         // create gradual infill areas
-        SkinInfillAreaComputation::generateGradualInfill(mesh, mesh.getSettingInMicrons("gradual_infill_step_height"), mesh.getSettingAsCount("gradual_infill_steps"));
+        SkinInfillAreaComputation::generateGradualInfill(mesh, mesh.layer_settings.gradual_infill_step_layer_count, mesh.getSettingAsCount("gradual_infill_steps"), 0, mesh.layers.size());
 
         //SubDivCube Pre-compute Octree
         if (mesh.getSettingAsFillMethod("infill_pattern") == EFillMethod::CUBICSUBDIV)
@@ -549,8 +1150,7 @@ void FffPolygonGenerator::processDerivedWallsSkinInfill(SliceMeshStorage& mesh)
         }
 
         // combine infill
-        unsigned int combined_infill_layers = std::max(1U, round_divide(mesh.getSettingInMicrons("infill_sparse_thickness"), std::max(getSettingInMicrons("layer_height"), (coord_t)1))); //How many infill layers to combine to obtain the requested sparse thickness.
-        combineInfillLayers(mesh,combined_infill_layers);
+        combineInfillLayers(mesh, mesh.layer_settings.combined_infill_layers); //How many infill layers to combine to obtain the requested sparse thickness.
     }
 
     // fuzzy skin
@@ -558,6 +1158,9 @@ void FffPolygonGenerator::processDerivedWallsSkinInfill(SliceMeshStorage& mesh)
     {
         processFuzzyWalls(mesh);
     }
+
+    // the outlines of the layers don't change anymore
+    computeBridgeAngles(mesh);
 }
 
 /*
@@ -569,25 +1172,112 @@ void FffPolygonGenerator::processDerivedWallsSkinInfill(SliceMeshStorage& mesh)
 void FffPolygonGenerator::processInsets(SliceMeshStorage& mesh, unsigned int layer_nr) 
 {
     SliceLayer* layer = &mesh.layers[layer_nr];
-    if (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::SURFACE)
+    const MeshLayerSettings& settings = mesh.layer_settings;
+    if (settings.surface_mode != ESurfaceMode::SURFACE)
+    {
+        int inset_count = getInsetCount(mesh, layer_nr);
+        int line_width_x = settings.wall_line_width_x;
+        int line_width_0 = settings.wall_line_width_0;
+        bool recompute_outline_based_on_outer_wall = settings.recompute_outline_based_on_outer_wall;
+        WallsComputation walls_computation(settings.wall_0_inset, line_width_0, line_width_x, inset_count, recompute_outline_based_on_outer_wall);
+        walls_computation.generateInsets(layer);
+    }
+}
+
+int FffPolygonGenerator::getInsetCount(const SliceMeshStorage& mesh, unsigned int layer_nr)
+{
+    const MeshLayerSettings& settings = mesh.layer_settings;
+    int inset_count = settings.wall_line_count;
+    if (getSettingBoolean("magic_spiralize") && static_cast<int>(layer_nr) < settings.bottom_layers && ((layer_nr % 2) + 2) % 2 == 1)//Add extra insets every 2 layers when spiralizing, this makes bottoms of cups watertight.
+        inset_count += 5;
+    if (settings.alternate_extra_perimeter)
     {
-        int inset_count = mesh.getSettingAsCount("wall_line_count");
-        if (getSettingBoolean("magic_spiralize") && static_cast<int>(layer_nr) < mesh.getSettingAsCount("bottom_layers") && ((layer_nr % 2) + 2) % 2 == 1)//Add extra insets every 2 layers when spiralizing, this makes bottoms of cups watertight.
-            inset_count += 5;
-        int line_width_x = mesh.getSettingInMicrons("wall_line_width_x");
-        int line_width_0 = mesh.getSettingInMicrons("wall_line_width_0");
-        if (mesh.getSettingBoolean("alternate_extra_perimeter"))
+        inset_count += ((layer_nr % 2) + 2) % 2;
+    }
+    return inset_count;
+}
+
+std::vector<int> FffPolygonGenerator::findLayersWithSameInsets(const SliceMeshStorage& mesh)
+{
+    const int layer_count = mesh.layers.size();
+    std::vector<int> source_layer_nr(layer_count, -1);
+    if (mesh.layer_settings.surface_mode == ESurfaceMode::SURFACE)
+    { // no walls are generated
+        return source_layer_nr;
+    }
+
+    // compare each layer to the two layers below, so that layers with an alternating number of walls are also found
+    std::vector<int> same_layer_nr(layer_count, -1);
+    ThreadPool::parallelFor(1, layer_count, [&](int layer_nr)
+    {
+        const std::vector<SliceLayerPart>& parts = mesh.layers[layer_nr].parts;
+        if (parts.empty())
         {
-            inset_count += ((layer_nr % 2) + 2) % 2;
+            return;
+        }
+        for (int below_layer_nr = layer_nr - 1; below_layer_nr >= std::max(0, layer_nr - 2); below_layer_nr--)
+        {
+            const std::vector<SliceLayerPart>& below_parts = mesh.layers[below_layer_nr].parts;
+            if (below_parts.size() != parts.size() || getInsetCount(mesh, below_layer_nr) != getInsetCount(mesh, layer_nr))
+            {
+                continue;
+            }
+            bool is_same = true;
+            for (unsigned int part_idx = 0; part_idx < parts.size() && is_same; part_idx++)
+            {
+                is_same = parts[part_idx].outline.isIdentical(below_parts[part_idx].outline);
+            }
+            if (is_same)
+            {
+                same_layer_nr[layer_nr] = below_layer_nr;
+                break;
+            }
+        }
+    });
+
+    // copy from the layer which is actually computed
+    for (int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        const int same = same_layer_nr[layer_nr];
+        if (same >= 0)
+        {
+            source_layer_nr[layer_nr] = (source_layer_nr[same] >= 0) ? source_layer_nr[same] : same;
         }
-        bool recompute_outline_based_on_outer_wall = mesh.getSettingBoolean("support_enable");
-        WallsComputation walls_computation(mesh.getSettingInMicrons("wall_0_inset"), line_width_0, line_width_x, inset_count, recompute_outline_based_on_outer_wall);
-        walls_computation.generateInsets(layer);
     }
+    return source_layer_nr;
 }
 
-void FffPolygonGenerator::removeEmptyFirstLayers(SliceDataStorage& storage, const int layer_height, unsigned int& total_layers)
+void FffPolygonGenerator::copyInsets(SliceMeshStorage& mesh, unsigned int source_layer_nr, unsigned int layer_nr)
 {
+    const std::vector<SliceLayerPart>& source_parts = mesh.layers[source_layer_nr].parts;
+    std::vector<SliceLayerPart>& parts = mesh.layers[layer_nr].parts;
+    unsigned int source_part_idx = 0;
+    for (unsigned int part_idx = 0; part_idx < parts.size(); part_idx++)
+    {
+        SliceLayerPart& part = parts[part_idx];
+        if (source_part_idx < source_parts.size() && part.outline.isIdentical(source_parts[source_part_idx].outline))
+        {
+            const SliceLayerPart& source_part = source_parts[source_part_idx];
+            part.insets = source_part.insets;
+            part.print_outline = source_part.print_outline;
+            source_part_idx++;
+        }
+        else
+        { // this part generated no walls on the source layer
+            parts.erase(parts.begin() + part_idx);
+            part_idx -= 1;
+        }
+    }
+}
+
+void FffPolygonGenerator::removeEmptyFirstLayers(SliceDataStorage& storage, unsigned int& total_layers)
+{
+    // the meshes don't get any content below the lowest layer with parts after slicing, so those layers needn't be checked
+    unsigned int first_filled_mesh_layer = total_layers;
+    for (const SliceMeshStorage& mesh : storage.meshes)
+    {
+        first_filled_mesh_layer = std::min(first_filled_mesh_layer, static_cast<unsigned int>(mesh.layer_nr_min_filled_layer));
+    }
     int n_empty_first_layers = 0;
     for (unsigned int layer_idx = 0; layer_idx < total_layers; layer_idx++)
     { 
@@ -601,6 +1291,11 @@ void FffPolygonGenerator::removeEmptyFirstLayers(SliceDataStorage& storage, cons
                 break;
             }
         }
+        if (layer_idx < first_filled_mesh_layer)
+        {
+            n_empty_first_layers++;
+            continue;
+        }
         for (SliceMeshStorage& mesh : storage.meshes)
         {
             SliceLayer& layer = mesh.layers[layer_idx];
@@ -631,17 +1326,31 @@ void FffPolygonGenerator::removeEmptyFirstLayers(SliceDataStorage& storage, cons
     if (n_empty_first_layers > 0)
     {
         log("Removing %d layers because they are empty\n", n_empty_first_layers);
+        // the layers move down by the thickness of the removed layers, except the first, in whose place the first remaining layer is printed
+        coord_t removed_height = 0;
+        for (int layer_nr = 1; layer_nr <= n_empty_first_layers && layer_nr < static_cast<int>(storage.layer_thicknesses.size()); layer_nr++)
+        {
+            removed_height += storage.layer_thicknesses[layer_nr];
+        }
+        std::vector<coord_t>& layer_thicknesses = storage.layer_thicknesses;
+        layer_thicknesses.erase(layer_thicknesses.begin(), layer_thicknesses.begin() + std::min(static_cast<size_t>(n_empty_first_layers), layer_thicknesses.size()));
+        if (!layer_thicknesses.empty())
+        {
+            layer_thicknesses[0] = getSettingInMicrons("layer_height_0");
+        }
         for (SliceMeshStorage& mesh : storage.meshes)
         {
             std::vector<SliceLayer>& layers = mesh.layers;
             layers.erase(layers.begin(), layers.begin() + n_empty_first_layers);
             for (SliceLayer& layer : layers)
             {
-                layer.printZ -= n_empty_first_layers * layer_height;
+                layer.printZ -= removed_height;
             }
             mesh.layer_nr_max_filled_layer -= n_empty_first_layers;
+            mesh.layer_nr_min_filled_layer = std::max(0, mesh.layer_nr_min_filled_layer - n_empty_first_layers);
         }
         total_layers -= n_empty_first_layers;
+        storage.removed_empty_first_layer_count += n_empty_first_layers;
         storage.support.layer_nr_max_filled_layer -= n_empty_first_layers;
         std::vector<SupportLayer>& support_layers = storage.support.supportLayers;
         support_layers.erase(support_layers.begin(), support_layers.begin() + n_empty_first_layers);
@@ -658,23 +1367,24 @@ void FffPolygonGenerator::removeEmptyFirstLayers(SliceDataStorage& storage, cons
  * processSkinsAndInfill read (depend on) mesh.layers[*].parts[*].{insets,boundingBox}.
  *                       write mesh.layers[n].parts[*].{skin_parts,infill_area}.
  */
-void FffPolygonGenerator::processSkinsAndInfill(SliceMeshStorage& mesh, unsigned int layer_nr, bool process_infill)
+void FffPolygonGenerator::processSkinsAndInfill(SliceMeshStorage& mesh, unsigned int layer_nr, bool process_infill, SkinLayerWindowIntersections* down_windows, SkinLayerWindowIntersections* up_windows)
 {
-    if (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::SURFACE) 
+    const MeshLayerSettings& settings = mesh.layer_settings;
+    if (settings.surface_mode == ESurfaceMode::SURFACE) 
     { 
         return;
     }
 
-    const int wall_line_count = mesh.getSettingAsCount("wall_line_count");
-    const int innermost_wall_line_width = (wall_line_count == 1) ? mesh.getSettingInMicrons("wall_line_width_0") : mesh.getSettingInMicrons("wall_line_width_x");
-    generateSkins(layer_nr, mesh, mesh.getSettingAsCount("bottom_layers"), mesh.getSettingAsCount("top_layers"), wall_line_count, mesh.getSettingInMicrons("wall_line_width_x"), mesh.getSettingAsCount("skin_outline_count"), mesh.getSettingBoolean("skin_no_small_gaps_heuristic"));
+    const int wall_line_count = settings.wall_line_count;
+    const int innermost_wall_line_width = (wall_line_count == 1) ? settings.wall_line_width_0 : settings.wall_line_width_x;
+    generateSkins(layer_nr, mesh, settings.bottom_layers, settings.top_layers, wall_line_count, settings.wall_line_width_x, settings.skin_outline_count, settings.skin_no_small_gaps_heuristic, down_windows, up_windows);
 
     if (process_infill)
     { // process infill when infill density > 0
         // or when other infill meshes want to modify this infill
         int infill_skin_overlap = 0;
-        bool infill_is_dense = mesh.getSettingInMicrons("infill_line_distance") < mesh.getSettingInMicrons("infill_line_width") + 10;
-        if (!infill_is_dense && mesh.getSettingAsFillMethod("infill_pattern") != EFillMethod::CONCENTRIC)
+        bool infill_is_dense = settings.infill_line_distance < settings.infill_line_width + 10;
+        if (!infill_is_dense && settings.infill_pattern != EFillMethod::CONCENTRIC)
         {
             infill_skin_overlap = innermost_wall_line_width / 2;
         }
@@ -755,15 +1465,18 @@ void FffPolygonGenerator::processOozeShield(SliceDataStorage& storage)
 
     const int ooze_shield_dist = getSettingInMicrons("ooze_shield_dist");
 
-    for (int layer_nr = 0; layer_nr <= storage.max_print_height_second_to_last_extruder; layer_nr++)
+    const int shield_layer_count = storage.max_print_height_second_to_last_extruder + 1;
+    storage.oozeShield.resize(std::max(0, shield_layer_count));
+    ThreadPool::parallelFor(0, shield_layer_count, [&](int layer_nr)
     {
-        storage.oozeShield.push_back(storage.getLayerOutlines(layer_nr, true).offset(ooze_shield_dist, ClipperLib::jtRound));
-    }
+        storage.oozeShield[layer_nr] = storage.getLayerOutlinesCached(layer_nr, true).offset(ooze_shield_dist, ClipperLib::jtRound);
+    });
 
     double angle = getSettingInAngleDegrees("ooze_shield_angle");
     if (angle <= 89)
     {
         int allowed_angle_offset = tan(getSettingInAngleRadians("ooze_shield_angle")) * getSettingInMicrons("layer_height"); // Allow for a 60deg angle in the oozeShield.
+        // each layer depends on the one processed before it, so these stay serial
         for (int layer_nr = 1; layer_nr <= storage.max_print_height_second_to_last_extruder; layer_nr++)
         {
             storage.oozeShield[layer_nr] = storage.oozeShield[layer_nr].unionPolygons(storage.oozeShield[layer_nr - 1].offset(-allowed_angle_offset));
@@ -775,10 +1488,10 @@ void FffPolygonGenerator::processOozeShield(SliceDataStorage& storage)
     }
 
     const float largest_printed_area = 1.0; // TODO: make var a parameter, and perhaps even a setting?
-    for (int layer_nr = 0; layer_nr <= storage.max_print_height_second_to_last_extruder; layer_nr++)
+    ThreadPool::parallelFor(0, shield_layer_count, [&](int layer_nr)
     {
         storage.oozeShield[layer_nr].removeSmallAreas(largest_printed_area);
-    }
+    });
 }
 
 void FffPolygonGenerator::processDraftShield(SliceDataStorage& storage)
@@ -792,10 +1505,23 @@ void FffPolygonGenerator::processDraftShield(SliceDataStorage& storage)
 
     const unsigned int layer_skip = 500 / layer_height + 1;
 
+    // the outlines are unioned in parallel in groups of a fixed number of layers, so that the result doesn't depend on the number of threads
+    constexpr int group_layer_count = 8;
+    const int sampled_layer_count = (std::min(storage.print_layer_count, draft_shield_layers) + layer_skip - 1) / layer_skip;
+    const int group_count = (sampled_layer_count + group_layer_count - 1) / group_layer_count;
+    std::vector<Polygons> group_shields(group_count);
+    ThreadPool::parallelFor(0, group_count, [&](int group_idx)
+    {
+        const int group_end = std::min(sampled_layer_count, (group_idx + 1) * group_layer_count);
+        for (int sample_idx = group_idx * group_layer_count; sample_idx < group_end; sample_idx++)
+        {
+            group_shields[group_idx] = group_shields[group_idx].unionPolygons(storage.getLayerOutlinesCached(sample_idx * layer_skip, true));
+        }
+    });
     Polygons& draft_shield = storage.draft_protection_shield;
-    for (unsigned int layer_nr = 0; layer_nr < storage.print_layer_count && layer_nr < draft_shield_layers; layer_nr += layer_skip)
+    for (const Polygons& group_shield : group_shields)
     {
-        draft_shield = draft_shield.unionPolygons(storage.getLayerOutlines(layer_nr, true));
+        draft_shield = draft_shield.unionPolygons(group_shield);
     }
 
     const int draft_shield_dist = getSettingInMicrons("draft_shield_dist");
@@ -825,6 +1551,46 @@ void FffPolygonGenerator::processPlatformAdhesion(SliceDataStorage& storage)
 }
 
 
+void FffPolygonGenerator::simplifyLayerOutlines(SliceMeshStorage& mesh)
+{
+    if (!mesh.hasSetting("meshfix_maximum_resolution"))
+    {
+        return;
+    }
+    const int maximum_resolution = mesh.getSettingInMicrons("meshfix_maximum_resolution");
+    if (maximum_resolution <= 0)
+    {
+        return;
+    }
+    const int maximum_deviation = mesh.hasSetting("meshfix_maximum_deviation")? mesh.getSettingInMicrons("meshfix_maximum_deviation") : maximum_resolution / 2;
+
+    const int layer_count = mesh.layers.size();
+    std::atomic<unsigned long long> point_count_before(0);
+    std::atomic<unsigned long long> point_count_after(0);
+    ThreadPool::parallelFor(0, layer_count, [&](int layer_nr)
+    {
+        std::vector<SliceLayerPart>& parts = mesh.layers[layer_nr].parts;
+        unsigned long long layer_point_count_before = 0;
+        unsigned long long layer_point_count_after = 0;
+        for (SliceLayerPart& part : parts)
+        {
+            layer_point_count_before += part.outline.pointCount();
+            part.outline.simplify(maximum_resolution, maximum_deviation);
+            layer_point_count_after += part.outline.pointCount();
+            part.boundaryBox.calculate(part.outline);
+        }
+        point_count_before += layer_point_count_before;
+        point_count_after += layer_point_count_after;
+        // the first polygon of a part is its outer boundary, so the part vanishes along with it
+        parts.erase(std::remove_if(parts.begin(), parts.end(),
+            [](const SliceLayerPart& part)
+            {
+                return part.outline.size() == 0 || part.outline[0].orientation() == false;
+            }), parts.end());
+    });
+    log("Simplifying the layer outlines removed %llu of %llu points\n", point_count_before.load() - point_count_after.load(), point_count_before.load());
+}
+
 void FffPolygonGenerator::processFuzzyWalls(SliceMeshStorage& mesh)
 {
     if (mesh.getSettingAsCount("wall_line_count") == 0)
@@ -835,28 +1601,37 @@ void FffPolygonGenerator::processFuzzyWalls(SliceMeshStorage& mesh)
     int64_t avg_dist_between_points = mesh.getSettingInMicrons("magic_fuzzy_skin_point_dist");
     int64_t min_dist_between_points = avg_dist_between_points * 3 / 4; // hardcoded: the point distance may vary between 3/4 and 5/4 the supplied value
     int64_t range_random_point_dist = avg_dist_between_points / 2;
-    for (unsigned int layer_nr = 0; layer_nr < mesh.layers.size(); layer_nr++)
+    const bool surface_mode = mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::SURFACE;
+    const unsigned int seed = mesh.hasSetting("magic_fuzzy_skin_seed")? mesh.getSettingAsCount("magic_fuzzy_skin_seed") : 0;
+    ThreadPool::parallelFor(0, static_cast<int>(mesh.layers.size()), [&](int layer_nr)
     {
+        // each layer has its own random numbers, so that the result doesn't depend on the order in which the layers are processed
+        std::seed_seq layer_seed{seed, static_cast<unsigned int>(layer_nr)};
+        std::mt19937 random(layer_seed);
+        const auto random_below = [&random](int64_t limit)
+            {
+                return static_cast<int64_t>(random() % limit);
+            };
         SliceLayer& layer = mesh.layers[layer_nr];
         for (SliceLayerPart& part : layer.parts)
         {
             Polygons results;
-            Polygons& skin = (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::SURFACE)? part.outline : part.insets[0];
+            Polygons& skin = surface_mode? part.outline : part.insets[0];
             for (PolygonRef poly : skin)
             {
                 // generate points in between p0 and p1
                 PolygonRef result = results.newPoly();
                 
-                int64_t dist_left_over = rand() % (min_dist_between_points / 2); // the distance to be traversed on the line before making the first new point
+                int64_t dist_left_over = random_below(min_dist_between_points / 2); // the distance to be traversed on the line before making the first new point
                 Point* p0 = &poly.back();
                 for (Point& p1 : poly)
                 { // 'a' is the (next) new point between p0 and p1
                     Point p0p1 = p1 - *p0;
                     int64_t p0p1_size = vSize(p0p1);    
                     int64_t dist_last_point = dist_left_over + p0p1_size * 2; // so that p0p1_size - dist_last_point evaulates to dist_left_over - p0p1_size
-                    for (int64_t p0pa_dist = dist_left_over; p0pa_dist < p0p1_size; p0pa_dist += min_dist_between_points + rand() % range_random_point_dist)
+                    for (int64_t p0pa_dist = dist_left_over; p0pa_dist < p0p1_size; p0pa_dist += min_dist_between_points + random_below(range_random_point_dist))
                     {
-                        int r = rand() % (fuzziness * 2) - fuzziness;
+                        int r = random_below(fuzziness * 2) - fuzziness;
                         Point perp_to_p0p1 = turn90CCW(p0p1);
                         Point fuzz = normal(perp_to_p0p1, r);
                         Point pa = *p0 + normal(p0p1, p0pa_dist) + fuzz;
@@ -883,8 +1658,32 @@ void FffPolygonGenerator::processFuzzyWalls(SliceMeshStorage& mesh)
             }
             skin = results;
         }
-    }
+    });
+}
+
+
+void FffPolygonGenerator::computeBridgeAngles(SliceMeshStorage& mesh)
+{
+    // the bridge angle of a skin part only depends on the outlines of the layer below
+    ThreadPool::parallelFor(1, static_cast<int>(mesh.layers.size()), [&](int layer_nr)
+    {
+        if (!mesh.layers[layer_nr].geometry_compressed) // otherwise finished along with its skin and infill, see finishLayerAreas
+        {
+            computeBridgeAngles(mesh, layer_nr);
+        }
+    });
 }
 
+void FffPolygonGenerator::computeBridgeAngles(SliceMeshStorage& mesh, unsigned int layer_nr)
+{
+    const SliceLayer& layer_below = mesh.layers[layer_nr - 1];
+    for (SliceLayerPart& part : mesh.layers[layer_nr].parts)
+    {
+        for (SkinPart& skin_part : part.skin_parts)
+        {
+            skin_part.bridge_angle = bridgeAngle(skin_part.outline, &layer_below);
+        }
+    }
+}
 
 }//namespace cura
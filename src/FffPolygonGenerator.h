@@ -16,6 +16,8 @@
 namespace cura
 {
 
+class SkinLayerWindowIntersections;
+
 /*!
  * Primary stage in Fused Filament Fabrication processing: Polygons are generated.
  * The model is sliced and each slice consists of polygons representing the outlines: the boundaries between inside and outside the object.
@@ -44,6 +46,34 @@ public:
      * \param storage Output parameter: where the outlines are stored. See SliceLayerPart::outline.
      */
     bool generateAreas(SliceDataStorage& storage, MeshGroup* object, TimeKeeper& timeKeeper);
+
+    /*!
+     * Generate the skin and infill areas or the support areas of areas generated before once more, after their settings changed,
+     * together with everything which is computed from them; see \ref SliceDataCache
+     *
+     * The walls and everything before them are kept.
+     *
+     * \param storage The areas generated with \ref FffPolygonGenerator::generateAreas, of which the settings have been replaced, see \ref SliceDataStorage::setMeshGroup
+     * \param timeKeeper Object which keeps track of timings of each stage.
+     * \param infill_changed Whether to generate the skin and infill areas again
+     * \param support_changed Whether to generate the support areas again
+     */
+    void regenerateAreas(SliceDataStorage& storage, TimeKeeper& timeKeeper, bool infill_changed, bool support_changed);
+
+    /*!
+     * Slice the \p object coarsely and generate only the outlines and the walls, for a quick preview of the layers.
+     *
+     * Only the first layer and every \p layer_stride th layer after it are sliced.
+     * The skin, infill, support and helpers aren't generated, and the mesh data isn't cleared,
+     * so that the \p object can be sliced in full with \ref FffPolygonGenerator::generateAreas afterwards.
+     *
+     * \param storage Output parameter: where the outlines and walls of the previewed layers are stored
+     * \param object The object to slice
+     * \param layer_stride The number of layers of the full slicing which each previewed layer stands for
+     * \param timeKeeper Object which keeps track of timings of each stage.
+     * \return Whether the preview has been generated
+     */
+    bool generatePreview(SliceDataStorage& storage, MeshGroup* object, unsigned int layer_stride, TimeKeeper& timeKeeper);
   
 private:
     /*!
@@ -65,10 +95,12 @@ private:
      * \param object The object to slice.
      * \param timeKeeper Object which keeps track of timings of each stage.
      * \param storage Output parameter: where the outlines are stored. See SliceLayerPart::outline.
+     * \param preview_layer_stride When slicing for a preview, only slice every so many layers
+     * and keep the mesh data; see \ref FffPolygonGenerator::generatePreview. Zero to slice in full.
      * 
      * \return Whether the process succeeded (always true).
      */
-    bool sliceModel(MeshGroup* object, TimeKeeper& timeKeeper, SliceDataStorage& storage); /// slices the model
+    bool sliceModel(MeshGroup* object, TimeKeeper& timeKeeper, SliceDataStorage& storage, unsigned int preview_layer_stride = 0); /// slices the model
 
     /*!
      * Processes the outline information as stored in the \p storage: generates inset perimeter polygons, support area polygons, etc. 
@@ -88,6 +120,101 @@ private:
      */
     void processBasicWallsSkinInfill(SliceDataStorage& storage, unsigned int mesh_order_idx, std::vector<unsigned int>& mesh_order, ProgressStageEstimator& inset_skin_progress_estimate);
 
+    /*!
+     * Whether the geometry of the layers is kept compressed from when their areas are finished until they are planned by the gcode writer.
+     *
+     * \param storage The areas, of which the mesh group has the settings of the job
+     */
+    bool isLayerGeometryCompressed(const SliceDataStorage& storage) const;
+
+    /*!
+     * Whether the areas of each layer of a mesh can be finished along with its skin and infill,
+     * so that the layer can be compressed while the other layers are still being processed.
+     *
+     * That's the case when the later stages only change each layer on its own: the perimeter gaps, the bridge angles and the infill areas without gradual steps,
+     * and when they only read the outlines of the layers which compressing them keeps.
+     *
+     * \param storage The areas of which the mesh is part
+     * \param mesh The mesh of which to finish the layers
+     */
+    bool canFinishLayerAreasAlongWithSkin(const SliceDataStorage& storage, const SliceMeshStorage& mesh) const;
+
+    /*!
+     * The layers of which the skin and infill areas are needed when only a shard of the layers is written, see \ref FffGcodeWriter::processShardStartCode:
+     * those of the shard and those above and below it from which the infill of its layers is derived.
+     *
+     * The walls of all layers are still generated, since the outlines they leave determine the support and which empty first layers are removed.
+     * The range is in the layer numbers after removing the empty first layers, so the layers are shifted up by that many while slicing.
+     * Where the extruders used on the layers outside of the shard, the infill meshes or the spaghetti infill affect the layers of the shard,
+     * the skin and infill of all layers is generated.
+     *
+     * \param storage The areas of which the mesh is part
+     * \param mesh The mesh of which the skin and infill is generated
+     * \param[out] layer_start The lowest layer of which the skin and infill is needed
+     * \param[out] layer_end The layer above the highest layer of which the skin and infill is needed
+     * \return Whether only a range of layers is needed
+     */
+    bool getShardSkinLayerRange(const SliceDataStorage& storage, const SliceMeshStorage& mesh, int& layer_start, int& layer_end) const;
+
+    /*!
+     * Generate the areas of a layer which the later stages would, see \ref FffPolygonGenerator::canFinishLayerAreasAlongWithSkin
+     *
+     * \param mesh The mesh of which the skin and infill of the layer have been generated
+     * \param layer_nr The layer of which to finish the areas
+     */
+    void finishLayerAreas(SliceMeshStorage& mesh, unsigned int layer_nr);
+
+    /*!
+     * Move the layers which don't fit in the layer_geometry_memory_budget to a temporary file as soon as they're compressed,
+     * if the geometry is to be kept compressed, see \ref SliceDataStorage::startSpillingLayerGeometry
+     *
+     * \param storage The areas of which no layer has been compressed yet
+     */
+    void startSpillingLayerGeometry(SliceDataStorage& storage) const;
+
+    /*!
+     * Compress the geometry of the layers which haven't been compressed along with their skin and infill yet,
+     * if the geometry is to be kept compressed, see \ref FffPolygonGenerator::isLayerGeometryCompressed,
+     * after which the layers moved to the temporary file can be read back.
+     *
+     * \param storage The areas of which all stages are done
+     */
+    void compressLayerGeometry(SliceDataStorage& storage);
+
+    /*!
+     * Generate the skin and infill areas of all layers of a mesh of which the walls have already been generated.
+     *
+     * \param mesh The mesh, without skin and infill areas, see \ref SliceMeshStorage::clearSkinAndInfillAreas
+     * \param process_infill Generate infill areas
+     */
+    void processSkinsAndInfillOfAllLayers(SliceMeshStorage& mesh, bool process_infill);
+
+    /*!
+     * Create the intersections of the layers below and above each layer of a mesh used to compute its skin, if they are to be shared between layers.
+     *
+     * \param mesh The mesh
+     * \param[out] down_windows The intersections of the bottom skin layers below each layer, or nullptr
+     * \param[out] up_windows The intersections of the top skin layers above each layer, or nullptr
+     */
+    void createSkinLayerWindows(const SliceMeshStorage& mesh, std::unique_ptr<SkinLayerWindowIntersections>& down_windows, std::unique_ptr<SkinLayerWindowIntersections>& up_windows);
+
+    /*!
+     * Generate the support areas of all meshes.
+     *
+     * \param storage The areas of which the walls have been generated, without support areas
+     * \param timeKeeper Object which keeps track of timings of each stage.
+     */
+    void processSupport(SliceDataStorage& storage, TimeKeeper& timeKeeper);
+
+    /*!
+     * Generate everything which is computed from the walls, skin, infill and support areas:
+     * the prime tower, shields, platform adhesion, perimeter gaps and the derived infill areas.
+     *
+     * \param storage The areas of which the walls, skin, infill and support have been generated
+     * \param process_perimeter_gaps_and_derived_areas Whether to also generate the perimeter gaps and the areas derived from the walls, skin and infill
+     */
+    void processHelpersAndDerivedAreas(SliceDataStorage& storage, bool process_perimeter_gaps_and_derived_areas);
+
     /*!
      * Generate areas for the gaps between walls where the next inset doesn't fit.
      * These areas should be filled with a skin-like pattern, so that these skin lines get combined into one line with gradual changing width.
@@ -96,6 +223,33 @@ private:
      */
     void processPerimeterGaps(SliceDataStorage& storage);
 
+    /*!
+     * The settings of a mesh which determine its perimeter gaps
+     */
+    struct MeshPerimeterGapSettings
+    {
+        bool fill_gaps_between_inner_wall_and_skin_or_infill;
+        coord_t wall_line_width_0;
+        coord_t wall_line_width_x;
+    };
+
+    /*!
+     * Get the settings of a mesh which determine its perimeter gaps.
+     *
+     * \param mesh The mesh of which to get the settings
+     * \param[out] settings The settings, if the perimeter gaps of the mesh are filled
+     * \return Whether the perimeter gaps of the mesh are filled
+     */
+    bool getPerimeterGapSettings(const SliceMeshStorage& mesh, MeshPerimeterGapSettings& settings) const;
+
+    /*!
+     * Generate the perimeter gaps of a single layer part, which only depend on the walls, skin and infill of that part.
+     *
+     * \param[in,out] part The part of which to generate the perimeter gaps
+     * \param settings The settings of the mesh of the part
+     */
+    static void processPerimeterGaps(SliceLayerPart& part, const MeshPerimeterGapSettings& settings);
+
     /*!
      * Process the mesh to be an infill mesh: limit all outlines to within the infill of normal meshes and subtract their volume from the infill of those meshes
      * 
@@ -118,11 +272,10 @@ private:
      * 
      * \warning Changes \p total_layers
      * 
-     * \param storage Input and Ouput parameter: stores all layers
-     * \param layer_height The height of each layer
+     * \param storage Input and Ouput parameter: stores all layers and their thicknesses
      * \param total_layers The total number of layers
      */
-    void removeEmptyFirstLayers(SliceDataStorage& storage, const int layer_height, unsigned int& total_layers);
+    void removeEmptyFirstLayers(SliceDataStorage& storage, unsigned int& total_layers);
 
     /*!
      * Set \ref SliceDataStorage::max_print_height_per_extruder and \ref SliceDataStorage::max_print_height_order and \ref SliceDataStorage::max_print_height_second_to_last_extruder
@@ -138,6 +291,37 @@ private:
      */
     void processInsets(SliceMeshStorage& mesh, unsigned int layer_nr);
 
+    /*!
+     * Get the number of walls to generate for the parts of a layer.
+     * \param mesh The mesh of which to get the number of walls
+     * \param layer_nr The layer for which to get the number of walls
+     */
+    int getInsetCount(const SliceMeshStorage& mesh, unsigned int layer_nr);
+
+    /*!
+     * Find the layers which will get exactly the same walls as a layer below them,
+     * because their parts have exactly the same outlines and the same number of walls.
+     * 
+     * Extruded parts often have the same cross section for many consecutive layers,
+     * so the walls of those layers can be copied from the first layer with that cross section instead of being computed again.
+     * 
+     * \param mesh The mesh of which to compare the layers
+     * \return For each layer the layer from which to copy its walls, or -1 if its walls need to be computed
+     */
+    std::vector<int> findLayersWithSameInsets(const SliceMeshStorage& mesh);
+
+    /*!
+     * Copy the walls of a layer found by \ref FffPolygonGenerator::findLayersWithSameInsets from the layer with the same parts.
+     * 
+     * The parts for which \ref FffPolygonGenerator::processInsets generated no walls have been removed from the source layer,
+     * so these are removed from the layer as well.
+     * 
+     * \param mesh The mesh of which to copy the walls
+     * \param source_layer_nr The layer of which the walls have been computed
+     * \param layer_nr The layer to which to copy the walls
+     */
+    void copyInsets(SliceMeshStorage& mesh, unsigned int source_layer_nr, unsigned int layer_nr);
+
     /*!
      * Generate the outline of the ooze shield.
      * \param storage Input and Output parameter: fetches the outline information (see SliceLayerPart::outline) and generates the other reachable field of the \p storage
@@ -149,8 +333,10 @@ private:
      * \param mesh Input and Output parameter: fetches the outline information (see SliceLayerPart::outline) and generates the other reachable field of the \p storage
      * \param layer_nr The layer for which to generate the skin areas.
      * \param process_infill Generate infill areas
+     * \param down_windows If given, the intersections of the bottom skin layers below each layer, shared between the layers
+     * \param up_windows If given, the intersections of the top skin layers above each layer, shared between the layers
      */
-    void processSkinsAndInfill(SliceMeshStorage& mesh, unsigned int layer_nr, bool process_infill); 
+    void processSkinsAndInfill(SliceMeshStorage& mesh, unsigned int layer_nr, bool process_infill, SkinLayerWindowIntersections* down_windows = nullptr, SkinLayerWindowIntersections* up_windows = nullptr);
 
     /*!
      * Generate the polygons where the draft screen should be.
@@ -165,6 +351,18 @@ private:
      */
     void processPlatformAdhesion(SliceDataStorage& storage);
 
+    /*!
+     * Simplify the outlines of the layer parts of a mesh,
+     * so that high resolution meshes don't produce lots of tiny line segments in all later stages and in the gcode.
+     * 
+     * Only performed when the optional setting meshfix_maximum_resolution is larger than zero.
+     * Vertices are only removed when the outline moves by less than meshfix_maximum_deviation,
+     * which defaults to half of the resolution.
+     * 
+     * \param[in,out] mesh where the layer parts are retrieved from and stored in.
+     */
+    void simplifyLayerOutlines(SliceMeshStorage& mesh);
+
     /*!
      * Make the outer wall 'fuzzy'
      * 
@@ -172,10 +370,30 @@ private:
      * 
      * This only changes the outer wall.
      * 
+     * The random distances of each layer are generated from the layer number and the optional magic_fuzzy_skin_seed setting,
+     * so that the layers can be processed in parallel and slicing the same model again gives the same result.
+     * 
      * \param[in,out] mesh where the outer wall is retrieved and stored in.
      */
     void processFuzzyWalls(SliceMeshStorage& mesh);
 
+    /*!
+     * Compute the bridge angle of each skin part, i.e. the angle between the two largest areas of the layer below on which it rests.
+     * 
+     * The skin parts are printed once for each extruder printing a feature of the mesh, so the angle is computed once beforehand instead.
+     * 
+     * \param[in,out] mesh where the skin parts are retrieved from and where the bridge angles are stored in.
+     */
+    void computeBridgeAngles(SliceMeshStorage& mesh);
+
+    /*!
+     * Compute the bridge angle of each skin part of a single layer, see \ref FffPolygonGenerator::computeBridgeAngles(SliceMeshStorage&)
+     *
+     * \param[in,out] mesh where the skin parts are retrieved from and where the bridge angles are stored in.
+     * \param layer_nr The layer of which to compute the bridge angles, above the first layer
+     */
+    static void computeBridgeAngles(SliceMeshStorage& mesh, unsigned int layer_nr);
+
 
 };
 }//namespace cura
@@ -1,4 +1,7 @@
 #include "FffProcessor.h" 
+#include "layerPart.h"
+#include "utils/SVG.h"
+#include "utils/ThreadPool.h"
 
 namespace cura 
 {
@@ -88,17 +91,89 @@ bool FffProcessor::processMeshGroup(MeshGroup* meshgroup)
         
     } else 
     {
-        SliceDataStorage storage(meshgroup);
-
-        if (!polygon_generator.generateAreas(storage, meshgroup, time_keeper))
+        const bool reuse_slice_data = meshgroup->hasSetting("reuse_slice_data") && meshgroup->getSettingBoolean("reuse_slice_data");
+        const std::string meshgroup_snapshot_file = (snapshot_file.empty() || meshgroup_number == 0)? snapshot_file : snapshot_file + "." + std::to_string(meshgroup_number);
+        SliceDataCache::Key slice_data_key;
+        std::unique_ptr<SliceDataStorage> storage;
+        bool infill_changed = false;
+        bool support_changed = false;
+        if (reuse_slice_data || !meshgroup_snapshot_file.empty())
         {
-            return false;
+            slice_data_key = SliceDataCache::computeKey(*meshgroup);
+        }
+        if (reuse_slice_data)
+        {
+            storage = slice_data_cache.take(slice_data_key, meshgroup, infill_changed, support_changed);
+        }
+        slice_data_cache.clear();
+        if (storage)
+        {
+            meshgroup->clear(); // the mesh data isn't needed, as after slicing
+            if (infill_changed || support_changed)
+            {
+                log("Reusing the walls of the previous meshgroup, generating the%s%s areas again.\n", infill_changed? " skin and infill" : "", support_changed? " support" : "");
+                polygon_generator.regenerateAreas(*storage, time_keeper, infill_changed, support_changed);
+            }
+            else
+            {
+                log("Reusing the areas of the previous meshgroup, since only gcode settings differ.\n");
+            }
+        }
+        else if (!meshgroup_snapshot_file.empty() && (storage = SliceDataCache::readSnapshot(meshgroup_snapshot_file, slice_data_key, meshgroup, infill_changed, support_changed)))
+        {
+            meshgroup->clear();
+            storage->keep_layer_geometry = reuse_slice_data;
+            if (infill_changed || support_changed)
+            {
+                log("Reading the walls from %s, generating the%s%s areas again.\n", meshgroup_snapshot_file.c_str(), infill_changed? " skin and infill" : "", support_changed? " support" : "");
+            }
+            else
+            {
+                log("Reading the areas from %s.\n", meshgroup_snapshot_file.c_str());
+            }
+            polygon_generator.regenerateAreas(*storage, time_keeper, infill_changed, support_changed); // the helper areas aren't part of the snapshot
+            if (infill_changed || support_changed)
+            {
+                SliceDataCache::writeSnapshot(meshgroup_snapshot_file, slice_data_key, *storage);
+            }
+        }
+        else
+        {
+            storage.reset(new SliceDataStorage(meshgroup));
+            storage->keep_layer_geometry = reuse_slice_data;
+            if (!polygon_generator.generateAreas(*storage, meshgroup, time_keeper))
+            {
+                return false;
+            }
+            if (!meshgroup_snapshot_file.empty())
+            {
+                SliceDataCache::writeSnapshot(meshgroup_snapshot_file, slice_data_key, *storage);
+            }
         }
         
+        if (isCancelled())
+        { // the areas of the layers which were skipped are missing
+            return false;
+        }
         Progress::messageProgressStage(Progress::Stage::EXPORT, &time_keeper);
-        gcode_writer.writeGCode(storage, time_keeper);
+        gcode_writer.writeGCode(*storage, time_keeper);
+        if (isCancelled())
+        { // the gcode is incomplete, so it isn't finished and the areas aren't reused
+            return false;
+        }
+        if (reuse_slice_data)
+        {
+            slice_data_cache.store(slice_data_key, std::move(storage));
+        }
     }
 
+    finishMeshGroup(*meshgroup, time_keeper_total);
+
+    return true;
+}
+
+void FffProcessor::finishMeshGroup(MeshGroup& meshgroup, TimeKeeper& time_keeper_total)
+{
     Progress::messageProgress(Progress::Stage::FINISH, 1, 1); // 100% on this meshgroup
     if (CommandSocket::isInstantiated())
     {
@@ -107,12 +182,133 @@ bool FffProcessor::processMeshGroup(MeshGroup* meshgroup)
     }
     log("Total time elapsed %5.2fs.\n", time_keeper_total.restart());
 
-    profile_string += getAllSettingsString(*meshgroup, meshgroup_number == 0);
+    profile_string += getAllSettingsString(meshgroup, meshgroup_number == 0);
     meshgroup_number++;
 
     polygon_generator.setParent(this); // otherwise consequent getSetting calls (e.g. for finalize) will refer to non-existent meshgroup
     gcode_writer.setParent(this); // otherwise consequent getSetting calls (e.g. for finalize) will refer to non-existent meshgroup
+}
+
+bool FffProcessor::previewMeshGroup(MeshGroup* meshgroup, unsigned int layer_stride)
+{
+    if (!meshgroup)
+    {
+        return false;
+    }
+    TimeKeeper time_keeper_preview;
+    SliceDataStorage storage(meshgroup);
+    polygon_generator.setParent(meshgroup);
+    const bool generated = polygon_generator.generatePreview(storage, meshgroup, layer_stride, time_keeper_preview);
+    polygon_generator.setParent(this);
+    if (!generated)
+    {
+        return false;
+    }
+    if (CommandSocket::isInstantiated())
+    {
+        CommandSocket::getInstance()->sendPreview(storage, layer_stride);
+    }
+    if (!preview_file_prefix.empty())
+    {
+        layerparts2SVGs(storage, preview_file_prefix + std::to_string(preview_file_count) + "_", 0, static_cast<int>(storage.print_layer_count) - 1, LAYER_PARTS_OUTLINES | LAYER_PARTS_INSETS);
+        SVG::waitForBackgroundWrites(); // the preview is to be shown before the meshgroup is sliced in full
+        preview_file_count++;
+    }
+    log("Preview of %i layers generated in %5.2fs.\n", storage.print_layer_count, time_keeper_preview.restart());
+    return true;
+}
+
+FffProcessor::QueuedMeshGroup::QueuedMeshGroup(MeshGroup* meshgroup)
+: meshgroup(meshgroup)
+, polygon_generator(meshgroup)
+, storage(new SliceDataStorage(meshgroup))
+{
+    const unsigned int thread_count = ThreadPool::getThreadCount(); // a new thread doesn't inherit the limit on the threads of this one
+    generated = std::async(std::launch::async, [=]()
+        {
+            ThreadPool::ThreadLimit thread_limit(thread_count);
+            return polygon_generator.generateAreas(*storage, this->meshgroup.get(), time_keeper);
+        });
+}
+
+bool FffProcessor::queueMeshGroup(MeshGroup* meshgroup)
+{
+    if (!meshgroup)
+    {
+        return false;
+    }
+    if (!preview_file_prefix.empty())
+    {
+        const unsigned int layer_stride = meshgroup->hasSetting("preview_layer_stride") ? std::max(1, meshgroup->getSettingAsCount("preview_layer_stride")) : 10;
+        if (!previewMeshGroup(meshgroup, layer_stride))
+        {
+            logWarning("Previewing the mesh group failed.\n");
+        }
+    }
+    const unsigned int pipeline_size = hasSetting("meshgroup_pipeline_size") ? std::max(1, getSettingAsCount("meshgroup_pipeline_size")) : 1;
+    bool process_directly = pipeline_size <= 1 || CommandSocket::isInstantiated() || meshgroup->getSettingBoolean("wireframe_enabled")
+        || !snapshot_file.empty(); // the areas may be read from the snapshot instead of being generated
+    bool empty = true;
+    for (Mesh& mesh : meshgroup->meshes)
+    {
+        if (!mesh.getSettingBoolean("infill_mesh") && !mesh.getSettingBoolean("anti_overhang_mesh"))
+        {
+            empty = false;
+        }
+        if (mesh.getSettingAsFillMethod("infill_pattern") == EFillMethod::CUBICSUBDIV)
+        { // the octree of the cubic subdivision infill is stored statically while it is generated and used to write the gcode
+            process_directly = true;
+        }
+    }
+    if (process_directly || empty)
+    {
+        bool success = flushMeshGroupQueue();
+        success &= processMeshGroup(meshgroup);
+        delete meshgroup;
+        return success;
+    }
+
+    queued_meshgroups.emplace_back(new QueuedMeshGroup(meshgroup));
+    bool success = true;
+    while (queued_meshgroups.size() >= pipeline_size)
+    {
+        success &= writeFirstQueuedMeshGroup();
+    }
+    return success;
+}
+
+bool FffProcessor::flushMeshGroupQueue()
+{
+    bool success = true;
+    while (!queued_meshgroups.empty())
+    {
+        success &= writeFirstQueuedMeshGroup();
+    }
+    return success;
+}
+
+bool FffProcessor::writeFirstQueuedMeshGroup()
+{
+    std::unique_ptr<QueuedMeshGroup> queued = std::move(queued_meshgroups.front());
+    queued_meshgroups.pop_front();
+    MeshGroup& meshgroup = *queued->meshgroup;
+
+    if (SHOW_ALL_SETTINGS) { logWarning(getAllSettingsString(meshgroup, meshgroup_number == 0).c_str()); }
+    TimeKeeper time_keeper_total;
+    time_keeper.restart();
+    if (!queued->generated.get() || isCancelled())
+    {
+        return false;
+    }
+    gcode_writer.setParent(&meshgroup);
+    Progress::messageProgressStage(Progress::Stage::EXPORT, &time_keeper);
+    gcode_writer.writeGCode(*queued->storage, time_keeper);
+    if (isCancelled())
+    {
+        return false;
+    }
 
+    finishMeshGroup(meshgroup, time_keeper_total);
     return true;
 }
 
@@ -1,15 +1,21 @@
 #ifndef FFF_PROCESSOR_H
 #define FFF_PROCESSOR_H
 
+#include <deque>
+#include <future>
+#include <memory>
+
 #include "settings/settings.h"
 #include "FffGcodeWriter.h"
 #include "FffPolygonGenerator.h"
+#include "SliceDataCache.h"
 #include "commandSocket.h"
 #include "Weaver.h"
 #include "Wireframe2gcode.h"
 #include "progress/Progress.h"
 #include "utils/gettime.h"
 #include "utils/NoCopy.h"
+#include "utils/ThreadPool.h"
 
 #define SHOW_ALL_SETTINGS true
 
@@ -51,6 +57,11 @@ private:
      */
     FffGcodeWriter gcode_writer;
 
+    /*!
+     * The areas of the last meshgroup, if reuse_slice_data is enabled, for the next meshgroup if only its gcode settings differ.
+     */
+    SliceDataCache slice_data_cache;
+
     /*!
      * The index of the meshgroup currently being processed, starting at zero.
      */
@@ -63,6 +74,21 @@ private:
      */
     std::string profile_string = "";
 
+    /*!
+     * The start of the names of the files to draw the previews to, or empty to not preview the meshgroups; see \ref FffProcessor::setPreviewFilePrefix
+     */
+    std::string preview_file_prefix;
+
+    /*!
+     * The number of meshgroups which have been previewed to files.
+     */
+    unsigned int preview_file_count = 0;
+
+    /*!
+     * The file to read the areas of the first meshgroup from and write them to, or empty to not keep snapshots; see \ref FffProcessor::setSnapshotFile
+     */
+    std::string snapshot_file;
+
     /*!
      * Get all settings for the current meshgroup in the format by which CuraEngine is called via the command line.
      * 
@@ -75,6 +101,48 @@ private:
      */
     std::string getAllSettingsString(MeshGroup& meshgroup, bool first_meshgroup);
 
+    /*!
+     * A meshgroup given to \ref FffProcessor::queueMeshGroup of which the gcode is not written yet.
+     *
+     * The areas are generated in the background as soon as the meshgroup is queued.
+     */
+    struct QueuedMeshGroup : NoCopy
+    {
+        std::unique_ptr<MeshGroup> meshgroup; //!< The meshgroup, which is owned by the queue
+        FffPolygonGenerator polygon_generator; //!< The polygon generator for this meshgroup alone, since its settings are those of the meshgroup
+        std::unique_ptr<SliceDataStorage> storage; //!< Where the areas are generated
+        TimeKeeper time_keeper; //!< The stop watch for the stages of the area generation
+        std::future<bool> generated; //!< Whether the areas were generated successfully, available once they are
+
+        /*!
+         * Queue a meshgroup and start generating its areas in the background.
+         *
+         * \param meshgroup The meshgroup to queue, which is deleted along with this object
+         */
+        QueuedMeshGroup(MeshGroup* meshgroup);
+    };
+
+    /*!
+     * The meshgroups given to \ref FffProcessor::queueMeshGroup of which the gcode is not written yet, in the order in which they have to be written.
+     */
+    std::deque<std::unique_ptr<QueuedMeshGroup>> queued_meshgroups;
+
+    /*!
+     * Write the gcode of the first of the \ref FffProcessor::queued_meshgroups,
+     * waiting for its areas to be generated first, and remove it from the queue.
+     *
+     * \return Whether generating its areas succeeded
+     */
+    bool writeFirstQueuedMeshGroup();
+
+    /*!
+     * Finish processing a meshgroup after its gcode has been written.
+     *
+     * \param meshgroup The meshgroup of which the gcode has been written
+     * \param time_keeper_total The stop watch which has been timing the whole processing of the meshgroup
+     */
+    void finishMeshGroup(MeshGroup& meshgroup, TimeKeeper& time_keeper_total);
+
 public:
     /*!
      * Get a string containing all setting values passed to the engine in the format by which CuraEngine is called via the command line.
@@ -105,9 +173,35 @@ public:
      */
     bool setTargetFile(const char* filename)
     {
+        flushMeshGroupQueue(); // the gcode of the meshgroups given before goes to the previous target
         return gcode_writer.setTargetFile(filename);
     }
 
+    /*!
+     * Write the gcode to the target file set after this call in binary format instead of as text.
+     */
+    void setBinaryOutput()
+    {
+        flushMeshGroupQueue();
+        gcode_writer.setBinaryOutput();
+    }
+
+    /*!
+     * Wait at the end until the target file is written to disk, see \ref FffGcodeWriter::setSyncOutputToDisk
+     */
+    void setSyncOutputToDisk()
+    {
+        gcode_writer.setSyncOutputToDisk();
+    }
+
+    /*!
+     * Write each layer to the target as soon as it's generated, see \ref FffGcodeWriter::setStreamingOutput
+     */
+    void setStreamingOutput()
+    {
+        gcode_writer.setStreamingOutput();
+    }
+
     /*!
      * Set the target to write gcode to: an output stream.
      * 
@@ -145,12 +239,42 @@ public:
 
     /*!
      * Add the end gcode and set all temperatures to zero.
+     *
+     * \ref FffProcessor::flushMeshGroupQueue has to be called before, if meshgroups have been queued.
      */
     void finalize()
     {
         gcode_writer.finalize();
     }
 
+    /*!
+     * Cancel the slicing in progress, because the front end doesn't need its result any more.
+     *
+     * May be called from any thread. The parallel stages stop within the layer each thread is processing,
+     * after which \ref FffProcessor::processMeshGroup returns false.
+     * The slicing stays cancelled until \ref FffProcessor::resetCancellation is called.
+     */
+    void cancel()
+    {
+        ThreadPool::cancel();
+    }
+
+    /*!
+     * Whether the slicing has been cancelled with \ref FffProcessor::cancel.
+     */
+    bool isCancelled() const
+    {
+        return ThreadPool::isCancelled();
+    }
+
+    /*!
+     * Let the next slicing run to completion again, after the previous one has been cancelled.
+     */
+    void resetCancellation()
+    {
+        ThreadPool::resetCancellation();
+    }
+
     /*!
      * Generate gcode for a given \p meshgroup
      * The primary function of this class.
@@ -159,6 +283,68 @@ public:
      * \return Whether this function succeeded
      */
     bool processMeshGroup(MeshGroup* meshgroup);
+
+    /*!
+     * Generate gcode for a given \p meshgroup, while the gcode of the previously queued meshgroups may still have to be written.
+     *
+     * The areas of the meshgroup are generated in the background, so that the next meshgroup can be loaded
+     * and the gcode of the previous meshgroup can be written in the meantime.
+     * The gcode is always written in the order in which the meshgroups are queued.
+     * The areas of at most meshgroup_pipeline_size meshgroups are kept in memory at once:
+     * when the queue is full the gcode of the oldest meshgroup is written first.
+     *
+     * Meshgroups are processed directly when the setting isn't larger than one, when slicing for the front-end,
+     * and for wireframe printing and cubic subdivision infill, which use state shared between meshgroups.
+     *
+     * \param meshgroup The meshgroup for which to generate gcode. It is deleted once its gcode is written.
+     * \return Whether processing the meshgroups of which the gcode was written in this call succeeded
+     */
+    bool queueMeshGroup(MeshGroup* meshgroup);
+
+    /*!
+     * Generate a quick preview of the outlines and walls of a meshgroup, see \ref FffPolygonGenerator::generatePreview
+     *
+     * The preview is sent to the front end when slicing for it, and drawn to files if \ref FffProcessor::setPreviewFilePrefix has been called.
+     * The meshgroup keeps its mesh data and settings, so that it can be processed in full afterwards.
+     *
+     * \param meshgroup The meshgroup to preview
+     * \param layer_stride The number of layers which each previewed layer stands for
+     * \return Whether the preview has been generated
+     */
+    bool previewMeshGroup(MeshGroup* meshgroup, unsigned int layer_stride);
+
+    /*!
+     * Preview each meshgroup given to \ref FffProcessor::queueMeshGroup from now on before processing it,
+     * drawing each previewed layer to a file of its own.
+     *
+     * The number of layers which each previewed layer stands for is set by preview_layer_stride, 10 by default.
+     *
+     * \param filename_prefix The start of the file names, which is followed by the index of the preview, an underscore and the layer number
+     */
+    void setPreviewFilePrefix(const std::string& filename_prefix)
+    {
+        preview_file_prefix = filename_prefix;
+    }
+
+    /*!
+     * Keep a snapshot of the areas of each meshgroup in a file, see \ref SliceDataSnapshot
+     *
+     * If the file holds the areas of a meshgroup with the same meshes and the same settings of the slicing and the walls,
+     * these are read instead of slicing the meshgroup. Otherwise the areas are written to it once they have been generated.
+     *
+     * \param filename The file of the first meshgroup. That of each next meshgroup has its index appended, as in "areas.snapshot.1"
+     */
+    void setSnapshotFile(const std::string& filename)
+    {
+        snapshot_file = filename;
+    }
+
+    /*!
+     * Write the gcode of all meshgroups given to \ref FffProcessor::queueMeshGroup which haven't been written yet.
+     *
+     * \return Whether processing all these meshgroups succeeded
+     */
+    bool flushMeshGroupQueue();
 };
 
 }//namespace cura
@@ -17,6 +17,15 @@ GCodePathConfig::GCodePathConfig(const GCodePathConfig& other)
 }
 
 
+GCodePathConfig::GCodePathConfig(const GCodePathConfig& other, int layer_thickness)
+: type(other.type)
+, speed_derivatives(other.speed_derivatives)
+, line_width(other.line_width)
+, layer_thickness(layer_thickness)
+, flow(other.flow)
+, extrusion_mm3_per_mm(calculateExtrusion())
+{
+}
 
 GCodePathConfig::GCodePathConfig(PrintFeatureType type, int line_width, int layer_height, double flow, GCodePathConfig::SpeedDerivatives speed_derivatives)
 : type(type)
@@ -38,6 +38,14 @@ public:
      */
     GCodePathConfig(const GCodePathConfig& other);
 
+    /*!
+     * Copy a config, but for lines of another layer thickness.
+     *
+     * \param other The config to copy
+     * \param layer_thickness The layer thickness for which to compute the extrusion
+     */
+    GCodePathConfig(const GCodePathConfig& other, int layer_thickness);
+
     /*!
      * Set the speed to somewhere between the speed of @p first_layer_config and the iconic speed.
      * 
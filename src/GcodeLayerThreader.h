@@ -3,13 +3,16 @@
 #define GCODE_LAYER_THREADER_H
 
 #include <queue> // priority_queue
+#include <algorithm> // min, max
 #include <functional> // function
-#include <thread> // sleep
-#include <chrono> // milliseconds
+#include <mutex>
+#include <condition_variable>
+#include <chrono> // steady_clock
 
 #include "utils/logoutput.h"
 #include "utils/optional.h"
 #include "utils/Lock.h"
+#include "utils/ThreadPool.h"
 
 namespace cura
 {
@@ -25,6 +28,16 @@ namespace cura
  * 
  * If there is only one thread, it consumes every time it has produced one item.
  * 
+ * A thread which can neither consume nor produce waits until another thread has finished producing or consuming an item.
+ * 
+ * The number of items which may be active at the same time starts at twice the number of threads.
+ * It grows up to \p max_task_count whenever a thread has to wait while the next item to consume is still being produced,
+ * so that threads aren't left idle by a single slow item while memory use stays low for cheap items.
+ * When a memory budget is given, it shrinks again whenever the items produced and not yet consumed take more memory than that,
+ * and it doesn't grow while they do.
+ * 
+ * Once the slicing is cancelled with ThreadPool::cancel, no more items are produced. The items already being produced are still consumed.
+ *
  * \warning This class is only adequate when the expected production time of an item is more than (n_threads - 1) times as much as the expected consumption time of an item
  */
 template <typename T>
@@ -36,14 +49,18 @@ public:
      * \param end_item_argument_index The last value with which to produce an item
      * \param produce_item The function with which to produce an item
      * \param consume_item The function with which to consume an item
-     * \param max_task_count The maximum number of items (being) produced without having been consumed
+     * \param max_task_count The upper limit on the number of items (being) produced without having been consumed
+     * \param memory_budget The number of bytes the items produced and not yet consumed may take, or zero for no limit
+     * \param get_item_memory_usage The function with which to get the number of bytes of a produced item, needed with a \p memory_budget
      */
     GcodeLayerThreader(
         int start_item_argument_index,
         int end_item_argument_index,
         const std::function<T* (int)>& produce_item,
         const std::function<void (T*)>& consume_item,
-        const unsigned int max_task_count
+        const unsigned int max_task_count,
+        const size_t memory_budget = 0,
+        const std::function<size_t (const T*)>& get_item_memory_usage = std::function<size_t (const T*)>()
     );
 
     /*!
@@ -68,7 +85,7 @@ private:
     /*!
      * Consume if possible, otherwise
      * Produce if possible, otherwise
-     * wait half a second
+     * wait until another thread has produced or consumed an item
      */
     void act();
 
@@ -77,18 +94,27 @@ private:
      */
     bool finished();
 
+    /*!
+     * Check whether no tasks are left for a thread to pick up, while \ref GcodeLayerThreader::state_mutex is already held
+     */
+    bool finishedLocked() const;
+
 private:
     // algorithm paramters
     const int start_item_argument_index; //!< The first index with which \ref GcodeLayerThreader::produce_item will be called
     const int end_item_argument_index; //!< The end index with which \ref GcodeLayerThreader::produce_item will not be called any more
     const unsigned int item_count; //!< The number of items to produce and consume
 
-    const int max_task_count; //!< The maximum amount of items active in the system
+    const int max_task_count; //!< The upper limit on \ref GcodeLayerThreader::task_count_limit
+    const size_t memory_budget; //!< The number of bytes the items produced and not yet consumed may take, or zero for no limit
+    const std::function<size_t (const T*)> get_item_memory_usage; //!< The function to get the number of bytes of a produced item
 
     const std::function<T* (int)>& produce_item; //!< The function to produce an item
     const std::function<void (T*)>& consume_item; //!< The function to consume an item
 
     // variables which change throughout the computation of the algorithm
+    std::mutex state_mutex; //!< Guards all variables below except \ref GcodeLayerThreader::consume_lock
+    std::condition_variable state_changed; //!< Notified whenever an item has been produced or consumed
     std::vector<T*> produced; //!< ordered list for every item to be produced; contains pointers to produced items which aren't consumed yet; rest is nullptr
     int last_produced_argument_index; //!< Counter to see which item next to produce
 
@@ -96,8 +122,17 @@ private:
     Lock consume_lock; //!< Lock to make sure no two threads consume at the same time
     int last_consumed_idx = -1; //!< The index into \ref GcodeLayerThreader::produced for the last item consumed
 
+    int task_count_limit; //!< The maximum amount of items active in the system, grown when threads are idle and shrunk when the items take more than the memory budget
+    std::vector<size_t> produced_bytes; //!< For every item produced and not yet consumed the number of bytes it took when it was produced
+    size_t produced_total_bytes = 0; //!< The sum of \ref GcodeLayerThreader::produced_bytes
+
     // statistics
     int active_task_count = 0; //!< Number of items active in this system.
+    double total_wait_time = 0.0; //!< The total time in seconds threads spent waiting because they could neither produce nor consume
+    int largest_task_count_limit; //!< The largest \ref GcodeLayerThreader::task_count_limit used
+    size_t peak_produced_bytes = 0; //!< The largest \ref GcodeLayerThreader::produced_total_bytes
+    int shrink_count = 0; //!< The number of times the \ref GcodeLayerThreader::task_count_limit was lowered to stay within the memory budget
+    int thread_count; //!< The number of threads producing and consuming items
 
 };
 
@@ -107,36 +142,50 @@ GcodeLayerThreader<T>::GcodeLayerThreader(
     int end_item_argument_index,
     const std::function<T* (int)>& produce_item,
     const std::function<void (T*)>& consume_item,
-    const unsigned int max_task_count
+    const unsigned int max_task_count,
+    const size_t memory_budget,
+    const std::function<size_t (const T*)>& get_item_memory_usage
 )
 : start_item_argument_index(start_item_argument_index)
 , end_item_argument_index(end_item_argument_index)
 , item_count(end_item_argument_index - start_item_argument_index)
 , max_task_count(max_task_count)
+, memory_budget(get_item_memory_usage? memory_budget : 0)
+, get_item_memory_usage(get_item_memory_usage)
 , produce_item(produce_item)
 , consume_item(consume_item)
 , last_produced_argument_index(start_item_argument_index - 1)
 {
     produced.resize(item_count, nullptr);
+    produced_bytes.resize(item_count, 0);
+    thread_count = ThreadPool::getThreadCount();
+    task_count_limit = std::max(1, std::min(static_cast<int>(max_task_count), 2 * thread_count));
+    largest_task_count_limit = task_count_limit;
 }
 
 template <typename T>
 void GcodeLayerThreader<T>::run()
 {
-    #pragma omp parallel
-    {
-#ifdef _OPENMP
-        #pragma omp master
-        log("Multithreading GcodeLayerThreader with %i threads.\n", omp_get_num_threads());
-#endif // _OPENMP
-        while (true)
+    const std::function<void ()> act_until_finished = [this]()
         {
-            if (finished())
+            while (!finished())
             {
-                break;
+                act();
             }
-            act();
+        };
+    log("Multithreading GcodeLayerThreader with %i threads.\n", thread_count);
+    { // the layers are given high priority, so that the threads of the pool help out with the next layer before with the work within a layer
+        ThreadPool::TaskGroup threads;
+        for (int thread_idx = 1; thread_idx < thread_count; thread_idx++)
+        {
+            threads.run(act_until_finished, ThreadPool::Priority::HIGH);
         }
+        act_until_finished();
+    }
+    log("GcodeLayerThreader threads spent %5.3fs waiting for items to become available, with at most %i items active.\n", total_wait_time, largest_task_count_limit);
+    if (memory_budget > 0)
+    {
+        log("The items waiting to be consumed took at most %zu bytes of the budget of %zu bytes; the number of active items was lowered %i times, to %i in the end.\n", peak_produced_bytes, memory_budget, shrink_count, task_count_limit);
     }
 }
 
@@ -145,87 +194,110 @@ void GcodeLayerThreader<T>::produce(int item_argument_index)
 {
     T* produced_item = produce_item(item_argument_index);
     int item_idx = item_argument_index - start_item_argument_index;
-    #pragma omp critical
+    const size_t item_bytes = (memory_budget > 0 && produced_item)? get_item_memory_usage(produced_item) : 0;
     {
+        std::lock_guard<std::mutex> lock(state_mutex);
         produced[item_idx] = produced_item;
+        produced_bytes[item_idx] = item_bytes;
+        produced_total_bytes += item_bytes;
+        peak_produced_bytes = std::max(peak_produced_bytes, produced_total_bytes);
+        if (memory_budget > 0 && produced_total_bytes > memory_budget && task_count_limit > 1)
+        { // the items waiting to be consumed take too much memory, so produce fewer of them ahead
+            task_count_limit--;
+            shrink_count++;
+        }
         if (item_idx == last_consumed_idx + 1 && item_idx < end_item_argument_index - start_item_argument_index)
         {
             assert(!to_be_consumed_item_idx && "the just produced item shouldn't be consumable already!");
             to_be_consumed_item_idx = item_idx;
         }
     }
+    state_changed.notify_all();
 }
 
 template <typename T>
 void GcodeLayerThreader<T>::consume(int item_idx)
 {
     consume_item(produced[item_idx]);
+    std::lock_guard<std::mutex> lock(state_mutex);
     produced[item_idx] = nullptr;
-    #pragma omp critical
+    produced_total_bytes -= produced_bytes[item_idx];
+    produced_bytes[item_idx] = 0;
+    assert(item_idx == last_consumed_idx + 1);
+    last_consumed_idx = item_idx;
+    if (last_consumed_idx + 1 < end_item_argument_index - start_item_argument_index && produced[last_consumed_idx + 1])
     {
-        assert(item_idx == last_consumed_idx + 1);
-        last_consumed_idx = item_idx;
-        if (produced[last_consumed_idx + 1] && last_consumed_idx + 1 < end_item_argument_index - start_item_argument_index)
-        {
-            assert(!to_be_consumed_item_idx && "The next produced item shouldn't already be noted as being consumable because of the lock!");
-            to_be_consumed_item_idx = last_consumed_idx + 1;
-        }
-        active_task_count--;
-        assert(active_task_count >= 0);
+        assert(!to_be_consumed_item_idx && "The next produced item shouldn't already be noted as being consumable because of the lock!");
+        to_be_consumed_item_idx = last_consumed_idx + 1;
     }
+    active_task_count--;
+    assert(active_task_count >= 0);
 }
 
 template <typename T>
 void GcodeLayerThreader<T>::act()
 {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    while (true)
     {
-        int item_idx = -1;
-        #pragma omp critical
-        {
-            if (to_be_consumed_item_idx && consume_lock.test_lock())
-            {
-                item_idx = *to_be_consumed_item_idx;
-                to_be_consumed_item_idx = nullptr;
-            }
-        }
-        if (item_idx >= 0)
+        if (to_be_consumed_item_idx && consume_lock.test_lock())
         {
+            int item_idx = *to_be_consumed_item_idx;
+            to_be_consumed_item_idx = nullptr;
+            lock.unlock();
             consume(item_idx);
             consume_lock.unlock();
+            state_changed.notify_all();
             return;
         }
-    }
 
-    {
-        std::optional<int> item_argument_index;
-        #pragma omp critical
+        if (ThreadPool::isCancelled() && last_produced_argument_index < end_item_argument_index - 1)
+        { // produce no more items; the items being produced are still consumed, so that none of them is leaked
+            last_produced_argument_index = end_item_argument_index - 1;
+            state_changed.notify_all();
+            continue;
+        }
+        if (active_task_count < task_count_limit)
         {
-            if (active_task_count < max_task_count)
+            int item_argument_index = ++last_produced_argument_index;
+            active_task_count++;
+            lock.unlock();
+            if (item_argument_index < end_item_argument_index)
             {
-                item_argument_index = ++last_produced_argument_index;
-                active_task_count++;
+                produce(item_argument_index);
             }
+            return;
         }
-        if (item_argument_index && *item_argument_index < end_item_argument_index)
+
+        if (finishedLocked())
         {
-            produce(*item_argument_index);
             return;
         }
+        if (!to_be_consumed_item_idx && task_count_limit < max_task_count && (memory_budget == 0 || produced_total_bytes <= memory_budget))
+        { // the next item to consume is still being produced, so let this thread produce further ahead
+            task_count_limit++;
+            largest_task_count_limit = std::max(largest_task_count_limit, task_count_limit);
+            continue;
+        }
+        // thread is blocked by too many items being processed
+        const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+        state_changed.wait(lock);
+        total_wait_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
     }
-    // thread is blocked by too many items being processed
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
 }
 
 template <typename T>
 bool GcodeLayerThreader<T>::finished()
 {
-    bool finished;
-    #pragma omp critical
-    {
-        finished = last_produced_argument_index >= end_item_argument_index - 1
-            && !to_be_consumed_item_idx;
-    }
-    return finished;
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return finishedLocked();
+}
+
+template <typename T>
+bool GcodeLayerThreader<T>::finishedLocked() const
+{
+    return last_produced_argument_index >= end_item_argument_index - 1
+        && !to_be_consumed_item_idx;
 }
 
 } // namespace cura
@@ -0,0 +1,161 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "JobEstimate.h"
+
+#include <algorithm> // max
+#include <cmath> // sqrt
+#include <string> // to_string
+
+#include "MeshGroup.h"
+#include "slicer.h"
+#include "utils/ThreadPool.h"
+
+namespace cura
+{
+
+namespace
+{
+
+constexpr uint64_t process_bytes = 32000000; //!< The settings, the registry and the code of the process itself
+constexpr double allocation_overhead = 1.5; //!< The unused capacity of the vectors and the temporary polygons of Clipper, relative to the estimated contents
+constexpr double point_bytes = sizeof(ClipperLib::IntPoint) + 8; //!< A point of a polygon, including its share of the vector and of the polygons around it
+constexpr double planned_point_bytes = 3 * sizeof(ClipperLib::IntPoint); //!< A point of a path in a layer plan, including the path and its config
+constexpr double seconds_per_segment = 0.2e-6; //!< Slicing a face at a layer and stitching the segment into polygons
+constexpr double seconds_per_area_point = 1e-6; //!< Offsetting and clipping a point of the areas of a layer
+constexpr double seconds_per_planned_point = 0.5e-6; //!< Generating, ordering and writing a point of the gcode
+
+/*!
+ * The number of infill lines crossing each scanline for an infill pattern.
+ */
+unsigned int getLineDirectionCount(EFillMethod pattern)
+{
+    switch (pattern)
+    {
+        case EFillMethod::NONE:
+            return 0;
+        case EFillMethod::LINES:
+        case EFillMethod::ZIG_ZAG:
+        case EFillMethod::CONCENTRIC:
+        case EFillMethod::CONCENTRIC_3D:
+            return 1;
+        case EFillMethod::GRID:
+        case EFillMethod::TETRAHEDRAL:
+            return 2;
+        default:
+            return 3;
+    }
+}
+
+}//namespace
+
+JobEstimate JobEstimate::estimate(const MeshGroup& meshgroup)
+{
+    JobEstimate estimate;
+    double segment_count = 0;
+    double area_point_count = 0;
+    double planned_point_count = 0;
+    double support_point_count = 0;
+    for (const Mesh& mesh : meshgroup.meshes)
+    {
+        estimate.face_count += mesh.faces.size();
+        estimate.mesh_bytes += mesh.vertices.capacity() * sizeof(MeshVertex) + mesh.faces.capacity() * sizeof(MeshFace)
+            + mesh.getVertexHashTableMemoryUsage() + mesh.getConnectedFacesMemoryUsage();
+        if (mesh.faces.empty())
+        {
+            continue;
+        }
+        const AABB3D aabb = mesh.getAABB();
+        const double layer_height = std::max(coord_t(1), mesh.getSettingInMicrons("layer_height"));
+        const double height = std::max(0, aabb.max.z - aabb.min.z);
+        const double layer_count = height / layer_height + 1;
+        estimate.layer_count = std::max(estimate.layer_count, static_cast<unsigned int>(aabb.max.z / layer_height) + 1);
+
+        // each face adds a segment to each layer it crosses, and its signed volume to that of the mesh
+        double mesh_segment_count = 0;
+        double volume = 0; // in cubic millimeters
+        for (const MeshFace& face : mesh.faces)
+        {
+            const Point3& a = mesh.vertices[face.vertex_index[0]].p;
+            const Point3& b = mesh.vertices[face.vertex_index[1]].p;
+            const Point3& c = mesh.vertices[face.vertex_index[2]].p;
+            const int32_t min_z = std::min(a.z, std::min(b.z, c.z));
+            const int32_t max_z = std::max(a.z, std::max(b.z, c.z));
+            mesh_segment_count += (max_z - min_z) / layer_height;
+            const double ax = a.x * 0.001, ay = a.y * 0.001, az = a.z * 0.001;
+            const double bx = b.x * 0.001, by = b.y * 0.001, bz = b.z * 0.001;
+            const double cx = c.x * 0.001, cy = c.y * 0.001, cz = c.z * 0.001;
+            volume += (ax * (by * cz - bz * cy) - ay * (bx * cz - bz * cx) + az * (bx * cy - by * cx)) / 6;
+        }
+        segment_count += mesh_segment_count;
+        const double cross_section_width = std::sqrt(std::abs(volume) / std::max(0.001, height * 0.001)) * 1000; // in microns, of a square with the average cross section
+
+        // the outline, each wall, the skin and infill areas, the combing boundary and the perimeter gaps follow the outline
+        const unsigned int wall_count = std::max(0, mesh.getSettingAsCount("wall_line_count"));
+        area_point_count += mesh_segment_count * (4 + wall_count);
+
+        // the layer plans hold the walls, and the lines of the infill, skin and support crossing the cross section
+        double lines_per_layer = 0;
+        const coord_t infill_line_distance = mesh.getSettingInMicrons("infill_line_distance");
+        if (infill_line_distance > 0)
+        {
+            lines_per_layer += getLineDirectionCount(mesh.getSettingAsFillMethod("infill_pattern")) * cross_section_width / infill_line_distance;
+        }
+        const coord_t skin_line_width = std::max(coord_t(1), mesh.getSettingInMicrons("skin_line_width"));
+        const double skin_layer_fraction = std::min(1.0, (mesh.getSettingAsCount("top_layers") + mesh.getSettingAsCount("bottom_layers")) / layer_count);
+        lines_per_layer += skin_layer_fraction * cross_section_width / skin_line_width;
+        planned_point_count += mesh_segment_count * wall_count + 2 * lines_per_layer * layer_count;
+
+        // the support covers the part of the bounding box the mesh doesn't, at most
+        if (mesh.getSettingBoolean("support_enable") || mesh.getSettingBoolean("support_mesh"))
+        {
+            const double footprint_width = std::sqrt(std::max(0.0, double(aabb.max.x - aabb.min.x) * double(aabb.max.y - aabb.min.y) - cross_section_width * cross_section_width));
+            const coord_t support_line_distance = mesh.getSettingInMicrons("support_line_distance");
+            const double support_lines_per_layer = (support_line_distance > 0) ? footprint_width / support_line_distance : 0;
+            support_point_count += (4 * footprint_width / std::max(coord_t(1), mesh.getSettingInMicrons("support_line_width")) + 2 * support_lines_per_layer) * layer_count;
+            planned_point_count += 2 * support_lines_per_layer * layer_count;
+        }
+    }
+
+    estimate.slicer_bytes = segment_count * (sizeof(SlicerSegment) + point_bytes);
+    estimate.layer_geometry_bytes = area_point_count * point_bytes;
+    estimate.support_bytes = support_point_count * point_bytes;
+    // the layer plan buffer keeps a few layers around each layer being planned by each thread
+    const double layers_in_flight = std::min(double(std::max(1u, estimate.layer_count)), 2.0 * ThreadPool::getThreadCount() + 8);
+    estimate.layer_plan_bytes = planned_point_count / std::max(1u, estimate.layer_count) * layers_in_flight * planned_point_bytes;
+    estimate.peak_bytes = estimate.getSpilledBytes(estimate.layer_geometry_bytes);
+    estimate.cpu_seconds = segment_count * seconds_per_segment + (area_point_count + support_point_count) * seconds_per_area_point + planned_point_count * seconds_per_planned_point;
+    return estimate;
+}
+
+uint64_t JobEstimate::getSpilledBytes(uint64_t layer_geometry_budget) const
+{
+    // the faces are cleared once sliced, after which the areas of all layers are generated;
+    // each layer is compressed and spilled as soon as its areas are finished, but for some features only once all layers are, so the areas are counted in full
+    const uint64_t slicing_bytes = mesh_bytes + slicer_bytes;
+    const uint64_t areas_bytes = layer_geometry_bytes + support_bytes;
+    const uint64_t writing_bytes = std::min(layer_geometry_budget, layer_geometry_bytes) + support_bytes + layer_plan_bytes;
+    return process_bytes + std::max(slicing_bytes, std::max(areas_bytes, writing_bytes)) * allocation_overhead;
+}
+
+uint64_t JobEstimate::getLayerGeometryBudget(uint64_t available_bytes) const
+{
+    if (available_bytes <= process_bytes)
+    {
+        return 0;
+    }
+    const uint64_t available_contents = (available_bytes - process_bytes) / allocation_overhead;
+    if (mesh_bytes + slicer_bytes > available_contents || layer_geometry_bytes + support_bytes > available_contents
+        || support_bytes + layer_plan_bytes >= available_contents)
+    {
+        return 0;
+    }
+    return available_contents - support_bytes - layer_plan_bytes;
+}
+
+void JobEstimate::setLayerGeometryMemoryBudget(MeshGroup& meshgroup, int megabytes)
+{
+    meshgroup.setSetting("layer_geometry_memory_budget", std::to_string(megabytes));
+}
+
+}//namespace cura
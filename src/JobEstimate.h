@@ -0,0 +1,68 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef JOB_ESTIMATE_H
+#define JOB_ESTIMATE_H
+
+#include <cstdint>
+
+namespace cura
+{
+
+class MeshGroup;
+
+/*!
+ * An estimate of the peak memory and the CPU time of slicing a mesh group, made once its models are loaded and before it is sliced.
+ *
+ * The estimate follows the components counted by MemoryReport: the meshes, which are measured,
+ * the segments of the slicer, the areas of the layers, the support and the layer plans in flight.
+ * Since the shape of the areas isn't known yet, their number of points is derived from the faces of the meshes:
+ * - each face crossing a layer adds a segment to it, and a point to the outline of that layer,
+ * - each wall, the skin and infill areas and the perimeter gaps are another polygon along the outline,
+ * - the lines of infill, skin and support follow from the average cross section of each mesh, its volume divided by its height, and their line distances.
+ * The CPU time is a rough cost per segment, per area point and per planned point.
+ *
+ * batch uses these to admit no more concurrent jobs than fit in its memory budget, see the -M option.
+ * Both are rough; with --memory-report the estimate is written before the measured stages, to compare it with them.
+ */
+struct JobEstimate
+{
+    uint64_t face_count = 0; //!< The faces of all meshes
+    unsigned int layer_count = 0; //!< The layers of the highest mesh
+    uint64_t mesh_bytes = 0; //!< The memory held by the loaded meshes
+    uint64_t slicer_bytes = 0; //!< The memory of the segments and polygons of the slicer, while slicing
+    uint64_t layer_geometry_bytes = 0; //!< The memory of the areas of all layers, which compressing and spilling them frees while the gcode is written
+    uint64_t support_bytes = 0; //!< The memory of the support areas
+    uint64_t layer_plan_bytes = 0; //!< The memory of the layer plans in flight
+    uint64_t peak_bytes = 0; //!< The estimated peak resident set size
+    double cpu_seconds = 0; //!< The estimated CPU time, summed over all threads
+
+    /*!
+     * Estimate the slicing of a mesh group of which the models are loaded and the settings flattened.
+     */
+    static JobEstimate estimate(const MeshGroup& meshgroup);
+
+    /*!
+     * Get the peak memory of the job with its layer geometry compressed and spilled beyond \p layer_geometry_budget bytes,
+     * which lowers the memory held while the gcode is written.
+     */
+    uint64_t getSpilledBytes(uint64_t layer_geometry_budget) const;
+
+    /*!
+     * Get the largest budget in bytes for the layer geometry with which the peak memory of the job fits in \p available_bytes,
+     * or zero if it doesn't fit even when all of its layer geometry is spilled.
+     */
+    uint64_t getLayerGeometryBudget(uint64_t available_bytes) const;
+
+    /*!
+     * Give a mesh group the budget in megabytes for its layer geometry with which its job was admitted.
+     *
+     * The budget is set on the mesh group itself, where the stages slicing it look first,
+     * so that it applies whether or not the settings of the mesh group have been flattened already.
+     */
+    static void setLayerGeometryMemoryBudget(MeshGroup& meshgroup, int megabytes);
+};
+
+}//namespace cura
+
+#endif//JOB_ESTIMATE_H
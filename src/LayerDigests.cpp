@@ -0,0 +1,51 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "LayerDigests.h"
+
+#include "LayerPlan.h"
+#include "PrintFeature.h"
+#include "utils/logoutput.h"
+
+namespace cura
+{
+
+FILE* LayerDigests::out = nullptr;
+std::mutex LayerDigests::out_mutex;
+
+namespace
+{
+//! The names of the feature types in the digests, in the order of PrintFeatureType
+const char* const feature_names[] = {"none", "wall_outer", "wall_inner", "skin", "support", "skirt_brim", "infill", "support_infill", "move_combing", "move_retraction", "support_interface"};
+static_assert(sizeof(feature_names) / sizeof(feature_names[0]) == static_cast<size_t>(PrintFeatureType::NumPrintFeatureTypes), "Each feature type needs a name");
+}//namespace
+
+void LayerDigests::enable(const std::string& output_file)
+{
+    out = fopen(output_file.c_str(), "w");
+    if (!out)
+    {
+        logError("Failed to open %s for the layer digests.\n", output_file.c_str());
+    }
+}
+
+void LayerDigests::write(const LayerPlan& layer_plan)
+{
+    const std::vector<uint64_t> digests = layer_plan.getPathDigests();
+    std::lock_guard<std::mutex> lock(out_mutex);
+    fprintf(out, "{\"layer\": %d, \"features\": {", layer_plan.getLayerNr());
+    bool first_feature = true;
+    for (unsigned int feature_idx = 0; feature_idx < digests.size(); feature_idx++)
+    {
+        if (digests[feature_idx] == 0)
+        {
+            continue;
+        }
+        fprintf(out, "%s\"%s\": \"%016llx\"", first_feature? "" : ", ", feature_names[feature_idx], static_cast<unsigned long long>(digests[feature_idx]));
+        first_feature = false;
+    }
+    fprintf(out, "}}\n");
+    fflush(out);
+}
+
+}//namespace cura
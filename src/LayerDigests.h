@@ -0,0 +1,56 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef LAYER_DIGESTS_H
+#define LAYER_DIGESTS_H
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+namespace cura
+{
+
+class LayerPlan;
+
+/*!
+ * Writes a digest of the planned paths of each layer, so that the output of a build of the engine can be compared with that of another build.
+ *
+ * Each layer is a line with a JSON object in the output file, with the layer number and the hash of the paths of each feature type of the layer,
+ * see LayerPlan::getPathDigests. The layers are written in the order in which they are written to the gcode.
+ * tests/golden_test.py compares these digests and those of the gcode of each layer with those of a baseline,
+ * to tell which layer and which feature differ first when a change which should leave the output alone doesn't.
+ *
+ * The digests are off unless LayerDigests::enable is called. Otherwise they cost a single check of a flag per layer.
+ */
+class LayerDigests
+{
+public:
+    /*!
+     * Start writing the digests to \p output_file, overwriting it.
+     */
+    static void enable(const std::string& output_file);
+
+    /*!
+     * Whether LayerDigests::enable has been called successfully.
+     */
+    static bool isEnabled()
+    {
+        return out != nullptr;
+    }
+
+    /*!
+     * Write the digests of the paths of a layer which is about to be written to the gcode.
+     *
+     * This function is thread safe.
+     */
+    static void write(const LayerPlan& layer_plan);
+
+private:
+    static FILE* out; //!< The file to which the digests are written
+    static std::mutex out_mutex; //!< Guards LayerDigests::out
+};
+
+}//namespace cura
+
+#endif//LAYER_DIGESTS_H
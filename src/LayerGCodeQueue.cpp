@@ -0,0 +1,94 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include <cassert>
+
+#include "LayerGCodeQueue.h"
+
+namespace cura
+{
+
+LayerGCodeQueue::LayerGCodeQueue(std::ostream& output, bool flush_each_layer)
+: output(output)
+, flush_each_layer(flush_each_layer)
+, next_to_convert(0)
+{
+}
+
+void LayerGCodeQueue::push(std::unique_ptr<DeferredLayerGCode> layer)
+{
+    std::lock_guard<std::mutex> lock(items_mutex);
+    items.emplace_back();
+    items.back().layer = std::move(layer);
+    items.back().is_converted = false;
+}
+
+void LayerGCodeQueue::work()
+{
+    while (true)
+    {
+        Item* item;
+        {
+            std::lock_guard<std::mutex> lock(items_mutex);
+            if (next_to_convert >= items.size())
+            {
+                return;
+            }
+            item = &items[next_to_convert]; // references to the items stay valid while others are pushed and popped
+            next_to_convert++;
+        }
+        item->text = item->layer->format();
+        item->layer.reset();
+        {
+            std::lock_guard<std::mutex> lock(items_mutex);
+            item->is_converted = true;
+        }
+        writeConverted();
+    }
+}
+
+void LayerGCodeQueue::flush()
+{
+    work();
+    writeConverted();
+    assert(items.empty() && "All layers should have been written once no other thread uses the queue.");
+}
+
+void LayerGCodeQueue::writeConverted()
+{
+    bool front_is_converted = true;
+    while (front_is_converted)
+    {
+        {
+            std::unique_lock<std::mutex> output_lock(output_mutex, std::try_to_lock);
+            if (!output_lock.owns_lock())
+            { // the thread writing will also write the layers converted in the meantime
+                return;
+            }
+            while (true)
+            {
+                std::string text;
+                {
+                    std::lock_guard<std::mutex> lock(items_mutex);
+                    if (items.empty() || !items.front().is_converted)
+                    {
+                        break;
+                    }
+                    text.swap(items.front().text);
+                    items.pop_front();
+                    next_to_convert--;
+                }
+                output << text;
+                if (flush_each_layer)
+                {
+                    output.flush();
+                }
+            }
+        }
+        // A layer at the front may have been converted by a thread which found the output locked just before it was unlocked.
+        std::lock_guard<std::mutex> lock(items_mutex);
+        front_is_converted = !items.empty() && items.front().is_converted;
+    }
+}
+
+}//namespace cura
@@ -0,0 +1,84 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef LAYER_GCODE_QUEUE_H
+#define LAYER_GCODE_QUEUE_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "gcodeExport.h"
+#include "utils/NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * The layers of which the gcode has been written in order, but of which the moves still have to be converted to text.
+ *
+ * Any thread may convert the next waiting layer to text, so that several layers are converted in parallel,
+ * after which the converted layers are written to the output stream in the order in which they were pushed.
+ *
+ * This class is thread safe, but only a single thread should push the layers, in order.
+ */
+class LayerGCodeQueue : NoCopy
+{
+public:
+    /*!
+     * \param output The stream to which the converted layers are written
+     * \param flush_each_layer Whether to pass each layer on to the target of \p output as soon as it's written
+     */
+    LayerGCodeQueue(std::ostream& output, bool flush_each_layer);
+
+    /*!
+     * Add the gcode of the next layer, to be converted to text.
+     *
+     * \param layer The gcode of the layer, which GCodeExport is done writing
+     */
+    void push(std::unique_ptr<DeferredLayerGCode> layer);
+
+    /*!
+     * Convert the layers waiting to be converted to text, one by one, and write the layers which are next in order.
+     *
+     * Returns when no layers are waiting, even if other threads are still converting layers.
+     */
+    void work();
+
+    /*!
+     * Convert and write all layers pushed.
+     *
+     * Should only be called when no other thread uses the queue anymore,
+     * before anything else is written to the output stream.
+     */
+    void flush();
+
+private:
+    /*!
+     * A layer in the queue.
+     */
+    struct Item
+    {
+        std::unique_ptr<DeferredLayerGCode> layer; //!< The gcode of the layer, until it's converted to text
+        std::string text; //!< The gcode of the layer as text, once converted
+        bool is_converted; //!< Whether \ref Item::text is complete
+    };
+
+    std::ostream& output; //!< The stream to which the converted layers are written
+    const bool flush_each_layer; //!< Whether to flush \ref LayerGCodeQueue::output after each layer
+    std::deque<Item> items; //!< The layers pushed which haven't been written yet, in order
+    size_t next_to_convert; //!< The index in \ref LayerGCodeQueue::items of the first layer no thread is converting yet
+    std::mutex items_mutex; //!< The lock on \ref LayerGCodeQueue::items and \ref LayerGCodeQueue::next_to_convert, but not on the layer and text of an item being converted
+    std::mutex output_mutex; //!< The lock on \ref LayerGCodeQueue::output, held by the single thread writing the converted layers
+
+    /*!
+     * Write the converted layers at the front of the queue, unless another thread is already writing them.
+     */
+    void writeConverted();
+};
+
+}//namespace cura
+
+#endif//LAYER_GCODE_QUEUE_H
@@ -1,11 +1,16 @@
 /** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
+#include <cmath> // llround
 #include <cstring>
+#include <memory> // unique_ptr
+#include <unordered_map>
 #include "LayerPlan.h"
 #include "pathOrderOptimizer.h"
 #include "sliceDataStorage.h"
 #include "utils/polygonUtils.h"
+#include "utils/PolygonSegmentGrid.h"
 #include "MergeInfillLines.h"
 #include "raft.h" // getTotalExtraLayers
+#include "LayerDigests.h"
 
 namespace cura {
 
@@ -59,13 +64,14 @@ GCodePath* LayerPlan::getLatestPathWithConfig(const GCodePathConfig* config, Spa
     std::vector<GCodePath>& paths = extruder_plans.back().paths;
     if (paths.size() > 0 && paths.back().config == config && !paths.back().done && paths.back().flow == flow) // spiralize can only change when a travel path is in between
         return &paths.back();
-    paths.emplace_back();
+    paths.emplace_back(memory->path_point_arena);
     GCodePath* ret = &paths.back();
     ret->retract = false;
     ret->perform_prime = false;
     ret->perform_z_hop = false;
     ret->config = config;
     ret->done = false;
+    ret->length = 0.0;
     ret->flow = flow;
     ret->spiralize = spiralize;
     ret->space_fill_type = space_fill_type;
@@ -79,14 +85,16 @@ void LayerPlan::forceNewPathStart()
         paths[paths.size()-1].done = true;
 }
 
-LayerPlan::LayerPlan(const SliceDataStorage& storage, int layer_nr, int z, int layer_thickness, unsigned int start_extruder, const std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder, CombingMode combing_mode, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance)
+LayerPlan::LayerPlan(const SliceDataStorage& storage, int layer_nr, int z, int layer_thickness, unsigned int start_extruder, const std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder, CombingMode combing_mode, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance, LayerPlanMemoryPool& memory_pool)
 : storage(storage)
-, configs_storage(storage, layer_nr, layer_thickness)
+, configs_storage(*storage.path_configs, storage, layer_nr, layer_thickness)
 , layer_nr(layer_nr)
 , is_initial_layer(layer_nr == 0 - Raft::getTotalExtraLayers(storage))
 , z(z)
 , layer_thickness(layer_thickness)
 , has_prime_tower_planned(false)
+, memory_pool(memory_pool)
+, memory(memory_pool.take())
 , last_extruder_previous_layer(start_extruder)
 , last_planned_extruder_setting_base(storage.meshgroup->getExtruderTrain(start_extruder))
 , first_travel_destination_is_inside(false) // set properly when addTravel is called for the first time (otherwise not set properly)
@@ -112,6 +120,7 @@ LayerPlan::LayerPlan(const SliceDataStorage& storage, int layer_nr, int z, int l
     }
     extruder_plans.reserve(storage.meshgroup->getExtruderCount());
     extruder_plans.emplace_back(current_extruder, layer_nr, is_initial_layer, layer_thickness, fan_speed_layer_time_settings_per_extruder[current_extruder], storage.retraction_config_per_extruder[current_extruder]);
+    memory->reusePathVector(extruder_plans.back().paths);
 
     for (int extruder = 0; extruder < storage.meshgroup->getExtruderCount(); extruder++)
     { //Skirt and brim.
@@ -123,6 +132,14 @@ LayerPlan::~LayerPlan()
 {
     if (comb)
         delete comb;
+    // keep the vectors of paths, and give back the memory once no paths use the points in its arena anymore
+    for (ExtruderPlan& extruder_plan : extruder_plans)
+    {
+        extruder_plan.paths.clear();
+        memory->path_vectors.push_back(std::move(extruder_plan.paths));
+    }
+    extruder_plans.clear();
+    memory_pool.give(std::move(memory));
 }
 
 SettingsBaseVirtual* LayerPlan::getLastPlannedExtruderTrainSettings()
@@ -208,6 +225,7 @@ bool LayerPlan::setExtruder(int extruder)
     else 
     {
         extruder_plans.emplace_back(extruder, layer_nr, is_initial_layer, layer_thickness, fan_speed_layer_time_settings_per_extruder[extruder], storage.retraction_config_per_extruder[extruder]);
+        memory->reusePathVector(extruder_plans.back().paths);
         assert((int)extruder_plans.size() <= storage.meshgroup->getExtruderCount() && "Never use the same extruder twice on one layer!");
     }
     last_planned_extruder_setting_base = storage.meshgroup->getExtruderTrain(extruder);
@@ -337,9 +355,8 @@ GCodePath& LayerPlan::addTravel(Point p, bool force_comb_retract)
                 // don't perform a z-hop
                 for (Point& combPoint : combPath)
                 {
-                    path->points.push_back(combPoint);
+                    addPoint(*path, combPoint);
                 }
-                last_planned_position = combPath.back();
             }
         }
     }
@@ -373,8 +390,7 @@ GCodePath& LayerPlan::addTravel_simple(Point p, GCodePath* path)
     {
         path = getLatestPathWithConfig(&configs_storage.travel_config_per_extruder[getExtruder()], SpaceFillType::None);
     }
-    path->points.push_back(p);
-    last_planned_position = p;
+    addPoint(*path, p);
     return *path;
 }
 
@@ -390,7 +406,16 @@ void LayerPlan::planPrime()
 
 void LayerPlan::addExtrusionMove(Point p, const GCodePathConfig* config, SpaceFillType space_fill_type, float flow, bool spiralize)
 {
-    getLatestPathWithConfig(config, space_fill_type, flow, spiralize)->points.push_back(p);
+    addPoint(*getLatestPathWithConfig(config, space_fill_type, flow, spiralize), p);
+}
+
+void LayerPlan::addPoint(GCodePath& path, Point p)
+{
+    if (last_planned_position)
+    {
+        path.length += vSizeMM(p - *last_planned_position);
+    }
+    path.points.push_back(p);
     last_planned_position = p;
 }
 
@@ -449,28 +474,70 @@ void LayerPlan::addPolygonsByOptimizer(const Polygons& polygons, const GCodePath
         return;
     }
     PathOrderOptimizer orderOptimizer(getLastPosition(), z_seam_pos, z_seam_type);
+    orderOptimizer.random_seed = layer_nr;
     for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
     {
         orderOptimizer.addPolygon(polygons[poly_idx]);
     }
     orderOptimizer.optimize();
-    for (unsigned int poly_idx : orderOptimizer.polyOrder)
+    addPolygonsInOrder(polygons, orderOptimizer.polyOrder, orderOptimizer.polyStart, config, wall_overlap_computation, wall_0_wipe_dist, spiralize, flow_ratio, always_retract);
+}
+
+void LayerPlan::addPolygonsInOrder(const Polygons& polygons, const std::vector<int>& poly_order, const std::vector<int>& poly_start, const GCodePathConfig* config, WallOverlapComputation* wall_overlap_computation, coord_t wall_0_wipe_dist, bool spiralize, float flow_ratio, bool always_retract)
+{
+    for (unsigned int poly_idx : poly_order)
     {
-        addPolygon(polygons[poly_idx], orderOptimizer.polyStart[poly_idx], config, wall_overlap_computation, wall_0_wipe_dist, spiralize, flow_ratio, always_retract);
+        addPolygon(polygons[poly_idx], poly_start[poly_idx], config, wall_overlap_computation, wall_0_wipe_dist, spiralize, flow_ratio, always_retract);
     }
 }
+
 void LayerPlan::addLinesByOptimizer(const Polygons& polygons, const GCodePathConfig* config, SpaceFillType space_fill_type, int wipe_dist, float flow_ratio)
 {
+    if (space_fill_type == SpaceFillType::PolyLines)
+    {
+        const Polygons polylines = chainLines(polygons);
+        if (polylines.size() == 1 && polygons.size() > 1)
+        { // the lines form a single polyline, which is already in order; only choose the end to start from
+            ConstPolygonRef polyline = polylines[0];
+            const Point last_position = getLastPosition();
+            addPolyLine(polyline, vSize2(polyline.back() - last_position) < vSize2(polyline[0] - last_position), config, space_fill_type, wipe_dist, flow_ratio);
+            return;
+        }
+        if (polylines.size() < polygons.size())
+        { // optimize the order of the polylines by their ends
+            Polygons polyline_ends;
+            for (ConstPolygonRef polyline : polylines)
+            {
+                polyline_ends.addLine(polyline[0], polyline.back());
+            }
+            LineOrderOptimizer order_optimizer(getLastPosition());
+            for (unsigned int polyline_idx = 0; polyline_idx < polyline_ends.size(); polyline_idx++)
+            {
+                order_optimizer.addPolygon(polyline_ends[polyline_idx]);
+            }
+            order_optimizer.optimize();
+            for (int polyline_idx : order_optimizer.polyOrder)
+            {
+                addPolyLine(polylines[polyline_idx], order_optimizer.polyStart[polyline_idx] == 1, config, space_fill_type, wipe_dist, flow_ratio);
+            }
+            return;
+        }
+    }
     LineOrderOptimizer orderOptimizer(getLastPosition());
     for (unsigned int line_idx = 0; line_idx < polygons.size(); line_idx++)
     {
         orderOptimizer.addPolygon(polygons[line_idx]);
     }
     orderOptimizer.optimize();
-    for (int poly_idx : orderOptimizer.polyOrder)
+    addLinesInOrder(polygons, orderOptimizer.polyOrder, orderOptimizer.polyStart, config, space_fill_type, wipe_dist, flow_ratio);
+}
+
+void LayerPlan::addLinesInOrder(const Polygons& polygons, const std::vector<int>& line_order, const std::vector<int>& line_start, const GCodePathConfig* config, SpaceFillType space_fill_type, int wipe_dist, float flow_ratio)
+{
+    for (int poly_idx : line_order)
     {
         ConstPolygonRef polygon = polygons[poly_idx];
-        int start = orderOptimizer.polyStart[poly_idx];
+        int start = line_start[poly_idx];
         int end = 1 - start;
         const Point& p0 = polygon[start];
         addTravel(p0);
@@ -487,25 +554,136 @@ void LayerPlan::addLinesByOptimizer(const Polygons& polygons, const GCodePathCon
     }
 }
 
+Polygons LayerPlan::chainLines(const Polygons& lines)
+{
+    // The ends of the lines at a point, as 2 * line index + end index. Only a point where exactly two ends meet is chained through.
+    struct EndsAtPoint
+    {
+        unsigned int count = 0;
+        unsigned int ends[2];
+    };
+    std::unordered_map<Point, EndsAtPoint> ends_at_point;
+    auto can_chain = [&lines](unsigned int line_idx)
+    {
+        return lines[line_idx].size() == 2 && lines[line_idx][0] != lines[line_idx][1];
+    };
+    for (unsigned int line_idx = 0; line_idx < lines.size(); line_idx++)
+    {
+        if (!can_chain(line_idx))
+        {
+            continue;
+        }
+        for (unsigned int end_idx = 0; end_idx < 2; end_idx++)
+        {
+            EndsAtPoint& ends = ends_at_point[lines[line_idx][end_idx]];
+            if (ends.count < 2)
+            {
+                ends.ends[ends.count] = line_idx * 2 + end_idx;
+            }
+            ends.count++;
+        }
+    }
+    // The end of the other line which continues at an end of a line, or -1 if there is none
+    auto continuation = [&lines, &ends_at_point](unsigned int line_end) -> int
+    {
+        const EndsAtPoint& ends = ends_at_point.find(lines[line_end / 2][line_end % 2])->second;
+        if (ends.count != 2)
+        {
+            return -1;
+        }
+        return (ends.ends[0] == line_end) ? ends.ends[1] : ends.ends[0];
+    };
+
+    Polygons result;
+    std::vector<bool> chained(lines.size(), false);
+    auto chain_from = [&](unsigned int line_idx, unsigned int start_end_idx)
+    {
+        PolygonRef polyline = result.newPoly();
+        polyline.add(lines[line_idx][start_end_idx]);
+        chained[line_idx] = true;
+        unsigned int line_end = line_idx * 2 + 1 - start_end_idx; // the end of the last chained line, at which the chain continues
+        while (true)
+        {
+            polyline.add(lines[line_end / 2][line_end % 2]);
+            const int next_line_end = continuation(line_end);
+            if (next_line_end < 0 || chained[next_line_end / 2])
+            {
+                break;
+            }
+            chained[next_line_end / 2] = true;
+            line_end = next_line_end ^ 1;
+        }
+    };
+    for (unsigned int line_idx = 0; line_idx < lines.size(); line_idx++)
+    { // start each open chain at one of its loose ends
+        if (!can_chain(line_idx))
+        {
+            result.add(lines[line_idx]);
+            chained[line_idx] = true;
+        }
+        else if (!chained[line_idx])
+        {
+            if (continuation(line_idx * 2) < 0)
+            {
+                chain_from(line_idx, 0);
+            }
+            else if (continuation(line_idx * 2 + 1) < 0)
+            {
+                chain_from(line_idx, 1);
+            }
+        }
+    }
+    for (unsigned int line_idx = 0; line_idx < lines.size(); line_idx++)
+    { // the remaining lines form closed chains
+        if (!chained[line_idx])
+        {
+            chain_from(line_idx, 0);
+        }
+    }
+    return result;
+}
+
+void LayerPlan::addPolyLine(ConstPolygonRef polyline, bool reversed, const GCodePathConfig* config, SpaceFillType space_fill_type, int wipe_dist, float flow_ratio)
+{
+    const unsigned int last_idx = polyline.size() - 1;
+    Point p0 = polyline[reversed ? last_idx : 0];
+    addTravel(p0);
+    Point p1 = p0;
+    for (unsigned int point_idx = 1; point_idx <= last_idx; point_idx++)
+    {
+        p0 = p1;
+        p1 = polyline[reversed ? last_idx - point_idx : point_idx];
+        addExtrusionMove(p1, config, space_fill_type, flow_ratio);
+    }
+    if (wipe_dist != 0)
+    {
+        int line_width = config->getLineWidth();
+        if (vSize2(p1-p0) > line_width * line_width * 4)
+        { // otherwise line will get optimized by combining multiple into a single extrusion move
+            addExtrusionMove(p1 + normal(p1-p0, wipe_dist), config, space_fill_type, 0.0);
+        }
+    }
+}
+
 void LayerPlan::spiralizeWallSlice(const GCodePathConfig* config, ConstPolygonRef wall, ConstPolygonRef last_wall, const int seam_vertex_idx, const int last_seam_vertex_idx)
 {
     const Point origin = (last_seam_vertex_idx >= 0) ? last_wall[last_seam_vertex_idx] : wall[seam_vertex_idx];
     addTravel_simple(origin);
 
     const int n_points = wall.size();
-    Polygons last_wall_polygons;
-    last_wall_polygons.add(last_wall);
     const int max_dist2 = config->getLineWidth() * config->getLineWidth() * 4; // (2 * lineWidth)^2;
     const bool smooth_contours = storage.getSettingBoolean("smooth_spiralized_contours");
 
-    double total_length = 0.0; // determine the length of the complete wall
+    // the length of the wall up to each point following the seam vertex, in a single pass
+    std::vector<double> wall_lengths(n_points + 1, 0.0);
     Point p0 = origin;
     for (int wall_point_idx = 1; wall_point_idx <= n_points; ++wall_point_idx)
     {
         const Point& p1 = wall[(seam_vertex_idx + wall_point_idx) % n_points];
-        total_length += vSizeMM(p1 - p0);
+        wall_lengths[wall_point_idx] = wall_lengths[wall_point_idx - 1] + vSizeMM(p1 - p0);
         p0 = p1;
     }
+    const double total_length = wall_lengths[n_points]; // the length of the complete wall
 
     if (total_length == 0.0)
     {
@@ -513,26 +691,28 @@ void LayerPlan::spiralizeWallSlice(const GCodePathConfig* config, ConstPolygonRe
         return;
     }
 
+    // the closest points on the last wall are found with a grid over its segments, rather than by going over all of them for each point
+    std::unique_ptr<PolygonSegmentGrid> last_wall_grid;
+    if (smooth_contours)
+    {
+        last_wall_grid.reset(new PolygonSegmentGrid(last_wall));
+    }
+
     // extrude to the points following the seam vertex
     // the last point is the seam vertex as the polygon is a loop
-    double wall_length = 0.0;
-    p0 = origin;
     for (int wall_point_idx = 1; wall_point_idx <= n_points; ++wall_point_idx)
     {
         // p is a point from the current wall polygon
         const Point& p = wall[(seam_vertex_idx + wall_point_idx) % n_points];
         if (smooth_contours)
         {
-            wall_length += vSizeMM(p - p0);
-            p0 = p;
-
             // now find the point on the last wall that is closest to p
-            ClosestPolygonPoint cpp = PolygonUtils::findClosest(p, last_wall_polygons);
-            // if we found a point and it's not further away than max_dist2, use it
-            if (cpp.isValid() && vSize2(cpp.location - p) <= max_dist2)
+            const Point closest = last_wall_grid->findClosestPoint(p);
+            // if it's not further away than max_dist2, use it
+            if (last_wall.size() > 0 && vSize2(closest - p) <= max_dist2)
             {
-                // interpolate between cpp.location and p depending on how far we have progressed along wall
-                addExtrusionMove(cpp.location + (p - cpp.location) * (wall_length / total_length), config, SpaceFillType::Polygons, 1.0, true);
+                // interpolate between the closest point and p depending on how far we have progressed along wall
+                addExtrusionMove(closest + (p - closest) * (wall_lengths[wall_point_idx] / total_length), config, SpaceFillType::Polygons, 1.0, true);
             }
             else
             {
@@ -581,6 +761,7 @@ void ExtruderPlan::forceMinimalLayerTime(double minTime, double minimalSpeed, do
         
         // Adjust stored naive time estimates
         estimates.extrude_time *= inv_factor;
+        path_times_to_end.clear();
         for (GCodePath& path : paths)
         {
             path.estimates.extrude_time *= inv_factor;
@@ -593,64 +774,90 @@ void ExtruderPlan::forceMinimalLayerTime(double minTime, double minimalSpeed, do
         this->totalPrintTime = (extrudeTime * inv_factor) + travelTime;
     }
 }
-TimeMaterialEstimates ExtruderPlan::computeNaiveTimeEstimates(Point starting_position)
+TimeMaterialEstimates ExtruderPlan::computeNaiveTimeEstimates(std::optional<Point> starting_position)
 {
-    TimeMaterialEstimates ret;
-    Point p0 = starting_position;
-
-    bool was_retracted = false; // wrong assumption; won't matter that much. (TODO)
+    path_times_to_end.clear();
     for (GCodePath& path : paths)
     {
-        bool is_extrusion_path = false;
-        double* path_time_estimate;
-        double& material_estimate = path.estimates.material;
-        if (!path.isTravelPath())
+        double length = path.length;
+        if (starting_position && !path.points.empty())
+        { // the move to the first point of the layer
+            length += vSizeMM(path.points.front() - *starting_position);
+            starting_position = std::optional<Point>();
+        }
+        computeNaiveTimeEstimates(path, length);
+        estimates += path.estimates;
+    }
+    return estimates;
+}
+
+const std::vector<double>& ExtruderPlan::getPathTimesToEnd()
+{
+    if (path_times_to_end.size() != paths.size() + 1)
+    { // paths have been added since, such as the travel move to the next layer
+        path_times_to_end.resize(paths.size() + 1);
+        path_times_to_end[paths.size()] = 0.0;
+        for (unsigned int path_idx = paths.size() - 1; int(path_idx) != -1; path_idx--)
+        {
+            path_times_to_end[path_idx] = path_times_to_end[path_idx + 1] + paths[path_idx].estimates.getTotalTime();
+        }
+    }
+    return path_times_to_end;
+}
+
+int ExtruderPlan::findPathStartingBeforeEnd(double time, bool or_equal)
+{
+    const std::vector<double>& times_to_end = getPathTimesToEnd();
+    // the times to the end decrease along the paths, so the paths starting before the time come first
+    const std::vector<double>::const_iterator after = std::partition_point(times_to_end.begin(), times_to_end.end() - 1,
+        [time, or_equal](double time_to_end) { return or_equal? time_to_end >= time : time_to_end > time; });
+    return int(after - times_to_end.begin()) - 1;
+}
+
+void ExtruderPlan::computeNaiveTimeEstimates(GCodePath& path, double length)
+{
+    const bool was_retracted = false; // wrong assumption; won't matter that much. (TODO)
+    bool is_extrusion_path = false;
+    double* path_time_estimate;
+    double& material_estimate = path.estimates.material;
+    if (!path.isTravelPath())
+    {
+        is_extrusion_path = true;
+        path_time_estimate = &path.estimates.extrude_time;
+    }
+    else 
+    {
+        if (path.retract)
         {
-            is_extrusion_path = true;
-            path_time_estimate = &path.estimates.extrude_time;
+            path_time_estimate = &path.estimates.retracted_travel_time;
         }
         else 
         {
+            path_time_estimate = &path.estimates.unretracted_travel_time;
+        }
+        if (path.retract != was_retracted)
+        { // handle retraction times
+            double retract_unretract_time;
             if (path.retract)
             {
-                path_time_estimate = &path.estimates.retracted_travel_time;
+                retract_unretract_time = retraction_config.distance / retraction_config.speed;
             }
             else 
             {
-                path_time_estimate = &path.estimates.unretracted_travel_time;
-            }
-            if (path.retract != was_retracted)
-            { // handle retraction times
-                double retract_unretract_time;
-                if (path.retract)
-                {
-                    retract_unretract_time = retraction_config.distance / retraction_config.speed;
-                }
-                else 
-                {
-                    retract_unretract_time = retraction_config.distance / retraction_config.primeSpeed;
-                }
-                path.estimates.retracted_travel_time += 0.5 * retract_unretract_time;
-                path.estimates.unretracted_travel_time += 0.5 * retract_unretract_time;
-            }
-        }
-        for(Point& p1 : path.points)
-        {
-            double length = vSizeMM(p0 - p1);
-            if (is_extrusion_path)
-            {
-                material_estimate += length * INT2MM(layer_thickness) * INT2MM(path.config->getLineWidth());
+                retract_unretract_time = retraction_config.distance / retraction_config.primeSpeed;
             }
-            double thisTime = length / path.config->getSpeed();
-            *path_time_estimate += thisTime;
-            p0 = p1;
+            path.estimates.retracted_travel_time += 0.5 * retract_unretract_time;
+            path.estimates.unretracted_travel_time += 0.5 * retract_unretract_time;
         }
-        estimates += path.estimates;
     }
-    return estimates;
+    if (is_extrusion_path)
+    {
+        material_estimate += length * INT2MM(layer_thickness) * INT2MM(path.config->getLineWidth());
+    }
+    *path_time_estimate += length / path.config->getSpeed();
 }
 
-void ExtruderPlan::processFanSpeedAndMinimalLayerTime(bool force_minimal_layer_time, Point starting_position)
+void ExtruderPlan::processFanSpeedAndMinimalLayerTime(bool force_minimal_layer_time, std::optional<Point> starting_position)
 {
     TimeMaterialEstimates estimates = computeNaiveTimeEstimates(starting_position);
     totalPrintTime = estimates.getTotalTime();
@@ -717,18 +924,127 @@ void LayerPlan::processFanSpeedAndMinimalLayerTime(Point starting_position)
     {
         ExtruderPlan& extruder_plan = extruder_plans[extr_plan_idx];
         bool force_minimal_layer_time = extr_plan_idx == extruder_plans.size() - 1;
-        extruder_plan.processFanSpeedAndMinimalLayerTime(force_minimal_layer_time, starting_position);
-        if (!extruder_plan.paths.empty() && !extruder_plan.paths.back().points.empty())
+        // only the move to the first point of the layer hasn't been accounted for while planning
+        extruder_plan.processFanSpeedAndMinimalLayerTime(force_minimal_layer_time, (extr_plan_idx == 0)? std::optional<Point>(true, starting_position) : std::optional<Point>());
+    }
+}
+
+void LayerPlan::precomputeInfillLineMerges()
+{
+    for (ExtruderPlan& extruder_plan : extruder_plans)
+    {
+        const int64_t nozzle_size = storage.meshgroup->getExtruderTrain(extruder_plan.extruder)->getSettingInMicrons("machine_nozzle_size");
+        extruder_plan.infill_line_merges = MergeInfillLines::findMerges(extruder_plan.paths, configs_storage.travel_config_per_extruder[extruder_plan.extruder], nozzle_size);
+    }
+}
+
+void LayerPlan::precomputeCoastingSplits()
+{
+    for (ExtruderPlan& extruder_plan : extruder_plans)
+    {
+        const CoastingConfig& coasting_config = storage.coasting_config[extruder_plan.extruder];
+        extruder_plan.coasting_splits = std::vector<ExtruderPlan::CoastingSplit>();
+        if (!coasting_config.coasting_enable || coasting_config.coasting_volume <= 0)
         {
-            starting_position = extruder_plan.paths.back().points.back();
+            continue;
+        }
+        std::vector<GCodePath>& paths = extruder_plan.paths;
+        for (unsigned int path_idx = 0; path_idx < paths.size(); path_idx++)
+        {
+            GCodePath& path = paths[path_idx];
+            const bool followed_by_travel = path_idx + 1 >= paths.size() || paths[path_idx + 1].config->isTravelPath();
+            if (path.spiralize || path.isTravelPath() || !followed_by_travel)
+            {
+                continue;
+            }
+            ExtruderPlan::CoastingSplit split;
+            if (computeCoastingSplit(path, path_idx, layer_thickness, coasting_config.coasting_volume, coasting_config.coasting_min_volume, split))
+            {
+                extruder_plan.coasting_splits->push_back(split);
+            }
         }
     }
 }
 
+size_t LayerPlan::getMemoryUsage() const
+{
+    size_t bytes = sizeof(LayerPlan) + extruder_plans.capacity() * sizeof(ExtruderPlan) + comb_boundary_inside.getMemoryUsage() + memory->getMemoryUsage(); // the arena includes the points of all paths
+    for (const ExtruderPlan& extruder_plan : extruder_plans)
+    {
+        bytes += extruder_plan.paths.capacity() * sizeof(GCodePath);
+        bytes += extruder_plan.inserts.capacity() * sizeof(NozzleTempInsert);
+        bytes += extruder_plan.path_times_to_end.capacity() * sizeof(double);
+        if (extruder_plan.infill_line_merges)
+        {
+            bytes += extruder_plan.infill_line_merges->capacity() * sizeof(ExtruderPlan::InfillLineMerge);
+        }
+        if (extruder_plan.coasting_splits)
+        {
+            bytes += extruder_plan.coasting_splits->capacity() * sizeof(ExtruderPlan::CoastingSplit);
+        }
+    }
+    return bytes;
+}
+
+size_t LayerPlan::getPlannedBytes() const
+{
+    size_t bytes = sizeof(LayerPlan) + extruder_plans.size() * sizeof(ExtruderPlan) + comb_boundary_inside.pointCount() * sizeof(Point);
+    for (const ExtruderPlan& extruder_plan : extruder_plans)
+    {
+        bytes += extruder_plan.paths.size() * sizeof(GCodePath);
+        for (const GCodePath& path : extruder_plan.paths)
+        {
+            bytes += path.points.size() * sizeof(Point);
+        }
+    }
+    return bytes;
+}
 
+std::vector<uint64_t> LayerPlan::getPathDigests() const
+{
+    constexpr uint64_t fnv_offset_basis = 14695981039346656037ull; // 64 bit FNV-1a, like SliceCache::hashMeshGeometry
+    std::vector<uint64_t> digests(static_cast<size_t>(PrintFeatureType::NumPrintFeatureTypes), 0);
+    for (const ExtruderPlan& extruder_plan : extruder_plans)
+    {
+        for (const GCodePath& path : extruder_plan.paths)
+        {
+            uint64_t& hash = digests[static_cast<size_t>(path.config->type)];
+            if (hash == 0)
+            {
+                hash = fnv_offset_basis;
+            }
+            const auto add = [&hash](int64_t value)
+            {
+                for (unsigned int byte_idx = 0; byte_idx < sizeof(value); byte_idx++)
+                {
+                    hash = (hash ^ static_cast<uint8_t>(value >> (byte_idx * 8))) * 1099511628211ull;
+                }
+            };
+            // the speed and the flow are rounded, so that differences in the last bits of a computation which don't show in the gcode are ignored
+            add(extruder_plan.extruder);
+            add(path.config->getLineWidth());
+            add(std::llround(path.config->getSpeed() * 1000));
+            add(std::llround(path.config->getFlowPercentage() * 1000));
+            add(std::llround(path.flow * 1000));
+            add(static_cast<int64_t>(path.space_fill_type));
+            add(path.retract | (path.perform_z_hop << 1) | (path.perform_prime << 2) | (path.spiralize << 3));
+            add(path.points.size());
+            for (const Point& point : path.points)
+            {
+                add(point.X);
+                add(point.Y);
+            }
+        }
+    }
+    return digests;
+}
 
 void LayerPlan::writeGCode(GCodeExport& gcode)
 {
+    if (LayerDigests::isEnabled())
+    {
+        LayerDigests::write(*this);
+    }
     CommandSocket::setLayerForSend(layer_nr);
     CommandSocket::setSendCurrentPosition( gcode.getPositionXY() );
     gcode.setLayerNr(layer_nr);
@@ -791,10 +1107,6 @@ void LayerPlan::writeGCode(GCodeExport& gcode)
         gcode.writeFanCommand(extruder_plan.getFanSpeed());
         std::vector<GCodePath>& paths = extruder_plan.paths;
 
-        extruder_plan.inserts.sort([](const NozzleTempInsert& a, const NozzleTempInsert& b) -> bool { 
-                return  a.path_idx < b.path_idx; 
-            } );
-
         const ExtruderTrain* train = storage.meshgroup->getExtruderTrain(extruder);
         if (train->getSettingInMillimetersPerSecond("max_feedrate_z_override") > 0)
         {
@@ -894,9 +1206,9 @@ void LayerPlan::writeGCode(GCodeExport& gcode)
                     }
                     else 
                     {
+                        sendLinesTo(path.config->type, path.points, path.getLineWidth());
                         for(unsigned int point_idx = 0; point_idx < path.points.size(); point_idx++)
                         {
-                            sendLineTo(path.config->type, path.points[point_idx], path.getLineWidth());
                             gcode.writeExtrusion(path.points[point_idx], speed, path.getExtrusionMM3perMM(), path.config->type);
                         }
                     }
@@ -923,13 +1235,13 @@ void LayerPlan::writeGCode(GCodeExport& gcode)
                 for (; path_idx < paths.size() && paths[path_idx].spiralize; path_idx++)
                 { // handle all consecutive spiralized paths > CHANGES path_idx!
                     GCodePath& path = paths[path_idx];
+                    sendLinesTo(path.config->type, path.points, path.getLineWidth());
                     for (unsigned int point_idx = 0; point_idx < path.points.size(); point_idx++)
                     {
                         Point p1 = path.points[point_idx];
                         length += vSizeMM(p0 - p1);
                         p0 = p1;
                         gcode.setZ(z + layer_thickness * length / totalLength);
-                        sendLineTo(path.config->type, path.points[point_idx], path.getLineWidth());
                         gcode.writeExtrusion(path.points[point_idx], speed, path.getExtrusionMM3perMM(), path.config->type);
                     }
                     // for layer display only - the loop finished at the seam vertex but as we started from
@@ -1012,30 +1324,15 @@ bool LayerPlan::makeRetractSwitchRetract(unsigned int extruder_plan_idx, unsigne
     }
 }
     
-bool LayerPlan::writePathWithCoasting(GCodeExport& gcode, unsigned int extruder_plan_idx, unsigned int path_idx, int64_t layerThickness, double coasting_volume, double coasting_speed, double coasting_min_volume)
+bool LayerPlan::computeCoastingSplit(const GCodePath& path, unsigned int path_idx, int64_t layerThickness, double coasting_volume, double coasting_min_volume, ExtruderPlan::CoastingSplit& split)
 {
-    if (coasting_volume <= 0) 
-    { 
-        return false; 
-    }
-    ExtruderPlan& extruder_plan = extruder_plans[extruder_plan_idx];
-    std::vector<GCodePath>& paths = extruder_plan.paths;
-    GCodePath& path = paths[path_idx];
-    if (path_idx + 1 >= paths.size()
-        ||
-        ! (!path.isTravelPath() &&  paths[path_idx + 1].config->isTravelPath()) 
-        ||
-        path.points.size() < 2
-        )
+    if (path.points.size() < 2)
     {
         return false;
     }
 
     int64_t coasting_min_dist_considered = 100; // hardcoded setting for when to not perform coasting
 
-    
-    double extrude_speed = path.config->getSpeed() * extruder_plan.getExtrudeSpeedFactor(); // travel speed 
-    
     int64_t coasting_dist = MM2INT(MM2_2INT(coasting_volume) / layerThickness) / path.config->getLineWidth(); // closing brackets of MM2INT at weird places for precision issues
     int64_t coasting_min_dist = MM2INT(MM2_2INT(coasting_min_volume + coasting_volume) / layerThickness) / path.config->getLineWidth(); // closing brackets of MM2INT at weird places for precision issues
     //           /\ the minimal distance when coasting will coast the full coasting volume instead of linearly less with linearly smaller paths
@@ -1052,10 +1349,10 @@ bool LayerPlan::writePathWithCoasting(GCodeExport& gcode, unsigned int extruder_
      // == the point printed BEFORE the start point for coasting
     
     
-    Point* last = &path.points[path.points.size() - 1];
+    const Point* last = &path.points[path.points.size() - 1];
     for (unsigned int backward_point_idx = 1; backward_point_idx < path.points.size(); backward_point_idx++)
     {
-        Point& point = path.points[path.points.size() - 1 - backward_point_idx];
+        const Point& point = path.points[path.points.size() - 1 - backward_point_idx];
         int64_t dist = vSize(point - *last);
         accumulated_dist += dist;
         accumulated_dist_per_point.push_back(accumulated_dist);
@@ -1099,28 +1396,76 @@ bool LayerPlan::writePathWithCoasting(GCodeExport& gcode, unsigned int extruder_
     Point start;
     { // computation of begin point of coasting
         int64_t residual_dist = actual_coasting_dist - accumulated_dist_per_point[acc_dist_idx_gt_coast_dist - 1];
-        Point& a = path.points[point_idx_before_start];
-        Point& b = path.points[point_idx_before_start + 1];
+        const Point& a = path.points[point_idx_before_start];
+        const Point& b = path.points[point_idx_before_start + 1];
         start = b + normal(a-b, residual_dist);
     }
 
+    split.path_idx = path_idx;
+    split.point_idx_before_start = point_idx_before_start;
+    split.start = start;
+    split.coasting_dist = actual_coasting_dist;
+    return true;
+}
+
+bool LayerPlan::writePathWithCoasting(GCodeExport& gcode, unsigned int extruder_plan_idx, unsigned int path_idx, int64_t layerThickness, double coasting_volume, double coasting_speed, double coasting_min_volume)
+{
+    if (coasting_volume <= 0) 
+    { 
+        return false; 
+    }
+    ExtruderPlan& extruder_plan = extruder_plans[extruder_plan_idx];
+    std::vector<GCodePath>& paths = extruder_plan.paths;
+    GCodePath& path = paths[path_idx];
+    if (path_idx + 1 >= paths.size()
+        ||
+        ! (!path.isTravelPath() &&  paths[path_idx + 1].config->isTravelPath()) 
+        ||
+        path.points.size() < 2
+        )
+    {
+        return false;
+    }
+
+    ExtruderPlan::CoastingSplit split;
+    if (extruder_plan.coasting_splits)
+    {
+        const std::vector<ExtruderPlan::CoastingSplit>& splits = *extruder_plan.coasting_splits;
+        auto precomputed = std::lower_bound(splits.begin(), splits.end(), path_idx,
+            [](const ExtruderPlan::CoastingSplit& elem, unsigned int path_idx)
+            {
+                return elem.path_idx < path_idx;
+            });
+        if (precomputed == splits.end() || precomputed->path_idx != path_idx)
+        {
+            return false;
+        }
+        split = *precomputed;
+    }
+    else if (!computeCoastingSplit(path, path_idx, layerThickness, coasting_volume, coasting_min_volume, split))
+    {
+        return false;
+    }
+
+    double extrude_speed = path.config->getSpeed() * extruder_plan.getExtrudeSpeedFactor(); // travel speed 
+
     { // write normal extrude path:
-        for(unsigned int point_idx = 0; point_idx <= point_idx_before_start; point_idx++)
+        for(unsigned int point_idx = 0; point_idx <= split.point_idx_before_start; point_idx++)
         {
             sendLineTo(path.config->type, path.points[point_idx], path.getLineWidth());
             gcode.writeExtrusion(path.points[point_idx], extrude_speed, path.getExtrusionMM3perMM(), path.config->type);
         }
-        sendLineTo(path.config->type, start, path.getLineWidth());
-        gcode.writeExtrusion(start, extrude_speed, path.getExtrusionMM3perMM(), path.config->type);
+        sendLineTo(path.config->type, split.start, path.getLineWidth());
+        gcode.writeExtrusion(split.start, extrude_speed, path.getExtrusionMM3perMM(), path.config->type);
     }
 
     // write coasting path
-    for (unsigned int point_idx = point_idx_before_start + 1; point_idx < path.points.size(); point_idx++)
+    for (unsigned int point_idx = split.point_idx_before_start + 1; point_idx < path.points.size(); point_idx++)
     {
         gcode.writeTravel(path.points[point_idx], coasting_speed * path.config->getSpeed());
     }
 
-    gcode.addLastCoastedVolume(path.getExtrusionMM3perMM() * INT2MM(actual_coasting_dist));
+    gcode.addLastCoastedVolume(path.getExtrusionMM3perMM() * INT2MM(split.coasting_dist));
     return true;
 }
 
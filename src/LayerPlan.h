@@ -2,6 +2,7 @@
 #ifndef LAYER_PLAN_H
 #define LAYER_PLAN_H
 
+#include <algorithm> // upper_bound
 #include <vector>
 
 #include "gcodeExport.h"
@@ -14,6 +15,7 @@
 #include "wallOverlap.h"
 #include "commandSocket.h"
 #include "FanSpeedLayerTime.h"
+#include "LayerPlanMemoryPool.h"
 #include "SpaceFillType.h"
 #include "GCodePathConfig.h"
 #include "settings/PathConfigStorage.h"
@@ -27,6 +29,7 @@ class SliceDataStorage;
 
 class LayerPlan; // forward declaration so that ExtruderPlan can be a friend
 class LayerPlanBuffer; // forward declaration so that ExtruderPlan can be a friend
+class MergeInfillLines; // forward declaration so that ExtruderPlan can be a friend
 
 /*!
  * An extruder plan contains all planned paths (GCodePath) pertaining to a single extruder train.
@@ -37,9 +40,35 @@ class ExtruderPlan
 {
     friend class LayerPlan; // TODO: LayerPlan still does a lot which should actually be handled in this class.
     friend class LayerPlanBuffer; // TODO: LayerPlanBuffer handles paths directly
+    friend class MergeInfillLines; // uses the precomputed infill line merges
+public:
+    /*!
+     * Two consecutive infill lines which MergeInfillLines can merge into a single line,
+     * as computed by MergeInfillLines::isConvertible
+     */
+    struct InfillLineMerge
+    {
+        unsigned int path_idx; //!< Index into ExtruderPlan::paths of the travel before the two extrusion moves to be merged
+        Point first_middle; //!< The middle of the first extrusion move
+        Point second_middle; //!< The middle of the second extrusion move
+        int64_t line_width; //!< The width of the resulting combined line
+    };
+
+    /*!
+     * Where an extrusion path stops extruding and starts to coast, as computed by LayerPlan::computeCoastingSplit
+     */
+    struct CoastingSplit
+    {
+        unsigned int path_idx; //!< Index into ExtruderPlan::paths of the extrusion path
+        unsigned int point_idx_before_start; //!< Index of the last point of the path which is still extruded to before the coasting start
+        Point start; //!< Where the coasting starts, on the segment after CoastingSplit::point_idx_before_start
+        int64_t coasting_dist; //!< The length of the coasted piece at the end of the path
+    };
 protected:
     std::vector<GCodePath> paths; //!< The paths planned for this extruder
-    std::list<NozzleTempInsert> inserts; //!< The nozzle temperature command inserts, to be inserted in between paths
+    std::vector<NozzleTempInsert> inserts; //!< The nozzle temperature command inserts, to be inserted in between paths, sorted on NozzleTempInsert::path_idx
+    unsigned int written_insert_count = 0; //!< The number of ExtruderPlan::inserts already written to gcode by ExtruderPlan::handleInserts
+    std::vector<double> path_times_to_end; //!< The cache of ExtruderPlan::getPathTimesToEnd
 
     int extruder; //!< The extruder used for this paths in the current plan.
     double heated_pre_travel_time; //!< The time at the start of this ExtruderPlan during which the head travels and has a temperature of initial_print_temperature
@@ -58,10 +87,12 @@ protected:
      */
     double required_start_temperature;
     std::optional<double> extrusion_temperature; //!< The normal temperature for printing this extruder plan. That start and end of this extruder plan may deviate because of the initial and final print temp (none if extruder plan has no extrusion moves)
-    std::optional<std::list<NozzleTempInsert>::iterator> extrusion_temperature_command; //!< The command to heat from the printing temperature of this extruder plan to the printing temperature of the next extruder plan (if it has the same extruder).
+    std::optional<unsigned int> extrusion_temperature_command; //!< The index into ExtruderPlan::inserts of the command to heat from the printing temperature of this extruder plan to the printing temperature of the next extruder plan (if it has the same extruder).
     std::optional<double> prev_extruder_standby_temp; //!< The temperature to which to set the previous extruder. Not used if the previous extruder plan was the same extruder.
 
     TimeMaterialEstimates estimates; //!< Accumulated time and material estimates for all planned paths within this extruder plan.
+    std::optional<std::vector<InfillLineMerge>> infill_line_merges; //!< All infill lines which can be merged, sorted on InfillLineMerge::path_idx (none if not precomputed by LayerPlan::precomputeInfillLineMerges)
+    std::optional<std::vector<CoastingSplit>> coasting_splits; //!< The coasting of all paths which can coast, sorted on CoastingSplit::path_idx (none if not precomputed by LayerPlan::precomputeCoastingSplits)
 public:
     /*!
      * Simple contructor.
@@ -80,11 +111,36 @@ public:
      * \param contructor_args The arguments for the constructor of an insert 
      */
     template<typename... Args>
-    void insertCommand(Args&&... contructor_args)
+    unsigned int insertCommand(Args&&... contructor_args)
     {
-        inserts.emplace_back(contructor_args...);
+        NozzleTempInsert insert(contructor_args...);
+        // after the inserts before the same path, so that those are written in the order in which they were inserted
+        const std::vector<NozzleTempInsert>::iterator position = std::upper_bound(inserts.begin(), inserts.end(), insert,
+            [](const NozzleTempInsert& a, const NozzleTempInsert& b) { return a.path_idx < b.path_idx; });
+        const unsigned int insert_idx = position - inserts.begin();
+        inserts.insert(position, insert);
+        if (extrusion_temperature_command && *extrusion_temperature_command >= insert_idx)
+        {
+            (*extrusion_temperature_command)++;
+        }
+        return insert_idx;
     }
 
+    /*!
+     * Get for each path the time from its start to the end of this extruder plan, followed by a zero for the end itself.
+     *
+     * The times are accumulated from the last path backward, the way the temperature commands are timed.
+     * They are computed again only when paths have been added since, because the time estimates of the paths don't change once computed.
+     */
+    const std::vector<double>& getPathTimesToEnd();
+
+    /*!
+     * Find the last path which starts more than \p time before the end of this extruder plan, or at least \p time before it if \p or_equal.
+     *
+     * \return The index of the path, or -1 if all paths together take less time than that
+     */
+    int findPathStartingBeforeEnd(double time, bool or_equal);
+
     /*!
      * Insert the inserts into gcode which should be inserted before \p path_idx
      * 
@@ -93,10 +149,10 @@ public:
      */
     void handleInserts(unsigned int& path_idx, GCodeExport& gcode)
     {
-        while ( ! inserts.empty() && path_idx >= inserts.front().path_idx)
+        while (written_insert_count < inserts.size() && path_idx >= inserts[written_insert_count].path_idx)
         { // handle the Insert to be inserted before this path_idx (and all inserts not handled yet)
-            inserts.front().write(gcode);
-            inserts.pop_front();
+            inserts[written_insert_count].write(gcode);
+            written_insert_count++;
         }
     }
 
@@ -111,22 +167,23 @@ public:
      */
     void handleAllRemainingInserts(GCodeExport& gcode)
     { 
-        while ( ! inserts.empty() )
+        for (; written_insert_count < inserts.size(); written_insert_count++)
         { // handle the Insert to be inserted before this path_idx (and all inserts not handled yet)
-            NozzleTempInsert& insert = inserts.front();
+            NozzleTempInsert& insert = inserts[written_insert_count];
             assert(insert.path_idx == paths.size());
             insert.write(gcode);
-            inserts.pop_front();
         }
+        inserts.clear();
+        written_insert_count = 0;
     }
 
     /*!
      * Applying speed corrections for minimal layer times and determine the fanSpeed. 
      * 
      * \param force_minimal_layer_time Whether we should apply speed changes and perhaps a head lift in order to meet the minimal layer time
-     * \param starting_position The position the head was before starting this extruder plan
+     * \param starting_position The position the head was before starting this layer, if this extruder plan is the first of the layer
      */
-    void processFanSpeedAndMinimalLayerTime(bool force_minimal_layer_time, Point starting_position);
+    void processFanSpeedAndMinimalLayerTime(bool force_minimal_layer_time, std::optional<Point> starting_position);
 
     /*!
      * Set the extrude speed factor. This is used for printing slower than normal.
@@ -206,10 +263,20 @@ protected:
      * Compute naive time estimates (without accounting for slow down at corners etc.) and naive material estimates (without accounting for MergeInfillLines)
      * and store them in each ExtruderPlan and each GCodePath.
      * 
-     * \param starting_position The position the head was in before starting this layer
+     * The lengths of the paths have been accumulated while planning them, see GCodePath::length, so this doesn't visit their points.
+     * 
+     * \param starting_position The position the head was in before starting this layer, if this extruder plan is the first of the layer
      * \return the total estimates of this layer
      */
-    TimeMaterialEstimates computeNaiveTimeEstimates(Point starting_position);
+    TimeMaterialEstimates computeNaiveTimeEstimates(std::optional<Point> starting_position);
+
+    /*!
+     * Compute the naive time and material estimates of a single path and store them in the path.
+     * 
+     * \param path The path for which to compute the estimates
+     * \param length The length in mm of the moves of the path
+     */
+    void computeNaiveTimeEstimates(GCodePath& path, double length);
 };
 
 class LayerPlanBuffer; // forward declaration to prevent circular dependency
@@ -253,6 +320,8 @@ private:
      */
     bool skirt_brim_is_processed[MAX_EXTRUDERS];
 
+    LayerPlanMemoryPool& memory_pool; //!< The pool to give the memory of this plan back to when it is destroyed
+    std::unique_ptr<LayerPlanMemory> memory; //!< The memory of the points and the vectors of the paths, used again by a later plan. Declared before the plans, since it must outlive them.
     std::vector<ExtruderPlan> extruder_plans; //!< should always contain at least one ExtruderPlan
 
     int last_extruder_previous_layer; //!< The last id of the extruder with which was printed in the previous layer
@@ -303,7 +372,7 @@ public:
      * \param last_position The position of the head at the start of this gcode layer
      * \param combing_mode Whether combing is enabled and full or within infill only.
      */
-    LayerPlan(const SliceDataStorage& storage, int layer_nr, int z, int layer_height, unsigned int start_extruder, const std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder, CombingMode combing_mode, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance);
+    LayerPlan(const SliceDataStorage& storage, int layer_nr, int z, int layer_height, unsigned int start_extruder, const std::vector<FanSpeedLayerTimeSettings>& fan_speed_layer_time_settings_per_extruder, CombingMode combing_mode, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance, LayerPlanMemoryPool& memory_pool);
     ~LayerPlan();
 
     void overrideFanSpeeds(double speed);
@@ -320,6 +389,37 @@ private:
      */
     Polygons computeCombBoundaryInside(CombingMode combing_mode);
 
+    /*!
+     * Add a point to a path and account for the length of the move to it in GCodePath::length.
+     *
+     * \param path The path to add the point to
+     * \param p The point
+     */
+    void addPoint(GCodePath& path, Point p);
+
+    /*!
+     * Join the lines which continue each other into polylines.
+     *
+     * Two lines are joined where an end of the one is an end of the other and no other line ends there,
+     * so that the connected zigzags made by a ZigzagConnectorProcessor become the polylines they were cut up from.
+     *
+     * \param lines The lines, of two points each
+     * \return The polylines, each of which is either a single line or a chain of lines in which each starts where the previous ends
+     */
+    static Polygons chainLines(const Polygons& lines);
+
+    /*!
+     * Add a polyline to the gcode: a travel to its start and an extrusion move to each of the next points.
+     *
+     * \param polyline The polyline
+     * \param reversed Whether to print the \p polyline from its last point to its first
+     * \param config The config of the polyline
+     * \param space_fill_type The type of space filling used to generate the polyline
+     * \param wipe_dist The distance wiped without extruding after laying down the polyline
+     * \param flow_ratio The ratio with which to multiply the extrusion amount
+     */
+    void addPolyLine(ConstPolygonRef polyline, bool reversed, const GCodePathConfig* config, SpaceFillType space_fill_type, int wipe_dist, float flow_ratio);
+
 public:
     int getLayerNr() const
     {
@@ -375,6 +475,15 @@ public:
         CommandSocket::sendLineTo(print_feature_type, to, line_width);
     }
 
+    /*!
+     * send the line segments of a path through the command socket, from the previous point through all \p points
+     */
+    template<typename PointVector>
+    void sendLinesTo(PrintFeatureType print_feature_type, const PointVector& points, int line_width) const
+    {
+        CommandSocket::sendLinesTo(print_feature_type, points.data(), points.size(), line_width);
+    }
+
     /*!
     * Set whether the next destination is inside a layer part or not.
     * 
@@ -477,6 +586,10 @@ public:
 
     /*!
      * Add lines to the gcode with optimized order.
+     *
+     * Lines of PolyLines space filling which continue each other are printed as one polyline without travels in between;
+     * only the order of the polylines is optimized, and not at all if they form a single polyline.
+     *
      * \param polygons The lines
      * \param config The config of the lines
      * \param space_fill_type The type of space filling used to generate the line segments (should be either Lines or PolyLines!)
@@ -485,6 +598,34 @@ public:
      */
     void addLinesByOptimizer(const Polygons& polygons, const GCodePathConfig* config, SpaceFillType space_fill_type, int wipe_dist = 0, float flow_ratio = 1.0);
 
+    /*!
+     * Add polygons to the gcode in an order which has been optimized before.
+     * 
+     * \param polygons The polygons
+     * \param poly_order The order in which to print the \p polygons as indices into \p polygons, see PathOrderOptimizer::polyOrder
+     * \param poly_start The starting vertex of each of the \p polygons, see PathOrderOptimizer::polyStart
+     * \param config The config with which to print the polygon lines
+     * \param wall_overlap_computation The wall overlap compensation calculator for each given segment (optionally nullptr)
+     * \param wall_0_wipe_dist The distance to travel along each polygon after it has been laid down, in order to wipe the start and end of the wall together
+     * \param spiralize Whether to gradually increase the z height from the normal layer height to the height of the next layer over each polygon printed
+     * \param flow_ratio The ratio with which to multiply the extrusion amount
+     * \param always_retract Whether to force a retraction when moving to the start of the polygon (used for outer walls)
+     */
+    void addPolygonsInOrder(const Polygons& polygons, const std::vector<int>& poly_order, const std::vector<int>& poly_start, const GCodePathConfig* config, WallOverlapComputation* wall_overlap_computation = nullptr, coord_t wall_0_wipe_dist = 0, bool spiralize = false, float flow_ratio = 1.0, bool always_retract = false);
+
+    /*!
+     * Add lines to the gcode in an order which has been optimized before.
+     * 
+     * \param polygons The lines
+     * \param line_order The order in which to print the lines as indices into \p polygons, see LineOrderOptimizer::polyOrder
+     * \param line_start The starting vertex of each of the lines, see LineOrderOptimizer::polyStart
+     * \param config The config of the lines
+     * \param space_fill_type The type of space filling used to generate the line segments (should be either Lines or PolyLines!)
+     * \param wipe_dist (optional) the distance wiped without extruding after laying down a line.
+     * \param flow_ratio The ratio with which to multiply the extrusion amount
+     */
+    void addLinesInOrder(const Polygons& polygons, const std::vector<int>& line_order, const std::vector<int>& line_start, const GCodePathConfig* config, SpaceFillType space_fill_type, int wipe_dist = 0, float flow_ratio = 1.0);
+
     /*!
      * Add a spiralized slice of wall that is interpolated in X/Y between \p last_wall and \p wall.
      *
@@ -516,10 +657,24 @@ public:
      */
     bool makeRetractSwitchRetract(unsigned int extruder_plan_idx, unsigned int path_idx);
     
+    /*!
+     * Compute where an extrusion path stops extruding to coast the last piece of it.
+     * 
+     * \param path The extrusion path
+     * \param path_idx The index of \p path in its extruder plan
+     * \param layerThickness The height of the current layer.
+     * \param coasting_volume The volume otherwise leaked during a normal move.
+     * \param coasting_min_volume The minimal volume a path should have (before starting to coast) which builds up enough pressure to ooze as much as \p coasting_volume.
+     * \param[out] split Where the path starts to coast
+     * \return Whether the path is long enough to coast
+     */
+    static bool computeCoastingSplit(const GCodePath& path, unsigned int path_idx, int64_t layerThickness, double coasting_volume, double coasting_min_volume, ExtruderPlan::CoastingSplit& split);
+
     /*!
      * Writes a path to GCode and performs coasting, or returns false if it did nothing.
      * 
      * Coasting replaces the last piece of an extruded path by move commands and uses the oozed material to lay down lines.
+     * Where to split the path is looked up in the splits precomputed by LayerPlan::precomputeCoastingSplits if available.
      * 
      * \param gcode The gcode to write the planned paths to
      * \param extruder_plan_idx The index of the current extruder plan
@@ -538,6 +693,46 @@ public:
      * \param starting_position The position of the print head when the first extruder plan of this layer starts
      */
     void processFanSpeedAndMinimalLayerTime(Point starting_position);
+
+    /*!
+     * Find all consecutive infill lines which MergeInfillLines can merge into a single line.
+     * 
+     * This only depends on the paths of this layer, so it can be done while planning the layers in parallel,
+     * so that LayerPlan::writeGCode only needs to look up which lines to merge.
+     * Paths may still be appended to the extruder plans afterwards, because they can't be merged with the paths before them.
+     */
+    void precomputeInfillLineMerges();
+
+    /*!
+     * Compute where each extrusion path which may coast stops extruding and starts to coast.
+     * 
+     * This only depends on the paths of this layer, so it can be done while planning the layers in parallel,
+     * so that LayerPlan::writePathWithCoasting only needs to look up where to split the paths.
+     * The last path of each extruder plan is included as well, since a travel may still be appended after it.
+     */
+    void precomputeCoastingSplits();
+
+    /*!
+     * Get the number of bytes allocated for the paths planned in this layer and for its comb boundary, including the unused capacity.
+     */
+    size_t getMemoryUsage() const;
+
+    /*!
+     * Get the number of bytes of the paths planned in this layer and of its comb boundary, counted by their size rather than their capacity.
+     *
+     * Unlike \ref LayerPlan::getMemoryUsage this doesn't depend on the memory reused from the plans of earlier layers,
+     * which depends on the order in which the threads finished them, so the same layers always give the same number.
+     */
+    size_t getPlannedBytes() const;
+
+    /*!
+     * Hash the planned paths per feature type, to compare the plans made by different builds of the engine, see LayerDigests.
+     *
+     * The hash of a path covers its extruder, its points, its line width, speed and flow and whether it is retracted, z hopped or primed.
+     *
+     * \return For each PrintFeatureType the hash of its paths in the order in which they are printed, or zero if it has no paths
+     */
+    std::vector<uint64_t> getPathDigests() const;
     
     /*!
      * Add a travel move to the layer plan to move inside the current layer part by a given distance away from the outline.
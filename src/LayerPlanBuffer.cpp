@@ -1,5 +1,7 @@
 /** Copyright (C) 2015 Ultimaker - Released under terms of the AGPLv3 License */
 
+#include <iterator> // next
+
 #include "LayerPlanBuffer.h"
 #include "gcodeExport.h"
 #include "utils/logoutput.h"
@@ -13,18 +15,21 @@ namespace cura {
 void LayerPlanBuffer::setPreheatConfig(MeshGroup& settings)
 {
     preheat_config.setConfig(settings);
+    buffer_time = preheat_config.getMaxHeatUpTimeFromStandby() + extra_preheat_time;
+    // in megabytes
+    buffer_memory_limit = static_cast<size_t>(settings.hasSetting("layer_plan_buffer_memory_limit")? std::max(1, settings.getSettingAsCount("layer_plan_buffer_memory_limit")) : 100) * 1000000;
 }
 
 void LayerPlanBuffer::push(LayerPlan& layer_plan)
 {
     buffer.push_back(&layer_plan);
+    buffer_planned_bytes += layer_plan.getPlannedBytes();
 }
 
 void LayerPlanBuffer::handle(LayerPlan& layer_plan, GCodeExport& gcode)
 {
     push(layer_plan);
-    LayerPlan* to_be_written = processBuffer();
-    if (to_be_written)
+    for (LayerPlan* to_be_written = processBuffer(); to_be_written; to_be_written = popLayerToWrite())
     {
         to_be_written->writeGCode(gcode);
         delete to_be_written;
@@ -40,23 +45,50 @@ LayerPlan* LayerPlanBuffer::processBuffer()
     processFanSpeedLayerTime();
     if (buffer.size() >= 2)
     {
-        addConnectingTravelMove(*--(--buffer.end()), *--buffer.end());
+        LayerPlan* prev_layer = *--(--buffer.end());
+        buffer_planned_bytes -= prev_layer->getPlannedBytes();
+        addConnectingTravelMove(prev_layer, *--buffer.end());
+        buffer_planned_bytes += prev_layer->getPlannedBytes();
     }
     if (buffer.size() > 0)
     {
         insertTempCommands(); // insert preheat commands of the just completed layer plan (not the newly emplaced one)
     }
-    if (buffer.size() > buffer_size)
+    return popLayerToWrite();
+}
+
+LayerPlan* LayerPlanBuffer::popLayerToWrite()
+{
+    if (buffer.size() <= min_buffer_size)
+    {
+        return nullptr;
+    }
+    bool window_exceeded = false;
+    double time_after_front = 0.0;
+    for (auto layer_it = std::next(buffer.begin()); layer_it != buffer.end() && !window_exceeded; ++layer_it)
     {
-        LayerPlan* ret = buffer.front();
-        if (CommandSocket::isInstantiated())
+        for (const ExtruderPlan& extruder_plan : (*layer_it)->extruder_plans)
         {
-            CommandSocket::getInstance()->flushGcode();
+            time_after_front += extruder_plan.estimates.getTotalTime();
         }
-        buffer.pop_front();
-        return ret;
+        window_exceeded = time_after_front >= buffer_time;
     }
-    return nullptr;
+    if (!window_exceeded)
+    { // many short layers, or a few which are still cheap to hold
+        window_exceeded = buffer_planned_bytes > buffer_memory_limit; // not the memory allocated, which depends on the order in which the threads planned the layers
+    }
+    if (!window_exceeded)
+    {
+        return nullptr;
+    }
+    LayerPlan* ret = buffer.front();
+    if (CommandSocket::isInstantiated())
+    {
+        CommandSocket::getInstance()->flushGcode();
+    }
+    buffer_planned_bytes -= ret->getPlannedBytes();
+    buffer.pop_front();
+    return ret;
 }
 
 void LayerPlanBuffer::flush()
@@ -74,6 +106,7 @@ void LayerPlanBuffer::flush()
         }
         buffer.pop_front();
     }
+    buffer_planned_bytes = 0;
 }
 
 void LayerPlanBuffer::addConnectingTravelMove(LayerPlan* prev_layer, const LayerPlan* newest_layer)
@@ -122,25 +155,17 @@ void LayerPlanBuffer::processFanSpeedLayerTime()
 }
 
 
-void LayerPlanBuffer::insertPreheatCommand(ExtruderPlan& extruder_plan_before, double time_after_extruder_plan_start, int extruder, double temp)
+unsigned int LayerPlanBuffer::insertPreheatCommand(ExtruderPlan& extruder_plan_before, double time_after_extruder_plan_start, int extruder, double temp)
 {
-    double acc_time = 0.0;
-    for (unsigned int path_idx = extruder_plan_before.paths.size() - 1; int(path_idx) != -1 ; path_idx--)
+    const int path_idx = extruder_plan_before.findPathStartingBeforeEnd(time_after_extruder_plan_start, false);
+    bool wait = false;
+    if (path_idx >= 0)
     {
-        GCodePath& path = extruder_plan_before.paths[path_idx];
-        const double time_this_path = path.estimates.getTotalTime();
-        acc_time += time_this_path;
-        if (acc_time > time_after_extruder_plan_start)
-        {
-            const double time_before_path_end = acc_time - time_after_extruder_plan_start;
-            bool wait = false;
-            extruder_plan_before.insertCommand(path_idx, extruder, temp, wait, time_this_path - time_before_path_end);
-            return;
-        }
+        const double time_this_path = extruder_plan_before.paths[path_idx].estimates.getTotalTime();
+        const double time_before_path_end = extruder_plan_before.getPathTimesToEnd()[path_idx] - time_after_extruder_plan_start;
+        return extruder_plan_before.insertCommand(path_idx, extruder, temp, wait, time_this_path - time_before_path_end);
     }
-    bool wait = false;
-    unsigned int path_idx = 0;
-    extruder_plan_before.insertCommand(path_idx, extruder, temp, wait); // insert at start of extruder plan if time_after_extruder_plan_start > extruder_plan.time
+    return extruder_plan_before.insertCommand(0, extruder, temp, wait); // insert at start of extruder plan if time_after_extruder_plan_start > extruder_plan.time
 }
 
 Preheat::WarmUpResult LayerPlanBuffer::computeStandbyTempPlan(std::vector<ExtruderPlan*>& extruder_plans, unsigned int extruder_plan_idx)
@@ -183,11 +208,11 @@ Preheat::WarmUpResult LayerPlanBuffer::computeStandbyTempPlan(std::vector<Extrud
     return warm_up;
 }
 
-void LayerPlanBuffer::insertPreheatCommand_singleExtrusion(ExtruderPlan& prev_extruder_plan, int extruder, double required_temp)
+std::optional<unsigned int> LayerPlanBuffer::insertPreheatCommand_singleExtrusion(ExtruderPlan& prev_extruder_plan, int extruder, double required_temp)
 {
     if (!gcode.getExtruderUsesTemp(extruder))
     {
-        return;
+        return std::optional<unsigned int>();
     }
     // time_before_extruder_plan_end is halved, so that at the layer change the temperature will be half way betewen the two requested temperatures
     constexpr bool during_printing = true;
@@ -195,7 +220,7 @@ void LayerPlanBuffer::insertPreheatCommand_singleExtrusion(ExtruderPlan& prev_ex
     double time_before_extruder_plan_end = 0.5 * preheat_config.getTimeToGoFromTempToTemp(extruder, prev_extrusion_temp, required_temp, during_printing);
     time_before_extruder_plan_end = std::min(prev_extruder_plan.estimates.getTotalTime(), time_before_extruder_plan_end);
 
-    insertPreheatCommand(prev_extruder_plan, time_before_extruder_plan_end, extruder, required_temp);
+    return std::optional<unsigned int>(insertPreheatCommand(prev_extruder_plan, time_before_extruder_plan_end, extruder, required_temp));
 }
 
 
@@ -278,8 +303,7 @@ void LayerPlanBuffer::insertTempCommands(std::vector<ExtruderPlan*>& extruder_pl
     
     if (prev_extruder == extruder)
     {
-        insertPreheatCommand_singleExtrusion(*prev_extruder_plan, extruder, extruder_plan.required_start_temperature);
-        prev_extruder_plan->extrusion_temperature_command = --prev_extruder_plan->inserts.end();
+        prev_extruder_plan->extrusion_temperature_command = insertPreheatCommand_singleExtrusion(*prev_extruder_plan, extruder, extruder_plan.required_start_temperature);
     }
     else 
     {
@@ -414,7 +438,8 @@ void LayerPlanBuffer::insertFinalPrintTempCommand(std::vector<ExtruderPlan*>& ex
             precool_extruder_plan = extruder_plans[precool_extruder_plan_idx];
             if (precool_extruder_plan->extrusion_temperature_command)
             { // the precool command ends up before the command to go to the print temperature of the next extruder plan, so remove that print temp command
-                precool_extruder_plan->inserts.erase(*precool_extruder_plan->extrusion_temperature_command);
+                precool_extruder_plan->inserts.erase(precool_extruder_plan->inserts.begin() + *precool_extruder_plan->extrusion_temperature_command);
+                precool_extruder_plan->extrusion_temperature_command = std::optional<unsigned int>();
             }
             double time_here = precool_extruder_plan->estimates.getTotalTime();
             if (cool_down_time < time_here)
@@ -428,19 +453,11 @@ void LayerPlanBuffer::insertFinalPrintTempCommand(std::vector<ExtruderPlan*>& ex
     // at this point cool_down_time is what time is left if cool down time of extruder plans after precool_extruder_plan (up until last_extruder_plan) are already taken into account
 
     { // insert temp command in precool_extruder_plan
-        double extrusion_time_seen = 0;
-        unsigned int path_idx;
-        for (path_idx = precool_extruder_plan->paths.size() - 1; int(path_idx) >= 0; path_idx--)
-        {
-            GCodePath& path = precool_extruder_plan->paths[path_idx];
-            extrusion_time_seen += path.estimates.getTotalTime();
-            if (extrusion_time_seen >= cool_down_time)
-            {
-                break;
-            }
-        }
+        // if all paths take less than the cool down time no path is found, so the command goes before the first path
+        const unsigned int path_idx = std::max(0, precool_extruder_plan->findPathStartingBeforeEnd(cool_down_time, true));
+        const double extrusion_time_seen = precool_extruder_plan->getPathTimesToEnd()[path_idx];
         bool wait = false;
-        double time_after_path_start = extrusion_time_seen - cool_down_time;
+        double time_after_path_start = std::max(0.0, extrusion_time_seen - cool_down_time);
         precool_extruder_plan->insertCommand(path_idx, extruder, final_print_temp, wait, time_after_path_start);
     }
 }
@@ -450,6 +467,7 @@ void LayerPlanBuffer::insertTempCommands()
 {
     if (buffer.back()->extruder_plans.size() == 0 || (buffer.back()->extruder_plans.size() == 1 && buffer.back()->extruder_plans[0].paths.size() == 0))
     { // disregard empty layer
+        buffer_planned_bytes -= buffer.back()->getPlannedBytes();
         buffer.pop_back();
         return;
     }
@@ -35,11 +35,20 @@ class LayerPlanBuffer : SettingsMessenger
     
     Preheat preheat_config; //!< the nozzle and material temperature settings for each extruder train.
     
-    static constexpr unsigned int buffer_size = 5; // should be as low as possible while still allowing enough time in the buffer to heat up from standby temp to printing temp // TODO: hardcoded value
-    // this value should be higher than 1, cause otherwise each layer is viewed as the first layer and no temp commands are inserted.
+    static constexpr unsigned int min_buffer_size = 2; //!< The number of layers always kept in the buffer. This value should be higher than 1, cause otherwise each layer is viewed as the first layer and no temp commands are inserted.
 
     static constexpr const double extra_preheat_time = 1.0; //!< Time to start heating earlier than computed to avoid accummulative discrepancy between actual heating times and computed ones.
 
+    /*!
+     * The estimated print time which the layers after the oldest layer in the buffer must cover before the oldest layer is written:
+     * enough time to heat up from standby temp to printing temp, so that any preheat command can still be inserted.
+     */
+    double buffer_time;
+
+    size_t buffer_memory_limit; //!< The planned bytes, see LayerPlan::getPlannedBytes, above which the oldest layers are written even when they don't cover \ref LayerPlanBuffer::buffer_time yet
+
+    size_t buffer_planned_bytes; //!< The sum of the planned bytes of the layers in the buffer, kept up to date so that checking the \ref LayerPlanBuffer::buffer_memory_limit doesn't go over all their paths
+
     std::vector<bool> extruder_used_in_meshgroup; //!< For each extruder whether it has already been planned once in this meshgroup. This is used to see whether we should heat to the initial_print_temp or to the extrusion_temperature
 
     /*!
@@ -53,6 +62,9 @@ public:
     LayerPlanBuffer(SettingsBaseVirtual* settings, GCodeExport& gcode)
     : SettingsMessenger(settings)
     , gcode(gcode)
+    , buffer_time(extra_preheat_time)
+    , buffer_memory_limit(100000000)
+    , buffer_planned_bytes(0)
     , extruder_used_in_meshgroup(MAX_EXTRUDERS, false)
     { }
 
@@ -78,11 +90,22 @@ public:
      * the fan speeds and layer time settings of the most recently pushed layer are processed;
      * the correctly combing travel move between the last added layer and the layer before is added.
      * 
-     * Pop out the earliest layer in the buffer if the buffer size is exceeded
+     * Pop out the earliest layer in the buffer if the buffer window is exceeded, see \ref LayerPlanBuffer::popLayerToWrite
      * \return A nullptr or the popped gcode_layer
      */
     LayerPlan* processBuffer();
 
+    /*!
+     * Pop out the earliest layer in the buffer if it is no longer needed to insert preheat commands in,
+     * because the later layers take at least \ref LayerPlanBuffer::buffer_time to print,
+     * or if the buffered layers take more than \ref LayerPlanBuffer::buffer_memory_limit.
+     *
+     * Called after \ref LayerPlanBuffer::processBuffer until it returns a nullptr, since a long layer may release several short ones at once.
+     *
+     * \return A nullptr or the popped gcode_layer
+     */
+    LayerPlan* popLayerToWrite();
+
     /*!
      * Write all remaining layer plans (LayerPlan) to gcode and empty the buffer.
      */
@@ -109,8 +132,9 @@ private:
      * \param time_before_extruder_plan_end The time before the end of the extruder plan, before which to insert the preheat command
      * \param extruder The extruder for which to set the temperature
      * \param temp The temperature of the preheat command
+     * \return The index of the preheat command into ExtruderPlan::inserts of \p extruder_plan_before
      */
-    void insertPreheatCommand(ExtruderPlan& extruder_plan_before, double time_before_extruder_plan_end, int extruder, double temp);
+    unsigned int insertPreheatCommand(ExtruderPlan& extruder_plan_before, double time_before_extruder_plan_end, int extruder, double temp);
 
     /*!
      * Compute the time needed to preheat from standby to required (initial) printing temperature at the start of an extruder plan,
@@ -133,8 +157,9 @@ private:
      * \param prev_extruder_plan The former extruder plan (of the former layer)
      * \param extruder The extruder for which too set the temperature
      * \param required_temp The required temperature for the second extruder plan
+     * \return The index of the preheat command into ExtruderPlan::inserts of \p prev_extruder_plan, if one was inserted
      */
-    void insertPreheatCommand_singleExtrusion(ExtruderPlan& prev_extruder_plan, int extruder, double required_temp);
+    std::optional<unsigned int> insertPreheatCommand_singleExtrusion(ExtruderPlan& prev_extruder_plan, int extruder, double required_temp);
 
     /*!
      * Insert the preheat command for an extruder plan which is preceded by an extruder plan with a different extruder.
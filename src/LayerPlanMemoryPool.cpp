@@ -0,0 +1,69 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "LayerPlanMemoryPool.h"
+
+namespace cura
+{
+
+size_t LayerPlanMemory::getMemoryUsage() const
+{
+    size_t bytes = path_point_arena.getMemoryUsage() + path_vectors.capacity() * sizeof(std::vector<GCodePath>);
+    for (const std::vector<GCodePath>& paths : path_vectors)
+    {
+        bytes += paths.capacity() * sizeof(GCodePath);
+    }
+    return bytes;
+}
+
+LayerPlanMemoryPool::LayerPlanMemoryPool(unsigned int max_kept_count, size_t max_kept_bytes)
+: max_kept_count(max_kept_count)
+, max_kept_bytes(max_kept_bytes)
+{
+}
+
+std::unique_ptr<LayerPlanMemory> LayerPlanMemoryPool::take()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!kept.empty())
+        {
+            std::unique_ptr<LayerPlanMemory> ret = std::move(kept.back());
+            kept.pop_back();
+            return ret;
+        }
+    }
+    return std::unique_ptr<LayerPlanMemory>(new LayerPlanMemory());
+}
+
+void LayerPlanMemoryPool::give(std::unique_ptr<LayerPlanMemory> memory)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (kept.size() >= max_kept_count)
+        {
+            return; // the memory is freed outside of the lock
+        }
+    }
+    // limit the memory outside of the lock, since resetting frees memory
+    size_t path_vector_bytes = 0;
+    unsigned int kept_path_vector_count = 0;
+    for (; kept_path_vector_count < memory->path_vectors.size(); kept_path_vector_count++)
+    { // the vectors of paths may use half of the bytes kept
+        const size_t bytes = memory->path_vectors[kept_path_vector_count].capacity() * sizeof(GCodePath);
+        if (path_vector_bytes + bytes > max_kept_bytes / 2)
+        {
+            break;
+        }
+        path_vector_bytes += bytes;
+    }
+    memory->path_vectors.resize(kept_path_vector_count);
+    memory->path_point_arena.reset(max_kept_bytes - path_vector_bytes);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (kept.size() < max_kept_count)
+    {
+        kept.push_back(std::move(memory));
+    }
+}
+
+}//namespace cura
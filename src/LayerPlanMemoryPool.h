@@ -0,0 +1,89 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef LAYER_PLAN_MEMORY_POOL_H
+#define LAYER_PLAN_MEMORY_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "pathPlanning/GCodePath.h"
+#include "utils/Arena.h"
+#include "utils/NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * The memory of a layer plan which can be used again by the plan of a later layer:
+ * the arena of the points of its paths and the vectors of paths of its extruder plans.
+ */
+class LayerPlanMemory : NoCopy
+{
+public:
+    Arena path_point_arena; //!< The memory of the points of all paths of the layer plan
+    std::vector<std::vector<GCodePath>> path_vectors; //!< Empty vectors of paths which have kept their capacity
+
+    /*!
+     * Give a vector of paths the capacity of one of the vectors kept, if any.
+     *
+     * \param[out] paths The empty vector of paths of a new extruder plan
+     */
+    void reusePathVector(std::vector<GCodePath>& paths)
+    {
+        if (!path_vectors.empty())
+        {
+            paths.swap(path_vectors.back());
+            path_vectors.pop_back();
+        }
+    }
+
+    /*!
+     * The number of bytes of the memory kept.
+     */
+    size_t getMemoryUsage() const;
+};
+
+/*!
+ * The memory of the layer plans which have been written, to be used again by the plans of the next layers,
+ * so that planning a layer hardly allocates the memory of its paths once the first layers have been planned.
+ *
+ * The memory kept is bounded: there is a maximum to the number of layer plans of which the memory is kept,
+ * and to the number of bytes kept of each.
+ *
+ * This class is thread safe, since the layer plans are created and destroyed by several threads.
+ */
+class LayerPlanMemoryPool : NoCopy
+{
+public:
+    /*!
+     * \param max_kept_count The maximum number of layer plans of which the memory is kept
+     * \param max_kept_bytes The maximum number of bytes kept of the memory of a layer plan
+     */
+    LayerPlanMemoryPool(unsigned int max_kept_count, size_t max_kept_bytes);
+
+    /*!
+     * Get the memory for a new layer plan: memory kept of an earlier plan, or new memory if none is left.
+     */
+    std::unique_ptr<LayerPlanMemory> take();
+
+    /*!
+     * Give back the memory of a layer plan which is destroyed.
+     *
+     * No paths may be left using the points in its arena.
+     *
+     * \param memory The memory to keep, reset and limited to the number of bytes kept, or to free if enough memory is kept already
+     */
+    void give(std::unique_ptr<LayerPlanMemory> memory);
+
+private:
+    const unsigned int max_kept_count; //!< The maximum number of layer plans of which the memory is kept
+    const size_t max_kept_bytes; //!< The maximum number of bytes kept of the memory of a layer plan
+    std::mutex mutex; //!< Guards LayerPlanMemoryPool::kept
+    std::vector<std::unique_ptr<LayerPlanMemory>> kept; //!< The memory kept to be used again
+};
+
+}//namespace cura
+
+#endif//LAYER_PLAN_MEMORY_POOL_H
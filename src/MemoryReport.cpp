@@ -0,0 +1,263 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "MemoryReport.h"
+
+#include <algorithm> // max
+
+#ifndef __WIN32
+#include <sys/resource.h>
+#include <unistd.h> // sysconf
+#endif
+
+#include "FffProcessor.h"
+#include "JobEstimate.h"
+#include "LayerPlan.h"
+#include "sliceDataStorage.h"
+#include "utils/logoutput.h"
+
+namespace cura
+{
+
+FILE* MemoryReport::out = nullptr;
+std::mutex MemoryReport::layer_plans_mutex;
+std::unordered_map<const LayerPlan*, size_t> MemoryReport::layer_plan_bytes;
+size_t MemoryReport::layer_plans_total_bytes = 0;
+size_t MemoryReport::layer_plans_peak_bytes = 0;
+size_t MemoryReport::layer_plans_peak_count = 0;
+
+namespace
+{
+
+template<typename T>
+size_t vectorMemoryUsage(const std::vector<T>& vector)
+{
+    return vector.capacity() * sizeof(T);
+}
+
+size_t polygonsMemoryUsage(const std::vector<Polygons>& polygons_list)
+{
+    size_t bytes = vectorMemoryUsage(polygons_list);
+    for (const Polygons& polygons : polygons_list)
+    {
+        bytes += polygons.getMemoryUsage();
+    }
+    return bytes;
+}
+
+/*!
+ * The bytes held by the layers of all meshes, per kind of area
+ */
+struct LayersMemoryUsage
+{
+    size_t layers = 0; //!< The layers and layer parts themselves
+    size_t outlines = 0; //!< SliceLayerPart::outline, SliceLayerPart::print_outline and the open polylines
+    size_t insets = 0; //!< SliceLayerPart::insets
+    size_t perimeter_gaps = 0; //!< SliceLayerPart::perimeter_gaps
+    size_t skin_parts = 0; //!< SliceLayerPart::skin_parts
+    size_t infill_area = 0; //!< SliceLayerPart::infill_area and SliceLayerPart::infill_area_own
+    size_t infill_area_per_combine_per_density = 0; //!< SliceLayerPart::infill_area_per_combine_per_density
+    size_t spaghetti_infill_volumes = 0; //!< SliceLayerPart::spaghetti_infill_volumes
+    size_t compressed_geometry = 0; //!< SliceLayerPart::compressed_geometry
+
+    void add(const SliceLayer& layer)
+    {
+        layers += vectorMemoryUsage(layer.parts);
+        outlines += layer.openPolyLines.getMemoryUsage();
+        for (const SliceLayerPart& part : layer.parts)
+        {
+            outlines += part.outline.getMemoryUsage() + part.print_outline.getMemoryUsage();
+            insets += polygonsMemoryUsage(part.insets);
+            perimeter_gaps += part.perimeter_gaps.getMemoryUsage();
+            skin_parts += vectorMemoryUsage(part.skin_parts);
+            for (const SkinPart& skin_part : part.skin_parts)
+            {
+                skin_parts += skin_part.outline.getMemoryUsage() + polygonsMemoryUsage(skin_part.insets) + skin_part.perimeter_gaps.getMemoryUsage();
+            }
+            infill_area += part.infill_area.getMemoryUsage();
+            if (part.infill_area_own)
+            {
+                infill_area += part.infill_area_own->getMemoryUsage();
+            }
+            infill_area_per_combine_per_density += vectorMemoryUsage(part.infill_area_per_combine_per_density);
+            for (const std::vector<Polygons>& infill_area_per_combine : part.infill_area_per_combine_per_density)
+            {
+                infill_area_per_combine_per_density += polygonsMemoryUsage(infill_area_per_combine);
+            }
+            spaghetti_infill_volumes += vectorMemoryUsage(part.spaghetti_infill_volumes);
+            for (const std::pair<Polygons, double>& volume : part.spaghetti_infill_volumes)
+            {
+                spaghetti_infill_volumes += volume.first.getMemoryUsage();
+            }
+            compressed_geometry += vectorMemoryUsage(part.compressed_geometry);
+        }
+    }
+};
+
+}//namespace
+
+void MemoryReport::enable(const std::string& output_file)
+{
+    out = fopen(output_file.c_str(), "w");
+    if (!out)
+    {
+        logError("Failed to open %s for the memory report.\n", output_file.c_str());
+    }
+}
+
+void MemoryReport::report(const char* stage, const SliceDataStorage& storage)
+{
+    if (!out)
+    {
+        return;
+    }
+    size_t mesh_vertices = 0;
+    size_t mesh_faces = 0;
+    size_t mesh_vertex_hash_table = 0;
+    size_t mesh_connected_faces = 0;
+    for (const Mesh& mesh : storage.meshgroup->meshes)
+    {
+        mesh_vertices += vectorMemoryUsage(mesh.vertices);
+        mesh_faces += vectorMemoryUsage(mesh.faces);
+        mesh_vertex_hash_table += mesh.getVertexHashTableMemoryUsage();
+        mesh_connected_faces += mesh.getConnectedFacesMemoryUsage();
+    }
+
+    LayersMemoryUsage layers;
+    for (const SliceMeshStorage& mesh : storage.meshes)
+    {
+        layers.layers += vectorMemoryUsage(mesh.layers);
+        for (const SliceLayer& layer : mesh.layers)
+        {
+            layers.add(layer);
+        }
+    }
+
+    size_t support = vectorMemoryUsage(storage.support.supportLayers);
+    for (const SupportLayer& support_layer : storage.support.supportLayers)
+    {
+        support += support_layer.supportAreas.getMemoryUsage()
+            + support_layer.support_bottom.getMemoryUsage()
+            + support_layer.support_roof.getMemoryUsage()
+            + support_layer.support_mesh_drop_down.getMemoryUsage()
+            + support_layer.support_mesh.getMemoryUsage()
+            + support_layer.anti_overhang.getMemoryUsage();
+    }
+
+    size_t helpers = storage.raftOutline.getMemoryUsage() + polygonsMemoryUsage(storage.oozeShield) + storage.draft_protection_shield.getMemoryUsage();
+    for (const Polygons& skirt_brim : storage.skirt_brim)
+    {
+        helpers += skirt_brim.getMemoryUsage();
+    }
+
+    size_t layer_plans_count;
+    size_t layer_plans_bytes;
+    size_t layer_plans_peak_count_since_last_report;
+    size_t layer_plans_peak_bytes_since_last_report;
+    {
+        std::lock_guard<std::mutex> lock(layer_plans_mutex);
+        layer_plans_count = layer_plan_bytes.size();
+        layer_plans_bytes = layer_plans_total_bytes;
+        layer_plans_peak_count_since_last_report = layer_plans_peak_count;
+        layer_plans_peak_bytes_since_last_report = layer_plans_peak_bytes;
+        layer_plans_peak_count = layer_plans_count;
+        layer_plans_peak_bytes = layer_plans_bytes;
+    }
+
+    fprintf(out, "{\"stage\": \"%s\", \"meshgroup\": %d"
+        ", \"mesh\": {\"vertices\": %zu, \"faces\": %zu, \"vertex_hash_table\": %zu, \"connected_faces\": %zu}"
+        ", \"layers\": {\"layers\": %zu, \"outlines\": %zu, \"insets\": %zu, \"perimeter_gaps\": %zu, \"skin_parts\": %zu, \"infill_area\": %zu, \"infill_area_per_combine_per_density\": %zu, \"spaghetti_infill_volumes\": %zu, \"compressed_geometry\": %zu}"
+        ", \"support\": %zu, \"helpers\": %zu"
+        ", \"layer_plans\": {\"count\": %zu, \"bytes\": %zu, \"peak_count\": %zu, \"peak_bytes\": %zu}"
+        ", \"rss\": %zu, \"peak_rss\": %zu}\n"
+        , stage, FffProcessor::getInstance()->getMeshgroupNr()
+        , mesh_vertices, mesh_faces, mesh_vertex_hash_table, mesh_connected_faces
+        , layers.layers, layers.outlines, layers.insets, layers.perimeter_gaps, layers.skin_parts, layers.infill_area, layers.infill_area_per_combine_per_density, layers.spaghetti_infill_volumes, layers.compressed_geometry
+        , support, helpers
+        , layer_plans_count, layer_plans_bytes, layer_plans_peak_count_since_last_report, layer_plans_peak_bytes_since_last_report
+        , getCurrentResidentSetSize(), getPeakResidentSetSize());
+    fflush(out);
+}
+
+void MemoryReport::reportEstimate(const JobEstimate& estimate)
+{
+    if (!out)
+    {
+        return;
+    }
+    fprintf(out, "{\"stage\": \"estimate\", \"meshgroup\": %d, \"faces\": %llu, \"layer_count\": %u"
+        ", \"mesh\": %llu, \"slicer\": %llu, \"layers\": %llu, \"support\": %llu, \"layer_plans\": %llu"
+        ", \"peak_rss\": %llu, \"cpu_seconds\": %.1f}\n"
+        , FffProcessor::getInstance()->getMeshgroupNr(), static_cast<unsigned long long>(estimate.face_count), estimate.layer_count
+        , static_cast<unsigned long long>(estimate.mesh_bytes), static_cast<unsigned long long>(estimate.slicer_bytes), static_cast<unsigned long long>(estimate.layer_geometry_bytes)
+        , static_cast<unsigned long long>(estimate.support_bytes), static_cast<unsigned long long>(estimate.layer_plan_bytes)
+        , static_cast<unsigned long long>(estimate.peak_bytes), estimate.cpu_seconds);
+    fflush(out);
+}
+
+void MemoryReport::trackLayerPlan(const LayerPlan& layer_plan)
+{
+    if (!out)
+    {
+        return;
+    }
+    const size_t bytes = layer_plan.getMemoryUsage();
+    std::lock_guard<std::mutex> lock(layer_plans_mutex);
+    layer_plan_bytes[&layer_plan] = bytes;
+    layer_plans_total_bytes += bytes;
+    layer_plans_peak_bytes = std::max(layer_plans_peak_bytes, layer_plans_total_bytes);
+    layer_plans_peak_count = std::max(layer_plans_peak_count, layer_plan_bytes.size());
+}
+
+void MemoryReport::releaseLayerPlan(const LayerPlan& layer_plan)
+{
+    if (!out)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(layer_plans_mutex);
+    std::unordered_map<const LayerPlan*, size_t>::iterator it = layer_plan_bytes.find(&layer_plan);
+    if (it != layer_plan_bytes.end())
+    {
+        layer_plans_total_bytes -= it->second;
+        layer_plan_bytes.erase(it);
+    }
+}
+
+size_t MemoryReport::getPeakResidentSetSize()
+{
+#ifdef __WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss; // in bytes
+#else
+    return usage.ru_maxrss * size_t(1024); // in kilobytes
+#endif
+#endif
+}
+
+size_t MemoryReport::getCurrentResidentSetSize()
+{
+#ifdef __WIN32
+    return 0;
+#else
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+    {
+        return 0;
+    }
+    unsigned long size_pages;
+    unsigned long resident_pages;
+    const bool read = fscanf(statm, "%lu %lu", &size_pages, &resident_pages) == 2;
+    fclose(statm);
+    return read? resident_pages * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+}
+
+}//namespace cura
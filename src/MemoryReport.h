@@ -0,0 +1,94 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace cura
+{
+
+struct JobEstimate;
+class LayerPlan;
+class SliceDataStorage;
+
+/*!
+ * Reports how much memory is held by each component of the slice data at the end of each stage of the engine.
+ *
+ * Each report is a line with a JSON object in the output file, containing the bytes allocated for
+ * the meshes, the areas of each kind in the layers of all meshes, the support,
+ * the layer plans which are in flight and the resident set size of the process.
+ * The bytes include the unused capacity of the vectors, since that is what is actually held.
+ *
+ * Reporting is off unless MemoryReport::enable is called. Otherwise the reports and the tracking of layer plans cost a single check of a flag.
+ */
+class MemoryReport
+{
+public:
+    /*!
+     * Start writing the reports to \p output_file, overwriting it.
+     */
+    static void enable(const std::string& output_file);
+
+    /*!
+     * Whether MemoryReport::enable has been called successfully.
+     */
+    static bool isEnabled()
+    {
+        return out != nullptr;
+    }
+
+    /*!
+     * Write the memory held by \p storage and by the layer plans in flight.
+     *
+     * \param stage The name of the stage which has just ended
+     * \param storage The slice data of the meshgroup being processed
+     */
+    static void report(const char* stage, const SliceDataStorage& storage);
+
+    /*!
+     * Write the estimate of a mesh group made before slicing it, as a line with the stage "estimate",
+     * to compare it with the reports of the stages which follow.
+     */
+    static void reportEstimate(const JobEstimate& estimate);
+
+    /*!
+     * Count the memory of a layer plan which has been planned, until \ref MemoryReport::releaseLayerPlan is called for it.
+     *
+     * This function is thread safe.
+     */
+    static void trackLayerPlan(const LayerPlan& layer_plan);
+
+    /*!
+     * Stop counting the memory of a layer plan tracked by \ref MemoryReport::trackLayerPlan, because it is about to be deleted.
+     *
+     * This function is thread safe.
+     */
+    static void releaseLayerPlan(const LayerPlan& layer_plan);
+
+    /*!
+     * Get the largest resident set size the process has had so far, in bytes, or zero if unknown on this platform.
+     */
+    static size_t getPeakResidentSetSize();
+
+    /*!
+     * Get the current resident set size of the process, in bytes, or zero if unknown on this platform.
+     */
+    static size_t getCurrentResidentSetSize();
+
+private:
+    static FILE* out; //!< The file to which the reports are written
+    static std::mutex layer_plans_mutex; //!< Guards the tracked layer plans below
+    static std::unordered_map<const LayerPlan*, size_t> layer_plan_bytes; //!< The bytes of each layer plan in flight when it was tracked
+    static size_t layer_plans_total_bytes; //!< The sum of MemoryReport::layer_plan_bytes
+    static size_t layer_plans_peak_bytes; //!< The largest MemoryReport::layer_plans_total_bytes since the last report
+    static size_t layer_plans_peak_count; //!< The largest number of layer plans in flight since the last report
+};
+
+}//namespace cura
+
+#endif//MEMORY_REPORT_H
@@ -1,6 +1,6 @@
 #include "MergeInfillLines.h"
 
-#include <algorithm> // min
+#include <algorithm> // min, lower_bound
 
 #include "utils/linearAlg2D.h"
 
@@ -58,20 +58,58 @@ bool MergeInfillLines::mergeInfillLines(unsigned int& path_idx)
     return false;
 };
 
+std::vector<ExtruderPlan::InfillLineMerge> MergeInfillLines::findMerges(const std::vector<GCodePath>& paths, const GCodePathConfig& travel_config, int64_t nozzle_size)
+{
+    std::vector<ExtruderPlan::InfillLineMerge> merges;
+    Point first_middle;
+    Point second_middle;
+    int64_t line_width;
+    for (unsigned int path_idx = 0; path_idx + 3 < paths.size(); path_idx++)
+    {
+        if (isConvertible(paths, travel_config, nozzle_size, path_idx, first_middle, second_middle, line_width))
+        {
+            merges.push_back(ExtruderPlan::InfillLineMerge{path_idx, first_middle, second_middle, line_width});
+        }
+    }
+    return merges;
+}
+
 bool MergeInfillLines::isConvertible(unsigned int path_idx_first_move, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first)
+{
+    if (extruder_plan.infill_line_merges)
+    {
+        const std::vector<ExtruderPlan::InfillLineMerge>& merges = *extruder_plan.infill_line_merges;
+        auto merge = std::lower_bound(merges.begin(), merges.end(), path_idx_first_move,
+            [](const ExtruderPlan::InfillLineMerge& elem, unsigned int path_idx)
+            {
+                return elem.path_idx < path_idx;
+            });
+        if (merge == merges.end() || merge->path_idx != path_idx_first_move)
+        {
+            return false;
+        }
+        first_middle = merge->first_middle;
+        second_middle = merge->second_middle;
+        resulting_line_width = merge->line_width;
+        return true;
+    }
+    return isConvertible(paths, travelConfig, nozzle_size, path_idx_first_move, first_middle, second_middle, resulting_line_width, use_second_middle_as_first);
+}
+
+bool MergeInfillLines::isConvertible(const std::vector<GCodePath>& paths, const GCodePathConfig& travel_config, int64_t nozzle_size, unsigned int path_idx_first_move, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first)
 {
     unsigned int idx = path_idx_first_move;
     if (idx + 3 > paths.size()-1) 
     {
         return false;
     }
-    if (   paths[idx+0].config != &travelConfig // must be travel
+    if (   paths[idx+0].config != &travel_config // must be travel
         || paths[idx+1].points.size() > 1       // extrusion path is single line
-        || paths[idx+1].config == &travelConfig // must be extrusion
+        || paths[idx+1].config == &travel_config // must be extrusion
 //        || paths[idx+2].points.size() > 1       // travel must be direct
-        || paths[idx+2].config != &travelConfig // must be travel
+        || paths[idx+2].config != &travel_config // must be travel
         || paths[idx+3].points.size() > 1       // extrusion path is single line
-        || paths[idx+3].config == &travelConfig // must be extrusion
+        || paths[idx+3].config == &travel_config // must be extrusion
         || paths[idx+1].config != paths[idx+3].config // both extrusion moves should have the same config
     )
     {
@@ -90,15 +128,15 @@ bool MergeInfillLines::isConvertible(unsigned int path_idx_first_move, Point& fi
 
     int64_t line_width = paths[idx+1].config->getLineWidth();
     
-    Point& a = paths[idx+0].points.back(); // first extruded line from
-    Point& b = paths[idx+1].points.back(); // first extruded line to
-    Point& c = paths[idx+2].points.back(); // second extruded line from
-    Point& d = paths[idx+3].points.back(); // second extruded line to
+    const Point& a = paths[idx+0].points.back(); // first extruded line from
+    const Point& b = paths[idx+1].points.back(); // first extruded line to
+    const Point& c = paths[idx+2].points.back(); // second extruded line from
+    const Point& d = paths[idx+3].points.back(); // second extruded line to
     
-    return isConvertible(a, b, c, d, line_width, first_middle, second_middle, resulting_line_width, use_second_middle_as_first);
+    return isConvertible(a, b, c, d, line_width, nozzle_size, first_middle, second_middle, resulting_line_width, use_second_middle_as_first);
 }
 
-bool MergeInfillLines::isConvertible(const Point& a, const Point& b, const Point& c, const Point& d, int64_t line_width, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first)
+bool MergeInfillLines::isConvertible(const Point& a, const Point& b, const Point& c, const Point& d, int64_t line_width, int64_t nozzle_size, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first)
 {
     use_second_middle_as_first = false;
     int64_t max_line_width = nozzle_size * 3 / 2;
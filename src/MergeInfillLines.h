@@ -23,6 +23,9 @@ class MergeInfillLines
 
     /*!
      * Whether the next two extrusion paths are convertible to a single line segment, starting from the end point the of the last travel move at \p path_idx_first_move
+     * 
+     * Looks up the result in the merges precomputed by LayerPlan::precomputeInfillLineMerges if available.
+     * 
      * \param path_idx_first_move Index into MergeInfillLines::paths to the travel before the two extrusion moves udner consideration
      * \param first_middle Output parameter: the middle of the first extrusion move
      * \param second_middle Input/Output parameter: outputs the middle of the second extrusion move; inputs \p first_middle so we don't have to compute it
@@ -32,6 +35,20 @@ class MergeInfillLines
      */
     bool isConvertible(unsigned int path_idx_first_move, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first = false);
 
+    /*!
+     * Whether the next two extrusion paths are convertible to a single line segment, starting from the end point the of the last travel move at \p path_idx_first_move
+     * \param paths The paths under consideration
+     * \param travel_config The travel settings used to see whether a path is a travel path or an extrusion path
+     * \param nozzle_size The diameter of the hole in the nozzle
+     * \param path_idx_first_move Index into \p paths to the travel before the two extrusion moves udner consideration
+     * \param first_middle Output parameter: the middle of the first extrusion move
+     * \param second_middle Input/Output parameter: outputs the middle of the second extrusion move; inputs \p first_middle so we don't have to compute it
+     * \param resulting_line_width Output parameter: The width of the resulting combined line (the average length of the lines combined)
+     * \param use_second_middle_as_first Whether to use \p second_middle as input parameter for \p first_middle
+     * \return Whether the next two extrusion paths are convertible to a single line segment, starting from the end point the of the last travel move at \p path_idx_first_move
+     */
+    static bool isConvertible(const std::vector<GCodePath>& paths, const GCodePathConfig& travel_config, int64_t nozzle_size, unsigned int path_idx_first_move, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first = false);
+
     /*!
      * Whether the two consecutive extrusion paths (ab and cd) are convitrible to a single line segment.
      * 
@@ -42,13 +59,14 @@ class MergeInfillLines
      * \param c second from
      * \param d second to
      * \param line_width The line width of the moves
+     * \param nozzle_size The diameter of the hole in the nozzle
      * \param first_middle Output parameter: the middle of the first extrusion move
      * \param second_middle Input/Output parameter: outputs the middle of the second extrusion move; inputs \p first_middle so we don't have to compute it
      * \param resulting_line_width Output parameter: The width of the resulting combined line (the average length of the lines combined)
      * \param use_second_middle_as_first Whether to use \p second_middle as input parameter for \p first_middle
      * \return Whether the next two extrusion paths are convertible to a single line segment, starting from the end point the of the last travel move at \p path_idx_first_move
      */
-    bool isConvertible(const Point& a, const Point& b, const Point& c, const Point& d, int64_t line_width, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first = false);
+    static bool isConvertible(const Point& a, const Point& b, const Point& c, const Point& d, int64_t line_width, int64_t nozzle_size, Point& first_middle, Point& second_middle, int64_t& resulting_line_width, bool use_second_middle_as_first = false);
 
     /*!
      * Write an extrusion move with compensated width and compensated speed so that the material flow will be the same.
@@ -86,6 +104,18 @@ public:
      * \return Whether lines have been merged and normal path-to-gcode generation can be skipped for the current resulting \p path_idx .
      */
     bool mergeInfillLines(unsigned int& path_idx);
+
+    /*!
+     * Find all consecutive infill lines in \p paths which can be merged into a single line.
+     * 
+     * This doesn't write anything, so it can be done before the paths are written to gcode.
+     * 
+     * \param paths The paths to check
+     * \param travel_config The travel settings used to see whether a path is a travel path or an extrusion path
+     * \param nozzle_size The diameter of the hole in the nozzle
+     * \return The infill lines which can be merged, sorted on the index of the travel before them
+     */
+    static std::vector<ExtruderPlan::InfillLineMerge> findMerges(const std::vector<GCodePath>& paths, const GCodePathConfig& travel_config, int64_t nozzle_size);
     
     /*!
      * send a line segment through the command socket from the previous point to the given point \p to
@@ -2,14 +2,23 @@
 //Copyright (c) 2017 Ultimaker B.V.
 //CuraEngine is released under the terms of the AGPLv3 or higher.
 
+#include <algorithm> // min, max
+#include <limits> // numeric_limits
+#include <ctype.h> // isspace
+#include <stdlib.h> // strtof
 #include <string.h>
 #include <strings.h>
 #include <stdio.h>
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <sys/mman.h> // mmap
+#endif
 
 #include "MeshGroup.h"
+#include "SliceCache.h"
 #include "utils/gettime.h"
 #include "utils/logoutput.h"
 #include "utils/string.h"
+#include "utils/ThreadPool.h"
 
 #include "settings/SettingRegistry.h" // loadExtruderJSONsettings
 
@@ -18,22 +27,6 @@ namespace cura
 
 FILE* binaryMeshBlob = nullptr;
 
-/* Custom fgets function to support Mac line-ends in Ascii STL files. OpenSCAD produces this when used on Mac */
-void* fgets_(char* ptr, size_t len, FILE* f)
-{
-    while(len && fread(ptr, 1, 1, f) > 0)
-    {
-        if (*ptr == '\n' || *ptr == '\r')
-        {
-            *ptr = '\0';
-            return ptr;
-        }
-        ptr++;
-        len--;
-    }
-    return nullptr;
-}
-
 MeshGroup::MeshGroup(SettingsBaseVirtual* settings_base)
 : SettingsBase(settings_base)
 , extruder_count(-1)
@@ -156,35 +149,227 @@ void MeshGroup::finalize()
     }
 }
 
+void MeshGroup::flattenSettings()
+{
+    SettingsBase::flattenSettings();
+    for (ExtruderTrain* train : extruders)
+    {
+        if (train)
+        {
+            train->flattenSettings();
+        }
+    }
+    for (Mesh& mesh : meshes)
+    {
+        mesh.flattenSettings();
+    }
+}
+
+/*!
+ * Get the whole contents of a file in memory: mapped when possible, otherwise read at once into \p file_buffer.
+ *
+ * \return The contents, or nullptr if the file couldn't be read
+ */
+const char* mapFile(FILE* f, long long file_size, std::vector<char>& file_buffer)
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (mapped != MAP_FAILED)
+    {
+        return static_cast<const char*>(mapped);
+    }
+#endif
+    // Fall back to reading the whole file at once.
+    file_buffer.resize(file_size);
+    rewind(f);
+    if (fread(file_buffer.data(), file_size, 1, f) != 1)
+    {
+        return nullptr;
+    }
+    return file_buffer.data();
+}
+
+/*!
+ * Release the contents of a file obtained with \ref mapFile
+ */
+void unmapFile(const char* file_data, long long file_size, const std::vector<char>& file_buffer)
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    if (file_buffer.empty())
+    {
+        munmap(const_cast<char*>(file_data), file_size);
+    }
+#endif
+}
+
+/*!
+ * Parse a floating point number like sscanf's %f does, skipping the whitespace before it.
+ *
+ * Plain decimal numbers with few digits are computed exactly from their digits, which gives the same correctly rounded
+ * float as strtof. Anything else is left to strtof.
+ *
+ * \return Where the number ends, or nullptr if there is no number
+ */
+const char* parseFloat(const char* pos, const char* end, float& value)
+{
+    while (pos < end && isspace(static_cast<unsigned char>(*pos)))
+    {
+        pos++;
+    }
+    const char* number_start = pos;
+    const bool negative = pos < end && *pos == '-';
+    if (pos < end && (*pos == '-' || *pos == '+'))
+    {
+        pos++;
+    }
+    uint64_t mantissa = 0;
+    int digit_count = 0;
+    int exponent = 0;
+    for (; pos < end && *pos >= '0' && *pos <= '9' && digit_count < 18; pos++, digit_count++)
+    {
+        mantissa = mantissa * 10 + (*pos - '0');
+    }
+    if (pos < end && *pos == '.')
+    {
+        for (pos++; pos < end && *pos >= '0' && *pos <= '9' && digit_count < 18; pos++, digit_count++)
+        {
+            mantissa = mantissa * 10 + (*pos - '0');
+            exponent--;
+        }
+    }
+    if (pos < end && (*pos == 'e' || *pos == 'E') && pos + 1 < end)
+    {
+        const char* exponent_pos = pos + 1;
+        const bool negative_exponent = *exponent_pos == '-';
+        if (*exponent_pos == '-' || *exponent_pos == '+')
+        {
+            exponent_pos++;
+        }
+        int exponent_value = 0;
+        for (; exponent_pos < end && *exponent_pos >= '0' && *exponent_pos <= '9' && exponent_value < 1000; exponent_pos++)
+        {
+            exponent_value = exponent_value * 10 + (*exponent_pos - '0');
+        }
+        exponent += negative_exponent? -exponent_value : exponent_value;
+        pos = exponent_pos; // like sscanf, an exponent without digits is consumed as well
+    }
+    // powers of ten which a float represents exactly, so that a single multiplication or division rounds correctly
+    static const float exact_powers_of_ten[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    const bool is_plain_number = digit_count > 0 && (pos == end || !strchr(".0123456789eExX", *pos) || *pos == '\0');
+    if (is_plain_number && mantissa <= (1 << 24) && exponent >= -10 && exponent <= 10)
+    {
+        value = (exponent >= 0)? static_cast<float>(mantissa) * exact_powers_of_ten[exponent] : static_cast<float>(mantissa) / exact_powers_of_ten[-exponent];
+        if (negative)
+        {
+            value = -value;
+        }
+        return pos;
+    }
+
+    char number[64];
+    const size_t number_length = std::min(static_cast<size_t>(end - number_start), sizeof(number) - 1);
+    memcpy(number, number_start, number_length);
+    number[number_length] = '\0';
+    char* number_end;
+    value = strtof(number, &number_end);
+    if (number_end == number)
+    {
+        return nullptr;
+    }
+    return number_start + (number_end - number);
+}
+
+/*!
+ * Parse a line of an ASCII STL file like sscanf(line, " vertex %f %f %f") does.
+ *
+ * \return Whether the line is a vertex
+ */
+bool parseVertexLine(const char* pos, const char* end, FPoint3& vertex)
+{
+    while (pos < end && isspace(static_cast<unsigned char>(*pos)))
+    {
+        pos++;
+    }
+    constexpr size_t keyword_length = 6;
+    if (end - pos < static_cast<long>(keyword_length) || memcmp(pos, "vertex", keyword_length) != 0)
+    {
+        return false;
+    }
+    pos += keyword_length;
+    return (pos = parseFloat(pos, end, vertex.x)) && (pos = parseFloat(pos, end, vertex.y)) && parseFloat(pos, end, vertex.z);
+}
+
 bool loadMeshSTL_ascii(Mesh* mesh, const char* filename, const FMatrix3x3& matrix)
 {
     FILE* f = fopen(filename, "rt");
-    char buffer[1024];
-    FPoint3 vertex;
-    int n = 0;
-    Point3 v0(0,0,0), v1(0,0,0), v2(0,0,0);
-    while(fgets_(buffer, sizeof(buffer), f))
+    if (f == nullptr)
+    {
+        return false;
+    }
+    fseek(f, 0L, SEEK_END);
+    const long long file_size = ftell(f);
+    std::vector<char> file_buffer;
+    const char* file_data = (file_size > 0)? mapFile(f, file_size, file_buffer) : nullptr;
+    fclose(f);
+    if (!file_data)
     {
-        if (sscanf(buffer, " vertex %f %f %f", &vertex.x, &vertex.y, &vertex.z) == 3)
+        mesh->finish();
+        return true; // an empty file has no faces, after which loadMeshSTL tries it as a binary file
+    }
+    const char* file_end = file_data + file_size;
+
+    // Parse the lines in chunks of the file in parallel. Lines end in '\n' or '\r', to support Mac line-ends. OpenSCAD produces those when used on Mac.
+    const auto is_line_end = [](char c) { return c == '\n' || c == '\r'; };
+    const long long chunk_count = std::max(1LL, std::min(static_cast<long long>(ThreadPool::getThreadCount()) * 4, file_size / (1 << 20)));
+    std::vector<const char*> chunk_start(chunk_count + 1, file_end);
+    chunk_start[0] = file_data;
+    for (long long chunk_idx = 1; chunk_idx < chunk_count; chunk_idx++)
+    { // start each chunk at the start of a line
+        const char* pos = std::max(chunk_start[chunk_idx - 1], file_data + file_size * chunk_idx / chunk_count);
+        while (pos < file_end && pos > file_data && !is_line_end(pos[-1]))
         {
-            n++;
-            switch(n)
+            pos++;
+        }
+        chunk_start[chunk_idx] = pos;
+    }
+    std::vector<std::vector<Point3>> chunk_vertices(chunk_count);
+    ThreadPool::parallelFor(0, chunk_count, [&](long long chunk_idx)
+    {
+        std::vector<Point3>& vertices = chunk_vertices[chunk_idx];
+        FPoint3 vertex;
+        for (const char* line_start = chunk_start[chunk_idx]; line_start < chunk_start[chunk_idx + 1]; )
+        {
+            const char* line_end = line_start;
+            while (line_end < file_end && !is_line_end(*line_end))
+            {
+                line_end++;
+            }
+            if (parseVertexLine(line_start, line_end, vertex))
             {
-            case 1:
-                v0 = matrix.apply(vertex);
-                break;
-            case 2:
-                v1 = matrix.apply(vertex);
-                break;
-            case 3:
-                v2 = matrix.apply(vertex);
-                mesh->addFace(v0, v1, v2);
-                n = 0;
-                break;
+                vertices.push_back(matrix.apply(vertex));
             }
+            line_start = line_end + 1;
         }
+    });
+    unmapFile(file_data, file_size, file_buffer);
+
+    // every three vertices form a face, regardless of the facets they are in
+    std::vector<Point3> face_vertices;
+    size_t vertex_count = 0;
+    for (const std::vector<Point3>& vertices : chunk_vertices)
+    {
+        vertex_count += vertices.size();
     }
-    fclose(f);
+    face_vertices.reserve(vertex_count);
+    for (const std::vector<Point3>& vertices : chunk_vertices)
+    {
+        face_vertices.insert(face_vertices.end(), vertices.begin(), vertices.end());
+    }
+    face_vertices.resize(face_vertices.size() / 3 * 3);
+
+    mesh->faces.reserve(face_vertices.size() / 3);
+    mesh->vertices.reserve(face_vertices.size() / 3);
+    mesh->addFaces(face_vertices);
     mesh->finish();
     return true;
 }
@@ -192,27 +377,33 @@ bool loadMeshSTL_ascii(Mesh* mesh, const char* filename, const FMatrix3x3& matri
 bool loadMeshSTL_binary(Mesh* mesh, const char* filename, const FMatrix3x3& matrix)
 {
     FILE* f = fopen(filename, "rb");
+    if (f == nullptr)
+    {
+        return false;
+    }
 
     fseek(f, 0L, SEEK_END);
     long long file_size = ftell(f); //The file size is the position of the cursor after seeking to the end.
     rewind(f); //Seek back to start.
-    size_t face_count = (file_size - 80 - sizeof(uint32_t)) / 50; //Subtract the size of the header. Every face uses exactly 50 bytes.
-
-    char buffer[80];
-    //Skip the header
-    if (fread(buffer, 80, 1, f) != 1)
+    if (file_size < 80 + static_cast<long long>(sizeof(uint32_t)))
     {
         fclose(f);
         return false;
     }
+    size_t face_count = (file_size - 80 - sizeof(uint32_t)) / 50; //Subtract the size of the header. Every face uses exactly 50 bytes.
 
-    uint32_t reported_face_count;
-    //Read the face count. We'll use it as a sort of redundancy code to check for file corruption.
-    if (fread(&reported_face_count, sizeof(uint32_t), 1, f) != 1)
+    // Map the whole file into memory, so that the faces can be parsed in parallel.
+    std::vector<char> file_buffer;
+    const char* file_data = mapFile(f, file_size, file_buffer);
+    fclose(f);
+    if (!file_data)
     {
-        fclose(f);
         return false;
     }
+
+    //Skip the header, then read the face count. We'll use it as a sort of redundancy code to check for file corruption.
+    uint32_t reported_face_count;
+    memcpy(&reported_face_count, file_data + 80, sizeof(uint32_t));
     if (reported_face_count != face_count)
     {
         logWarning("Face count reported by file (%s) is not equal to actual face count (%s). File could be corrupt!\n", std::to_string(reported_face_count).c_str(), std::to_string(face_count).c_str());
@@ -221,23 +412,22 @@ bool loadMeshSTL_binary(Mesh* mesh, const char* filename, const FMatrix3x3& matr
     //For each face read:
     //float(x,y,z) = normal, float(X,Y,Z)*3 = vertexes, uint16_t = flags
     // Every Face is 50 Bytes: Normal(3*float), Vertices(9*float), 2 Bytes Spacer
-    mesh->faces.reserve(face_count);
-    mesh->vertices.reserve(face_count);
-    for (unsigned int i = 0; i < face_count; i++)
+    const char* face_data = file_data + 80 + sizeof(uint32_t);
+    std::vector<Point3> face_vertices(face_count * 3);
+    ThreadPool::parallelFor(0, static_cast<long long>(face_count), [&](long long face_idx)
     {
-        if (fread(buffer, 50, 1, f) != 1)
-        {
-            fclose(f);
-            return false;
-        }
-        float *v= ((float*)buffer)+3;
+        float v[9];
+        memcpy(v, face_data + face_idx * 50 + 3 * sizeof(float), sizeof(v)); // faces are not aligned on 4 bytes
+        face_vertices[face_idx * 3] = matrix.apply(FPoint3(v[0], v[1], v[2]));
+        face_vertices[face_idx * 3 + 1] = matrix.apply(FPoint3(v[3], v[4], v[5]));
+        face_vertices[face_idx * 3 + 2] = matrix.apply(FPoint3(v[6], v[7], v[8]));
+    });
 
-        Point3 v0 = matrix.apply(FPoint3(v[0], v[1], v[2]));
-        Point3 v1 = matrix.apply(FPoint3(v[3], v[4], v[5]));
-        Point3 v2 = matrix.apply(FPoint3(v[6], v[7], v[8]));
-        mesh->addFace(v0, v1, v2);
-    }
-    fclose(f);
+    unmapFile(file_data, file_size, file_buffer);
+
+    mesh->faces.reserve(face_count);
+    mesh->vertices.reserve(face_count);
+    mesh->addFaces(face_vertices);
     mesh->finish();
     return true;
 }
@@ -296,20 +486,164 @@ bool loadMeshSTL(Mesh* mesh, const char* filename, const FMatrix3x3& matrix)
     return loadMeshSTL_binary(mesh, filename, matrix);
 }
 
-bool loadMeshIntoMeshGroup(MeshGroup* meshgroup, const char* filename, const FMatrix3x3& transformation, SettingsBaseVirtual* object_parent_settings)
+/*!
+ * Parse an index of a face vertex in an OBJ file, ignoring the texture and normal indices after it.
+ *
+ * \param vertex_count The number of vertices before the face, to which negative indices are relative
+ * \param[out] vertex_idx The zero-based index of the vertex
+ * \return Where the face vertex ends, or nullptr if there is no valid index
+ */
+const char* parseOBJFaceVertex(const char* pos, const char* end, size_t vertex_count, int32_t& vertex_idx)
 {
-    TimeKeeper load_timer;
+    const bool negative = *pos == '-';
+    if (*pos == '-' || *pos == '+')
+    {
+        pos++;
+    }
+    long long index = 0;
+    const char* digits_start = pos;
+    for (; pos < end && *pos >= '0' && *pos <= '9' && index <= std::numeric_limits<int32_t>::max(); pos++)
+    {
+        index = index * 10 + (*pos - '0');
+    }
+    if (pos == digits_start || index == 0)
+    {
+        return nullptr;
+    }
+    index = negative? static_cast<long long>(vertex_count) - index : index - 1; // indices start at 1, negative indices count back from the last vertex
+    if (index < 0 || index > std::numeric_limits<int32_t>::max())
+    {
+        return nullptr;
+    }
+    vertex_idx = index;
+    while (pos < end && !isspace(static_cast<unsigned char>(*pos)))
+    { // skip the texture and normal indices
+        pos++;
+    }
+    return pos;
+}
 
-    const char* ext = strrchr(filename, '.');
-    if (ext && (strcmp(ext, ".stl") == 0 || strcmp(ext, ".STL") == 0))
+bool loadMeshOBJ(Mesh* mesh, const char* filename, const FMatrix3x3& matrix)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == nullptr)
+    {
+        return false;
+    }
+    fseek(f, 0L, SEEK_END);
+    const long long file_size = ftell(f);
+    std::vector<char> file_buffer;
+    const char* file_data = (file_size > 0)? mapFile(f, file_size, file_buffer) : nullptr;
+    fclose(f);
+    if (!file_data)
+    {
+        return false;
+    }
+    const char* file_end = file_data + file_size;
+
+    // The vertices are shared by the faces already, so they are added to the mesh as they are rather than welded.
+    std::vector<Point3> vertices;
+    std::vector<int32_t> face_vertex_indices;
+    std::vector<int32_t> polygon;
+    bool success = true;
+    for (const char* line_start = file_data; line_start < file_end && success; )
     {
-        Mesh mesh = object_parent_settings ? Mesh(object_parent_settings) : Mesh(meshgroup); //If we have object_parent_settings, use them as parent settings. Otherwise, just use meshgroup.
-        if(loadMeshSTL(&mesh,filename,transformation)) //Load it! If successful...
+        const char* line_end = line_start;
+        while (line_end < file_end && *line_end != '\n' && *line_end != '\r')
         {
-            meshgroup->meshes.push_back(mesh);
-            log("loading '%s' took %.3f seconds\n",filename,load_timer.restart());
-            return true;
+            line_end++;
         }
+        const char* pos = line_start;
+        while (pos < line_end && isspace(static_cast<unsigned char>(*pos)))
+        {
+            pos++;
+        }
+        const bool is_vertex = line_end - pos > 1 && pos[0] == 'v' && isspace(static_cast<unsigned char>(pos[1]));
+        const bool is_face = line_end - pos > 1 && pos[0] == 'f' && isspace(static_cast<unsigned char>(pos[1]));
+        if (is_vertex)
+        {
+            FPoint3 vertex;
+            if ((pos = parseFloat(pos + 1, line_end, vertex.x)) && (pos = parseFloat(pos, line_end, vertex.y)) && parseFloat(pos, line_end, vertex.z))
+            {
+                vertices.push_back(matrix.apply(vertex));
+            }
+            else
+            {
+                success = false;
+            }
+        }
+        else if (is_face)
+        {
+            polygon.clear();
+            for (pos++; pos < line_end; )
+            {
+                if (isspace(static_cast<unsigned char>(*pos)))
+                {
+                    pos++;
+                    continue;
+                }
+                int32_t vertex_idx;
+                pos = parseOBJFaceVertex(pos, line_end, vertices.size(), vertex_idx);
+                if (!pos)
+                {
+                    success = false;
+                    break;
+                }
+                polygon.push_back(vertex_idx);
+            }
+            for (unsigned int point_idx = 1; point_idx + 1 < polygon.size(); point_idx++)
+            { // faces can have more than three vertices, which form a fan of triangles
+                face_vertex_indices.push_back(polygon[0]);
+                face_vertex_indices.push_back(polygon[point_idx]);
+                face_vertex_indices.push_back(polygon[point_idx + 1]);
+            }
+        }
+        line_start = line_end + 1;
+    }
+    unmapFile(file_data, file_size, file_buffer);
+
+    if (!success || !mesh->addIndexedFaces(vertices, face_vertex_indices))
+    {
+        logError("'%s' contains an invalid vertex or face.\n", filename);
+        return false;
+    }
+    mesh->finish();
+    return true;
+}
+
+bool loadMesh(Mesh* mesh, const char* filename, const FMatrix3x3& transformation)
+{
+    TimeKeeper load_timer;
+
+    const char* ext = strrchr(filename, '.');
+    const bool is_stl = ext && stringcasecompare(ext, ".stl") == 0;
+    const bool is_obj = ext && stringcasecompare(ext, ".obj") == 0;
+    if (!is_stl && !is_obj)
+    {
+        return false;
+    }
+    const uint64_t cache_key = SliceCache::getMeshKey(filename, transformation);
+    if (SliceCache::loadMesh(cache_key, *mesh))
+    {
+        log("loading '%s' from the slice cache took %.3f seconds\n", filename, load_timer.restart());
+        return true;
+    }
+    if (is_stl? loadMeshSTL(mesh, filename, transformation) : loadMeshOBJ(mesh, filename, transformation)) //Load it! If successful...
+    {
+        SliceCache::storeMesh(cache_key, *mesh);
+        log("loading '%s' took %.3f seconds\n", filename, load_timer.restart());
+        return true;
+    }
+    return false;
+}
+
+bool loadMeshIntoMeshGroup(MeshGroup* meshgroup, const char* filename, const FMatrix3x3& transformation, SettingsBaseVirtual* object_parent_settings)
+{
+    Mesh mesh = object_parent_settings ? Mesh(object_parent_settings) : Mesh(meshgroup); //If we have object_parent_settings, use them as parent settings. Otherwise, just use meshgroup.
+    if (loadMesh(&mesh, filename, transformation))
+    {
+        meshgroup->meshes.push_back(mesh);
+        return true;
     }
     return false;
 }
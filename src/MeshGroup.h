@@ -43,11 +43,31 @@ public:
     void clear();
 
     void finalize();
+
+    /*!
+     * Flatten the settings of the mesh group, its extruder trains and its meshes, see \ref SettingsBase::flattenSettings
+     *
+     * Called once all settings have been given, including the extruders to which settings are limited.
+     */
+    void flattenSettings();
 };
 
+/*!
+ * Load the vertices and faces of a mesh from file, or from the slice cache.
+ * 
+ * \param mesh The empty mesh in which to load them, which keeps its settings
+ * \param filename The filename of the mesh file, an STL or OBJ file
+ * \param transformation The transformation applied to all vertices
+ * \return whether the file could be loaded
+ */
+bool loadMesh(Mesh* mesh, const char* filename, const FMatrix3x3& transformation);
+
 /*!
  * Load a Mesh from file and store it in the \p meshgroup.
  * 
+ * STL files and Wavefront OBJ files are supported. The vertices of an OBJ file are shared by its faces already,
+ * so they are used as they are rather than welded like those of an STL file.
+ * 
  * \param meshgroup The meshgroup where to store the mesh
  * \param filename The filename of the mesh file
  * \param transformation The transformation applied to all vertices
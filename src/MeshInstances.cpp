@@ -0,0 +1,225 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "MeshInstances.h"
+
+#include <algorithm> // max
+#include <cassert>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include "MeshGroup.h"
+#include "slicer.h"
+#include "sliceDataStorage.h"
+#include "utils/ThreadPool.h"
+
+namespace cura
+{
+
+MeshInstances::MeshInstances(unsigned int mesh_count)
+: source_mesh_idx(mesh_count, -1)
+, offsets(mesh_count, Point(0, 0))
+{
+}
+
+MeshInstances MeshInstances::find(MeshGroup& meshgroup)
+{
+    std::vector<Mesh>& meshes = meshgroup.meshes;
+    MeshInstances instances(meshes.size());
+    const std::vector<bool> can_be_instanced = findSeparateMeshes(meshgroup);
+
+    std::unordered_map<uint64_t, std::vector<unsigned int>> sources_per_shape; // the meshes which aren't a copy, per hash of their shape
+    for (unsigned int mesh_idx = 0; mesh_idx < meshes.size(); mesh_idx++)
+    {
+        if (!can_be_instanced[mesh_idx])
+        {
+            continue;
+        }
+        std::vector<unsigned int>& sources = sources_per_shape[hashShape(meshes[mesh_idx])];
+        for (unsigned int source_idx : sources)
+        {
+            Point offset;
+            if (haveSameSettings(meshes[source_idx], meshes[mesh_idx]) && findOffset(meshes[source_idx], meshes[mesh_idx], offset))
+            {
+                instances.source_mesh_idx[mesh_idx] = source_idx;
+                instances.offsets[mesh_idx] = offset;
+                break;
+            }
+        }
+        if (instances.source_mesh_idx[mesh_idx] < 0)
+        {
+            sources.push_back(mesh_idx);
+        }
+    }
+    return instances;
+}
+
+std::vector<bool> MeshInstances::findSeparateMeshes(const MeshGroup& meshgroup)
+{
+    const std::vector<Mesh>& meshes = meshgroup.meshes;
+    // the distance around each mesh within which its outlines may change because of the other meshes
+    std::vector<coord_t> margins;
+    std::vector<bool> separate;
+    for (const Mesh& mesh : meshes)
+    {
+        margins.push_back(std::max(coord_t(0), mesh.getSettingInMicrons("multiple_mesh_overlap")) + std::max(coord_t(0), mesh.getSettingInMicrons("xy_offset")));
+        separate.push_back(!mesh.vertices.empty() && canBeInstanced(mesh));
+    }
+    for (unsigned int mesh_idx = 0; mesh_idx < meshes.size(); mesh_idx++)
+    {
+        if (!separate[mesh_idx])
+        {
+            continue;
+        }
+        for (unsigned int other_mesh_idx = 0; other_mesh_idx < meshes.size(); other_mesh_idx++)
+        {
+            if (other_mesh_idx == mesh_idx)
+            {
+                continue;
+            }
+            AABB3D aabb = meshes[mesh_idx].getAABB();
+            aabb.expandXY(margins[mesh_idx] + margins[other_mesh_idx]);
+            if (aabb.hit(meshes[other_mesh_idx].getAABB()))
+            {
+                separate[mesh_idx] = false;
+                break;
+            }
+        }
+    }
+    return separate;
+}
+
+unsigned int MeshInstances::getCopyCount() const
+{
+    return std::count_if(source_mesh_idx.begin(), source_mesh_idx.end(), [](int source_idx) { return source_idx >= 0; });
+}
+
+Slicer* MeshInstances::translateSlices(const Slicer& source, const Mesh* mesh, Point offset)
+{
+    Slicer* slicer = new Slicer(mesh);
+    slicer->layers.resize(source.layers.size());
+    for (unsigned int layer_nr = 0; layer_nr < source.layers.size(); layer_nr++)
+    {
+        const SlicerLayer& source_layer = source.layers[layer_nr];
+        SlicerLayer& layer = slicer->layers[layer_nr];
+        layer.z = source_layer.z;
+        layer.polygons = source_layer.polygons;
+        layer.polygons.translate(offset);
+        layer.openPolylines = source_layer.openPolylines;
+        layer.openPolylines.translate(offset);
+    }
+    return slicer;
+}
+
+void MeshInstances::translateAreas(const SliceMeshStorage& source, SliceMeshStorage& mesh)
+{
+    assert(source.layers.size() == mesh.layers.size());
+    ThreadPool::parallelFor(0, static_cast<int>(mesh.layers.size()), [&](int layer_nr)
+    {
+        const SliceLayer& source_layer = source.layers[layer_nr];
+        SliceLayer& layer = mesh.layers[layer_nr];
+        layer.parts = source_layer.parts;
+        for (SliceLayerPart& part : layer.parts)
+        {
+            part.translate(mesh.instance_offset);
+        }
+        layer.openPolyLines = source_layer.openPolyLines;
+        layer.openPolyLines.translate(mesh.instance_offset);
+    });
+    mesh.layer_nr_max_filled_layer = source.layer_nr_max_filled_layer;
+    mesh.layer_nr_min_filled_layer = source.layer_nr_min_filled_layer;
+}
+
+bool MeshInstances::canBeInstanced(const Mesh& mesh)
+{
+    return !mesh.getSettingBoolean("infill_mesh")
+        && !mesh.getSettingBoolean("cutting_mesh")
+        && !mesh.getSettingBoolean("support_mesh")
+        && !mesh.getSettingBoolean("anti_overhang_mesh")
+        && !mesh.getSettingBoolean("mold_enabled");
+}
+
+uint64_t MeshInstances::hashShape(const Mesh& mesh)
+{
+    uint64_t hash = 14695981039346656037ull; // 64 bit FNV-1a, like SliceCache::hashMeshGeometry
+    const auto add = [&hash](int64_t value)
+    {
+        for (unsigned int byte_idx = 0; byte_idx < sizeof(value); byte_idx++)
+        {
+            hash = (hash ^ static_cast<uint8_t>(value >> (byte_idx * 8))) * 1099511628211ull;
+        }
+    };
+    add(mesh.vertices.size());
+    const Point3 origin = mesh.vertices.empty()? Point3(0, 0, 0) : mesh.vertices.front().p;
+    for (const MeshVertex& vertex : mesh.vertices)
+    {
+        add(vertex.p.x - origin.x);
+        add(vertex.p.y - origin.y);
+        add(vertex.p.z - origin.z);
+    }
+    add(mesh.faces.size());
+    for (const MeshFace& face : mesh.faces)
+    {
+        add(face.vertex_index[0]);
+        add(face.vertex_index[1]);
+        add(face.vertex_index[2]);
+    }
+    return hash;
+}
+
+bool MeshInstances::haveSameSettings(Mesh& mesh, Mesh& other)
+{
+    if (mesh.getParent() != other.getParent())
+    {
+        return false;
+    }
+    std::set<std::string> keys;
+    mesh.getLocalSettingKeys(keys);
+    other.getLocalSettingKeys(keys);
+    for (const std::string& key : keys)
+    {
+        if (key.compare(0, 14, "mesh_position_") == 0)
+        { // the position has already been applied to the vertices
+            continue;
+        }
+        if (mesh.getSettingString(key) != other.getSettingString(key))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MeshInstances::findOffset(const Mesh& source, const Mesh& mesh, Point& offset)
+{
+    if (source.vertices.size() != mesh.vertices.size() || source.faces.size() != mesh.faces.size())
+    {
+        return false;
+    }
+    const Point3 offset_3d = mesh.vertices.front().p - source.vertices.front().p;
+    if (offset_3d.z != 0)
+    { // the layers would be sliced at other heights through the mesh
+        return false;
+    }
+    for (unsigned int vertex_idx = 0; vertex_idx < mesh.vertices.size(); vertex_idx++)
+    {
+        if (mesh.vertices[vertex_idx].p - source.vertices[vertex_idx].p != offset_3d)
+        {
+            return false;
+        }
+    }
+    for (unsigned int face_idx = 0; face_idx < mesh.faces.size(); face_idx++)
+    {
+        const MeshFace& face = mesh.faces[face_idx];
+        const MeshFace& source_face = source.faces[face_idx];
+        if (face.vertex_index[0] != source_face.vertex_index[0] || face.vertex_index[1] != source_face.vertex_index[1] || face.vertex_index[2] != source_face.vertex_index[2])
+        {
+            return false;
+        }
+    }
+    offset = Point(offset_3d.x, offset_3d.y);
+    return true;
+}
+
+}//namespace cura
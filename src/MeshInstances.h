@@ -0,0 +1,137 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef MESH_INSTANCES_H
+#define MESH_INSTANCES_H
+
+#include <cstdint>
+#include <vector>
+
+#include "utils/intpoint.h"
+
+namespace cura
+{
+
+class Mesh;
+class MeshGroup;
+class SliceMeshStorage;
+class Slicer;
+
+/*!
+ * Finds the meshes of a mesh group which are copies of another mesh, moved horizontally, like a plate full of the same part.
+ *
+ * Only the first mesh of each set of copies is sliced and gets its walls, skin and infill generated.
+ * The layers of the other copies are translated from it, which gives the same result, since each of these steps only depends on the shape of the mesh itself.
+ * The support, the adhesion and the helpers are still generated for the whole plate.
+ *
+ * A mesh is a copy of another when:
+ * - they have the same faces, and the same vertices except for a translation by whole microns in X and Y,
+ * - they have the same settings, except for their position,
+ * - they are both normal meshes; not infill, cutting, support, anti overhang or mold meshes,
+ * - their bounding boxes don't come near those of any other mesh, so that carving and overlapping the meshes leaves them alone.
+ */
+class MeshInstances
+{
+public:
+    /*!
+     * No mesh is a copy of another.
+     *
+     * \param mesh_count The number of meshes in the mesh group
+     */
+    explicit MeshInstances(unsigned int mesh_count);
+
+    /*!
+     * Find the copies among the meshes of a mesh group.
+     *
+     * Must be called before the faces and vertices of the meshes are cleared.
+     *
+     * \param meshgroup The meshes, with their vertices moved to where they are on the build plate
+     */
+    static MeshInstances find(MeshGroup& meshgroup);
+
+    /*!
+     * Get the index of the mesh of which a mesh is a copy, or -1 if it isn't a copy.
+     *
+     * The source mesh always has a lower index than its copies, and isn't a copy itself.
+     */
+    int getSourceMeshIdx(unsigned int mesh_idx) const
+    {
+        return source_mesh_idx[mesh_idx];
+    }
+
+    /*!
+     * Get the translation from the source mesh of a copy to the copy.
+     */
+    Point getOffset(unsigned int mesh_idx) const
+    {
+        return offsets[mesh_idx];
+    }
+
+    /*!
+     * The number of meshes which are a copy of another.
+     */
+    unsigned int getCopyCount() const;
+
+    /*!
+     * Create a slicer for a copy with the sliced layers of its source mesh, translated.
+     *
+     * Unlike slicing the copy, this doesn't register the horizontal expansion in the bounding box of \p mesh.
+     *
+     * \param source The slicer of the source mesh
+     * \param mesh The copy
+     * \param offset The translation from the source mesh to the copy
+     */
+    static Slicer* translateSlices(const Slicer& source, const Mesh* mesh, Point offset);
+
+    /*!
+     * Replace the layers of a copy with the layers of its source mesh, translated by \ref SliceMeshStorage::instance_offset,
+     * once the walls, skin and infill of the source mesh have been generated.
+     *
+     * \param source The source mesh
+     * \param mesh The copy
+     */
+    static void translateAreas(const SliceMeshStorage& source, SliceMeshStorage& mesh);
+
+    /*!
+     * Find the meshes of which the areas only depend on their own shape and settings, so that moving such a mesh horizontally moves its areas the same way.
+     *
+     * These are the normal meshes which keep clear of all other meshes, see \ref MeshInstances
+     *
+     * \param meshgroup The meshes, with their vertices moved to where they are on the build plate
+     * \return For each mesh whether it's separate from the others
+     */
+    static std::vector<bool> findSeparateMeshes(const MeshGroup& meshgroup);
+
+    /*!
+     * Hash the faces and the vertices of a mesh relative to its first vertex, which is the same for a mesh and its copies.
+     */
+    static uint64_t hashShape(const Mesh& mesh);
+
+private:
+    std::vector<int> source_mesh_idx; //!< For each mesh the index of the mesh of which it is a copy, or -1
+    std::vector<Point> offsets; //!< For each mesh the translation from its source mesh
+
+    /*!
+     * Whether a mesh is of a kind which can be a copy or the source of copies, judging by its settings.
+     */
+    static bool canBeInstanced(const Mesh& mesh);
+
+    /*!
+     * Whether two meshes have the same settings, except for their position.
+     */
+    static bool haveSameSettings(Mesh& mesh, Mesh& other);
+
+    /*!
+     * Check whether a mesh is the same as another one, translated horizontally.
+     *
+     * \param source The other mesh
+     * \param mesh The mesh which may be a copy of \p source
+     * \param[out] offset The translation from \p source to \p mesh, if it is a copy
+     * \return Whether \p mesh is a copy of \p source
+     */
+    static bool findOffset(const Mesh& source, const Mesh& mesh, Point& offset);
+};
+
+}//namespace cura
+
+#endif//MESH_INSTANCES_H
@@ -1,6 +1,7 @@
 /** Copyright (C) 2017 Ultimaker - Released under terms of the AGPLv3 License */
 #include "Mold.h"
 #include "utils/intpoint.h"
+#include "utils/ThreadPool.h"
 #include "sliceDataStorage.h"
 
 namespace cura
@@ -35,11 +36,23 @@ void Mold::process(SliceDataStorage& storage, std::vector<Slicer*>& slicer_list,
         }
     }
 
-    std::vector<Polygons> mold_outline_above_per_mesh; // the outer outlines of the layer above without the original model(s) being cut out
-    mold_outline_above_per_mesh.resize(slicer_list.size());
-    for (int layer_nr = layer_count - 1; layer_nr >= 0; layer_nr--)
+    // The model outlines and their big offsets don't depend on other layers, so they are computed for all layers in parallel.
+    // Only growing the mold by the mold angle depends on the layer above, which is done in a serial pass afterwards.
+    std::vector<std::vector<Polygons>> mold_outlines_per_mesh(slicer_list.size()); // per mesh per layer the outside of the mold, without the original model(s) being cut out
+    std::vector<std::vector<Polygons>> roofs_per_mesh(slicer_list.size()); // per mesh per layer the roofs still to be added to the outside of the mold
+    for (unsigned int mesh_idx = 0; mesh_idx < slicer_list.size(); mesh_idx++)
     {
-        Polygons all_original_mold_outlines; // outlines of all models for which to generate a mold (insides of all molds)
+        if (storage.meshgroup->meshes[mesh_idx].getSettingBoolean("mold_enabled"))
+        {
+            mold_outlines_per_mesh[mesh_idx].resize(slicer_list[mesh_idx]->layers.size());
+            roofs_per_mesh[mesh_idx].resize(slicer_list[mesh_idx]->layers.size());
+        }
+    }
+    std::vector<Polygons> all_original_mold_outlines_per_layer(layer_count); // outlines of all models for which to generate a mold (insides of all molds)
+
+    ThreadPool::parallelFor(0, static_cast<int>(layer_count), [&](int layer_nr)
+    {
+        Polygons& all_original_mold_outlines = all_original_mold_outlines_per_layer[layer_nr];
 
         // first generate outlines
         for (unsigned int mesh_idx = 0; mesh_idx < slicer_list.size(); mesh_idx++)
@@ -55,7 +68,6 @@ void Mold::process(SliceDataStorage& storage, std::vector<Slicer*>& slicer_list,
             double angle = mesh.getSettingInAngleDegrees("mold_angle");
             coord_t roof_height = mesh.getSettingInMicrons("mold_roof_height");
 
-            coord_t inset = tan(angle / 180 * M_PI) * layer_height;
             unsigned int roof_layer_count = roof_height / layer_height;
 
 
@@ -64,38 +76,73 @@ void Mold::process(SliceDataStorage& storage, std::vector<Slicer*>& slicer_list,
             layer.openPolylines.clear();
             all_original_mold_outlines.add(model_outlines);
 
-            if (angle >= 90)
-            {
-                layer.polygons = model_outlines.offset(width, ClipperLib::jtRound);
-            }
-            else
-            {
-                Polygons& mold_outline_above = mold_outline_above_per_mesh[mesh_idx]; // the outside of the mold on the layer above
-                layer.polygons = mold_outline_above.offset(-inset).unionPolygons(model_outlines.offset(width, ClipperLib::jtRound));
-            }
+            Polygons& mold_outline = mold_outlines_per_mesh[mesh_idx][layer_nr];
+            mold_outline = model_outlines.offset(width, ClipperLib::jtRound);
 
             // add roofs
             if (roof_layer_count > 0 && layer_nr > 0)
             {
+                // the polygons of the layers aren't changed until all layers are processed, so these are still the original outlines
                 unsigned int layer_nr_below = std::max(0, static_cast<int>(layer_nr - roof_layer_count));
                 Polygons roofs = slicer.layers[layer_nr_below].polygons.offset(width, ClipperLib::jtRound); // TODO: don't compute offset twice!
-                layer.polygons = layer.polygons.unionPolygons(roofs);
+                if (angle >= 90)
+                {
+                    mold_outline = mold_outline.unionPolygons(roofs);
+                }
+                else
+                { // the roofs are added after growing the mold from the layer above
+                    roofs_per_mesh[mesh_idx][layer_nr] = std::move(roofs);
+                }
             }
-
-            mold_outline_above_per_mesh[mesh_idx] = layer.polygons;
         }
-        all_original_mold_outlines = all_original_mold_outlines.unionPolygons();
+        all_original_mold_outlines = all_original_mold_outlines.unionPolygonsInClusters();
+    });
 
-        // cut out molds from all objects after generating mold outlines for all objects so that molds won't overlap into the casting cutout of another mold
+    // grow the molds with an angle from the top down
+    for (unsigned int mesh_idx = 0; mesh_idx < slicer_list.size(); mesh_idx++)
+    {
+        const Mesh& mesh = storage.meshgroup->meshes[mesh_idx];
+        double angle = mesh.getSettingInAngleDegrees("mold_angle");
+        if (!mesh.getSettingBoolean("mold_enabled") || angle >= 90)
+        {
+            continue;
+        }
+        coord_t inset = tan(angle / 180 * M_PI) * layer_height;
+        unsigned int roof_layer_count = mesh.getSettingInMicrons("mold_roof_height") / layer_height;
+        std::vector<Polygons>& mold_outlines = mold_outlines_per_mesh[mesh_idx];
+        std::vector<Polygons>& roofs = roofs_per_mesh[mesh_idx];
+        Polygons mold_outline_above; // the outside of the mold on the layer above
+        for (int layer_nr = static_cast<int>(mold_outlines.size()) - 1; layer_nr >= 0; layer_nr--)
+        {
+            Polygons& mold_outline = mold_outlines[layer_nr];
+            mold_outline = mold_outline_above.offset(-inset).unionPolygons(mold_outline);
+            if (roof_layer_count > 0 && layer_nr > 0)
+            {
+                mold_outline = mold_outline.unionPolygons(roofs[layer_nr]);
+            }
+            mold_outline_above = mold_outline;
+        }
+    }
 
+    // cut out molds from all objects after generating mold outlines for all objects so that molds won't overlap into the casting cutout of another mold
+    ThreadPool::parallelFor(0, static_cast<int>(layer_count), [&](int layer_nr)
+    {
         // carve molds out of all other models
         for (unsigned int mesh_idx = 0; mesh_idx < slicer_list.size(); mesh_idx++)
         {
             Slicer& slicer = *slicer_list[mesh_idx];
+            if (layer_nr >= static_cast<int>(slicer.layers.size()))
+            {
+                continue;
+            }
             SlicerLayer& layer = slicer.layers[layer_nr];
-            layer.polygons = layer.polygons.difference(all_original_mold_outlines);
+            if (!mold_outlines_per_mesh[mesh_idx].empty())
+            {
+                layer.polygons = std::move(mold_outlines_per_mesh[mesh_idx][layer_nr]);
+            }
+            layer.polygons = layer.polygons.difference(all_original_mold_outlines_per_layer[layer_nr]);
         }
-    }
+    });
 
 }
 
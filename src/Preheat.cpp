@@ -19,6 +19,11 @@ void Preheat::setConfig(const MeshGroup& meshgroup)
         config.time_to_heatup_1_degree[0] = 1.0 / machine_nozzle_heat_up_speed;
         config.time_to_cooldown_1_degree[1] = 1.0 / (machine_nozzle_cool_down_speed + material_extrusion_cool_down_speed);
         config.time_to_heatup_1_degree[1] = 1.0 / (machine_nozzle_heat_up_speed - material_extrusion_cool_down_speed);
+        for (bool during_printing : {false, true})
+        { // the constants of the linear heat up and cool down models used for every extruder switch
+            config.time_ratio_cooldown_heatup[during_printing] = config.time_to_cooldown_1_degree[during_printing] / config.time_to_heatup_1_degree[during_printing];
+            config.time_to_cooldown_and_heatup_1_degree[during_printing] = config.time_to_cooldown_1_degree[during_printing] + config.time_to_heatup_1_degree[during_printing];
+        }
         config.standby_temp = extruder_train.getSettingInSeconds("material_standby_temperature");
 
         config.min_time_window = extruder_train.getSettingInSeconds("machine_min_cool_heat_time_window");
@@ -49,6 +54,28 @@ double Preheat::getTimeToGoFromTempToTemp(int extruder, double temp_before, doub
     return std::max(0.0, time);
 }
 
+double Preheat::getMaxHeatUpTimeFromStandby()
+{
+    double max_time = 0.0;
+    for (unsigned int extruder = 0; extruder < config_per_extruder.size(); extruder++)
+    {
+        const Config& config = config_per_extruder[extruder];
+        double print_temp = std::max(config.material_print_temperature, std::max(config.material_print_temperature_layer_0, config.material_initial_print_temperature));
+        if (config.flow_dependent_temperature)
+        {
+            for (const FlowTempGraph::Datum& datum : config.flow_temp_graph.data)
+            {
+                print_temp = std::max(print_temp, datum.temp);
+            }
+        }
+        for (bool during_printing : {false, true})
+        {
+            max_time = std::max(max_time, getTimeToGoFromTempToTemp(extruder, config.standby_temp, print_temp, during_printing));
+        }
+    }
+    return max_time;
+}
+
 double Preheat::getTemp(unsigned int extruder, double flow, bool is_initial_layer)
 {
     if (is_initial_layer && config_per_extruder[extruder].material_print_temperature_layer_0 != 0)
@@ -97,7 +124,7 @@ Preheat::WarmUpResult Preheat::getWarmUpPointAfterCoolDown(double time_window, u
         return result;
     }
 
-    double time_ratio_cooldown_heatup = time_to_cooldown_1_degree / time_to_heatup_1_degree;
+    const double time_ratio_cooldown_heatup = config.time_ratio_cooldown_heatup[during_printing];
     double time_to_heat_from_standby_to_print_temp = getTimeToGoFromTempToTemp(extruder, temp_mid, outer_temp, during_printing);
     double time_needed_to_reach_standby_temp = time_to_heat_from_standby_to_print_temp * (1.0 + time_ratio_cooldown_heatup);
     if (time_needed_to_reach_standby_temp < limited_time_window)
@@ -107,7 +134,7 @@ Preheat::WarmUpResult Preheat::getWarmUpPointAfterCoolDown(double time_window, u
     }
     else 
     {
-        result.heating_time += limited_time_window * time_to_heatup_1_degree / (time_to_cooldown_1_degree + time_to_heatup_1_degree);
+        result.heating_time += limited_time_window * time_to_heatup_1_degree / config.time_to_cooldown_and_heatup_1_degree[during_printing];
         result.lowest_temperature = std::max(temp_mid, temp_end - result.heating_time / time_to_heatup_1_degree);
     }
 
@@ -159,7 +186,7 @@ Preheat::CoolDownResult Preheat::getCoolDownPointAfterWarmUp(double time_window,
         result.highest_temperature = std::max(temp_start, temp_end);
         return result;
     }
-    double time_ratio_cooldown_heatup = time_to_cooldown_1_degree / time_to_heatup_1_degree;
+    const double time_ratio_cooldown_heatup = config.time_ratio_cooldown_heatup[during_printing];
     double cool_down_time = getTimeToGoFromTempToTemp(extruder, temp_mid, outer_temp, during_printing);
     double time_needed_to_reach_temp1 = cool_down_time * (1.0 + time_ratio_cooldown_heatup);
     if (time_needed_to_reach_temp1 < limited_time_window)
@@ -169,7 +196,7 @@ Preheat::CoolDownResult Preheat::getCoolDownPointAfterWarmUp(double time_window,
     }
     else 
     {
-        result.cooling_time += limited_time_window * time_to_heatup_1_degree / (time_to_cooldown_1_degree + time_to_heatup_1_degree);
+        result.cooling_time += limited_time_window * time_to_heatup_1_degree / config.time_to_cooldown_and_heatup_1_degree[during_printing];
         result.highest_temperature = std::min(temp_mid, temp_end + result.cooling_time / time_to_cooldown_1_degree);
     }
 
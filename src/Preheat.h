@@ -28,6 +28,8 @@ class Preheat
     public:
         double time_to_heatup_1_degree[2]; //!< average time it takes to heat up one degree (in the range of normal print temperatures and standby temperature), while not-printing and while printing
         double time_to_cooldown_1_degree[2]; //!< average time it takes to cool down one degree (in the range of normal print temperatures and standby temperature), while not-printing and while printing
+        double time_ratio_cooldown_heatup[2]; //!< time_to_cooldown_1_degree divided by time_to_heatup_1_degree, while not-printing and while printing
+        double time_to_cooldown_and_heatup_1_degree[2]; //!< time_to_cooldown_1_degree plus time_to_heatup_1_degree, while not-printing and while printing
 
         double standby_temp; //!< The temperature at which the nozzle rests when it is not printing.
 
@@ -195,6 +197,12 @@ public:
      * \return The time needed
      */
     double getTimeToGoFromTempToTemp(int extruder, double temp_before, double temp_after, bool during_printing);
+
+    /*!
+     * Get the longest time any extruder needs to heat up from its standby temperature to the highest of its printing temperatures,
+     * which is how long before an extruder plan its preheat command may have to be inserted.
+     */
+    double getMaxHeatUpTimeFromStandby();
 };
 
 } // namespace cura 
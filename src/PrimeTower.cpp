@@ -8,6 +8,7 @@
 #include "LayerPlan.h"
 #include "infill.h"
 #include "PrintFeature.h"
+#include "pathOrderOptimizer.h"
 
 namespace cura 
 {
@@ -62,6 +63,7 @@ void PrimeTower::generatePaths(const SliceDataStorage& storage)
     {
         generatePaths_denseInfill(storage);
         generateWipeLocations(storage);
+        generatePreWipeMoves(storage);
     }
 }
 
@@ -124,7 +126,7 @@ void PrimeTower::addToGcode(const SliceDataStorage& storage, LayerPlan& gcodeLay
         preWipe(storage, gcodeLayer, layer_nr, new_extruder);
     }
 
-    addToGcode_denseInfill(gcodeLayer, layer_nr, new_extruder);
+    addToGcode_denseInfill(gcodeLayer, layer_nr, new_extruder, pre_wipe);
 
     // post-wipe:
     if (post_wipe)
@@ -135,14 +137,36 @@ void PrimeTower::addToGcode(const SliceDataStorage& storage, LayerPlan& gcodeLay
     gcodeLayer.setPrimeTowerIsPlanned();
 }
 
-void PrimeTower::addToGcode_denseInfill(LayerPlan& gcode_layer, const int layer_nr, const int extruder_nr) const
+void PrimeTower::addToGcode_denseInfill(LayerPlan& gcode_layer, const int layer_nr, const int extruder_nr, const bool pre_wiped) const
 {
-    const ExtrusionMoves& pattern = patterns_per_extruder[extruder_nr][((layer_nr % 2) + 2) % 2]; // +2) %2 to handle negative layer numbers
+    const unsigned int pattern_idx = ((layer_nr % 2) + 2) % 2; // +2) %2 to handle negative layer numbers
+    const ExtrusionMoves& pattern = patterns_per_extruder[extruder_nr][pattern_idx];
 
     const GCodePathConfig& config = gcode_layer.configs_storage.prime_tower_config_per_extruder[extruder_nr];
 
-    gcode_layer.addPolygonsByOptimizer(pattern.polygons, &config);
-    gcode_layer.addLinesByOptimizer(pattern.lines, &config, SpaceFillType::Lines);
+    // after a pre-wipe the order in which to print the pattern is known in advance
+    const PatternOrder* order = nullptr;
+    if (pre_wiped)
+    {
+        order = &pre_wipe_moves_per_extruder[extruder_nr][getPreWipeLocationIdx(layer_nr)].pattern_orders[pattern_idx];
+    }
+
+    if (order && gcode_layer.getLastPosition() == order->start_position)
+    {
+        gcode_layer.addPolygonsInOrder(pattern.polygons, order->polygon_order, order->polygon_start, &config);
+    }
+    else
+    {
+        gcode_layer.addPolygonsByOptimizer(pattern.polygons, &config);
+    }
+    if (order && gcode_layer.getLastPosition() == order->lines_start_position)
+    {
+        gcode_layer.addLinesInOrder(pattern.lines, order->line_order, order->line_start, &config, SpaceFillType::Lines);
+    }
+    else
+    {
+        gcode_layer.addLinesByOptimizer(pattern.lines, &config, SpaceFillType::Lines);
+    }
 }
 
 Point PrimeTower::getLocationBeforePrimeTower(const SliceDataStorage& storage) const
@@ -225,17 +249,78 @@ void PrimeTower::generateWipeLocations(const SliceDataStorage& storage)
     PolygonUtils::spreadDots(segment_start, segment_end, number_of_pre_wipe_locations, pre_wipe_locations);
 }
 
+void PrimeTower::generatePreWipeMoves(const SliceDataStorage& storage)
+{
+    for (int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
+    {
+        pre_wipe_moves_per_extruder.emplace_back();
+        const ExtruderTrain& train = *storage.meshgroup->getExtruderTrain(extruder_nr);
+        if (!train.getSettingBoolean("dual_pre_wipe"))
+        {
+            continue;
+        }
+        const int inward_dist = train.getSettingInMicrons("machine_nozzle_size") * 3 / 2 ;
+        const int start_dist = train.getSettingInMicrons("machine_nozzle_size") * 2;
+        std::vector<PreWipeMoves>& pre_wipe_moves = pre_wipe_moves_per_extruder.back();
+        for (const ClosestPolygonPoint& wipe_location : pre_wipe_locations)
+        {
+            pre_wipe_moves.emplace_back();
+            PreWipeMoves& moves = pre_wipe_moves.back();
+            moves.end = PolygonUtils::moveInsideDiagonally(wipe_location, inward_dist);
+            const Point outward_dir = wipe_location.location - moves.end;
+            moves.start = wipe_location.location + normal(outward_dir, start_dist);
+            for (const ExtrusionMoves& pattern : patterns_per_extruder[extruder_nr])
+            {
+                moves.pattern_orders.push_back(optimizeOrder(pattern, moves.end));
+            }
+        }
+    }
+}
+
+PrimeTower::PatternOrder PrimeTower::optimizeOrder(const ExtrusionMoves& pattern, Point start_position)
+{
+    // the same as what LayerPlan::addPolygonsByOptimizer and LayerPlan::addLinesByOptimizer would do from the start position
+    PatternOrder ret;
+    ret.start_position = start_position;
+    ret.lines_start_position = start_position;
+    if (pattern.polygons.size() > 0)
+    {
+        PathOrderOptimizer polygon_order_optimizer(start_position);
+        for (unsigned int poly_idx = 0; poly_idx < pattern.polygons.size(); poly_idx++)
+        {
+            polygon_order_optimizer.addPolygon(pattern.polygons[poly_idx]);
+        }
+        polygon_order_optimizer.optimize();
+        ret.polygon_order = polygon_order_optimizer.polyOrder;
+        ret.polygon_start = polygon_order_optimizer.polyStart;
+        if (!ret.polygon_order.empty())
+        { // LayerPlan::addPolygon ends where it started, unless the polygon is only a line
+            ConstPolygonRef last_polygon = pattern.polygons[ret.polygon_order.back()];
+            const int last_start = ret.polygon_start[ret.polygon_order.back()];
+            ret.lines_start_position = (last_polygon.size() > 2)? last_polygon[last_start] : last_polygon[(last_start + last_polygon.size() - 1) % last_polygon.size()];
+        }
+    }
+    LineOrderOptimizer line_order_optimizer(ret.lines_start_position);
+    for (unsigned int line_idx = 0; line_idx < pattern.lines.size(); line_idx++)
+    {
+        line_order_optimizer.addPolygon(pattern.lines[line_idx]);
+    }
+    line_order_optimizer.optimize();
+    ret.line_order = line_order_optimizer.polyOrder;
+    ret.line_start = line_order_optimizer.polyStart;
+    return ret;
+}
+
+unsigned int PrimeTower::getPreWipeLocationIdx(const int layer_nr) const
+{
+    return (pre_wipe_location_skip * layer_nr) % number_of_pre_wipe_locations;
+}
+
 void PrimeTower::preWipe(const SliceDataStorage& storage, LayerPlan& gcode_layer, const int layer_nr, const int extruder_nr) const
 {
-    int current_pre_wipe_location_idx = (pre_wipe_location_skip * layer_nr) % number_of_pre_wipe_locations;
-    const ClosestPolygonPoint wipe_location = pre_wipe_locations[current_pre_wipe_location_idx];
-
-    ExtruderTrain& train = *storage.meshgroup->getExtruderTrain(extruder_nr);
-    const int inward_dist = train.getSettingInMicrons("machine_nozzle_size") * 3 / 2 ;
-    const int start_dist = train.getSettingInMicrons("machine_nozzle_size") * 2;
-    const Point end = PolygonUtils::moveInsideDiagonally(wipe_location, inward_dist);
-    const Point outward_dir = wipe_location.location - end;
-    const Point start = wipe_location.location + normal(outward_dir, start_dist);
+    const PreWipeMoves& moves = pre_wipe_moves_per_extruder[extruder_nr][getPreWipeLocationIdx(layer_nr)];
+    const Point& start = moves.start;
+    const Point& end = moves.end;
     if (wipe_from_middle)
     {
         // for hollow wipe tower:
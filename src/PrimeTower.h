@@ -43,10 +43,35 @@ private:
     Point post_wipe_point; //!< Location to post-wipe the unused nozzle off on
 
     std::vector<ClosestPolygonPoint> pre_wipe_locations; //!< The differernt locations where to pre-wipe the active nozzle
-    const unsigned int pre_wipe_location_skip = 13; //!< How big the steps are when stepping through \ref PrimeTower::wipe_locations
-    const unsigned int number_of_pre_wipe_locations = 21; //!< The required size of \ref PrimeTower::wipe_locations
+    static constexpr unsigned int pre_wipe_location_skip = 13; //!< How big the steps are when stepping through \ref PrimeTower::wipe_locations
+    static constexpr unsigned int number_of_pre_wipe_locations = 21; //!< The required size of \ref PrimeTower::wipe_locations
     // note that the above are two consecutive numbers in the Fibonacci sequence
 
+    /*!
+     * The order in which to print the moves of a pattern, optimized for starting from a given position
+     */
+    struct PatternOrder
+    {
+        Point start_position; //!< The position from which the order of the polygons is optimized
+        std::vector<int> polygon_order; //!< The order of the polygons of the pattern, see PathOrderOptimizer::polyOrder
+        std::vector<int> polygon_start; //!< The starting vertex of each polygon of the pattern, see PathOrderOptimizer::polyStart
+        Point lines_start_position; //!< The position where the polygons end, from which the order of the lines is optimized
+        std::vector<int> line_order; //!< The order of the lines of the pattern, see LineOrderOptimizer::polyOrder
+        std::vector<int> line_start; //!< The starting vertex of each line of the pattern, see LineOrderOptimizer::polyStart
+    };
+
+    /*!
+     * The moves to pre-wipe at one of the pre-wipe locations,
+     * together with the order of the patterns which are printed right after the pre-wipe
+     */
+    struct PreWipeMoves
+    {
+        Point start; //!< Where the wipe starts, just outside of the prime tower
+        Point end; //!< Where the wipe ends, inside of the prime tower
+        std::vector<PatternOrder> pattern_orders; //!< For each pattern the order in which to print it starting from \ref PreWipeMoves::end
+    };
+    std::vector<std::vector<PreWipeMoves>> pre_wipe_moves_per_extruder; //!< For each extruder which pre-wipes the moves for each of the \ref PrimeTower::pre_wipe_locations
+
 public:
     bool enabled; //!< Whether the prime tower is enabled.
     Polygons ground_poly; //!< The outline of the prime tower to be used for each layer
@@ -114,6 +139,34 @@ private:
      */
     void generateWipeLocations(const SliceDataStorage& storage);
 
+    /*!
+     * Generate the pre-wipe moves for each extruder which pre-wipes,
+     * and the order in which to print the patterns from where each pre-wipe ends.
+     * 
+     * The same moves are used on every layer, so they are only computed once.
+     * 
+     * \param storage where to get settings from
+     * Depends on the patterns and the pre-wipe locations being generated
+     */
+    void generatePreWipeMoves(const SliceDataStorage& storage);
+
+    /*!
+     * Optimize the order in which to print a pattern
+     * 
+     * \param pattern The pattern to print
+     * \param start_position The position from where to start printing the \p pattern
+     * \return The order in which to print the \p pattern
+     */
+    static PatternOrder optimizeOrder(const ExtrusionMoves& pattern, Point start_position);
+
+    /*!
+     * Get the index into \ref PrimeTower::pre_wipe_locations where to pre-wipe on a given layer
+     * 
+     * \param layer_nr The layer number
+     * \return The index of the pre-wipe location
+     */
+    unsigned int getPreWipeLocationIdx(const int layer_nr) const;
+
     /*!
      * \see WipeTower::generatePaths
      * 
@@ -133,8 +186,9 @@ private:
      * \param layer_nr The layer for which to generate the prime tower paths
      * \param extruder The extruder we just switched to, with which the prime
      * tower paths should be drawn.
+     * \param pre_wiped Whether the paths are added right after the pre-wipe of this layer
      */
-    void addToGcode_denseInfill(LayerPlan& gcode_layer, const int layer_nr, const int extruder) const;
+    void addToGcode_denseInfill(LayerPlan& gcode_layer, const int layer_nr, const int extruder, const bool pre_wiped) const;
 
     /*!
      * Plan the moves for wiping the current nozzles oozed material before starting to print the prime tower.
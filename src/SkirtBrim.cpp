@@ -3,7 +3,9 @@
 //CuraEngine is released under the terms of the AGPLv3 or higher.
 
 #include "SkirtBrim.h"
+
 #include "support.h"
+#include "utils/ThreadPool.h"
 
 namespace cura 
 {
@@ -15,14 +17,14 @@ void SkirtBrim::getFirstLayerOutline(SliceDataStorage& storage, const unsigned i
     if (is_skirt)
     {
         const bool include_helper_parts = true;
-        first_layer_outline = storage.getLayerOutlines(layer_nr, include_helper_parts, external_only);
+        first_layer_outline = storage.getLayerOutlinesCached(layer_nr, include_helper_parts, external_only);
         first_layer_outline = first_layer_outline.approxConvexHull();
     }
     else
     { // add brim underneath support by removing support where there's brim around the model
         const bool include_helper_parts = false; // include manually below
-        first_layer_outline = storage.getLayerOutlines(layer_nr, include_helper_parts, external_only);
-        first_layer_outline = first_layer_outline.unionPolygons(); //To guard against overlapping outlines, which would produce holes according to the even-odd rule.
+        first_layer_outline = storage.getLayerOutlinesCached(layer_nr, include_helper_parts, external_only);
+        first_layer_outline = first_layer_outline.unionPolygonsInClusters(); //To guard against overlapping outlines, which would produce holes according to the even-odd rule.
         Polygons first_layer_empty_holes;
         if (outside_only)
         {
@@ -67,13 +69,34 @@ void SkirtBrim::getFirstLayerOutline(SliceDataStorage& storage, const unsigned i
 
 int SkirtBrim::generatePrimarySkirtBrimLines(int start_distance, unsigned int primary_line_count, const int primary_extruder_skirt_brim_line_width, const int64_t primary_extruder_minimal_length, const Polygons& first_layer_outline, Polygons& skirt_brim_primary_extruder)
 {
+    const int first_offset_distance = start_distance - primary_extruder_skirt_brim_line_width / 2 + primary_extruder_skirt_brim_line_width;
+
+    // The lines are offsets of the same outline, so they are computed in batches of distances at once.
+    // The distances are distributed over the batches alternately, because the outer lines are longer and take longer to compute.
+    std::vector<Polygons> outer_skirt_brim_lines(primary_line_count);
+    const unsigned int thread_count = ThreadPool::getThreadCount();
+    const int batch_count = std::min(thread_count, primary_line_count);
+    ThreadPool::parallelFor(0, batch_count, [&](int batch_idx)
+    {
+        std::vector<int> offset_distances;
+        for (unsigned int skirt_brim_number = batch_idx; skirt_brim_number < primary_line_count; skirt_brim_number += batch_count)
+        {
+            offset_distances.push_back(first_offset_distance + skirt_brim_number * primary_extruder_skirt_brim_line_width);
+        }
+        std::vector<Polygons> batch_lines = first_layer_outline.offsetMulti(offset_distances, ClipperLib::jtRound);
+        for (unsigned int line_idx = 0; line_idx < batch_lines.size(); line_idx++)
+        {
+            outer_skirt_brim_lines[batch_idx + line_idx * batch_count] = std::move(batch_lines[line_idx]);
+        }
+    });
 
     int offset_distance = start_distance - primary_extruder_skirt_brim_line_width / 2;
+    int64_t total_length = skirt_brim_primary_extruder.polygonLength();
     for (unsigned int skirt_brim_number = 0; skirt_brim_number < primary_line_count; skirt_brim_number++)
     {
         offset_distance += primary_extruder_skirt_brim_line_width;
 
-        Polygons outer_skirt_brim_line = first_layer_outline.offset(offset_distance, ClipperLib::jtRound);
+        Polygons outer_skirt_brim_line = (skirt_brim_number < outer_skirt_brim_lines.size())? std::move(outer_skirt_brim_lines[skirt_brim_number]) : first_layer_outline.offset(offset_distance, ClipperLib::jtRound);
 
         //Remove small inner skirt and brim holes. Holes have a negative area, remove anything smaller then 100x extrusion "area"
         for (unsigned int n = 0; n < outer_skirt_brim_line.size(); n++)
@@ -86,8 +109,9 @@ int SkirtBrim::generatePrimarySkirtBrimLines(int start_distance, unsigned int pr
         }
 
         skirt_brim_primary_extruder.add(outer_skirt_brim_line);
+        total_length += outer_skirt_brim_line.polygonLength();
 
-        int length = skirt_brim_primary_extruder.polygonLength();
+        int length = total_length;
         if (skirt_brim_number + 1 >= primary_line_count && length > 0 && length < primary_extruder_minimal_length) //Make brim or skirt have more lines when total length is too small.
         {
             primary_line_count++;
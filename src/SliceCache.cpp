@@ -0,0 +1,451 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "SliceCache.h"
+
+#include <atomic>
+#include <cinttypes> // PRIx64
+#include <cstdio>
+#include <vector>
+
+#ifdef __WIN32
+#include <process.h> // _getpid
+#else
+#include <unistd.h> // getpid
+#endif
+
+#include "mesh.h"
+#include "slicer.h"
+#include "utils/floatpoint.h"
+#include "utils/logoutput.h"
+
+namespace cura
+{
+
+std::string SliceCache::directory;
+
+namespace
+{
+
+constexpr uint32_t file_magic = 0x43534543; //!< "CESC", also telling apart files written on a machine with another byte order
+constexpr uint32_t file_version = 2; //!< To be incremented whenever the layout of the files or the output of the Slicer changes
+
+/*!
+ * Computes a 64 bit FNV-1a hash of a sequence of values.
+ */
+class Hash
+{
+public:
+    uint64_t value = 14695981039346656037ull;
+
+    void add(int64_t v)
+    {
+        for (unsigned int byte_idx = 0; byte_idx < sizeof(v); byte_idx++)
+        {
+            value = (value ^ static_cast<uint8_t>(v >> (byte_idx * 8))) * 1099511628211ull;
+        }
+    }
+
+    void addBytes(const unsigned char* data, size_t size)
+    {
+        for (size_t byte_idx = 0; byte_idx < size; byte_idx++)
+        {
+            value = (value ^ data[byte_idx]) * 1099511628211ull;
+        }
+    }
+};
+
+/*!
+ * Whether a file starts with the header of a cache file of the current version with the given key.
+ */
+bool hasCacheFileHeader(const std::string& path, uint64_t key)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t file_key = 0;
+    const bool read = fread(&magic, sizeof(magic), 1, file) == 1 && fread(&version, sizeof(version), 1, file) == 1 && fread(&file_key, sizeof(file_key), 1, file) == 1;
+    fclose(file);
+    return read && magic == file_magic && version == file_version && file_key == key;
+}
+
+/*!
+ * Writes a cache file to a temporary file, which replaces the cache file once it is complete.
+ *
+ * The coordinates of the polygons are written as the differences to the previous point in variable length integers,
+ * which takes two or three bytes per coordinate rather than eight.
+ */
+class CacheFileWriter
+{
+public:
+    CacheFileWriter(const std::string& path, uint64_t key)
+    : key(key)
+    , path(path)
+#ifdef __WIN32
+    , temp_path(path + ".tmp" + std::to_string(_getpid()) + "-" + std::to_string(writer_count++))
+#else
+    , temp_path(path + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(writer_count++))
+#endif
+    , file(fopen(temp_path.c_str(), "wb"))
+    , ok(file != nullptr)
+    {
+        write(&file_magic, sizeof(file_magic));
+        write(&file_version, sizeof(file_version));
+        write(&key, sizeof(key));
+    }
+
+    ~CacheFileWriter()
+    {
+        if (file)
+        {
+            ok = fclose(file) == 0 && ok;
+        }
+        if (ok)
+        {
+            if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+            { // rename doesn't replace an existing file on all platforms
+                if (hasCacheFileHeader(path, key))
+                { // another writer stored the same entry first, e.g. another thread loading the same mesh
+                    std::remove(temp_path.c_str());
+                    return;
+                }
+                std::remove(path.c_str()); // an entry of an older version
+                ok = std::rename(temp_path.c_str(), path.c_str()) == 0;
+            }
+        }
+        if (!ok)
+        {
+            std::remove(temp_path.c_str());
+            logWarning("Failed to write %s to the slice cache.\n", path.c_str());
+        }
+    }
+
+    void write(const void* data, size_t size)
+    {
+        ok = ok && fwrite(data, 1, size, file) == size;
+    }
+
+    void writeUnsigned(uint64_t value)
+    {
+        unsigned char buffer[10];
+        unsigned int size = 0;
+        while (value >= 0x80)
+        {
+            buffer[size++] = static_cast<unsigned char>(value) | 0x80;
+            value >>= 7;
+        }
+        buffer[size++] = static_cast<unsigned char>(value);
+        write(buffer, size);
+    }
+
+    void writeSigned(int64_t value)
+    {
+        writeUnsigned((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    void writePolygons(const Polygons& polygons)
+    {
+        writeUnsigned(polygons.size());
+        for (ConstPolygonRef polygon : polygons)
+        {
+            writeUnsigned(polygon.size());
+            Point last(0, 0);
+            for (const Point& point : polygon)
+            {
+                writeSigned(point.X - last.X);
+                writeSigned(point.Y - last.Y);
+                last = point;
+            }
+        }
+    }
+
+private:
+    static std::atomic<unsigned int> writer_count; //!< Numbers the temporary files of the writers of this process, so that threads writing the same entry don't share one
+    const uint64_t key;
+    const std::string path; //!< The cache file
+    const std::string temp_path; //!< The file written to, private to this writer
+    FILE* file;
+    bool ok; //!< Whether everything has been written successfully so far
+};
+
+std::atomic<unsigned int> CacheFileWriter::writer_count(0);
+
+/*!
+ * Reads a cache file written by a CacheFileWriter. All reads fail once a read has failed.
+ */
+class CacheFileReader
+{
+    FILE* file;
+public:
+    CacheFileReader(const std::string& path, uint64_t key)
+    : file(fopen(path.c_str(), "rb"))
+    , ok(file != nullptr)
+    {
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint64_t file_key = 0;
+        read(&magic, sizeof(magic));
+        read(&version, sizeof(version));
+        read(&file_key, sizeof(file_key));
+        ok = ok && magic == file_magic && version == file_version && file_key == key;
+    }
+
+    ~CacheFileReader()
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+    }
+
+    bool ok; //!< Whether everything has been read successfully so far
+
+    bool read(void* data, size_t size)
+    {
+        ok = ok && fread(data, 1, size, file) == size;
+        return ok;
+    }
+
+    uint64_t readUnsigned()
+    {
+        uint64_t value = 0;
+        for (unsigned int shift = 0; ok && shift < 64; shift += 7)
+        {
+            const int byte = getc(file);
+            if (byte == EOF)
+            {
+                ok = false;
+                break;
+            }
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    int64_t readSigned()
+    {
+        const uint64_t value = readUnsigned();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    /*!
+     * Read a count of elements of at least \p element_size bytes, failing if the file can't contain that many of them.
+     */
+    size_t readCount(size_t element_size)
+    {
+        const uint64_t count = readUnsigned();
+        ok = ok && count <= max_count / element_size;
+        return ok? count : 0;
+    }
+
+    void readPolygons(Polygons& polygons)
+    {
+        const size_t polygon_count = readCount(1);
+        for (size_t polygon_idx = 0; polygon_idx < polygon_count && ok; polygon_idx++)
+        {
+            const size_t point_count = readCount(2);
+            PolygonRef polygon = polygons.newPoly();
+            Point last(0, 0);
+            for (size_t point_idx = 0; point_idx < point_count && ok; point_idx++)
+            {
+                last.X += readSigned();
+                last.Y += readSigned();
+                polygon.add(last);
+            }
+        }
+    }
+
+private:
+    static constexpr size_t max_count = size_t(1) << 32; //!< More bytes than any cache file is expected to have, to guard against allocating for a corrupt count
+};
+
+}//namespace
+
+void SliceCache::enable(const std::string& directory)
+{
+    SliceCache::directory = directory;
+}
+
+uint64_t SliceCache::hashMeshGeometry(const Mesh& mesh)
+{
+    Hash hash;
+    hash.add(mesh.vertices.size());
+    for (const MeshVertex& vertex : mesh.vertices)
+    {
+        hash.add(vertex.p.x);
+        hash.add(vertex.p.y);
+        hash.add(vertex.p.z);
+    }
+    hash.add(mesh.faces.size());
+    for (const MeshFace& face : mesh.faces)
+    {
+        hash.add(face.vertex_index[0]);
+        hash.add(face.vertex_index[1]);
+        hash.add(face.vertex_index[2]);
+    }
+    return hash.value;
+}
+
+std::string SliceCache::getPath(const char* kind, uint64_t key)
+{
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/%s-%016" PRIx64 ".bin", kind, key);
+    return directory + filename;
+}
+
+uint64_t SliceCache::getMeshKey(const char* filename, const FMatrix3x3& transformation)
+{
+    if (!isEnabled())
+    {
+        return 0;
+    }
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+    Hash hash;
+    std::vector<unsigned char> buffer(1 << 16);
+    size_t read_size;
+    while ((read_size = fread(buffer.data(), 1, buffer.size(), file)) > 0)
+    {
+        hash.addBytes(buffer.data(), read_size);
+    }
+    const bool read_error = ferror(file);
+    fclose(file);
+    if (read_error)
+    {
+        return 0;
+    }
+    hash.addBytes(reinterpret_cast<const unsigned char*>(transformation.m), sizeof(transformation.m));
+    return hash.value;
+}
+
+bool SliceCache::loadMesh(uint64_t key, Mesh& mesh)
+{
+    if (key == 0)
+    {
+        return false;
+    }
+    CacheFileReader reader(getPath("mesh", key), key);
+    const size_t vertex_count = reader.readCount(sizeof(Point3));
+    std::vector<Point3> vertex_locations(vertex_count);
+    reader.read(vertex_locations.data(), vertex_count * sizeof(Point3));
+    const size_t face_count = reader.readCount(sizeof(MeshFace));
+    mesh.faces.resize(face_count);
+    reader.read(mesh.faces.data(), face_count * sizeof(MeshFace));
+    const size_t vertex_face_count = reader.readCount(sizeof(uint32_t));
+    mesh.vertex_faces.resize(vertex_face_count);
+    reader.read(mesh.vertex_faces.data(), vertex_face_count * sizeof(uint32_t));
+    mesh.vertex_face_start.resize(vertex_count + 1);
+    reader.read(mesh.vertex_face_start.data(), mesh.vertex_face_start.size() * sizeof(uint32_t));
+    reader.read(&mesh.aabb, sizeof(mesh.aabb));
+    if (!reader.ok || face_count == 0 || mesh.vertex_face_start.back() != vertex_face_count)
+    {
+        mesh.clear();
+        return false;
+    }
+    mesh.vertices.reserve(vertex_count);
+    for (const Point3& location : vertex_locations)
+    {
+        mesh.vertices.emplace_back(location);
+    }
+    return true;
+}
+
+void SliceCache::storeMesh(uint64_t key, const Mesh& mesh)
+{
+    if (key == 0)
+    {
+        return;
+    }
+    CacheFileWriter writer(getPath("mesh", key), key);
+    writer.writeUnsigned(mesh.vertices.size());
+    for (const MeshVertex& vertex : mesh.vertices)
+    {
+        writer.write(&vertex.p, sizeof(vertex.p));
+    }
+    writer.writeUnsigned(mesh.faces.size());
+    writer.write(mesh.faces.data(), mesh.faces.size() * sizeof(MeshFace));
+    writer.writeUnsigned(mesh.vertex_faces.size());
+    writer.write(mesh.vertex_faces.data(), mesh.vertex_faces.size() * sizeof(uint32_t));
+    writer.write(mesh.vertex_face_start.data(), mesh.vertex_face_start.size() * sizeof(uint32_t));
+    writer.write(&mesh.aabb, sizeof(mesh.aabb));
+}
+
+uint64_t SliceCache::getSlicesKey(const Mesh& mesh, const std::vector<int>& slice_z, bool keep_none_closed, bool extensive_stitching)
+{
+    if (!isEnabled())
+    {
+        return 0;
+    }
+    Hash hash;
+    hash.add(hashMeshGeometry(mesh));
+    hash.add(slice_z.size());
+    for (int z : slice_z)
+    {
+        hash.add(z);
+    }
+    hash.add(keep_none_closed);
+    hash.add(extensive_stitching);
+    // The settings read by SlicerLayer::makePolygons
+    hash.add(static_cast<int64_t>(mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode")));
+    hash.add(mesh.getSettingInMicrons("xy_offset"));
+    return hash.value;
+}
+
+Slicer* SliceCache::loadSlices(uint64_t key, Mesh* mesh)
+{
+    if (key == 0)
+    {
+        return nullptr;
+    }
+    CacheFileReader reader(getPath("slices", key), key);
+    const size_t layer_count = reader.readCount(3);
+    if (!reader.ok || layer_count == 0)
+    {
+        return nullptr;
+    }
+    Slicer* slicer = new Slicer(mesh);
+    slicer->layers.resize(layer_count);
+    for (SlicerLayer& layer : slicer->layers)
+    {
+        layer.z = reader.readSigned();
+        reader.readPolygons(layer.polygons);
+        reader.readPolygons(layer.openPolylines);
+    }
+    if (!reader.ok)
+    {
+        delete slicer;
+        return nullptr;
+    }
+    mesh->expandXY(mesh->getSettingInMicrons("xy_offset"));
+    return slicer;
+}
+
+void SliceCache::storeSlices(uint64_t key, const Slicer& slicer)
+{
+    if (key == 0)
+    {
+        return;
+    }
+    CacheFileWriter writer(getPath("slices", key), key);
+    writer.writeUnsigned(slicer.layers.size());
+    for (const SlicerLayer& layer : slicer.layers)
+    {
+        writer.writeSigned(layer.z);
+        writer.writePolygons(layer.polygons);
+        writer.writePolygons(layer.openPolylines);
+    }
+}
+
+}//namespace cura
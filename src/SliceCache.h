@@ -0,0 +1,120 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef SLICE_CACHE_H
+#define SLICE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cura
+{
+
+class FMatrix3x3;
+class Mesh;
+class Slicer;
+
+/*!
+ * Keeps the loaded models and the layers sliced from them in files in a directory, so that slicing the same model again,
+ * for instance with other infill or wall settings, skips reading the model file, welding its vertices, connecting its faces and slicing it.
+ *
+ * There are two kinds of files:
+ * - mesh-<key>.bin: the faces and vertices of a model loaded from a file, keyed by the contents of the file and the transformation applied to it.
+ * - slices-<key>.bin: the sliced layers of a mesh, keyed by the vertices and faces of the mesh after it has been positioned on the build plate,
+ *   the height of the layers and the settings used while slicing.
+ *
+ * The files are written to a temporary file which is then renamed, so that several processes can share a directory.
+ * Files which can't be read, or which were written by another version of the format, are ignored and overwritten.
+ *
+ * The cache is off unless SliceCache::enable is called. Otherwise all keys are zero and nothing is looked up.
+ */
+class SliceCache
+{
+public:
+    /*!
+     * Start keeping the models and the sliced layers in \p directory, which must exist.
+     */
+    static void enable(const std::string& directory);
+
+    /*!
+     * Whether SliceCache::enable has been called.
+     */
+    static bool isEnabled()
+    {
+        return !directory.empty();
+    }
+
+    /*!
+     * Hash the locations of the vertices and the vertex indices of the faces of a mesh with 64 bit FNV-1a.
+     */
+    static uint64_t hashMeshGeometry(const Mesh& mesh);
+
+    /*!
+     * Get the key of a model file loaded with a transformation.
+     *
+     * \param filename The model file
+     * \param transformation The transformation applied to the vertices while loading
+     * \return The key, or zero if the cache isn't enabled or the file can't be read
+     */
+    static uint64_t getMeshKey(const char* filename, const FMatrix3x3& transformation);
+
+    /*!
+     * Load the faces and vertices of a model from the cache into an empty mesh.
+     *
+     * \param key The key of the model, see \ref SliceCache::getMeshKey
+     * \param mesh The mesh to load the model into, as it would be after \ref Mesh::finish
+     * \return Whether the model was in the cache
+     */
+    static bool loadMesh(uint64_t key, Mesh& mesh);
+
+    /*!
+     * Write a loaded and finished mesh to the cache.
+     *
+     * \param key The key of the model, see \ref SliceCache::getMeshKey
+     * \param mesh The mesh loaded from the model file
+     */
+    static void storeMesh(uint64_t key, const Mesh& mesh);
+
+    /*!
+     * Get the key of the layers sliced from a mesh, with the parameters of the \ref Slicer.
+     *
+     * \param slice_z For each layer the height at which it is sliced
+     * \return The key, or zero if the cache isn't enabled
+     */
+    static uint64_t getSlicesKey(const Mesh& mesh, const std::vector<int>& slice_z, bool keep_none_closed, bool extensive_stitching);
+
+    /*!
+     * Load the sliced layers of a mesh from the cache.
+     *
+     * The horizontal expansion is registered in the bounding box of \p mesh like the \ref Slicer does.
+     *
+     * \param key The key of the sliced layers, see \ref SliceCache::getSlicesKey
+     * \param mesh The sliced mesh
+     * \return The slicer with the layers, or nullptr if they weren't in the cache
+     */
+    static Slicer* loadSlices(uint64_t key, Mesh* mesh);
+
+    /*!
+     * Write the layers of a slicer to the cache.
+     *
+     * \param key The key of the sliced layers, see \ref SliceCache::getSlicesKey
+     * \param slicer The slicer which has just sliced the mesh
+     */
+    static void storeSlices(uint64_t key, const Slicer& slicer);
+
+private:
+    /*!
+     * Get the file in the cache directory of a key.
+     *
+     * \param kind The kind of file, "mesh" or "slices"
+     * \param key The key
+     */
+    static std::string getPath(const char* kind, uint64_t key);
+
+    static std::string directory; //!< The directory with the cache files, or empty if the cache isn't enabled
+};
+
+}//namespace cura
+
+#endif//SLICE_CACHE_H
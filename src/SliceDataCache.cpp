@@ -0,0 +1,324 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "SliceDataCache.h"
+
+#include <cstring> // strlen
+#include <set>
+#include <sstream>
+
+#include "FffProcessor.h"
+#include "MeshInstances.h"
+#include "SliceCache.h"
+#include "SliceDataSnapshot.h"
+#include "sliceDataStorage.h"
+#include "settings/SettingsTrace.h"
+#include "utils/logoutput.h"
+
+namespace cura
+{
+
+SliceDataCache::SettingStage SliceDataCache::getSettingStage(const std::string& key)
+{
+    static const char* gcode_setting_prefixes[] = {
+        "speed_", "acceleration_", "jerk_", "cool_", "coasting_", "travel_", "switch_extruder_",
+        "material_print_temperature", "material_initial_print_temperature", "material_final_print_temperature",
+        "material_standby_temperature", "material_bed_temperature", "material_extrusion_cool_down_speed",
+        "material_flow_dependent_temperature", "material_flow_temp_graph", "default_material_print_temperature",
+        "machine_start_gcode", "machine_end_gcode", "reuse_slice_data", "compress_layer_geometry", "layer_geometry_memory_budget",
+        "layer_plan_memory_budget", "thread_count_"
+    };
+    static const char* infill_setting_prefixes[] = {
+        "infill_", "gradual_infill_", "spaghetti_", "sub_div_rad_", "min_infill_area"
+    };
+    // modifier meshes and hollow infill change the areas before the skin and infill are generated
+    static const char* infill_area_settings[] = {
+        "infill_mesh", "infill_mesh_order", "infill_hollow"
+    };
+    // support meshes are handled while slicing, and the outlines are recomputed from the outer wall when support is enabled
+    static const char* support_area_settings[] = {
+        "support_mesh", "support_mesh_drop_down", "support_enable"
+    };
+    const auto starts_with = [&key](const char* prefix)
+        {
+            return key.compare(0, strlen(prefix), prefix) == 0;
+        };
+    if (starts_with("retraction_"))
+    { // the z hop decides where the prime tower is wiped
+        return starts_with("retraction_hop")? SettingStage::AREAS : SettingStage::GCODE;
+    }
+    for (const char* prefix : gcode_setting_prefixes)
+    {
+        if (starts_with(prefix))
+        {
+            return SettingStage::GCODE;
+        }
+    }
+    for (const char* prefix : infill_setting_prefixes)
+    {
+        if (starts_with(prefix))
+        {
+            for (const char* area_setting : infill_area_settings)
+            {
+                if (key == area_setting)
+                {
+                    return SettingStage::AREAS;
+                }
+            }
+            return SettingStage::INFILL;
+        }
+    }
+    if (starts_with("support_"))
+    {
+        for (const char* area_setting : support_area_settings)
+        {
+            if (key == area_setting)
+            {
+                return SettingStage::AREAS;
+            }
+        }
+        return SettingStage::SUPPORT;
+    }
+    return SettingStage::AREAS;
+}
+
+SliceDataCache::SettingStage SliceDataCache::getTracedSettingStage(const std::string& key, SettingStage stage)
+{
+    if (stage == SettingStage::AREAS)
+    {
+        return stage;
+    }
+    bool read_by_infill = stage == SettingStage::INFILL;
+    bool read_by_support = stage == SettingStage::SUPPORT;
+    bool read_by_helpers = false;
+    for (const char* trace_stage : SettingsTrace::getStagesReading(key))
+    {
+        const std::string name(trace_stage);
+        if (name == "slicing" || name == "insets")
+        {
+            return SettingStage::AREAS;
+        }
+        read_by_infill |= name == "skin" || name == "infill";
+        read_by_support |= name == "support";
+        read_by_helpers |= name == "helpers";
+    }
+    if (read_by_infill && read_by_support)
+    { // both have to be generated again, which isn't a single stage
+        return SettingStage::AREAS;
+    }
+    if (read_by_infill)
+    {
+        return SettingStage::INFILL;
+    }
+    if (read_by_support || read_by_helpers)
+    { // the helpers are generated again after any stage, but not when only the gcode settings changed
+        return SettingStage::SUPPORT;
+    }
+    return SettingStage::GCODE;
+}
+
+bool SliceDataCache::canRegenerate(const SliceDataStorage& storage)
+{
+    if (storage.removed_empty_first_layer_count > 0)
+    {
+        return false;
+    }
+    for (const SliceMeshStorage& mesh : storage.meshes)
+    {
+        if (mesh.getSettingBoolean("infill_mesh") || mesh.getSettingBoolean("anti_overhang_mesh") || mesh.getSettingBoolean("support_mesh")
+            || mesh.getSettingBoolean("magic_fuzzy_skin_enabled") || mesh.getSettingBoolean("infill_hollow"))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+SliceDataCache::Key SliceDataCache::computeKey(const MeshGroup& meshgroup)
+{
+    Key key;
+    std::ostringstream meshes;
+    meshes << meshgroup.getExtruderCount() << ' ' << meshgroup.meshes.size();
+    for (const Mesh& mesh : meshgroup.meshes)
+    {
+        meshes << ' ' << SliceCache::hashMeshGeometry(mesh);
+    }
+    key.meshes = meshes.str();
+    const std::vector<bool> separate = MeshInstances::findSeparateMeshes(meshgroup);
+    for (unsigned int mesh_idx = 0; mesh_idx < meshgroup.meshes.size(); mesh_idx++)
+    {
+        const Mesh& mesh = meshgroup.meshes[mesh_idx];
+        key.placements.push_back({MeshInstances::hashShape(mesh), mesh.vertices.empty()? Point3(0, 0, 0) : mesh.vertices.front().p, separate[mesh_idx]});
+    }
+    computeSettingsKey(meshgroup, key);
+    return key;
+}
+
+void SliceDataCache::computeSettingsKey(const MeshGroup& meshgroup, Key& key)
+{
+    std::set<std::string> setting_keys;
+    FffProcessor::getInstance()->getLocalSettingKeys(setting_keys);
+    meshgroup.getLocalSettingKeys(setting_keys);
+    std::vector<const SettingsBase*> settings_objects;
+    settings_objects.push_back(&meshgroup);
+    for (int extruder_nr = 0; extruder_nr < meshgroup.getExtruderCount(); extruder_nr++)
+    {
+        settings_objects.push_back(meshgroup.getExtruderTrain(extruder_nr));
+    }
+    for (const Mesh& mesh : meshgroup.meshes)
+    {
+        settings_objects.push_back(&mesh);
+    }
+    for (const SettingsBase* settings : settings_objects)
+    {
+        settings->getLocalSettingKeys(setting_keys);
+    }
+
+    std::ostringstream areas;
+    std::ostringstream infill;
+    std::ostringstream support;
+    // The values as seen by each object, so that settings overridden per extruder or per mesh and limited to an extruder are taken into account.
+    for (const SettingsBase* settings : settings_objects)
+    {
+        areas << '\n';
+        infill << '\n';
+        support << '\n';
+        for (const std::string& setting_key : setting_keys)
+        {
+            SettingStage stage = getSettingStage(setting_key);
+            if (SettingsTrace::isEnabled())
+            {
+                stage = getTracedSettingStage(setting_key, stage);
+            }
+            if (stage == SettingStage::GCODE || !settings->hasSetting(setting_key) || setting_key.compare(0, 14, "mesh_position_") == 0)
+            { // the position of a mesh is part of its vertices
+                continue;
+            }
+            std::ostringstream& result = (stage == SettingStage::INFILL)? infill : (stage == SettingStage::SUPPORT)? support : areas;
+            result << setting_key << '=' << settings->getSettingString(setting_key) << '\n';
+        }
+    }
+    key.areas = areas.str();
+    key.infill = infill.str();
+    key.support = support.str();
+}
+
+bool SliceDataCache::canTranslate(const Key& key) const
+{
+    if (key.placements.size() != this->key.placements.size())
+    {
+        return false;
+    }
+    for (unsigned int mesh_idx = 0; mesh_idx < key.placements.size(); mesh_idx++)
+    {
+        const Key::MeshPlacement& placement = key.placements[mesh_idx];
+        const Key::MeshPlacement& cached_placement = this->key.placements[mesh_idx];
+        if (placement.shape != cached_placement.shape)
+        { // rotated, scaled or another mesh altogether
+            return false;
+        }
+        const Point3 offset = placement.origin - cached_placement.origin;
+        if (offset == Point3(0, 0, 0))
+        {
+            continue;
+        }
+        if (offset.z != 0 || !placement.separate || !cached_placement.separate)
+        { // the layers would be sliced at other heights, or the other meshes carve, overlap or modify it here or there
+            return false;
+        }
+    }
+    return true;
+}
+
+void SliceDataCache::translateMovedMeshes(const Key& key, SliceDataStorage& storage) const
+{
+    unsigned int moved_mesh_count = 0;
+    for (unsigned int mesh_idx = 0; mesh_idx < key.placements.size(); mesh_idx++)
+    {
+        const Point3 offset = key.placements[mesh_idx].origin - this->key.placements[mesh_idx].origin;
+        if (offset == Point3(0, 0, 0))
+        {
+            continue;
+        }
+        SliceMeshStorage& mesh = storage.meshes[mesh_idx];
+        mesh.translate(Point(offset.x, offset.y));
+        delete mesh.base_subdiv_cube; // the octree is built around the mesh where it was, see FffPolygonGenerator::regenerateAreas
+        mesh.base_subdiv_cube = nullptr;
+        moved_mesh_count++;
+    }
+    storage.model_min = storage.meshgroup->min();
+    storage.model_max = storage.meshgroup->max();
+    storage.model_size = storage.model_max - storage.model_min;
+    log("Moving the areas of %u moved meshes of the previous meshgroup.\n", moved_mesh_count);
+}
+
+std::unique_ptr<SliceDataStorage> SliceDataCache::take(const Key& key, MeshGroup* meshgroup, bool& infill_changed, bool& support_changed)
+{
+    if (!storage || key.areas != this->key.areas)
+    {
+        return nullptr;
+    }
+    const bool moved = key.meshes != this->key.meshes;
+    if (moved && !canTranslate(key))
+    {
+        return nullptr;
+    }
+    infill_changed = key.infill != this->key.infill;
+    support_changed = key.support != this->key.support || moved; // the support and the helpers are generated for all meshes together
+    storage->setMeshGroup(meshgroup);
+    if ((infill_changed || support_changed) && !canRegenerate(*storage))
+    {
+        return nullptr;
+    }
+    if (moved)
+    {
+        translateMovedMeshes(key, *storage);
+    }
+    this->key = Key();
+    return std::move(storage);
+}
+
+void SliceDataCache::store(const Key& key, std::unique_ptr<SliceDataStorage> storage)
+{
+    this->key = key;
+    if (SettingsTrace::isEnabled())
+    { // the stages of the settings may have changed while this meshgroup was processed
+        computeSettingsKey(*storage->meshgroup, this->key);
+    }
+    this->storage = std::move(storage);
+}
+
+void SliceDataCache::clear()
+{
+    key = Key();
+    storage.reset();
+}
+
+std::unique_ptr<SliceDataStorage> SliceDataCache::readSnapshot(const std::string& filename, const Key& key, MeshGroup* meshgroup, bool& infill_changed, bool& support_changed)
+{
+    SliceDataSnapshot::Digests snapshot_digests;
+    if (!SliceDataSnapshot::readDigests(filename, snapshot_digests))
+    {
+        return nullptr;
+    }
+    const SliceDataSnapshot::Digests digests = SliceDataSnapshot::Digests::of(key);
+    if (digests.meshes != snapshot_digests.meshes || digests.areas != snapshot_digests.areas)
+    {
+        return nullptr;
+    }
+    infill_changed = digests.infill != snapshot_digests.infill;
+    support_changed = digests.support != snapshot_digests.support;
+    std::unique_ptr<SliceDataStorage> storage = SliceDataSnapshot::read(filename, meshgroup);
+    if (!storage || ((infill_changed || support_changed) && !canRegenerate(*storage)))
+    {
+        return nullptr;
+    }
+    return storage;
+}
+
+void SliceDataCache::writeSnapshot(const std::string& filename, const Key& key, const SliceDataStorage& storage)
+{
+    SliceDataSnapshot::write(filename, SliceDataSnapshot::Digests::of(key), storage);
+}
+
+}//namespace cura
@@ -0,0 +1,195 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef SLICE_DATA_CACHE_H
+#define SLICE_DATA_CACHE_H
+
+#include <memory> // unique_ptr
+#include <string>
+#include <vector>
+
+#include "utils/intpoint.h"
+#include "utils/NoCopy.h"
+
+namespace cura
+{
+
+class MeshGroup;
+class SliceDataStorage;
+
+/*!
+ * Keeps the areas generated for the last meshgroup, so that the gcode of a next meshgroup with the same meshes
+ * which only differs in the settings used while writing the gcode can be written without slicing it again.
+ *
+ * These settings are the speeds, accelerations, jerk, temperatures, cooling, retraction (except z hop),
+ * coasting and travel settings and the start and end gcode, which are only read by \ref FffGcodeWriter
+ * and the path configs, not while generating the areas.
+ *
+ * When also infill or support settings differ, the walls are reused and only the skin and infill areas or the support areas
+ * are generated again, together with everything computed after them; see \ref FffPolygonGenerator::regenerateAreas
+ *
+ * When meshes have only been moved horizontally, like when an object is moved on the build plate, the areas of these meshes are moved along
+ * and only the support and the helpers are generated again, provided that the moved meshes keep clear of the other meshes; see \ref MeshInstances::findSeparateMeshes
+ *
+ * When the settings are traced, the stages of the settings are checked against the stages which actually read them, see \ref SettingsTrace.
+ *
+ * Only used when the setting reuse_slice_data is enabled.
+ * The layers of the cached areas are then kept while writing the gcode, so these slices use more memory.
+ */
+class SliceDataCache : NoCopy
+{
+public:
+    /*!
+     * The values of the settings of a meshgroup which affect its areas, divided by the stages which read them.
+     */
+    struct Key
+    {
+        /*!
+         * Where a mesh is, so that a mesh which has only been moved can be recognized.
+         */
+        struct MeshPlacement
+        {
+            uint64_t shape; //!< The hash of the vertices and faces of the mesh, relative to its first vertex, see \ref MeshInstances::hashShape
+            Point3 origin; //!< The first vertex of the mesh
+            bool separate; //!< Whether the areas of the mesh only depend on its own shape and settings, see \ref MeshInstances::findSeparateMeshes
+        };
+
+        std::string meshes; //!< The vertices and faces of the meshes
+        std::vector<MeshPlacement> placements; //!< For each mesh where it is
+        std::string areas; //!< The settings of the slicing and the walls, and all other settings which aren't in one of the stages below
+        std::string infill; //!< The settings of the infill, read while generating the skin and infill areas and the areas derived from them
+        std::string support; //!< The settings of the support, read while generating the support areas
+    };
+
+    /*!
+     * Compute the key identifying the areas of a meshgroup: its vertices and faces
+     * and the values of all settings of the meshgroup, its extruders and its meshes which affect the areas.
+     *
+     * Must be called before the meshgroup is sliced, since that clears the meshes.
+     *
+     * \param meshgroup The meshgroup of which to compute the key
+     */
+    static Key computeKey(const MeshGroup& meshgroup);
+
+    /*!
+     * Take the cached areas, if they were generated for a meshgroup with the same key
+     * or with a key which only differs in stages which can be generated again on the cached areas.
+     *
+     * The areas then take their settings from \p meshgroup.
+     *
+     * \param key The key of \p meshgroup, see \ref SliceDataCache::computeKey
+     * \param meshgroup The meshgroup to write the gcode of
+     * \param[out] infill_changed Whether the skin and infill areas have to be generated again
+     * \param[out] support_changed Whether the support areas have to be generated again
+     * \return The areas, or nullptr if the cached areas can't be used
+     */
+    std::unique_ptr<SliceDataStorage> take(const Key& key, MeshGroup* meshgroup, bool& infill_changed, bool& support_changed);
+
+    /*!
+     * Keep the areas of a meshgroup of which the gcode has been written, replacing the areas cached before.
+     *
+     * \param key The key of the meshgroup of \p storage
+     * \param storage The areas, of which the layers must have been kept while writing the gcode
+     */
+    void store(const Key& key, std::unique_ptr<SliceDataStorage> storage);
+
+    /*!
+     * Free the cached areas.
+     */
+    void clear();
+
+    /*!
+     * Read the areas of a meshgroup from a snapshot file written by \ref SliceDataCache::writeSnapshot,
+     * if they were generated for a meshgroup with the same key or with a key which only differs in stages which can be generated again,
+     * like \ref SliceDataCache::take
+     *
+     * The helper areas aren't part of the snapshot, so these must be generated again in any case, see \ref FffPolygonGenerator::regenerateAreas
+     *
+     * \param filename The snapshot file, see \ref SliceDataSnapshot
+     * \param key The key of \p meshgroup, see \ref SliceDataCache::computeKey
+     * \param meshgroup The meshgroup to write the gcode of
+     * \param[out] infill_changed Whether the skin and infill areas have to be generated again
+     * \param[out] support_changed Whether the support areas have to be generated again
+     * \return The areas, or nullptr if there is no usable snapshot in the file
+     */
+    static std::unique_ptr<SliceDataStorage> readSnapshot(const std::string& filename, const Key& key, MeshGroup* meshgroup, bool& infill_changed, bool& support_changed);
+
+    /*!
+     * Write the areas of a meshgroup to a snapshot file, see \ref SliceDataSnapshot
+     *
+     * \param filename The snapshot file
+     * \param key The key of the meshgroup of \p storage
+     * \param storage The areas, which must have been generated but not yet have been used to write gcode
+     */
+    static void writeSnapshot(const std::string& filename, const Key& key, const SliceDataStorage& storage);
+
+private:
+    /*!
+     * The part of the key a setting belongs to
+     */
+    enum class SettingStage
+    {
+        AREAS,
+        INFILL,
+        SUPPORT,
+        GCODE //!< Only used while writing the gcode, so that it isn't part of the key
+    };
+
+    /*!
+     * Get the part of the key a setting belongs to.
+     */
+    static SettingStage getSettingStage(const std::string& key);
+
+    /*!
+     * Correct the stage of a setting found from its name with the stages which have read it so far, see \ref SettingsTrace.
+     *
+     * The stage is only ever moved to an earlier stage: a setting read while slicing or generating the walls,
+     * or read by both the skin and infill and the support, belongs to the areas,
+     * and a gcode setting read while generating the helper areas belongs to the support, after which these are generated again.
+     *
+     * \param key The setting
+     * \param stage The stage found by \ref SliceDataCache::getSettingStage
+     */
+    static SettingStage getTracedSettingStage(const std::string& key, SettingStage stage);
+
+    /*!
+     * Compute the parts of a key with the values of the settings of a meshgroup, its extruders and its meshes.
+     *
+     * \param meshgroup The meshgroup of which to compute the key
+     * \param[in,out] key The key of which to compute all parts except the meshes
+     */
+    static void computeSettingsKey(const MeshGroup& meshgroup, Key& key);
+
+    /*!
+     * Whether the stages of the areas of a meshgroup can be generated again on the areas generated before.
+     *
+     * That isn't possible when a stage changed areas which were generated before it in a way that can't be undone:
+     * fuzzy skin and hollow infill change the outlines, modifier meshes change the areas of other meshes,
+     * and removing the empty first layers changes the layers below the support.
+     *
+     * \param storage The cached areas
+     */
+    static bool canRegenerate(const SliceDataStorage& storage);
+
+    /*!
+     * Whether the meshes of a meshgroup are the meshes of the cached areas, of which some have only been moved horizontally while keeping clear of the other meshes.
+     *
+     * \param key The key of the meshgroup
+     */
+    bool canTranslate(const Key& key) const;
+
+    /*!
+     * Move the areas of the meshes which have been moved since the cached areas were generated.
+     *
+     * \param key The key of the meshgroup to which the meshes have been moved
+     * \param storage The cached areas, which take their settings from the meshgroup of \p key
+     */
+    void translateMovedMeshes(const Key& key, SliceDataStorage& storage) const;
+
+    Key key; //!< The key of the cached areas
+    std::unique_ptr<SliceDataStorage> storage; //!< The cached areas. Their settings refer to a meshgroup which has been deleted, until they are taken.
+};
+
+}//namespace cura
+
+#endif//SLICE_DATA_CACHE_H
@@ -0,0 +1,410 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "SliceDataSnapshot.h"
+
+#include <algorithm> // max
+#include <cstdio>
+#include <vector>
+
+#ifdef __WIN32
+#include <process.h> // _getpid
+#else
+#include <unistd.h> // getpid
+#endif
+
+#include "sliceDataStorage.h"
+#include "utils/CompressedGeometry.h"
+#include "utils/ThreadPool.h"
+#include "utils/logoutput.h"
+
+namespace cura
+{
+
+namespace
+{
+
+constexpr uint32_t snapshot_magic = 0x44534543; //!< "CESD", also telling apart files written on a machine with another byte order
+constexpr uint32_t snapshot_version = 1; //!< To be incremented whenever the layout of the file or the areas it holds change
+
+/*!
+ * The start of a snapshot file.
+ */
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t digests[4]; //!< The \ref SliceDataSnapshot::Digests of the meshes, areas, infill and support
+    uint64_t layer_count; //!< The number of entries in the layer table
+    uint64_t storage_size; //!< The size of the storage block, which follows the header
+    uint64_t storage_digest; //!< The hash of the storage block
+};
+
+/*!
+ * Where the block of a layer is in a snapshot file. The table of these follows the storage block.
+ */
+struct LayerEntry
+{
+    uint64_t offset; //!< From the start of the file
+    uint64_t size;
+    uint64_t digest; //!< The hash of the block, to tell a damaged file apart
+};
+
+uint64_t hashBytes(const uint8_t* data, size_t size)
+{
+    uint64_t value = 14695981039346656037ull;
+    for (size_t byte_idx = 0; byte_idx < size; byte_idx++)
+    {
+        value = (value ^ data[byte_idx]) * 1099511628211ull;
+    }
+    return value;
+}
+
+uint64_t hashString(const std::string& string)
+{
+    return hashBytes(reinterpret_cast<const uint8_t*>(string.data()), string.size());
+}
+
+/*!
+ * The number of layers of which a storage has areas: of the meshes, of the support and the printed layers.
+ */
+size_t getLayerCount(const SliceDataStorage& storage)
+{
+    size_t layer_count = std::max(static_cast<size_t>(storage.print_layer_count), storage.support.supportLayers.size());
+    for (const SliceMeshStorage& mesh : storage.meshes)
+    {
+        layer_count = std::max(layer_count, mesh.layers.size());
+    }
+    return layer_count;
+}
+
+void writeStorage(CompressedGeometryWriter& writer, const SliceDataStorage& storage)
+{
+    writer.writeUnsigned(storage.print_layer_count);
+    writer.writeUnsigned(storage.layer_thicknesses.size());
+    for (coord_t thickness : storage.layer_thicknesses)
+    {
+        writer.writeSigned(thickness);
+    }
+    for (const Point3& point : { storage.model_min, storage.model_max })
+    {
+        writer.writeSigned(point.x);
+        writer.writeSigned(point.y);
+        writer.writeSigned(point.z);
+    }
+    writer.writeUnsigned(storage.removed_empty_first_layer_count);
+    writer.writeUnsigned(storage.meshes.size());
+    for (const SliceMeshStorage& mesh : storage.meshes)
+    {
+        writer.writeUnsigned(mesh.layers.size());
+        writer.writeSigned(mesh.layer_nr_max_filled_layer);
+        writer.writeSigned(mesh.layer_nr_min_filled_layer);
+    }
+    writer.writeUnsigned(storage.support.generated ? 1 : 0);
+    writer.writeSigned(storage.support.layer_nr_max_filled_layer);
+    writer.writeUnsigned(storage.support.supportLayers.size());
+}
+
+/*!
+ * Read the storage block into a new storage, of which the layers are created but left empty.
+ *
+ * \return Whether the block fits the meshgroup and the number of layers in the file
+ */
+bool readStorage(CompressedGeometryReader& reader, SliceDataStorage& storage, MeshGroup* meshgroup, size_t layer_count)
+{
+    storage.print_layer_count = reader.readUnsigned();
+    const size_t thickness_count = reader.readUnsigned();
+    if (storage.print_layer_count > layer_count || thickness_count > layer_count)
+    {
+        return false;
+    }
+    storage.layer_thicknesses.resize(thickness_count);
+    for (coord_t& thickness : storage.layer_thicknesses)
+    {
+        thickness = reader.readSigned();
+    }
+    for (Point3* point : { &storage.model_min, &storage.model_max })
+    {
+        point->x = reader.readSigned();
+        point->y = reader.readSigned();
+        point->z = reader.readSigned();
+    }
+    storage.model_size = storage.model_max - storage.model_min;
+    storage.removed_empty_first_layer_count = reader.readUnsigned();
+    if (reader.readUnsigned() != meshgroup->meshes.size())
+    {
+        return false;
+    }
+    storage.meshes.reserve(meshgroup->meshes.size()); // no reallocation, as in FffPolygonGenerator::sliceModel
+    for (unsigned int mesh_idx = 0; mesh_idx < meshgroup->meshes.size(); mesh_idx++)
+    {
+        const size_t mesh_layer_count = reader.readUnsigned();
+        if (mesh_layer_count > layer_count)
+        {
+            return false;
+        }
+        storage.meshes.emplace_back(&meshgroup->meshes[mesh_idx], mesh_layer_count);
+        SliceMeshStorage& mesh = storage.meshes.back();
+        mesh.layer_nr_max_filled_layer = reader.readSigned();
+        mesh.layer_nr_min_filled_layer = reader.readSigned();
+    }
+    storage.support.generated = reader.readUnsigned() != 0;
+    storage.support.layer_nr_max_filled_layer = reader.readSigned();
+    const size_t support_layer_count = reader.readUnsigned();
+    if (support_layer_count > layer_count)
+    {
+        return false;
+    }
+    storage.support.supportLayers.resize(support_layer_count);
+    return reader.atEnd();
+}
+
+void writeLayer(CompressedGeometryWriter& writer, const SliceDataStorage& storage, size_t layer_nr)
+{
+    for (const SliceMeshStorage& mesh : storage.meshes)
+    {
+        if (layer_nr >= mesh.layers.size())
+        {
+            continue;
+        }
+        const SliceLayer& layer = mesh.layers[layer_nr];
+        writer.writeSigned(layer.sliceZ);
+        writer.writeSigned(layer.printZ);
+        writer.writePolygons(layer.openPolyLines);
+        writer.writeUnsigned(layer.parts.size());
+        for (size_t part_idx = 0; part_idx < layer.parts.size(); part_idx++)
+        {
+            const SliceLayerPart& part = layer.parts[part_idx];
+            writer.writeSigned(part.boundaryBox.min.X);
+            writer.writeSigned(part.boundaryBox.min.Y);
+            writer.writeSigned(part.boundaryBox.max.X);
+            writer.writeSigned(part.boundaryBox.max.Y);
+            writer.writePolygons(part.print_outline.toPolygons());
+            if (!layer.geometry_compressed)
+            {
+                part.writeGeometry(writer);
+            }
+            else
+            { // the compressed data continues from another last point, so it can't be copied as is
+                SliceLayerPart decompressed = part;
+                storage.getCompressedGeometry(layer, part_idx, decompressed.compressed_geometry); // it may have been moved to a temporary file
+                decompressed.decompressGeometry();
+                decompressed.writeGeometry(writer);
+            }
+        }
+    }
+    if (layer_nr < storage.support.supportLayers.size())
+    {
+        const SupportLayer& support_layer = storage.support.supportLayers[layer_nr];
+        writer.writePolygons(support_layer.supportAreas);
+        writer.writePolygons(support_layer.support_bottom);
+        writer.writePolygons(support_layer.support_roof);
+        writer.writePolygons(support_layer.support_mesh_drop_down);
+        writer.writePolygons(support_layer.support_mesh);
+        writer.writePolygons(support_layer.anti_overhang);
+    }
+}
+
+void readLayer(CompressedGeometryReader& reader, SliceDataStorage& storage, size_t layer_nr)
+{
+    for (SliceMeshStorage& mesh : storage.meshes)
+    {
+        if (layer_nr >= mesh.layers.size())
+        {
+            continue;
+        }
+        SliceLayer& layer = mesh.layers[layer_nr];
+        layer.sliceZ = reader.readSigned();
+        layer.printZ = reader.readSigned();
+        reader.readPolygons(layer.openPolyLines);
+        layer.parts.resize(reader.readUnsigned());
+        for (SliceLayerPart& part : layer.parts)
+        {
+            part.boundaryBox.min.X = reader.readSigned();
+            part.boundaryBox.min.Y = reader.readSigned();
+            part.boundaryBox.max.X = reader.readSigned();
+            part.boundaryBox.max.Y = reader.readSigned();
+            Polygons print_outline;
+            reader.readPolygons(print_outline);
+            part.print_outline = CompactPolygons(print_outline);
+            part.readGeometry(reader);
+        }
+    }
+    if (layer_nr < storage.support.supportLayers.size())
+    {
+        SupportLayer& support_layer = storage.support.supportLayers[layer_nr];
+        reader.readPolygons(support_layer.supportAreas);
+        reader.readPolygons(support_layer.support_bottom);
+        reader.readPolygons(support_layer.support_roof);
+        reader.readPolygons(support_layer.support_mesh_drop_down);
+        reader.readPolygons(support_layer.support_mesh);
+        reader.readPolygons(support_layer.anti_overhang);
+    }
+}
+
+}//namespace
+
+SliceDataSnapshot::Digests SliceDataSnapshot::Digests::of(const SliceDataCache::Key& key)
+{
+    Digests digests;
+    digests.meshes = hashString(key.meshes);
+    digests.areas = hashString(key.areas);
+    digests.infill = hashString(key.infill);
+    digests.support = hashString(key.support);
+    return digests;
+}
+
+bool SliceDataSnapshot::write(const std::string& filename, const Digests& digests, const SliceDataStorage& storage)
+{
+    std::vector<uint8_t> storage_block;
+    CompressedGeometryWriter storage_writer(storage_block);
+    writeStorage(storage_writer, storage);
+
+    const size_t layer_count = getLayerCount(storage);
+    std::vector<std::vector<uint8_t>> layer_blocks(layer_count);
+    ThreadPool::parallelFor(0, static_cast<int>(layer_count), [&](int layer_nr)
+    {
+        CompressedGeometryWriter writer(layer_blocks[layer_nr]);
+        writeLayer(writer, storage, layer_nr);
+    });
+    if (ThreadPool::isCancelled())
+    {
+        return false;
+    }
+
+    SnapshotHeader header;
+    header.magic = snapshot_magic;
+    header.version = snapshot_version;
+    header.digests[0] = digests.meshes;
+    header.digests[1] = digests.areas;
+    header.digests[2] = digests.infill;
+    header.digests[3] = digests.support;
+    header.layer_count = layer_count;
+    header.storage_size = storage_block.size();
+    header.storage_digest = hashBytes(storage_block.data(), storage_block.size());
+
+    std::vector<LayerEntry> layer_table(layer_count);
+    uint64_t offset = sizeof(SnapshotHeader) + storage_block.size() + layer_count * sizeof(LayerEntry);
+    for (size_t layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        layer_table[layer_nr].offset = offset;
+        layer_table[layer_nr].size = layer_blocks[layer_nr].size();
+        layer_table[layer_nr].digest = hashBytes(layer_blocks[layer_nr].data(), layer_blocks[layer_nr].size());
+        offset += layer_blocks[layer_nr].size();
+    }
+
+#ifdef __WIN32
+    const std::string temp_filename = filename + ".tmp" + std::to_string(_getpid());
+#else
+    const std::string temp_filename = filename + ".tmp" + std::to_string(getpid());
+#endif
+    FILE* file = fopen(temp_filename.c_str(), "wb");
+    bool ok = file != nullptr;
+    const auto write_data = [&](const void* data, size_t size)
+        {
+            ok = ok && (size == 0 || fwrite(data, 1, size, file) == size);
+        };
+    write_data(&header, sizeof(header));
+    write_data(storage_block.data(), storage_block.size());
+    write_data(layer_table.data(), layer_table.size() * sizeof(LayerEntry));
+    for (const std::vector<uint8_t>& layer_block : layer_blocks)
+    {
+        write_data(layer_block.data(), layer_block.size());
+    }
+    if (file)
+    {
+        ok = fclose(file) == 0 && ok;
+    }
+    if (ok && std::rename(temp_filename.c_str(), filename.c_str()) != 0)
+    { // rename doesn't replace an existing file on all platforms
+        std::remove(filename.c_str());
+        ok = std::rename(temp_filename.c_str(), filename.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        std::remove(temp_filename.c_str());
+        logWarning("Failed to write the snapshot of the areas to %s.\n", filename.c_str());
+    }
+    return ok;
+}
+
+bool SliceDataSnapshot::readDigests(const std::string& filename, Digests& digests)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    SnapshotHeader header;
+    const bool ok = fread(&header, 1, sizeof(header), file) == sizeof(header)
+        && header.magic == snapshot_magic && header.version == snapshot_version;
+    fclose(file);
+    if (ok)
+    {
+        digests.meshes = header.digests[0];
+        digests.areas = header.digests[1];
+        digests.infill = header.digests[2];
+        digests.support = header.digests[3];
+    }
+    return ok;
+}
+
+std::unique_ptr<SliceDataStorage> SliceDataSnapshot::read(const std::string& filename, MeshGroup* meshgroup)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        return nullptr;
+    }
+    bool ok = true;
+    const auto read_data = [&](void* data, size_t size)
+        {
+            ok = ok && (size == 0 || fread(data, 1, size, file) == size);
+        };
+    constexpr uint64_t max_size = uint64_t(1) << 40; //!< More bytes than any snapshot is expected to have, to guard against allocating for a damaged size
+    SnapshotHeader header;
+    read_data(&header, sizeof(header));
+    ok = ok && header.magic == snapshot_magic && header.version == snapshot_version
+        && header.storage_size < max_size && header.layer_count < max_size / sizeof(LayerEntry);
+
+    std::vector<uint8_t> storage_block(ok ? header.storage_size : 0);
+    read_data(storage_block.data(), storage_block.size());
+    std::vector<LayerEntry> layer_table(ok ? header.layer_count : 0);
+    read_data(layer_table.data(), layer_table.size() * sizeof(LayerEntry));
+    std::vector<std::vector<uint8_t>> layer_blocks(layer_table.size());
+    for (size_t layer_nr = 0; layer_nr < layer_table.size() && ok; layer_nr++)
+    {
+        const LayerEntry& entry = layer_table[layer_nr];
+        ok = entry.size < max_size && fseek(file, entry.offset, SEEK_SET) == 0;
+        layer_blocks[layer_nr].resize(ok ? entry.size : 0);
+        read_data(layer_blocks[layer_nr].data(), layer_blocks[layer_nr].size());
+        ok = ok && hashBytes(layer_blocks[layer_nr].data(), layer_blocks[layer_nr].size()) == entry.digest;
+    }
+    fclose(file);
+    if (!ok || hashBytes(storage_block.data(), storage_block.size()) != header.storage_digest)
+    {
+        logWarning("The snapshot of the areas in %s can't be read or is damaged.\n", filename.c_str());
+        return nullptr;
+    }
+
+    std::unique_ptr<SliceDataStorage> storage(new SliceDataStorage(meshgroup));
+    CompressedGeometryReader storage_reader(storage_block);
+    if (!readStorage(storage_reader, *storage, meshgroup, layer_table.size()))
+    {
+        logWarning("The snapshot of the areas in %s doesn't fit the meshgroup.\n", filename.c_str());
+        return nullptr;
+    }
+    ThreadPool::parallelFor(0, static_cast<int>(layer_blocks.size()), [&](int layer_nr)
+    {
+        CompressedGeometryReader reader(layer_blocks[layer_nr]);
+        readLayer(reader, *storage, layer_nr);
+        std::vector<uint8_t>().swap(layer_blocks[layer_nr]);
+    });
+    if (ThreadPool::isCancelled())
+    {
+        return nullptr;
+    }
+    return storage;
+}
+
+}//namespace cura
@@ -0,0 +1,86 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef SLICE_DATA_SNAPSHOT_H
+#define SLICE_DATA_SNAPSHOT_H
+
+#include <cstdint>
+#include <memory> // unique_ptr
+#include <string>
+
+#include "SliceDataCache.h"
+
+namespace cura
+{
+
+class MeshGroup;
+class SliceDataStorage;
+
+/*!
+ * Writes the areas generated for a meshgroup to a file and reads them back, so that the gcode can be written from them
+ * in another run of the engine, on another machine, or with other gcode settings, without slicing the meshgroup again.
+ *
+ * A snapshot holds the areas as they are after \ref FffPolygonGenerator::generateAreas: the layers of all meshes and the support areas.
+ * The helper areas (skirt, brim, raft, shields and prime tower) aren't part of it; these are generated again after reading it,
+ * see \ref FffPolygonGenerator::regenerateAreas
+ *
+ * The file consists of:
+ * - A header of fixed size: a magic number, the version of the format, a digest of each part of the \ref SliceDataCache::Key,
+ *   the number of layers and the size of the storage block.
+ * - The storage block: the layer count and thicknesses, the model bounds, and per mesh and for the support the number of layers and the filled layers.
+ * - A table with for each layer the offset, the size and the digest of its block, so that each layer can be found without reading the others.
+ * - For each layer a block with that layer of all meshes and of the support, encoded by a CompressedGeometryWriter of its own.
+ *
+ * The numbers in the header and the table are written in the byte order of the machine, which the magic number tells apart.
+ */
+class SliceDataSnapshot
+{
+public:
+    /*!
+     * The 64 bit FNV-1a hashes of the parts of a \ref SliceDataCache::Key, by which a snapshot is matched to a meshgroup.
+     */
+    struct Digests
+    {
+        uint64_t meshes;
+        uint64_t areas;
+        uint64_t infill;
+        uint64_t support;
+
+        /*!
+         * Compute the digests of a key.
+         */
+        static Digests of(const SliceDataCache::Key& key);
+    };
+
+    /*!
+     * Write the areas of a meshgroup to a file, replacing it once it's complete.
+     *
+     * \param filename The file to write to
+     * \param digests The digests of the key of the meshgroup of \p storage
+     * \param storage The areas, which must have been generated but not yet have been used to write gcode
+     * \return Whether the file could be written
+     */
+    static bool write(const std::string& filename, const Digests& digests, const SliceDataStorage& storage);
+
+    /*!
+     * Read the digests of the key of the meshgroup of which the areas are in a file.
+     *
+     * \param filename The file to read from
+     * \param[out] digests The digests
+     * \return Whether the file is a snapshot which was written by this version of the format
+     */
+    static bool readDigests(const std::string& filename, Digests& digests);
+
+    /*!
+     * Read the areas in a file into a new storage for a meshgroup.
+     *
+     * \param filename The file to read from
+     * \param meshgroup The meshgroup the areas are read for, which must have the meshes of which the areas were written
+     * \return The areas, or nullptr if the file can't be read or is damaged
+     */
+    static std::unique_ptr<SliceDataStorage> read(const std::string& filename, MeshGroup* meshgroup);
+};
+
+}//namespace cura
+
+#endif//SLICE_DATA_SNAPSHOT_H
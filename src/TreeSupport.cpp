@@ -0,0 +1,297 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include <cmath> // tan, sin, cos
+#include <limits>
+
+#include "TreeSupport.h"
+
+#include "support.h" // computeBasicAndFullOverhang
+#include "progress/Progress.h"
+#include "utils/math.h"
+#include "utils/polygonUtils.h"
+#include "utils/SparsePointGridInclusive.h"
+#include "utils/ThreadPool.h"
+
+namespace cura
+{
+
+namespace
+{
+
+constexpr unsigned int circle_resolution = 12; //!< The number of vertices of the circles around the branches
+
+coord_t getSettingInMicronsOr(const SettingsBaseVirtual& settings, const std::string& key, const coord_t default_value)
+{
+    return settings.hasSetting(key) ? settings.getSettingInMicrons(key) : default_value;
+}
+
+double getSettingInAngleRadiansOr(const SettingsBaseVirtual& settings, const std::string& key, const double default_value)
+{
+    return settings.hasSetting(key) ? settings.getSettingInAngleRadians(key) : default_value;
+}
+
+}//namespace
+
+bool TreeSupport::isEnabled(const SettingsBaseVirtual& mesh)
+{
+    return mesh.hasSetting("support_structure") && mesh.getSettingString("support_structure") == "tree";
+}
+
+void TreeSupport::generateSupportAreas(SliceDataStorage& storage, const SettingsBaseVirtual& infill_settings, unsigned int mesh_idx, unsigned int layer_count, std::vector<Polygons>& supportAreas)
+{
+    const SliceMeshStorage& mesh = storage.meshes[mesh_idx];
+
+    // given settings
+    const ESupportType support_type = storage.getSettingAsSupportType("support_type");
+    if (!mesh.getSettingBoolean("support_enable") || support_type == ESupportType::NONE)
+    {
+        return;
+    }
+    const bool support_on_buildplate_only = support_type == ESupportType::PLATFORM_ONLY;
+
+    const coord_t layer_height = storage.getSettingInMicrons("layer_height");
+    const double support_angle = infill_settings.getSettingInAngleRadians("support_angle");
+    const coord_t z_distance_top = infill_settings.getSettingInMicrons("support_top_distance");
+    const coord_t z_distance_bottom = infill_settings.getSettingInMicrons("support_bottom_distance");
+    const coord_t xy_distance = infill_settings.getSettingInMicrons("support_xy_distance");
+    const coord_t line_width = infill_settings.getSettingInMicrons("support_line_width");
+
+    const double branch_angle = std::min(getSettingInAngleRadiansOr(mesh, "support_tree_angle", M_PI / 180 * 40), M_PI / 180 * 85);
+    const coord_t branch_radius = std::max(line_width, getSettingInMicronsOr(mesh, "support_tree_branch_diameter", MM2INT(2.0))) / 2;
+    const double branch_diameter_angle = getSettingInAngleRadiansOr(mesh, "support_tree_branch_diameter_angle", M_PI / 180 * 5);
+    const coord_t branch_distance = std::max(line_width, getSettingInMicronsOr(mesh, "support_tree_branch_distance", MM2INT(1.0)));
+
+    // derived settings
+    const unsigned int z_distance_top_layers = round_up_divide(std::max(static_cast<coord_t>(0), z_distance_top), layer_height) + 1; // support must always be 1 layer below overhang
+    const unsigned int z_distance_bottom_layers = round_up_divide(std::max(static_cast<coord_t>(0), z_distance_bottom), layer_height); // number of empty layers between support and model
+    const coord_t max_move = tan(branch_angle) * layer_height; // the furthest a branch may move sideways per layer
+    const double radius_growth = tan(branch_diameter_angle) * layer_height; // the increase in radius of a branch per layer it descends
+    const coord_t max_dist_from_lower_layer = (tan(support_angle) - 0.01) * layer_height; // max dist which can be bridged
+    const coord_t merge_search_radius = std::max(branch_distance, 2 * branch_radius) * 3; // the distance within which branches move toward each other
+    const coord_t collision_distance = xy_distance + branch_radius; // how far the center of a branch is kept away from the model
+    const unsigned int tip_layers = branch_radius / layer_height; // the number of layers over which a branch widens from its tip to its normal radius
+    auto getRadius = [&](const unsigned int distance_to_top) -> coord_t
+    {
+        if (distance_to_top < tip_layers)
+        {
+            return line_width / 2 + (branch_radius - line_width / 2) * distance_to_top / tip_layers;
+        }
+        return branch_radius + (distance_to_top - tip_layers) * radius_growth;
+    };
+
+    if (z_distance_top_layers + 1 > layer_count)
+    {
+        return;
+    }
+
+    // compute the areas to avoid, once per layer
+    std::vector<const Polygons*> model_outlines(layer_count);
+    std::vector<const Polygons*> collision(layer_count);
+    ThreadPool::parallelFor(0, static_cast<int>(layer_count), [&](int layer_idx)
+    {
+        model_outlines[layer_idx] = &storage.getLayerOutlinesCached(layer_idx, false);
+        collision[layer_idx] = &storage.getLayerOutlinesCached(layer_idx, false, false, collision_distance);
+    });
+
+    // place the tips of the branches in the overhang areas; the tips of a support layer support the overhang z_distance_top_layers above it
+    std::vector<std::vector<Point>> contact_points(layer_count);
+    ThreadPool::parallelFor(0, static_cast<int>(layer_count - z_distance_top_layers), [&](int layer_idx)
+    {
+        Polygons overhang = AreaSupport::computeBasicAndFullOverhang(storage, mesh, layer_idx + z_distance_top_layers, max_dist_from_lower_layer).first;
+        overhang.removeSmallAreas(INT2MM(line_width) * INT2MM(line_width));
+        generateContactPoints(overhang, branch_distance, contact_points[layer_idx]);
+    });
+
+    // drop the branches down from the top, layer by layer
+    std::vector<std::vector<Node>> nodes(layer_count);
+    std::vector<unsigned int> nearby;
+    for (int layer_idx = layer_count - 1 - z_distance_top_layers; layer_idx > 0; layer_idx--)
+    {
+        std::vector<Node>& layer_nodes = nodes[layer_idx];
+        for (const Point& contact_point : contact_points[layer_idx])
+        {
+            layer_nodes.emplace_back(contact_point, 0);
+        }
+        contact_points[layer_idx].clear();
+        if (layer_nodes.empty())
+        {
+            continue;
+        }
+
+        SparsePointGridInclusive<unsigned int> node_grid(merge_search_radius, layer_nodes.size());
+        for (unsigned int node_idx = 0; node_idx < layer_nodes.size(); node_idx++)
+        {
+            node_grid.insert(layer_nodes[node_idx].position, node_idx);
+        }
+        std::vector<bool> is_dropped(layer_nodes.size(), false);
+        std::vector<Node>& lower_nodes = nodes[layer_idx - 1];
+        const Polygons& lower_outlines = *model_outlines[layer_idx - 1];
+        const Polygons& lower_collision = *collision[layer_idx - 1];
+        for (unsigned int node_idx = 0; node_idx < layer_nodes.size(); node_idx++)
+        {
+            if (is_dropped[node_idx])
+            {
+                continue;
+            }
+            is_dropped[node_idx] = true;
+            const Node& node = layer_nodes[node_idx];
+            Node lower_node(node.position, node.distance_to_top + 1);
+            lower_node.sources.push_back(node_idx);
+
+            // move toward the nearest branch which hasn't dropped yet, or merge with it if it's close enough
+            unsigned int nearest_idx = NO_INDEX;
+            int64_t nearest_dist2 = std::numeric_limits<int64_t>::max();
+            node_grid.getNearbyVals(node.position, merge_search_radius, nearby);
+            for (unsigned int other_idx : nearby)
+            {
+                const int64_t dist2 = vSize2(layer_nodes[other_idx].position - node.position);
+                if (!is_dropped[other_idx] && (dist2 < nearest_dist2 || (dist2 == nearest_dist2 && other_idx < nearest_idx)))
+                {
+                    nearest_idx = other_idx;
+                    nearest_dist2 = dist2;
+                }
+            }
+            if (nearest_idx != NO_INDEX)
+            {
+                const Node& nearest = layer_nodes[nearest_idx];
+                // merge when both can reach the middle, or when the branches mostly overlap already
+                const coord_t merge_distance = std::max(2 * max_move, getRadius(std::max(node.distance_to_top, nearest.distance_to_top)));
+                if (nearest_dist2 <= merge_distance * merge_distance)
+                {
+                    lower_node.position = (node.position + nearest.position) / 2;
+                    lower_node.distance_to_top = std::max(node.distance_to_top, nearest.distance_to_top) + 1;
+                    lower_node.sources.push_back(nearest_idx);
+                    is_dropped[nearest_idx] = true;
+                }
+                else
+                {
+                    lower_node.position = node.position + normal(nearest.position - node.position, max_move);
+                }
+            }
+
+            // avoid the model
+            if (lower_collision.inside(lower_node.position))
+            {
+                const int64_t max_avoid_dist = collision_distance + max_move;
+                const bool is_moved = PolygonUtils::moveOutside(lower_collision, lower_node.position, 5, max_avoid_dist * max_avoid_dist) != NO_INDEX;
+                if (!is_moved && lower_outlines.inside(lower_node.position))
+                { // the branch ends on the model; if support may only rest on the build plate the whole branch is removed below
+                    continue;
+                }
+            }
+            lower_nodes.push_back(lower_node);
+        }
+
+        Progress::messageProgress(Progress::Stage::SUPPORT, (layer_count - layer_idx) + layer_count * mesh_idx, layer_count * storage.meshes.size());
+    }
+    for (const Point& contact_point : contact_points[0])
+    {
+        nodes[0].emplace_back(contact_point, 0);
+    }
+
+    // only keep the branches which reach the build plate
+    std::vector<std::vector<bool>> is_supported(layer_count);
+    for (unsigned int layer_idx = 0; layer_idx < layer_count; layer_idx++)
+    {
+        is_supported[layer_idx].resize(nodes[layer_idx].size(), layer_idx == 0 || !support_on_buildplate_only);
+        if (layer_idx == 0 || !support_on_buildplate_only)
+        {
+            continue;
+        }
+        for (unsigned int lower_node_idx = 0; lower_node_idx < nodes[layer_idx - 1].size(); lower_node_idx++)
+        {
+            if (is_supported[layer_idx - 1][lower_node_idx])
+            {
+                for (unsigned int source_idx : nodes[layer_idx - 1][lower_node_idx].sources)
+                {
+                    is_supported[layer_idx][source_idx] = true;
+                }
+            }
+        }
+    }
+
+    // draw the branches
+    ThreadPool::parallelFor(0, static_cast<int>(layer_count), [&](int layer_idx)
+    {
+        Polygons circles;
+        for (unsigned int node_idx = 0; node_idx < nodes[layer_idx].size(); node_idx++)
+        {
+            if (is_supported[layer_idx][node_idx])
+            {
+                const Node& node = nodes[layer_idx][node_idx];
+                addCircle(node.position, getRadius(node.distance_to_top), circles);
+            }
+        }
+        if (circles.empty())
+        {
+            return;
+        }
+        Polygons disallowed = storage.getLayerOutlinesCached(layer_idx, false, false, xy_distance);
+        for (unsigned int below = 1; below <= z_distance_bottom_layers && below <= static_cast<unsigned int>(layer_idx); below++)
+        { // bottom Z distance
+            disallowed.add(*model_outlines[layer_idx - below]);
+        }
+        for (unsigned int above = 1; above < z_distance_top_layers && layer_idx + above < layer_count; above++)
+        { // top Z distance
+            disallowed.add(*model_outlines[layer_idx + above]);
+        }
+        supportAreas[layer_idx] = circles.unionPolygons().difference(disallowed.unionPolygons());
+    });
+
+    for (unsigned int layer_idx = supportAreas.size() - 1; layer_idx != static_cast<unsigned int>(std::max(-1, storage.support.layer_nr_max_filled_layer)); layer_idx--)
+    {
+        if (supportAreas[layer_idx].size() > 0)
+        {
+            storage.support.layer_nr_max_filled_layer = layer_idx;
+            break;
+        }
+    }
+
+    storage.support.generated = true;
+}
+
+void TreeSupport::generateContactPoints(const Polygons& overhang, const coord_t point_spread, std::vector<Point>& result)
+{
+    for (const PolygonsPart& part : overhang.splitIntoPartsByContainment())
+    {
+        const AABB aabb(part);
+        // use a grid aligned to the origin, so that the tips of consecutive layers line up and merge
+        const coord_t x_start = aabb.min.X - (aabb.min.X % point_spread + point_spread) % point_spread + point_spread;
+        const coord_t y_start = aabb.min.Y - (aabb.min.Y % point_spread + point_spread) % point_spread + point_spread;
+        bool has_contact_point = false;
+        for (coord_t x = x_start; x < aabb.max.X; x += point_spread)
+        {
+            for (coord_t y = y_start; y < aabb.max.Y; y += point_spread)
+            {
+                const Point candidate(x, y);
+                if (part.inside(candidate))
+                {
+                    result.push_back(candidate);
+                    has_contact_point = true;
+                }
+            }
+        }
+        if (!has_contact_point)
+        { // the part is too small for the grid
+            Point middle = aabb.getMiddle();
+            if (!part.inside(middle))
+            {
+                PolygonUtils::moveInside(part, middle);
+            }
+            result.push_back(middle);
+        }
+    }
+}
+
+void TreeSupport::addCircle(const Point center, const coord_t radius, Polygons& result)
+{
+    PolygonRef circle = result.newPoly();
+    for (unsigned int vertex_idx = 0; vertex_idx < circle_resolution; vertex_idx++)
+    {
+        const double angle = 2 * M_PI * vertex_idx / circle_resolution;
+        circle.add(center + Point(radius * cos(angle), radius * sin(angle)));
+    }
+}
+
+}//namespace cura
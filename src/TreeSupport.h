@@ -0,0 +1,88 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef TREE_SUPPORT_H
+#define TREE_SUPPORT_H
+
+#include <vector>
+
+#include "sliceDataStorage.h"
+
+namespace cura
+{
+
+/*!
+ * Generates support in the shape of trees, rather than filling the whole projected overhang down to the build plate.
+ *
+ * Contact points are placed on a grid in the overhang areas.
+ * From the top down, each point drops one layer at a time, moving toward the nearest other branch
+ * no further than the maximum branch angle allows, so that branches merge into thicker trunks.
+ * Branches move around the model if they can, and otherwise end on the model
+ * (or are removed altogether when support may only rest on the build plate).
+ * The support areas of a layer are the circles around the branches of that layer.
+ *
+ * The support is generated into the same support areas as \ref AreaSupport generates,
+ * so the support infill, roofs and bottoms are handled the same for both.
+ */
+class TreeSupport
+{
+public:
+    /*!
+     * Whether the support of a mesh should be generated as trees.
+     *
+     * \param mesh The settings of the mesh
+     */
+    static bool isEnabled(const SettingsBaseVirtual& mesh);
+
+    /*!
+     * Generate the tree support areas over all layers for one object.
+     *
+     * \param storage data storage containing the input layer outline data
+     * \param infill_settings The settings base to get the settings from which are based on the infill of the support
+     * \param mesh_idx The index of the object for which to generate support areas
+     * \param layer_count total number of layers
+     * \param[out] supportAreas The support areas for each layer
+     */
+    static void generateSupportAreas(SliceDataStorage& storage, const SettingsBaseVirtual& infill_settings, unsigned int mesh_idx, unsigned int layer_count, std::vector<Polygons>& supportAreas);
+
+private:
+    /*!
+     * A location where a branch passes through a layer.
+     */
+    struct Node
+    {
+        Point position; //!< The center of the branch on this layer
+        unsigned int distance_to_top; //!< The number of layers between this node and the top of the branch, which determines its radius
+        std::vector<unsigned int> sources; //!< The indices of the nodes on the layer above which have dropped onto this node
+
+        Node(Point position, unsigned int distance_to_top)
+        : position(position)
+        , distance_to_top(distance_to_top)
+        {
+        }
+    };
+
+    /*!
+     * Place the contact points of the branches in an overhang area, on a grid with the given spacing.
+     *
+     * An overhang part which is too small to contain a grid point still gets a single contact point.
+     *
+     * \param overhang The areas to be supported
+     * \param point_spread The distance between the contact points
+     * \param[out] result Where to add the contact points
+     */
+    static void generateContactPoints(const Polygons& overhang, const coord_t point_spread, std::vector<Point>& result);
+
+    /*!
+     * Approximate a circle by a polygon.
+     *
+     * \param center The center of the circle
+     * \param radius The radius of the circle
+     * \param[out] result Where to add the polygon
+     */
+    static void addCircle(const Point center, const coord_t radius, Polygons& result);
+};
+
+}//namespace cura
+
+#endif//TREE_SUPPORT_H
@@ -23,7 +23,7 @@ void WallsComputation::generateInsets(SliceLayerPart* part)
     if (insetCount == 0)
     {
         part->insets.push_back(part->outline);
-        part->print_outline = part->outline;
+        part->print_outline = CompactPolygons(part->outline);
         return;
     }
     
@@ -49,11 +49,11 @@ void WallsComputation::generateInsets(SliceLayerPart* part)
         {
             if (recompute_outline_based_on_outer_wall)
             {
-                part->print_outline = part->insets[0].offset(line_width_0 / 2, ClipperLib::jtSquare);
+                part->print_outline = CompactPolygons(part->insets[0].offset(line_width_0 / 2, ClipperLib::jtSquare));
             }
             else
             {
-                part->print_outline = part->outline;
+                part->print_outline = CompactPolygons(part->outline);
             }
         }
         if (part->insets[i].size() < 1)
@@ -7,6 +7,7 @@
 #include "progress/Progress.h"
 #include "weaveDataStorage.h"
 #include "PrintFeature.h"
+#include "utils/ThreadPool.h"
 
 namespace cura 
 {
@@ -105,34 +106,45 @@ void Weaver::weave(MeshGroup* meshgroup)
     std::cerr<< "finding horizontal parts..." << std::endl;
     {
         Progress::messageProgressStage(Progress::Stage::SUPPORT, nullptr);
-        for (unsigned int layer_idx = 0; layer_idx < wireFrame.layers.size(); layer_idx++)
+        // the horizontal parts of a layer only depend on the polygons to be connected of the layer itself and the layer above
+        const int weave_layer_count = wireFrame.layers.size();
+        Progress::StepCounter progress(Progress::Stage::SUPPORT, weave_layer_count); // abuse the progress system of the normal mode of CuraEngine
+        ThreadPool::parallelFor(0, weave_layer_count, [&](int layer_idx)
         {
-            Progress::messageProgress(Progress::Stage::SUPPORT, layer_idx+1, wireFrame.layers.size()); // abuse the progress system of the normal mode of CuraEngine
-            
             WeaveLayer& layer = wireFrame.layers[layer_idx];
             
             Polygons empty;
-            Polygons& layer_above = (layer_idx+1 < wireFrame.layers.size())? wireFrame.layers[layer_idx+1].supported : empty;
+            Polygons& layer_above = (layer_idx + 1 < weave_layer_count)? wireFrame.layers[layer_idx+1].supported : empty;
             
             createHorizontalFill(layer, layer_above);
-        }
+            progress.step();
+        });
     }
     // at this point layer.supported still only contains the polygons to be connected
     // when connecting layers, we further add the supporting polygons created by the roofs
     
     std::cerr<< "connecting layers..." << std::endl;
     {
-        Polygons* lower_top_parts = &wireFrame.bottom_outline;
-        int last_z = wireFrame.z_bottom;
-        for (unsigned int layer_idx = 0; layer_idx < wireFrame.layers.size(); layer_idx++) // use top of every layer but the last
+        // each layer is connected to the polygons to be connected of the layer below together with the roofs of the layer below
+        const int weave_layer_count = wireFrame.layers.size();
+        ThreadPool::parallelFor(0, weave_layer_count, [&](int layer_idx)
         {
             WeaveLayer& layer = wireFrame.layers[layer_idx];
-            
-            connect_polygons(*lower_top_parts, last_z, layer.supported, layer.z1, layer);
+            if (layer_idx == 0)
+            {
+                connect_polygons(wireFrame.bottom_outline, wireFrame.z_bottom, layer.supported, layer.z1, layer);
+            }
+            else
+            {
+                const WeaveLayer& layer_below = wireFrame.layers[layer_idx - 1];
+                Polygons lower_top_parts = layer_below.supported;
+                lower_top_parts.add(layer_below.roofs.roof_outlines);
+                connect_polygons(lower_top_parts, layer_below.z1, layer.supported, layer.z1, layer);
+            }
+        });
+        for (WeaveLayer& layer : wireFrame.layers)
+        {
             layer.supported.add(layer.roofs.roof_outlines);
-            lower_top_parts = &layer.supported;
-            
-            last_z = layer.z1;
         }
     }
 
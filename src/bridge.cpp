@@ -5,13 +5,13 @@
 
 namespace cura {
 
-int bridgeAngle(Polygons outline, const SliceLayer* prevLayer)
+int bridgeAngle(const Polygons& outline, const SliceLayer* prevLayer)
 {
     AABB boundaryBox(outline);
     //To detect if we have a bridge, first calculate the intersection of the current layer with the previous layer.
     // This gives us the islands that the layer rests on.
     Polygons islands;
-    for(auto prevLayerPart : prevLayer->parts)
+    for(const SliceLayerPart& prevLayerPart : prevLayer->parts)
     {
         if (!boundaryBox.hit(prevLayerPart.boundaryBox))
             continue;
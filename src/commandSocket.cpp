@@ -7,43 +7,64 @@
 #include "FffProcessor.h"
 #include "progress/Progress.h"
 
+#include <algorithm> // all_of
+#include <atomic>
 #include <thread>
 #include <cinttypes>
+#include <mutex>
 
 #ifdef ARCUS
 #include <Arcus/Socket.h>
 #include <Arcus/SocketListener.h>
 #include <Arcus/Error.h>
+#include <google/protobuf/arena.h>
 #endif
 
+#include <cstring> // memcpy
 #include <string> // stoi
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-#define DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR(x) 
-
-// std::cerr << x;
-
 namespace cura {
 
 #define BYTES_PER_FLOAT 4
+#define BYTES_PER_INT 4
 #define FLOATS_PER_VECTOR 3
 #define VECTORS_PER_FACE 3
 
 CommandSocket* CommandSocket::instance = nullptr; // instantiate instance
 
 #ifdef ARCUS
+/*!
+ * Cancels the slicing in progress when the front end isn't waiting for its result any more:
+ * when the connection is closed or when a new message arrives during the slicing, as when the front end slices again.
+ */
 class Listener : public Arcus::SocketListener
 {
 public:
-    void stateChanged(Arcus::SocketState::SocketState) override
+    Listener()
+    : received_count(0)
+    , taken_count(0)
+    , slicing(false)
+    { }
+
+    void stateChanged(Arcus::SocketState::SocketState new_state) override
     {
+        if (new_state == Arcus::SocketState::Closing || new_state == Arcus::SocketState::Closed || new_state == Arcus::SocketState::Error)
+        {
+            FffProcessor::getInstance()->cancel();
+        }
     }
 
     void messageReceived() override
     {
+        const unsigned int count = ++received_count;
+        if (slicing && count > taken_count)
+        { // not the message which started the slicing, of which the listener may be told only after it has been taken
+            FffProcessor::getInstance()->cancel();
+        }
     }
 
     void error(const Arcus::Error & error) override
@@ -57,6 +78,82 @@ public:
             logError("%s\n", error.toString().c_str());
         }
     }
+
+    std::atomic<unsigned int> received_count; //!< The number of messages the listener has been told about
+    std::atomic<unsigned int> taken_count; //!< The number of messages taken from the socket
+    std::atomic<bool> slicing; //!< Whether the messages taken are being sliced
+};
+
+/*!
+ * Stream buffer which sends the gcode written to it to the front end in GCodeLayer messages of bounded size.
+ *
+ * When the buffer is full, the complete lines in it are sent, so that a large layer doesn't have to be held in memory as a whole.
+ */
+class GCodeMessageBuffer : public std::streambuf
+{
+    static constexpr size_t max_message_size = 1 << 18; //!< The size of the buffer, which bounds the size of the messages
+    Arcus::Socket* socket;
+    std::vector<char> buffer;
+public:
+    GCodeMessageBuffer()
+    : socket(nullptr)
+    , buffer(max_message_size)
+    {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    void setSocket(Arcus::Socket* new_socket)
+    {
+        socket = new_socket;
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        char* const begin = pbase();
+        char* send_end = pptr();
+        while (send_end > begin && *(send_end - 1) != '\n')
+        {
+            send_end--;
+        }
+        if (send_end == begin)
+        { // a single line longer than the buffer
+            send_end = pptr();
+        }
+        send(begin, send_end);
+        const size_t remaining = pptr() - send_end;
+        std::copy(send_end, pptr(), begin);
+        setp(begin, epptr());
+        pbump(remaining);
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    /*!
+     * Send everything written so far.
+     */
+    int sync() override
+    {
+        send(pbase(), pptr());
+        setp(pbase(), epptr());
+        return 0;
+    }
+
+private:
+    void send(const char* begin, const char* end)
+    {
+        if (begin == end || !socket)
+        {
+            return;
+        }
+        auto message = std::make_shared<cura::proto::GCodeLayer>();
+        message->set_data(begin, end - begin);
+        socket->sendMessage(message);
+    }
 };
 
 /*!
@@ -84,32 +181,55 @@ public:
     std::unordered_map<int, std::shared_ptr<T>> slice_data;
 };
 
+/*!
+ * Create a message in a protobuf arena of its own, so that the message and its sub-messages are allocated in a few blocks instead of one by one.
+ *
+ * The arena is destroyed with the last copy of the returned pointer, which may be held by the socket until the message has been sent.
+ *
+ * \param start_block_size The size of the first block of the arena
+ */
+template<typename T>
+std::shared_ptr<T> createArenaMessage(size_t start_block_size)
+{
+    google::protobuf::ArenaOptions options;
+    options.start_block_size = start_block_size;
+    std::shared_ptr<google::protobuf::Arena> arena = std::make_shared<google::protobuf::Arena>(options);
+    return std::shared_ptr<T>(arena, google::protobuf::Arena::CreateMessage<T>(arena.get())); // shares the ownership of the arena
+}
+
 class CommandSocket::Private
 {
 public:
     Private()
         : socket(nullptr)
         , object_count(0)
+        , gcode_output_stream(&gcode_output_buffer)
         , last_sent_progress(-1)
     { }
 
-    std::shared_ptr<cura::proto::Layer> getLayerById(int id);
-
     std::shared_ptr<cura::proto::LayerOptimized> getOptimizedLayerById(int id);
 
+    /*!
+     * Send the optimized layer data of a layer of which all paths have been compiled, so that the front end can show it while slicing continues.
+     *
+     * \param id The layer number, not including the layer offset of the current object
+     */
+    void sendOptimizedLayer(int id);
+
     Arcus::Socket* socket;
     
     // Number of objects that need to be sliced
     int object_count;
 
     std::string temp_gcode_file;
-    std::ostringstream gcode_output_stream;
+    GCodeMessageBuffer gcode_output_buffer; //!< Sends the gcode in messages of bounded size while it's being written
+    std::ostream gcode_output_stream;
     
     // Print object that olds one or more meshes that need to be sliced. 
     std::vector< std::shared_ptr<MeshGroup> > objects_to_slice;
 
-    SliceDataStruct<cura::proto::Layer> sliced_layers;
     SliceDataStruct<cura::proto::LayerOptimized> optimized_layers;
+    std::mutex optimized_layers_mutex; //!< The layer info of upcoming layers is set while the paths of earlier layers are being compiled and sent
 
     int last_sent_progress; //!< Last sent progress promille (1/1000th). Used to not send duplicate messages with the same promille.
 };
@@ -164,6 +284,8 @@ public:
         if (_layer_nr != new_layer_nr)
         {
             flushPathSegments();
+            // layers are written in order, so no more paths will be added to the previous layer
+            _cs_private_data.sendOptimizedLayer(_layer_nr);
             _layer_nr = new_layer_nr;
         }
     }
@@ -219,6 +341,10 @@ public:
      * Adds a single line segment to the current path. The line segment added is from the current last point to point \p to
      */
     void sendLineTo(PrintFeatureType print_feature_type, Point to, int width);
+    /*!
+     * Adds the line segments from the current last point through \p point_count points to the current path
+     */
+    void sendLinesTo(PrintFeatureType print_feature_type, const Point* to, unsigned int point_count, int width);
     /*!
      * Adds closed polygon to the current path
      */
@@ -275,7 +401,9 @@ void CommandSocket::connect(const std::string& ip, int port)
 {
 #ifdef ARCUS
     private_data->socket = new Arcus::Socket();
-    private_data->socket->addListener(new Listener());
+    private_data->gcode_output_buffer.setSocket(private_data->socket);
+    Listener* listener = new Listener();
+    private_data->socket->addListener(listener);
 
     //private_data->socket->registerMessageType(1, &Cura::ObjectList::default_instance());
     private_data->socket->registerMessageType(&cura::proto::Slice::default_instance());
@@ -301,12 +429,17 @@ void CommandSocket::connect(const std::string& ip, int port)
     log("Connected to %s:%i\n", ip.c_str(), port);
     
     bool slice_another_time = true;
+    unsigned int preview_layer_stride = 0; // if positive, the layers of the next slice are first previewed at this stride
     
     // Start & continue listening as long as socket is not closed and there is no error.
     while(private_data->socket->getState() != Arcus::SocketState::Closed && private_data->socket->getState() != Arcus::SocketState::Error && slice_another_time)
     {
         // Actually start handling messages.
         Arcus::MessagePtr message = private_data->socket->takeNextMessage();
+        if (message)
+        {
+            listener->taken_count++;
+        }
 
         /*
          * handle a message which consists purely of a SettingList
@@ -359,6 +492,11 @@ void CommandSocket::connect(const std::string& ip, int port)
                     }
                 }
             }
+            for (std::shared_ptr<MeshGroup> meshgroup : private_data->objects_to_slice)
+            {
+                meshgroup->flattenSettings();
+            }
+            preview_layer_stride = std::max(0, slice->preview_layer_stride());
             logDebug("Done reading Slice message\n");
         }
 
@@ -368,19 +506,39 @@ void CommandSocket::connect(const std::string& ip, int port)
             int object_count = private_data->objects_to_slice.size();
             logDebug("Slicing %i objects\n", object_count);
             FffProcessor::getInstance()->resetMeshGroupNumber();
+            FffProcessor::getInstance()->resetCancellation();
+            listener->slicing = true;
+            if (preview_layer_stride > 0)
+            { // the meshgroups are printed one after another, so the first one is the first to be shown
+                logDebug("Previewing every %u layers\n", preview_layer_stride);
+                if (!FffProcessor::getInstance()->previewMeshGroup(private_data->objects_to_slice.front().get(), preview_layer_stride))
+                {
+                    logWarning("Previewing the mesh group failed.\n");
+                }
+            }
             int i = 1;
             for (auto object : private_data->objects_to_slice)
             {
                 logDebug("Slicing object %i of %i\n", i, object_count);
                 if (!FffProcessor::getInstance()->processMeshGroup(object.get()))
                 {
+                    if (FffProcessor::getInstance()->isCancelled())
+                    {
+                        break;
+                    }
                     logError("Slicing mesh group failed!");
                 }
                 i++;
             }
+            listener->slicing = false;
+            private_data->objects_to_slice.clear();
+            if (FffProcessor::getInstance()->isCancelled())
+            { // the front end doesn't wait for the result, so stop without finishing the gcode
+                log("Slicing cancelled\n");
+                break;
+            }
             logDebug("Done slicing objects\n");
 
-            private_data->objects_to_slice.clear();
             FffProcessor::getInstance()->finalize();
             flushGcode();
             sendPrintTimeMaterialEstimates();
@@ -449,17 +607,18 @@ void CommandSocket::handleObjectList(cura::proto::ObjectList* list, const google
         }
     }
 
-    for (auto object : list->objects())
+    for (const cura::proto::Object& object : list->objects())
     {
-        int bytes_per_face = BYTES_PER_FLOAT * FLOATS_PER_VECTOR * VECTORS_PER_FACE;
-        int face_count = object.vertices().size() / bytes_per_face;
+        const int bytes_per_vertex = BYTES_PER_FLOAT * FLOATS_PER_VECTOR;
+        const int bytes_per_face = bytes_per_vertex * VECTORS_PER_FACE;
+        const bool is_indexed = !object.indices().empty();
+        const int face_count = is_indexed ? object.indices().size() / (BYTES_PER_INT * VECTORS_PER_FACE) : object.vertices().size() / bytes_per_face;
 
         if (face_count <= 0)
         {
             logWarning("Got an empty mesh, ignoring it!");
             continue;
         }
-        DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("solid Cura_out\n");
 
         // Check to which extruder train this object belongs
         int extruder_train_nr = 0; // assume extruder 0 if setting wasn't supplied
@@ -476,27 +635,33 @@ void CommandSocket::handleObjectList(cura::proto::ObjectList* list, const google
         meshgroup->meshes.push_back(extruder_train); //Construct a new mesh (with the corresponding extruder train as settings parent object) and put it into MeshGroup's mesh list.
         Mesh& mesh = meshgroup->meshes.back();
 
-        for (int i = 0; i < face_count; ++i)
+        // The floats are read straight from the message; the bytes aren't guaranteed to be aligned, so they are copied per vector.
+        const char* vertex_data = object.vertices().data();
+        const int vertex_count = object.vertices().size() / bytes_per_vertex;
+        std::vector<Point3> points(is_indexed ? vertex_count : face_count * VECTORS_PER_FACE);
+        for (unsigned int point_idx = 0; point_idx < points.size(); point_idx++)
         {
             //TODO: Apply matrix
-            std::string data = object.vertices().substr(i * bytes_per_face, bytes_per_face);
-            const FPoint3* float_vertices = reinterpret_cast<const FPoint3*>(data.data());
-
-            Point3 verts[3];
-            verts[0] = matrix.apply(float_vertices[0]);
-            verts[1] = matrix.apply(float_vertices[1]);
-            verts[2] = matrix.apply(float_vertices[2]);
-            mesh.addFace(verts[0], verts[1], verts[2]);
+            FPoint3 float_vertex;
+            memcpy(&float_vertex, vertex_data + point_idx * bytes_per_vertex, bytes_per_vertex);
+            points[point_idx] = matrix.apply(float_vertex);
+        }
 
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("  facet normal -1 0 0\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("    outer loop\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(verts[0].x) <<" " << INT2MM(verts[0].y) <<" " << INT2MM(verts[0].z) << "\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(verts[1].x) <<" " << INT2MM(verts[1].y) <<" " << INT2MM(verts[1].z) << "\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("      vertex "<<INT2MM(verts[2].x) <<" " << INT2MM(verts[2].y) <<" " << INT2MM(verts[2].z) << "\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("    endloop\n");
-            DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("  endfacet\n");
+        if (is_indexed)
+        { // The frontend has already deduplicated the vertices, so they don't need to be welded again.
+            std::vector<int32_t> indices(face_count * VECTORS_PER_FACE);
+            memcpy(indices.data(), object.indices().data(), indices.size() * BYTES_PER_INT);
+            if (!mesh.addIndexedFaces(points, indices))
+            {
+                logWarning("Got a mesh with vertex indices out of range, ignoring it!");
+                meshgroup->meshes.pop_back();
+                continue;
+            }
+        }
+        else
+        {
+            mesh.addFaces(points);
         }
-        DEBUG_OUTPUT_OBJECT_STL_THROUGH_CERR("endsolid Cura_out\n");
 
         for (auto setting : object.settings())
         {
@@ -564,6 +729,23 @@ void CommandSocket::sendLineTo(cura::PrintFeatureType type, Point to, int line_w
 #endif
 }
 
+void CommandSocket::sendLinesTo(cura::PrintFeatureType type, const Point* points, unsigned int point_count, int line_width)
+{
+#ifdef ARCUS
+    if (CommandSocket::isInstantiated())
+    {
+        auto& path_comp = CommandSocket::getInstance()->path_comp;
+
+        path_comp->sendLinesTo(type, points, point_count, line_width);
+    }
+#else
+    UNUSED_PARAM(type);
+    UNUSED_PARAM(points);
+    UNUSED_PARAM(point_count);
+    UNUSED_PARAM(line_width);
+#endif
+}
+
 void CommandSocket::setSendCurrentPosition(Point position)
 {
 #ifdef ARCUS
@@ -660,54 +842,100 @@ void CommandSocket::sendPrintMaterialForObject(int, int, float)
     //Do nothing.
 }
 
-void CommandSocket::sendLayerData()
+void CommandSocket::sendOptimizedLayerData()
 {
 #ifdef ARCUS
-    auto& data = private_data->sliced_layers;
+    path_comp->flushPathSegments(); // make sure the last path segment has been flushed from the compiler
+
+    std::lock_guard<std::mutex> lock(private_data->optimized_layers_mutex);
+    auto& data = private_data->optimized_layers;
 
     data.sliced_objects++;
     data.current_layer_offset = data.current_layer_count;
-//    log("End sliced object called. Sending %d layers.", data.current_layer_count);
+    log("End sliced object called. Sending %d remaining layers.", data.slice_data.size());
 
-    // Only send the data to the front end when all mesh groups have been processed.
+    // Most layers have already been sent by PathCompiler::setLayer as soon as they were complete.
+    for (std::pair<const int, std::shared_ptr<cura::proto::LayerOptimized>> entry : data.slice_data) //Note: This is in no particular order!
+    {
+        logDebug("Sending layer data for layer %i of %i.\n", entry.first, data.slice_data.size());
+        private_data->socket->sendMessage(entry.second); //Send the actual layers.
+    }
+    data.slice_data.clear();
     if (data.sliced_objects >= private_data->object_count)
     {
-        for (std::pair<const int, std::shared_ptr<cura::proto::Layer>> entry : data.slice_data) //Note: This is in no particular order!
-        {
-            logDebug("Sending layer data for layer %i of %i.\n", entry.first, data.slice_data.size());
-            private_data->socket->sendMessage(entry.second); //Send the actual layers.
-        }
         data.sliced_objects = 0;
         data.current_layer_count = 0;
         data.current_layer_offset = 0;
-        data.slice_data.clear();
     }
 #endif
 }
 
-void CommandSocket::sendOptimizedLayerData()
+void CommandSocket::sendPreview(const SliceDataStorage& storage, unsigned int layer_stride)
 {
 #ifdef ARCUS
-    path_comp->flushPathSegments(); // make sure the last path segment has been flushed from the compiler
-
-    auto& data = private_data->optimized_layers;
-
-    data.sliced_objects++;
-    data.current_layer_offset = data.current_layer_count;
-    log("End sliced object called. Sending %d layers.", data.current_layer_count);
-
-    if (data.sliced_objects >= private_data->object_count)
+    coord_t last_z = 0;
+    for (unsigned int layer_idx = 0; layer_idx < storage.print_layer_count; layer_idx++)
     {
-        for (std::pair<const int, std::shared_ptr<cura::proto::LayerOptimized>> entry : data.slice_data) //Note: This is in no particular order!
+        const int layer_nr = layer_idx * layer_stride;
+        coord_t z = -1;
+        for (const SliceMeshStorage& mesh : storage.meshes)
         {
-            logDebug("Sending layer data for layer %i of %i.\n", entry.first, data.slice_data.size());
-            private_data->socket->sendMessage(entry.second); //Send the actual layers.
+            if (layer_idx < mesh.layers.size())
+            {
+                z = std::max(z, static_cast<coord_t>(mesh.layers[layer_idx].printZ));
+            }
         }
-        data.sliced_objects = 0;
-        data.current_layer_count = 0;
-        data.current_layer_offset = 0;
-        data.slice_data.clear();
+        if (z < 0)
+        {
+            continue;
+        }
+        // the layer is shown as thick as the layers it stands for, from the previewed layer below up to its top
+        sendOptimizedLayerInfo(layer_nr, z, (layer_idx == 0)? storage.layer_thicknesses[0] : z - last_z);
+        last_z = z;
+        path_comp->setLayer(layer_nr);
+        for (const SliceMeshStorage& mesh : storage.meshes)
+        {
+            if (layer_idx >= mesh.layers.size())
+            {
+                continue;
+            }
+            path_comp->setExtruder(mesh.getSettingAsIndex("extruder_nr"));
+            for (const SliceLayerPart& part : mesh.layers[layer_idx].parts)
+            {
+                if (part.insets.empty())
+                { // no walls fit, or only the surface is printed
+                    for (ConstPolygonRef polygon : part.outline)
+                    {
+                        path_comp->sendPolygon(PrintFeatureType::OuterWall, polygon, mesh.layer_settings.wall_line_width_0);
+                    }
+                    continue;
+                }
+                for (unsigned int inset_idx = 0; inset_idx < part.insets.size(); inset_idx++)
+                {
+                    const PrintFeatureType type = (inset_idx == 0)? PrintFeatureType::OuterWall : PrintFeatureType::InnerWall;
+                    const int line_width = (inset_idx == 0)? mesh.layer_settings.wall_line_width_0 : mesh.layer_settings.wall_line_width_x;
+                    for (ConstPolygonRef polygon : part.insets[inset_idx])
+                    {
+                        path_comp->sendPolygon(type, polygon, line_width);
+                    }
+                }
+            }
+        }
+    }
+    path_comp->flushPathSegments();
+
+    // send the last layer, and let the full slicing start at the same layer numbers again
+    std::lock_guard<std::mutex> lock(private_data->optimized_layers_mutex);
+    auto& data = private_data->optimized_layers;
+    for (std::pair<const int, std::shared_ptr<cura::proto::LayerOptimized>> entry : data.slice_data)
+    {
+        private_data->socket->sendMessage(entry.second);
     }
+    data.slice_data.clear();
+    data.current_layer_count = data.current_layer_offset;
+#else
+    UNUSED_PARAM(storage);
+    UNUSED_PARAM(layer_stride);
 #endif
 }
 
@@ -731,11 +959,7 @@ void CommandSocket::beginGCode()
 void CommandSocket::flushGcode()
 {
 #ifdef ARCUS
-    auto message = std::make_shared<cura::proto::GCodeLayer>();
-    message->set_data(private_data->gcode_output_stream.str());
-    private_data->socket->sendMessage(message);
-    
-    private_data->gcode_output_stream.str("");
+    private_data->gcode_output_stream.flush();
 #endif
 }
 
@@ -748,33 +972,10 @@ void CommandSocket::sendGCodePrefix(std::string prefix)
 #endif
 }
 
-#ifdef ARCUS
-std::shared_ptr<cura::proto::Layer> CommandSocket::Private::getLayerById(int id)
-{
-    id += sliced_layers.current_layer_offset;
-
-    auto itr = sliced_layers.slice_data.find(id);
-
-    std::shared_ptr<cura::proto::Layer> layer;
-    if (itr != sliced_layers.slice_data.end())
-    {
-        layer = itr->second;
-    }
-    else
-    {
-        layer = std::make_shared<cura::proto::Layer>();
-        layer->set_id(id);
-        sliced_layers.current_layer_count++;
-        sliced_layers.slice_data[id] = layer;
-    }
-
-    return layer;
-}
-#endif
-
 #ifdef ARCUS
 std::shared_ptr<cura::proto::LayerOptimized> CommandSocket::Private::getOptimizedLayerById(int id)
 {
+    std::lock_guard<std::mutex> lock(optimized_layers_mutex);
     id += optimized_layers.current_layer_offset;
 
     auto itr = optimized_layers.slice_data.find(id);
@@ -786,7 +987,7 @@ std::shared_ptr<cura::proto::LayerOptimized> CommandSocket::Private::getOptimize
     }
     else
     {
-        layer = std::make_shared<cura::proto::LayerOptimized>();
+        layer = createArenaMessage<cura::proto::LayerOptimized>(4096); // room for the path segments of several extruders
         layer->set_id(id);
         optimized_layers.current_layer_count++;
         optimized_layers.slice_data[id] = layer;
@@ -794,6 +995,24 @@ std::shared_ptr<cura::proto::LayerOptimized> CommandSocket::Private::getOptimize
 
     return layer;
 }
+
+void CommandSocket::Private::sendOptimizedLayer(int id)
+{
+    std::shared_ptr<cura::proto::LayerOptimized> layer;
+    {
+        std::lock_guard<std::mutex> lock(optimized_layers_mutex);
+        id += optimized_layers.current_layer_offset;
+        auto itr = optimized_layers.slice_data.find(id);
+        if (itr == optimized_layers.slice_data.end() || itr->second->path_segment_size() == 0)
+        { // a layer with only its height set is still to be written
+            return;
+        }
+        layer = itr->second;
+        optimized_layers.slice_data.erase(itr);
+    }
+    logDebug("Sending layer data for layer %i.\n", id);
+    socket->sendMessage(layer);
+}
 #endif
 
 #ifdef ARCUS
@@ -806,15 +1025,12 @@ void CommandSocket::PathCompiler::flushPathSegments()
         cura::proto::PathSegment* p = proto_layer->add_path_segment();
         p->set_extruder(extruder);
         p->set_point_type(data_point_type);
-        std::string line_type_data;
-        line_type_data.append(reinterpret_cast<const char*>(line_types.data()), line_types.size()*sizeof(PrintFeatureType));
-        p->set_line_type(line_type_data);
-        std::string polydata;
-        polydata.append(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(float));
-        p->set_points(polydata);
-        std::string line_width_data;
-        line_width_data.append(reinterpret_cast<const char*>(line_widths.data()), line_widths.size()*sizeof(float));
-        p->set_line_width(line_width_data);
+        // The line types and widths may be sent as a single value if they are the same for all line segments.
+        const bool single_line_type = std::all_of(line_types.begin(), line_types.end(), [this](PrintFeatureType type) { return type == line_types.front(); });
+        p->set_line_type(reinterpret_cast<const char*>(line_types.data()), (single_line_type ? 1 : line_types.size()) * sizeof(PrintFeatureType));
+        p->set_points(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(float));
+        const bool single_line_width = std::all_of(line_widths.begin(), line_widths.end(), [this](float width) { return width == line_widths.front(); });
+        p->set_line_width(reinterpret_cast<const char*>(line_widths.data()), (single_line_width ? 1 : line_widths.size()) * sizeof(float));
     }
     points.clear();
     line_widths.clear();
@@ -831,6 +1047,23 @@ void CommandSocket::PathCompiler::sendLineTo(PrintFeatureType print_feature_type
     }
 }
 
+void CommandSocket::PathCompiler::sendLinesTo(PrintFeatureType print_feature_type, const Point* to, unsigned int point_count, int width)
+{
+    assert(points.size() > 0 && "A point must already be in the buffer for sendLinesTo(.) to function properly");
+
+    points.reserve(points.size() + 2 * point_count);
+    line_types.reserve(line_types.size() + point_count);
+    line_widths.reserve(line_widths.size() + point_count);
+    for (unsigned int point_idx = 0; point_idx < point_count; point_idx++)
+    {
+        // Ignore zero-length segments.
+        if (to[point_idx] != last_point)
+        {
+            addLineSegment(print_feature_type, to[point_idx], width);
+        }
+    }
+}
+
 void CommandSocket::PathCompiler::sendPolygon(PrintFeatureType print_feature_type, ConstPolygonRef polygon, int width)
 {
     if (polygon.size() < 2)
@@ -16,6 +16,8 @@
 namespace cura
 {
 
+class SliceDataStorage;
+
 class CommandSocket
 {
 private:
@@ -71,6 +73,18 @@ public:
      */
     static void sendLineTo(cura::PrintFeatureType type, Point to, int line_width);
 
+    /*!
+     * Send the lines through a sequence of points to the front-end, each from the previous point. This is used for the layerview in the GUI
+     *
+     * Sends all the lines of a path at once, instead of calling \ref CommandSocket::sendLineTo for each of them.
+     *
+     * \param type The print feature of all lines
+     * \param points The points to which the lines go in turn
+     * \param point_count The number of points
+     * \param line_width The width of all lines
+     */
+    static void sendLinesTo(cura::PrintFeatureType type, const Point* points, unsigned int point_count, int line_width);
+
     /*!
      * Set the current position of the path compiler to \p position. This is used for the layerview in the GUI
      */
@@ -111,14 +125,6 @@ public:
      */
     void sendPrintMaterialForObject(int index, int extruder_nr, float material_amount);
     
-    /*!
-     * Send the slices of the model as polygons to the GUI.
-     *
-     * The GUI may use this to visualize the early result of the slicing
-     * process.
-     */
-    void sendLayerData();
-
     /*!
      * Send the sliced layer data to the GUI after the optimization is done and
      * the actual order in which to print has been set.
@@ -128,6 +134,17 @@ public:
      */
     void sendOptimizedLayerData();
 
+    /*!
+     * Send the outlines and walls of a preview to the GUI, see \ref FffProcessor::previewMeshGroup
+     *
+     * Each previewed layer is sent as the layer of the full slicing which it stands for, so that the GUI can show it in its place
+     * until that layer is sent in full.
+     *
+     * \param storage The areas generated by \ref FffPolygonGenerator::generatePreview
+     * \param layer_stride The number of layers which each previewed layer stands for
+     */
+    void sendPreview(const SliceDataStorage& storage, unsigned int layer_stride);
+
     /*!
      * \brief Sends a message to indicate that all the slicing is done.
      *
@@ -140,6 +157,8 @@ public:
     
     /*!
      * Flush the gcode in gcode_output_stream into a message queued in the socket.
+     * 
+     * Large amounts of gcode are already sent in between, in messages of bounded size.
      */
     void flushGcode();
     void sendGCodePrefix(std::string prefix);
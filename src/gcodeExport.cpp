@@ -16,8 +16,44 @@ namespace cura {
 
 double layer_height; //!< report basic layer height in RepRap gcode file.
 
+void DeferredLayerGCode::Move::write(std::ostream& out, const std::string& new_line) const
+{
+    if (write_feedrate)
+    {
+        out << " F" << PrecisionedDouble{1, feedrate};
+    }
+    out << " X" << MMtoStream{x} << " Y" << MMtoStream{y};
+    if (write_z)
+    {
+        out << " Z" << MMtoStream{z};
+    }
+    if (write_e)
+    {
+        out << " " << e_character << PrecisionedDouble{5, e};
+    }
+    out << new_line;
+}
+
+std::string DeferredLayerGCode::format() const
+{
+    const std::string unformatted = text.str();
+    std::ostringstream formatted;
+    formatted.copyfmt(text);
+    size_t text_pos = 0;
+    for (const Move& move : moves)
+    {
+        formatted.write(unformatted.data() + text_pos, move.text_pos - text_pos);
+        text_pos = move.text_pos;
+        move.write(formatted, new_line);
+    }
+    formatted.write(unformatted.data() + text_pos, unformatted.size() - text_pos);
+    return formatted.str();
+}
+
 GCodeExport::GCodeExport()
 : output_stream(&std::cout)
+, deferred_output_stream(nullptr)
+, deferred_layer(nullptr)
 , currentPosition(0,0,MM2INT(20))
 , layer_nr(0)
 {
@@ -36,6 +72,7 @@ GCodeExport::GCodeExport()
     current_max_z_feedrate = -1;
 
     isZHopped = 0;
+    use_extruder_offset_to_offset_coords = false;
     setFlavor(EGCodeFlavor::REPRAP);
     initial_bed_temp = 0;
 
@@ -52,6 +89,7 @@ void GCodeExport::preSetup(const MeshGroup* meshgroup)
 {
     setFlavor(meshgroup->getSettingAsGCodeFlavor("machine_gcode_flavor"));
     use_extruder_offset_to_offset_coords = meshgroup->getSettingBoolean("machine_use_extruder_offset_to_offset_coords");
+    chooseMoveWriters();
 
     extruder_count = meshgroup->getSettingAsCount("machine_extruder_count");
 
@@ -187,6 +225,44 @@ void GCodeExport::setLayerNr(unsigned int layer_nr_) {
     layer_nr = layer_nr_;
 }
 
+std::string GCodeExport::padFileHeader(const std::string& header, size_t size) const
+{
+    const size_t padding_line_size = 1 + new_line.size(); // a comment with nothing but spaces
+    if (header.size() + padding_line_size > size)
+    {
+        return std::string();
+    }
+    return header + ";" + std::string(size - header.size() - padding_line_size, ' ') + new_line;
+}
+
+void GCodeExport::flushOutputStream()
+{
+    output_stream->flush();
+}
+
+std::ostream* GCodeExport::getOutputStream() const
+{
+    return deferred_layer? deferred_output_stream : output_stream;
+}
+
+void GCodeExport::beginDeferredLayer(DeferredLayerGCode& layer)
+{
+    assert(!deferred_layer && "The previous deferred layer should have been ended.");
+    layer.text.copyfmt(*output_stream);
+    layer.new_line = new_line;
+    deferred_output_stream = output_stream;
+    deferred_layer = &layer;
+    output_stream = &layer.text;
+}
+
+void GCodeExport::endDeferredLayer()
+{
+    assert(deferred_layer && "A deferred layer should have been begun.");
+    output_stream = deferred_output_stream;
+    deferred_output_stream = nullptr;
+    deferred_layer = nullptr;
+}
+
 void GCodeExport::setOutputStream(std::ostream* stream)
 {
     output_stream = stream;
@@ -253,6 +329,42 @@ void GCodeExport::setFlavor(EGCodeFlavor flavor)
     {
         firmware_retract = false;
     }
+    chooseMoveWriters();
+}
+
+void GCodeExport::chooseMoveWriters()
+{
+    if (flavor == EGCodeFlavor::BFB)
+    {
+        travel_writer = &GCodeExport::writeTravelBFB;
+        extrusion_writer = &GCodeExport::writeMoveBFB;
+    }
+    else if (is_volumatric)
+    {
+        if (use_extruder_offset_to_offset_coords)
+        {
+            travel_writer = &GCodeExport::writeTravel<true, true>;
+            extrusion_writer = &GCodeExport::writeExtrusion<true, true>;
+        }
+        else
+        {
+            travel_writer = &GCodeExport::writeTravel<true, false>;
+            extrusion_writer = &GCodeExport::writeExtrusion<true, false>;
+        }
+    }
+    else
+    {
+        if (use_extruder_offset_to_offset_coords)
+        {
+            travel_writer = &GCodeExport::writeTravel<false, true>;
+            extrusion_writer = &GCodeExport::writeExtrusion<false, true>;
+        }
+        else
+        {
+            travel_writer = &GCodeExport::writeTravel<false, false>;
+            extrusion_writer = &GCodeExport::writeExtrusion<false, false>;
+        }
+    }
 }
 
 EGCodeFlavor GCodeExport::getFlavor() const
@@ -496,22 +608,17 @@ void GCodeExport::writeExtrusion(Point p, double speed, double extrusion_mm3_per
 
 void GCodeExport::writeTravel(Point3 p, double speed)
 {
-    if (flavor == EGCodeFlavor::BFB)
-    {
-        writeMoveBFB(p.x, p.y, p.z + isZHopped, speed, 0.0, PrintFeatureType::MoveCombing);
-        return;
-    }
-    writeTravel(p.x, p.y, p.z + isZHopped, speed);
+    (this->*travel_writer)(p.x, p.y, p.z + isZHopped, speed);
 }
 
 void GCodeExport::writeExtrusion(Point3 p, double speed, double extrusion_mm3_per_mm, PrintFeatureType feature)
 {
-    if (flavor == EGCodeFlavor::BFB)
-    {
-        writeMoveBFB(p.x, p.y, p.z, speed, extrusion_mm3_per_mm, feature);
-        return;
-    }
-    writeExtrusion(p.x, p.y, p.z, speed, extrusion_mm3_per_mm, feature);
+    (this->*extrusion_writer)(p.x, p.y, p.z, speed, extrusion_mm3_per_mm, feature);
+}
+
+void GCodeExport::writeTravelBFB(int x, int y, int z, double speed)
+{
+    writeMoveBFB(x, y, z, speed, 0.0, PrintFeatureType::MoveCombing);
 }
 
 void GCodeExport::writeMoveBFB(int x, int y, int z, double speed, double extrusion_mm3_per_mm, PrintFeatureType feature)
@@ -578,6 +685,7 @@ void GCodeExport::writeMoveBFB(int x, int y, int z, double speed, double extrusi
     estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(currentPosition.x), INT2MM(currentPosition.y), INT2MM(currentPosition.z), eToMm(current_e_value)), speed, feature);
 }
 
+template<bool volumetric, bool offset_coords>
 void GCodeExport::writeTravel(int x, int y, int z, double speed)
 {
     if (currentPosition.x == x && currentPosition.y == y && currentPosition.z == z)
@@ -595,9 +703,10 @@ void GCodeExport::writeTravel(int x, int y, int z, double speed)
     CommandSocket::sendLineTo(travel_move_type, Point(x, y), display_width);
 
     *output_stream << "G0";
-    writeFXYZE(speed, x, y, z, current_e_value, PrintFeatureType::MoveCombing);
+    writeFXYZE<volumetric, offset_coords>(speed, x, y, z, current_e_value, PrintFeatureType::MoveCombing);
 }
 
+template<bool volumetric, bool offset_coords>
 void GCodeExport::writeExtrusion(int x, int y, int z, double speed, double extrusion_mm3_per_mm, PrintFeatureType feature)
 {
     if (currentPosition.x == x && currentPosition.y == y && currentPosition.z == z)
@@ -630,7 +739,7 @@ void GCodeExport::writeExtrusion(int x, int y, int z, double speed, double extru
         logWarning("Warning! Negative extrusion move!");
     }
 
-    double extrusion_per_mm = mm3ToE(extrusion_mm3_per_mm);
+    const double extrusion_per_mm = volumetric? extrusion_mm3_per_mm : extrusion_mm3_per_mm / extruder_attr[current_extruder].filament_area; // mm3ToE
 
     Point3 diff = Point3(x,y,z) - currentPosition;
     if (isZHopped > 0)
@@ -643,34 +752,40 @@ void GCodeExport::writeExtrusion(int x, int y, int z, double speed, double extru
     double new_e_value = current_e_value + extrusion_per_mm * diff.vSizeMM();
 
     *output_stream << "G1";
-    writeFXYZE(speed, x, y, z, new_e_value, feature);
+    writeFXYZE<volumetric, offset_coords>(speed, x, y, z, new_e_value, feature);
 }
 
+template<bool volumetric, bool offset_coords>
 void GCodeExport::writeFXYZE(double speed, int x, int y, int z, double e, PrintFeatureType feature)
 {
-    if (currentSpeed != speed)
-    {
-        *output_stream << " F" << PrecisionedDouble{1, speed * 60};
-        currentSpeed = speed;
-    }
-
-    Point gcode_pos = getGcodePos(x, y, current_extruder);
+    const Point gcode_pos = offset_coords? Point(x, y) - getExtruderOffset(current_extruder) : Point(x, y); // getGcodePos
     total_bounding_box.include(Point3(gcode_pos.X, gcode_pos.Y, z));
 
-    *output_stream << " X" << MMtoStream{gcode_pos.X} << " Y" << MMtoStream{gcode_pos.Y};
-    if (z != currentPosition.z)
+    DeferredLayerGCode::Move move;
+    move.write_feedrate = currentSpeed != speed;
+    move.write_z = z != currentPosition.z;
+    move.write_e = e != current_e_value;
+    move.e_character = extruder_attr[current_extruder].extruderCharacter;
+    move.feedrate = speed * 60;
+    move.x = gcode_pos.X;
+    move.y = gcode_pos.Y;
+    move.z = z;
+    move.e = e;
+    if (deferred_layer)
     {
-        *output_stream << " Z" << MMtoStream{z};
+        move.text_pos = static_cast<size_t>(output_stream->tellp());
+        deferred_layer->moves.push_back(move);
     }
-    if (e != current_e_value)
+    else
     {
-        *output_stream << " " << extruder_attr[current_extruder].extruderCharacter << PrecisionedDouble{5, e};
+        move.write(*output_stream, new_line);
     }
-    *output_stream << new_line;
-    
+
+    currentSpeed = speed;
     currentPosition = Point3(x, y, z);
     current_e_value = e;
-    estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(x), INT2MM(y), INT2MM(z), eToMm(e)), speed, feature);
+    const double e_mm = volumetric? e / extruder_attr[current_extruder].filament_area : e; // eToMm
+    estimateCalculator.plan(TimeEstimateCalculator::Position(INT2MM(x), INT2MM(y), INT2MM(z), e_mm), speed, feature);
 }
 
 void GCodeExport::writeUnretractionAndPrime()
@@ -812,6 +927,18 @@ void GCodeExport::writeZhopEnd()
     }
 }
 
+void GCodeExport::startShard(int extruder, const RetractionConfig& retraction_config)
+{
+    current_extruder = extruder;
+    extruder_attr[extruder].is_used = true;
+    extruder_attr[extruder].retraction_e_amount_current = (flavor == EGCodeFlavor::BFB)? 1.0 : mmToE(retraction_config.distance); // 1.0 is a stub, as in writeRetraction
+    resetExtrusionValue();
+    CommandSocket::setExtruderForSend(extruder);
+
+    //Change the Z position so it gets written again. We do not know at which height the previous shard ended.
+    currentPosition.z += 1;
+}
+
 void GCodeExport::startExtruder(int new_extruder)
 {
     if (new_extruder != current_extruder) // wouldn't be the case on the very first extruder start if it's extruder 0
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <deque> // for extrusionAmountAtPreviousRetractions
 #include <sstream> // for stream.str()
+#include <vector>
 
 #include "settings/settings.h"
 #include "utils/intpoint.h"
@@ -30,6 +31,57 @@ struct CoastingConfig
     double coasting_min_volume;  //!< The minimal volume printed to build up enough pressure to leek the coasting_volume
 };
 
+/*!
+ * The gcode of a layer of which the coordinates of the moves haven't been converted to text yet.
+ *
+ * Writing the layers changes the state of GCodeExport (position, E value, extruder, retraction), so they are written in order.
+ * Converting the numbers of the moves to text doesn't depend on that state anymore once the moves are known,
+ * so it's left to \ref DeferredLayerGCode::format, which can be done for several layers in parallel.
+ *
+ * \see GCodeExport::beginDeferredLayer
+ */
+class DeferredLayerGCode : public NoCopy
+{
+    friend class GCodeExport;
+public:
+    /*!
+     * The numbers of a move which come after the G0 or G1.
+     */
+    struct Move
+    {
+        size_t text_pos; //!< The position in the text of the layer at which the move is written
+        bool write_feedrate; //!< Whether the feedrate has changed
+        bool write_z; //!< Whether the z coordinate has changed
+        bool write_e; //!< Whether the E value has changed
+        char e_character; //!< The character of the E value of the extruder
+        double feedrate; //!< The F value in mm/min
+        int64_t x; //!< The x coordinate in gcode, in micron
+        int64_t y; //!< The y coordinate in gcode, in micron
+        int z; //!< The z coordinate, in micron
+        double e; //!< The E value (in mm or mm^3)
+
+        /*!
+         * Write the numbers of the move to gcode.
+         *
+         * \param out The stream to write to
+         * \param new_line The line ending of the gcode
+         */
+        void write(std::ostream& out, const std::string& new_line) const;
+    };
+
+    /*!
+     * Convert the moves to text and insert them into the rest of the gcode of the layer.
+     *
+     * \return The gcode of the layer
+     */
+    std::string format() const;
+
+private:
+    std::ostringstream text; //!< All gcode of the layer except the numbers of the moves
+    std::vector<Move> moves; //!< The moves in the order in which they are written
+    std::string new_line; //!< The line ending of the gcode
+};
+
 
 //The GCodeExport class writes the actual GCode. This is the only class that knows how GCode looks and feels.
 //  Any customizations on GCodes flavors are done in this class.
@@ -93,6 +145,8 @@ private:
 
     std::ostream* output_stream;
     std::string new_line;
+    std::ostream* deferred_output_stream; //!< The output stream while writing the layer given to \ref GCodeExport::beginDeferredLayer
+    DeferredLayerGCode* deferred_layer; //!< The layer to which the moves are recorded, or nullptr to write them directly
 
     double current_e_value; //!< The last E value written to gcode (in mm or mm^3)
     Point3 currentPosition; //!< The last build plate coordinates written to gcode (which might be different from actually written gcode coordinates when the extruder offset is encoded in the gcode)
@@ -177,10 +231,45 @@ public:
      */
     std::string getFileHeader(const std::vector<bool>& extruder_is_used, const double* print_time = nullptr, const std::vector<double>& filament_used = std::vector<double>(), const std::vector<std::string>& mat_ids = std::vector<std::string>());
 
+    /*!
+     * Pad a file header with a comment line up to a size, so that it can overwrite a header of that size written before.
+     *
+     * \param header The file header, see \ref GCodeExport::getFileHeader
+     * \param size The size of the padded header in bytes
+     * \return The padded header, or an empty string if \p header doesn't fit
+     */
+    std::string padFileHeader(const std::string& header, size_t size) const;
+
     void setLayerNr(unsigned int layer_nr);
     
     void setOutputStream(std::ostream* stream);
 
+    /*!
+     * Get the stream to which the gcode is written, other than the gcode of a deferred layer.
+     */
+    std::ostream* getOutputStream() const;
+
+    /*!
+     * Pass all gcode written so far on to the target of the output stream.
+     */
+    void flushOutputStream();
+
+    /*!
+     * Write all gcode to \p layer rather than to the output stream, until \ref GCodeExport::endDeferredLayer.
+     *
+     * The state changes just as when writing to the output stream,
+     * but the numbers of the moves are only converted to text by \ref DeferredLayerGCode::format,
+     * of which the result should then be written to the output stream in the order in which the layers were written.
+     *
+     * \param layer The empty gcode of the layer to write
+     */
+    void beginDeferredLayer(DeferredLayerGCode& layer);
+
+    /*!
+     * Write the gcode to the output stream again, after \ref GCodeExport::beginDeferredLayer.
+     */
+    void endDeferredLayer();
+
     bool getExtruderIsUsed(const int extruder_nr) const; //!< return whether the extruder has been used throughout printing all meshgroup up till now
 
     bool getExtruderUsesTemp(const int extruder_nr) const; //!< Returns whether the extruder with the given index uses temperature control, i.e. whether temperature commands will be included for this extruder
@@ -302,14 +391,35 @@ public:
      */
     void writeExtrusion(Point3 p, double speed, double extrusion_mm3_per_mm, PrintFeatureType feature);
 private:
+    /*!
+     * The function writing the travel moves for the current flavor, see \ref GCodeExport::chooseMoveWriters
+     */
+    void (GCodeExport::*travel_writer)(int x, int y, int z, double speed);
+
+    /*!
+     * The function writing the extrusion moves for the current flavor, see \ref GCodeExport::chooseMoveWriters
+     */
+    void (GCodeExport::*extrusion_writer)(int x, int y, int z, double speed, double extrusion_mm3_per_mm, PrintFeatureType feature);
+
+    /*!
+     * Choose the functions writing the moves, specialized for the flavor and whether the extruder offsets are encoded in the coordinates,
+     * so that these aren't checked for every move.
+     *
+     * Called whenever the flavor or GCodeExport::use_extruder_offset_to_offset_coords change.
+     */
+    void chooseMoveWriters();
+
     /*!
      * Coordinates are build plate coordinates, which might be offsetted when extruder offsets are encoded in the gcode.
      * 
+     * \tparam volumetric Whether the E values are in mm^3, see \ref GCodeExport::is_volumatric
+     * \tparam offset_coords Whether the extruder offsets are encoded in the coordinates, see \ref GCodeExport::getGcodePos
      * \param x build plate x
      * \param y build plate y
      * \param z build plate z
      * \param speed movement speed
      */
+    template<bool volumetric, bool offset_coords>
     void writeTravel(int x, int y, int z, double speed);
 
     /*!
@@ -318,6 +428,8 @@ private:
      * Write extrusion move
      * Coordinates are build plate coordinates, which might be offsetted when extruder offsets are encoded in the gcode.
      * 
+     * \tparam volumetric Whether the E values are in mm^3, see \ref GCodeExport::is_volumatric
+     * \tparam offset_coords Whether the extruder offsets are encoded in the coordinates, see \ref GCodeExport::getGcodePos
      * \param x build plate x
      * \param y build plate y
      * \param z build plate z
@@ -325,6 +437,7 @@ private:
      * \param extrusion_mm3_per_mm flow
      * \param feature the print feature that's currently printing
      */
+    template<bool volumetric, bool offset_coords>
     void writeExtrusion(int x, int y, int z, double speed, double extrusion_mm3_per_mm, PrintFeatureType feature);
 
     /*!
@@ -336,7 +449,11 @@ private:
      * This function updates the \ref GCodeExport::total_bounding_box
      * It estimates the time in \ref GCodeExport::estimateCalculator for the correct feature
      * It updates \ref GCodeExport::currentPosition, \ref GCodeExport::current_e_value and \ref GCodeExport::currentSpeed
+     *
+     * \tparam volumetric Whether the E values are in mm^3, see \ref GCodeExport::is_volumatric
+     * \tparam offset_coords Whether the extruder offsets are encoded in the coordinates, see \ref GCodeExport::getGcodePos
      */
+    template<bool volumetric, bool offset_coords>
     void writeFXYZE(double speed, int x, int y, int z, double e, PrintFeatureType feature);
 
     /*!
@@ -349,6 +466,11 @@ private:
      * \param feature print feature to track print time for
      */
     void writeMoveBFB(int x, int y, int z, double speed, double extrusion_mm3_per_mm, PrintFeatureType feature);
+
+    /*!
+     * The writeTravel when flavor == BFB
+     */
+    void writeTravelBFB(int x, int y, int z, double speed);
 public:
     /*!
      * Get ready for extrusion moves:
@@ -374,6 +496,18 @@ public:
      */
     void writeZhopEnd();
 
+    /*!
+     * Continue the gcode of the previous shard of a print of which the layers are sliced in separate shards,
+     * so that the gcode of the shards can be concatenated.
+     * 
+     * The previous shard ended retracted with \p extruder, at a position which isn't known here.
+     * The E value is zeroed, so that it doesn't matter at which E value the previous shard ended.
+     * 
+     * \param extruder The extruder with which the previous shard ended
+     * \param retraction_config The retraction with which the previous shard ended
+     */
+    void startShard(int extruder, const RetractionConfig& retraction_config);
+
     /*!
      * Start the new_extruder: 
      * - set new extruder
@@ -1,8 +1,13 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include "infill.h"
+#include <algorithm> // sort, unique
+#include <memory> // unique_ptr
 #include "functional"
+#include "utils/linearAlg2D.h"
 #include "utils/polygonUtils.h"
+#include "utils/Profiler.h"
 #include "utils/logoutput.h"
+#include "utils/ThreadPool.h"
 
 namespace cura {
 
@@ -21,7 +26,30 @@ void Infill::generate(Polygons& result_polygons, Polygons& result_lines, const S
 {
     if (in_outline.size() == 0) return;
     if (line_distance == 0) return;
-    Polygons outline_offsetted;
+    Profiler::Zone zone("infill");
+    // the other patterns depend on the layer height, and the perimeter gaps are an output which isn't cached
+    const bool is_cacheable = mesh && !perimeter_gaps
+        && (pattern == EFillMethod::LINES || pattern == EFillMethod::GRID || pattern == EFillMethod::TRIANGLES || pattern == EFillMethod::CONCENTRIC || pattern == EFillMethod::ZIG_ZAG);
+    if (!is_cacheable)
+    {
+        generatePattern(result_polygons, result_lines, mesh);
+        return;
+    }
+    const InfillCache::Parameters parameters = {pattern, outline_offset, infill_line_width, line_distance, infill_overlap, fill_angle, shift, connected_zigzags, use_endpieces};
+    if (mesh->infill_cache->get(parameters, in_outline, result_polygons, result_lines))
+    {
+        return;
+    }
+    Polygons pattern_polygons;
+    Polygons pattern_lines;
+    generatePattern(pattern_polygons, pattern_lines, mesh);
+    mesh->infill_cache->put(parameters, in_outline, pattern_polygons, pattern_lines);
+    result_polygons.add(pattern_polygons);
+    result_lines.add(pattern_lines);
+}
+
+void Infill::generatePattern(Polygons& result_polygons, Polygons& result_lines, const SliceMeshStorage* mesh)
+{
     switch(pattern)
     {
     case EFillMethod::GRID:
@@ -77,21 +105,31 @@ void Infill::generateConcentricInfill(Polygons& result, int inset_value)
 
 void Infill::generateConcentricInfill(Polygons& first_concentric_wall, Polygons& result, int inset_value)
 {
-    result.add(first_concentric_wall);
-    Polygons* prev_inset = &first_concentric_wall;
-    Polygons next_inset;
-    while (prev_inset->size() > 0)
+    // each ring is an offset of the previous one, so the rings are made one after the other
+    std::vector<Polygons> rings;
+    rings.push_back(first_concentric_wall);
+    while (rings.back().size() > 0)
     {
-        next_inset = prev_inset->offset(-inset_value);
-        result.add(next_inset);
-        if (perimeter_gaps)
+        rings.push_back(rings.back().offset(-inset_value));
+    }
+    for (const Polygons& ring : rings)
+    {
+        result.add(ring);
+    }
+    if (perimeter_gaps)
+    {
+        // the gaps between two consecutive rings don't depend on the other rings, so they are computed in parallel
+        std::vector<Polygons> gaps(rings.size() - 1);
+        ThreadPool::parallelFor(0, static_cast<int>(gaps.size()), [&](int ring_idx)
+        {
+            const Polygons outer = rings[ring_idx].offset(-infill_line_width / 2 - perimeter_gaps_extra_offset);
+            const Polygons inner = rings[ring_idx + 1].offset(infill_line_width / 2);
+            gaps[ring_idx] = outer.difference(inner);
+        });
+        for (const Polygons& gaps_here : gaps)
         {
-            const Polygons outer = prev_inset->offset(-infill_line_width / 2 - perimeter_gaps_extra_offset);
-            const Polygons inner = next_inset.offset(infill_line_width / 2);
-            const Polygons gaps_here = outer.difference(inner);
             perimeter_gaps->add(gaps_here);
         }
-        prev_inset = &next_inset;
     }
 }
 
@@ -112,16 +150,13 @@ void Infill::generateConcentric3DInfill(Polygons& result)
 
 void Infill::generateGridInfill(Polygons& result)
 {
-    generateLineInfill(result, line_distance, fill_angle, 0);
-    generateLineInfill(result, line_distance, fill_angle + 90, 0);
+    generateMultiLineInfill(result, line_distance, {{fill_angle, 0}, {fill_angle + 90, 0}});
 }
 
 void Infill::generateCubicInfill(Polygons& result)
 {
     int64_t shift = one_over_sqrt_2 * z;
-    generateLineInfill(result, line_distance, fill_angle, shift);
-    generateLineInfill(result, line_distance, fill_angle + 120, shift);
-    generateLineInfill(result, line_distance, fill_angle + 240, shift);
+    generateMultiLineInfill(result, line_distance, {{fill_angle, shift}, {fill_angle + 120, shift}, {fill_angle + 240, shift}});
 }
 
 void Infill::generateTetrahedralInfill(Polygons& result)
@@ -131,17 +166,12 @@ void Infill::generateTetrahedralInfill(Polygons& result)
     shift = std::min(shift, period - shift); // symmetry due to the fact that we are applying the shift in both directions
     shift = std::min(shift, period / 2 - infill_line_width / 2); // don't put lines too close to each other
     shift = std::max(shift, infill_line_width / 2); // don't put lines too close to each other
-    generateLineInfill(result, period, fill_angle, shift);
-    generateLineInfill(result, period, fill_angle, -shift);
-    generateLineInfill(result, period, fill_angle + 90, shift);
-    generateLineInfill(result, period, fill_angle + 90, -shift);
+    generateMultiLineInfill(result, period, {{fill_angle, shift}, {fill_angle, -shift}, {fill_angle + 90, shift}, {fill_angle + 90, -shift}});
 }
 
 void Infill::generateTriangleInfill(Polygons& result)
 {
-    generateLineInfill(result, line_distance, fill_angle, 0);
-    generateLineInfill(result, line_distance, fill_angle + 60, 0);
-    generateLineInfill(result, line_distance, fill_angle + 120, 0);
+    generateMultiLineInfill(result, line_distance, {{fill_angle, 0}, {fill_angle + 60, 0}, {fill_angle + 120, 0}});
 }
 
 void Infill::generateCubicSubDivInfill(Polygons& result, const SliceMeshStorage& mesh)
@@ -153,54 +183,234 @@ void Infill::generateCubicSubDivInfill(Polygons& result, const SliceMeshStorage&
 
 void Infill::addLineSegmentsInfill(Polygons& result, Polygons& input)
 {
-    ClipperLib::PolyTree interior_segments_tree = in_outline.lineSegmentIntersection(input);
-    ClipperLib::Paths interior_segments;
-    ClipperLib::OpenPathsFromPolyTree(interior_segments_tree, interior_segments);
-    for (uint64_t idx = 0; idx < interior_segments.size(); idx++)
+    AABB outline_box(in_outline);
+    outline_box.expand(1);
+    const double outline_diagonal = vSize(outline_box.max - outline_box.min);
+    const std::unique_ptr<LocToLineGrid> outline_grid(PolygonUtils::createLocToLineGrid(in_outline, std::max(line_distance, static_cast<int>(MM2INT(1.0)))));
+    std::vector<PolygonsPointIndex> crossed_segments;
+    std::vector<double> crossings;
+    for (ConstPolygonRef polyline : input)
     {
-        result.addLine(interior_segments[idx][0], interior_segments[idx][1]);
+        for (unsigned int point_idx = 1; point_idx < polyline.size(); point_idx++)
+        {
+            const Point a = polyline[point_idx - 1];
+            const Point b = polyline[point_idx];
+            if (a == b || !outline_box.hit(AABB(Point(std::min(a.X, b.X), std::min(a.Y, b.Y)), Point(std::max(a.X, b.X) + 1, std::max(a.Y, b.Y) + 1))))
+            {
+                continue;
+            }
+            // Follow the line from a start outside of the polygon, so that each crossing toggles between outside and inside.
+            // The line is extended backwards beyond the bounding box if a lies within it.
+            Point start = a;
+            double a_param = 0.0; // where a lies on the line from start to b
+            if (outline_box.contains(a))
+            {
+                const double extension = (outline_diagonal + 1) / vSize(b - a) + 1;
+                start = a + Point(std::llrint((a.X - b.X) * extension), std::llrint((a.Y - b.Y) * extension));
+                a_param = extension / (extension + 1);
+            }
+            const Point direction = b - start;
+            crossed_segments.clear();
+            outline_grid->processLine(std::make_pair(start, b), [&crossed_segments](const PolygonsPointIndex& segment)
+                {
+                    crossed_segments.push_back(segment);
+                    return true;
+                });
+            // a segment of the polygon can lie in several cells
+            std::sort(crossed_segments.begin(), crossed_segments.end(), [](const PolygonsPointIndex& x, const PolygonsPointIndex& y) { return x.poly_idx < y.poly_idx || (x.poly_idx == y.poly_idx && x.point_idx < y.point_idx); });
+            crossed_segments.erase(std::unique(crossed_segments.begin(), crossed_segments.end()), crossed_segments.end());
+            crossings.clear();
+            for (const PolygonsPointIndex& segment : crossed_segments)
+            {
+                const Point p = segment.p();
+                const Point q = segment.next().p();
+                // a vertex on the line counts as lying on its right, so that the crossings at vertices are counted once
+                const bool p_left = LinearAlg2D::pointIsLeftOfLine(p, start, b) > 0;
+                const bool q_left = LinearAlg2D::pointIsLeftOfLine(q, start, b) > 0;
+                if (p_left == q_left)
+                {
+                    continue;
+                }
+                const Point edge = q - p;
+                const double param = static_cast<double>((p.X - start.X) * edge.Y - (p.Y - start.Y) * edge.X) / static_cast<double>(direction.X * edge.Y - direction.Y * edge.X);
+                if (param >= 0.0 && param <= 1.0)
+                {
+                    crossings.push_back(param);
+                }
+            }
+            std::sort(crossings.begin(), crossings.end());
+            const auto point_at = [&](double param)
+                {
+                    if (param <= a_param)
+                    {
+                        return a;
+                    }
+                    if (param >= 1.0)
+                    {
+                        return b;
+                    }
+                    return start + Point(std::llrint(direction.X * param), std::llrint(direction.Y * param));
+                };
+            for (unsigned int crossing_idx = 0; crossing_idx < crossings.size(); crossing_idx += 2)
+            { // the pieces between an even and the next odd crossing lie inside
+                const double piece_start = crossings[crossing_idx];
+                const double piece_end = (crossing_idx + 1 < crossings.size())? crossings[crossing_idx + 1] : 1.0;
+                if (piece_end <= a_param)
+                {
+                    continue;
+                }
+                const Point from = point_at(piece_start);
+                const Point to = point_at(piece_end);
+                if (from != to)
+                {
+                    result.addLine(from, to);
+                }
+            }
+        }
     }
 }
 
-void Infill::addLineInfill(Polygons& result, const PointMatrix& rotation_matrix, const int scanline_min_idx, const int line_distance, const AABB boundary, std::vector<std::vector<int64_t>>& cut_list, int64_t shift)
+void Infill::addLineInfill(Polygons& result, const PointMatrix& rotation_matrix, const int scanline_min_idx, const int line_distance, const AABB boundary, std::vector<uint64_t>& cuts, int64_t shift)
 {
-    auto compare_int64_t = [](const void* a, const void* b)
+    // a single sort of all intersections orders them per scanline, so that each scanline is a consecutive range of the sorted cuts
+    std::sort(cuts.begin(), cuts.end());
+
+    unsigned int range_start = 0;
+    while (range_start < cuts.size())
     {
-        int64_t n = (*(int64_t*)a) - (*(int64_t*)b);
-        if (n < 0)
+        const unsigned int scanline_offset = cuts[range_start] >> 32;
+        unsigned int range_end = range_start + 1;
+        while (range_end < cuts.size() && (cuts[range_end] >> 32) == scanline_offset)
         {
-            return -1;
+            range_end++;
         }
-        if (n > 0)
+        const int64_t x = (scanline_min_idx + static_cast<int64_t>(scanline_offset)) * line_distance + shift;
+        if (x >= boundary.max.X)
         {
-            return 1;
+            break;
         }
-        return 0;
-    };
-
-    int scanline_idx = 0;
-    for(int64_t x = scanline_min_idx * line_distance + shift; x < boundary.max.X; x += line_distance)
-    {
-        std::vector<int64_t>& crossings = cut_list[scanline_idx];
-        qsort(crossings.data(), crossings.size(), sizeof(int64_t), compare_int64_t);
-        for(unsigned int crossing_idx = 0; crossing_idx + 1 < crossings.size(); crossing_idx += 2)
+        auto decodeY = [&cuts](const unsigned int cut_idx)
         {
-            if (crossings[crossing_idx + 1] - crossings[crossing_idx] < infill_line_width / 5)
+            return static_cast<int64_t>(static_cast<int32_t>(static_cast<uint32_t>(cuts[cut_idx]) ^ 0x80000000u));
+        };
+        for(unsigned int crossing_idx = range_start; crossing_idx + 1 < range_end; crossing_idx += 2)
+        {
+            const int64_t y0 = decodeY(crossing_idx);
+            const int64_t y1 = decodeY(crossing_idx + 1);
+            if (y1 - y0 < infill_line_width / 5)
             { // segment is too short to create infill
                 continue;
             }
-            result.addLine(rotation_matrix.unapply(Point(x, crossings[crossing_idx])), rotation_matrix.unapply(Point(x, crossings[crossing_idx + 1])));
+            result.addLine(rotation_matrix.unapply(Point(x, y0)), rotation_matrix.unapply(Point(x, y1)));
         }
-        scanline_idx += 1;
+        range_start = range_end;
     }
 }
 
 void Infill::generateLineInfill(Polygons& result, int line_distance, const double& fill_angle, int64_t shift)
 {
-    PointMatrix rotation_matrix(fill_angle);
-    NoZigZagConnectorProcessor lines_processor(rotation_matrix, result);
-    bool connected_zigzags = false;
-    generateLinearBasedInfill(outline_offset, result, line_distance, rotation_matrix, lines_processor, connected_zigzags, shift);
+    generateMultiLineInfill(result, line_distance, {{fill_angle, shift}});
+}
+
+void Infill::generateMultiLineInfill(Polygons& result, int line_distance, const std::vector<LineDirection>& directions)
+{
+    if (line_distance == 0 || in_outline.size() == 0)
+    {
+        return;
+    }
+    const Polygons outline = getScanlineOutline(outline_offset);
+    if (outline.size() == 0)
+    {
+        return;
+    }
+
+    Polygons rotated_outline;
+    AABB boundary;
+    std::vector<uint64_t> cuts; // all intersections of scanlines with polygon segments, see Infill::encodeCut
+    for (unsigned int direction_idx = 0; direction_idx < directions.size(); direction_idx++)
+    {
+        const LineDirection& direction = directions[direction_idx];
+        const PointMatrix rotation_matrix(direction.fill_angle);
+        if (direction_idx == 0 || direction.fill_angle != directions[direction_idx - 1].fill_angle)
+        {
+            rotated_outline = outline;
+            rotated_outline.applyMatrix(rotation_matrix);
+            boundary = AABB(rotated_outline);
+        }
+
+        int shift = direction.extra_shift + this->shift;
+        if (shift < 0)
+        {
+            shift = line_distance - (-shift) % line_distance;
+        }
+        else
+        {
+            shift = shift % line_distance;
+        }
+
+        const int scanline_min_idx = computeScanSegmentIdx(boundary.min.X - shift, line_distance);
+        const int line_count = computeScanSegmentIdx(boundary.max.X - shift, line_distance) + 1 - scanline_min_idx;
+        if (line_count <= 0)
+        {
+            continue;
+        }
+
+        // the same crossings as those of Infill::generateLinearBasedInfill
+        cuts.clear();
+        for (ConstPolygonRef poly : rotated_outline)
+        {
+            Point p0 = poly.back();
+            for (const Point& p1 : poly)
+            {
+                if (p1.X == p0.X)
+                {
+                    p0 = p1;
+                    continue;
+                }
+                int scanline_idx0;
+                int scanline_idx1;
+                int step = 1;
+                if (p0.X < p1.X)
+                {
+                    scanline_idx0 = computeScanSegmentIdx(p0.X - shift, line_distance) + 1;
+                    scanline_idx1 = computeScanSegmentIdx(p1.X - shift, line_distance);
+                }
+                else
+                {
+                    step = -1;
+                    scanline_idx0 = computeScanSegmentIdx(p0.X - shift, line_distance);
+                    scanline_idx1 = computeScanSegmentIdx(p1.X - shift, line_distance) + 1;
+                }
+                for (int scanline_idx = scanline_idx0; scanline_idx != scanline_idx1 + step; scanline_idx += step)
+                {
+                    const int x = scanline_idx * line_distance + shift;
+                    const int y = p1.Y + (p0.Y - p1.Y) * (x - p1.X) / (p0.X - p1.X);
+                    assert(scanline_idx - scanline_min_idx >= 0 && scanline_idx - scanline_min_idx < line_count && "reading infill cutlist index out of bounds!");
+                    cuts.push_back(encodeCut(scanline_idx - scanline_min_idx, y));
+                }
+                p0 = p1;
+            }
+        }
+        addLineInfill(result, rotation_matrix, scanline_min_idx, line_distance, boundary, cuts, shift);
+    }
+}
+
+Polygons Infill::getScanlineOutline(const int outline_offset)
+{
+    Polygons outline;
+    if (outline_offset != 0)
+    {
+        outline = in_outline.offset(outline_offset);
+        if (perimeter_gaps)
+        {
+            perimeter_gaps->add(in_outline.difference(outline.offset(infill_line_width / 2 + perimeter_gaps_extra_offset)));
+        }
+    }
+    else
+    {
+        outline = in_outline;
+    }
+    return outline.offset(infill_overlap);
 }
 
 
@@ -251,7 +461,8 @@ void Infill::generateZigZagInfill(Polygons& result, const int line_distance, con
  * Edit: the term scansegment is wrong, since I call a boundary segment leaving from an even scanline to the left as belonging to an even scansegment, 
  *  while I also call a boundary segment leaving from an even scanline toward the right as belonging to an even scansegment.
  */
-void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& result, const int line_distance, const PointMatrix& rotation_matrix, ZigzagConnectorProcessor& zigzag_connector_processor, const bool connected_zigzags, int64_t extra_shift)
+template<typename ZigzagConnectorProcessorType>
+void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& result, const int line_distance, const PointMatrix& rotation_matrix, ZigzagConnectorProcessorType& zigzag_connector_processor, const bool connected_zigzags, int64_t extra_shift)
 {
     if (line_distance == 0)
     {
@@ -264,21 +475,7 @@ void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& resul
 
     int shift = extra_shift + this->shift;
 
-    Polygons outline;
-    if (outline_offset != 0)
-    {
-        outline = in_outline.offset(outline_offset);
-        if (perimeter_gaps)
-        {
-            perimeter_gaps->add(in_outline.difference(outline.offset(infill_line_width / 2 + perimeter_gaps_extra_offset)));
-        }
-    }
-    else
-    {
-        outline = in_outline;
-    }
-
-    outline = outline.offset(infill_overlap);
+    Polygons outline = getScanlineOutline(outline_offset);
 
     if (outline.size() == 0)
     {
@@ -301,12 +498,7 @@ void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& resul
     int scanline_min_idx = computeScanSegmentIdx(boundary.min.X - shift, line_distance);
     int line_count = computeScanSegmentIdx(boundary.max.X - shift, line_distance) + 1 - scanline_min_idx;
 
-    std::vector<std::vector<int64_t> > cut_list; // mapping from scanline to all intersections with polygon segments
-
-    for(int scanline_idx = 0; scanline_idx < line_count; scanline_idx++)
-    {
-        cut_list.push_back(std::vector<int64_t>());
-    }
+    std::vector<uint64_t> cuts; // all intersections of scanlines with polygon segments, see Infill::encodeCut
 
     for(unsigned int poly_idx = 0; poly_idx < outline.size(); poly_idx++)
     {
@@ -347,8 +539,8 @@ void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& resul
             {
                 int x = scanline_idx * line_distance + shift;
                 int y = p1.Y + (p0.Y - p1.Y) * (x - p1.X) / (p0.X - p1.X);
-                assert(scanline_idx - scanline_min_idx >= 0 && scanline_idx - scanline_min_idx < int(cut_list.size()) && "reading infill cutlist index out of bounds!");
-                cut_list[scanline_idx - scanline_min_idx].push_back(y);
+                assert(scanline_idx - scanline_min_idx >= 0 && scanline_idx - scanline_min_idx < line_count && "reading infill cutlist index out of bounds!");
+                cuts.push_back(encodeCut(scanline_idx - scanline_min_idx, y));
                 Point scanline_linesegment_intersection(x, y);
                 zigzag_connector_processor.registerScanlineSegmentIntersection(scanline_linesegment_intersection, scanline_idx % 2 == 0);
             }
@@ -358,16 +550,16 @@ void Infill::generateLinearBasedInfill(const int outline_offset, Polygons& resul
         zigzag_connector_processor.registerPolyFinished();
     }
 
-    if (cut_list.size() == 0)
+    if (line_count <= 0)
     {
         return;
     }
-    if (connected_zigzags && cut_list.size() == 1 && cut_list[0].size() <= 2)
+    if (connected_zigzags && line_count == 1 && cuts.size() <= 2)
     {
         return;  // don't add connection if boundary already contains whole outline!
     }
 
-    addLineInfill(result, rotation_matrix, scanline_min_idx, line_distance, boundary, cut_list, shift);
+    addLineInfill(result, rotation_matrix, scanline_min_idx, line_distance, boundary, cuts, shift);
 }
 
 }//namespace cura
@@ -76,6 +76,9 @@ public:
     /*!
      * Generate the infill.
      * 
+     * When a \p mesh is given, patterns which don't depend on the layer height are looked up in the mesh's infill cache first,
+     * so that layers with the same infill area as a recent layer reuse its pattern.
+     * 
      * \param result_polygons (output) The resulting polygons (from concentric infill)
      * \param result_lines (output) The resulting line segments (from linear infill types)
      * \param mesh The mesh for which to geenrate infill (should only be used for non-helper objects)
@@ -83,6 +86,15 @@ public:
     void generate(Polygons& result_polygons, Polygons& result_lines, const SliceMeshStorage* mesh = nullptr);
 
 private:
+    /*!
+     * Generate the infill pattern, without consulting the infill cache.
+     * 
+     * \param result_polygons (output) The resulting polygons (from concentric infill)
+     * \param result_lines (output) The resulting line segments (from linear infill types)
+     * \param mesh The mesh for which to geenrate infill (should only be used for non-helper objects)
+     */
+    void generatePattern(Polygons& result_polygons, Polygons& result_lines, const SliceMeshStorage* mesh);
+
     /*!
      * Function which returns the scanline_idx for a given x coordinate
      * 
@@ -151,19 +163,35 @@ private:
     void generateCubicSubDivInfill(Polygons& result, const SliceMeshStorage& mesh);
 
     /*!
-     * Convert a mapping from scanline to line_segment-scanline-intersections (\p cut_list) into line segments, using the even-odd rule
+     * Encode a line_segment-scanline-intersection as a single number,
+     * such that sorting the numbers sorts the intersections by scanline first and by y-coordinate second.
+     * 
+     * \param scanline_offset The index of the scanline relative to the lowest scanline crossing the polygon
+     * \param y The y-coordinate (in the space transformed by the rotation matrix) where the polygon crosses the scanline
+     * \return The encoded intersection
+     */
+    static uint64_t encodeCut(const int scanline_offset, const int y)
+    {
+        return (static_cast<uint64_t>(scanline_offset) << 32) | (static_cast<uint32_t>(y) ^ 0x80000000u);
+    }
+
+    /*!
+     * Convert the line_segment-scanline-intersections (\p cuts) into line segments, using the even-odd rule
      * \param result (output) The resulting lines
      * \param rotation_matrix The rotation matrix (un)applied to enforce the angle of the infill 
      * \param scanline_min_idx The lowest index of all scanlines crossing the polygon
      * \param line_distance The distance between two lines which are in the same direction
      * \param boundary The axis aligned boundary box within which the polygon is
-     * \param cut_list A mapping of each scanline to all y-coordinates (in the space transformed by rotation_matrix) where the polygons are crossing the scanline
+     * \param cuts All intersections of all scanlines with the polygons, as encoded by Infill::encodeCut. These are sorted in place.
      * \param total_shift total shift of the scanlines in the direction perpendicular to the fill_angle.
      */
-    void addLineInfill(Polygons& result, const PointMatrix& rotation_matrix, const int scanline_min_idx, const int line_distance, const AABB boundary, std::vector<std::vector<int64_t>>& cut_list, int64_t total_shift);
+    void addLineInfill(Polygons& result, const PointMatrix& rotation_matrix, const int scanline_min_idx, const int line_distance, const AABB boundary, std::vector<uint64_t>& cuts, int64_t total_shift);
 
     /*!
-     * Crop line segments by the infill polygon using Clipper
+     * Crop line segments by the infill polygon.
+     *
+     * Each segment is cut where it crosses the polygon, found through a grid of the segments of the polygon,
+     * and the pieces inside according to the even-odd rule are kept.
      * \param result (output) The resulting lines
      * \param input The line segments to be cropped
      */
@@ -181,6 +209,36 @@ private:
      * \param extra_shift extra shift of the scanlines in the direction perpendicular to the fill_angle
      */
     void generateLineInfill(Polygons& result, int line_distance, const double& fill_angle, int64_t extra_shift);
+
+    /*!
+     * A direction of the lines of Infill::generateMultiLineInfill
+     */
+    struct LineDirection
+    {
+        double fill_angle; //!< The angle of the lines
+        int64_t extra_shift; //!< Extra shift of the scanlines in the direction perpendicular to the fill_angle
+    };
+
+    /*!
+     * Generate lines in several directions, giving the same lines in the same order as generating the lines of each direction in turn.
+     *
+     * The outline is offset only once for all directions and rotated only once for consecutive directions with the same angle,
+     * and the buffer of the scanline crossings is kept between the directions.
+     *
+     * \param result (output) The resulting lines
+     * \param line_distance The distance between two lines which are in the same direction
+     * \param directions The directions of the lines, in the order in which they are added to \p result
+     */
+    void generateMultiLineInfill(Polygons& result, int line_distance, const std::vector<LineDirection>& directions);
+
+    /*!
+     * Get the outline within which the scanlines of the linear based infill patterns are cropped.
+     *
+     * Also adds the perimeter gaps between \ref Infill::in_outline and this outline, if requested.
+     *
+     * \param outline_offset An offset from the reference polygon (Infill::in_outline) to get the actual outline within which to generate infill
+     */
+    Polygons getScanlineOutline(const int outline_offset);
     
     /*!
      * Function for creating linear based infill types (Lines, ZigZag).
@@ -188,8 +246,12 @@ private:
      * This function implements the basic functionality of Infill::generateLineInfill (see doc of that function),
      * but makes calls to a ZigzagConnectorProcessor which handles what to do with each line segment - scanline intersection.
      * 
-     * It is called only from Infill::generateLineinfill and Infill::generateZigZagInfill.
+     * It is called only from Infill::generateZigZagInfill; the plain lines of Infill::generateLineInfill are generated by Infill::generateMultiLineInfill.
+     * 
+     * The processor is a template parameter rather than a ZigzagConnectorProcessor reference,
+     * so that the calls made for each scanline intersection are resolved at compile time.
      * 
+     * \tparam ZigzagConnectorProcessorType The final ZigzagConnectorProcessor class used
      * \param outline_offset An offset from the reference polygon (Infill::in_outline) to get the actual outline within which to generate infill
      * \param result (output) The resulting lines
      * \param line_distance The distance between two lines which are in the same direction
@@ -198,7 +260,8 @@ private:
      * \param connected_zigzags Whether to connect the endpiece zigzag segments on both sides to the same infill line
      * \param extra_shift extra shift of the scanlines in the direction perpendicular to the fill_angle
      */
-    void generateLinearBasedInfill(const int outline_offset, Polygons& result, const int line_distance, const PointMatrix& rotation_matrix, ZigzagConnectorProcessor& zigzag_connector_processor, const bool connected_zigzags, int64_t extra_shift);
+    template<typename ZigzagConnectorProcessorType>
+    void generateLinearBasedInfill(const int outline_offset, Polygons& result, const int line_distance, const PointMatrix& rotation_matrix, ZigzagConnectorProcessorType& zigzag_connector_processor, const bool connected_zigzags, int64_t extra_shift);
 
     /*!
      * 
@@ -0,0 +1,80 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include <functional> // hash
+
+#include "InfillCache.h"
+
+namespace cura
+{
+
+constexpr unsigned int InfillCache::max_entry_count;
+
+bool InfillCache::Parameters::operator==(const Parameters& other) const
+{
+    return pattern == other.pattern
+        && outline_offset == other.outline_offset
+        && infill_line_width == other.infill_line_width
+        && line_distance == other.line_distance
+        && infill_overlap == other.infill_overlap
+        && fill_angle == other.fill_angle
+        && shift == other.shift
+        && connected_zigzags == other.connected_zigzags
+        && use_endpieces == other.use_endpieces;
+}
+
+size_t InfillCache::hash(const Parameters& parameters, const Polygons& area)
+{
+    size_t result = std::hash<int>()(static_cast<int>(parameters.pattern));
+    auto combine = [&result](size_t value)
+    {
+        result ^= value + 0x9e3779b9 + (result << 6) + (result >> 2);
+    };
+    combine(std::hash<int>()(parameters.line_distance));
+    combine(std::hash<double>()(parameters.fill_angle));
+    combine(std::hash<int64_t>()(parameters.shift));
+    for (ConstPolygonRef poly : area)
+    {
+        combine(poly.size());
+        for (const Point& p : poly)
+        {
+            combine(std::hash<ClipperLib::cInt>()(p.X));
+            combine(std::hash<ClipperLib::cInt>()(p.Y));
+        }
+    }
+    return result;
+}
+
+bool InfillCache::get(const Parameters& parameters, const Polygons& area, Polygons& result_polygons, Polygons& result_lines) const
+{
+    const size_t area_hash = hash(parameters, area);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Entry& entry : entries)
+    {
+        if (entry.hash == area_hash && entry.parameters == parameters && entry.area.isIdentical(area))
+        {
+            result_polygons.add(entry.polygons);
+            result_lines.add(entry.lines);
+            return true;
+        }
+    }
+    return false;
+}
+
+void InfillCache::put(const Parameters& parameters, const Polygons& area, const Polygons& polygons, const Polygons& lines)
+{
+    Entry entry;
+    entry.hash = hash(parameters, area);
+    entry.parameters = parameters;
+    entry.area = area;
+    entry.polygons = polygons;
+    entry.lines = lines;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.size() >= max_entry_count)
+    {
+        entries.pop_front();
+    }
+    entries.push_back(std::move(entry));
+}
+
+} // namespace cura
@@ -0,0 +1,91 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef INFILL_INFILL_CACHE_H
+#define INFILL_INFILL_CACHE_H
+
+#include <deque>
+#include <mutex>
+
+#include "../settings/settings.h" // EFillMethod
+#include "../utils/NoCopy.h"
+#include "../utils/polygon.h"
+
+namespace cura
+{
+
+/*!
+ * A cache of the infill patterns generated for a mesh, so that layers with exactly the same infill area don't generate the same pattern again.
+ * 
+ * Prismatic parts often have the same cross section for hundreds of layers,
+ * so that the infill of a layer is the same as that of the layer below, or of the layer below that when the infill angle alternates.
+ * Only the most recently generated patterns are kept.
+ * 
+ * This class is thread safe.
+ */
+class InfillCache : NoCopy
+{
+public:
+    /*!
+     * The parameters of the Infill other than its area, which together with the area completely determine the generated pattern.
+     */
+    struct Parameters
+    {
+        EFillMethod pattern;
+        int outline_offset;
+        int infill_line_width;
+        int line_distance;
+        int infill_overlap;
+        double fill_angle;
+        int64_t shift;
+        bool connected_zigzags;
+        bool use_endpieces;
+
+        bool operator==(const Parameters& other) const;
+    };
+
+    /*!
+     * Look up the pattern generated earlier for the given parameters and area.
+     * 
+     * \param parameters The parameters of the infill
+     * \param area The area in which the infill is generated
+     * \param[out] result_polygons The polygons of the cached pattern are added to this
+     * \param[out] result_lines The lines of the cached pattern are added to this
+     * \return Whether the pattern was found in the cache
+     */
+    bool get(const Parameters& parameters, const Polygons& area, Polygons& result_polygons, Polygons& result_lines) const;
+
+    /*!
+     * Store a generated pattern, evicting the least recently stored pattern if the cache is full.
+     * 
+     * \param parameters The parameters of the infill
+     * \param area The area in which the infill was generated
+     * \param polygons The polygons of the generated pattern
+     * \param lines The lines of the generated pattern
+     */
+    void put(const Parameters& parameters, const Polygons& area, const Polygons& polygons, const Polygons& lines);
+
+private:
+    static constexpr unsigned int max_entry_count = 16; //!< The number of patterns kept
+
+    struct Entry
+    {
+        size_t hash; //!< The hash of the parameters and area, to quickly skip entries which don't match
+        Parameters parameters;
+        Polygons area;
+        Polygons polygons;
+        Polygons lines;
+    };
+
+    /*!
+     * Compute the hash of the parameters and area of an infill pattern.
+     */
+    static size_t hash(const Parameters& parameters, const Polygons& area);
+
+    std::deque<Entry> entries; //!< The cached patterns, from the least to the most recently stored
+    mutable std::mutex mutex; //!< Protects \ref InfillCache::entries
+};
+
+} // namespace cura
+
+#endif // INFILL_INFILL_CACHE_H
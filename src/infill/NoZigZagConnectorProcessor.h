@@ -8,7 +8,7 @@
 namespace cura
 {
 
-class NoZigZagConnectorProcessor : public ZigzagConnectorProcessor
+class NoZigZagConnectorProcessor final : public ZigzagConnectorProcessor
 {
 public:
     NoZigZagConnectorProcessor(const PointMatrix& rotation_matrix, Polygons& result)
@@ -16,9 +16,20 @@ public:
     {
     }
 
-    void registerVertex(const Point& vertex);
-    void registerScanlineSegmentIntersection(const Point& intersection, bool scanline_is_even);
-    void registerPolyFinished();
+    // These are defined here so that they are inlined into Infill::generateLinearBasedInfill.
+    void registerVertex(const Point&)
+    {
+        //No need to add anything.
+    }
+
+    void registerScanlineSegmentIntersection(const Point&, bool)
+    {
+        //No need to add anything.
+    }
+
+    void registerPolyFinished()
+    {
+    }
 };
 
 
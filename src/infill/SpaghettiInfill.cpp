@@ -1,5 +1,8 @@
 /** Copyright (C) 2017 Ultimaker - Released under terms of the AGPLv3 License */
 #include "SpaghettiInfill.h"
+#include "../utils/ThreadPool.h"
+
+#include <algorithm> // binary_search
 
 namespace cura {
 
@@ -21,33 +24,77 @@ void SpaghettiInfill::generateSpaghettiInfill(SliceMeshStorage& mesh)
         connection_inset_dist = tan(mesh.getSettingInAngleRadians("spaghetti_max_infill_angle")) * mesh.getSettingInMicrons("layer_height"); // Horizontal component of the spaghetti_max_infill_angle
     }
 
+    const int bottom_layers = mesh.layer_settings.bottom_layers;
+    if (mesh.layers.size() <= static_cast<size_t>(mesh.layer_settings.top_layers))
+    {
+        return;
+    }
+    size_t max_layer = mesh.layers.size() - 1 - mesh.layer_settings.top_layers;
+
+    // The infill parts and their connections are independent per layer, so they are computed in parallel.
+    // Only keeping track of the pillars themselves is done layer by layer.
+    std::vector<std::vector<InfillPart>> infill_parts_per_layer(max_layer + 1);
+    const int layer_count = max_layer + 1;
+    ThreadPool::parallelFor(bottom_layers, layer_count, [&](int layer_idx)
+    {
+        std::vector<InfillPart>& infill_parts = infill_parts_per_layer[layer_idx];
+        for (SliceLayerPart& slice_layer_part : mesh.layers[layer_idx].parts)
+        {
+            for (PolygonsPart& infill_part : slice_layer_part.getOwnInfillArea().splitIntoPartsByContainment())
+            {
+                infill_parts.emplace_back(std::move(infill_part), slice_layer_part, connection_inset_dist);
+            }
+        }
+    });
+    ThreadPool::parallelFor(bottom_layers, layer_count, [&](int layer_idx)
+    {
+        std::vector<InfillPart>& infill_parts = infill_parts_per_layer[layer_idx];
+        for (unsigned int part_idx = 0; part_idx < infill_parts.size(); part_idx++)
+        {
+            InfillPart& infill_part = infill_parts[part_idx];
+            if (layer_idx > bottom_layers)
+            { // where the pillars of the layer below end
+                const std::vector<InfillPart>& infill_parts_below = infill_parts_per_layer[layer_idx - 1];
+                for (unsigned int below_part_idx = 0; below_part_idx < infill_parts_below.size(); below_part_idx++)
+                {
+                    if (infill_part.isConnected(infill_parts_below[below_part_idx]))
+                    {
+                        infill_part.connected_below.push_back(below_part_idx);
+                    }
+                }
+            }
+            for (unsigned int before_part_idx = 0; before_part_idx < part_idx; before_part_idx++)
+            { // where the pillars end which already got a part of this layer added
+                if (infill_part.isConnected(infill_parts[before_part_idx]))
+                {
+                    infill_part.connected_before.push_back(before_part_idx);
+                }
+            }
+        }
+    });
+
     std::list<SpaghettiInfill::InfillPillar> pillar_base;
     coord_t current_z = 0;
 
-    size_t max_layer = mesh.layers.size() - 1 - mesh.getSettingAsCount("top_layers");
     for (size_t layer_idx = 0; layer_idx <= max_layer; layer_idx++) //Skip every few layers, but extrude more.
     {
         const coord_t layer_height = (layer_idx == 0)? mesh.getSettingInMicrons("layer_height_0") : mesh.getSettingInMicrons("layer_height");
         current_z += layer_height;
-        if (static_cast<int>(layer_idx) < mesh.getSettingAsCount("bottom_layers"))
+        if (static_cast<int>(layer_idx) < bottom_layers)
         { // nothing to add to pillar base
             continue;
         }
-        SliceLayer& layer = mesh.layers[layer_idx];
 
         // add infill parts to pillar_base
-        for (SliceLayerPart& slice_layer_part : layer.parts)
+        const std::vector<InfillPart>& infill_parts = infill_parts_per_layer[layer_idx];
+        for (unsigned int part_idx = 0; part_idx < infill_parts.size(); part_idx++)
         {
-            std::vector<PolygonsPart> part_infill_parts = slice_layer_part.getOwnInfillArea().splitIntoParts();
-
-            // add parts to pillar_base
-            for (PolygonsPart& infill_part : part_infill_parts)
-            {
-                coord_t bottom_z = current_z - layer_height;
-                SpaghettiInfill::InfillPillar& pillar = addPartToPillarBase(infill_part, pillar_base, connection_inset_dist, layer_height, bottom_z);
-                pillar.top_slice_layer_part = &slice_layer_part;
-                pillar.last_layer_added = layer_idx;
-            }
+            const InfillPart& infill_part = infill_parts[part_idx];
+            coord_t bottom_z = current_z - layer_height;
+            SpaghettiInfill::InfillPillar& pillar = addPartToPillarBase(infill_part, layer_idx, pillar_base, connection_inset_dist, layer_height, bottom_z);
+            pillar.top_slice_layer_part = infill_part.slice_layer_part;
+            pillar.last_layer_added = layer_idx;
+            pillar.top_part_idx = part_idx;
         }
 
 
@@ -102,10 +149,22 @@ void SpaghettiInfill::InfillPillar::addToTopSliceLayerPart(coord_t filling_area_
     slice_layer_part.spaghetti_infill_volumes.emplace_back(filling_area, volume);
 }
 
-bool SpaghettiInfill::InfillPillar::isConnected(const PolygonsPart& infill_part) const
+SpaghettiInfill::InfillPart::InfillPart(PolygonsPart&& part, SliceLayerPart& slice_layer_part, coord_t connection_inset_dist)
+: part(std::move(part))
+, slice_layer_part(&slice_layer_part)
+, aabb(this->part)
+, connection_area(this->part.offset(-connection_inset_dist))
+, connection_aabb(connection_area)
 {
-    Polygons insetted = infill_part.offset(-connection_inset_dist);
-    if (insetted.intersection(top_part).size() > 0)
+}
+
+bool SpaghettiInfill::InfillPart::isConnected(const InfillPart& top_part) const
+{
+    if (connection_area.size() == 0 || !connection_aabb.hit(top_part.aabb))
+    {
+        return false;
+    }
+    if (connection_area.intersection(top_part.part).size() > 0)
     {
         return true;
     }
@@ -115,16 +174,18 @@ bool SpaghettiInfill::InfillPillar::isConnected(const PolygonsPart& infill_part)
     }
 }
 
-SpaghettiInfill::InfillPillar& SpaghettiInfill::addPartToPillarBase(const PolygonsPart& infill_part, std::list<SpaghettiInfill::InfillPillar>& pillar_base, coord_t connection_inset_dist, int layer_height, coord_t bottom_z)
+SpaghettiInfill::InfillPillar& SpaghettiInfill::addPartToPillarBase(const InfillPart& infill_part, int layer_idx, std::list<SpaghettiInfill::InfillPillar>& pillar_base, coord_t connection_inset_dist, int layer_height, coord_t bottom_z)
 {
     std::list<SpaghettiInfill::InfillPillar>::iterator ret = pillar_base.end();
     for (auto it = pillar_base.begin(); it != pillar_base.end(); ++it)
     {
         InfillPillar& pillar = *it;
-        if (pillar.isConnected(infill_part))
+        // the top of each pillar is either on the layer below or already on this layer
+        const std::vector<unsigned int>& connected_parts = (pillar.last_layer_added == layer_idx)? infill_part.connected_before : infill_part.connected_below;
+        if (std::binary_search(connected_parts.begin(), connected_parts.end(), pillar.top_part_idx))
         {
-            pillar.total_volume_mm3 += INT2MM(INT2MM(infill_part.area())) * INT2MM(layer_height);
-            pillar.top_part = infill_part;
+            pillar.total_volume_mm3 += INT2MM(INT2MM(infill_part.part.area())) * INT2MM(layer_height);
+            pillar.top_part = infill_part.part;
             if (ret != pillar_base.end())
             { // connecting two pillars of the layer below via one area on this layer
                 pillar.total_volume_mm3 += ret->total_volume_mm3;
@@ -135,7 +196,7 @@ SpaghettiInfill::InfillPillar& SpaghettiInfill::addPartToPillarBase(const Polygo
     }
     if (ret == pillar_base.end())
     { // couldn't connect to any existing pillar
-        pillar_base.emplace_back(infill_part, connection_inset_dist, layer_height, bottom_z);
+        pillar_base.emplace_back(infill_part.part, connection_inset_dist, layer_height, bottom_z);
         return pillar_base.back();
     }
     return *ret;
@@ -4,6 +4,7 @@
 
 #include <list>
 
+#include "../utils/AABB.h"
 #include "../utils/intpoint.h"
 #include "../utils/polygon.h"
 #include "../sliceDataStorage.h"
@@ -32,6 +33,35 @@ public:
     static void generateSpaghettiInfill(SliceMeshStorage& mesh);
 
 protected:
+    /*!
+     * A single connected infill area of a layer, together with the data to check connectivity with other infill areas
+     */
+    struct InfillPart
+    {
+        PolygonsPart part; //!< The infill area
+        SliceLayerPart* slice_layer_part; //!< The slice_layer_part of which the \ref InfillPart::part is (a piece of) the infill area
+        AABB aabb; //!< The bounding box of \ref InfillPart::part
+        Polygons connection_area; //!< The \ref InfillPart::part insetted by the connection_inset_dist; the part is connected to the areas it intersects with
+        AABB connection_aabb; //!< The bounding box of \ref InfillPart::connection_area
+        std::vector<unsigned int> connected_below; //!< The ascending indices of the infill parts on the layer below which this part is connected to
+        std::vector<unsigned int> connected_before; //!< The ascending indices of the infill parts before this part on the same layer which this part is connected to
+
+        /*!
+         * \param part The infill area
+         * \param slice_layer_part The slice_layer_part of which the \p part is (a piece of) the infill area
+         * \param connection_inset_dist Horizontal component of the spaghetti_max_infill_angle
+         */
+        InfillPart(PolygonsPart&& part, SliceLayerPart& slice_layer_part, coord_t connection_inset_dist);
+
+        /*!
+         * Check whether this part is connected (enough) to the given \p top_part.
+         * 
+         * \param top_part The part to check for connectivity, which is the top of a pillar which this part might be incorporated in
+         * \return Whether this part can be incorporated in the pillar with \p top_part as top
+         */
+        bool isConnected(const InfillPart& top_part) const;
+    };
+
     class InfillPillar
     {
     public:
@@ -41,6 +71,7 @@ protected:
         coord_t connection_inset_dist; //!< Horizontal component of the spaghetti_max_infill_angle: the distance insetted corresponding to the maximum angle which can be filled by spaghetti infill.
         coord_t bottom_z; //!< The z coordinate of the bottom of the first layer this pillar is present in
         int last_layer_added = -1; //!< The last layer from which areas got added to this pillar
+        unsigned int top_part_idx = 0; //!< The index of the top part among the infill parts of the layer \ref InfillPillar::last_layer_added
 
         /*!
          * Basic constructor of a pillar from a single area, which is to be the top of the new pillar
@@ -58,15 +89,6 @@ protected:
         {
         }
 
-        /*!
-         * Check whether the top of this pillar is connected (enough) to the given \p infill_part.
-         * It is assumed the infill_part is on the layer directly above the top part of this pillar.
-         * 
-         * \param infill_part The part to check for connectivity
-         * \return Whether the infill part can be incorporated in this pillar
-         */
-        bool isConnected(const PolygonsPart& infill_part) const;
-
         /*!
          * Register the volume of this infill pillar in the sliceDataStorage.
          * The filling area and the volume are saved in \ref SliceLayerPart::spaghetti_infill_volumes
@@ -86,12 +108,13 @@ private:
      * The pillar to which the area was added is returned
      * 
      * \param infill_part The area to add to the base
+     * \param layer_idx The layer which contains the \p infill_part
      * \param pillar_base The collection of pillars used up till the current layer
      * \param connection_inset_dist The distance insetted corresponding to the maximum angle which can be filled by spaghetti infill
      * \param layer_height The layer height of the added area
      * \param bottom_z The z coordinate of the bottom of the layer which contains the \p infill_part
      */
-    static InfillPillar& addPartToPillarBase(const PolygonsPart& infill_part, std::list<InfillPillar>& pillar_base, coord_t connection_inset_dist, int layer_height, coord_t bottom_z);
+    static InfillPillar& addPartToPillarBase(const InfillPart& infill_part, int layer_idx, std::list<InfillPillar>& pillar_base, coord_t connection_inset_dist, int layer_height, coord_t bottom_z);
 };
 
 }//namespace cura
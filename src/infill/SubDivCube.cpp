@@ -1,10 +1,12 @@
 #include "SubDivCube.h"
 
 #include <functional>
+#include <limits>
 
 #include "../utils/polygonUtils.h"
 #include "../sliceDataStorage.h"
 #include "../utils/math.h"
+#include "../utils/ThreadPool.h"
 
 #define ONE_OVER_SQRT_2 0.7071067811865475244008443621048490392848359376884740 //1 / sqrt(2)
 #define ONE_OVER_SQRT_3 0.577350269189625764509148780501957455647601751270126876018 //1 / sqrt(3)
@@ -14,6 +16,8 @@
 namespace cura
 {
 
+constexpr unsigned int min_task_depth = 3; //!< the smallest depth of a cube of which the children are constructed in parallel tasks; smaller subtrees aren't worth a task
+
 std::vector<SubDivCube::CubeProperties> SubDivCube::cube_properties_per_recursion_step;
 int32_t SubDivCube::radius_addition = 0;
 Point3Matrix SubDivCube::rotation_matrix;
@@ -77,7 +81,84 @@ void SubDivCube::precomputeOctree(SliceMeshStorage& mesh)
 
     rotation_matrix = infill_angle_mat.compose(tilt);
 
-    mesh.base_subdiv_cube = new SubDivCube(mesh, center, curr_recursion_depth - 1);
+    LayerBorders layer_borders;
+    layer_borders.layer_height = mesh.getSettingInMicrons("layer_height");
+    // the smallest spheres tested are those around the children of the cubes at depth 1
+    layer_borders.grid_cell_size = std::max(coord_t(infill_line_distance), (cube_properties_per_recursion_step.size() > 1)? coord_t(double(cube_properties_per_recursion_step[1].height) / 4.0 + radius_addition) : coord_t(0));
+    int layer_count = mesh.layers.size();
+    layer_borders.borders_per_layer.resize(layer_count);
+    layer_borders.loc_to_line_per_layer.resize(layer_count);
+    ThreadPool::parallelFor(0, layer_count, [&](int layer_nr)
+    {
+        Polygons& borders = layer_borders.borders_per_layer[layer_nr];
+        mesh.layers[layer_nr].getSecondOrInnermostWalls(borders);
+        layer_borders.loc_to_line_per_layer[layer_nr].reset(PolygonUtils::createLocToLineGrid(borders, layer_borders.grid_cell_size));
+    });
+
+    mesh.base_subdiv_cube = new SubDivCube(layer_borders, center, curr_recursion_depth - 1);
+    if (!cube_properties_per_recursion_step.empty())
+    {
+        mesh.base_subdiv_cube->flatten();
+    }
+}
+
+void SubDivCube::flatten()
+{
+    collectNodes(nodes);
+    for (int child_idx = 0; child_idx < 8; child_idx++)
+    {
+        delete children[child_idx];
+        children[child_idx] = nullptr;
+    }
+
+    // the lines of a cube are drawn within max_draw_z_diff of its center, so the smallest cubes occur in no more than three ranges
+    z_range_height = std::max(int64_t(1), cube_properties_per_recursion_step[0].max_draw_z_diff);
+    z_ranges_bottom = std::numeric_limits<coord_t>::max();
+    coord_t z_ranges_top = std::numeric_limits<coord_t>::min();
+    for (const Node& node : nodes)
+    {
+        const int64_t max_draw_z_diff = cube_properties_per_recursion_step[node.depth].max_draw_z_diff;
+        z_ranges_bottom = std::min(z_ranges_bottom, coord_t(node.center.z - max_draw_z_diff));
+        z_ranges_top = std::max(z_ranges_top, coord_t(node.center.z + max_draw_z_diff));
+    }
+    const unsigned int z_range_count = (z_ranges_top - z_ranges_bottom) / z_range_height + 1;
+    const auto for_each_z_range = [this](const Node& node, const std::function<void (unsigned int)>& func)
+    {
+        const int64_t max_draw_z_diff = cube_properties_per_recursion_step[node.depth].max_draw_z_diff;
+        const unsigned int first_z_range = (node.center.z - max_draw_z_diff - z_ranges_bottom) / z_range_height;
+        const unsigned int last_z_range = (node.center.z + max_draw_z_diff - z_ranges_bottom) / z_range_height;
+        for (unsigned int z_range = first_z_range; z_range <= last_z_range; z_range++)
+        {
+            func(z_range);
+        }
+    };
+    z_range_start.assign(z_range_count + 1, 0);
+    for (const Node& node : nodes)
+    {
+        for_each_z_range(node, [this](unsigned int z_range) { z_range_start[z_range + 1]++; });
+    }
+    for (unsigned int z_range = 0; z_range < z_range_count; z_range++)
+    {
+        z_range_start[z_range + 1] += z_range_start[z_range];
+    }
+    z_range_nodes.resize(z_range_start.back());
+    std::vector<unsigned int> z_range_end(z_range_start.begin(), z_range_start.end() - 1);
+    for (unsigned int node_idx = 0; node_idx < nodes.size(); node_idx++)
+    {
+        for_each_z_range(nodes[node_idx], [this, &z_range_end, node_idx](unsigned int z_range) { z_range_nodes[z_range_end[z_range]++] = node_idx; });
+    }
+}
+
+void SubDivCube::collectNodes(std::vector<Node>& result) const
+{
+    result.push_back(Node{center, depth});
+    for (int child_idx = 0; child_idx < 8; child_idx++)
+    {
+        if (children[child_idx])
+        {
+            children[child_idx]->collectNodes(result);
+        }
+    }
 }
 
 void SubDivCube::generateSubdivisionLines(int64_t z, Polygons& result)
@@ -88,7 +169,14 @@ void SubDivCube::generateSubdivisionLines(int64_t z, Polygons& result)
     }
     Polygons directional_line_groups[3];
 
-    generateSubdivisionLines(z, result, directional_line_groups);
+    if (z >= z_ranges_bottom && z < z_ranges_bottom + int64_t(z_range_start.size() - 1) * z_range_height)
+    {
+        const unsigned int z_range = (z - z_ranges_bottom) / z_range_height;
+        for (unsigned int range_node_idx = z_range_start[z_range]; range_node_idx < z_range_start[z_range + 1]; range_node_idx++)
+        {
+            generateSubdivisionLines(nodes[z_range_nodes[range_node_idx]], z, directional_line_groups);
+        }
+    }
 
     for (int dir_idx = 0; dir_idx < 3; dir_idx++)
     {
@@ -100,15 +188,12 @@ void SubDivCube::generateSubdivisionLines(int64_t z, Polygons& result)
     }
 }
 
-void SubDivCube::generateSubdivisionLines(int64_t z, Polygons& result, Polygons (&directional_line_groups)[3])
+void SubDivCube::generateSubdivisionLines(const Node& node, int64_t z, Polygons (&directional_line_groups)[3])
 {
-    CubeProperties cube_properties = cube_properties_per_recursion_step[depth];
+    const CubeProperties& cube_properties = cube_properties_per_recursion_step[node.depth];
+    const Point3& center = node.center;
 
     int32_t z_diff = std::abs(z - center.z); //!< the difference between the cube center and the target layer.
-    if (z_diff > cube_properties.height / 2) //!< this cube does not touch the target layer. Early exit.
-    {
-        return;
-    }
     if (z_diff < cube_properties.max_draw_z_diff) //!< this cube has lines that need to be drawn.
     {
         Point relative_a, relative_b; //!< relative coordinates of line endpoints around cube center
@@ -133,16 +218,9 @@ void SubDivCube::generateSubdivisionLines(int64_t z, Polygons& result, Polygons
             }
         }
     }
-    for (int idx = 0; idx < 8; idx++) //!< draws the eight children
-    {
-        if (children[idx] != nullptr)
-        {
-            children[idx]->generateSubdivisionLines(z, result, directional_line_groups);
-        }
-    }
 }
 
-SubDivCube::SubDivCube(SliceMeshStorage& mesh, Point3& center, unsigned int depth)
+SubDivCube::SubDivCube(const LayerBorders& layer_borders, Point3& center, unsigned int depth)
 {
     this->depth = depth;
     this->center = center;
@@ -157,10 +235,8 @@ SubDivCube::SubDivCube(SliceMeshStorage& mesh, Point3& center, unsigned int dept
     }
 
     CubeProperties cube_properties = cube_properties_per_recursion_step[depth];
-    Point3 child_center;
     coord_t radius = double(cube_properties.height) / 4.0 + radius_addition;
 
-    int child_nr = 0;
     std::vector<Point3> rel_child_centers;
     rel_child_centers.emplace_back(1, 1, 1); // top
     rel_child_centers.emplace_back(-1, 1, 1); // top three
@@ -170,18 +246,40 @@ SubDivCube::SubDivCube(SliceMeshStorage& mesh, Point3& center, unsigned int dept
     rel_child_centers.emplace_back(1, -1, -1); // bottom three
     rel_child_centers.emplace_back(-1, 1, -1);
     rel_child_centers.emplace_back(-1, -1, 1);
-    for (Point3 rel_child_center : rel_child_centers)
+    SubDivCube* valid_children[8] = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr}; //!< The children in the order of rel_child_centers (nullptr for the cubes which aren't subdivided)
+    ThreadPool::TaskGroup child_tasks;
+    for (unsigned int child_idx = 0; child_idx < 8; child_idx++)
     {
-        child_center = center + rotation_matrix.apply(rel_child_center * int32_t(cube_properties.side_length / 4));
-        if (isValidSubdivision(mesh, child_center, radius))
+        Point3 child_center = center + rotation_matrix.apply(rel_child_centers[child_idx] * int32_t(cube_properties.side_length / 4));
+        const std::function<void ()> create_child = [&layer_borders, &valid_children, child_idx, child_center, radius, depth]() mutable
+            {
+                if (isValidSubdivision(layer_borders, child_center, radius))
+                {
+                    valid_children[child_idx] = new SubDivCube(layer_borders, child_center, depth - 1);
+                }
+            };
+        if (depth >= min_task_depth && ThreadPool::getThreadCount() > 1)
+        {
+            child_tasks.run(create_child);
+        }
+        else
+        {
+            create_child();
+        }
+    }
+    child_tasks.wait();
+    int child_nr = 0;
+    for (SubDivCube* child : valid_children)
+    {
+        if (child)
         {
-            children[child_nr] = new SubDivCube(mesh, child_center, depth - 1);
+            children[child_nr] = child;
             child_nr++;
         }
     }
 }
 
-bool SubDivCube::isValidSubdivision(SliceMeshStorage& mesh, Point3& center, int64_t radius)
+bool SubDivCube::isValidSubdivision(const LayerBorders& layer_borders, Point3& center, int64_t radius)
 {
     int64_t distance2 = 0;
     coord_t sphere_slice_radius2;//!< squared radius of bounding sphere slice on target layer
@@ -189,7 +287,7 @@ bool SubDivCube::isValidSubdivision(SliceMeshStorage& mesh, Point3& center, int6
     bool outside_somewhere = false;
     int inside;
     double part_dist;//what percentage of the radius the target layer is away from the center along the z axis. 0 - 1
-    const coord_t layer_height = mesh.getSettingInMicrons("layer_height");
+    const coord_t layer_height = layer_borders.layer_height;
     int bottom_layer = (center.z - radius) / layer_height;
     int top_layer = (center.z + radius) / layer_height;
     for (int test_layer = bottom_layer; test_layer <= top_layer; test_layer += 3) // steps of three. Low-hanging speed gain.
@@ -198,7 +296,7 @@ bool SubDivCube::isValidSubdivision(SliceMeshStorage& mesh, Point3& center, int6
         sphere_slice_radius2 = radius * radius * (1.0 - (part_dist * part_dist));
         Point loc(center.x, center.y);
 
-        inside = distanceFromPointToMesh(mesh, test_layer, loc, &distance2);
+        inside = distanceFromPointToMesh(layer_borders, test_layer, loc, sphere_slice_radius2, &distance2);
         if (inside == 1)
         {
             inside_somewhere = true;
@@ -219,20 +317,33 @@ bool SubDivCube::isValidSubdivision(SliceMeshStorage& mesh, Point3& center, int6
     return false;
 }
 
-int SubDivCube::distanceFromPointToMesh(SliceMeshStorage& mesh, int layer_nr, Point& location, int64_t* distance2)
+int SubDivCube::distanceFromPointToMesh(const LayerBorders& layer_borders, int layer_nr, Point& location, int64_t max_dist2, int64_t* distance2)
 {
-    if (layer_nr < 0 || (unsigned int)layer_nr >= mesh.layers.size()) //!< this layer is outside of valid range
+    if (layer_nr < 0 || (unsigned int)layer_nr >= layer_borders.borders_per_layer.size()) //!< this layer is outside of valid range
     {
         return 2;
         *distance2 = 0;
     }
-    Polygons collide;
-    mesh.layers[layer_nr].getSecondOrInnermostWalls(collide);
-    Point centerpoint = location;
-    bool inside = collide.inside(centerpoint);
-    ClosestPolygonPoint border_point = PolygonUtils::moveInside2(collide, centerpoint);
-    Point diff = border_point.location - location;
-    *distance2 = vSize2(diff);
+    const Polygons& collide = layer_borders.borders_per_layer[layer_nr];
+    bool inside = collide.inside(location);
+    const int64_t cell_size2 = layer_borders.grid_cell_size * layer_borders.grid_cell_size;
+    // all line segments within one cell size from the location are visited, so if the closest of those is that close it's the closest of all
+    std::optional<ClosestPolygonPoint> border_point = PolygonUtils::findClose(location, collide, *layer_borders.loc_to_line_per_layer[layer_nr]);
+    if (border_point && vSize2(border_point->location - location) <= cell_size2)
+    {
+        *distance2 = vSize2(border_point->location - location);
+    }
+    else if (max_dist2 <= cell_size2 && collide.size() > 0)
+    { // the border is further away than the distance which matters
+        *distance2 = max_dist2;
+    }
+    else
+    {
+        Point centerpoint = location;
+        ClosestPolygonPoint border_point = PolygonUtils::moveInside2(collide, centerpoint);
+        Point diff = border_point.location - location;
+        *distance2 = vSize2(diff);
+    }
     if (inside)
     {
         return 1;
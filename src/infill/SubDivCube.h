@@ -1,7 +1,10 @@
 #ifndef INFILL_SUBDIVCUBE_H
 #define INFILL_SUBDIVCUBE_H
 
+#include <memory> // unique_ptr
+
 #include "../sliceDataStorage.h"
+#include "../utils/polygonUtils.h"
 
 namespace cura
 {
@@ -10,15 +13,29 @@ class Infill;
 
 class SubDivCube
 {
-public:
+    /*!
+     * The infill borders of each layer of a mesh, against which the cubes are tested while building the octree.
+     */
+    struct LayerBorders
+    {
+        std::vector<Polygons> borders_per_layer; //!< The second or innermost walls of each layer
+        std::vector<std::unique_ptr<LocToLineGrid>> loc_to_line_per_layer; //!< For each layer the mapping from locations to the nearby line segments of its borders
+        coord_t grid_cell_size; //!< The cell size of the grids in \ref LayerBorders::loc_to_line_per_layer
+        coord_t layer_height; //!< The layer height of the mesh
+    };
+
     /*!
      * Constructor for SubDivCube. Recursively calls itself eight times to flesh out the octree.
-     * \param mesh contains infill layer data and settings
+     *
+     * The children of the cubes above a certain depth are constructed in parallel tasks.
+     *
+     * \param layer_borders The infill borders of each layer
      * \param my_center the center of the cube
      * \param depth the recursion depth of the cube (0 is most recursed)
      */
-    SubDivCube(SliceMeshStorage& mesh, Point3& center, unsigned int depth);
+    SubDivCube(const LayerBorders& layer_borders, Point3& center, unsigned int depth);
 
+public:
     ~SubDivCube(); //!< destructor (also destroys children
 
     /*!
@@ -27,19 +44,45 @@ public:
      */
     static void precomputeOctree(SliceMeshStorage& mesh);
     /*!
-     * Generates the lines of subdivision of the specific cube at the specific layer. It recursively calls itself, so it ends up drawing all the subdivision lines of sub-cubes too.
+     * Generates the lines of subdivision of all cubes of the octree at the specific layer.
+     *
+     * Only the cubes in the range of heights of the layer are visited.
+     *
+     * \warning Should only be called on the root of the octree, which stores the flattened octree.
+     *
      * \param z the specified layer height
      * \param result (output) The resulting lines
      */
     void generateSubdivisionLines(int64_t z, Polygons& result);
 private:
     /*!
-     * Generates the lines of subdivision of the specific cube at the specific layer. It recursively calls itself, so it ends up drawing all the subdivision lines of sub-cubes too.
+     * A cube of the flattened octree
+     */
+    struct Node
+    {
+        Point3 center; //!< center location of the cube in absolute coordinates
+        unsigned int depth; //!< the recursion depth of the cube (0 is most recursed)
+    };
+
+    /*!
+     * Store the octree below this cube in SubDivCube::nodes and SubDivCube::z_range_nodes, and delete the child cubes.
+     */
+    void flatten();
+
+    /*!
+     * Add this cube and all cubes below it to \p result, in the depth-first order in which the lines of the cubes used to be generated.
+     *
+     * \param[out] result Where to add the cubes to
+     */
+    void collectNodes(std::vector<Node>& result) const;
+
+    /*!
+     * Generates the lines of subdivision of a single cube at the specific layer.
+     * \param node The cube
      * \param z the specified layer height
-     * \param result (output) The resulting lines
      * \param directional_line_groups Array of 3 times a polylines. Used to keep track of line segments that are all pointing the same direction for line segment combining
      */
-    void generateSubdivisionLines(int64_t z, Polygons& result, Polygons (&directional_line_groups)[3]);
+    static void generateSubdivisionLines(const Node& node, int64_t z, Polygons (&directional_line_groups)[3]);
     struct CubeProperties
     {
         int64_t side_length; //!< side length of cubes
@@ -60,21 +103,26 @@ private:
     static void rotatePointInitial(Point& target);
     /*!
      * Determines if a described theoretical cube should be subdivided based on if a sphere that encloses the cube touches the infill mesh.
-     * \param mesh contains infill layer data and settings
+     * \param layer_borders The infill borders of each layer
      * \param center the center of the described cube
      * \param radius the radius of the enclosing sphere
      * \return the described cube should be subdivided
      */
-    static bool isValidSubdivision(SliceMeshStorage& mesh, Point3& center, int64_t radius);
+    static bool isValidSubdivision(const LayerBorders& layer_borders, Point3& center, int64_t radius);
     /*!
      * Finds the distance to the infill border at the specified layer from the specified point.
-     * \param mesh contains infill layer data and settings
+     *
+     * The distance is only computed exactly when it is smaller than \p max_dist2,
+     * which is the only case in which the exact distance matters.
+     *
+     * \param layer_borders The infill borders of each layer
      * \param layer_nr the number of the specified layer
      * \param location the location of the specified point
-     * \param[out] distance2 the squared distance to the infill border
+     * \param max_dist2 The squared distance up to which \p distance2 has to be exact
+     * \param[out] distance2 the squared distance to the infill border, or a value no smaller than \p max_dist2 if the border is further away
      * \return Code 0: outside, 1: inside, 2: boundary does not exist at specified layer
      */
-    static int distanceFromPointToMesh(SliceMeshStorage& mesh, int layer_nr, Point& location, int64_t* distance2);
+    static int distanceFromPointToMesh(const LayerBorders& layer_borders, int layer_nr, Point& location, int64_t max_dist2, int64_t* distance2);
 
     /*!
      * Adds the defined line to the specified polygons. It assumes that the specified polygons are all parallel lines. Combines line segments with touching ends closer than epsilon.
@@ -82,11 +130,16 @@ private:
      * \param from the first endpoint of the line
      * \param to the second endpoint of the line
      */
-    void addLineAndCombine(Polygons& group, Point from, Point to);
+    static void addLineAndCombine(Polygons& group, Point from, Point to);
 
     unsigned int depth; //!< the recursion depth of the cube (0 is most recursed)
     Point3 center; //!< center location of the cube in absolute coordinates
-    SubDivCube* children[8] = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr}; //!< pointers to this cube's eight octree children
+    SubDivCube* children[8] = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr}; //!< pointers to this cube's eight octree children (only while constructing the octree)
+    std::vector<Node> nodes; //!< All cubes of the flattened octree in depth-first order (only in the root)
+    coord_t z_range_height; //!< The height of each range of heights in SubDivCube::z_range_nodes
+    coord_t z_ranges_bottom; //!< The bottom of the lowest range of heights in SubDivCube::z_range_nodes
+    std::vector<unsigned int> z_range_start; //!< For each range of heights the index of its first cube index in SubDivCube::z_range_nodes, followed by the total number of cube indices
+    std::vector<unsigned int> z_range_nodes; //!< For each range of heights the ascending indices into SubDivCube::nodes of the cubes which have lines within that range
     static std::vector<CubeProperties> cube_properties_per_recursion_step; //!< precomputed array of basic properties of cubes based on recursion depth.
     static double radius_multiplier; //!< multiplier for the bounding radius when determining if a cube should be subdivided
     static Point3Matrix rotation_matrix; //!< The rotation matrix to get from axis aligned cubes to cubes standing on a corner point aligned with the infill_angle
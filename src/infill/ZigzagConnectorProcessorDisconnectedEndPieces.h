@@ -8,7 +8,7 @@
 namespace cura
 {
 
-class ZigzagConnectorProcessorDisconnectedEndPieces : public ZigzagConnectorProcessorEndPieces
+class ZigzagConnectorProcessorDisconnectedEndPieces final : public ZigzagConnectorProcessorEndPieces
 {
 
 public:
@@ -9,7 +9,7 @@
 namespace cura
 {
 
-class ZigzagConnectorProcessorNoEndPieces : public ActualZigzagConnectorProcessor
+class ZigzagConnectorProcessorNoEndPieces final : public ActualZigzagConnectorProcessor
 {
 public:
     ZigzagConnectorProcessorNoEndPieces(const PointMatrix& rotation_matrix, Polygons& result)
@@ -5,6 +5,7 @@
 #include "progress/Progress.h"
 
 #include "utils/SVG.h" // debug output
+#include "utils/ThreadPool.h"
 
 /*
 The layer-part creation step is the first step in creating actual useful data for 3D printing.
@@ -46,32 +47,42 @@ void createLayerParts(SliceMeshStorage& mesh, Slicer* slicer, bool union_layers,
 {
     const auto total_layers = slicer->layers.size();
     assert(mesh.layers.size() == total_layers);
-#pragma omp parallel for default(none) shared(mesh,slicer) firstprivate(union_layers,union_all_remove_holes) schedule(dynamic)
-    for (unsigned int layer_nr = 0; layer_nr < total_layers; layer_nr++)
+    ThreadPool::parallelFor(0, total_layers, [&](unsigned int layer_nr)
     {
         SliceLayer& layer_storage = mesh.layers[layer_nr];
         SlicerLayer& slice_layer = slicer->layers[layer_nr];
         layer_storage.sliceZ = slice_layer.z;
         layer_storage.printZ = slice_layer.z;
         createLayerWithParts(layer_storage, &slice_layer, union_layers, union_all_remove_holes);
-    }
+    });
 
+    const bool include_open_polylines = mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL;
+    const auto has_content = [&mesh, include_open_polylines](unsigned int layer_nr)
+        {
+            const SliceLayer& layer_storage = mesh.layers[layer_nr];
+            return layer_storage.parts.size() > 0 || (include_open_polylines && layer_storage.openPolyLines.size() > 0);
+        };
     for (unsigned int layer_nr = total_layers - 1; static_cast<int>(layer_nr) != -1; layer_nr--)
     {
-        SliceLayer& layer_storage = mesh.layers[layer_nr];
-        if (layer_storage.parts.size() > 0 || (mesh.getSettingAsSurfaceMode("magic_mesh_surface_mode") != ESurfaceMode::NORMAL && layer_storage.openPolyLines.size() > 0) )
+        if (has_content(layer_nr))
         {
             mesh.layer_nr_max_filled_layer = layer_nr; // last set by the highest non-empty layer
             break;
         }
     }
+    mesh.layer_nr_min_filled_layer = total_layers;
+    for (unsigned int layer_nr = 0; layer_nr < total_layers; layer_nr++)
+    {
+        if (has_content(layer_nr))
+        {
+            mesh.layer_nr_min_filled_layer = layer_nr;
+            break;
+        }
+    }
 }
 
 void layerparts2HTML(SliceDataStorage& storage, const char* filename, bool all_layers, int layer_nr)
 {
-    
-    FILE* out = fopen(filename, "w");
-    fprintf(out, "<!DOCTYPE html><html><body>");
     Point3 modelSize = storage.model_size;
     Point3 modelMin = storage.model_min;
     
@@ -108,4 +119,46 @@ void layerparts2HTML(SliceDataStorage& storage, const char* filename, bool all_l
     }
 }
 
+void layerparts2SVGs(const SliceDataStorage& storage, const std::string& filename_prefix, int first_layer_nr, int last_layer_nr, unsigned int features)
+{
+    const Point model_min_2d(storage.model_min.x, storage.model_min.y);
+    const AABB aabb(model_min_2d, model_min_2d + Point(storage.model_size.x, storage.model_size.y));
+    ThreadPool::parallelFor(std::max(0, first_layer_nr), last_layer_nr + 1, [&](int layer_nr)
+    {
+        SVG svg((filename_prefix + std::to_string(layer_nr) + ".html").c_str(), aabb);
+        for (const SliceMeshStorage& mesh : storage.meshes)
+        {
+            if (layer_nr >= static_cast<int>(mesh.layers.size()))
+            {
+                continue;
+            }
+            for (const SliceLayerPart& part : mesh.layers[layer_nr].parts)
+            {
+                if (features & LAYER_PARTS_OUTLINES)
+                {
+                    svg.writeAreas(part.outline);
+                }
+                if (features & LAYER_PARTS_INFILL)
+                {
+                    svg.writeAreas(part.getOwnInfillArea(), SVG::Color::YELLOW);
+                }
+                if (features & LAYER_PARTS_SKIN)
+                {
+                    for (const SkinPart& skin_part : part.skin_parts)
+                    {
+                        svg.writePolygons(skin_part.outline, SVG::Color::BLUE);
+                    }
+                }
+                if (features & LAYER_PARTS_INSETS)
+                {
+                    for (const Polygons& inset : part.insets)
+                    {
+                        svg.writePolygons(inset, SVG::Color::RED);
+                    }
+                }
+            }
+        }
+    });
+}
+
 }//namespace cura
@@ -26,6 +26,30 @@ void createLayerParts(SliceMeshStorage& mesh, Slicer* slicer, bool union_layers,
 
 void layerparts2HTML(SliceDataStorage& mesh, const char* filename, bool all_layers = true, int layer_nr = -1);
 
+/*!
+ * The features of the layer parts drawn by \ref layerparts2SVGs, which can be combined.
+ */
+enum LayerPartsFeatures : unsigned int
+{
+    LAYER_PARTS_OUTLINES = 1,
+    LAYER_PARTS_INSETS = 2,
+    LAYER_PARTS_SKIN = 4,
+    LAYER_PARTS_INFILL = 8
+};
+
+/*!
+ * Draw the parts of a range of layers of all meshes, each layer to a file of its own.
+ *
+ * The layers are drawn in parallel and their files are written in the background; see \ref SVG::waitForBackgroundWrites
+ *
+ * \param storage The sliced meshes
+ * \param filename_prefix The start of the name of each file, followed by the layer number and ".html"
+ * \param first_layer_nr The first layer to draw
+ * \param last_layer_nr The last layer to draw
+ * \param features The features to draw, see \ref LayerPartsFeatures
+ */
+void layerparts2SVGs(const SliceDataStorage& storage, const std::string& filename_prefix, int first_layer_nr, int last_layer_nr, unsigned int features = LAYER_PARTS_OUTLINES);
+
 }//namespace cura
 
 #endif//LAYERPART_H
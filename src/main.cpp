@@ -6,23 +6,37 @@
 #include <signal.h>
 #if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
 #include <execinfo.h>
+#include <poll.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #endif
 #include <stddef.h>
+#include <cerrno>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
 #include <vector>
 
+#include "utils/BinaryGcode.h"
 #include "utils/gettime.h"
 #include "utils/logoutput.h"
+#include "utils/Profiler.h"
 #include "utils/string.h"
 
 #include "FffProcessor.h"
+#include "JobEstimate.h"
+#include "LayerDigests.h"
+#include "MemoryReport.h"
+#include "SliceCache.h"
+#include "progress/Progress.h"
 #include "settings/SettingRegistry.h"
+#include "settings/SettingsTrace.h"
 
 #include "settings/SettingsToGV.h"
-
-#ifdef _OPENMP
-    #include <omp.h> // omp_get_num_threads
-#endif // _OPENMP
+#include "utils/InstructionSet.h"
+#include "utils/ThreadPool.h"
 
 namespace cura
 {
@@ -38,23 +52,46 @@ void print_usage()
     logAlways("  --connect <host>[:<port>]\n\tConnect to <host> via a command socket, \n\tinstead of passing information via the command line\n");
     logAlways("  -j<settings.def.json>\n\tLoad settings.json file to register all settings and their defaults\n");
     logAlways("  -v\n\tIncrease the verbose level (show log messages).\n");
-#ifdef _OPENMP
     logAlways("  -m<thread_count>\n\tSet the desired number of threads. Supports only a single digit.\n");
-#endif // _OPENMP
     logAlways("\n");
-    logAlways("CuraEngine slice [-v] [-p] [-j <settings.json>] [-s <settingkey>=<value>] [-g] [-e<extruder_nr>] [-o <output.gcode>] [-l <model.stl>] [--next]\n");
+    logAlways("CuraEngine slice [-v] [-p] [-j <settings.json>] [-s <settingkey>=<value>] [-g] [-e<extruder_nr>] [-b] [-o <output.gcode>] [-l <model.stl>] [--next] [--profile <profile.json>] [--profile-counters] [--memory-report <memory.jsonl>] [--layer-digests <digests.jsonl>] [--progress-json <progress.jsonl>] [--slice-cache <directory>] [--trace-settings <trace.json>] [--numa] [--preview <file_prefix>] [--stream] [--fsync] [--snapshot <file>] [--isa <level>]\n");
     logAlways("  -v\n\tIncrease the verbose level (show log messages).\n");
-#ifdef _OPENMP
-    logAlways("  -m<thread_count>\n\tSet the desired number of threads.\n");
-#endif // _OPENMP
+    logAlways("  -m<thread_count>\n\tSet the desired number of threads. The settings thread_count_slicing, thread_count_areas \n\tand thread_count_gcode limit the threads of each stage to fewer.\n");
     logAlways("  -p\n\tLog progress information.\n");
     logAlways("  -j\n\tLoad settings.def.json file to register all settings and their defaults.\n");
     logAlways("  -s <setting>=<value>\n\tSet a setting to a value for the last supplied object, \n\textruder train, or general settings.\n");
-    logAlways("  -l <model_file>\n\tLoad an STL model. \n");
+    logAlways("  -l <model_file>\n\tLoad an STL or OBJ model. \n");
     logAlways("  -g\n\tSwitch setting focus to the current mesh group only.\n\tUsed for one-at-a-time printing.\n");
     logAlways("  -e<extruder_nr>\n\tSwitch setting focus to the extruder train with the given number.\n");
     logAlways("  --next\n\tGenerate gcode for the previously supplied mesh group and append that to \n\tthe gcode of further models for one-at-a-time printing.\n");
-    logAlways("  -o <output_file>\n\tSpecify a file to which to write the generated gcode.\n");
+    logAlways("  -o <output_file>\n\tSpecify a file to which to write the generated gcode. \n\tIt is compressed with gzip if its name ends in .gz.\n");
+    logAlways("  -b\n\tWrite the gcode to the output file in binary format. Must precede -o.\n");
+    logAlways("  --profile <profile_file>\n\tWrite the time spent in each stage of slicing and on each thread to a file, \n\tin the Chrome trace format. Must precede the first --next.\n");
+    logAlways("  --profile-counters\n\tInclude the CPU cycles, instructions, cache misses and branch misses of each stage \n\tin the profile, where the system allows counting them. Must precede the first --next.\n");
+    logAlways("  --memory-report <report_file>\n\tWrite the bytes held by the meshes, the layer areas, the support and the layer plans \n\tand the resident set size at the end of each stage, as a line of JSON per stage.\n");
+    logAlways("  --layer-digests <digests_file>\n\tWrite a hash of the planned paths of each feature type in each layer, \n\tas a line of JSON per layer, to compare the output of different builds.\n");
+    logAlways("  --progress-json <progress_file>\n\tWrite the progress, the layers per second, the estimated remaining time \n\tand the resident set size as lines of JSON, to a file, a named pipe or to stdout for \"-\" when the gcode is written to a file with -o.\n");
+    logAlways("  --slice-cache <directory>\n\tKeep the loaded models and their sliced layers in files in an existing directory, \n\tso that slicing the same models again skips loading and slicing them. Must precede -l.\n");
+    logAlways("  --trace-settings <trace_file>\n\tWrite which settings are read by each stage of slicing and writing the gcode to a file, \n\tas JSON, and use it to check which areas can be reused by the next mesh group. Must precede the first --next.\n");
+    logAlways("  --numa\n\tPin the threads to the NUMA nodes of the machine and give each node its own block of layers.\n");
+    logAlways("  --preview <file_prefix>\n\tBefore slicing each mesh group in full, slice only every preview_layer_stride layers (10 by default) \n\tand draw their outlines and walls to a file per layer. Must precede the first --next.\n");
+    logAlways("  --stream\n\tWrite each layer to the output as soon as it's generated, so that a printer reading \n\tthe output file or stdout can start before slicing is done. Must precede the first --next.\n");
+    logAlways("  --fsync\n\tWait until the output file is written to disk before exiting.\n");
+    logAlways("  --snapshot <file>\n\tRead the areas of the mesh group from a file if they were generated with the same models \n\tand slicing and wall settings, or else write them to it. Must precede the first --next.\n");
+    logAlways("  --isa <level>\n\tUse the vectorized kernels for an instruction set other than the widest the machine supports: \n\tbaseline, avx2 or avx512.\n");
+    logAlways("\n");
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    logAlways("CuraEngine batch [-v] [-m<thread_count>] [-c<job_count>] [-M<megabytes>] [-j <settings.def.json>]\n");
+    logAlways("\tRead slicing jobs from stdin, one per line, each with the arguments of slice. \n\tThe settings files are loaded only once and are used as the defaults of every job.\n");
+    logAlways("  -v\n\tIncrease the verbose level (show log messages).\n");
+    logAlways("  -m<thread_count>\n\tSet the desired number of threads per job.\n");
+    logAlways("  -c<job_count>\n\tSet the number of jobs to slice concurrently.\n");
+    logAlways("  -M<megabytes>\n\tStart slicing a job once its models are loaded and its estimated peak memory fits \n\tin what the running jobs leave of this budget, in the order of the batch. \n\tA job which only fits with its layer geometry spilled to a temporary file \n\tis sliced with a layer_geometry_memory_budget, and one which doesn't fit at all is sliced alone.\n");
+    logAlways("  -j\n\tLoad settings.def.json file to register all settings and their defaults.\n");
+    logAlways("\n");
+#endif
+    logAlways("CuraEngine decode <input.bgcode> <output.gcode>\n");
+    logAlways("\tConvert a binary gcode file written with -b back to gcode text.\n");
     logAlways("\n");
     logAlways("The settings are appended to the last supplied object:\n");
     logAlways("CuraEngine slice [general settings] \n\t-g [current group settings] \n\t-e0 [extruder train 0 settings] \n\t-l obj_inheriting_from_last_extruder_train.stl [object settings] \n\t--next [next group settings]\n\t... etc.\n");
@@ -92,9 +129,7 @@ void connect(int argc, char **argv)
         port = std::stoi(ip_port.substr(ip_port.find(':') + 1).data());
     }
 
-#ifdef _OPENMP
     int n_threads;
-#endif // _OPENMP
 
     for(int argn = 3; argn < argc; argn++)
     {
@@ -108,15 +143,13 @@ void connect(int argc, char **argv)
                 case 'v':
                     cura::increaseVerboseLevel();
                     break;
-#ifdef _OPENMP
                 case 'm':
                     str++;
                     n_threads = std::strtol(str, &str, 10);
                     str--;
                     n_threads = std::max(1, n_threads);
-                    omp_set_num_threads(n_threads);
+                    ThreadPool::setThreadCount(n_threads);
                     break;
-#endif // _OPENMP
                 case 'j':
                     argn++;
                     if (SettingRegistry::getInstance()->loadJSONsettings(argv[argn], FffProcessor::getInstance()))
@@ -139,23 +172,111 @@ void connect(int argc, char **argv)
     CommandSocket::getInstance()->connect(ip, port);
 }
 
+/*!
+ * A model given on the command line, which is loaded once all models of its meshgroup are known.
+ */
+struct MeshLoad
+{
+    unsigned int mesh_idx; //!< The index of the mesh in its meshgroup, which already holds the settings given for it
+    const char* filename; //!< The file from which to load the mesh
+    FMatrix3x3 transformation; //!< The transformation applied to the model when loaded
+};
+
+/*!
+ * Load the models of a meshgroup in parallel into their meshes, which were added in the order of the command line.
+ * Exits when a model can't be loaded.
+ * 
+ * \param meshgroup The meshgroup to which the meshes were added
+ * \param[in,out] mesh_loads The models to load, which are cleared afterwards
+ */
+void loadMeshes(MeshGroup* meshgroup, std::vector<MeshLoad>& mesh_loads)
+{
+    std::vector<char> is_loaded(mesh_loads.size(), false);
+    ThreadPool::parallelFor(0, static_cast<int>(mesh_loads.size()), [&](int load_idx)
+    {
+        const MeshLoad& mesh_load = mesh_loads[load_idx];
+        is_loaded[load_idx] = loadMesh(&meshgroup->meshes[mesh_load.mesh_idx], mesh_load.filename, mesh_load.transformation);
+    });
+    for (unsigned int load_idx = 0; load_idx < mesh_loads.size(); load_idx++)
+    {
+        if (!is_loaded[load_idx])
+        {
+            logError("Failed to load model: %s\n", mesh_loads[load_idx].filename);
+            std::exit(1);
+        }
+    }
+    mesh_loads.clear();
+}
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+/*!
+ * The pipes through which a job of a batch with a memory budget is admitted by the batch, or -1 otherwise; see batch.
+ */
+int admission_request_fd = -1; //!< The job writes the estimate of its first mesh group to it, and keeps it open until it exits
+int admission_reply_fd = -1; //!< The job reads from it the memory budget in megabytes for its layer geometry once admitted, or zero to keep it all in memory
+#endif
+
+/*!
+ * Estimate the peak memory and CPU time of slicing a loaded mesh group, when it's reported or when this is a job waiting to be admitted by a batch.
+ *
+ * Only the first mesh group of a job is admitted; the mesh groups after --next are sliced by the same process once admitted.
+ */
+void admitMeshGroup(MeshGroup* meshgroup)
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    const bool is_waiting = admission_request_fd >= 0 && admission_reply_fd >= 0;
+#else
+    const bool is_waiting = false;
+#endif
+    if (!is_waiting && !MemoryReport::isEnabled())
+    {
+        return;
+    }
+    const JobEstimate estimate = JobEstimate::estimate(*meshgroup);
+    log("Estimated %lluMB of peak memory and %.1fs of CPU time for %llu faces in %u layers.\n", static_cast<unsigned long long>(estimate.peak_bytes / 1000000), estimate.cpu_seconds
+        , static_cast<unsigned long long>(estimate.face_count), estimate.layer_count);
+    MemoryReport::reportEstimate(estimate);
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    if (!is_waiting)
+    {
+        return;
+    }
+    int32_t layer_geometry_memory_budget;
+    if (write(admission_request_fd, &estimate, sizeof(estimate)) != sizeof(estimate)
+        || read(admission_reply_fd, &layer_geometry_memory_budget, sizeof(layer_geometry_memory_budget)) != sizeof(layer_geometry_memory_budget))
+    {
+        logError("Lost contact with the batch.\n");
+        std::exit(1);
+    }
+    close(admission_reply_fd);
+    admission_reply_fd = -1;
+    FffProcessor::getInstance()->time_keeper.restart(); // don't count the wait as slicing time
+    if (layer_geometry_memory_budget > 0)
+    {
+        log("Spilling the layer geometry beyond %dMB to fit in the memory budget of the batch.\n", layer_geometry_memory_budget);
+        JobEstimate::setLayerGeometryMemoryBudget(*meshgroup, layer_geometry_memory_budget);
+    }
+#endif
+}
+
 void slice(int argc, char **argv)
 {   
     FffProcessor::getInstance()->time_keeper.restart();
     
     FMatrix3x3 transformation; // the transformation applied to a model when loaded
                         
-    MeshGroup* meshgroup = new MeshGroup(FffProcessor::getInstance());
+    std::unique_ptr<MeshGroup> meshgroup(new MeshGroup(FffProcessor::getInstance())); // held until it's queued, so that it's deleted when loading it fails
     
     int extruder_train_nr = 0;
 
-#ifdef _OPENMP
     int n_threads;
-#endif // _OPENMP
 
     SettingsBase* last_extruder_train = nullptr;
     // extruder defaults cannot be loaded yet cause no json has been parsed
     SettingsBase* last_settings_object = FffProcessor::getInstance();
+    std::vector<MeshLoad> mesh_loads; //!< The models of the current meshgroup, which are loaded together when it is complete
+    bool has_target_file = false; //!< Whether the gcode is written to a file rather than to stdout
+    bool progress_to_stdout = false;
     for(int argn = 2; argn < argc; argn++)
     {
         char* str = argv[argn];
@@ -168,6 +289,7 @@ void slice(int argc, char **argv)
                     try {
                         //Catch all exceptions, this prevents the "something went wrong" dialog on windows to pop up on a thrown exception.
                         // Only ClipperLib currently throws exceptions. And only in case that it makes an internal error.
+                        loadMeshes(meshgroup.get(), mesh_loads);
                         log("Loaded from disk in %5.3fs\n", FffProcessor::getInstance()->time_keeper.restart());
                         
                         for (int extruder_nr = 0; extruder_nr < FffProcessor::getInstance()->getSettingAsCount("machine_extruder_count"); extruder_nr++)
@@ -176,22 +298,92 @@ void slice(int argc, char **argv)
                         }
 
                         meshgroup->finalize();
+                        admitMeshGroup(meshgroup.get());
+                        meshgroup->flattenSettings();
 
                         //start slicing
-                        FffProcessor::getInstance()->processMeshGroup(meshgroup);
+                        FffProcessor::getInstance()->queueMeshGroup(meshgroup.release()); // deletes the meshgroup once it's done
                         
                         // initialize loading of new meshes
                         FffProcessor::getInstance()->time_keeper.restart();
-                        delete meshgroup;
-                        meshgroup = new MeshGroup(FffProcessor::getInstance());
+                        meshgroup.reset(new MeshGroup(FffProcessor::getInstance()));
                         last_extruder_train = meshgroup->createExtruderTrain(0); 
-                        last_settings_object = meshgroup;
+                        last_settings_object = meshgroup.get();
                         
                     }catch(...){
                         cura::logError("Unknown exception\n");
                         exit(1);
                     }
-                }else{
+                }
+                else if (stringcasecompare(str, "--profile") == 0)
+                {
+                    argn++;
+                    Profiler::enable(argv[argn]);
+                }
+                else if (stringcasecompare(str, "--profile-counters") == 0)
+                {
+                    Profiler::enableHardwareCounters();
+                }
+                else if (stringcasecompare(str, "--memory-report") == 0)
+                {
+                    argn++;
+                    MemoryReport::enable(argv[argn]);
+                }
+                else if (stringcasecompare(str, "--layer-digests") == 0)
+                {
+                    argn++;
+                    LayerDigests::enable(argv[argn]);
+                }
+                else if (stringcasecompare(str, "--progress-json") == 0)
+                {
+                    argn++;
+                    progress_to_stdout = strcmp(argv[argn], "-") == 0;
+                    Progress::enableJsonOutput(argv[argn]);
+                }
+                else if (stringcasecompare(str, "--slice-cache") == 0)
+                {
+                    argn++;
+                    SliceCache::enable(argv[argn]);
+                }
+                else if (stringcasecompare(str, "--trace-settings") == 0)
+                {
+                    argn++;
+                    SettingsTrace::enable(argv[argn]);
+                }
+                else if (stringcasecompare(str, "--numa") == 0)
+                {
+                    ThreadPool::setNumaAffinity(true);
+                }
+                else if (stringcasecompare(str, "--preview") == 0)
+                {
+                    argn++;
+                    FffProcessor::getInstance()->setPreviewFilePrefix(argv[argn]);
+                }
+                else if (stringcasecompare(str, "--stream") == 0)
+                {
+                    FffProcessor::getInstance()->setStreamingOutput();
+                }
+                else if (stringcasecompare(str, "--fsync") == 0)
+                {
+                    FffProcessor::getInstance()->setSyncOutputToDisk();
+                }
+                else if (stringcasecompare(str, "--snapshot") == 0)
+                {
+                    argn++;
+                    FffProcessor::getInstance()->setSnapshotFile(argv[argn]);
+                }
+                else if (stringcasecompare(str, "--isa") == 0)
+                {
+                    argn++;
+                    if (!InstructionSet::setLevel(argv[argn]))
+                    {
+                        logError("Instruction set %s is unknown or not supported by this machine.\n", argv[argn]);
+                        exit(1);
+                    }
+                    log("Vectorized kernels use instruction set: %s\n", InstructionSet::getLevelName());
+                }
+                else
+                {
                     cura::logError("Unknown option: %s\n", str);
                 }
             }else{
@@ -202,15 +394,13 @@ void slice(int argc, char **argv)
                     case 'v':
                         cura::increaseVerboseLevel();
                         break;
-#ifdef _OPENMP
                     case 'm':
                         str++;
                         n_threads = std::strtol(str, &str, 10);
                         str--;
                         n_threads = std::max(1, n_threads);
-                        omp_set_num_threads(n_threads);
+                        ThreadPool::setThreadCount(n_threads);
                         break;
-#endif // _OPENMP
                     case 'p':
                         cura::enableProgressLogging();
                         break;
@@ -240,15 +430,10 @@ void slice(int argc, char **argv)
                         {
                             last_extruder_train = meshgroup->createExtruderTrain(0); // assume a json has already been provided on the command line
                         }
-                        if (!loadMeshIntoMeshGroup(meshgroup, argv[argn], transformation, last_extruder_train))
-                        {
-                            logError("Failed to load model: %s\n", argv[argn]);
-                            std::exit(1);
-                        }
-                        else 
-                        {
-                            last_settings_object = &(meshgroup->meshes.back()); // pointer is valid until a new object is added, so this is OK
-                        }
+                        // only add the mesh now, so that the settings after it are given to it; all meshes of the meshgroup are loaded together later
+                        meshgroup->meshes.emplace_back(last_extruder_train);
+                        mesh_loads.push_back(MeshLoad{static_cast<unsigned int>(meshgroup->meshes.size() - 1), argv[argn], transformation});
+                        last_settings_object = &(meshgroup->meshes.back()); // pointer is valid until a new object is added, so this is OK
                         break;
                     case 'o':
                         argn++;
@@ -257,9 +442,13 @@ void slice(int argc, char **argv)
                             cura::logError("Failed to open %s for output.\n", argv[argn]);
                             exit(1);
                         }
+                        has_target_file = true;
+                        break;
+                    case 'b':
+                        FffProcessor::getInstance()->setBinaryOutput();
                         break;
                     case 'g':
-                        last_settings_object = meshgroup;
+                        last_settings_object = meshgroup.get();
                     case 's':
                         {
                             //Parse the given setting and store it.
@@ -293,6 +482,12 @@ void slice(int argc, char **argv)
         }
     }
 
+    if (progress_to_stdout && !has_target_file)
+    {
+        cura::logError("The progress can't be written to stdout when the gcode is, give the gcode file with -o.\n");
+        exit(1);
+    }
+
     int extruder_count = FffProcessor::getInstance()->getSettingAsCount("machine_extruder_count");
     for (extruder_train_nr = 0; extruder_train_nr < extruder_count; extruder_train_nr++)
     { // initialize remaining extruder trains and load the defaults
@@ -305,11 +500,15 @@ void slice(int argc, char **argv)
 #endif
         //Catch all exceptions, this prevents the "something went wrong" dialog on windows to pop up on a thrown exception.
         // Only ClipperLib currently throws exceptions. And only in case that it makes an internal error.
+        loadMeshes(meshgroup.get(), mesh_loads);
         meshgroup->finalize();
         log("Loaded from disk in %5.3fs\n", FffProcessor::getInstance()->time_keeper.restart());
+        admitMeshGroup(meshgroup.get());
+        meshgroup->flattenSettings();
         
         //start slicing
-        FffProcessor::getInstance()->processMeshGroup(meshgroup);
+        FffProcessor::getInstance()->queueMeshGroup(meshgroup.release()); // deletes the meshgroup once it's done
+        FffProcessor::getInstance()->flushMeshGroupQueue();
 
 #ifndef DEBUG
     }catch(...){
@@ -320,8 +519,382 @@ void slice(int argc, char **argv)
     //Finalize the processor, this adds the end.gcode. And reports statistics.
     FffProcessor::getInstance()->finalize();
 
-    delete meshgroup;
+    Profiler::writeReport();
+    SettingsTrace::writeReport();
+}
+
+void decode(int argc, char **argv)
+{
+    if (argc != 4)
+    {
+        print_call(argc, argv);
+        print_usage();
+        exit(1);
+    }
+    std::ifstream input(argv[2], std::ios::binary);
+    if (!input.is_open())
+    {
+        cura::logError("Failed to open %s for input.\n", argv[2]);
+        exit(1);
+    }
+    std::ofstream output(argv[3], std::ios::binary);
+    if (!output.is_open())
+    {
+        cura::logError("Failed to open %s for output.\n", argv[3]);
+        exit(1);
+    }
+    if (!BinaryGcode::decode(input, output))
+    {
+        cura::logError("%s is not a valid binary gcode file.\n", argv[2]);
+        exit(1);
+    }
+}
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+/*!
+ * Read a line from stdin without buffering.
+ * 
+ * The jobs of a batch are forked processes, which share the file offset of stdin with the batch.
+ * Reading through a buffer would let a job which exits move that offset back over the lines already buffered.
+ * 
+ * \param[out] line The line read, without the newline
+ * \return Whether a line was read
+ */
+bool readBatchLine(std::string& line)
+{
+    line.clear();
+    char character;
+    while (read(STDIN_FILENO, &character, 1) == 1)
+    {
+        if (character == '\n')
+        {
+            return true;
+        }
+        line += character;
+    }
+    return !line.empty();
+}
+
+/*!
+ * Split a line of a batch into the arguments of a slicing job.
+ * 
+ * Arguments are separated by whitespace. An argument containing whitespace can be put between double quotes.
+ */
+std::vector<std::string> splitBatchLine(const std::string& line)
+{
+    std::vector<std::string> arguments;
+    bool in_argument = false;
+    bool in_quotes = false;
+    for (const char character : line)
+    {
+        if (character == '"')
+        {
+            in_quotes = !in_quotes;
+            if (!in_argument)
+            {
+                arguments.emplace_back();
+                in_argument = true;
+            }
+        }
+        else if (!in_quotes && (character == ' ' || character == '\t' || character == '\r'))
+        {
+            in_argument = false;
+        }
+        else
+        {
+            if (!in_argument)
+            {
+                arguments.emplace_back();
+                in_argument = true;
+            }
+            arguments.back() += character;
+        }
+    }
+    return arguments;
+}
+
+/*!
+ * Slice the jobs read from stdin, each in its own process forked from this one.
+ * 
+ * The settings files given on the command line are loaded before the first job,
+ * so that each job starts out with the registry and the defaults already in place.
+ * Empty lines and lines starting with '#' are skipped.
+ *
+ * With a memory budget, each job loads its models, sends the estimate of its peak memory to the batch and waits to be admitted,
+ * see admitMeshGroup. The jobs are admitted in order, for as long as their estimates fit in what the admitted jobs leave of the budget.
+ * The jobs waiting to be admitted count towards the number of concurrent jobs.
+ */
+void batch(int argc, char **argv)
+{
+    int max_running_jobs = 1;
+    uint64_t memory_budget = 0; // in bytes, or zero to start each job right away
+    int n_threads;
+
+    for(int argn = 2; argn < argc; argn++)
+    {
+        char* str = argv[argn];
+        if (str[0] == '-')
+        {
+            for(str++; *str; str++)
+            {
+                switch(*str)
+                {
+                case 'v':
+                    cura::increaseVerboseLevel();
+                    break;
+                case 'm':
+                    str++;
+                    n_threads = std::strtol(str, &str, 10);
+                    str--;
+                    n_threads = std::max(1, n_threads);
+                    ThreadPool::setThreadCount(n_threads);
+                    break;
+                case 'c':
+                    str++;
+                    max_running_jobs = std::strtol(str, &str, 10);
+                    str--;
+                    max_running_jobs = std::max(1, max_running_jobs);
+                    break;
+                case 'M':
+                    str++;
+                    memory_budget = std::max(0l, std::strtol(str, &str, 10)) * 1000000ull;
+                    str--;
+                    break;
+                case 'j':
+                    argn++;
+                    if (SettingRegistry::getInstance()->loadJSONsettings(argv[argn], FffProcessor::getInstance()))
+                    {
+                        cura::logError("Failed to load json file: %s\n", argv[argn]);
+                        std::exit(1);
+                    }
+                    break;
+                default:
+                    cura::logError("Unknown option: %c\n", *str);
+                    print_call(argc, argv);
+                    print_usage();
+                    exit(1);
+                    break;
+                }
+            }
+        }
+        else
+        {
+            cura::logError("Unknown option: %s\n", argv[argn]);
+            print_call(argc, argv);
+            print_usage();
+            exit(1);
+        }
+    }
+
+    if (memory_budget > 0)
+    {
+        signal(SIGPIPE, SIG_IGN); // a job which has died is noticed by the end of its request pipe, rather than by writing to it
+    }
+
+    /*!
+     * A job which has been started, which with a memory budget first loads its models and then waits to be admitted.
+     */
+    struct BatchJob
+    {
+        unsigned int job_nr; //!< The number of the job in the batch, counting from 1
+        int request_fd; //!< The end of the pipe through which the job sends its estimate, which is closed when it exits, or -1 without a memory budget
+        int reply_fd; //!< The end of the pipe through which the job is admitted, or -1 once admitted or without a memory budget
+        uint64_t reserved_bytes; //!< The part of the memory budget taken by the job once admitted
+    };
+    std::map<pid_t, BatchJob> running_jobs; // each running job, by its process
+    std::deque<std::pair<pid_t, JobEstimate>> waiting_jobs; // the jobs waiting to be admitted, in the order of the batch, with their estimates
+    uint64_t reserved_bytes = 0; // the part of the memory budget taken by the admitted jobs
+    unsigned int failed_job_count = 0;
+    auto finishJob = [&running_jobs, &reserved_bytes, &failed_job_count](pid_t pid, int status)
+    {
+        const BatchJob& job = running_jobs[pid];
+        if (job.request_fd >= 0)
+        {
+            close(job.request_fd);
+        }
+        if (job.reply_fd >= 0)
+        {
+            close(job.reply_fd);
+        }
+        reserved_bytes -= job.reserved_bytes;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            log("Finished job %u.\n", job.job_nr);
+        }
+        else
+        {
+            cura::logError("Job %u failed.\n", job.job_nr);
+            failed_job_count++;
+        }
+        running_jobs.erase(pid);
+    };
+    // admit the waiting jobs in order, for as long as their estimates fit in the budget,
+    // spilling the layer geometry of a job which only fits that way, and admitting one which doesn't fit at all when no job is running
+    auto admitJobs = [&running_jobs, &waiting_jobs, &reserved_bytes, memory_budget]()
+    {
+        while (!waiting_jobs.empty())
+        {
+            BatchJob& job = running_jobs[waiting_jobs.front().first];
+            const JobEstimate& estimate = waiting_jobs.front().second;
+            const uint64_t available_bytes = (memory_budget > reserved_bytes) ? memory_budget - reserved_bytes : 0;
+            int32_t layer_geometry_memory_budget = 0; // in megabytes, or zero to keep all layer geometry in memory
+            if (estimate.peak_bytes > available_bytes)
+            {
+                const uint64_t layer_geometry_budget = estimate.getLayerGeometryBudget(available_bytes);
+                if (layer_geometry_budget >= 1000000)
+                {
+                    layer_geometry_memory_budget = layer_geometry_budget / 1000000;
+                }
+                else if (reserved_bytes == 0)
+                {
+                    layer_geometry_memory_budget = 1;
+                    logWarning("Job %u is estimated to take %lluMB, more than the memory budget; slicing it alone.\n", job.job_nr, static_cast<unsigned long long>(estimate.peak_bytes / 1000000));
+                }
+                else
+                {
+                    return;
+                }
+            }
+            job.reserved_bytes = (layer_geometry_memory_budget > 0) ? estimate.getSpilledBytes(static_cast<uint64_t>(layer_geometry_memory_budget) * 1000000) : estimate.peak_bytes;
+            reserved_bytes += job.reserved_bytes;
+            if (write(job.reply_fd, &layer_geometry_memory_budget, sizeof(layer_geometry_memory_budget)) != sizeof(layer_geometry_memory_budget))
+            {
+                cura::logError("Failed to admit job %u.\n", job.job_nr); // it has died, which its request pipe tells
+            }
+            close(job.reply_fd);
+            job.reply_fd = -1;
+            log("Admitted job %u with an estimated %lluMB and %.1fs of CPU time%s; %lluMB of the budget is taken.\n", job.job_nr
+                , static_cast<unsigned long long>(job.reserved_bytes / 1000000), estimate.cpu_seconds, (layer_geometry_memory_budget > 0) ? ", spilling its layer geometry" : ""
+                , static_cast<unsigned long long>(reserved_bytes / 1000000));
+            waiting_jobs.pop_front();
+        }
+    };
+    auto waitForJob = [&running_jobs, &waiting_jobs, memory_budget, &finishJob, &admitJobs]()
+    {
+        int status;
+        if (memory_budget == 0)
+        {
+            const pid_t pid = wait(&status);
+            if (pid < 0)
+            {
+                cura::logError("Lost track of the running jobs.\n");
+                std::exit(1);
+            }
+            finishJob(pid, status);
+            return;
+        }
+        // with a memory budget each job either sends its estimate through its request pipe or closes it by exiting
+        std::vector<pollfd> request_fds;
+        std::vector<pid_t> pids;
+        for (const std::pair<const pid_t, BatchJob>& job : running_jobs)
+        {
+            request_fds.push_back(pollfd{job.second.request_fd, POLLIN, 0});
+            pids.push_back(job.first);
+        }
+        if (poll(request_fds.data(), request_fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                return;
+            }
+            cura::logError("Lost track of the running jobs.\n");
+            std::exit(1);
+        }
+        for (unsigned int job_idx = 0; job_idx < pids.size(); job_idx++)
+        {
+            if (request_fds[job_idx].revents == 0)
+            {
+                continue;
+            }
+            JobEstimate estimate;
+            if (read(request_fds[job_idx].fd, &estimate, sizeof(estimate)) == sizeof(estimate))
+            {
+                waiting_jobs.emplace_back(pids[job_idx], estimate);
+                continue;
+            }
+            for (auto waiting_job = waiting_jobs.begin(); waiting_job != waiting_jobs.end(); waiting_job++)
+            {
+                if (waiting_job->first == pids[job_idx])
+                { // it died before being admitted
+                    waiting_jobs.erase(waiting_job);
+                    break;
+                }
+            }
+            if (waitpid(pids[job_idx], &status, 0) < 0)
+            {
+                cura::logError("Lost track of the running jobs.\n");
+                std::exit(1);
+            }
+            finishJob(pids[job_idx], status);
+        }
+        admitJobs();
+    };
+
+    unsigned int job_nr = 0;
+    std::string line;
+    while (readBatchLine(line))
+    {
+        std::vector<std::string> arguments = splitBatchLine(line);
+        if (arguments.empty() || arguments[0][0] == '#')
+        {
+            continue;
+        }
+        while (running_jobs.size() >= static_cast<unsigned int>(max_running_jobs))
+        {
+            waitForJob();
+        }
+        job_nr++;
+        int request_pipe[2] = {-1, -1};
+        int reply_pipe[2] = {-1, -1};
+        if (memory_budget > 0 && (pipe(request_pipe) != 0 || pipe(reply_pipe) != 0))
+        {
+            cura::logError("Failed to start job %u.\n", job_nr);
+            std::exit(1);
+        }
+        fflush(stdout);
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            cura::logError("Failed to start job %u.\n", job_nr);
+            std::exit(1);
+        }
+        if (pid == 0)
+        {
+            if (memory_budget > 0)
+            {
+                signal(SIGPIPE, SIG_DFL);
+                close(request_pipe[0]);
+                close(reply_pipe[1]);
+                admission_request_fd = request_pipe[1];
+                admission_reply_fd = reply_pipe[0];
+            }
+            std::vector<char*> job_argv = {argv[0], argv[1]}; // slice skips the first two arguments
+            for (std::string& argument : arguments)
+            {
+                job_argv.push_back(&argument[0]);
+            }
+            slice(job_argv.size(), job_argv.data());
+            std::exit(0);
+        }
+        if (memory_budget > 0)
+        {
+            close(request_pipe[1]);
+            close(reply_pipe[0]);
+        }
+        running_jobs[pid] = BatchJob{job_nr, request_pipe[0], reply_pipe[1], 0};
+        log("Started job %u: %s\n", job_nr, line.c_str());
+    }
+    while (!running_jobs.empty())
+    {
+        waitForJob();
+    }
+    if (failed_job_count > 0)
+    {
+        cura::logError("%u of %u jobs failed.\n", failed_job_count, job_nr);
+        std::exit(1);
+    }
 }
+#endif
 
 }//namespace cura
 
@@ -366,17 +939,16 @@ int main(int argc, char **argv)
         exit(1);
     }
 
-#pragma omp parallel
-    {
-#pragma omp master
-        {
-#ifdef _OPENMP
-            log("OpenMP multithreading enabled, likely number of threads to be used: %u\n", omp_get_num_threads());
-#else
-            log("OpenMP multithreading disabled\n");
-#endif
-        }
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    if (stringcasecompare(argv[1], "batch") == 0)
+    { // the jobs are forked, which the thread pool doesn't survive once it has started its threads
+        batch(argc, argv);
+        exit(0);
     }
+#endif
+
+    log("Multithreading enabled, number of threads to be used: %u\n", ThreadPool::getThreadCount());
+    log("Vectorized kernels use instruction set: %s\n", InstructionSet::getLevelName());
 
     if (stringcasecompare(argv[1], "connect") == 0)
     {
@@ -386,6 +958,10 @@ int main(int argc, char **argv)
     {
         slice(argc, argv);
     }
+    else if (stringcasecompare(argv[1], "decode") == 0)
+    {
+        decode(argc, argv);
+    }
     else if (stringcasecompare(argv[1], "help") == 0)
     {
         print_usage();
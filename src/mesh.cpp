@@ -1,5 +1,8 @@
+#include <algorithm> // stable_sort
+
 #include "mesh.h"
 #include "utils/logoutput.h"
+#include "utils/ThreadPool.h"
 
 namespace cura
 {
@@ -16,6 +19,7 @@ static inline uint32_t pointHash(const Point3& p)
 
 Mesh::Mesh(SettingsBaseVirtual* parent)
 : SettingsBase(parent)
+, vertex_hash_table_entry_count(0)
 , has_disconnected_faces(false)
 , has_overlapping_faces(false)
 {
@@ -28,37 +32,332 @@ void Mesh::addFace(Point3& v0, Point3& v1, Point3& v2)
     int vi2 = findIndexOfVertex(v2);
     if (vi0 == vi1 || vi1 == vi2 || vi0 == vi2) return; // the face has two vertices which get assigned the same location. Don't add the face.
 
-    int idx = faces.size(); // index of face to be added
     faces.emplace_back();
-    MeshFace& face = faces[idx];
+    MeshFace& face = faces.back();
     face.vertex_index[0] = vi0;
     face.vertex_index[1] = vi1;
     face.vertex_index[2] = vi2;
-    vertices[face.vertex_index[0]].connected_faces.push_back(idx);
-    vertices[face.vertex_index[1]].connected_faces.push_back(idx);
-    vertices[face.vertex_index[2]].connected_faces.push_back(idx);
+}
+
+void Mesh::addFaces(const std::vector<Point3>& face_vertices)
+{
+    assert(face_vertices.size() % 3 == 0);
+    if (!vertices.empty())
+    { // The parallel welding below only welds the new vertices to each other.
+        for (unsigned int point_idx = 0; point_idx + 2 < face_vertices.size(); point_idx += 3)
+        {
+            Point3 v0 = face_vertices[point_idx];
+            Point3 v1 = face_vertices[point_idx + 1];
+            Point3 v2 = face_vertices[point_idx + 2];
+            addFace(v0, v1, v2);
+        }
+        return;
+    }
+
+    const int point_count = face_vertices.size();
+    std::vector<uint32_t> hashes(point_count);
+    ThreadPool::parallelFor(0, point_count, [&](int point_idx)
+    {
+        hashes[point_idx] = pointHash(face_vertices[point_idx]);
+    });
+
+    // Distribute the points over buckets, such that all points with the same hash end up in the same bucket, in order of appearance.
+    // Each bucket can then be welded independently with the same outcome as welding all points one after the other.
+    const unsigned int thread_count = ThreadPool::getThreadCount();
+    const int bucket_count = thread_count * 16;
+    std::vector<unsigned int> bucket_start(bucket_count + 1, 0);
+    for (int point_idx = 0; point_idx < point_count; point_idx++)
+    {
+        bucket_start[hashes[point_idx] % bucket_count + 1]++;
+    }
+    for (int bucket_idx = 0; bucket_idx < bucket_count; bucket_idx++)
+    {
+        bucket_start[bucket_idx + 1] += bucket_start[bucket_idx];
+    }
+    std::vector<unsigned int> bucket_points(point_count);
+    {
+        std::vector<unsigned int> insert_idx(bucket_start.begin(), bucket_start.end() - 1);
+        for (int point_idx = 0; point_idx < point_count; point_idx++)
+        {
+            bucket_points[insert_idx[hashes[point_idx] % bucket_count]++] = point_idx;
+        }
+    }
+
+    // For each point find the first earlier point it melds with; points which don't meld with an earlier point represent themselves.
+    // Within each bucket the points are sorted on their hash (keeping the order of appearance within each hash),
+    // so that the points which could meld are consecutive and no hash map is needed.
+    std::vector<unsigned int> representative(point_count);
+    ThreadPool::parallelFor(0, bucket_count, [&](int bucket_idx)
+    {
+        const std::vector<unsigned int>::iterator bucket_begin = bucket_points.begin() + bucket_start[bucket_idx];
+        const std::vector<unsigned int>::iterator bucket_end = bucket_points.begin() + bucket_start[bucket_idx + 1];
+        std::stable_sort(bucket_begin, bucket_end, [&hashes](unsigned int a, unsigned int b) { return hashes[a] < hashes[b]; });
+        std::vector<unsigned int> candidates; // the representatives found so far with the current hash
+        for (std::vector<unsigned int>::iterator it = bucket_begin; it != bucket_end; ++it)
+        {
+            const unsigned int point_idx = *it;
+            if (it == bucket_begin || hashes[*(it - 1)] != hashes[point_idx])
+            {
+                candidates.clear();
+            }
+            const Point3& p = face_vertices[point_idx];
+            representative[point_idx] = point_idx;
+            for (unsigned int candidate : candidates)
+            {
+                if ((face_vertices[candidate] - p).testLength(vertex_meld_distance))
+                {
+                    representative[point_idx] = candidate;
+                    break;
+                }
+            }
+            if (representative[point_idx] == point_idx)
+            {
+                candidates.push_back(point_idx);
+            }
+        }
+    });
+
+    // Number the vertices in order of their first appearance, like findIndexOfVertex does.
+    std::vector<int> vertex_indices(point_count);
+    for (int point_idx = 0; point_idx < point_count; point_idx++)
+    {
+        if (representative[point_idx] == static_cast<unsigned int>(point_idx))
+        {
+            vertex_indices[point_idx] = vertices.size();
+            vertices.emplace_back(face_vertices[point_idx]);
+            aabb.include(face_vertices[point_idx]);
+        }
+        else
+        {
+            vertex_indices[point_idx] = vertex_indices[representative[point_idx]];
+        }
+    }
+
+    faces.reserve(faces.size() + point_count / 3);
+    for (int point_idx = 0; point_idx + 2 < point_count; point_idx += 3)
+    {
+        const int vi0 = vertex_indices[point_idx];
+        const int vi1 = vertex_indices[point_idx + 1];
+        const int vi2 = vertex_indices[point_idx + 2];
+        if (vi0 == vi1 || vi1 == vi2 || vi0 == vi2) continue; // the face has two vertices which get assigned the same location. Don't add the face.
+
+        faces.emplace_back();
+        MeshFace& face = faces.back();
+        face.vertex_index[0] = vi0;
+        face.vertex_index[1] = vi1;
+        face.vertex_index[2] = vi2;
+    }
+}
+
+bool Mesh::addIndexedFaces(const std::vector<Point3>& vertex_locations, const std::vector<int32_t>& face_vertex_indices)
+{
+    assert(face_vertex_indices.size() % 3 == 0);
+    for (const int32_t vertex_idx : face_vertex_indices)
+    {
+        if (vertex_idx < 0 || static_cast<size_t>(vertex_idx) >= vertex_locations.size())
+        {
+            return false;
+        }
+    }
+
+    const int first_vertex_idx = vertices.size();
+    vertices.reserve(vertices.size() + vertex_locations.size());
+    for (const Point3& p : vertex_locations)
+    {
+        vertices.emplace_back(p);
+        aabb.include(p);
+    }
+
+    faces.reserve(faces.size() + face_vertex_indices.size() / 3);
+    for (unsigned int idx = 0; idx + 2 < face_vertex_indices.size(); idx += 3)
+    {
+        const int vi0 = first_vertex_idx + face_vertex_indices[idx];
+        const int vi1 = first_vertex_idx + face_vertex_indices[idx + 1];
+        const int vi2 = first_vertex_idx + face_vertex_indices[idx + 2];
+        if (vi0 == vi1 || vi1 == vi2 || vi0 == vi2) continue; // the face has the same vertex twice. Don't add the face.
+
+        faces.emplace_back();
+        MeshFace& face = faces.back();
+        face.vertex_index[0] = vi0;
+        face.vertex_index[1] = vi1;
+        face.vertex_index[2] = vi2;
+    }
+    return true;
 }
 
 void Mesh::clear()
 {
     faces.clear();
     vertices.clear();
-    vertex_hash_map.clear();
+    vertex_faces.clear();
+    vertex_face_start.clear();
+    clearVertexHashTable();
+}
+
+/*!
+ * An edge of a face, used to find the faces which share an edge by sorting.
+ */
+struct FaceEdge
+{
+    uint64_t key; //!< Unique key for the pair of vertices of the edge, regardless of direction
+    uint32_t face_idx; //!< The face of which this is an edge
+    uint32_t edge_idx; //!< Which edge of the face; edge i runs from vertex i to vertex i+1
+};
+
+/*!
+ * Sort face edges on their key with an LSD radix sort.
+ *
+ * The sort is stable, so edges with equal keys remain in their original order.
+ *
+ * \param edges The edges to sort
+ * \param max_key The maximum key among the edges
+ */
+static void radixSortFaceEdges(std::vector<FaceEdge>& edges, uint64_t max_key)
+{
+    constexpr unsigned int digit_bits = 16;
+    constexpr unsigned int bucket_count = 1 << digit_bits;
+    std::vector<FaceEdge> sorted(edges.size());
+    std::vector<unsigned int> bucket_start(bucket_count + 1);
+    for (unsigned int shift = 0; shift < 64 && (max_key >> shift) != 0; shift += digit_bits)
+    {
+        std::fill(bucket_start.begin(), bucket_start.end(), 0);
+        for (const FaceEdge& edge : edges)
+        {
+            bucket_start[((edge.key >> shift) & (bucket_count - 1)) + 1]++;
+        }
+        for (unsigned int bucket_idx = 0; bucket_idx < bucket_count; bucket_idx++)
+        {
+            bucket_start[bucket_idx + 1] += bucket_start[bucket_idx];
+        }
+        for (const FaceEdge& edge : edges)
+        {
+            sorted[bucket_start[(edge.key >> shift) & (bucket_count - 1)]++] = edge;
+        }
+        edges.swap(sorted);
+    }
 }
 
 void Mesh::finish()
 {
-    // Finish up the mesh, clear the vertex_hash_map, as it's no longer needed from this point on and uses quite a bit of memory.
-    vertex_hash_map.clear();
+    // Finish up the mesh, clear the vertex_hash_table, as it's no longer needed from this point on and uses quite a bit of memory.
+    clearVertexHashTable();
 
     // For each face, store which other face is connected with it.
-    for(unsigned int i=0; i<faces.size(); i++)
+    // All edges are sorted on the pair of vertices they connect, so that the faces sharing an edge end up next to each other, in order of face index.
+    const int face_count = faces.size();
+    const uint64_t vertex_count = vertices.size();
+    std::vector<FaceEdge> edges(face_count * 3);
+    ThreadPool::parallelFor(0, face_count, [&](int face_idx)
+    {
+        const MeshFace& face = faces[face_idx];
+        for (unsigned int edge_idx = 0; edge_idx < 3; edge_idx++)
+        {
+            const uint64_t vertex_a = face.vertex_index[edge_idx];
+            const uint64_t vertex_b = face.vertex_index[(edge_idx + 1) % 3];
+            FaceEdge& edge = edges[face_idx * 3 + edge_idx];
+            edge.key = std::min(vertex_a, vertex_b) * vertex_count + std::max(vertex_a, vertex_b);
+            edge.face_idx = face_idx;
+            edge.edge_idx = edge_idx;
+        }
+    });
+    radixSortFaceEdges(edges, vertex_count * vertex_count);
+
+    // Gather the faces connected to each vertex.
+    vertex_face_start.assign(vertex_count + 1, 0);
+    for (const MeshFace& face : faces)
+    {
+        for (unsigned int vertex_nr = 0; vertex_nr < 3; vertex_nr++)
+        {
+            vertex_face_start[face.vertex_index[vertex_nr] + 1]++;
+        }
+    }
+    for (unsigned int vertex_idx = 0; vertex_idx < vertex_count; vertex_idx++)
+    {
+        vertex_face_start[vertex_idx + 1] += vertex_face_start[vertex_idx];
+    }
+    vertex_faces.resize(vertex_face_start.back());
+    {
+        std::vector<uint32_t> insert_idx(vertex_face_start.begin(), vertex_face_start.end() - 1);
+        for (int face_idx = 0; face_idx < face_count; face_idx++)
+        {
+            for (unsigned int vertex_nr = 0; vertex_nr < 3; vertex_nr++)
+            {
+                vertex_faces[insert_idx[faces[face_idx].vertex_index[vertex_nr]]++] = face_idx;
+            }
+        }
+    }
+
+    // Pair up the faces of each edge. Edges shared by more than two faces are handled afterwards, because choosing between them logs warnings.
+    const int edge_count = edges.size();
+    std::atomic<int> disconnected_edge_count(0);
+    std::atomic<int> non_manifold_edge_count(0);
+    ThreadPool::parallelFor(0, edge_count, [&](int run_start)
     {
-        MeshFace& face = faces[i];
-        // faces are connected via the outside
-        face.connected_face_index[0] = getFaceIdxWithPoints(face.vertex_index[0], face.vertex_index[1], i, face.vertex_index[2]);
-        face.connected_face_index[1] = getFaceIdxWithPoints(face.vertex_index[1], face.vertex_index[2], i, face.vertex_index[0]);
-        face.connected_face_index[2] = getFaceIdxWithPoints(face.vertex_index[2], face.vertex_index[0], i, face.vertex_index[1]);
+        if (run_start > 0 && edges[run_start - 1].key == edges[run_start].key)
+        {
+            return; // not the start of a run of edges with the same vertices
+        }
+        int run_end = run_start + 1;
+        while (run_end < edge_count && edges[run_end].key == edges[run_start].key)
+        {
+            run_end++;
+        }
+        const FaceEdge& edge = edges[run_start];
+        switch (run_end - run_start)
+        {
+            case 1:
+                cura::logDebug("Couldn't find face connected to face %i.\n", edge.face_idx);
+                faces[edge.face_idx].connected_face_index[edge.edge_idx] = -1;
+                disconnected_edge_count++;
+                break;
+            case 2:
+            {
+                const FaceEdge& other = edges[run_start + 1];
+                faces[edge.face_idx].connected_face_index[edge.edge_idx] = other.face_idx;
+                faces[other.face_idx].connected_face_index[other.edge_idx] = edge.face_idx;
+                break;
+            }
+            default:
+                non_manifold_edge_count++;
+                break;
+        }
+    });
+    if (disconnected_edge_count > 0 && !has_disconnected_faces)
+    {
+        cura::logWarning("Mesh has disconnected faces!\n");
+        has_disconnected_faces = true;
+    }
+
+    if (non_manifold_edge_count > 0)
+    {
+        std::vector<int> candidate_faces;
+        for (int run_start = 0; run_start < edge_count; )
+        {
+            int run_end = run_start + 1;
+            while (run_end < edge_count && edges[run_end].key == edges[run_start].key)
+            {
+                run_end++;
+            }
+            if (run_end - run_start > 2)
+            {
+                for (int edge_nr = run_start; edge_nr < run_end; edge_nr++)
+                {
+                    const FaceEdge& edge = edges[edge_nr];
+                    MeshFace& face = faces[edge.face_idx];
+                    candidate_faces.clear();
+                    for (int other_nr = run_start; other_nr < run_end; other_nr++)
+                    {
+                        if (other_nr != edge_nr)
+                        {
+                            candidate_faces.push_back(edges[other_nr].face_idx);
+                        }
+                    }
+                    // faces are connected via the outside
+                    face.connected_face_index[edge.edge_idx] = getFaceIdxWithPoints(face.vertex_index[edge.edge_idx], face.vertex_index[(edge.edge_idx + 1) % 3], edge.face_idx, face.vertex_index[(edge.edge_idx + 2) % 3], candidate_faces);
+                }
+            }
+            run_start = run_end;
+        }
     }
 }
 
@@ -74,6 +373,14 @@ AABB3D Mesh::getAABB() const
 {
     return aabb;
 }
+size_t Mesh::getVertexHashTableMemoryUsage() const
+{
+    return vertex_hash_table.capacity() * sizeof(VertexHashEntry);
+}
+size_t Mesh::getConnectedFacesMemoryUsage() const
+{
+    return (vertex_faces.capacity() + vertex_face_start.capacity()) * sizeof(uint32_t);
+}
 void Mesh::expandXY(int64_t offset)
 {
     if (offset)
@@ -85,16 +392,28 @@ void Mesh::expandXY(int64_t offset)
 
 int Mesh::findIndexOfVertex(const Point3& v)
 {
-    uint32_t hash = pointHash(v);
+    if (vertex_hash_table_entry_count < vertices.size())
+    { // The vertices were added by addFaces, which doesn't fill the vertex_hash_table.
+        for (unsigned int vertex_idx = vertex_hash_table_entry_count; vertex_idx < vertices.size(); vertex_idx++)
+        {
+            insertVertexHash(pointHash(vertices[vertex_idx].p), vertex_idx);
+        }
+    }
+    const uint32_t hash = pointHash(v);
 
-    for(unsigned int idx = 0; idx < vertex_hash_map[hash].size(); idx++)
+    if (!vertex_hash_table.empty())
     {
-        if ((vertices[vertex_hash_map[hash][idx]].p - v).testLength(vertex_meld_distance))
+        const unsigned int slot_mask = vertex_hash_table.size() - 1;
+        for (unsigned int slot = getVertexHashSlot(hash); vertex_hash_table[slot].vertex_idx != static_cast<uint32_t>(-1); slot = (slot + 1) & slot_mask)
         {
-            return vertex_hash_map[hash][idx];
+            const VertexHashEntry& entry = vertex_hash_table[slot];
+            if (entry.hash == hash && (vertices[entry.vertex_idx].p - v).testLength(vertex_meld_distance))
+            {
+                return entry.vertex_idx;
+            }
         }
     }
-    vertex_hash_map[hash].push_back(vertices.size());
+    insertVertexHash(hash, vertices.size());
     vertices.emplace_back(v);
     
     aabb.include(v);
@@ -102,6 +421,47 @@ int Mesh::findIndexOfVertex(const Point3& v)
     return vertices.size() - 1;
 }
 
+unsigned int Mesh::getVertexHashSlot(uint32_t hash) const
+{
+    // The point hash is weak in its lower bits, so mix it before reducing it to the table size.
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash & (vertex_hash_table.size() - 1);
+}
+
+void Mesh::insertVertexHash(uint32_t hash, uint32_t vertex_idx)
+{
+    if ((vertex_hash_table_entry_count + 1) * 2 > vertex_hash_table.size())
+    { // Keep the table at most half full.
+        // The table holds exactly the vertices before vertex_idx, so reinserting those in order keeps equal hashes in order of insertion.
+        const unsigned int old_entry_count = vertex_hash_table_entry_count;
+        vertex_hash_table.assign(std::max<size_t>(64, vertex_hash_table.size() * 2), VertexHashEntry{0, static_cast<uint32_t>(-1)});
+        vertex_hash_table_entry_count = 0;
+        for (unsigned int old_vertex_idx = 0; old_vertex_idx < old_entry_count; old_vertex_idx++)
+        {
+            insertVertexHash(pointHash(vertices[old_vertex_idx].p), old_vertex_idx);
+        }
+    }
+    const unsigned int slot_mask = vertex_hash_table.size() - 1;
+    unsigned int slot = getVertexHashSlot(hash);
+    while (vertex_hash_table[slot].vertex_idx != static_cast<uint32_t>(-1))
+    {
+        slot = (slot + 1) & slot_mask;
+    }
+    vertex_hash_table[slot].hash = hash;
+    vertex_hash_table[slot].vertex_idx = vertex_idx;
+    vertex_hash_table_entry_count++;
+}
+
+void Mesh::clearVertexHashTable()
+{
+    std::vector<VertexHashEntry>().swap(vertex_hash_table);
+    vertex_hash_table_entry_count = 0;
+}
+
 /*!
 Returns the index of the 'other' face connected to the edge between vertices with indices idx0 and idx1.
 In case more than two faces are connected via the same edge, the next face in a counter-clockwise ordering (looking from idx1 to idx0) is returned.
@@ -126,22 +486,8 @@ See <a href="http://stackoverflow.com/questions/14066933/direct-way-of-computing
 
 
 */
-int Mesh::getFaceIdxWithPoints(int idx0, int idx1, int notFaceIdx, int notFaceVertexIdx) const
+int Mesh::getFaceIdxWithPoints(int idx0, int idx1, int notFaceIdx, int notFaceVertexIdx, const std::vector<int>& candidateFaces) const
 {
-    std::vector<int> candidateFaces; // in case more than two faces meet at an edge, multiple candidates are generated
-    for(int f : vertices[idx0].connected_faces) // search through all faces connected to the first vertex and find those that are also connected to the second
-    {
-        if (f == notFaceIdx)
-        {
-            continue;
-        }
-        if ( faces[f].vertex_index[0] == idx1 // && faces[f].vertex_index[1] == idx0 // next face should have the right direction!
-          || faces[f].vertex_index[1] == idx1 // && faces[f].vertex_index[2] == idx0
-          || faces[f].vertex_index[2] == idx1 // && faces[f].vertex_index[0] == idx0
-            )  candidateFaces.push_back(f);
-
-    }
-
     if (candidateFaces.size() == 0)
     {
         cura::logDebug("Couldn't find face connected to face %i.\n", notFaceIdx);
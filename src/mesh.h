@@ -9,15 +9,29 @@ namespace cura
 /*!
 Vertex type to be used in a Mesh.
 
-Keeps track of which faces connect to it.
+The faces connected to a vertex are stored in the Mesh, see \ref Mesh::getConnectedFaces
 */
 class MeshVertex
 {
 public:
     Point3 p; //!< location of the vertex
-    std::vector<uint32_t> connected_faces; //!< list of the indices of connected faces
 
-    MeshVertex(Point3 p) : p(p) {connected_faces.reserve(8);} //!< doesn't set connected_faces
+    MeshVertex(Point3 p) : p(p) {}
+};
+
+/*!
+ * The indices of the faces connected to a vertex; see \ref Mesh::getConnectedFaces
+ */
+class ConnectedFaces
+{
+public:
+    ConnectedFaces(const uint32_t* begin, const uint32_t* end) : begin_(begin), end_(end) {}
+    const uint32_t* begin() const { return begin_; }
+    const uint32_t* end() const { return end_; }
+    size_t size() const { return end_ - begin_; }
+private:
+    const uint32_t* begin_;
+    const uint32_t* end_;
 };
 
 /*! A MeshFace is a 3 dimensional model triangle with 3 points. These points are already converted to integers
@@ -56,22 +70,74 @@ See MeshFace for the specifics of how/when faces are connected.
 */
 class Mesh : public SettingsBase // inherits settings
 {
-    //! The vertex_hash_map stores a index reference of each vertex for the hash of that location. Allows for quick retrieval of points with the same location.
-    std::unordered_map<uint32_t, std::vector<uint32_t> > vertex_hash_map;
+    friend class SliceCache;
+
+    /*!
+     * An entry of the vertex_hash_table: the hash of the location of a vertex and the index of that vertex.
+     */
+    struct VertexHashEntry
+    {
+        uint32_t hash;
+        uint32_t vertex_idx; //!< The index of the vertex, or -1 for an empty slot
+    };
+    //! The vertex_hash_table stores a index reference of each vertex for the hash of that location. Allows for quick retrieval of points with the same location.
+    //! It uses open addressing with linear probing, so vertices with the same hash are encountered in the order in which they were added.
+    std::vector<VertexHashEntry> vertex_hash_table;
+    unsigned int vertex_hash_table_entry_count; //!< The number of occupied slots in the vertex_hash_table
     AABB3D aabb;
+
+    //! The faces connected to each vertex in one flat array: the faces of vertex i are at the indices [vertex_face_start[i], vertex_face_start[i + 1])
+    std::vector<uint32_t> vertex_faces;
+    std::vector<uint32_t> vertex_face_start; //!< For each vertex the index into vertex_faces of its first connected face, plus one past the end
 public:
     std::vector<MeshVertex> vertices;//!< list of all vertices in the mesh
     std::vector<MeshFace> faces; //!< list of all faces in the mesh
 
     Mesh(SettingsBaseVirtual* parent); //!< initializes the settings
 
-    void addFace(Point3& v0, Point3& v1, Point3& v2); //!< add a face to the mesh without settings it's connected_faces.
+    void addFace(Point3& v0, Point3& v1, Point3& v2); //!< add a face to the mesh without setting its connected_face_index fields.
+
+    /*!
+     * Add many faces to the mesh at once, without setting their connected_face_index fields.
+     *
+     * The vertices are welded in parallel. The result is the same as calling
+     * \ref Mesh::addFace for each consecutive triplet of points.
+     *
+     * \param face_vertices The vertices of the faces to add; each consecutive three points form a face.
+     */
+    void addFaces(const std::vector<Point3>& face_vertices);
+
+    /*!
+     * Add faces which index into an array of vertices, without setting their connected_face_index fields.
+     *
+     * The vertices are assumed to be unique already, so they are not welded.
+     * Faces with the same vertex index twice are skipped, like \ref Mesh::addFace does.
+     *
+     * \param vertex_locations The vertices to add
+     * \param face_vertex_indices Each consecutive three indices into \p vertex_locations form a face.
+     * \return false if an index is out of range, in which case nothing is added
+     */
+    bool addIndexedFaces(const std::vector<Point3>& vertex_locations, const std::vector<int32_t>& face_vertex_indices);
     void clear(); //!< clears all data
-    void finish(); //!< complete the model : set the connected_face_index fields of the faces.
+    void finish(); //!< complete the model : set the connected_face_index fields of the faces and gather the faces connected to each vertex.
+
+    /*!
+     * Get the indices of the faces connected to a vertex, in order of face index.
+     *
+     * Only available after \ref Mesh::finish
+     *
+     * \param vertex_idx The index of the vertex
+     */
+    ConnectedFaces getConnectedFaces(unsigned int vertex_idx) const
+    {
+        return ConnectedFaces(vertex_faces.data() + vertex_face_start[vertex_idx], vertex_faces.data() + vertex_face_start[vertex_idx + 1]);
+    }
 
     Point3 min() const; //!< min (in x,y and z) vertex of the bounding box
     Point3 max() const; //!< max (in x,y and z) vertex of the bounding box
     AABB3D getAABB() const; //!< Get the axis aligned bounding box
+    size_t getVertexHashTableMemoryUsage() const; //!< Get the number of bytes allocated for the vertex_hash_table
+    size_t getConnectedFacesMemoryUsage() const; //!< Get the number of bytes allocated for the faces connected to each vertex, see \ref Mesh::getConnectedFaces
     void expandXY(int64_t offset); //!< Register applied horizontal expansion in the AABB
     
     /*!
@@ -91,6 +157,24 @@ private:
     mutable bool has_overlapping_faces; //!< Whether it has been logged that this mesh contains overlapping faces
     int findIndexOfVertex(const Point3& v); //!< find index of vertex close to the given point, or create a new vertex and return its index.
 
+    /*!
+     * Add a vertex to the vertex_hash_table, growing the table if it gets too full.
+     *
+     * \param hash The hash of the location of the vertex
+     * \param vertex_idx The index of the vertex
+     */
+    void insertVertexHash(uint32_t hash, uint32_t vertex_idx);
+
+    /*!
+     * Get the slot in the vertex_hash_table at which to start probing for a hash.
+     */
+    unsigned int getVertexHashSlot(uint32_t hash) const;
+
+    /*!
+     * Release the memory of the vertex_hash_table.
+     */
+    void clearVertexHashTable();
+
     /*!
      * Get the index of the face connected to the face with index \p notFaceIdx, via vertices \p idx0 and \p idx1.
      * 
@@ -100,9 +184,10 @@ private:
      * \param idx1 the second vertex index
      * \param notFaceIdx the index of a face which shouldn't be returned
      * \param notFaceVertexIdx should be the third vertex of face \p notFaceIdx.
+     * \param candidateFaces The other faces which share the edge, in order of face index
      * \return the face index of a face sharing the edge from \p idx0 to \p idx1
     */
-    int getFaceIdxWithPoints(int idx0, int idx1, int notFaceIdx, int notFaceVertexIdx) const;
+    int getFaceIdxWithPoints(int idx0, int idx1, int notFaceIdx, int notFaceVertexIdx, const std::vector<int>& candidateFaces) const;
 };
 
 }//namespace cura
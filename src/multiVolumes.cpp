@@ -3,51 +3,74 @@
 
 #include "multiVolumes.h"
 
+#include "utils/AABB.h"
+#include "utils/ThreadPool.h"
+
 namespace cura 
 {
  
+/*!
+ * Whether a volume takes part in carving and in the overlap between volumes,
+ * i.e. whether it isn't a modifier mesh which doesn't generate an outline of its own.
+ */
+static bool isCarvedVolume(const Slicer& volume)
+{
+    return !volume.mesh->getSettingBoolean("infill_mesh")
+        && !volume.mesh->getSettingBoolean("anti_overhang_mesh")
+        && !volume.mesh->getSettingBoolean("support_mesh");
+}
+
 void carveMultipleVolumes(std::vector<Slicer*> &volumes, bool alternate_carve_order)
 {
-    //Go trough all the volumes, and remove the previous volume outlines from our own outline, so we never have overlapped areas.
+    std::vector<bool> is_carved_volume;
+    unsigned int layer_count = 0;
+    for (Slicer* volume : volumes)
+    {
+        is_carved_volume.push_back(isCarvedVolume(*volume));
+        layer_count = std::max(layer_count, static_cast<unsigned int>(volume->layers.size()));
+    }
+
+    // Only volumes with overlapping bounding boxes can carve each other.
+    // Determine those pairs once, so that each layer can be carved independently of the other layers.
+    std::vector<std::pair<unsigned int, unsigned int>> carve_pairs; // the index of the carved volume and of the volume carved from it, in the order in which to carve
     for (unsigned int volume_1_idx = 1; volume_1_idx < volumes.size(); volume_1_idx++)
     {
-        Slicer& volume_1 = *volumes[volume_1_idx];
-        if (volume_1.mesh->getSettingBoolean("infill_mesh") 
-            || volume_1.mesh->getSettingBoolean("anti_overhang_mesh")
-            || volume_1.mesh->getSettingBoolean("support_mesh")
-            )
+        if (!is_carved_volume[volume_1_idx])
         {
             continue;
         }
         for (unsigned int volume_2_idx = 0; volume_2_idx < volume_1_idx; volume_2_idx++)
         {
-            Slicer& volume_2 = *volumes[volume_2_idx];
-            if (volume_2.mesh->getSettingBoolean("infill_mesh")
-                || volume_2.mesh->getSettingBoolean("anti_overhang_mesh")
-                || volume_2.mesh->getSettingBoolean("support_mesh")
-                )
+            if (is_carved_volume[volume_2_idx] && volumes[volume_1_idx]->mesh->getAABB().hit(volumes[volume_2_idx]->mesh->getAABB()))
             {
-                continue;
+                carve_pairs.emplace_back(volume_1_idx, volume_2_idx);
             }
-            if (!volume_1.mesh->getAABB().hit(volume_2.mesh->getAABB()))
+        }
+    }
+
+    //Go trough all the volumes, and remove the previous volume outlines from our own outline, so we never have overlapped areas.
+    ThreadPool::parallelFor(0, layer_count, [&](unsigned int layerNr)
+    {
+        for (const std::pair<unsigned int, unsigned int>& carve_pair : carve_pairs)
+        {
+            Slicer& volume_1 = *volumes[carve_pair.first];
+            Slicer& volume_2 = *volumes[carve_pair.second];
+            if (layerNr >= volume_1.layers.size())
             {
                 continue;
             }
-            for (unsigned int layerNr = 0; layerNr < volume_1.layers.size(); layerNr++)
+            SlicerLayer& layer1 = volume_1.layers[layerNr];
+            SlicerLayer& layer2 = volume_2.layers[layerNr];
+            if (alternate_carve_order && layerNr % 2 == 0)
             {
-                SlicerLayer& layer1 = volume_1.layers[layerNr];
-                SlicerLayer& layer2 = volume_2.layers[layerNr];
-                if (alternate_carve_order && layerNr % 2 == 0)
-                {
-                    layer2.polygons = layer2.polygons.difference(layer1.polygons);
-                }
-                else
-                {
-                    layer1.polygons = layer1.polygons.difference(layer2.polygons);
-                }
+                layer2.polygons = layer2.polygons.difference(layer1.polygons);
+            }
+            else
+            {
+                layer1.polygons = layer1.polygons.difference(layer2.polygons);
             }
         }
-    }
+    });
 }
  
 //Expand each layer a bit and then keep the extra overlapping parts that overlap with other volumes.
@@ -60,72 +83,128 @@ void generateMultipleVolumesOverlap(std::vector<Slicer*> &volumes)
     }
 
     int offset_to_merge_other_merged_volumes = 20;
+
+    // Determine once which other volumes are close enough to each volume to overlap with it,
+    // so that each layer can be processed independently of the other layers.
+    std::vector<bool> is_carved_volume;
     for (Slicer* volume : volumes)
     {
-        int overlap = volume->mesh->getSettingInMicrons("multiple_mesh_overlap");
-        if (volume->mesh->getSettingBoolean("infill_mesh")
-            || volume->mesh->getSettingBoolean("anti_overhang_mesh")
-            || volume->mesh->getSettingBoolean("support_mesh")
-            || overlap == 0)
+        is_carved_volume.push_back(isCarvedVolume(*volume));
+    }
+    std::vector<int> overlaps(volumes.size(), 0);
+    std::vector<std::vector<unsigned int>> neighbouring_volumes(volumes.size()); // the other volumes with which each volume overlaps, if any
+    for (unsigned int volume_idx = 0; volume_idx < volumes.size(); volume_idx++)
+    {
+        Slicer* volume = volumes[volume_idx];
+        overlaps[volume_idx] = volume->mesh->getSettingInMicrons("multiple_mesh_overlap");
+        if (!is_carved_volume[volume_idx] || overlaps[volume_idx] == 0)
         {
             continue;
         }
         AABB3D aabb(volume->mesh->getAABB());
-        aabb.expandXY(overlap); // expand to account for the case where two models and their bounding boxes are adjacent along the X or Y-direction
-        for (unsigned int layer_nr = 0; layer_nr < volume->layers.size(); layer_nr++)
+        aabb.expandXY(overlaps[volume_idx]); // expand to account for the case where two models and their bounding boxes are adjacent along the X or Y-direction
+        for (unsigned int other_volume_idx = 0; other_volume_idx < volumes.size(); other_volume_idx++)
         {
+            if (is_carved_volume[other_volume_idx]
+                && volumes[other_volume_idx]->mesh->getAABB().hit(aabb)
+                && other_volume_idx != volume_idx
+            )
+            {
+                neighbouring_volumes[volume_idx].push_back(other_volume_idx);
+            }
+        }
+    }
+    unsigned int layer_count = 0;
+    for (Slicer* volume : volumes)
+    {
+        layer_count = std::max(layer_count, static_cast<unsigned int>(volume->layers.size()));
+    }
+
+    // the volumes are processed in order on each layer, since the overlap added to one volume is part of the other volumes for the next one
+    ThreadPool::parallelFor(0, layer_count, [&](unsigned int layer_nr)
+    {
+        for (unsigned int volume_idx = 0; volume_idx < volumes.size(); volume_idx++)
+        {
+            Slicer* volume = volumes[volume_idx];
+            const int overlap = overlaps[volume_idx];
+            if (!is_carved_volume[volume_idx] || overlap == 0 || layer_nr >= volume->layers.size())
+            {
+                continue;
+            }
             Polygons all_other_volumes;
-            for (Slicer* other_volume : volumes)
+            for (unsigned int other_volume_idx : neighbouring_volumes[volume_idx])
             {
-                if (other_volume->mesh->getSettingBoolean("infill_mesh")
-                    || other_volume->mesh->getSettingBoolean("anti_overhang_mesh")
-                    || other_volume->mesh->getSettingBoolean("support_mesh")
-                    || !other_volume->mesh->getAABB().hit(aabb)
-                    || other_volume == volume
-                )
-                {
-                    continue;
-                }
-                SlicerLayer& other_volume_layer = other_volume->layers[layer_nr];
+                SlicerLayer& other_volume_layer = volumes[other_volume_idx]->layers[layer_nr];
                 all_other_volumes = all_other_volumes.unionPolygons(other_volume_layer.polygons.offset(offset_to_merge_other_merged_volumes));
             }
 
             SlicerLayer& volume_layer = volume->layers[layer_nr];
             volume_layer.polygons = volume_layer.polygons.unionPolygons(all_other_volumes.intersection(volume_layer.polygons.offset(overlap / 2)));
         }
-    }
+    });
 }
 
 void MultiVolumes::carveCuttingMeshes(std::vector<Slicer*>& volumes, const std::vector<Mesh>& meshes)
 {
-    for (unsigned int carving_mesh_idx = 0; carving_mesh_idx < volumes.size(); carving_mesh_idx++)
+    std::vector<unsigned int> cutting_mesh_indices;
+    std::vector<unsigned int> carved_mesh_indices;
+    unsigned int layer_count = 0;
+    for (unsigned int mesh_idx = 0; mesh_idx < volumes.size(); mesh_idx++)
     {
-        const Mesh& cutting_mesh = meshes[carving_mesh_idx];
-        if (!cutting_mesh.getSettingBoolean("cutting_mesh"))
+        if (meshes[mesh_idx].getSettingBoolean("cutting_mesh"))
         {
-            continue;
+            cutting_mesh_indices.push_back(mesh_idx);
+            layer_count = std::max(layer_count, static_cast<unsigned int>(volumes[mesh_idx]->layers.size()));
         }
-        Slicer& cutting_mesh_volume = *volumes[carving_mesh_idx];
-        for (unsigned int layer_nr = 0; layer_nr < cutting_mesh_volume.layers.size(); layer_nr++)
+        else
         {
+            carved_mesh_indices.push_back(mesh_idx);
+        }
+    }
+
+    ThreadPool::parallelFor(0, layer_count, [&](unsigned int layer_nr)
+    {
+        // carving only shrinks the carved outlines, so their bounding boxes stay valid while carving this layer
+        std::vector<AABB> carved_mesh_layer_aabbs;
+        for (unsigned int carved_mesh_idx : carved_mesh_indices)
+        {
+            carved_mesh_layer_aabbs.emplace_back(volumes[carved_mesh_idx]->layers[layer_nr].polygons);
+        }
+        std::vector<bool> is_carved(carved_mesh_indices.size(), false); // whether a difference has been computed on the carved outlines of this layer
+        for (unsigned int cutting_mesh_idx : cutting_mesh_indices)
+        {
+            Slicer& cutting_mesh_volume = *volumes[cutting_mesh_idx];
+            if (layer_nr >= cutting_mesh_volume.layers.size())
+            {
+                continue;
+            }
             Polygons& cutting_mesh_layer = cutting_mesh_volume.layers[layer_nr].polygons;
+            const AABB cutting_mesh_layer_aabb(cutting_mesh_layer);
             Polygons new_outlines;
-            for (unsigned int carved_mesh_idx = 0; carved_mesh_idx < volumes.size(); carved_mesh_idx++)
+            for (unsigned int carved_idx = 0; carved_idx < carved_mesh_indices.size(); carved_idx++)
             {
-                const Mesh& carved_mesh = meshes[carved_mesh_idx];
-                if (carved_mesh.getSettingBoolean("cutting_mesh"))
-                {
+                if (!cutting_mesh_layer_aabb.hit(carved_mesh_layer_aabbs[carved_idx]))
+                { // the intersection is empty and the difference leaves the carved outlines as they are
                     continue;
                 }
-                Slicer& carved_volume = *volumes[carved_mesh_idx];
+                Slicer& carved_volume = *volumes[carved_mesh_indices[carved_idx]];
                 Polygons& carved_mesh_layer = carved_volume.layers[layer_nr].polygons;
                 Polygons intersection = cutting_mesh_layer.intersection(carved_mesh_layer);
                 new_outlines.add(intersection);
                 carved_mesh_layer = carved_mesh_layer.difference(cutting_mesh_layer);
+                is_carved[carved_idx] = true;
             }
             cutting_mesh_layer = new_outlines.unionPolygons();
         }
-    }
+        for (unsigned int carved_idx = 0; carved_idx < carved_mesh_indices.size(); carved_idx++)
+        {
+            Polygons& carved_mesh_layer = volumes[carved_mesh_indices[carved_idx]]->layers[layer_nr].polygons;
+            if (!is_carved[carved_idx] && !carved_mesh_layer.empty())
+            { // the outlines are still processed by the even-odd rule like a difference would, so that carving doesn't depend on how close the cutting meshes are
+                carved_mesh_layer = carved_mesh_layer.processEvenOdd();
+            }
+        }
+    });
 }
 
 
@@ -1,13 +1,177 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
+#include <random> // mt19937
+
 #include "pathOrderOptimizer.h"
 #include "utils/logoutput.h"
 #include "utils/SparsePointGridInclusive.h"
 #include "utils/linearAlg2D.h"
+#include "utils/AABB.h"
 
 #define INLINE static inline
 
 namespace cura {
 
+namespace
+{
+
+/*!
+ * Grid of buckets of points, from which points can be removed, for finding the points nearest to a location.
+ *
+ * Unlike \ref SparsePointGridInclusive, the grid is dense and covers the bounding box of the points,
+ * with the cell size chosen such that there are about two points per cell.
+ */
+class NearestPointGrid
+{
+public:
+    /*!
+     * \param points The points to insert. Points are referred to by their index in this vector.
+     * \param skip Which points not to insert
+     */
+    NearestPointGrid(const std::vector<Point>& points, const std::vector<bool>& skip)
+    : point_cell(points.size())
+    , point_pos_in_cell(points.size())
+    {
+        AABB aabb;
+        unsigned int point_count = 0;
+        for (unsigned int point_idx = 0; point_idx < points.size(); point_idx++)
+        {
+            if (!skip[point_idx])
+            {
+                aabb.include(points[point_idx]);
+                point_count++;
+            }
+        }
+        if (point_count == 0)
+        {
+            aabb = AABB(Point(0, 0), Point(0, 0));
+        }
+        origin = aabb.min;
+        const double area = std::max(1.0, double(aabb.max.X - aabb.min.X) * double(aabb.max.Y - aabb.min.Y));
+        cell_size = std::max(coord_t(1), coord_t(std::sqrt(2.0 * area / std::max(1u, point_count))));
+        cell_size = std::max(cell_size, std::max(aabb.max.X - aabb.min.X, aabb.max.Y - aabb.min.Y) / 1024 + 1); // limit the number of cells for points on a line
+        width = (aabb.max.X - aabb.min.X) / cell_size + 1;
+        height = (aabb.max.Y - aabb.min.Y) / cell_size + 1;
+
+        cell_start.assign(width * height + 1, 0);
+        for (unsigned int point_idx = 0; point_idx < points.size(); point_idx++)
+        {
+            if (!skip[point_idx])
+            {
+                point_cell[point_idx] = getCellIdx(points[point_idx]);
+                cell_start[point_cell[point_idx] + 1]++;
+            }
+        }
+        for (unsigned int cell_idx = 0; cell_idx < width * height; cell_idx++)
+        {
+            cell_start[cell_idx + 1] += cell_start[cell_idx];
+        }
+        cell_end.assign(cell_start.begin(), cell_start.end() - 1);
+        cell_points.resize(point_count);
+        for (unsigned int point_idx = 0; point_idx < points.size(); point_idx++)
+        {
+            if (!skip[point_idx])
+            {
+                point_pos_in_cell[point_idx] = cell_end[point_cell[point_idx]];
+                cell_points[cell_end[point_cell[point_idx]]++] = point_idx;
+            }
+        }
+    }
+
+    /*!
+     * Remove a point from the grid.
+     */
+    void remove(unsigned int point_idx)
+    {
+        const unsigned int cell_idx = point_cell[point_idx];
+        const unsigned int last_pos = --cell_end[cell_idx];
+        const unsigned int moved_point_idx = cell_points[last_pos];
+        cell_points[point_pos_in_cell[point_idx]] = moved_point_idx;
+        point_pos_in_cell[moved_point_idx] = point_pos_in_cell[point_idx];
+    }
+
+    /*!
+     * Visit the points in the grid in rings of cells around \p location, until \p done says the remaining points need not be visited.
+     *
+     * \param location The location around which to look for points
+     * \param visit Called with the index of each visited point
+     * \param done Called after each ring with a lower bound on the distance of the points not visited yet
+     */
+    template<typename Visit, typename Done>
+    void visitNearest(Point location, Visit visit, Done done) const
+    {
+        const int64_t location_x = floorDiv(location.X - origin.X, cell_size);
+        const int64_t location_y = floorDiv(location.Y - origin.Y, cell_size);
+        const int64_t max_ring = std::max(std::max(location_x, int64_t(width) - 1 - location_x), std::max(location_y, int64_t(height) - 1 - location_y));
+        const int64_t min_ring = std::max(std::max(int64_t(0), std::max(-location_x, location_x - (int64_t(width) - 1))), std::max(-location_y, location_y - (int64_t(height) - 1))); // the first ring which overlaps with the grid
+        for (int64_t ring = min_ring; ring <= max_ring; ring++)
+        {
+            const int64_t min_y = std::max(int64_t(0), location_y - ring);
+            const int64_t max_y = std::min(int64_t(height) - 1, location_y + ring);
+            for (int64_t y = min_y; y <= max_y; y++)
+            {
+                const bool is_edge_row = y == location_y - ring || y == location_y + ring;
+                if (is_edge_row)
+                {
+                    const int64_t min_x = std::max(int64_t(0), location_x - ring);
+                    const int64_t max_x = std::min(int64_t(width) - 1, location_x + ring);
+                    for (int64_t x = min_x; x <= max_x; x++)
+                    {
+                        visitCell(y * width + x, visit);
+                    }
+                }
+                else
+                {
+                    if (location_x - ring >= 0)
+                    {
+                        visitCell(y * width + location_x - ring, visit);
+                    }
+                    if (location_x + ring < int64_t(width))
+                    {
+                        visitCell(y * width + location_x + ring, visit);
+                    }
+                }
+            }
+            // the points in cells further away are at least this far removed from the location
+            if (done(ring * cell_size))
+            {
+                return;
+            }
+        }
+    }
+
+private:
+    Point origin; //!< The minimum of the bounding box of the points
+    coord_t cell_size;
+    unsigned int width; //!< The number of cells in x direction
+    unsigned int height; //!< The number of cells in y direction
+    std::vector<unsigned int> cell_start; //!< For each cell the index of its first point in cell_points
+    std::vector<unsigned int> cell_end; //!< For each cell the index one past its last point in cell_points which hasn't been removed
+    std::vector<unsigned int> cell_points; //!< The points of all cells
+    std::vector<unsigned int> point_cell; //!< For each point the cell it is in
+    std::vector<unsigned int> point_pos_in_cell; //!< For each point its index in cell_points
+
+    template<typename Visit>
+    void visitCell(unsigned int cell_idx, Visit& visit) const
+    {
+        for (unsigned int pos = cell_start[cell_idx]; pos < cell_end[cell_idx]; pos++)
+        {
+            visit(cell_points[pos]);
+        }
+    }
+
+    static int64_t floorDiv(int64_t a, int64_t b)
+    {
+        return (a >= 0) ? a / b : -((-a + b - 1) / b);
+    }
+
+    unsigned int getCellIdx(Point p) const
+    {
+        return ((p.Y - origin.Y) / cell_size) * width + (p.X - origin.X) / cell_size;
+    }
+};
+
+}//namespace
+
 /**
 *
 */
@@ -36,31 +200,42 @@ void PathOrderOptimizer::optimize()
     }
 
 
+    // The start points are fixed while ordering the polygons, so they can be put in a grid to find the nearest one.
+    std::vector<Point> start_points(polygons.size());
+    std::vector<bool> skip(polygons.size()); /// skip single-point-polygons
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        skip[poly_idx] = polygons[poly_idx].size() < 1;
+        if (!skip[poly_idx])
+        {
+            start_points[poly_idx] = polygons[poly_idx][polyStart[poly_idx]];
+        }
+    }
+    NearestPointGrid start_point_grid(start_points, skip);
+
     Point prev_point = startPoint;
     for (unsigned int poly_order_idx = 0; poly_order_idx < polygons.size(); poly_order_idx++) /// actual path order optimizer
     {
         int best_poly_idx = -1;
         float bestDist = std::numeric_limits<float>::infinity();
 
-
-        for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+        // Same outcome as checking all polygons in order: the lowest index wins among equally close polygons.
+        auto visit = [&](unsigned int poly_idx)
         {
-            if (picked[poly_idx] || polygons[poly_idx].size() < 1) /// skip single-point-polygons
-            {
-                continue;
-            }
-
             assert (polygons[poly_idx].size() != 2);
 
-            float dist = vSize2f(polygons[poly_idx][polyStart[poly_idx]] - prev_point);
-            if (dist < bestDist)
+            float dist = vSize2f(start_points[poly_idx] - prev_point);
+            if (dist < bestDist || (dist == bestDist && static_cast<int>(poly_idx) < best_poly_idx))
             {
                 best_poly_idx = poly_idx;
                 bestDist = dist;
             }
-
-        }
-
+        };
+        auto done = [&bestDist](coord_t unvisited_dist)
+        { // allow for the rounding errors of vSize2f, so that no polygon with the same rounded distance is missed
+            return double(unvisited_dist) * double(unvisited_dist) > double(bestDist) * (1.0 + 1e-5) + 1.0;
+        };
+        start_point_grid.visitNearest(prev_point, visit, done);
 
         if (best_poly_idx > -1) /// should always be true; we should have been able to identify the best next polygon
         {
@@ -69,6 +244,7 @@ void PathOrderOptimizer::optimize()
             prev_point = polygons[best_poly_idx][polyStart[best_poly_idx]];
 
             picked[best_poly_idx] = true;
+            start_point_grid.remove(best_poly_idx);
             polyOrder.push_back(best_poly_idx);
         }
         else
@@ -77,6 +253,11 @@ void PathOrderOptimizer::optimize()
         }
     }
 
+    if (two_opt_max_evaluations > 0)
+    {
+        improveOrderTwoOpt();
+    }
+
     prev_point = startPoint;
     for (unsigned int order_idx = 0; order_idx < polyOrder.size(); order_idx++) /// decide final starting points in each polygon
     {
@@ -88,6 +269,47 @@ void PathOrderOptimizer::optimize()
     }
 }
 
+void PathOrderOptimizer::improveOrderTwoOpt()
+{
+    const unsigned int count = polyOrder.size();
+    // location 0 is the start point, location i is the start of the i-th polygon in the order
+    std::vector<Point> locations(count + 1);
+    locations[0] = startPoint;
+    for (unsigned int order_idx = 0; order_idx < count; order_idx++)
+    {
+        locations[order_idx + 1] = polygons[polyOrder[order_idx]][polyStart[polyOrder[order_idx]]];
+    }
+    auto dist = [&locations](unsigned int a, unsigned int b)
+    {
+        return vSizeMM(locations[a] - locations[b]);
+    };
+    unsigned int evaluations = 0;
+    bool improved = true;
+    while (improved && evaluations < two_opt_max_evaluations)
+    {
+        improved = false;
+        for (unsigned int first = 1; first < count && evaluations < two_opt_max_evaluations; first++)
+        {
+            for (unsigned int last = first + 1; last <= count && evaluations < two_opt_max_evaluations; last++)
+            {
+                evaluations++;
+                // reverse the polygons first..last
+                double gain = dist(first - 1, first) - dist(first - 1, last);
+                if (last < count)
+                {
+                    gain += dist(last, last + 1) - dist(first, last + 1);
+                }
+                if (gain > 0.001) // more than a micron
+                {
+                    std::reverse(polyOrder.begin() + first - 1, polyOrder.begin() + last);
+                    std::reverse(locations.begin() + first, locations.begin() + last + 1);
+                    improved = true;
+                }
+            }
+        }
+    }
+}
+
 int PathOrderOptimizer::getPolyStart(Point prev_point, int poly_idx)
 {
     switch (type)
@@ -103,30 +325,47 @@ int PathOrderOptimizer::getPolyStart(Point prev_point, int poly_idx)
 int PathOrderOptimizer::getClosestPointInPolygon(Point prev_point, int poly_idx)
 {
     ConstPolygonRef poly = polygons[poly_idx];
+    const unsigned int point_count = poly.size();
+
+    // The inside corner score lies between -2 * corner_score_weight and 0, so only the vertices which are at most that
+    // much further away than the closest vertex can have the best score. The angles are what takes the time, so the
+    // closest vertex is found first in a loop without branches, which the compiler can vectorize.
+    constexpr double corner_score_weight = 5000 * 5000; // this score is in the order of 5 mm
+    int64_t min_dist = std::numeric_limits<int64_t>::max();
+    for (unsigned int point_idx = 0; point_idx < point_count; point_idx++)
+    {
+        min_dist = std::min(min_dist, vSize2(poly[point_idx] - prev_point));
+    }
+    const double max_candidate_dist = (min_dist + 2 * corner_score_weight) * (1.0 + 1e-6) + 1.0; // allow for the rounding of the float scores
 
     int best_point_idx = -1;
     float best_point_score = std::numeric_limits<float>::infinity();
-    Point p0 = poly.back();
-    for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+    for (unsigned int point_idx = 0; point_idx < point_count; point_idx++)
     {
         const Point& p1 = poly[point_idx];
-        const Point& p2 = poly[(point_idx + 1) % poly.size()];
         int64_t dist = vSize2(p1 - prev_point);
-        float is_on_inside_corner_score = -LinearAlg2D::getAngleLeft(p0, p1, p2) / M_PI * 5000 * 5000; // prefer inside corners
-        // this score is in the order of 5 mm
+        if (dist > max_candidate_dist)
+        {
+            continue;
+        }
+        const Point& p0 = poly[(point_idx + point_count - 1) % point_count];
+        const Point& p2 = poly[(point_idx + 1) % point_count];
+        float is_on_inside_corner_score = -LinearAlg2D::getAngleLeft(p0, p1, p2) / M_PI * corner_score_weight; // prefer inside corners
         if (dist + is_on_inside_corner_score < best_point_score)
         {
             best_point_idx = point_idx;
             best_point_score = dist + is_on_inside_corner_score;
         }
-        p0 = p1;
     }
     return best_point_idx;
 }
 
 int PathOrderOptimizer::getRandomPointInPolygon(int poly_idx)
 {
-    return rand() % polygons[poly_idx].size();
+    ConstPolygonRef poly = polygons[poly_idx];
+    std::seed_seq polygon_seed{random_seed, static_cast<unsigned int>(poly[0].X), static_cast<unsigned int>(poly[0].Y), static_cast<unsigned int>(poly.size())};
+    std::mt19937 random(polygon_seed);
+    return std::uniform_int_distribution<unsigned int>(0, poly.size() - 1)(random);
 }
 
 /**
@@ -135,7 +374,8 @@ int PathOrderOptimizer::getRandomPointInPolygon(int poly_idx)
 void LineOrderOptimizer::optimize()
 {
     int gridSize = 5000; // the size of the cells in the hash grid. TODO
-    SparsePointGridInclusive<unsigned int> line_bucket_grid(gridSize);
+    using LineBucketGrid = SparsePointGridInclusive<unsigned int, MortonGridMap<SparsePointGridInclusiveImpl::SparsePointGridInclusiveElem<unsigned int>>>;
+    LineBucketGrid line_bucket_grid(gridSize);
     bool picked[polygons.size()];
     memset(picked, false, sizeof(bool) * polygons.size());/// initialized as falses
     
@@ -163,6 +403,21 @@ void LineOrderOptimizer::optimize()
     }
 
 
+    // The grid of line ends to find the best line among all lines when there is none nearby; point 2*i+j is end j of line i.
+    std::vector<Point> line_ends(polygons.size() * 2);
+    std::vector<bool> skip(polygons.size() * 2);
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        const bool is_empty = polygons[poly_idx].size() < 1; /// skip single-point-polygons
+        skip[poly_idx * 2] = skip[poly_idx * 2 + 1] = is_empty;
+        if (!is_empty)
+        {
+            line_ends[poly_idx * 2] = polygons[poly_idx][0];
+            line_ends[poly_idx * 2 + 1] = polygons[poly_idx][1];
+        }
+    }
+    NearestPointGrid line_end_grid(line_ends, skip);
+
     Point incoming_perpundicular_normal(0, 0);
     Point prev_point = startPoint;
     for (unsigned int order_idx = 0; order_idx < polygons.size(); order_idx++) /// actual path order optimizer
@@ -171,29 +426,40 @@ void LineOrderOptimizer::optimize()
         float best_score = std::numeric_limits<float>::infinity(); // distance score for the best next line
 
         /// check if single-line-polygon is close to last point
-        for(unsigned int close_line_idx :
-                line_bucket_grid.getNearbyVals(prev_point, gridSize))
-        {
-            if (picked[close_line_idx] || polygons[close_line_idx].size() < 1)
+        line_bucket_grid.visitNearbyVals(prev_point, gridSize,
+            [&](unsigned int close_line_idx)
             {
-                continue;
-            }
-
-            updateBestLine(close_line_idx, best_line_idx, best_score, prev_point, incoming_perpundicular_normal);
-        }
+                if (!picked[close_line_idx] && polygons[close_line_idx].size() >= 1)
+                {
+                    updateBestLine(close_line_idx, best_line_idx, best_score, prev_point, incoming_perpundicular_normal);
+                }
+                return true;
+            });
 
         if (best_line_idx == -1) /// if single-line-polygon hasn't been found yet
-        {
-            for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+        { // Find the best line among all lines, with the same outcome as calling updateBestLine on all lines in order.
+            int best_end_idx = -1;
+            auto visit = [&](unsigned int end_point_idx)
             {
-                if (picked[poly_idx] || polygons[poly_idx].size() < 1) /// skip single-point-polygons
+                const unsigned int poly_idx = end_point_idx / 2;
+                assert(polygons[poly_idx].size() == 2);
+                ConstPolygonRef line = polygons[poly_idx];
+                const float score = vSize2f(line[end_point_idx % 2] - prev_point) + getAngleScore(incoming_perpundicular_normal, line[0], line[1]);
+                if (score < best_score || (score == best_score && static_cast<int>(end_point_idx) < best_end_idx))
                 {
-                    continue;
+                    best_end_idx = end_point_idx;
+                    best_score = score;
                 }
-                assert(polygons[poly_idx].size() == 2);
-
-                updateBestLine(poly_idx, best_line_idx, best_score, prev_point, incoming_perpundicular_normal);
-
+            };
+            auto done = [&best_score](coord_t unvisited_dist)
+            { // the angle score is at most 100, and allow for the rounding errors of the scores
+                return double(unvisited_dist) * double(unvisited_dist) * (1.0 - 1e-6) - 101.0 > double(best_score) + std::abs(double(best_score)) * 1e-5 + 1.0;
+            };
+            line_end_grid.visitNearest(prev_point, visit, done);
+            if (best_end_idx != -1)
+            {
+                best_line_idx = best_end_idx / 2;
+                polyStart[best_line_idx] = best_end_idx % 2;
             }
         }
 
@@ -210,6 +476,8 @@ void LineOrderOptimizer::optimize()
             incoming_perpundicular_normal = turn90CCW(normal(line_end - line_start, 1000));
 
             picked[best_line_idx] = true;
+            line_end_grid.remove(best_line_idx * 2);
+            line_end_grid.remove(best_line_idx * 2 + 1);
             polyOrder.push_back(best_line_idx);
         }
         else
@@ -24,10 +24,25 @@ public:
     std::vector<int> polyStart; //!< polygons[i][polyStart[i]] = point of polygon i which is to be the starting point in printing the polygon
     std::vector<int> polyOrder; //!< the optimized order as indices in #polygons
 
+    /*!
+     * The maximum number of reversals to evaluate when improving the greedy order with 2-opt.
+     * Zero means the greedy nearest neighbour order is used as is.
+     */
+    unsigned int two_opt_max_evaluations;
+
+    /*!
+     * The seed of the starting vertices chosen for EZSeamType::RANDOM, such as the layer number.
+     * Each polygon gets its starting vertex from the seed and its own vertices,
+     * so that the seams don't depend on which thread planned which layer first.
+     */
+    unsigned int random_seed;
+
     PathOrderOptimizer(Point startPoint, Point z_seam_pos = Point(0, 0), EZSeamType type = EZSeamType::SHORTEST)
     : type(type)
     , startPoint(startPoint)
     , z_seam_pos(z_seam_pos)
+    , two_opt_max_evaluations(0)
+    , random_seed(0)
     {
     }
 
@@ -58,6 +73,13 @@ private:
      */
     int getPolyStart(Point prev_point, int poly_idx);
 
+    /*!
+     * Shorten the travel between the polygons in \ref PathOrderOptimizer::polyOrder by reversing parts of the order (2-opt).
+     * 
+     * Since the polygons are closed, a polygon is left where it was entered, so reversing part of the order doesn't change the travel within it.
+     */
+    void improveOrderTwoOpt();
+
     int getClosestPointInPolygon(Point prev, int i_polygon); //!< returns the index of the closest point
     int getRandomPointInPolygon(int poly_idx);
 
@@ -2,12 +2,14 @@
 #include "Comb.h"
 
 #include <algorithm>
-#include <functional> // function
-#include <unordered_set>
+#include <functional> // function, hash
+#include <list>
+#include <mutex>
 
 #include "../utils/polygonUtils.h"
 #include "../utils/linearAlg2D.h"
 #include "../utils/PolygonsPointIndex.h"
+#include "../utils/Profiler.h"
 #include "../sliceDataStorage.h"
 #include "../utils/SVG.h"
 
@@ -22,6 +24,11 @@ Polygons& Comb::getBoundaryOutside()
 {
     return *boundary_outside;
 }
+
+const std::vector<AABB>& Comb::getBoundaryOutsideAABBs()
+{
+    return *boundary_outside_aabbs;
+}
   
 Comb::Comb(const SliceDataStorage& storage, int layer_nr, const Polygons& comb_boundary_inside, int64_t comb_boundary_offset, bool travel_avoid_other_parts, int64_t travel_avoid_distance)
 : storage(storage)
@@ -32,13 +39,15 @@ Comb::Comb(const SliceDataStorage& storage, int layer_nr, const Polygons& comb_b
 , offset_from_inside_to_outside(offset_from_outlines + offset_from_outlines_outside)
 , max_crossing_dist2(offset_from_inside_to_outside * offset_from_inside_to_outside * 2) // so max_crossing_dist = offset_from_inside_to_outside * sqrt(2) =approx 1.5 to allow for slightly diagonal crossings and slightly inaccurate crossing computation
 , avoid_other_parts(travel_avoid_other_parts)
-, boundary_inside( comb_boundary_inside ) // copy the boundary, because the partsView_inside will reorder the polygons
-, partsView_inside( boundary_inside.splitIntoPartsView() ) // WARNING !! changes the order of boundary_inside !!
-, inside_loc_to_line(PolygonUtils::createLocToLineGrid(boundary_inside, comb_boundary_offset))
+, inside(getInsideBoundary(comb_boundary_inside, comb_boundary_offset))
+, boundary_inside(inside->polygons)
+, partsView_inside(inside->parts_view)
+, inside_loc_to_line(inside->loc_to_line.get())
 , boundary_outside(
         [&storage, layer_nr, travel_avoid_distance]()
         {
-            return storage.getLayerOutlines(layer_nr, false).offset(travel_avoid_distance);
+            Profiler::Zone zone("combing");
+            return storage.getLayerOutlinesCached(layer_nr, false, false, travel_avoid_distance);
         }
     )
 , outside_loc_to_line(
@@ -49,15 +58,113 @@ Comb::Comb(const SliceDataStorage& storage, int layer_nr, const Polygons& comb_b
         , this
         , offset_from_inside_to_outside
     )
+, flat_boundary_outside(
+        [this]()
+        {
+            return FlatPolygons(getBoundaryOutside());
+        }
+    )
+, boundary_outside_aabbs(
+        [this]()
+        {
+            return AABB::calculatePerPolygon(getBoundaryOutside());
+        }
+    )
 {
 }
 
-Comb::~Comb()
+Comb::InsideBoundary::InsideBoundary(const Polygons& boundary, int64_t offset)
+: polygons(boundary) // copy the boundary, because the parts_view will reorder the polygons
+, parts_view(polygons.splitIntoPartsView()) // WARNING !! changes the order of polygons !!
+, loc_to_line(PolygonUtils::createLocToLineGrid(polygons, offset))
+, poly_part_idx(polygons.size(), NO_INDEX)
 {
-    if (inside_loc_to_line)
+    // assemble the parts once, rather than for every travel move which combs within them
+    parts.reserve(parts_view.size());
+    flat_parts.reserve(parts_view.size());
+    for (unsigned int part_idx = 0; part_idx < parts_view.size(); part_idx++)
     {
-        delete inside_loc_to_line;
+        parts.emplace_back(parts_view.assemblePart(part_idx));
+        flat_parts.emplace_back(parts.back());
+        for (unsigned int poly_idx : parts_view[part_idx])
+        {
+            poly_part_idx[poly_idx] = part_idx;
+        }
     }
+    // beyond both the distance a start or end point is moved inside and the distance from which it may be moved inside
+    const coord_t clearance = std::max(static_cast<int64_t>(offset_extra_start_end), 2 * offset) + 10;
+    clearance_grid.reset(new BoundaryClearanceGrid(polygons, poly_part_idx, parts_view.size(), clearance));
+}
+
+std::shared_ptr<const Comb::InsideBoundary> Comb::getInsideBoundary(const Polygons& boundary, int64_t offset)
+{
+    Profiler::Zone zone("combing");
+    struct CachedBoundary
+    {
+        size_t hash;
+        Polygons boundary; //!< The boundary as given, before reordering
+        int64_t offset;
+        std::weak_ptr<const InsideBoundary> inside;
+    };
+    constexpr size_t max_cached_boundaries = 8; // about the number of layers which are planned at the same time
+    static std::list<CachedBoundary> cache; // most recently used first
+    static std::mutex cache_mutex;
+
+    size_t hash = std::hash<int64_t>()(offset);
+    for (ConstPolygonRef poly : boundary)
+    {
+        hash = hash * 31 + poly.size();
+        for (const Point& p : poly)
+        {
+            hash = hash * 31 + std::hash<Point>()(p);
+        }
+    }
+    auto isSameBoundary = [&boundary, offset, hash](const CachedBoundary& cached)
+    {
+        if (cached.hash != hash || cached.offset != offset || cached.boundary.size() != boundary.size())
+        {
+            return false;
+        }
+        for (unsigned int poly_idx = 0; poly_idx < boundary.size(); poly_idx++)
+        {
+            ConstPolygonRef poly = boundary[poly_idx];
+            ConstPolygonRef cached_poly = cached.boundary[poly_idx];
+            if (poly.size() != cached_poly.size() || !std::equal(poly.begin(), poly.end(), cached_poly.begin()))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (auto it = cache.begin(); it != cache.end(); )
+        {
+            std::shared_ptr<const InsideBoundary> inside = it->inside.lock();
+            if (!inside)
+            { // no layer uses this boundary anymore
+                it = cache.erase(it);
+                continue;
+            }
+            if (isSameBoundary(*it))
+            {
+                cache.splice(cache.begin(), cache, it);
+                return inside;
+            }
+            ++it;
+        }
+    }
+
+    // construct outside of the lock, so that other layers don't have to wait for it
+    std::shared_ptr<const InsideBoundary> inside = std::make_shared<const InsideBoundary>(boundary, offset);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache.push_front(CachedBoundary{hash, boundary, offset, inside});
+    if (cache.size() > max_cached_boundaries)
+    {
+        cache.pop_back();
+    }
+    return inside;
 }
 
 bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _startInside, bool _endInside, int64_t max_comb_distance_ignored, bool via_outside_makes_combing_fail, bool fail_on_unavoidable_obstacles)
@@ -67,6 +174,14 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
         return true;
     }
 
+    if (_startInside && _endInside && inside->clearance_grid->getFarPart(startPoint, endPoint) != BoundaryClearanceGrid::near_boundary)
+    { // the travel lies well within a single part, so it wouldn't be moved nor would it collide with the boundary
+        combPaths.emplace_back();
+        combPaths.back().push_back(startPoint);
+        combPaths.back().push_back(endPoint);
+        return true;
+    }
+
     //Move start and end point inside the comb boundary
     unsigned int start_inside_poly = NO_INDEX;
     const bool startInside = moveInside(_startInside, startPoint, start_inside_poly);
@@ -81,9 +196,8 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
     
     if (startInside && endInside && start_part_idx == end_part_idx)
     { // normal combing within part
-        PolygonsPart part = partsView_inside.assemblePart(start_part_idx);
         combPaths.emplace_back();
-        return LinePolygonsCrossings::comb(part, *inside_loc_to_line, startPoint, endPoint, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+        return LinePolygonsCrossings::comb(inside->parts[start_part_idx], inside->flat_parts[start_part_idx], *inside_loc_to_line, &partsView_inside[start_part_idx], startPoint, endPoint, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
     }
     else 
     { // comb inside part to edge (if needed) >> move through air avoiding other parts >> comb inside end part upto the endpoint (if needed) 
@@ -102,8 +216,8 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
         Crossing end_crossing(endPoint, endInside, end_part_idx, end_part_boundary_poly_idx, boundary_inside, inside_loc_to_line);
 
         { // find crossing over the in-between area between inside and outside
-            start_crossing.findCrossingInOrMid(partsView_inside, endPoint);
-            end_crossing.findCrossingInOrMid(partsView_inside, start_crossing.in_or_mid);
+            start_crossing.findCrossingInOrMid(*inside, endPoint);
+            end_crossing.findCrossingInOrMid(*inside, start_crossing.in_or_mid);
         }
 
         bool skip_avoid_other_parts_path = false;
@@ -133,9 +247,9 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
         if (startInside)
         {
             // start to boundary
-            assert(start_crossing.dest_part.size() > 0 && "The part we start inside when combing should have been computed already!");
+            assert(start_crossing.dest_part && start_crossing.dest_part->size() > 0 && "The part we start inside when combing should have been computed already!");
             combPaths.emplace_back();
-            bool combing_succeeded = LinePolygonsCrossings::comb(start_crossing.dest_part, *inside_loc_to_line, startPoint, start_crossing.in_or_mid, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+            bool combing_succeeded = LinePolygonsCrossings::comb(*start_crossing.dest_part, inside->flat_parts[start_part_idx], *inside_loc_to_line, &partsView_inside[start_part_idx], startPoint, start_crossing.in_or_mid, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
             if (!combing_succeeded)
             { // Couldn't comb between start point and computed crossing from the start part! Happens for very thin parts when the offset_to_get_off_boundary moves points to outside the polygon
                 return false;
@@ -154,7 +268,7 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
             }
             else
             {
-                bool combing_succeeded = LinePolygonsCrossings::comb(*boundary_outside, *outside_loc_to_line, start_crossing.out, end_crossing.out, combPaths.back(), offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+                bool combing_succeeded = LinePolygonsCrossings::comb(*boundary_outside, *flat_boundary_outside, *outside_loc_to_line, nullptr, start_crossing.out, end_crossing.out, combPaths.back(), offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
                 if (!combing_succeeded)
                 {
                     return false;
@@ -191,10 +305,10 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
         if (endInside)
         {
             // boundary to end
-            assert(end_crossing.dest_part.size() > 0 && "The part we end up inside when combing should have been computed already!");
+            assert(end_crossing.dest_part && end_crossing.dest_part->size() > 0 && "The part we end up inside when combing should have been computed already!");
             combPaths.emplace_back();
             
-            bool combing_succeeded = LinePolygonsCrossings::comb(end_crossing.dest_part, *inside_loc_to_line, end_crossing.in_or_mid, endPoint, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
+            bool combing_succeeded = LinePolygonsCrossings::comb(*end_crossing.dest_part, inside->flat_parts[end_part_idx], *inside_loc_to_line, &partsView_inside[end_part_idx], end_crossing.in_or_mid, endPoint, combPaths.back(), -offset_dist_to_get_from_on_the_polygon_to_outside, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
             if (!combing_succeeded)
             { // Couldn't comb between end point and computed crossing to the end part! Happens for very thin parts when the offset_to_get_off_boundary moves points to outside the polygon
                 return false;
@@ -207,6 +321,7 @@ bool Comb::calc(Point startPoint, Point endPoint, CombPaths& combPaths, bool _st
 
 Comb::Crossing::Crossing(const Point& dest_point, const bool dest_is_inside, const unsigned int dest_part_idx, const unsigned int dest_part_boundary_crossing_poly_idx, const Polygons& boundary_inside, const LocToLineGrid* inside_loc_to_line)
 : dest_is_inside(dest_is_inside)
+, dest_part(nullptr)
 , boundary_inside(boundary_inside)
 , inside_loc_to_line(inside_loc_to_line)
 , dest_point(dest_point)
@@ -222,6 +337,16 @@ bool Comb::moveInside(bool is_inside, Point& dest_point, unsigned int& inside_po
 {
     if (is_inside)
     {
+        const unsigned int far_part_idx = inside->clearance_grid->getFarPart(dest_point);
+        if (far_part_idx == NO_INDEX)
+        { // too far outside to be moved inside
+            return false;
+        }
+        if (far_part_idx != BoundaryClearanceGrid::near_boundary)
+        { // far enough inside to stay where it is; the closest polygon would be one of this part
+            inside_poly = partsView_inside[far_part_idx][0];
+            return true;
+        }
         ClosestPolygonPoint cpp = PolygonUtils::ensureInsideOrOutside(boundary_inside, dest_point, offset_extra_start_end, max_moveInside_distance2, &boundary_inside, inside_loc_to_line);
         if (!cpp.isValid())
         {
@@ -236,27 +361,24 @@ bool Comb::moveInside(bool is_inside, Point& dest_point, unsigned int& inside_po
     return false;
 }
 
-void Comb::Crossing::findCrossingInOrMid(const PartsView& partsView_inside, const Point close_to)
+void Comb::Crossing::findCrossingInOrMid(const InsideBoundary& inside, const Point close_to)
 {
     if (dest_is_inside)
     { // in-case
         // find the point on the start inside-polygon closest to the endpoint, but also kind of close to the start point
         Point _dest_point(dest_point); // copy to local variable for lambda capture
         std::function<int(Point)> close_towards_start_penalty_function([_dest_point](Point candidate){ return vSize2((candidate - _dest_point) / 10); });
-        dest_part = partsView_inside.assemblePart(dest_part_idx);
+        dest_part = &inside.parts[dest_part_idx];
 
         ClosestPolygonPoint boundary_crossing_point;
         { // set [result] to a point on the destination part closest to close_to (but also a bit close to _dest_point)
-            std::unordered_set<unsigned int> dest_part_poly_indices;
-            for (unsigned int poly_idx : partsView_inside[dest_part_idx])
-            {
-                dest_part_poly_indices.emplace(poly_idx);
-            }
+            const std::vector<unsigned int>& poly_part_idx = inside.poly_part_idx;
+            const unsigned int part_idx = dest_part_idx;
             coord_t dist2_score = std::numeric_limits<coord_t>::max();
             std::function<bool (const PolygonsPointIndex&)> line_processor
-                = [close_to, _dest_point, &boundary_crossing_point, &dist2_score, &dest_part_poly_indices](const PolygonsPointIndex& boundary_segment)
+                = [close_to, _dest_point, &boundary_crossing_point, &dist2_score, &poly_part_idx, part_idx](const PolygonsPointIndex& boundary_segment)
                 {
-                    if (dest_part_poly_indices.find(boundary_segment.poly_idx) == dest_part_poly_indices.end())
+                    if (poly_part_idx[boundary_segment.poly_idx] != part_idx)
                     { // we're not looking at a polygon from the dest_part
                         return true; // a.k.a. continue;
                     }
@@ -278,7 +400,7 @@ void Comb::Crossing::findCrossingInOrMid(const PartsView& partsView_inside, cons
             result = dest_point;
         }
 
-        ClosestPolygonPoint crossing_1_in_cp = PolygonUtils::ensureInsideOrOutside(dest_part, result, boundary_crossing_point, offset_dist_to_get_from_on_the_polygon_to_outside, &boundary_inside, inside_loc_to_line, close_towards_start_penalty_function);
+        ClosestPolygonPoint crossing_1_in_cp = PolygonUtils::ensureInsideOrOutside(*dest_part, result, boundary_crossing_point, offset_dist_to_get_from_on_the_polygon_to_outside, &boundary_inside, inside_loc_to_line, close_towards_start_penalty_function);
         if (crossing_1_in_cp.isValid())
         {
             dest_crossing_poly = crossing_1_in_cp.poly;
@@ -298,7 +420,7 @@ void Comb::Crossing::findCrossingInOrMid(const PartsView& partsView_inside, cons
 bool Comb::Crossing::findOutside(const Polygons& outside, const Point close_to, const bool fail_on_unavoidable_obstacles, Comb& comber)
 {
     out = in_or_mid;
-    if (dest_is_inside || outside.inside(in_or_mid, true)) // start in_between
+    if (dest_is_inside || outside.inside(in_or_mid, comber.getBoundaryOutsideAABBs(), true)) // start in_between
     { // move outside
         Point preferred_crossing_1_out = in_or_mid + normal(close_to - in_or_mid, comber.offset_from_inside_to_outside);
         std::function<int(Point)> close_to_penalty_function([preferred_crossing_1_out](Point candidate){ return vSize2((candidate - preferred_crossing_1_out) / 2); });
@@ -4,10 +4,13 @@
 
 #include <memory> // shared_ptr
 
+#include "../utils/AABB.h"
+#include "../utils/BoundaryClearanceGrid.h"
 #include "../utils/optional.h"
 #include "../utils/polygon.h"
 #include "../utils/SparsePointGridInclusive.h"
 #include "../utils/polygonUtils.h"
+#include "../utils/FlatPolygons.h"
 #include "../utils/LazyInitialization.h"
 
 #include "LinePolygonsCrossings.h"
@@ -36,6 +39,24 @@ class Comb
 {
     friend class LinePolygonsCrossings;
 private:
+    /*!
+     * The data of the inside boundary, which only depends on the boundary polygons and the offset.
+     * 
+     * Layers with the same boundary (e.g. the layers of a prismatic model) share this data instead of each splitting the boundary into parts and building a grid of their own.
+     */
+    struct InsideBoundary
+    {
+        Polygons polygons; //!< The boundary within which to comb. (Reordered by the parts_view)
+        const PartsView parts_view; //!< Structured indices onto polygons which shows which polygons belong to which part.
+        const std::unique_ptr<const LocToLineGrid> loc_to_line; //!< The SparsePointGridInclusive mapping locations to line segments of the polygons.
+        std::vector<PolygonsPart> parts; //!< The assembled parts, in the order of parts_view
+        std::vector<FlatPolygons> flat_parts; //!< The assembled parts in a single buffer each, for the scans over all their points
+        std::vector<unsigned int> poly_part_idx; //!< For each polygon the index of the part it belongs to
+        std::unique_ptr<const BoundaryClearanceGrid> clearance_grid; //!< Which locations lie well inside or outside the parts, so that moving them inside needs no search over the polygons
+
+        InsideBoundary(const Polygons& boundary, int64_t offset);
+    };
+
     /*!
      * A crossing from the inside boundary to the outside boundary.
      * 
@@ -47,7 +68,7 @@ private:
         bool dest_is_inside; //!< Whether the startPoint or endPoint is inside the inside boundary
         Point in_or_mid; //!< The point on the inside boundary, or in between the inside and outside boundary if the start/end point isn't inside the inside boudary
         Point out; //!< The point on the outside boundary
-        PolygonsPart dest_part; //!< The assembled inside-boundary PolygonsPart in which the dest_point lies. (will only be initialized when Crossing::dest_is_inside holds)
+        const PolygonsPart* dest_part; //!< The assembled inside-boundary PolygonsPart in which the dest_point lies. (will only be initialized when Crossing::dest_is_inside holds)
         std::optional<ConstPolygonRef> dest_crossing_poly; //!< The polygon of the part in which dest_point lies, which will be crossed (often will be the outside polygon)
         const Polygons& boundary_inside; //!< The inside boundary as in \ref Comb::boundary_inside
         const LocToLineGrid* inside_loc_to_line; //!< The loc to line grid \ref Comb::inside_loc_to_line
@@ -66,10 +87,10 @@ private:
         /*!
          * Find the not-outside location (Combing::in_or_mid) of the crossing between to the outside boundary
          * 
-         * \param partsView_inside Structured indices onto Comb::boundary_inside which shows which polygons belong to which part. 
+         * \param inside The data of the inside boundary, of which the assembled parts are used
          * \param close_to[in] Try to get a crossing close to this point
          */
-        void findCrossingInOrMid(const PartsView& partsView_inside, const Point close_to);
+        void findCrossingInOrMid(const InsideBoundary& inside, const Point close_to);
 
         /*!
          * Find the outside location (Combing::out)
@@ -115,11 +136,22 @@ private:
 
     const bool avoid_other_parts; //!< Whether to perform inverse combing a.k.a. avoid parts.
     
-    Polygons boundary_inside; //!< The boundary within which to comb. (Will be reordered by the partsView_inside)
-    const PartsView partsView_inside; //!< Structured indices onto boundary_inside which shows which polygons belong to which part. 
-    LocToLineGrid* inside_loc_to_line; //!< The SparsePointGridInclusive mapping locations to line segments of the inner boundary.
+    /*!
+     * Get the inside boundary data for a boundary, from the layers which are still using the same boundary if possible.
+     * 
+     * \param boundary The comb boundary within which to comb within layer parts
+     * \param offset The offset from the outline polygon, which determines the cell size of the grid
+     */
+    static std::shared_ptr<const InsideBoundary> getInsideBoundary(const Polygons& boundary, int64_t offset);
+
+    const std::shared_ptr<const InsideBoundary> inside; //!< The (possibly shared) data of the inside boundary
+    const Polygons& boundary_inside; //!< The boundary within which to comb. (Reordered by the partsView_inside)
+    const PartsView& partsView_inside; //!< Structured indices onto boundary_inside which shows which polygons belong to which part. 
+    const LocToLineGrid* inside_loc_to_line; //!< The SparsePointGridInclusive mapping locations to line segments of the inner boundary.
     LazyInitialization<Polygons> boundary_outside; //!< The boundary outside of which to stay to avoid collision with other layer parts. This is a pointer cause we only compute it when we move outside the boundary (so not when there is only a single part in the layer)
     LazyInitialization<LocToLineGrid, Comb*, const int64_t> outside_loc_to_line; //!< The SparsePointGridInclusive mapping locations to line segments of the outside boundary.
+    LazyInitialization<FlatPolygons> flat_boundary_outside; //!< The boundary_outside in a single buffer, for the scans over all its points
+    LazyInitialization<std::vector<AABB>> boundary_outside_aabbs; //!< The bounding box of each polygon of the outside boundary, for the many inside checks on a boundary with many holes.
 
     /*!
      * Get the SparsePointGridInclusive mapping locations to line segments of the outside boundary. Calculate it when it hasn't been calculated yet.
@@ -131,6 +163,11 @@ private:
       */
     Polygons& getBoundaryOutside();
 
+    /*!
+     * Get the bounding box of each polygon of the boundary_outside. Calculate them when they haven't been calculated yet.
+     */
+    const std::vector<AABB>& getBoundaryOutsideAABBs();
+
     /*!
      * Move the startPoint or endPoint inside when it should be inside
      * \param is_inside[in] Whether the \p dest_point should be inside
@@ -155,8 +192,6 @@ public:
      */
     Comb(const SliceDataStorage& storage, int layer_nr, const Polygons& comb_boundary_inside, int64_t offset_from_outlines, bool travel_avoid_other_parts, int64_t travel_avoid_distance);
 
-    ~Comb();
-
     /*!
      * Calculate the comb paths (if any) - one for each polygon combed alternated with travel paths
      * 
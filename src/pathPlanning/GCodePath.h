@@ -4,6 +4,7 @@
 
 #include "../SpaceFillType.h"
 #include "../GCodePathConfig.h"
+#include "../utils/Arena.h"
 
 #include "TimeMaterialEstimates.h"
 
@@ -29,13 +30,22 @@ public:
     bool retract; //!< Whether the path is a move path preceded by a retraction move; whether the path is a retracted move path. 
     bool perform_z_hop; //!< Whether to perform a z_hop in this path, which is assumed to be a travel path.
     bool perform_prime; //!< Whether this path is preceded by a prime (blob)
-    std::vector<Point> points; //!< The points constituting this path.
+    std::vector<Point, ArenaAllocator<Point>> points; //!< The points constituting this path, allocated from the arena of the layer plan.
     bool done;//!< Path is finished, no more moves should be added, and a new path should be started instead of any appending done to this one.
 
     bool spiralize; //!< Whether to gradually increment the z position during the printing of this path. A sequence of spiralized paths should start at the given layer height and end in one layer higher.
 
+    double length; //!< The length in mm of the moves to the points of this path, accumulated while the points are planned. Excludes the move to the first point of a layer, which depends on where the previous layer ended.
     TimeMaterialEstimates estimates; //!< Naive time and material estimates
 
+    /*!
+     * \param point_arena The arena to allocate the points from, which must outlive the path
+     */
+    GCodePath(Arena& point_arena)
+    : points(ArenaAllocator<Point>(point_arena))
+    {
+    }
+
     /*!
      * Whether this config is the config of a travel path.
      * 
@@ -2,6 +2,7 @@
 #include "LinePolygonsCrossings.h"
 
 #include <algorithm>
+#include <functional> // function
 
 #include "../utils/polygonUtils.h"
 #include "../sliceDataStorage.h"
@@ -16,14 +17,16 @@ bool LinePolygonsCrossings::calcScanlineCrossings(bool fail_on_unavoidable_obsta
     min_crossing_idx = NO_INDEX;
     max_crossing_idx = NO_INDEX;
 
-    for(unsigned int poly_idx = 0; poly_idx < boundary.size(); poly_idx++)
+    for (unsigned int poly_idx : candidate_poly_idx)
     {
         PolyCrossings minMax(poly_idx); 
-        PolygonRef poly = boundary[poly_idx];
-        Point p0 = transformation_matrix.apply(poly[poly.size() - 1]);
+        ConstFlatPolygonRef poly = flat_boundary[poly_idx];
+        transformed_poly.resize(poly.size());
+        transformation_matrix.apply(poly.begin(), transformed_poly.data(), poly.size()); // all points are visited, so transform them in one go
+        Point p0 = transformed_poly.back();
         for(unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
         {
-            Point p1 = transformation_matrix.apply(poly[point_idx]);
+            Point p1 = transformed_poly[point_idx];
             if ((p0.Y >= transformed_startPoint.Y && p1.Y <= transformed_startPoint.Y) || (p1.Y >= transformed_startPoint.Y && p0.Y <= transformed_startPoint.Y))
             { // if line segment crosses the line through the transformed start and end point (aka scanline)
                 if (p1.Y == p0.Y) //Line segment is parallel with the scanline. That means that both endpoints lie on the scanline, so they will have intersected with the adjacent line.
@@ -71,6 +74,40 @@ bool LinePolygonsCrossings::calcScanlineCrossings(bool fail_on_unavoidable_obsta
 }
 
 
+void LinePolygonsCrossings::findCandidatePolygons()
+{
+    // Look along the boundary of a thin rectangle around the line segment and along the segment itself,
+    // so that polygons which only cross the scanline due to the rounding of the transformation are found as well.
+    constexpr coord_t rounding_margin = 10;
+    const Point along = (endPoint == startPoint)? Point(rounding_margin, 0) : normal(endPoint - startPoint, rounding_margin);
+    const Point side = turn90CCW(along);
+    const Point corners[] = { startPoint - along + side, endPoint + along + side, endPoint + along - side, startPoint - along - side };
+
+    std::vector<unsigned int> near_grid_poly_idx;
+    const std::function<bool (const PolygonsPointIndex&)> add_polygon = [&near_grid_poly_idx](const PolygonsPointIndex& line)
+        {
+            near_grid_poly_idx.push_back(line.poly_idx);
+            return true;
+        };
+    for (unsigned int corner_idx = 0; corner_idx < 4; corner_idx++)
+    {
+        loc_to_line_grid.processLine(std::make_pair(corners[corner_idx], corners[(corner_idx + 1) % 4]), add_polygon);
+    }
+    loc_to_line_grid.processLine(std::make_pair(startPoint, endPoint), add_polygon);
+    std::sort(near_grid_poly_idx.begin(), near_grid_poly_idx.end());
+    near_grid_poly_idx.erase(std::unique(near_grid_poly_idx.begin(), near_grid_poly_idx.end()), near_grid_poly_idx.end());
+
+    candidate_poly_idx.clear();
+    for (unsigned int poly_idx = 0; poly_idx < flat_boundary.size(); poly_idx++)
+    {
+        const unsigned int poly_idx_in_grid = (grid_poly_idx)? (*grid_poly_idx)[poly_idx] : poly_idx;
+        if (std::binary_search(near_grid_poly_idx.begin(), near_grid_poly_idx.end(), poly_idx_in_grid))
+        {
+            candidate_poly_idx.push_back(poly_idx);
+        }
+    }
+}
+
 bool LinePolygonsCrossings::lineSegmentCollidesWithBoundary()
 {
     Point diff = endPoint - startPoint;
@@ -79,8 +116,10 @@ bool LinePolygonsCrossings::lineSegmentCollidesWithBoundary()
     transformed_startPoint = transformation_matrix.apply(startPoint);
     transformed_endPoint = transformation_matrix.apply(endPoint);
 
-    for(PolygonRef poly : boundary)
+    findCandidatePolygons();
+    for (unsigned int poly_idx : candidate_poly_idx)
     {
+        ConstFlatPolygonRef poly = flat_boundary[poly_idx];
         Point p0 = transformation_matrix.apply(poly.back());
         for(Point p1_ : poly)
         {
@@ -144,7 +183,7 @@ void LinePolygonsCrossings::getBasicCombingPath(CombPath& combPath)
 
 void LinePolygonsCrossings::getBasicCombingPath(PolyCrossings& polyCrossings, CombPath& combPath) 
 {
-    PolygonRef poly = boundary[polyCrossings.poly_idx];
+    ConstPolygonRef poly = boundary[polyCrossings.poly_idx];
     combPath.push_back(transformation_matrix.unapply(Point(polyCrossings.min.x - std::abs(dist_to_move_boundary_point_outside), transformed_startPoint.Y)));
     if ( ( polyCrossings.max.point_idx - polyCrossings.min.point_idx + poly.size() ) % poly.size() 
         < poly.size() / 2 )
@@ -2,6 +2,7 @@
 #ifndef PATH_PLANNING_LINE_POLYGONS_CROSSINGS_H
 #define PATH_PLANNING_LINE_POLYGONS_CROSSINGS_H
 
+#include "../utils/FlatPolygons.h"
 #include "../utils/polygon.h"
 #include "../utils/polygonUtils.h"
 #include "../utils/SparseLineGrid.h"
@@ -81,8 +82,11 @@ private:
     unsigned int min_crossing_idx; //!< The index into LinePolygonsCrossings::crossings to the crossing with the minimal PolyCrossings::min crossing of all PolyCrossings's.
     unsigned int max_crossing_idx; //!< The index into LinePolygonsCrossings::crossings to the crossing with the maximal PolyCrossings::max crossing of all PolyCrossings's.
     
-    Polygons& boundary; //!< The boundary not to cross during combing.
-    LocToLineGrid& loc_to_line_grid; //!< Mapping from locations to line segments of \ref LinePolygonsCrossings::boundary
+    const Polygons& boundary; //!< The boundary not to cross during combing.
+    const FlatPolygons& flat_boundary; //!< The same boundary in a single buffer, for the scans over all its points
+    const LocToLineGrid& loc_to_line_grid; //!< Mapping from locations to line segments of \ref LinePolygonsCrossings::boundary
+    const std::vector<unsigned int>* grid_poly_idx; //!< For each polygon in \ref LinePolygonsCrossings::boundary the index of the same polygon in \ref LinePolygonsCrossings::loc_to_line_grid, or nullptr if they are the same
+    std::vector<unsigned int> candidate_poly_idx; //!< The indices of the polygons in \ref LinePolygonsCrossings::boundary which come near the line segment from start to end, in increasing order
     Point startPoint; //!< The start point of the scanline.
     Point endPoint; //!< The end point of the scanline.
     
@@ -91,12 +95,21 @@ private:
     PointMatrix transformation_matrix; //!< The transformation which rotates everything such that the scanline is aligned with the x-axis.
     Point transformed_startPoint; //!< The LinePolygonsCrossings::startPoint as transformed by Comb::transformation_matrix such that it has (roughly) the same Y as transformed_endPoint
     Point transformed_endPoint; //!< The LinePolygonsCrossings::endPoint as transformed by Comb::transformation_matrix such that it has (roughly) the same Y as transformed_startPoint
+    std::vector<Point> transformed_poly; //!< Buffer for the points of a polygon of the boundary as transformed by LinePolygonsCrossings::transformation_matrix, reused for each polygon
 
     
+    /*!
+     * Find the polygons which come near the line segment from LinePolygonsCrossings::startPoint to LinePolygonsCrossings::endPoint
+     * from the LinePolygonsCrossings::loc_to_line_grid, so that only those are transformed and scanned.
+     * 
+     * Sets LinePolygonsCrossings::candidate_poly_idx
+     */
+    void findCandidatePolygons();
+
     /*!
      * Check if we are crossing the boundaries, and pre-calculate some values.
      * 
-     * Sets Comb::transformation_matrix, Comb::transformed_startPoint and Comb::transformed_endPoint
+     * Sets Comb::transformation_matrix, Comb::transformed_startPoint, Comb::transformed_endPoint and LinePolygonsCrossings::candidate_poly_idx
      * \return Whether the line segment from LinePolygonsCrossings::startPoint to LinePolygonsCrossings::endPoint collides with the boundary
      */
     bool lineSegmentCollidesWithBoundary();
@@ -162,13 +175,18 @@ private:
     /*!
      * Create a LinePolygonsCrossings with minimal initialization.
      * \param boundary The boundary which not to cross during combing
+     * \param flat_boundary The same \p boundary as FlatPolygons
+     * \param loc_to_line_grid A sparse grid mapping cells to all line segments of (at least) \p boundary in those cells
+     * \param grid_poly_idx For each polygon in \p boundary the index of the same polygon in \p loc_to_line_grid, or nullptr if they are the same
      * \param start the starting point
      * \param end the end point
      * \param dist_to_move_boundary_point_outside Distance used to move a point from a boundary so that it doesn't intersect with it anymore. (Precision issue)
      */
-    LinePolygonsCrossings(Polygons& boundary, LocToLineGrid& loc_to_line_grid, Point& start, Point& end, int64_t dist_to_move_boundary_point_outside)
+    LinePolygonsCrossings(const Polygons& boundary, const FlatPolygons& flat_boundary, const LocToLineGrid& loc_to_line_grid, const std::vector<unsigned int>* grid_poly_idx, Point& start, Point& end, int64_t dist_to_move_boundary_point_outside)
     : boundary(boundary)
+    , flat_boundary(flat_boundary)
     , loc_to_line_grid(loc_to_line_grid)
+    , grid_poly_idx(grid_poly_idx)
     , startPoint(start)
     , endPoint(end)
     , dist_to_move_boundary_point_outside(dist_to_move_boundary_point_outside)
@@ -180,16 +198,18 @@ public:
     /*!
      * The main function of this class: calculate one combing path within the boundary.
      * \param boundary The polygons to follow when calculating the basic combing path
+     * \param flat_boundary The same \p boundary as FlatPolygons
      * \param loc_to_line_grid A sparse grid mapping cells to all line segments of (at least) \p boundary in those cells
+     * \param grid_poly_idx For each polygon in \p boundary the index of the same polygon in \p loc_to_line_grid, or nullptr if they are the same
      * \param startPoint From where to start the combing move.
      * \param endPoint Where to end the combing move.
      * \param combPath Output parameter: the combing path generated.
      * \param fail_on_unavoidable_obstacles When moving over other parts is inavoidable, stop calculation early and return false.
      * \return Whether combing succeeded, i.e. we didn't cross any gaps/other parts
      */
-    static bool comb(Polygons& boundary, LocToLineGrid& loc_to_line_grid, Point startPoint, Point endPoint, CombPath& combPath, int64_t dist_to_move_boundary_point_outside, int64_t max_comb_distance_ignored, bool fail_on_unavoidable_obstacles)
+    static bool comb(const Polygons& boundary, const FlatPolygons& flat_boundary, const LocToLineGrid& loc_to_line_grid, const std::vector<unsigned int>* grid_poly_idx, Point startPoint, Point endPoint, CombPath& combPath, int64_t dist_to_move_boundary_point_outside, int64_t max_comb_distance_ignored, bool fail_on_unavoidable_obstacles)
     {
-        LinePolygonsCrossings linePolygonsCrossings(boundary, loc_to_line_grid, startPoint, endPoint, dist_to_move_boundary_point_outside);
+        LinePolygonsCrossings linePolygonsCrossings(boundary, flat_boundary, loc_to_line_grid, grid_poly_idx, startPoint, endPoint, dist_to_move_boundary_point_outside);
         return linePolygonsCrossings.getCombingPath(combPath, max_comb_distance_ignored, fail_on_unavoidable_obstacles);
     };
 };
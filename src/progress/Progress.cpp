@@ -1,7 +1,10 @@
 /** Copyright (C) 2015 Ultimaker - Released under terms of the AGPLv3 License */
 #include "Progress.h"
 
+#include <algorithm> // min, max
+
 #include "../commandSocket.h"
+#include "../MemoryReport.h"
 #include "../utils/gettime.h"
 
 namespace cura {
@@ -31,6 +34,14 @@ std::string Progress::names [] =
 double Progress::accumulated_times [N_PROGRESS_STAGES] = {-1};
 double Progress::total_timing = -1;
 
+FILE* Progress::json_output = nullptr;
+std::mutex Progress::json_output_mutex;
+Progress::Clock::time_point Progress::start_time;
+Progress::Clock::time_point Progress::meshgroup_start_time;
+Progress::Clock::time_point Progress::stage_start_time;
+Progress::Clock::time_point Progress::last_json_output_time;
+Progress::Stage Progress::json_stage = Progress::Stage::START;
+
 /*
 const Progress::Stage Progress::stages[] = 
 { 
@@ -63,6 +74,49 @@ void Progress::init()
     total_timing = accumulated_time;
 }
 
+void Progress::enableJsonOutput(const std::string& output_file)
+{
+    json_output = (output_file == "-")? stdout : fopen(output_file.c_str(), "w");
+    if (!json_output)
+    {
+        logError("Failed to open %s for the progress.\n", output_file.c_str());
+        return;
+    }
+    start_time = Clock::now();
+    meshgroup_start_time = start_time;
+    stage_start_time = start_time;
+    last_json_output_time = start_time;
+}
+
+void Progress::writeJsonProgress(Progress::Stage stage, int progress_in_stage, int progress_in_stage_max, float percentage)
+{
+    constexpr double min_output_interval = 0.2; // seconds; the steps of the parallel stages come in much faster than schedulers need them
+    std::lock_guard<std::mutex> lock(json_output_mutex);
+    const Clock::time_point now = Clock::now();
+    if (stage != json_stage)
+    {
+        if (stage < json_stage)
+        { // the stages start over for each meshgroup
+            meshgroup_start_time = now;
+        }
+        json_stage = stage;
+        stage_start_time = now;
+    }
+    else if (progress_in_stage > 0 && progress_in_stage < progress_in_stage_max && std::chrono::duration<double>(now - last_json_output_time).count() < min_output_interval)
+    {
+        return;
+    }
+    last_json_output_time = now;
+    const double elapsed = std::chrono::duration<double>(now - start_time).count();
+    const double stage_elapsed = std::chrono::duration<double>(now - stage_start_time).count();
+    const double steps_per_second = (stage_elapsed > 0)? progress_in_stage / stage_elapsed : 0;
+    const double meshgroup_elapsed = std::chrono::duration<double>(now - meshgroup_start_time).count();
+    const double eta = (percentage > 0)? meshgroup_elapsed * (1.0 - percentage) / percentage : -1; // of the current meshgroup
+    fprintf(json_output, "{\"stage\": \"%s\", \"step\": %d, \"steps\": %d, \"steps_per_second\": %.3f, \"progress\": %.4f, \"elapsed\": %.3f, \"eta\": %.3f, \"rss\": %zu}\n"
+        , names[(int)stage].c_str(), progress_in_stage, progress_in_stage_max, steps_per_second, percentage, elapsed, eta, MemoryReport::getCurrentResidentSetSize());
+    fflush(json_output);
+}
+
 void Progress::messageProgress(Progress::Stage stage, int progress_in_stage, int progress_in_stage_max)
 {
     float percentage = calcOverallProgress(stage, float(progress_in_stage) / float(progress_in_stage_max));
@@ -70,16 +124,83 @@ void Progress::messageProgress(Progress::Stage stage, int progress_in_stage, int
     {
         CommandSocket::getInstance()->sendProgress(percentage);
     }
+    if (json_output)
+    {
+        writeJsonProgress(stage, progress_in_stage, progress_in_stage_max, percentage);
+    }
     
     logProgress(names[(int)stage].c_str(), progress_in_stage, progress_in_stage_max, percentage);
 }
 
+Progress::StepCounter::StepCounter(Stage stage, int step_count, std::function<double (int)> step_progress)
+: stage(stage)
+, step_count(std::max(1, step_count))
+, step_progress(step_progress)
+, done_step_count(0)
+, reported_step_count(-1)
+, stopping(false)
+{
+    reporter = std::thread([this]()
+        {
+            constexpr std::chrono::milliseconds report_interval(100);
+            std::unique_lock<std::mutex> lock(stop_mutex);
+            while (!stop_requested.wait_for(lock, report_interval, [this]() { return stopping; }))
+            {
+                lock.unlock();
+                report();
+                lock.lock();
+            }
+        });
+}
+
+Progress::StepCounter::~StepCounter()
+{
+    finish();
+}
+
+void Progress::StepCounter::finish()
+{
+    if (!reporter.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex);
+        stopping = true;
+    }
+    stop_requested.notify_one();
+    reporter.join();
+    report();
+}
+
+void Progress::StepCounter::report()
+{
+    const int done = std::min(step_count, done_step_count.load(std::memory_order_relaxed)); // steps before the first counted one may be counted as well
+    if (done == reported_step_count)
+    {
+        return;
+    }
+    reported_step_count = done;
+    if (step_progress)
+    {
+        messageProgress(stage, step_progress(done) * 100, 100);
+    }
+    else
+    {
+        messageProgress(stage, done, step_count);
+    }
+}
+
 void Progress::messageProgressStage(Progress::Stage stage, TimeKeeper* time_keeper)
 {
     if (CommandSocket::getInstance())
     {
         CommandSocket::getInstance()->sendProgressStage(stage);
     }
+    if (json_output)
+    {
+        writeJsonProgress(stage, 0, 1, calcOverallProgress(stage, 0));
+    }
     
     if (time_keeper)
     {
@@ -2,10 +2,18 @@
 #ifndef PROGRESS_H
 #define PROGRESS_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "../utils/logoutput.h"
 #include "../utils/gettime.h"
+#include "../utils/NoCopy.h"
 
 namespace cura {
 
@@ -48,8 +56,39 @@ private:
      * \return An estimate of the overall progress.
      */
     static float calcOverallProgress(Stage stage, float stage_progress);
+
+    using Clock = std::chrono::steady_clock;
+    static FILE* json_output; //!< The file to which the progress is written as JSON lines, if any; see Progress::enableJsonOutput
+    static std::mutex json_output_mutex; //!< Guards the json output and its timings below
+    static Clock::time_point start_time; //!< When the json output was enabled
+    static Clock::time_point meshgroup_start_time; //!< When the first stage of the current meshgroup started
+    static Clock::time_point stage_start_time; //!< When the last stage written as JSON started
+    static Clock::time_point last_json_output_time; //!< When the last progress line was written
+    static Stage json_stage; //!< The last stage written as JSON
+
+    /*!
+     * Write a line of JSON with the progress, the throughput and the estimated remaining time, if the json output is enabled.
+     *
+     * Lines are written at most a few times per second, except for the first and the last step of each stage.
+     *
+     * \param stage The current stage of processing
+     * \param progress_in_stage Any number giving the progress within the stage
+     * \param progress_in_stage_max The maximal value of \p progress_in_stage
+     * \param percentage The overall progress between 0 and 1
+     */
+    static void writeJsonProgress(Stage stage, int progress_in_stage, int progress_in_stage_max, float percentage);
 public:
     static void init(); //!< Initialize some values needed in a fast computation of the progress
+
+    /*!
+     * Write the progress to \p output_file as well, as a line of JSON for each update, for schedulers monitoring the engine.
+     *
+     * Each line contains the stage, the steps done in the stage (mostly layers), the steps per second in the stage,
+     * the overall progress, the elapsed and the estimated remaining seconds, and the resident set size in bytes.
+     *
+     * \param output_file The file to write to, which may be a named pipe, or "-" for stdout
+     */
+    static void enableJsonOutput(const std::string& output_file);
     /*!
      * Message progress over the CommandSocket and to the terminal (if the command line arg '-p' is provided).
      * 
@@ -65,6 +104,57 @@ public:
      * \param timeKeeper The stapwatch keeping track of the timings for each stage (optional)
      */
     static void messageProgressStage(Stage stage, TimeKeeper* timeKeeper);
+
+    /*!
+     * Counts the steps done by the threads of a parallel stage and messages the progress from a thread of its own,
+     * so that the threads doing the work never wait for the command socket or the terminal.
+     *
+     * The count is sampled a few times per second, and once more when the counter goes out of scope.
+     */
+    class StepCounter : NoCopy
+    {
+    public:
+        /*!
+         * \param stage The stage of which the steps are counted
+         * \param step_count The number of steps in the stage
+         * \param step_progress Optionally a function giving the progress in the stage between 0 and 1 after a number of steps, for stages of which the steps take different times
+         */
+        StepCounter(Stage stage, int step_count, std::function<double (int)> step_progress = nullptr);
+
+        /*!
+         * Message the final count, unless that has been done with \ref StepCounter::finish already.
+         */
+        ~StepCounter();
+
+        /*!
+         * Stop the reporting thread and message the final count, when all steps are done before the counter goes out of scope.
+         */
+        void finish();
+
+        /*!
+         * Count a step as done. This only increments a counter, so it can be called from any thread.
+         */
+        void step()
+        {
+            done_step_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    private:
+        const Stage stage; //!< The stage of which the steps are counted
+        const int step_count; //!< The number of steps in the stage
+        const std::function<double (int)> step_progress; //!< The progress in the stage after a number of steps, or nullptr if all steps take equally long
+        std::atomic<int> done_step_count; //!< The number of steps done so far
+        int reported_step_count; //!< The number of steps when the progress was messaged last, only used by the reporting thread
+        std::mutex stop_mutex; //!< Guards \ref StepCounter::stopping
+        std::condition_variable stop_requested; //!< Notified when the reporting thread is to stop
+        bool stopping; //!< Whether the reporting thread is to stop
+        std::thread reporter; //!< The thread messaging the progress
+
+        /*!
+         * Message the progress if steps have been done since the last time.
+         */
+        void report();
+    };
 };
 
 
@@ -10,7 +10,7 @@ namespace cura {
 void Raft::generate(SliceDataStorage& storage, int distance)
 {
     assert(storage.raftOutline.size() == 0 && "Raft polygon isn't generated yet, so should be empty!");
-    storage.raftOutline = storage.getLayerOutlines(0, true).offset(distance, ClipperLib::jtRound);
+    storage.raftOutline = storage.getLayerOutlinesCached(0, true).offset(distance, ClipperLib::jtRound); // the outlines of the first layer have already been computed for the shields, if any
     const int shield_line_width = storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex("adhesion_extruder_nr"))->getSettingInMicrons("skirt_brim_line_width");
     if (storage.draft_protection_shield.size() > 0)
     {
@@ -65,6 +65,19 @@ PathConfigStorage::MeshPathConfigs::MeshPathConfigs(const SliceMeshStorage& mesh
     }
 }
 
+PathConfigStorage::MeshPathConfigs::MeshPathConfigs(const MeshPathConfigs& base, int layer_thickness)
+: inset0_config(base.inset0_config, layer_thickness)
+, insetX_config(base.insetX_config, layer_thickness)
+, skin_config(base.skin_config, layer_thickness)
+, perimeter_gap_config(base.perimeter_gap_config, layer_thickness)
+{
+    infill_config.reserve(base.infill_config.size());
+    for (const GCodePathConfig& base_infill_config : base.infill_config)
+    {
+        infill_config.emplace_back(base_infill_config, layer_thickness);
+    }
+}
+
 PathConfigStorage::PathConfigStorage(const SliceDataStorage& storage, int layer_nr, int layer_thickness)
 : adhesion_extruder_train(storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex("adhesion_extruder_nr")))
 , support_infill_train(storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex("support_infill_extruder_nr")))
@@ -156,6 +169,43 @@ PathConfigStorage::PathConfigStorage(const SliceDataStorage& storage, int layer_
     }
 }
 
+PathConfigStorage::PathConfigStorage(const PathConfigStorage& base, const SliceDataStorage& storage, int layer_nr, int layer_thickness)
+: adhesion_extruder_train(base.adhesion_extruder_train)
+, support_infill_train(base.support_infill_train)
+, support_roof_train(base.support_roof_train)
+, support_bottom_train(base.support_bottom_train)
+, raft_base_config(base.raft_base_config) // the raft has its own layer thicknesses
+, raft_interface_config(base.raft_interface_config)
+, raft_surface_config(base.raft_surface_config)
+, travel_config_per_extruder(base.travel_config_per_extruder)
+, support_infill_config(base.support_infill_config, layer_thickness)
+, support_roof_config(base.support_roof_config, layer_thickness)
+, support_bottom_config(base.support_bottom_config, layer_thickness)
+{
+    skirt_brim_config_per_extruder.reserve(base.skirt_brim_config_per_extruder.size());
+    for (const GCodePathConfig& skirt_brim_config : base.skirt_brim_config_per_extruder)
+    {
+        skirt_brim_config_per_extruder.emplace_back(skirt_brim_config, layer_thickness);
+    }
+    prime_tower_config_per_extruder.reserve(base.prime_tower_config_per_extruder.size());
+    for (const GCodePathConfig& prime_tower_config : base.prime_tower_config_per_extruder)
+    {
+        prime_tower_config_per_extruder.emplace_back(prime_tower_config, layer_thickness);
+    }
+
+    mesh_configs.reserve(base.mesh_configs.size());
+    for (const MeshPathConfigs& mesh_config : base.mesh_configs)
+    {
+        mesh_configs.emplace_back(mesh_config, layer_thickness);
+    }
+
+    const int initial_speedup_layer_count = storage.getSettingAsCount("speed_slowdown_layers");
+    if (layer_nr < initial_speedup_layer_count)
+    {
+        handleInitialLayerSpeedup(storage, layer_nr, initial_speedup_layer_count);
+    }
+}
+
 void cura::PathConfigStorage::handleInitialLayerSpeedup(const SliceDataStorage& storage, int layer_nr, int initial_speedup_layer_count)
 {
     std::vector<GCodePathConfig::SpeedDerivatives> global_first_layer_config_per_extruder;
@@ -35,6 +35,11 @@ public:
         std::vector<GCodePathConfig> infill_config;
 
         MeshPathConfigs(const SliceMeshStorage& mesh, int layer_thickness);
+
+        /*!
+         * Copy the configs of a mesh, but for another layer thickness.
+         */
+        MeshPathConfigs(const MeshPathConfigs& base, int layer_thickness);
     };
     
     GCodePathConfig raft_base_config;
@@ -56,6 +61,15 @@ public:
      */
     PathConfigStorage(const SliceDataStorage& storage, int layer_nr, int layer_thickness);
 
+    /*!
+     * Get the configs of a layer from the configs computed from the settings once for all layers,
+     * rather than looking up all the settings again for each layer.
+     * 
+     * \param base The configs of a layer which isn't slowed down as an initial layer
+     * \warning Note that the layer_nr might be below zero for raft (filler) layers
+     */
+    PathConfigStorage(const PathConfigStorage& base, const SliceDataStorage& storage, int layer_nr, int layer_thickness);
+
 private:
     void handleInitialLayerSpeedup(const SliceDataStorage& storage, int layer_nr, int initial_speedup_layer_count);
 };
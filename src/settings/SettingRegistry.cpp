@@ -1,12 +1,13 @@
 /** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
 #include "SettingRegistry.h"
 
-#include <sstream>
+#include <cstdio> // snprintf
 #include <iostream> // debug IO
 #include <libgen.h> // dirname
 #include <string>
 #include <cstring> // strtok (split string using delimiters) strcpy
 #include <fstream> // ifstream (to see if file exists)
+#include <sys/stat.h> // stat (modification time)
 
 #include "rapidjson/rapidjson.h"
 #include "rapidjson/document.h"
@@ -16,8 +17,6 @@
 
 namespace cura
 {
-    
-SettingRegistry SettingRegistry::instance; // define settingRegistry
 
 std::string SettingRegistry::toString(rapidjson::Type type)
 {
@@ -43,19 +42,64 @@ SettingConfig::SettingConfig(std::string key, std::string label)
 
 bool SettingRegistry::settingExists(std::string key) const
 {
-    return setting_key_to_config.find(key) != setting_key_to_config.end();
+    return definitions.find(key) != definitions.end();
 }
 
 SettingConfig* SettingRegistry::getSettingConfig(std::string key) const
 {
-    auto it = setting_key_to_config.find(key);
-    if (it == setting_key_to_config.end())
+    auto it = definitions.find(key);
+    if (it == definitions.end() || !it->second.json)
+        return nullptr;
+    SettingDefinition& definition = it->second;
+    if (!definition.config)
+    {
+        definition.config.reset(new SettingConfig(key, (*definition.json)["label"].GetString()));
+        definition.config->setType(definition.type);
+        definition.config->setDefault(definition.default_value);
+        definition.config->setUnit(definition.unit);
+    }
+    return definition.config.get();
+}
+
+InternedSettingKey* SettingRegistry::getInternedKey(const std::string& key) const
+{
+    auto it = definitions.find(key);
+    if (it == definitions.end())
+    {
         return nullptr;
-    return it->second;
+    }
+    return &it->second.interned;
+}
+
+unsigned int SettingRegistry::getInternedKeyCount() const
+{
+    return definitions.size();
+}
+
+SettingRegistry::SettingDefinition& SettingRegistry::getOrAddDefinition(const std::string& name)
+{
+    const size_t definition_count = definitions.size();
+    SettingDefinition& definition = definitions[name];
+    if (definitions.size() > definition_count)
+    { // definitions are never removed, so the ids number the keys from zero
+        definition.interned.id = definition_count;
+    }
+    return definition;
+}
+
+void SettingRegistry::debugOutputAllSettings() const
+{
+    std::cerr << "\nSETTINGS BASE: settings" << std::endl;
+    for (const std::pair<const std::string, SettingDefinition>& definition : definitions)
+    {
+        if (definition.second.json)
+        {
+            std::cerr << definition.first << "(" << definition.second.default_value << ")" << std::endl;
+        }
+    }
 }
 
 SettingRegistry::SettingRegistry()
-: setting_definitions("settings", "Settings")
 {
     // load search paths from environment variable CURA_ENGINE_SEARCH_PATH
     char* paths = getenv("CURA_ENGINE_SEARCH_PATH");
@@ -96,6 +140,46 @@ int SettingRegistry::loadJSON(std::string filename, rapidjson::Document& json_do
     return 0;
 }
 
+int SettingRegistry::loadCachedJSON(const std::string& filename, std::shared_ptr<const ParsedJSON>& parsed)
+{
+    struct stat file_stat;
+    if (stat(filename.c_str(), &file_stat) != 0)
+    {
+        cura::logError("Couldn't open JSON file.\n");
+        return 1;
+    }
+    auto cached = json_cache.find(filename);
+    if (cached != json_cache.end() && cached->second.modification_time == file_stat.st_mtime)
+    {
+        parsed = cached->second.parsed;
+        return 0;
+    }
+    json_cache.erase(filename);
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f)
+    {
+        cura::logError("Couldn't open JSON file.\n");
+        return 1;
+    }
+    // read the whole file, so that the document can be parsed in situ, without copying its strings
+    std::shared_ptr<ParsedJSON> parsed_json = std::make_shared<ParsedJSON>();
+    parsed_json->text.reset(new char[file_stat.st_size + 1]);
+    const size_t size = fread(parsed_json->text.get(), 1, file_stat.st_size, f);
+    fclose(f);
+    parsed_json->text[size] = '\0';
+    parsed_json->document.ParseInsitu(parsed_json->text.get());
+    if (parsed_json->document.HasParseError())
+    {
+        cura::logError("Error parsing JSON(offset %u): %s\n", (unsigned)parsed_json->document.GetErrorOffset(), GetParseError_En(parsed_json->document.GetParseError()));
+        return 2;
+    }
+    parsed = parsed_json;
+    CachedJSON& cache_entry = json_cache[filename];
+    cache_entry.modification_time = file_stat.st_mtime;
+    cache_entry.parsed = parsed;
+    return 0;
+}
+
 /*!
  * Check whether a file exists.
  * from https://techoverflow.net/blog/2013/01/11/cpp-check-if-file-exists/
@@ -148,12 +232,12 @@ int SettingRegistry::loadExtruderJSONsettings(unsigned int extruder_nr, Settings
 
 int SettingRegistry::loadJSONsettings(std::string filename, SettingsBase* settings_base, bool warn_base_file_duplicates)
 {
-    rapidjson::Document json_document;
-    
     log("Loading %s...\n", filename.c_str());
 
-    int err = loadJSON(filename, json_document);
+    std::shared_ptr<const ParsedJSON> parsed;
+    int err = loadCachedJSON(filename, parsed);
     if (err) { return err; }
+    const rapidjson::Document& json_document = parsed->document;
 
     { // add parent folder to search paths
         char filename_cstr[filename.size()];
@@ -176,11 +260,11 @@ int SettingRegistry::loadJSONsettings(std::string filename, SettingsBase* settin
         {
             return err;
         }
-        err = loadJSONsettingsFromDoc(json_document, settings_base, false);
+        err = loadJSONsettingsFromDoc(parsed, settings_base, false);
     }
     else 
     {
-        err = loadJSONsettingsFromDoc(json_document, settings_base, warn_base_file_duplicates);
+        err = loadJSONsettingsFromDoc(parsed, settings_base, warn_base_file_duplicates);
     }
 
     if (json_document.HasMember("metadata") && json_document["metadata"].IsObject())
@@ -214,40 +298,42 @@ int SettingRegistry::loadJSONsettings(std::string filename, SettingsBase* settin
     return err;
 }
 
-int SettingRegistry::loadJSONsettingsFromDoc(rapidjson::Document& json_document, SettingsBase* settings_base, bool warn_duplicates)
+int SettingRegistry::loadJSONsettingsFromDoc(const std::shared_ptr<const ParsedJSON>& parsed, SettingsBase* settings_base, bool warn_duplicates)
 {
-    
+    const rapidjson::Document& json_document = parsed->document;
     if (!json_document.IsObject())
     {
         cura::logError("JSON file is not an object.\n");
         return 3;
     }
 
-    if (json_document.HasMember("settings"))
+    rapidjson::Value::ConstMemberIterator settings_it = json_document.FindMember("settings");
+    if (settings_it != json_document.MemberEnd())
     {
-        handleChildren(json_document["settings"], settings_base, warn_duplicates);
+        handleChildren(settings_it->value, parsed, settings_base, warn_duplicates);
     }
     
-    if (json_document.HasMember("overrides"))
+    rapidjson::Value::ConstMemberIterator overrides_it = json_document.FindMember("overrides");
+    if (overrides_it != json_document.MemberEnd())
     {
-        const rapidjson::Value& json_object_container = json_document["overrides"];
+        const rapidjson::Value& json_object_container = overrides_it->value;
         for (rapidjson::Value::ConstMemberIterator override_iterator = json_object_container.MemberBegin(); override_iterator != json_object_container.MemberEnd(); ++override_iterator)
         {
             std::string setting = override_iterator->name.GetString();
-            SettingConfig* conf = getSettingConfig(setting);
-            if (!conf) //Setting could not be found.
+            auto definition_it = definitions.find(setting);
+            if (definition_it == definitions.end() || !definition_it->second.json) //Setting could not be found.
             {
                 logWarning("Trying to override unknown setting %s.\n", setting.c_str());
                 continue;
             }
-            _loadSettingValues(conf, override_iterator, settings_base);
+            _loadSettingValues(setting, override_iterator->value, definition_it->second, settings_base);
         }
     }
     
     return 0;
 }
 
-void SettingRegistry::handleChildren(const rapidjson::Value& settings_list, SettingsBase* settings_base, bool warn_duplicates)
+void SettingRegistry::handleChildren(const rapidjson::Value& settings_list, const std::shared_ptr<const ParsedJSON>& document, SettingsBase* settings_base, bool warn_duplicates)
 {
     if (!settings_list.IsObject())
     {
@@ -256,10 +342,15 @@ void SettingRegistry::handleChildren(const rapidjson::Value& settings_list, Sett
     }
     for (rapidjson::Value::ConstMemberIterator setting_iterator = settings_list.MemberBegin(); setting_iterator != settings_list.MemberEnd(); ++setting_iterator)
     {
-        handleSetting(setting_iterator, settings_base, warn_duplicates);
-        if (setting_iterator->value.HasMember("children"))
+        handleSetting(setting_iterator, document, settings_base, warn_duplicates);
+        if (!setting_iterator->value.IsObject())
         {
-            handleChildren(setting_iterator->value["children"], settings_base, warn_duplicates);
+            continue;
+        }
+        rapidjson::Value::ConstMemberIterator children_it = setting_iterator->value.FindMember("children");
+        if (children_it != setting_iterator->value.MemberEnd())
+        {
+            handleChildren(children_it->value, document, settings_base, warn_duplicates);
         }
     }
 }
@@ -277,7 +368,7 @@ bool SettingRegistry::settingIsUsedByEngine(const rapidjson::Value& setting)
 }
 
 
-void SettingRegistry::handleSetting(const rapidjson::Value::ConstMemberIterator& json_setting_it, SettingsBase* settings_base, bool warn_duplicates)
+void SettingRegistry::handleSetting(const rapidjson::Value::ConstMemberIterator& json_setting_it, const std::shared_ptr<const ParsedJSON>& document, SettingsBase* settings_base, bool warn_duplicates)
 {
     const rapidjson::Value& json_setting = json_setting_it->value;
     if (!json_setting.IsObject())
@@ -286,100 +377,103 @@ void SettingRegistry::handleSetting(const rapidjson::Value::ConstMemberIterator&
         return;
     }
     std::string name = json_setting_it->name.GetString();
-    if (json_setting.HasMember("type") && json_setting["type"].IsString() && json_setting["type"].GetString() == std::string("category"))
+    rapidjson::Value::ConstMemberIterator type_it = json_setting.FindMember("type");
+    if (type_it != json_setting.MemberEnd() && type_it->value.IsString() && type_it->value.GetString() == std::string("category"))
     { // skip category objects
-        setting_key_to_config[name] = nullptr; // add the category name to the mapping, but don't instantiate a setting config for it.
+        getOrAddDefinition(name).json = nullptr; // add the category name to the mapping, but don't record a definition for it.
         return;
     }
     if (settingIsUsedByEngine(json_setting))
     {
-        if (!json_setting.HasMember("label") || !json_setting["label"].IsString())
+        rapidjson::Value::ConstMemberIterator label_it = json_setting.FindMember("label");
+        if (label_it == json_setting.MemberEnd() || !label_it->value.IsString())
         {
             logError("json setting \"%s\" has no label!\n", name.c_str());
             return;
         }
-        std::string label = json_setting["label"].GetString();
         
-        SettingConfig* setting = getSettingConfig(name);
-        if (warn_duplicates && setting)
+        SettingDefinition& definition = getOrAddDefinition(name);
+        if (warn_duplicates && definition.json)
         {
-            cura::logWarning("Duplicate definition of setting: %s a.k.a. \"%s\" was already claimed by \"%s\"\n", name.c_str(), label.c_str(), getSettingConfig(name)->getLabel().c_str());
+            cura::logWarning("Duplicate definition of setting: %s a.k.a. \"%s\" was already claimed by \"%s\"\n", name.c_str(), label_it->value.GetString(), (*definition.json)["label"].GetString());
         }
-        if (!setting)
-        {
-            setting = &addSetting(name, label);
+        if (!definition.json)
+        { // the label of the first definition is kept, like its config
+            definition.json = &json_setting;
+            definition.document = document;
         }
-        _loadSettingValues(setting, json_setting_it, settings_base);
+        _loadSettingValues(name, json_setting, definition, settings_base);
     }
     else
     {
-        setting_key_to_config[name] = nullptr; // add the setting name to the mapping, but don't instantiate a setting config for it.
+        getOrAddDefinition(name).json = nullptr; // add the setting name to the mapping, but don't record a definition for it.
     }
 }
 
-SettingConfig& SettingRegistry::addSetting(std::string name, std::string label)
+void SettingRegistry::loadDefault(const std::string& key, const rapidjson::Value& dflt, SettingDefinition& definition)
 {
-    SettingConfig* config = setting_definitions.addChild(name, label);
-
-    setting_key_to_config[name] = config;
-
-    return *config;
-}
-
-void SettingRegistry::loadDefault(const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it, SettingConfig* config)
-{
-    const rapidjson::Value& setting_content = json_object_it->value;
-    if (setting_content.HasMember("default_value"))
+    if (dflt.IsString())
     {
-        const rapidjson::Value& dflt = setting_content["default_value"];
-        if (dflt.IsString())
-        {
-            config->setDefault(dflt.GetString());
-        }
-        else if (dflt.IsTrue())
-        {
-            config->setDefault("true");
-        }
-        else if (dflt.IsFalse())
-        {
-            config->setDefault("false");
-        }
-        else if (dflt.IsNumber())
-        {
-            std::ostringstream ss;
-            ss << dflt.GetDouble();
-            config->setDefault(ss.str());
-        } // arrays are ignored because machine_extruder_trains needs to be handled separately
-        else 
-        {
-            logWarning("WARNING: Unrecognized data type in JSON: %s has type %s\n", json_object_it->name.GetString(), toString(dflt.GetType()).c_str());
-        }
+        definition.default_value.assign(dflt.GetString(), dflt.GetStringLength());
+    }
+    else if (dflt.IsTrue())
+    {
+        definition.default_value = "true";
+    }
+    else if (dflt.IsFalse())
+    {
+        definition.default_value = "false";
+    }
+    else if (dflt.IsNumber())
+    {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%g", dflt.GetDouble()); // the same as writing it to a default std::ostream
+        definition.default_value = number;
+    } // arrays are ignored because machine_extruder_trains needs to be handled separately
+    else 
+    {
+        logWarning("WARNING: Unrecognized data type in JSON: %s has type %s\n", key.c_str(), toString(dflt.GetType()).c_str());
     }
 }
 
 
-void SettingRegistry::_loadSettingValues(SettingConfig* config, const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it, SettingsBase* settings_base)
+void SettingRegistry::_loadSettingValues(const std::string& key, const rapidjson::Value& data, SettingDefinition& definition, SettingsBase* settings_base)
 {
-    const rapidjson::Value& data = json_object_it->value;
-    /// Fill the setting config object with data we have in the json file.
-    if (data.HasMember("type") && data["type"].IsString())
+    /// Fill the setting definition with data we have in the json file.
+    rapidjson::Value::ConstMemberIterator type_it = data.FindMember("type");
+    if (type_it != data.MemberEnd() && type_it->value.IsString())
     {
-        config->setType(data["type"].GetString());
+        definition.type.assign(type_it->value.GetString(), type_it->value.GetStringLength());
     }
-    if (config->getType() == std::string("polygon") || config->getType() == std::string("polygons"))
+    if (definition.type == "polygon" || definition.type == "polygons")
     { // skip polygon settings : not implemented yet and not used yet (TODO)
-//         logWarning("WARNING: Loading polygon setting %s not implemented...\n", json_object_it->name.GetString());
+        if (definition.config)
+        {
+            definition.config->setType(definition.type);
+        }
         return;
     }
 
-    loadDefault(json_object_it, config);
+    rapidjson::Value::ConstMemberIterator default_it = data.FindMember("default_value");
+    if (default_it != data.MemberEnd())
+    {
+        loadDefault(key, default_it->value, definition);
+    }
 
-    if (data.HasMember("unit") && data["unit"].IsString())
+    rapidjson::Value::ConstMemberIterator unit_it = data.FindMember("unit");
+    if (unit_it != data.MemberEnd() && unit_it->value.IsString())
     {
-        config->setUnit(data["unit"].GetString());
+        definition.unit.assign(unit_it->value.GetString(), unit_it->value.GetStringLength());
+    }
+
+    if (definition.config)
+    { // keep a config which was already asked for up to date
+        definition.config->setType(definition.type);
+        definition.config->setDefault(definition.default_value);
+        definition.config->setUnit(definition.unit);
     }
 
-    settings_base->_setSetting(config->getKey(), config->getDefaultValue());
+    settings_base->_setSetting(key, definition.default_value);
 }
 
 }//namespace cura
@@ -8,6 +8,8 @@
 #include <unordered_map>
 #include <string>
 #include <iostream> // debug out
+#include <memory> // unique_ptr
+#include <ctime> // time_t
 
 #include "SettingConfig.h"
 #include "SettingContainer.h"
@@ -28,17 +30,51 @@ namespace cura
 class SettingRegistry : NoCopy
 {
 private:
-    static SettingRegistry instance;
-
     SettingRegistry();
-    
-    std::unordered_map<std::string, SettingConfig*> setting_key_to_config; //!< Mapping from setting keys to their configurations
 
-    SettingContainer setting_definitions; //!< All setting configurations (A flat list)
-    
+    /*!
+     * A json file as parsed in situ, so that the strings of the document point into the text of the file.
+     */
+    struct ParsedJSON
+    {
+        std::unique_ptr<char[]> text; //!< The contents of the file, which the document refers to
+        rapidjson::Document document;
+    };
+
+    /*!
+     * The definition of a setting, as far as it's needed to slice.
+     * The SettingConfig with the label of the setting is only built when asked for, from the json object of its definition.
+     */
+    struct SettingDefinition
+    {
+        std::string type; //!< The type of the setting, e.g. float, int, bool
+        std::string default_value; //!< The default value of the last definition or override of the setting
+        std::string unit; //!< The unit of the setting, e.g. "mm"
+        const rapidjson::Value* json = nullptr; //!< The json object defining the setting, or nullptr for categories and the settings not used by the engine, which have no config
+        std::shared_ptr<const ParsedJSON> document; //!< The document of SettingDefinition::json, which is kept as long as it's referred to
+        std::unique_ptr<SettingConfig> config; //!< The config of the setting, once it's asked for
+        InternedSettingKey interned; //!< The id of the setting, given when its definition is first loaded
+    };
+
+    /*!
+     * All setting keys and categories in the loaded definition files, with the defaults of the settings.
+     * Mutable so that the configs can be built on demand by SettingRegistry::getSettingConfig.
+     */
+    mutable std::unordered_map<std::string, SettingDefinition> definitions;
+
     std::vector<std::string> extruder_train_ids; //!< The internal id's of each extruder (the filename without the extension)
 
     std::unordered_set<std::string> search_paths; //!< The paths to search for json files.
+
+    /*!
+     * A json document as parsed from a file, along with the modification time of the file when it was parsed.
+     */
+    struct CachedJSON
+    {
+        time_t modification_time;
+        std::shared_ptr<const ParsedJSON> parsed;
+    };
+    std::unordered_map<std::string, CachedJSON> json_cache; //!< The parsed json files, by filename, so that every extruder train and mesh group doesn't parse them again
 public:
     /*!
      * Get the SettingRegistry.
@@ -47,7 +83,11 @@ public:
      * 
      * \return The SettingRegistry
      */
-    static SettingRegistry* getInstance() { return &instance; }
+    static SettingRegistry* getInstance()
+    {
+        static SettingRegistry instance; // constructed on first use
+        return &instance;
+    }
     
     /*!
      * Check whether a setting exists, according to the settings json files.
@@ -60,10 +100,25 @@ public:
     /*!
      * Get the config of a setting with a given key.
      * 
+     * The config is built from the definition of the setting the first time it's asked for.
+     * 
      * \param key the (internal) key for a setting
-     * \return the setting definition values
+     * \return the setting definition values, or nullptr for categories, unknown settings and settings not used by the engine
      */
     SettingConfig* getSettingConfig(std::string key) const;
+
+    /*!
+     * Get the interned key of a setting, of which the id is given when its definition is first loaded.
+     *
+     * \param key The internal key for the setting
+     * \return The interned key, or nullptr for settings which aren't in the loaded definition files
+     */
+    InternedSettingKey* getInternedKey(const std::string& key) const;
+
+    /*!
+     * The number of interned keys, which is one more than the highest id.
+     */
+    unsigned int getInternedKeyCount() const;
 protected:
     /*!
      * Whether this json settings object is a definition of a CuraEngine setting,
@@ -88,10 +143,11 @@ protected:
     /*!
      * Get the default value of a json setting object in the format used internally (c style).
      * 
-     * \param[in] json_object_it An iterator for a given setting json object
-     * \param[out] config Where the default value is stored
+     * \param[in] key The key of the setting
+     * \param[in] default_value The default_value of the json setting object
+     * \param[out] definition Where the default value is stored
      */
-    static void loadDefault(const rapidjson::GenericValue< rapidjson::UTF8< char > >::ConstMemberIterator& json_object_it, SettingConfig* config);
+    static void loadDefault(const std::string& key, const rapidjson::Value& default_value, SettingDefinition& definition);
 public:
     /*!
      * Load settings from a json file and all the parents it inherits from.
@@ -105,10 +161,7 @@ public:
      */
     int loadJSONsettings(std::string filename, SettingsBase* settings_base, bool warn_base_file_duplicates = true);
     
-    void debugOutputAllSettings() const
-    {
-        setting_definitions.debugOutputAllSettings();
-    }
+    void debugOutputAllSettings() const;
 
     /*!
      * Load settings from the extruder definition json file and all the parents it inherits from.
@@ -139,51 +192,63 @@ public:
     static int loadJSON(std::string filename, rapidjson::Document& json_document);
 private:
     /*!
-     * Load settings from a single json file.
+     * Get the json document of a file, parsing it only if it wasn't parsed before or if the file was modified since.
      * 
      * \param filename The filename of the json file to parse
-     * \param settings_base The settings base where to store the default values.
-     * \param warn_duplicates whether to warn for duplicate definitions
+     * \param[out] parsed The document loaded, which stays valid until the file is parsed again and no setting definition refers to it anymore
      * \return an error code or zero of succeeded
      */
-    int loadJSONsettingsFromDoc(rapidjson::Document& json_document, SettingsBase* settings_base, bool warn_duplicates);
+    int loadCachedJSON(const std::string& filename, std::shared_ptr<const ParsedJSON>& parsed);
 
     /*!
-     * Create a new SettingConfig and add it to the registry.
+     * Load settings from a single json file.
      * 
-     * \param name The internal key of the setting
-     * \param label The human readable name for the frontend
-     * \return The config created
+     * \param parsed The parsed json file
+     * \param settings_base The settings base where to store the default values.
+     * \param warn_duplicates whether to warn for duplicate definitions
+     * \return an error code or zero of succeeded
      */
-    SettingConfig& addSetting(std::string name, std::string label);
+    int loadJSONsettingsFromDoc(const std::shared_ptr<const ParsedJSON>& parsed, SettingsBase* settings_base, bool warn_duplicates);
 
     /*!
-     * Load inessential data about the setting, like its type and unit.
+     * Load the type, default value and unit of a setting, and store its default value in \p settings_base.
      * 
-     * \param[out] config Where to store the data
-     * \param[in] json_object_it Iterator to a setting json object
+     * \param key The key of the setting
+     * \param[in] data A setting json object or an override of one
+     * \param[out] definition Where to store the data
      * \param[out] settings_base The settings base where to store the default values.
      */
-    void _loadSettingValues(SettingConfig* config, const rapidjson::Value::ConstMemberIterator& json_object_it, SettingsBase* settings_base);
+    void _loadSettingValues(const std::string& key, const rapidjson::Value& data, SettingDefinition& definition, SettingsBase* settings_base);
 
     /*!
      * Handle a json object which contains a list of settings.
      * 
      * \param settings_list The object containing one or more setting definitions
-     * \param path The path of (internal) setting names traversed to get to this object
+     * \param document The document containing \p settings_list
      * \param settings_base The settings base where to store the default values.
      * \param warn_duplicates whether to warn for duplicate setting definitions
      */
-    void handleChildren(const rapidjson::Value& settings_list, SettingsBase* settings_base, bool warn_duplicates);
+    void handleChildren(const rapidjson::Value& settings_list, const std::shared_ptr<const ParsedJSON>& document, SettingsBase* settings_base, bool warn_duplicates);
     
     /*!
      * Handle a json object for a setting.
      * 
+     * Only the key, type and default value are recorded; the label is read when the config of the setting is asked for.
+     * 
      * \param json_setting_it Iterator for the setting which contains the key (setting name) and attributes info
+     * \param document The document containing the setting
      * \param settings_base The settings base where to store the default values.
      * \param warn_duplicates whether to warn for duplicate setting definitions
      */
-    void handleSetting(const rapidjson::Value::ConstMemberIterator& json_setting_it, SettingsBase* settings_base, bool warn_duplicates);
+    void handleSetting(const rapidjson::Value::ConstMemberIterator& json_setting_it, const std::shared_ptr<const ParsedJSON>& document, SettingsBase* settings_base, bool warn_duplicates);
+
+    /*!
+     * Get the definition of a setting or category, adding it if there is none yet, which interns its key.
+     *
+     * \param name The key of the setting or category
+     * \return The definition
+     */
+    SettingDefinition& getOrAddDefinition(const std::string& name);
 };
 
 }//namespace cura
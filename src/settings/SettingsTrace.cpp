@@ -0,0 +1,89 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "SettingsTrace.h"
+
+#include <cstdio>
+
+#include "../utils/logoutput.h"
+
+namespace cura
+{
+
+bool SettingsTrace::enabled = false;
+std::string SettingsTrace::output_file;
+std::atomic<const char*> SettingsTrace::stage(nullptr);
+thread_local const char* SettingsTrace::thread_stage = nullptr;
+std::mutex SettingsTrace::keys_mutex;
+std::vector<std::string> SettingsTrace::stages;
+std::map<std::string, std::set<std::string>> SettingsTrace::keys_per_stage;
+
+void SettingsTrace::enable(const std::string& output_file)
+{
+    SettingsTrace::output_file = output_file;
+    enabled = true;
+}
+
+void SettingsTrace::recordRead(const std::string& key)
+{
+    const char* active_stage = thread_stage ? thread_stage : stage.load();
+    if (!active_stage)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(keys_mutex);
+    std::map<std::string, std::set<std::string>>::iterator stage_keys = keys_per_stage.find(active_stage);
+    if (stage_keys == keys_per_stage.end())
+    {
+        stages.emplace_back(active_stage);
+        stage_keys = keys_per_stage.emplace(active_stage, std::set<std::string>()).first;
+    }
+    stage_keys->second.insert(key);
+}
+
+std::vector<const char*> SettingsTrace::getStagesReading(const std::string& key)
+{
+    std::vector<const char*> ret;
+    std::lock_guard<std::mutex> lock(keys_mutex);
+    for (const std::string& stage_name : stages)
+    {
+        const std::set<std::string>& keys = keys_per_stage[stage_name];
+        if (keys.find(key) != keys.end())
+        {
+            ret.push_back(stage_name.c_str());
+        }
+    }
+    return ret;
+}
+
+bool SettingsTrace::writeReport()
+{
+    if (!enabled)
+    {
+        return false;
+    }
+    FILE* out = fopen(output_file.c_str(), "w");
+    if (!out)
+    {
+        logError("Failed to open %s for the settings trace.\n", output_file.c_str());
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(keys_mutex);
+    fprintf(out, "{");
+    for (unsigned int stage_idx = 0; stage_idx < stages.size(); stage_idx++)
+    {
+        fprintf(out, "%s\n    \"%s\": [", (stage_idx > 0)? "," : "", stages[stage_idx].c_str());
+        bool first = true;
+        for (const std::string& key : keys_per_stage[stages[stage_idx]])
+        {
+            fprintf(out, "%s\"%s\"", first? "" : ", ", key.c_str());
+            first = false;
+        }
+        fprintf(out, "]");
+    }
+    fprintf(out, "\n}\n");
+    fclose(out);
+    return true;
+}
+
+}//namespace cura
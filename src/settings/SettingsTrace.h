@@ -0,0 +1,143 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef SETTINGS_SETTINGS_TRACE_H
+#define SETTINGS_SETTINGS_TRACE_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../utils/NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Records which settings are read by each stage of the engine, to find out which results of a stage
+ * become invalid when a setting changes.
+ *
+ * A stage is active while a SettingsTrace::Stage is in scope. It applies to the settings read by all threads,
+ * so that the worker threads of the parallel loops in a stage are included.
+ * Stages which are processed interleaved on the same threads, like the walls and the skin of a mesh,
+ * are told apart with a SettingsTrace::ThreadStage, which only applies to the thread it's constructed on.
+ * Settings read outside of any stage, for instance while loading the meshes, aren't recorded.
+ *
+ * The stage → settings table is written to a JSON file by SettingsTrace::writeReport,
+ * and is used by \ref SliceDataCache to check which stages have to be generated again for a next meshgroup.
+ *
+ * Tracing is off unless SettingsTrace::enable is called. A setting lookup then costs a single check of a flag.
+ */
+class SettingsTrace
+{
+public:
+    /*!
+     * Makes a stage active for as long as it is in scope, on all threads.
+     *
+     * Must only be used on the main thread, in between parallel loops.
+     */
+    class Stage : NoCopy
+    {
+    public:
+        /*!
+         * \param name The name of the stage, which must outlive the trace, e.g. a string literal
+         */
+        Stage(const char* name)
+        : previous(SettingsTrace::stage.exchange(name))
+        {
+        }
+
+        ~Stage()
+        {
+            SettingsTrace::stage = previous;
+        }
+    private:
+        const char* previous; //!< The stage which was active before this one
+    };
+
+    /*!
+     * Makes a stage active for as long as it is in scope, on the thread on which it's constructed,
+     * overriding the stage active on all threads.
+     */
+    class ThreadStage : NoCopy
+    {
+    public:
+        /*!
+         * \param name The name of the stage, which must outlive the trace, e.g. a string literal
+         */
+        ThreadStage(const char* name)
+        : previous(SettingsTrace::thread_stage)
+        {
+            SettingsTrace::thread_stage = name;
+        }
+
+        ~ThreadStage()
+        {
+            SettingsTrace::thread_stage = previous;
+        }
+    private:
+        const char* previous; //!< The stage which was active on this thread before this one
+    };
+
+    /*!
+     * Start recording the settings read by each stage, which are written to \p output_file by SettingsTrace::writeReport.
+     *
+     * Must be called before the first meshgroup is processed.
+     */
+    static void enable(const std::string& output_file);
+
+    /*!
+     * Whether SettingsTrace::enable has been called.
+     */
+    static bool isEnabled()
+    {
+        return enabled;
+    }
+
+    /*!
+     * Record that a setting is read in the active stage, if any.
+     *
+     * This function is thread safe.
+     */
+    static void record(const std::string& key)
+    {
+        if (enabled)
+        {
+            recordRead(key);
+        }
+    }
+
+    /*!
+     * Get the stages which have read a setting so far.
+     *
+     * \param key The setting
+     * \return The names of the stages, in the order in which they were first active
+     */
+    static std::vector<const char*> getStagesReading(const std::string& key);
+
+    /*!
+     * Write the settings read by each stage so far to the file given to SettingsTrace::enable,
+     * as a JSON object from each stage name to the sorted keys of the settings read in it.
+     *
+     * \return Whether the table has been written, which is false if tracing wasn't enabled or if the file couldn't be written
+     */
+    static bool writeReport();
+
+private:
+    static bool enabled; //!< Whether reads are recorded
+    static std::string output_file; //!< The file to which to write the table
+    static std::atomic<const char*> stage; //!< The stage active on all threads, or nullptr
+    static thread_local const char* thread_stage; //!< The stage active on this thread only, or nullptr
+    static std::mutex keys_mutex; //!< Guards SettingsTrace::stages and SettingsTrace::keys_per_stage
+    static std::vector<std::string> stages; //!< The names of the stages which have read settings, in the order in which they were first active
+    static std::map<std::string, std::set<std::string>> keys_per_stage; //!< The settings read by each stage
+
+    static void recordRead(const std::string& key);
+};
+
+}//namespace cura
+
+#endif//SETTINGS_SETTINGS_TRACE_H
@@ -9,6 +9,7 @@
 
 #include "settings.h"
 #include "SettingRegistry.h"
+#include "SettingsTrace.h"
 
 namespace cura
 {
@@ -53,11 +54,13 @@ SettingsBaseVirtual::SettingsBaseVirtual(SettingsBaseVirtual* parent)
 
 SettingsBase::SettingsBase()
 : SettingsBaseVirtual(nullptr)
+, is_flattened(false)
 {
 }
 
 SettingsBase::SettingsBase(SettingsBaseVirtual* parent)
 : SettingsBaseVirtual(parent)
+, is_flattened(false)
 {
 }
 
@@ -66,13 +69,41 @@ SettingsMessenger::SettingsMessenger(SettingsBaseVirtual* parent)
 {
 }
 
-void SettingsBase::_setSetting(std::string key, std::string value)
+/*!
+ * Mark the values of a setting cached by any settings object as outdated.
+ */
+static void invalidateTypedSettingValues(const std::string& key)
+{
+    InternedSettingKey* interned = SettingRegistry::getInstance()->getInternedKey(key);
+    if (interned)
+    {
+        interned->change_count++;
+    }
+}
+
+/*!
+ * Read a setting value as a boolean.
+ */
+static bool parseBoolean(const std::string& value)
+{
+    if (value == "on")
+        return true;
+    if (value == "yes")
+        return true;
+    if (value == "true" or value == "True") //Python uses "True"
+        return true;
+    int num = atoi(value.c_str());
+    return num != 0;
+}
+
+void SettingsBase::_setSetting(const std::string& key, const std::string& value)
 {
     setting_values[key] = value;
+    invalidateTypedSettingValues(key);
 }
 
 
-void SettingsBase::setSetting(std::string key, std::string value)
+void SettingsBase::setSetting(const std::string& key, const std::string& value)
 {
     if (SettingRegistry::getInstance()->settingExists(key))
     {
@@ -85,57 +116,211 @@ void SettingsBase::setSetting(std::string key, std::string value)
     }
 }
 
-void SettingsBase::setSettingInheritBase(std::string key, const SettingsBaseVirtual& parent)
+void SettingsBase::setSettingInheritBase(const std::string& key, const SettingsBaseVirtual& parent)
 {
     setting_inherit_base.emplace(key, &parent);
+    invalidateTypedSettingValues(key);
+    if (is_flattened)
+    { // the flattened value of the setting may come from another setting base now
+        flattened_values.clear();
+        is_flattened = false;
+    }
+}
+
+
+std::string SettingsBase::getSettingString(const std::string& key) const
+{
+    SettingsTrace::record(key);
+    const std::string* value = findSettingValue(key);
+    if (value)
+    {
+        return *value;
+    }
+
+    cura::logError("Trying to retrieve unregistered setting with no value given: '%s'\n", key.c_str());
+    std::exit(-1);
+    return "";
 }
 
+bool SettingsBase::hasSetting(const std::string& key) const
+{
+    SettingsTrace::record(key);
+    return findSettingValue(key) != nullptr;
+}
 
-std::string SettingsBase::getSettingString(std::string key) const
+const std::string* SettingsBase::findSettingValue(const std::string& key) const
 {
     auto value_it = setting_values.find(key);
     if (value_it != setting_values.end())
     {
-        return value_it->second;
+        return &value_it->second;
+    }
+    if (is_flattened)
+    {
+        auto flattened_it = flattened_values.find(key);
+        if (flattened_it != flattened_values.end())
+        {
+            return flattened_it->second;
+        }
+        // the ancestors may have got the setting after the flattening, so look it up in them like before
     }
     auto inherit_override_it = setting_inherit_base.find(key);
     if (inherit_override_it != setting_inherit_base.end())
     {
-        return inherit_override_it->second->getSettingString(key);
+        return inherit_override_it->second->findSettingValue(key);
     }
     if (parent)
     {
-        return parent->getSettingString(key);
+        return parent->findSettingValue(key);
     }
+    return nullptr;
+}
 
-    cura::logError("Trying to retrieve unregistered setting with no value given: '%s'\n", key.c_str());
-    std::exit(-1);
-    return "";
+void SettingsBase::getSettingKeys(std::set<std::string>& keys) const
+{
+    getLocalSettingKeys(keys);
+    if (parent)
+    { // not the keys of the flattened values, since the ancestors may have got more settings since
+        parent->getSettingKeys(keys);
+    }
+}
+
+void SettingsBase::flattenSettings()
+{
+    std::set<std::string> keys;
+    getSettingKeys(keys);
+    std::unordered_map<std::string, const std::string*> resolved_values;
+    for (const std::string& key : keys)
+    {
+        if (setting_values.find(key) != setting_values.end())
+        { // the settings of this object itself are always looked up first; their values may still change
+            continue;
+        }
+        const std::string* value = findSettingValue(key);
+        if (value)
+        { // values are stored in nodes of the unordered maps of the ancestors, which never move and are never erased
+            resolved_values.emplace(key, value);
+        }
+    }
+    flattened_values = std::move(resolved_values);
+    is_flattened = true;
+
+    SettingRegistry* registry = SettingRegistry::getInstance();
+    std::vector<TypedSettingValue> parsed_values(registry->getInternedKeyCount()); // settings without a value are left out
+    for (const std::string& key : keys)
+    {
+        const InternedSettingKey* interned = registry->getInternedKey(key);
+        const std::string* value = findSettingValue(key);
+        if (!interned || !value)
+        { // settings which aren't in the definition files are parsed on every call
+            continue;
+        }
+        TypedSettingValue& typed = parsed_values[interned->id];
+        typed.has_value = true;
+        typed.change_count = interned->change_count.load();
+        typed.number = atof(value->c_str());
+        typed.integer = atoi(value->c_str());
+        typed.boolean = parseBoolean(*value);
+    }
+    typed_values = std::move(parsed_values);
+}
+
+const TypedSettingValue* SettingsBase::findTypedSettingValue(const std::string& key) const
+{
+    if (typed_values.empty())
+    {
+        return nullptr;
+    }
+    const InternedSettingKey* interned = SettingRegistry::getInstance()->getInternedKey(key);
+    if (!interned || interned->id >= typed_values.size())
+    { // registered after this object was flattened
+        return nullptr;
+    }
+    const TypedSettingValue& typed = typed_values[interned->id];
+    if (!typed.has_value || typed.change_count != interned->change_count.load(std::memory_order_relaxed))
+    { // changed since it was parsed, or reported as missing by getSettingString
+        return nullptr;
+    }
+    SettingsTrace::record(key);
+    return &typed;
+}
+
+void SettingsBase::getLocalSettingKeys(std::set<std::string>& keys) const
+{
+    for (const std::pair<const std::string, std::string>& key_and_value : setting_values)
+    {
+        keys.insert(key_and_value.first);
+    }
+    for (const std::pair<const std::string, const SettingsBaseVirtual*>& key_and_base : setting_inherit_base)
+    {
+        keys.insert(key_and_base.first);
+    }
 }
 
-void SettingsMessenger::setSetting(std::string key, std::string value)
+void SettingsMessenger::setSetting(const std::string& key, const std::string& value)
 {
     parent->setSetting(key, value);
 }
 
-void SettingsMessenger::setSettingInheritBase(std::string key, const SettingsBaseVirtual& new_parent)
+void SettingsMessenger::setSettingInheritBase(const std::string& key, const SettingsBaseVirtual& new_parent)
 {
     parent->setSettingInheritBase(key, new_parent);
 }
 
 
-std::string SettingsMessenger::getSettingString(std::string key) const
+std::string SettingsMessenger::getSettingString(const std::string& key) const
 {
     return parent->getSettingString(key);
 }
 
-int SettingsBaseVirtual::getSettingAsIndex(std::string key) const
+bool SettingsMessenger::hasSetting(const std::string& key) const
 {
+    return parent->hasSetting(key);
+}
+
+const std::string* SettingsMessenger::findSettingValue(const std::string& key) const
+{
+    return parent->findSettingValue(key);
+}
+
+void SettingsMessenger::getSettingKeys(std::set<std::string>& keys) const
+{
+    parent->getSettingKeys(keys);
+}
+
+const TypedSettingValue* SettingsMessenger::findTypedSettingValue(const std::string& key) const
+{
+    return parent->findTypedSettingValue(key);
+}
+
+double SettingsBaseVirtual::getSettingAsNumber(const std::string& key) const
+{
+    const TypedSettingValue* typed = findTypedSettingValue(key);
+    if (typed)
+    {
+        return typed->number;
+    }
+    std::string value = getSettingString(key);
+    return atof(value.c_str());
+}
+
+int SettingsBaseVirtual::getSettingAsInteger(const std::string& key) const
+{
+    const TypedSettingValue* typed = findTypedSettingValue(key);
+    if (typed)
+    {
+        return typed->integer;
+    }
     std::string value = getSettingString(key);
     return atoi(value.c_str());
 }
 
-int SettingsBaseVirtual::getSettingAsExtruderNr(std::string key) const
+int SettingsBaseVirtual::getSettingAsIndex(const std::string& key) const
+{
+    return getSettingAsInteger(key);
+}
+
+int SettingsBaseVirtual::getSettingAsExtruderNr(const std::string& key) const
 {
     int extruder_nr = getSettingAsIndex(key);
     if (extruder_nr == -1)
@@ -145,13 +330,12 @@ int SettingsBaseVirtual::getSettingAsExtruderNr(std::string key) const
     return extruder_nr;
 }
 
-int SettingsBaseVirtual::getSettingAsCount(std::string key) const
+int SettingsBaseVirtual::getSettingAsCount(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return atoi(value.c_str());
+    return getSettingAsInteger(key);
 }
 
-unsigned int SettingsBaseVirtual::getSettingAsLayerNumber(std::string key) const
+unsigned int SettingsBaseVirtual::getSettingAsLayerNumber(const std::string& key) const
 {
     const unsigned int indicated_layer_number = stoul(getSettingString(key));
     if (indicated_layer_number < 1) //Input checking: Layer 0 is not allowed.
@@ -162,79 +346,67 @@ unsigned int SettingsBaseVirtual::getSettingAsLayerNumber(std::string key) const
     return indicated_layer_number - 1; //Input starts counting at layer 1, but engine code starts counting at layer 0.
 }
 
-double SettingsBaseVirtual::getSettingInMillimeters(std::string key) const
+double SettingsBaseVirtual::getSettingInMillimeters(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return atof(value.c_str());
+    return getSettingAsNumber(key);
 }
 
-coord_t SettingsBaseVirtual::getSettingInMicrons(std::string key) const
+coord_t SettingsBaseVirtual::getSettingInMicrons(const std::string& key) const
 {
     return getSettingInMillimeters(key) * 1000.0;
 }
 
-double SettingsBaseVirtual::getSettingInAngleDegrees(std::string key) const
+double SettingsBaseVirtual::getSettingInAngleDegrees(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return atof(value.c_str());
+    return getSettingAsNumber(key);
 }
 
-double SettingsBaseVirtual::getSettingInAngleRadians(std::string key) const
+double SettingsBaseVirtual::getSettingInAngleRadians(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return atof(value.c_str()) / 180.0 * M_PI;
+    return getSettingAsNumber(key) / 180.0 * M_PI;
 }
 
-bool SettingsBaseVirtual::getSettingBoolean(std::string key) const
+bool SettingsBaseVirtual::getSettingBoolean(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    if (value == "on")
-        return true;
-    if (value == "yes")
-        return true;
-    if (value == "true" or value == "True") //Python uses "True"
-        return true;
-    int num = atoi(value.c_str());
-    return num != 0;
+    const TypedSettingValue* typed = findTypedSettingValue(key);
+    if (typed)
+    {
+        return typed->boolean;
+    }
+    return parseBoolean(getSettingString(key));
 }
 
-double SettingsBaseVirtual::getSettingInDegreeCelsius(std::string key) const
+double SettingsBaseVirtual::getSettingInDegreeCelsius(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return atof(value.c_str());
+    return getSettingAsNumber(key);
 }
 
-double SettingsBaseVirtual::getSettingInMillimetersPerSecond(std::string key) const
+double SettingsBaseVirtual::getSettingInMillimetersPerSecond(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return std::max(0.0, atof(value.c_str()));
+    return std::max(0.0, getSettingAsNumber(key));
 }
 
-double SettingsBaseVirtual::getSettingInCubicMillimeters(std::string key) const
+double SettingsBaseVirtual::getSettingInCubicMillimeters(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return std::max(0.0, atof(value.c_str()));
+    return std::max(0.0, getSettingAsNumber(key));
 }
 
-double SettingsBaseVirtual::getSettingInPercentage(std::string key) const
+double SettingsBaseVirtual::getSettingInPercentage(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return std::max(0.0, atof(value.c_str()));
+    return std::max(0.0, getSettingAsNumber(key));
 }
 
-double SettingsBaseVirtual::getSettingAsRatio(std::string key) const
+double SettingsBaseVirtual::getSettingAsRatio(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return atof(value.c_str()) / 100.0;
+    return getSettingAsNumber(key) / 100.0;
 }
 
-double SettingsBaseVirtual::getSettingInSeconds(std::string key) const
+double SettingsBaseVirtual::getSettingInSeconds(const std::string& key) const
 {
-    std::string value = getSettingString(key);
-    return std::max(0.0, atof(value.c_str()));
+    return std::max(0.0, getSettingAsNumber(key));
 }
 
-DraftShieldHeightLimitation SettingsBaseVirtual::getSettingAsDraftShieldHeightLimitation(const std::string key) const
+DraftShieldHeightLimitation SettingsBaseVirtual::getSettingAsDraftShieldHeightLimitation(const std::string& key) const
 {
     const std::string value = getSettingString(key);
     if (value == "full")
@@ -248,7 +420,7 @@ DraftShieldHeightLimitation SettingsBaseVirtual::getSettingAsDraftShieldHeightLi
     return DraftShieldHeightLimitation::FULL; //Default.
 }
 
-FlowTempGraph SettingsBaseVirtual::getSettingAsFlowTempGraph(std::string key) const
+FlowTempGraph SettingsBaseVirtual::getSettingAsFlowTempGraph(const std::string& key) const
 {
     FlowTempGraph ret;
     std::string value_string = getSettingString(key);
@@ -292,7 +464,7 @@ FlowTempGraph SettingsBaseVirtual::getSettingAsFlowTempGraph(std::string key) co
     return ret;
 }
 
-FMatrix3x3 SettingsBaseVirtual::getSettingAsPointMatrix(std::string key) const
+FMatrix3x3 SettingsBaseVirtual::getSettingAsPointMatrix(const std::string& key) const
 {
     FMatrix3x3 ret;
 
@@ -334,7 +506,7 @@ FMatrix3x3 SettingsBaseVirtual::getSettingAsPointMatrix(std::string key) const
 }
 
 
-EGCodeFlavor SettingsBaseVirtual::getSettingAsGCodeFlavor(std::string key) const
+EGCodeFlavor SettingsBaseVirtual::getSettingAsGCodeFlavor(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "Griffin")
@@ -354,7 +526,7 @@ EGCodeFlavor SettingsBaseVirtual::getSettingAsGCodeFlavor(std::string key) const
     return EGCodeFlavor::REPRAP;
 }
 
-EFillMethod SettingsBaseVirtual::getSettingAsFillMethod(std::string key) const
+EFillMethod SettingsBaseVirtual::getSettingAsFillMethod(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "lines")
@@ -378,7 +550,7 @@ EFillMethod SettingsBaseVirtual::getSettingAsFillMethod(std::string key) const
     return EFillMethod::NONE;
 }
 
-EPlatformAdhesion SettingsBaseVirtual::getSettingAsPlatformAdhesion(std::string key) const
+EPlatformAdhesion SettingsBaseVirtual::getSettingAsPlatformAdhesion(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "brim")
@@ -390,7 +562,7 @@ EPlatformAdhesion SettingsBaseVirtual::getSettingAsPlatformAdhesion(std::string
     return EPlatformAdhesion::SKIRT;
 }
 
-ESupportType SettingsBaseVirtual::getSettingAsSupportType(std::string key) const
+ESupportType SettingsBaseVirtual::getSettingAsSupportType(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "everywhere")
@@ -400,7 +572,7 @@ ESupportType SettingsBaseVirtual::getSettingAsSupportType(std::string key) const
     return ESupportType::NONE;
 }
 
-EZSeamType SettingsBaseVirtual::getSettingAsZSeamType(std::string key) const
+EZSeamType SettingsBaseVirtual::getSettingAsZSeamType(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "random")
@@ -412,7 +584,7 @@ EZSeamType SettingsBaseVirtual::getSettingAsZSeamType(std::string key) const
     return EZSeamType::SHORTEST;
 }
 
-ESurfaceMode SettingsBaseVirtual::getSettingAsSurfaceMode(std::string key) const
+ESurfaceMode SettingsBaseVirtual::getSettingAsSurfaceMode(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "normal")
@@ -424,7 +596,7 @@ ESurfaceMode SettingsBaseVirtual::getSettingAsSurfaceMode(std::string key) const
     return ESurfaceMode::NORMAL;
 }
 
-FillPerimeterGapMode SettingsBaseVirtual::getSettingAsFillPerimeterGapMode(std::string key) const
+FillPerimeterGapMode SettingsBaseVirtual::getSettingAsFillPerimeterGapMode(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "nowhere")
@@ -438,7 +610,7 @@ FillPerimeterGapMode SettingsBaseVirtual::getSettingAsFillPerimeterGapMode(std::
     return FillPerimeterGapMode::NOWHERE;
 }
 
-CombingMode SettingsBaseVirtual::getSettingAsCombingMode(std::string key) const
+CombingMode SettingsBaseVirtual::getSettingAsCombingMode(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "off")
@@ -456,7 +628,7 @@ CombingMode SettingsBaseVirtual::getSettingAsCombingMode(std::string key) const
     return CombingMode::ALL;
 }
 
-SupportDistPriority SettingsBaseVirtual::getSettingAsSupportDistPriority(std::string key) const
+SupportDistPriority SettingsBaseVirtual::getSettingAsSupportDistPriority(const std::string& key) const
 {
     std::string value = getSettingString(key);
     if (value == "xy_overrides_z")
@@ -470,7 +642,7 @@ SupportDistPriority SettingsBaseVirtual::getSettingAsSupportDistPriority(std::st
     return SupportDistPriority::XY_OVERRIDES_Z;
 }
 
-std::vector<int> SettingsBaseVirtual::getSettingAsIntegerList(std::string key) const
+std::vector<int> SettingsBaseVirtual::getSettingAsIntegerList(const std::string& key) const
 {
     std::vector<int> result;
     std::string value_string = getSettingString(key);
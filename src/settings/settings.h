@@ -2,8 +2,10 @@
 #ifndef SETTINGS_SETTINGS_H
 #define SETTINGS_SETTINGS_H
 
+#include <atomic>
 #include <vector>
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <sstream>
 
@@ -184,6 +186,29 @@ enum class SupportDistPriority
     
 class SettingsBase;
 
+/*!
+ * A setting key interned by the SettingRegistry when the definition files are loaded.
+ *
+ * The ids number the keys from zero, so that they can index the typed values cached by each SettingsBase.
+ */
+struct InternedSettingKey
+{
+    unsigned int id = 0; //!< The number of the setting
+    std::atomic<unsigned int> change_count{0}; //!< The number of times the setting was given a value or an inheritance override in any settings object, which makes the values cached before outdated
+};
+
+/*!
+ * The value of a setting parsed once, so that the getters don't parse the string on every call.
+ */
+struct TypedSettingValue
+{
+    bool has_value; //!< Whether the setting has a value at all
+    unsigned int change_count; //!< The InternedSettingKey::change_count of the setting when its value was parsed
+    double number; //!< The value as a floating point number, as read by atof
+    int integer; //!< The value as an integer, as read by atoi
+    bool boolean; //!< The value as read by SettingsBaseVirtual::getSettingBoolean
+};
+
 /*!
  * An abstract class for classes that can provide setting values.
  * These are: SettingsBase, which contains setting information 
@@ -194,9 +219,16 @@ class SettingsBaseVirtual
 protected:
     SettingsBaseVirtual* parent;
 public:
-    virtual std::string getSettingString(std::string key) const = 0;
+    virtual std::string getSettingString(const std::string& key) const = 0;
+
+    /*!
+     * Whether a setting has a value in this settings object or any of its ancestors.
+     * 
+     * Used for optional settings, which needn't be present in the setting definitions.
+     */
+    virtual bool hasSetting(const std::string& key) const = 0;
     
-    virtual void setSetting(std::string key, std::string value) = 0;
+    virtual void setSetting(const std::string& key, const std::string& value) = 0;
 
     /*!
      * Set the parent settings base for inheriting a setting to a specific setting base.
@@ -205,7 +237,26 @@ public:
      * \param key The setting for which to override the inheritance
      * \param parent The setting base from which to obtain the setting instead.
      */
-    virtual void setSettingInheritBase(std::string key, const SettingsBaseVirtual& parent) = 0;
+    virtual void setSettingInheritBase(const std::string& key, const SettingsBaseVirtual& parent) = 0;
+
+    /*!
+     * Find the value of a setting in this settings object or any of its ancestors, without recording the access in the \ref SettingsTrace
+     *
+     * \return The stored value, or nullptr if the setting has no value
+     */
+    virtual const std::string* findSettingValue(const std::string& key) const = 0;
+
+    /*!
+     * Add the keys of all settings which have a value in this settings object or any of its ancestors to \p keys.
+     */
+    virtual void getSettingKeys(std::set<std::string>& keys) const = 0;
+
+    /*!
+     * Find the parsed value of a setting, as cached by \ref SettingsBase::flattenSettings
+     *
+     * \return The parsed value, or nullptr if it isn't cached or changed since, in which case the string value should be parsed
+     */
+    virtual const TypedSettingValue* findTypedSettingValue(const std::string& key) const = 0;
 
     virtual ~SettingsBaseVirtual() {}
     
@@ -215,14 +266,14 @@ public:
     void setParent(SettingsBaseVirtual* parent) { this->parent = parent; }
     SettingsBaseVirtual* getParent() { return parent; }
     
-    int getSettingAsIndex(std::string key) const;
-    int getSettingAsCount(std::string key) const;
+    int getSettingAsIndex(const std::string& key) const;
+    int getSettingAsCount(const std::string& key) const;
 
     /*!
      * Get a setting as an int, but if it's -1 then return
      * the value of the setting "extruder_nr"
      */
-    int getSettingAsExtruderNr(std::string key) const;
+    int getSettingAsExtruderNr(const std::string& key) const;
 
     /*!
      * \brief Interprets a setting as a layer number.
@@ -232,34 +283,38 @@ public:
      *
      * \return Zero-based numbering of a layer number setting.
      */
-    unsigned int getSettingAsLayerNumber(std::string key) const;
-
-    double getSettingInAngleDegrees(std::string key) const;
-    double getSettingInAngleRadians(std::string key) const;
-    double getSettingInMillimeters(std::string key) const;
-    coord_t getSettingInMicrons(std::string key) const;
-    bool getSettingBoolean(std::string key) const;
-    double getSettingInDegreeCelsius(std::string key) const;
-    double getSettingInMillimetersPerSecond(std::string key) const;
-    double getSettingInCubicMillimeters(std::string key) const;
-    double getSettingInPercentage(std::string key) const;
-    double getSettingAsRatio(std::string key) const; //!< For settings which are provided in percentage
-    double getSettingInSeconds(std::string key) const;
-
-    FlowTempGraph getSettingAsFlowTempGraph(std::string key) const;
-    FMatrix3x3 getSettingAsPointMatrix(std::string key) const;
-
-    DraftShieldHeightLimitation getSettingAsDraftShieldHeightLimitation(const std::string key) const;
-    EGCodeFlavor getSettingAsGCodeFlavor(std::string key) const;
-    EFillMethod getSettingAsFillMethod(std::string key) const;
-    EPlatformAdhesion getSettingAsPlatformAdhesion(std::string key) const;
-    ESupportType getSettingAsSupportType(std::string key) const;
-    EZSeamType getSettingAsZSeamType(std::string key) const;
-    ESurfaceMode getSettingAsSurfaceMode(std::string key) const;
-    FillPerimeterGapMode getSettingAsFillPerimeterGapMode(std::string key) const;
-    CombingMode getSettingAsCombingMode(std::string key) const;
-    SupportDistPriority getSettingAsSupportDistPriority(std::string key) const;
-    std::vector<int> getSettingAsIntegerList(std::string key) const;
+    unsigned int getSettingAsLayerNumber(const std::string& key) const;
+
+    double getSettingInAngleDegrees(const std::string& key) const;
+    double getSettingInAngleRadians(const std::string& key) const;
+    double getSettingInMillimeters(const std::string& key) const;
+    coord_t getSettingInMicrons(const std::string& key) const;
+    bool getSettingBoolean(const std::string& key) const;
+    double getSettingInDegreeCelsius(const std::string& key) const;
+    double getSettingInMillimetersPerSecond(const std::string& key) const;
+    double getSettingInCubicMillimeters(const std::string& key) const;
+    double getSettingInPercentage(const std::string& key) const;
+    double getSettingAsRatio(const std::string& key) const; //!< For settings which are provided in percentage
+    double getSettingInSeconds(const std::string& key) const;
+
+    FlowTempGraph getSettingAsFlowTempGraph(const std::string& key) const;
+    FMatrix3x3 getSettingAsPointMatrix(const std::string& key) const;
+
+    DraftShieldHeightLimitation getSettingAsDraftShieldHeightLimitation(const std::string& key) const;
+    EGCodeFlavor getSettingAsGCodeFlavor(const std::string& key) const;
+    EFillMethod getSettingAsFillMethod(const std::string& key) const;
+    EPlatformAdhesion getSettingAsPlatformAdhesion(const std::string& key) const;
+    ESupportType getSettingAsSupportType(const std::string& key) const;
+    EZSeamType getSettingAsZSeamType(const std::string& key) const;
+    ESurfaceMode getSettingAsSurfaceMode(const std::string& key) const;
+    FillPerimeterGapMode getSettingAsFillPerimeterGapMode(const std::string& key) const;
+    CombingMode getSettingAsCombingMode(const std::string& key) const;
+    SupportDistPriority getSettingAsSupportDistPriority(const std::string& key) const;
+    std::vector<int> getSettingAsIntegerList(const std::string& key) const;
+
+private:
+    double getSettingAsNumber(const std::string& key) const; //!< Get a setting as read by atof
+    int getSettingAsInteger(const std::string& key) const; //!< Get a setting as read by atoi
 };
 
 class SettingRegistry;
@@ -280,6 +335,18 @@ private:
      * Mapping for each setting which must inherit from a different setting base than \ref SettingsBaseVirtual::parent
      */
     std::unordered_map<std::string, const SettingsBaseVirtual*> setting_inherit_base;
+
+    /*!
+     * For each setting which isn't given to this object itself, the value it resolves to in the ancestors, see \ref SettingsBase::flattenSettings
+     */
+    std::unordered_map<std::string, const std::string*> flattened_values;
+    bool is_flattened; //!< Whether \ref SettingsBase::flattened_values holds the settings of the ancestors, at the time they were flattened
+
+    /*!
+     * The values of all registered settings parsed by \ref SettingsBase::flattenSettings, by the id of their interned key.
+     * A value is only used as long as its setting hasn't changed since, in this object or any other.
+     */
+    std::vector<TypedSettingValue> typed_values;
 public:
     SettingsBase(); //!< SettingsBase without a parent settings object
     SettingsBase(SettingsBaseVirtual* parent); //!< construct a SettingsBase with a parent settings object
@@ -289,9 +356,30 @@ public:
      * \param key the setting
      * \param value the value
      */
-    void setSetting(std::string key, std::string value);
-    void setSettingInheritBase(std::string key, const SettingsBaseVirtual& parent); //!< See \ref SettingsBaseVirtual::setSettingInheritBase
-    std::string getSettingString(std::string key) const; //!< Get a setting from this SettingsBase (or any ancestral SettingsBase)
+    void setSetting(const std::string& key, const std::string& value);
+    void setSettingInheritBase(const std::string& key, const SettingsBaseVirtual& parent); //!< See \ref SettingsBaseVirtual::setSettingInheritBase
+    std::string getSettingString(const std::string& key) const; //!< Get a setting from this SettingsBase (or any ancestral SettingsBase)
+    bool hasSetting(const std::string& key) const; //!< See \ref SettingsBaseVirtual::hasSetting
+    const std::string* findSettingValue(const std::string& key) const; //!< See \ref SettingsBaseVirtual::findSettingValue
+    void getSettingKeys(std::set<std::string>& keys) const; //!< See \ref SettingsBaseVirtual::getSettingKeys
+    const TypedSettingValue* findTypedSettingValue(const std::string& key) const; //!< See \ref SettingsBaseVirtual::findTypedSettingValue
+
+    /*!
+     * Resolve every setting of the ancestors once, following the inheritance overrides and the parent chain,
+     * so that looking up a setting no longer walks the chain.
+     * Also parse the values of all registered settings, so that the getters of numbers and booleans don't parse strings anymore.
+     *
+     * Call this once all settings of this object and its ancestors are known, after flattening the ancestors.
+     * Values changed in the ancestors afterwards are still seen, and so are settings which they get afterwards, which are looked up along the chain.
+     * Only a setting which an ancestor gets afterwards while it was already resolved to an ancestor further up isn't seen.
+     * Setting an inheritance override on this object undoes the flattening.
+     */
+    void flattenSettings();
+
+    /*!
+     * Add the keys of the settings given to this object itself to \p keys, including the settings inheriting from a different setting base.
+     */
+    void getLocalSettingKeys(std::set<std::string>& keys) const;
     
     std::string getAllLocalSettingsString() const
     {
@@ -317,7 +405,7 @@ protected:
      * 
      * Used in SettingsRegistry
      */
-    void _setSetting(std::string key, std::string value);
+    void _setSetting(const std::string& key, const std::string& value);
 };
 
 /*!
@@ -330,9 +418,13 @@ class SettingsMessenger : public SettingsBaseVirtual
 public:
     SettingsMessenger(SettingsBaseVirtual* parent); //!< construct a SettingsMessenger with a parent settings object
     
-    void setSetting(std::string key, std::string value); //!< Set a setting of the parent SettingsBase to a given value
-    void setSettingInheritBase(std::string key, const SettingsBaseVirtual& parent); //!< See \ref SettingsBaseVirtual::setSettingInheritBase
-    std::string getSettingString(std::string key) const; //!< Get a setting from the parent SettingsBase (or any further ancestral SettingsBase)
+    void setSetting(const std::string& key, const std::string& value); //!< Set a setting of the parent SettingsBase to a given value
+    void setSettingInheritBase(const std::string& key, const SettingsBaseVirtual& parent); //!< See \ref SettingsBaseVirtual::setSettingInheritBase
+    std::string getSettingString(const std::string& key) const; //!< Get a setting from the parent SettingsBase (or any further ancestral SettingsBase)
+    bool hasSetting(const std::string& key) const; //!< See \ref SettingsBaseVirtual::hasSetting
+    const std::string* findSettingValue(const std::string& key) const; //!< See \ref SettingsBaseVirtual::findSettingValue
+    void getSettingKeys(std::set<std::string>& keys) const; //!< See \ref SettingsBaseVirtual::getSettingKeys
+    const TypedSettingValue* findTypedSettingValue(const std::string& key) const; //!< See \ref SettingsBaseVirtual::findTypedSettingValue
 };
 
 
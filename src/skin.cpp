@@ -1,9 +1,12 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
+#include <cassert>
 #include <cmath> // std::ceil
 
 #include "skin.h"
+#include "utils/AABB.h"
 #include "utils/math.h"
 #include "utils/polygonUtils.h"
+#include "utils/ThreadPool.h"
 
 #define MIN_AREA_SIZE (0.4 * 0.4) 
 
@@ -20,9 +23,9 @@ namespace cura
  *
  * generateSkins therefore reads (depends on) data from mesh.layers[*].parts[*].insets and writes mesh.layers[n].parts[*].skin_parts
  */
-void generateSkins(int layerNr, SliceMeshStorage& mesh, int downSkinCount, int upSkinCount, int wall_line_count, int wall_line_width_x, int insetCount, bool no_small_gaps_heuristic)
+void generateSkins(int layerNr, SliceMeshStorage& mesh, int downSkinCount, int upSkinCount, int wall_line_count, int wall_line_width_x, int insetCount, bool no_small_gaps_heuristic, SkinLayerWindowIntersections* down_windows, SkinLayerWindowIntersections* up_windows)
 {
-    generateSkinAreas(layerNr, mesh, wall_line_width_x, downSkinCount, upSkinCount, wall_line_count, no_small_gaps_heuristic);
+    generateSkinAreas(layerNr, mesh, wall_line_width_x, downSkinCount, upSkinCount, wall_line_count, no_small_gaps_heuristic, down_windows, up_windows);
 
     SliceLayer* layer = &mesh.layers[layerNr];
     for(unsigned int partNr=0; partNr<layer->parts.size(); partNr++)
@@ -32,13 +35,89 @@ void generateSkins(int layerNr, SliceMeshStorage& mesh, int downSkinCount, int u
     }
 }
 
+SkinLayerWindowIntersections::SkinLayerWindowIntersections(const SliceMeshStorage& mesh, int window_size, int wall_line_count)
+: mesh(mesh)
+, window_size(window_size)
+, wall_line_count(wall_line_count)
+, blocks(new Block[mesh.layers.size() / window_size + 1])
+{
+    assert(window_size > 0);
+}
+
+Polygons SkinLayerWindowIntersections::getInside(int layer_nr) const
+{
+    Polygons result;
+    for (const SliceLayerPart& part : mesh.layers[layer_nr].parts)
+    {
+        if (!part.insets.empty())
+        {
+            unsigned int wall_idx = std::max(0, std::min(wall_line_count, (int) part.insets.size()) - 1);
+            result.add(part.insets[wall_idx]);
+        }
+    }
+    return result;
+}
+
+Polygons SkinLayerWindowIntersections::getHead(int block_idx, int last_layer_nr)
+{
+    Block& block = blocks[block_idx];
+    std::lock_guard<std::mutex> lock(block.mutex);
+    const int first_layer_nr = block_idx * window_size;
+    while (first_layer_nr + static_cast<int>(block.heads.size()) <= last_layer_nr)
+    {
+        const int layer_nr = first_layer_nr + block.heads.size();
+        block.heads.emplace_back(block.heads.empty() ? getInside(layer_nr) : block.heads.back().intersection(getInside(layer_nr)));
+    }
+    return block.heads[last_layer_nr - first_layer_nr];
+}
+
+Polygons SkinLayerWindowIntersections::getTail(int block_idx, int first_layer_nr)
+{
+    Block& block = blocks[block_idx];
+    std::lock_guard<std::mutex> lock(block.mutex);
+    const int block_first_layer_nr = block_idx * window_size;
+    if (block.tails.empty())
+    { // the whole block is below the end of the window, so all its walls are done
+        block.tails.resize(window_size);
+        const int block_last_layer_nr = block_first_layer_nr + window_size - 1;
+        block.tails.back() = getInside(block_last_layer_nr);
+        for (int layer_nr = block_last_layer_nr - 1; layer_nr >= block_first_layer_nr; layer_nr--)
+        {
+            block.tails[layer_nr - block_first_layer_nr] = block.tails[layer_nr - block_first_layer_nr + 1].intersection(getInside(layer_nr));
+        }
+    }
+    return block.tails[first_layer_nr - block_first_layer_nr];
+}
+
+Polygons SkinLayerWindowIntersections::getIntersection(int first_layer_nr, const AABB& near)
+{
+    assert(first_layer_nr >= 0 && first_layer_nr + window_size <= static_cast<int>(mesh.layers.size()));
+    const int block_idx = first_layer_nr / window_size;
+    Polygons intersection = getTail(block_idx, first_layer_nr);
+    if (first_layer_nr % window_size != 0)
+    {
+        intersection = intersection.intersection(getHead(block_idx + 1, first_layer_nr + window_size - 1));
+    }
+
+    Polygons result;
+    const std::vector<AABB> poly_aabbs = AABB::calculatePerPolygon(intersection);
+    for (unsigned int poly_idx = 0; poly_idx < intersection.size(); poly_idx++)
+    {
+        if (near.hit(poly_aabbs[poly_idx]))
+        {
+            result.add(intersection[poly_idx]);
+        }
+    }
+    return result;
+}
+
 /*
  * This function is executed in a parallel region based on layer_nr.
  * When modifying make sure any changes does not introduce data races.
  *
  * generateSkinAreas reads data from mesh.layers[*].parts[*].insets and writes to mesh.layers[n].parts[*].skin_parts
  */
-void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost_wall_line_width, int downSkinCount, int upSkinCount, int wall_line_count, bool no_small_gaps_heuristic)
+void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost_wall_line_width, int downSkinCount, int upSkinCount, int wall_line_count, bool no_small_gaps_heuristic, SkinLayerWindowIntersections* down_windows, SkinLayerWindowIntersections* up_windows)
 {
     SliceLayer& layer = mesh.layers[layer_nr];
     
@@ -46,7 +125,7 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
     {
         return;
     }
-    int min_infill_area = mesh.getSettingInMillimeters("min_infill_area");
+    const int min_infill_area = mesh.layer_settings.min_infill_area;
     for(unsigned int partNr = 0; partNr < layer.parts.size(); partNr++)
     {
         SliceLayerPart& part = layer.parts[partNr];
@@ -102,10 +181,18 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
         {
             if (layer_nr >= downSkinCount && downSkinCount > 0)
             {
-                Polygons not_air = getInsidePolygons(mesh.layers[layer_nr - 1]);
-                for (int downskin_layer_nr = layer_nr - downSkinCount; downskin_layer_nr < layer_nr - 1; downskin_layer_nr++)
+                Polygons not_air;
+                if (down_windows)
                 {
-                    not_air = not_air.intersection(getInsidePolygons(mesh.layers[downskin_layer_nr]));
+                    not_air = down_windows->getIntersection(layer_nr - downSkinCount, part.boundaryBox);
+                }
+                else
+                {
+                    not_air = getInsidePolygons(mesh.layers[layer_nr - 1]);
+                    for (int downskin_layer_nr = layer_nr - downSkinCount; downskin_layer_nr < layer_nr - 1; downskin_layer_nr++)
+                    {
+                        not_air = not_air.intersection(getInsidePolygons(mesh.layers[downskin_layer_nr]));
+                    }
                 }
                 if (min_infill_area > 0)
                 {
@@ -116,10 +203,18 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
             
             if (layer_nr < static_cast<int>(mesh.layers.size()) - 1 - upSkinCount && upSkinCount > 0)
             {
-                Polygons not_air = getInsidePolygons(mesh.layers[layer_nr + 1]);
-                for (int upskin_layer_nr = layer_nr + 2; upskin_layer_nr < layer_nr + upSkinCount + 1; upskin_layer_nr++)
+                Polygons not_air;
+                if (up_windows)
                 {
-                    not_air = not_air.intersection(getInsidePolygons(mesh.layers[upskin_layer_nr]));
+                    not_air = up_windows->getIntersection(layer_nr + 1, part.boundaryBox);
+                }
+                else
+                {
+                    not_air = getInsidePolygons(mesh.layers[layer_nr + 1]);
+                    for (int upskin_layer_nr = layer_nr + 2; upskin_layer_nr < layer_nr + upSkinCount + 1; upskin_layer_nr++)
+                    {
+                        not_air = not_air.intersection(getInsidePolygons(mesh.layers[upskin_layer_nr]));
+                    }
                 }
                 if (min_infill_area > 0)
                 {
@@ -129,11 +224,11 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
             }
         }
 
-        int expand_skins_expand_distance = mesh.getSettingInMicrons("expand_skins_expand_distance");
+        int expand_skins_expand_distance = mesh.layer_settings.expand_skins_expand_distance;
         
         if (expand_skins_expand_distance > 0)
         {
-            int pre_shrink = mesh.getSettingInMicrons("min_skin_width_for_expansion") / 2;
+            int pre_shrink = mesh.layer_settings.min_skin_width_for_expansion / 2;
 
             // skin areas are to be enlarged by expand_skins_expand_distance but before they are expanded
             // the skin areas are shrunk by pre_shrink so that very narrow regions of skin
@@ -141,12 +236,12 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
 
             expand_skins_expand_distance += pre_shrink; // increase the expansion distance to compensate for the shrinkage
 
-            if (mesh.getSettingBoolean("expand_upper_skins"))
+            if (mesh.layer_settings.expand_upper_skins)
             {
                 upskin = upskin.offset(-pre_shrink).offset(expand_skins_expand_distance).unionPolygons(upskin).intersection(original_outline);
             }
 
-            if (mesh.getSettingBoolean("expand_lower_skins"))
+            if (mesh.layer_settings.expand_lower_skins)
             {
                 downskin = downskin.offset(-pre_shrink).offset(expand_skins_expand_distance).unionPolygons(downskin).intersection(original_outline);
             }
@@ -157,7 +252,7 @@ void generateSkinAreas(int layer_nr, SliceMeshStorage& mesh, const int innermost
 
         skin.removeSmallAreas(MIN_AREA_SIZE);
         
-        for (PolygonsPart& skin_area_part : skin.splitIntoParts())
+        for (PolygonsPart& skin_area_part : skin.splitIntoPartsByContainment())
         {
             part.skin_parts.emplace_back();
             part.skin_parts.back().outline = skin_area_part;
@@ -214,11 +309,12 @@ void generateInfill(int layerNr, SliceMeshStorage& mesh, const int innermost_wal
     SliceLayer& layer = mesh.layers[layerNr];
 
     int extra_offset = 0;
-    EFillMethod fill_pattern = mesh.getSettingAsFillMethod("infill_pattern");
+    const MeshLayerSettings& settings = mesh.layer_settings;
+    EFillMethod fill_pattern = settings.infill_pattern;
     if ((fill_pattern == EFillMethod::CONCENTRIC || fill_pattern == EFillMethod::CONCENTRIC_3D)
-        && mesh.getSettingBoolean("alternate_extra_perimeter")
+        && settings.alternate_extra_perimeter
         && layerNr % 2 == 0
-        && mesh.getSettingInMicrons("infill_line_distance") > mesh.getSettingInMicrons("infill_line_width") * 2)
+        && settings.infill_line_distance > settings.infill_line_width * 2)
     {
         extra_offset = -innermost_wall_line_width;
     }
@@ -245,9 +341,9 @@ void generateInfill(int layerNr, SliceMeshStorage& mesh, const int innermost_wal
 
         Polygons final_infill = infill.offset(infill_skin_overlap);
 
-        if (mesh.getSettingBoolean("infill_hollow"))
+        if (settings.infill_hollow)
         {
-            part.print_outline = part.print_outline.difference(final_infill);
+            part.print_outline = CompactPolygons(part.print_outline.toPolygons().difference(final_infill));
         }
         else
         {
@@ -256,7 +352,7 @@ void generateInfill(int layerNr, SliceMeshStorage& mesh, const int innermost_wal
     }
 }
 
-void SkinInfillAreaComputation::generateGradualInfill(SliceMeshStorage& mesh, unsigned int gradual_infill_step_height, unsigned int max_infill_steps)
+void SkinInfillAreaComputation::generateGradualInfill(SliceMeshStorage& mesh, unsigned int gradual_infill_step_layer_count, unsigned int max_infill_steps, int start_layer_nr, int end_layer_nr)
 {
     // no early-out for this function; it needs to initialize the [infill_area_per_combine_per_density]
     float layer_skip_count = 8; // skip every so many layers as to ignore small gaps in the model making computation more easy
@@ -264,19 +360,23 @@ void SkinInfillAreaComputation::generateGradualInfill(SliceMeshStorage& mesh, un
     {
         layer_skip_count = 1;
     }
-    unsigned int gradual_infill_step_layer_count = round_divide(gradual_infill_step_height, mesh.getSettingInMicrons("layer_height")); // The difference in layer count between consecutive density infill areas
-
     // make gradual_infill_step_height divisable by layer_skip_count
     float n_skip_steps_per_gradual_step = std::max(1.0f, std::ceil(gradual_infill_step_layer_count / layer_skip_count)); // only decrease layer_skip_count to make it a divisor of gradual_infill_step_layer_count
     layer_skip_count = gradual_infill_step_layer_count / n_skip_steps_per_gradual_step;
 
 
-    size_t min_layer = mesh.getSettingAsCount("bottom_layers");
-    size_t max_layer = mesh.layers.size() - 1 - mesh.getSettingAsCount("top_layers");
+    size_t min_layer = mesh.layer_settings.bottom_layers;
+    size_t max_layer = mesh.layers.size() - 1 - mesh.layer_settings.top_layers;
 
-    for (size_t layer_idx = 0; layer_idx < mesh.layers.size(); layer_idx++)
+    // Each layer only writes the infill_area_per_combine_per_density of its own parts and reads the own infill areas of the layers above,
+    // so the layers can be processed in parallel. The own infill areas are only cleared after all layers are done.
+    ThreadPool::parallelFor(start_layer_nr, end_layer_nr, [&](int layer_idx)
     { // loop also over layers which don't contain infill cause of bottom_ and top_layer to initialize their infill_area_per_combine_per_density
         SliceLayer& layer = mesh.layers[layer_idx];
+        if (layer.geometry_compressed)
+        {
+            return;
+        }
 
         for (SliceLayerPart& part : layer.parts)
         {
@@ -284,7 +384,7 @@ void SkinInfillAreaComputation::generateGradualInfill(SliceMeshStorage& mesh, un
 
             const Polygons& infill_area = part.getOwnInfillArea();
 
-            if (infill_area.size() == 0 || layer_idx < min_layer || layer_idx > max_layer)
+            if (infill_area.size() == 0 || static_cast<size_t>(layer_idx) < min_layer || static_cast<size_t>(layer_idx) > max_layer)
             { // initialize infill_area_per_combine_per_density empty
                 part.infill_area_per_combine_per_density.emplace_back(); // create a new infill_area_per_combine
                 part.infill_area_per_combine_per_density.back().emplace_back(); // put empty infill area in the newly constructed infill_area_per_combine
@@ -334,15 +434,29 @@ void SkinInfillAreaComputation::generateGradualInfill(SliceMeshStorage& mesh, un
             part.infill_area_per_combine_per_density.emplace_back();
             std::vector<Polygons>& infill_area_per_combine_current_density = part.infill_area_per_combine_per_density.back();
             infill_area_per_combine_current_density.push_back(infill_area);
-            part.infill_area_own = nullptr; // clear infill_area_own, it's not needed any more.
             assert(part.infill_area_per_combine_per_density.size() != 0 && "infill_area_per_combine_per_density is now initialized");
         }
+    });
+
+    for (int layer_idx = start_layer_nr; layer_idx < end_layer_nr; layer_idx++)
+    {
+        if (static_cast<size_t>(layer_idx) < min_layer || static_cast<size_t>(layer_idx) > max_layer || mesh.layers[layer_idx].geometry_compressed)
+        {
+            continue;
+        }
+        for (SliceLayerPart& part : mesh.layers[layer_idx].parts)
+        {
+            if (part.getOwnInfillArea().size() != 0)
+            {
+                part.infill_area_own = nullptr; // clear infill_area_own, it's not needed any more.
+            }
+        }
     }
 }
 
 void combineInfillLayers(SliceMeshStorage& mesh, unsigned int amount)
 {
-    if (mesh.layers.empty() || mesh.layers.size() - 1 < static_cast<size_t>(mesh.getSettingAsCount("top_layers")) || mesh.getSettingAsCount("infill_line_distance") <= 0) //No infill is even generated.
+    if (mesh.layers.empty() || mesh.layers.size() - 1 < static_cast<size_t>(mesh.layer_settings.top_layers) || mesh.getSettingAsCount("infill_line_distance") <= 0) //No infill is even generated.
     {
         return;
     }
@@ -354,12 +468,20 @@ void combineInfillLayers(SliceMeshStorage& mesh, unsigned int amount)
     divisible index. Otherwise we get some parts that have infill at divisible
     layers and some at non-divisible layers. Those layers would then miss each
     other. */
-    size_t min_layer = mesh.getSettingAsCount("bottom_layers") + amount - 1;
+    size_t min_layer = mesh.layer_settings.bottom_layers + amount - 1;
     min_layer -= min_layer % amount; //Round upwards to the nearest layer divisible by infill_sparse_combine.
-    size_t max_layer = mesh.layers.size() - 1 - mesh.getSettingAsCount("top_layers");
+    size_t max_layer = mesh.layers.size() - 1 - mesh.layer_settings.top_layers;
     max_layer -= max_layer % amount; //Round downwards to the nearest layer divisible by infill_sparse_combine.
-    for(size_t layer_idx = min_layer;layer_idx <= max_layer;layer_idx += amount) //Skip every few layers, but extrude more.
+    if (max_layer < min_layer)
+    {
+        return;
+    }
+    // Each group consists of a combining layer and the amount - 1 layers below it, down to the previous combining layer (exclusive),
+    // so the groups don't share any layers and can be processed in parallel.
+    const int group_count = (max_layer - min_layer) / amount + 1;
+    ThreadPool::parallelFor(0, group_count, [&](int group_idx) //Skip every few layers, but extrude more.
     {
+        const size_t layer_idx = min_layer + group_idx * amount;
         SliceLayer* layer = &mesh.layers[layer_idx];
         for(unsigned int combine_count_here = 1; combine_count_here < amount; combine_count_here++)
         {
@@ -403,7 +525,7 @@ void combineInfillLayers(SliceMeshStorage& mesh, unsigned int amount)
                 }
             }
         }
-    }
+    });
 }
 
 
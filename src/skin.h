@@ -2,10 +2,78 @@
 #ifndef SKIN_H
 #define SKIN_H
 
+#include <memory> // unique_ptr
+#include <mutex>
+#include <vector>
+
 #include "sliceDataStorage.h"
 
 namespace cura 
 {
+
+/*!
+ * The intersections of the areas inside the walls of windows of consecutive layers of a mesh.
+ *
+ * When the skin of each layer is computed separately, the areas of the layers below and above it are intersected over and over again,
+ * because the windows of neighbouring layers mostly overlap.
+ * Instead the layers are divided into blocks as long as the window, and for each block the intersections from its first layer
+ * up to each of its layers (heads) and from each of its layers up to its last layer (tails) are kept.
+ * Any window is the tail of one block intersected with the head of the next block,
+ * which takes one intersection per window plus on average two per layer, regardless of the number of skin layers.
+ *
+ * The areas are those of all parts of a layer, rather than only those of the parts near the part of which the skin is computed.
+ * The areas of the other parts don't overlap the part, so this doesn't change the skin;
+ * it only changes the order of the intersections, and thereby the rounding of their vertices.
+ *
+ * Windows can be requested from multiple threads at once, as long as the walls of all layers in a window have been generated.
+ */
+class SkinLayerWindowIntersections
+{
+public:
+    /*!
+     * \param mesh The mesh of which to intersect the areas inside the walls
+     * \param window_size The number of consecutive layers to intersect
+     * \param wall_line_count The number of walls, i.e. the number of the wall of which to take the inside
+     */
+    SkinLayerWindowIntersections(const SliceMeshStorage& mesh, int window_size, int wall_line_count);
+
+    /*!
+     * Get the intersection of the areas inside the walls of the layers from \p first_layer_nr up to \p first_layer_nr + window_size.
+     *
+     * \param first_layer_nr The lowest layer of the window
+     * \param near Only the polygons of the intersection of which the bounding box hits this box are returned
+     * \return The polygons of the intersection near \p near
+     */
+    Polygons getIntersection(int first_layer_nr, const AABB& near);
+
+private:
+    struct Block
+    {
+        std::mutex mutex; //!< Guards the heads and tails of this block
+        std::vector<Polygons> heads; //!< The intersection of the first layers of the block, as far as they have been computed
+        std::vector<Polygons> tails; //!< The intersection of the last layers of the block, once computed
+    };
+
+    const SliceMeshStorage& mesh;
+    const int window_size;
+    const int wall_line_count;
+    std::unique_ptr<Block[]> blocks;
+
+    /*!
+     * Get the areas inside the walls of all parts of a layer.
+     */
+    Polygons getInside(int layer_nr) const;
+
+    /*!
+     * Get the intersection of the first layers of a block, up to and including \p last_layer_nr.
+     */
+    Polygons getHead(int block_idx, int last_layer_nr);
+
+    /*!
+     * Get the intersection of the last layers of a block, from \p first_layer_nr.
+     */
+    Polygons getTail(int block_idx, int first_layer_nr);
+};
 /*!
  * Generate the skin areas and its insets.
  * 
@@ -17,8 +85,10 @@ namespace cura
  * \param wall_line_width_x The line width of the inner most wall
  * \param insetCount The number of perimeters to surround the skin
  * \param no_small_gaps_heuristic A heuristic which assumes there will be no small gaps between bottom and top skin with a z size smaller than the skin size itself
+ * \param down_windows If given, the intersections of the \p downSkinCount layers below a layer are taken from here. See \ref generateSkinAreas
+ * \param up_windows If given, the intersections of the \p upSkinCount layers above a layer are taken from here
  */
-void generateSkins(int layerNr, SliceMeshStorage& mesh, int downSkinCount, int upSkinCount, int wall_line_count, int wall_line_width_x, int insetCount, bool no_small_gaps_heuristic);
+void generateSkins(int layerNr, SliceMeshStorage& mesh, int downSkinCount, int upSkinCount, int wall_line_count, int wall_line_width_x, int insetCount, bool no_small_gaps_heuristic, SkinLayerWindowIntersections* down_windows = nullptr, SkinLayerWindowIntersections* up_windows = nullptr);
 
 /*!
  * Generate the skin areas (outlines)
@@ -35,8 +105,13 @@ void generateSkins(int layerNr, SliceMeshStorage& mesh, int downSkinCount, int u
  * \param no_small_gaps_heuristic A heuristic which assumes there will be no
  * small gaps between bottom and top skin with a z size smaller than the skin
  * size itself.
+ * \param down_windows If given, the intersections of the \p downSkinCount layers
+ * below a layer are taken from here instead of intersecting the layers for each
+ * part. Not used with \p no_small_gaps_heuristic.
+ * \param up_windows If given, the intersections of the \p upSkinCount layers
+ * above a layer are taken from here.
  */
-void generateSkinAreas(int layerNr, SliceMeshStorage& mesh, const int innermost_wall_line_width, int downSkinCount, int upSkinCount, int wall_line_count, bool no_small_gaps_heuristic);
+void generateSkinAreas(int layerNr, SliceMeshStorage& mesh, const int innermost_wall_line_width, int downSkinCount, int upSkinCount, int wall_line_count, bool no_small_gaps_heuristic, SkinLayerWindowIntersections* down_windows = nullptr, SkinLayerWindowIntersections* up_windows = nullptr);
 
 /*!
  * Generate the skin insets.
@@ -92,10 +167,14 @@ public:
      * This function also guarantees that the SliceLayerPart::infill_area_per_combine_per_density is initialized with at least one item.
      * The last item in the list will be equal to the infill_area after this function.
      * 
-     * \param gradual_infill_step_height // The height difference between consecutive density infill areas
+     * The layers of which the geometry is compressed are skipped, since their areas have been finished already.
+     * 
+     * \param gradual_infill_step_layer_count The difference in layer count between consecutive density infill areas
      * \param max_infill_steps the maximum exponent of division of infill density. At 5 the least dense infill will be 2^4 * infill_line_distance i.e. one 16th as dense
+     * \param start_layer_nr The lowest layer of which to generate the infill areas
+     * \param end_layer_nr The layer above the highest layer of which to generate the infill areas
      */
-    static void generateGradualInfill(SliceMeshStorage& mesh, unsigned int gradual_infill_step_height, unsigned int max_infill_steps);
+    static void generateGradualInfill(SliceMeshStorage& mesh, unsigned int gradual_infill_step_layer_count, unsigned int max_infill_steps, int start_layer_nr, int end_layer_nr);
     
 };
 
@@ -3,8 +3,16 @@
 
 #include "sliceDataStorage.h"
 
+#include <algorithm> // max
+#include <cassert>
+#include <cstdlib> // exit
+#include <limits>
+
 #include "FffProcessor.h" //To create a mesh group with if none is provided.
 #include "infill/SubDivCube.h" // For the destructor
+#include "settings/SettingsTrace.h"
+#include "utils/CompressedGeometry.h"
+#include "utils/ThreadPool.h"
 
 
 namespace cura
@@ -27,6 +35,165 @@ const Polygons& SliceLayerPart::getOwnInfillArea() const
     }
 }
 
+void SliceLayerPart::compressGeometry()
+{
+    if (!compressed_geometry.empty())
+    {
+        return;
+    }
+    CompressedGeometryWriter writer(compressed_geometry);
+    writeGeometry(writer);
+    compressed_geometry.shrink_to_fit();
+
+    outline = PolygonsPart();
+    std::vector<Polygons>().swap(insets);
+    perimeter_gaps = Polygons();
+    std::vector<SkinPart>().swap(skin_parts);
+    infill_area = Polygons();
+    infill_area_own = nullptr;
+    std::vector<std::vector<Polygons>>().swap(infill_area_per_combine_per_density);
+    std::vector<std::pair<Polygons, double>>().swap(spaghetti_infill_volumes);
+}
+
+void SliceLayerPart::decompressGeometry()
+{
+    if (compressed_geometry.empty())
+    {
+        return;
+    }
+    CompressedGeometryReader reader(compressed_geometry);
+    readGeometry(reader);
+    assert(reader.atEnd());
+    std::vector<uint8_t>().swap(compressed_geometry);
+}
+
+void SliceLayerPart::writeGeometry(CompressedGeometryWriter& writer) const
+{
+    writer.writePolygons(outline);
+    writer.writeUnsigned(insets.size());
+    for (const Polygons& inset : insets)
+    {
+        writer.writePolygons(inset);
+    }
+    writer.writePolygons(perimeter_gaps);
+    writer.writeUnsigned(skin_parts.size());
+    for (const SkinPart& skin_part : skin_parts)
+    {
+        writer.writePolygons(skin_part.outline);
+        writer.writeUnsigned(skin_part.insets.size());
+        for (const Polygons& inset : skin_part.insets)
+        {
+            writer.writePolygons(inset);
+        }
+        writer.writePolygons(skin_part.perimeter_gaps);
+        writer.writeSigned(skin_part.bridge_angle);
+    }
+    writer.writePolygons(infill_area);
+    writer.writeUnsigned(infill_area_own ? 1 : 0);
+    if (infill_area_own)
+    {
+        writer.writePolygons(*infill_area_own);
+    }
+    writer.writeUnsigned(infill_area_per_combine_per_density.size());
+    for (const std::vector<Polygons>& infill_area_per_combine : infill_area_per_combine_per_density)
+    {
+        writer.writeUnsigned(infill_area_per_combine.size());
+        for (const Polygons& infill_area : infill_area_per_combine)
+        {
+            writer.writePolygons(infill_area);
+        }
+    }
+    writer.writeUnsigned(spaghetti_infill_volumes.size());
+    for (const std::pair<Polygons, double>& volume : spaghetti_infill_volumes)
+    {
+        writer.writePolygons(volume.first);
+        writer.writeDouble(volume.second);
+    }
+}
+
+void SliceLayerPart::readGeometry(CompressedGeometryReader& reader)
+{
+    reader.readPolygons(outline);
+    insets.resize(reader.readUnsigned());
+    for (Polygons& inset : insets)
+    {
+        reader.readPolygons(inset);
+    }
+    reader.readPolygons(perimeter_gaps);
+    skin_parts.resize(reader.readUnsigned());
+    for (SkinPart& skin_part : skin_parts)
+    {
+        reader.readPolygons(skin_part.outline);
+        skin_part.insets.resize(reader.readUnsigned());
+        for (Polygons& inset : skin_part.insets)
+        {
+            reader.readPolygons(inset);
+        }
+        reader.readPolygons(skin_part.perimeter_gaps);
+        skin_part.bridge_angle = reader.readSigned();
+    }
+    reader.readPolygons(infill_area);
+    if (reader.readUnsigned())
+    {
+        infill_area_own.emplace();
+        reader.readPolygons(*infill_area_own);
+    }
+    infill_area_per_combine_per_density.resize(reader.readUnsigned());
+    for (std::vector<Polygons>& infill_area_per_combine : infill_area_per_combine_per_density)
+    {
+        infill_area_per_combine.resize(reader.readUnsigned());
+        for (Polygons& infill_area : infill_area_per_combine)
+        {
+            reader.readPolygons(infill_area);
+        }
+    }
+    spaghetti_infill_volumes.resize(reader.readUnsigned());
+    for (std::pair<Polygons, double>& volume : spaghetti_infill_volumes)
+    {
+        reader.readPolygons(volume.first);
+        volume.second = reader.readDouble();
+    }
+}
+
+void SliceLayerPart::translate(Point translation)
+{
+    assert(compressed_geometry.empty());
+    boundaryBox.min += translation;
+    boundaryBox.max += translation;
+    outline.translate(translation);
+    print_outline.translate(translation);
+    for (Polygons& inset : insets)
+    {
+        inset.translate(translation);
+    }
+    perimeter_gaps.translate(translation);
+    for (SkinPart& skin_part : skin_parts)
+    {
+        skin_part.outline.translate(translation);
+        for (Polygons& inset : skin_part.insets)
+        {
+            inset.translate(translation);
+        }
+        skin_part.perimeter_gaps.translate(translation);
+    }
+    infill_area.translate(translation);
+    if (infill_area_own)
+    {
+        infill_area_own->translate(translation);
+    }
+    for (std::vector<Polygons>& infill_area_per_combine : infill_area_per_combine_per_density)
+    {
+        for (Polygons& infill_area : infill_area_per_combine)
+        {
+            infill_area.translate(translation);
+        }
+    }
+    for (std::pair<Polygons, double>& volume : spaghetti_infill_volumes)
+    {
+        volume.first.translate(translation);
+    }
+}
+
 Polygons SliceLayer::getOutlines(bool external_polys_only) const
 {
     Polygons ret;
@@ -44,7 +211,7 @@ void SliceLayer::getOutlines(Polygons& result, bool external_polys_only) const
         }
         else 
         {
-            result.add(part.print_outline);
+            part.print_outline.addTo(result);
         }
     }
 }
@@ -85,6 +252,79 @@ SliceMeshStorage::~SliceMeshStorage()
     }
 }
 
+void SliceMeshStorage::translate(Point translation)
+{
+    ThreadPool::parallelFor(0, static_cast<int>(layers.size()), [&](int layer_nr)
+    {
+        SliceLayer& layer = layers[layer_nr];
+        for (SliceLayerPart& part : layer.parts)
+        {
+            part.translate(translation);
+        }
+        layer.openPolyLines.translate(translation);
+    });
+}
+
+void SliceMeshStorage::resolveLayerSettings(const SliceDataStorage& storage)
+{
+    SettingsTrace::Stage trace_stage("layer_settings"); // these are read again whenever any of the stages using them is generated again
+    layer_settings.surface_mode = getSettingAsSurfaceMode("magic_mesh_surface_mode");
+    layer_settings.wall_line_count = getSettingAsCount("wall_line_count");
+    layer_settings.wall_line_width_0 = getSettingInMicrons("wall_line_width_0");
+    layer_settings.wall_line_width_x = getSettingInMicrons("wall_line_width_x");
+    layer_settings.wall_0_inset = getSettingInMicrons("wall_0_inset");
+    layer_settings.alternate_extra_perimeter = getSettingBoolean("alternate_extra_perimeter");
+    layer_settings.recompute_outline_based_on_outer_wall = getSettingBoolean("support_enable");
+    layer_settings.bottom_layers = storage.convertLayerCount(getSettingAsCount("bottom_layers"));
+    layer_settings.top_layers = storage.convertLayerCount(getSettingAsCount("top_layers"));
+    layer_settings.skin_outline_count = getSettingAsCount("skin_outline_count");
+    layer_settings.skin_no_small_gaps_heuristic = getSettingBoolean("skin_no_small_gaps_heuristic");
+    layer_settings.skin_sliding_window = hasSetting("skin_sliding_window") && getSettingBoolean("skin_sliding_window");
+    layer_settings.min_infill_area = 0;
+    layer_settings.expand_skins_expand_distance = 0;
+    layer_settings.min_skin_width_for_expansion = 0;
+    layer_settings.expand_upper_skins = false;
+    layer_settings.expand_lower_skins = false;
+    if (layer_settings.bottom_layers != 0 || layer_settings.top_layers != 0)
+    { // only needed when there is skin
+        layer_settings.min_infill_area = getSettingInMillimeters("min_infill_area");
+        layer_settings.expand_skins_expand_distance = getSettingInMicrons("expand_skins_expand_distance");
+        if (layer_settings.expand_skins_expand_distance > 0)
+        {
+            layer_settings.min_skin_width_for_expansion = getSettingInMicrons("min_skin_width_for_expansion");
+            layer_settings.expand_upper_skins = getSettingBoolean("expand_upper_skins");
+            layer_settings.expand_lower_skins = getSettingBoolean("expand_lower_skins");
+        }
+    }
+    layer_settings.infill_pattern = getSettingAsFillMethod("infill_pattern");
+    layer_settings.infill_line_distance = getSettingInMicrons("infill_line_distance");
+    layer_settings.infill_line_width = getSettingInMicrons("infill_line_width");
+    layer_settings.infill_hollow = getSettingBoolean("infill_hollow");
+    layer_settings.combined_infill_layers = std::max(coord_t(1), (getSettingInMicrons("infill_sparse_thickness") + storage.getMaxLayerThickness() / 2) / storage.getMaxLayerThickness());
+    layer_settings.gradual_infill_step_layer_count = (getSettingInMicrons("gradual_infill_step_height") + storage.getMinLayerThickness() / 2) / storage.getMinLayerThickness();
+}
+
+void SliceMeshStorage::clearSkinAndInfillAreas()
+{
+    for (SliceLayer& layer : layers)
+    {
+        for (SliceLayerPart& part : layer.parts)
+        {
+            part.perimeter_gaps.clear();
+            part.skin_parts.clear();
+            part.infill_area.clear();
+            part.infill_area_own = nullptr;
+            part.infill_area_per_combine_per_density.clear();
+            part.spaghetti_infill_volumes.clear();
+        }
+    }
+    infill_angles.clear();
+    skin_angles.clear();
+    delete base_subdiv_cube;
+    base_subdiv_cube = nullptr;
+    infill_cache = std::make_shared<InfillCache>();
+}
+
 bool SliceMeshStorage::getExtruderIsUsed(int extruder_nr) const
 {
     if (getSettingBoolean("magic_spiralize"))
@@ -119,6 +359,19 @@ bool SliceMeshStorage::getExtruderIsUsed(int extruder_nr) const
 }
 
 bool SliceMeshStorage::getExtruderIsUsed(int extruder_nr, int layer_nr) const
+{
+    if (layer_nr < 0 || layer_nr >= static_cast<int>(layers.size()))
+    {
+        return false;
+    }
+    if (layer_nr < static_cast<int>(extruders_used_per_layer.size()))
+    {
+        return extruders_used_per_layer[layer_nr][extruder_nr];
+    }
+    return computeExtruderIsUsed(extruder_nr, layer_nr);
+}
+
+bool SliceMeshStorage::computeExtruderIsUsed(int extruder_nr, int layer_nr) const
 {
     if (layer_nr < 0 || layer_nr >= static_cast<int>(layers.size()))
     {
@@ -130,6 +383,10 @@ bool SliceMeshStorage::getExtruderIsUsed(int extruder_nr, int layer_nr) const
         return false;
     }
     const SliceLayer& layer = layers[layer_nr];
+    if (layer.geometry_compressed)
+    {
+        return layer.extruders_used_while_compressed[extruder_nr];
+    }
     if (getSettingAsCount("wall_line_count") > 0 && getSettingAsExtruderNr("wall_0_extruder_nr") == extruder_nr)
     {
         for (const SliceLayerPart& part : layer.parts)
@@ -205,10 +462,41 @@ SliceDataStorage::SliceDataStorage(MeshGroup* meshgroup) : SettingsMessenger(mes
     retraction_config_per_extruder(initializeRetractionConfigs()),
     extruder_switch_retraction_config_per_extruder(initializeRetractionConfigs()),
     max_print_height_second_to_last_extruder(-1),
-    primeTower(*this)
+    primeTower(*this),
+    extruders_used_first_layer_nr(0),
+    removed_empty_first_layer_count(0),
+    keep_layer_geometry(false)
 {
 }
 
+coord_t SliceDataStorage::getMinLayerThickness() const
+{
+    if (layer_thicknesses.size() < 2)
+    {
+        return std::max(coord_t(1), getSettingInMicrons("layer_height"));
+    }
+    return std::max(coord_t(1), *std::min_element(layer_thicknesses.begin() + 1, layer_thicknesses.end())); // the first layer is never adapted
+}
+
+coord_t SliceDataStorage::getMaxLayerThickness() const
+{
+    if (layer_thicknesses.size() < 2)
+    {
+        return std::max(coord_t(1), getSettingInMicrons("layer_height"));
+    }
+    return std::max(coord_t(1), *std::max_element(layer_thicknesses.begin() + 1, layer_thicknesses.end()));
+}
+
+int SliceDataStorage::convertLayerCount(int layer_count) const
+{
+    if (layer_count <= 0)
+    {
+        return layer_count;
+    }
+    const coord_t min_layer_thickness = getMinLayerThickness();
+    return (layer_count * getSettingInMicrons("layer_height") + min_layer_thickness / 2) / min_layer_thickness; // rounded to the nearest number of layers
+}
+
 Polygons SliceDataStorage::getLayerOutlines(int layer_nr, bool include_helper_parts, bool external_polys_only) const
 {
     if (layer_nr < 0 && layer_nr < -Raft::getFillerLayerCount(*this))
@@ -271,6 +559,64 @@ Polygons SliceDataStorage::getLayerOutlines(int layer_nr, bool include_helper_pa
     }
 }
 
+const Polygons& SliceDataStorage::getLayerOutlinesCached(int layer_nr, bool include_helper_parts, bool external_polys_only, coord_t offset) const
+{
+    if (!include_helper_parts && !external_polys_only && offset == 0 && layer_nr >= 0 && layer_nr < static_cast<int>(precomputed_layer_outlines.size()))
+    {
+        return precomputed_layer_outlines[layer_nr];
+    }
+    const LayerOutlinesKey key(layer_nr, include_helper_parts, external_polys_only, offset);
+    {
+        std::lock_guard<std::mutex> lock(layer_outlines_cache_mutex);
+        auto cached = layer_outlines_cache.find(key);
+        if (cached != layer_outlines_cache.end())
+        {
+            return cached->second;
+        }
+    }
+    // compute outside of the lock, so that other layers can be computed in parallel;
+    // if another thread computed the same outlines in the mean time, those are kept and these are discarded
+    Polygons outlines = (offset == 0) ? getLayerOutlines(layer_nr, include_helper_parts, external_polys_only) : getLayerOutlinesCached(layer_nr, include_helper_parts, external_polys_only).offset(offset);
+    std::lock_guard<std::mutex> lock(layer_outlines_cache_mutex);
+    return layer_outlines_cache.emplace(key, std::move(outlines)).first->second;
+}
+
+const Polygons& SliceDataStorage::getLayerGeometryCached(int layer_nr, const std::string& kind, const std::function<Polygons ()>& compute) const
+{
+    std::pair<int, std::string> key(layer_nr, kind);
+    {
+        std::lock_guard<std::mutex> lock(layer_outlines_cache_mutex);
+        auto cached = layer_geometry_cache.find(key);
+        if (cached != layer_geometry_cache.end())
+        {
+            return cached->second;
+        }
+    }
+    // computed outside of the lock, like the outlines
+    Polygons geometry = compute();
+    std::lock_guard<std::mutex> lock(layer_outlines_cache_mutex);
+    return layer_geometry_cache.emplace(std::move(key), std::move(geometry)).first->second;
+}
+
+void SliceDataStorage::invalidateLayerOutlinesCache()
+{
+    layer_outlines_cache.clear();
+    layer_geometry_cache.clear();
+    precomputed_layer_outlines.clear();
+}
+
+void SliceDataStorage::precomputeLayerOutlines()
+{
+    invalidateLayerOutlinesCache();
+    std::vector<Polygons> outlines(print_layer_count);
+    const int layer_count = print_layer_count;
+    ThreadPool::parallelFor(0, layer_count, [&](int layer_nr)
+    {
+        outlines[layer_nr] = getLayerOutlines(layer_nr, false);
+    });
+    precomputed_layer_outlines.swap(outlines);
+}
+
 Polygons SliceDataStorage::getLayerSecondOrInnermostWalls(int layer_nr, bool include_helper_parts) const
 {
     if (layer_nr < 0 && layer_nr < -Raft::getFillerLayerCount(*this))
@@ -362,7 +708,7 @@ std::vector<bool> SliceDataStorage::getExtrudersUsed() const
     // all meshes are presupposed to actually have content
     for (const SliceMeshStorage& mesh : meshes)
     {
-        for (unsigned int extruder_nr = 0; extruder_nr <= ret.size(); extruder_nr++)
+        for (unsigned int extruder_nr = 0; extruder_nr < ret.size(); extruder_nr++)
         {
             ret[extruder_nr] = ret[extruder_nr] || mesh.getExtruderIsUsed(extruder_nr);
         }
@@ -372,6 +718,17 @@ std::vector<bool> SliceDataStorage::getExtrudersUsed() const
 
 std::vector<bool> SliceDataStorage::getExtrudersUsed(int layer_nr) const
 {
+    const int layer_idx = layer_nr - extruders_used_first_layer_nr;
+    if (layer_idx >= 0 && layer_idx < static_cast<int>(extruders_used_per_layer.size()))
+    {
+        const std::bitset<MAX_EXTRUDERS>& extruders_used = extruders_used_per_layer[layer_idx];
+        std::vector<bool> ret(meshgroup->getExtruderCount());
+        for (unsigned int extruder_nr = 0; extruder_nr < ret.size(); extruder_nr++)
+        {
+            ret[extruder_nr] = extruders_used[extruder_nr];
+        }
+        return ret;
+    }
 
     std::vector<bool> ret;
     ret.resize(meshgroup->getExtruderCount(), false);
@@ -449,7 +806,7 @@ std::vector<bool> SliceDataStorage::getExtrudersUsed(int layer_nr) const
     {
         for (const SliceMeshStorage& mesh : meshes)
         {
-            for (unsigned int extruder_nr = 0; extruder_nr <= ret.size(); extruder_nr++)
+            for (unsigned int extruder_nr = 0; extruder_nr < ret.size(); extruder_nr++)
             {
                 ret[extruder_nr] = ret[extruder_nr] || mesh.getExtruderIsUsed(extruder_nr, layer_nr);
             }
@@ -458,6 +815,43 @@ std::vector<bool> SliceDataStorage::getExtrudersUsed(int layer_nr) const
     return ret;
 }
 
+void SliceDataStorage::computeExtrudersUsedPerLayer()
+{
+    const int extruder_count = meshgroup->getExtruderCount();
+    const int first_layer_nr = -Raft::getTotalExtraLayers(*this);
+    int end_layer_nr = print_layer_count;
+    for (SliceMeshStorage& mesh : meshes)
+    {
+        mesh.extruders_used_per_layer.assign(mesh.layers.size(), std::bitset<MAX_EXTRUDERS>());
+        end_layer_nr = std::max(end_layer_nr, static_cast<int>(mesh.layers.size()));
+    }
+    extruders_used_per_layer.clear(); // so that the layers are checked rather than looked up below
+    std::vector<std::bitset<MAX_EXTRUDERS>> extruders_used(print_layer_count - first_layer_nr);
+    ThreadPool::parallelFor(first_layer_nr, end_layer_nr, [&](int layer_nr)
+    {
+        for (SliceMeshStorage& mesh : meshes)
+        {
+            if (layer_nr >= 0 && layer_nr < static_cast<int>(mesh.layers.size()))
+            {
+                for (int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
+                {
+                    mesh.extruders_used_per_layer[layer_nr][extruder_nr] = mesh.computeExtruderIsUsed(extruder_nr, layer_nr);
+                }
+            }
+        }
+        if (layer_nr < static_cast<int>(print_layer_count))
+        { // looks up the meshes on this layer, which have just been computed
+            const std::vector<bool> used = getExtrudersUsed(layer_nr);
+            for (int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
+            {
+                extruders_used[layer_nr - first_layer_nr][extruder_nr] = used[extruder_nr];
+            }
+        }
+    });
+    extruders_used_first_layer_nr = first_layer_nr;
+    extruders_used_per_layer.swap(extruders_used);
+}
+
 bool SliceDataStorage::getExtruderPrimeBlobEnabled(int extruder_nr) const
 {
     if (extruder_nr >= meshgroup->getExtruderCount())
@@ -469,4 +863,248 @@ bool SliceDataStorage::getExtruderPrimeBlobEnabled(int extruder_nr) const
     return train->getSettingBoolean("prime_blob_enable");
 }
 
+void SliceDataStorage::releaseLayerGeometry(int layer_nr)
+{
+    if (keep_layer_geometry)
+    {
+        return;
+    }
+    for (SliceMeshStorage& mesh : meshes)
+    {
+        if (layer_nr < 0 || layer_nr >= static_cast<int>(mesh.layers.size()))
+        {
+            continue;
+        }
+        SliceLayer& layer = mesh.layers[layer_nr];
+        std::vector<SliceLayerPart>().swap(layer.parts);
+        layer.openPolyLines = Polygons();
+    }
+    if (layer_nr >= 0 && layer_nr < static_cast<int>(support.supportLayers.size()))
+    {
+        support.supportLayers[layer_nr] = SupportLayer();
+    }
+    if (layer_nr >= 0 && layer_nr < static_cast<int>(precomputed_layer_outlines.size()))
+    {
+        precomputed_layer_outlines[layer_nr] = Polygons();
+    }
+    std::lock_guard<std::mutex> lock(layer_outlines_cache_mutex);
+    layer_outlines_cache.erase(layer_outlines_cache.lower_bound(LayerOutlinesKey(layer_nr, false, false, std::numeric_limits<coord_t>::min())), layer_outlines_cache.lower_bound(LayerOutlinesKey(layer_nr + 1, false, false, std::numeric_limits<coord_t>::min())));
+}
+
+void SliceDataStorage::compressLayerGeometry(int layer_nr)
+{
+    for (SliceMeshStorage& mesh : meshes)
+    {
+        compressLayerGeometry(mesh, layer_nr);
+    }
+}
+
+void SliceDataStorage::compressLayerGeometry(SliceMeshStorage& mesh, int layer_nr)
+{
+    if (layer_nr < 0 || layer_nr >= static_cast<int>(mesh.layers.size()) || mesh.layers[layer_nr].geometry_compressed)
+    {
+        return;
+    }
+    SliceLayer& layer = mesh.layers[layer_nr];
+    const int extruder_count = meshgroup->getExtruderCount();
+    for (int extruder_nr = 0; extruder_nr < extruder_count; extruder_nr++)
+    {
+        layer.extruders_used_while_compressed[extruder_nr] = mesh.computeExtruderIsUsed(extruder_nr, layer_nr);
+    }
+    uint64_t layer_bytes = 0;
+    for (SliceLayerPart& part : layer.parts)
+    {
+        part.compressGeometry();
+        layer_bytes += part.compressed_geometry.size();
+    }
+    layer.geometry_compressed = true;
+    if (layer_bytes == 0)
+    {
+        return;
+    }
+
+    // gather the layer, so that it's read back with a single read
+    std::vector<uint8_t> layer_data;
+    {
+        std::lock_guard<std::mutex> lock(layer_geometry_spill_mutex);
+        if (layer_geometry_memory_budget == 0 || kept_layer_geometry_bytes + layer_bytes <= layer_geometry_memory_budget)
+        {
+            kept_layer_geometry_bytes += layer_bytes;
+            return;
+        }
+        if (!layer_geometry_spill)
+        {
+            layer_geometry_spill.reset(new SpillFile());
+        }
+        layer_data.reserve(layer_bytes);
+        for (const SliceLayerPart& part : layer.parts)
+        {
+            layer_data.insert(layer_data.end(), part.compressed_geometry.begin(), part.compressed_geometry.end());
+        }
+        if (!layer_geometry_spill->isOpen() || !layer_geometry_spill->write(layer_data, layer.spilled_geometry.offset))
+        {
+            if (layer_geometry_spill->isOpen())
+            {
+                logWarning("Failed to write layer %d to the temporary file, so the layers from there on are kept in memory.\n", layer_nr);
+            }
+            layer_geometry_memory_budget = 0;
+            kept_layer_geometry_bytes += layer_bytes;
+            return;
+        }
+        spilled_layer_count++;
+    }
+    layer.spilled_geometry.size = layer_bytes;
+    for (SliceLayerPart& part : layer.parts)
+    {
+        layer.spilled_geometry.part_sizes.push_back(part.compressed_geometry.size());
+        std::vector<uint8_t>().swap(part.compressed_geometry);
+    }
+}
+
+void SliceDataStorage::decompressLayerGeometry(int layer_nr)
+{
+    for (SliceMeshStorage& mesh : meshes)
+    {
+        if (layer_nr < 0 || layer_nr >= static_cast<int>(mesh.layers.size()))
+        {
+            continue;
+        }
+        // the layers are decompressed about in order, so start reading the layers which will be decompressed soon
+        constexpr int prefetch_layer_count = 8;
+        const int prefetch_layer_nr = layer_nr + prefetch_layer_count;
+        if (layer_geometry_spill && prefetch_layer_nr < static_cast<int>(mesh.layers.size()))
+        {
+            // only the offset and size, since the part sizes may be in use by the thread decompressing that layer
+            const SliceLayer::SpilledGeometry& prefetched = mesh.layers[prefetch_layer_nr].spilled_geometry;
+            layer_geometry_spill->prefetch(prefetched.offset, prefetched.size);
+        }
+
+        SliceLayer& layer = mesh.layers[layer_nr];
+        if (!layer.spilled_geometry.part_sizes.empty())
+        {
+            std::vector<uint64_t>::const_iterator part_size = layer.spilled_geometry.part_sizes.begin();
+            uint64_t offset = layer.spilled_geometry.offset;
+            for (SliceLayerPart& part : layer.parts)
+            {
+                if (!layer_geometry_spill->read(offset, *part_size, part.compressed_geometry))
+                {
+                    logError("Failed to read layer %d back from the temporary file.\n", layer_nr);
+                    std::exit(1);
+                }
+                offset += *part_size;
+                ++part_size;
+            }
+            std::vector<uint64_t>().swap(layer.spilled_geometry.part_sizes);
+        }
+        for (SliceLayerPart& part : layer.parts)
+        {
+            part.decompressGeometry();
+        }
+        layer.geometry_compressed = false;
+    }
+}
+
+void SliceDataStorage::decompressAllLayerGeometry()
+{
+    int layer_count = 0;
+    for (const SliceMeshStorage& mesh : meshes)
+    {
+        layer_count = std::max(layer_count, static_cast<int>(mesh.layers.size()));
+    }
+    ThreadPool::parallelFor(0, layer_count, [this](int layer_nr)
+    {
+        decompressLayerGeometry(layer_nr);
+    });
+    for (SliceMeshStorage& mesh : meshes)
+    {
+        for (SliceLayer& layer : mesh.layers)
+        {
+            layer.spilled_geometry = SliceLayer::SpilledGeometry();
+        }
+    }
+    layer_geometry_spill.reset(); // all layers have been read back from it
+    layer_geometry_memory_budget = 0;
+    kept_layer_geometry_bytes = 0;
+    spilled_layer_count = 0;
+}
+
+void SliceDataStorage::getCompressedGeometry(const SliceLayer& layer, size_t part_idx, std::vector<uint8_t>& compressed_geometry) const
+{
+    const SliceLayer::SpilledGeometry& spilled = layer.spilled_geometry;
+    if (spilled.part_sizes.empty())
+    {
+        compressed_geometry = layer.parts[part_idx].compressed_geometry;
+        return;
+    }
+    uint64_t offset = spilled.offset;
+    for (size_t previous_part_idx = 0; previous_part_idx < part_idx; previous_part_idx++)
+    {
+        offset += spilled.part_sizes[previous_part_idx];
+    }
+    if (!layer_geometry_spill->read(offset, spilled.part_sizes[part_idx], compressed_geometry))
+    {
+        logError("Failed to read a layer back from the temporary file.\n");
+        std::exit(1);
+    }
+}
+
+void SliceDataStorage::startSpillingLayerGeometry(uint64_t memory_budget)
+{
+    std::lock_guard<std::mutex> lock(layer_geometry_spill_mutex);
+    layer_geometry_memory_budget = memory_budget;
+}
+
+void SliceDataStorage::finishSpillingLayerGeometry()
+{
+    std::lock_guard<std::mutex> lock(layer_geometry_spill_mutex);
+    layer_geometry_memory_budget = 0;
+    if (!layer_geometry_spill || !layer_geometry_spill->isOpen())
+    {
+        return;
+    }
+    layer_geometry_spill->finishWriting();
+    log("Moved %d layers of the meshes to a temporary file of %llu bytes.\n", spilled_layer_count, static_cast<unsigned long long>(layer_geometry_spill->size()));
+}
+
+void SliceDataStorage::setMeshGroup(MeshGroup* meshgroup)
+{
+    assert(meshgroup->meshes.size() == meshes.size());
+    this->meshgroup = meshgroup;
+    setParent(meshgroup);
+    for (unsigned int mesh_idx = 0; mesh_idx < meshes.size(); mesh_idx++)
+    {
+        meshes[mesh_idx].setParent(&meshgroup->meshes[mesh_idx]);
+    }
+    retraction_config_per_extruder = initializeRetractionConfigs();
+    extruder_switch_retraction_config_per_extruder = initializeRetractionConfigs();
+    coasting_config.clear();
+}
+
+void SliceDataStorage::clearSupportAreas()
+{
+    support = SupportStorage();
+    support.supportLayers.resize(print_layer_count);
+}
+
+void SliceDataStorage::clearHelperAreas()
+{
+    max_print_height_per_extruder.clear();
+    max_print_height_order.clear();
+    max_print_height_second_to_last_extruder = -1;
+    primeTower = PrimeTower(*this);
+    oozeShield.clear();
+    draft_protection_shield.clear();
+    for (Polygons& skirt_brim_polygons : skirt_brim)
+    {
+        skirt_brim_polygons.clear();
+    }
+    raftOutline.clear();
+    extruders_used_per_layer.clear();
+    for (SliceMeshStorage& mesh : meshes)
+    {
+        mesh.extruders_used_per_layer.clear();
+    }
+    invalidateLayerOutlinesCache();
+}
+
 } // namespace cura
\ No newline at end of file
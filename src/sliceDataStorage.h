@@ -5,18 +5,34 @@
 #ifndef SLICE_DATA_STORAGE_H
 #define SLICE_DATA_STORAGE_H
 
+#include <bitset>
+#include <functional>
+#include <map>
+#include <memory> // shared_ptr
+#include <mutex>
+#include <tuple>
+
 #include "utils/intpoint.h"
 #include "utils/optional.h"
 #include "utils/polygon.h"
 #include "utils/NoCopy.h"
 #include "utils/AABB.h"
+#include "utils/CompactPolygons.h"
+#include "utils/SpillFile.h"
 #include "mesh.h"
 #include "MeshGroup.h"
 #include "PrimeTower.h"
 #include "gcodeExport.h" // CoastingConfig
+#include "infill/InfillCache.h"
+#include "settings/PathConfigStorage.h"
 
 namespace cura 
 {
+
+class CompressedGeometryReader;
+class CompressedGeometryWriter;
+class SliceDataStorage;
+
 /*!
  * A SkinPart is a connected area designated as top and/or bottom skin. 
  * Surrounding each non-bridged skin area with an outline may result in better top skins.
@@ -28,6 +44,7 @@ public:
     PolygonsPart outline;           //!< The skinOutline is the area which needs to be 100% filled to generate a proper top&bottom filling. It's filled by the "skin" module.
     std::vector<Polygons> insets;   //!< The skin can have perimeters so that the skin lines always start at a perimeter instead of in the middle of an infill cell.
     Polygons perimeter_gaps; //!< The gaps between the extra skin walls and gaps between the outer skin wall and the inner part inset
+    int bridge_angle = -1; //!< The angle of the lines bridging the skin between the two largest areas it rests on, or -1 if it isn't bridging. See bridgeAngle.
 };
 /*!
     The SliceLayerPart is a single enclosed printable area for a single layer. (Also known as islands)
@@ -39,7 +56,7 @@ class SliceLayerPart
 public:
     AABB boundaryBox;       //!< The boundaryBox is an axis-aligned bounardy box which is used to quickly check for possible collision between different parts on different layers. It's an optimalization used during skin calculations.
     PolygonsPart outline;       //!< The outline is the first member that is filled, and it's filled with polygons that match a cross section of the 3D model. The first polygon is the outer boundary polygon and the rest are holes.
-    Polygons print_outline; //!< An approximation to the outline of what's actually printed, based on the outer wall. Too small parts will be omitted compared to the outline.
+    CompactPolygons print_outline; //!< An approximation to the outline of what's actually printed, based on the outer wall. Too small parts will be omitted compared to the outline. Only used for the outlines of the layer, so it's stored compactly.
     std::vector<Polygons> insets;         //!< The insets are generated with. The insets are also known as perimeters or the walls.
     Polygons perimeter_gaps; //!< The gaps betwee nconsecutive walls and between the inner wall and outer skin inset
     std::vector<SkinPart> skin_parts;     //!< The skin parts which are filled for 100% with lines and/or insets.
@@ -87,6 +104,50 @@ public:
     const Polygons& getOwnInfillArea() const;
 
     std::vector<std::pair<Polygons, double>> spaghetti_infill_volumes; //!< For each filling volume on this layer, the area within which to fill and the total volume to fill over the area
+
+    /*!
+     * While the geometry of this part is compressed: all areas except for the boundaryBox and the print_outline, encoded by a CompressedGeometryWriter.
+     * Empty while the geometry isn't compressed.
+     */
+    std::vector<uint8_t> compressed_geometry;
+
+    /*!
+     * Encode all areas except for the boundaryBox and the print_outline into SliceLayerPart::compressed_geometry and free them.
+     * The print_outline remains, so that the outlines of the layer can still be used by the layers around it.
+     *
+     * Does nothing if the geometry is already compressed.
+     */
+    void compressGeometry();
+
+    /*!
+     * Restore the areas encoded by SliceLayerPart::compressGeometry exactly as they were, and free the encoded data.
+     *
+     * Does nothing if the geometry isn't compressed.
+     */
+    void decompressGeometry();
+
+    /*!
+     * Encode all areas except for the boundaryBox and the print_outline, as \ref SliceLayerPart::compressGeometry does.
+     *
+     * \param writer The writer to encode the areas with
+     */
+    void writeGeometry(CompressedGeometryWriter& writer) const;
+
+    /*!
+     * Read the areas encoded by \ref SliceLayerPart::writeGeometry into this part, of which these areas must be empty.
+     *
+     * \param reader The reader positioned at the encoded areas
+     */
+    void readGeometry(CompressedGeometryReader& reader);
+
+    /*!
+     * Move all areas of this part, including the boundaryBox and the print_outline, in some direction.
+     *
+     * The geometry must not be compressed.
+     *
+     * \param translation The direction in which to move the part
+     */
+    void translate(Point translation);
 };
 
 /*!
@@ -100,6 +161,19 @@ public:
     int printZ;     //!< The height at which this layer needs to be printed. Can differ from sliceZ due to the raft.
     std::vector<SliceLayerPart> parts;  //!< An array of LayerParts which contain the actual data. The parts are printed one at a time to minimize travel outside of the 3D model.
     Polygons openPolyLines; //!< A list of lines which were never hooked up into a 2D polygon. (Currently unused in normal operation)
+    bool geometry_compressed = false; //!< Whether the geometry of the parts is compressed, see \ref SliceDataStorage::compressLayerGeometry
+    std::bitset<MAX_EXTRUDERS> extruders_used_while_compressed; //!< The extruders which print the parts, which can't be checked from their areas while these are compressed
+
+    /*!
+     * Where the compressed geometry of the parts is in the temporary file of the \ref SliceDataStorage, see \ref SliceDataStorage::startSpillingLayerGeometry
+     */
+    struct SpilledGeometry
+    {
+        uint64_t offset = 0; //!< The position in the file of the geometry of the first part
+        uint64_t size = 0; //!< The size of the geometry of all parts together
+        std::vector<uint64_t> part_sizes; //!< The size of the geometry of each part in order, or empty if the geometry isn't in the file
+    };
+    SpilledGeometry spilled_geometry; //!< Where the compressed geometry of the parts is, if it has been moved to a temporary file
 
     /*!
      * Get the all outlines of all layer parts in this layer.
@@ -133,6 +207,18 @@ public:
 };
 
 /******************/
+/*!
+ * The support infill of one island of the support areas of a layer, see \ref SupportLayer::support_infill_islands
+ */
+class SupportInfillIsland
+{
+public:
+    Polygons outline; //!< The outer polygon of the island, by which the islands are ordered
+    Polygons boundary; //!< The line printed along the inside of the island before the pattern, for the patterns which have one
+    Polygons infill_polygons; //!< The closed polygons of the infill pattern
+    Polygons infill_lines; //!< The lines of the infill pattern
+};
+
 class SupportLayer
 {
 public:
@@ -142,6 +228,13 @@ public:
     Polygons support_mesh_drop_down; //!< Areas from support meshes which should be supported by more support
     Polygons support_mesh; //!< Areas from support meshes which should NOT be supported by more support
     Polygons anti_overhang; //!< Areas where no overhang should be detected.
+
+    // The patterns with which the areas above are filled, generated for all layers before the layers are planned, see FffGcodeWriter::generateSupportPatterns
+    std::vector<SupportInfillIsland> support_infill_islands; //!< The infill of each island of supportAreas
+    Polygons support_roof_polygons; //!< The closed polygons of the pattern of support_roof
+    Polygons support_roof_lines; //!< The lines of the pattern of support_roof
+    Polygons support_bottom_polygons; //!< The closed polygons of the pattern of support_bottom
+    Polygons support_bottom_lines; //!< The lines of the pattern of support_bottom
 };
 
 class SupportStorage
@@ -164,27 +257,84 @@ public:
 
 class SubDivCube; // forward declaration to prevent dependency loop
 
+/*!
+ * The settings of a mesh which are read for every layer while generating the walls, skin and infill areas.
+ *
+ * These are resolved once by \ref SliceMeshStorage::resolveLayerSettings, so that the parallel layer loops
+ * read plain fields instead of looking up and parsing the setting strings for every layer.
+ */
+struct MeshLayerSettings
+{
+    ESurfaceMode surface_mode; //!< magic_mesh_surface_mode
+    int wall_line_count; //!< wall_line_count
+    coord_t wall_line_width_0; //!< wall_line_width_0
+    coord_t wall_line_width_x; //!< wall_line_width_x
+    coord_t wall_0_inset; //!< wall_0_inset
+    bool alternate_extra_perimeter; //!< alternate_extra_perimeter
+    bool recompute_outline_based_on_outer_wall; //!< support_enable
+    int bottom_layers; //!< bottom_layers, converted with the layer thicknesses, see \ref SliceDataStorage::convertLayerCount
+    int top_layers; //!< top_layers, converted with the layer thicknesses, see \ref SliceDataStorage::convertLayerCount
+    int skin_outline_count; //!< skin_outline_count
+    bool skin_no_small_gaps_heuristic; //!< skin_no_small_gaps_heuristic
+    bool skin_sliding_window; //!< skin_sliding_window, optional: whether to share the intersections of the layers above and below between layers, see \ref SkinLayerWindowIntersections
+    int min_infill_area; //!< min_infill_area, truncated to whole square millimeters
+    coord_t expand_skins_expand_distance; //!< expand_skins_expand_distance
+    coord_t min_skin_width_for_expansion; //!< min_skin_width_for_expansion
+    bool expand_upper_skins; //!< expand_upper_skins
+    bool expand_lower_skins; //!< expand_lower_skins
+    EFillMethod infill_pattern; //!< infill_pattern
+    coord_t infill_line_distance; //!< infill_line_distance
+    coord_t infill_line_width; //!< infill_line_width
+    bool infill_hollow; //!< infill_hollow
+    unsigned int combined_infill_layers; //!< infill_sparse_thickness as a number of layers, at least 1; counted with the thickest layers, so that the combined infill is never thicker than that
+    unsigned int gradual_infill_step_layer_count; //!< gradual_infill_step_height as a number of layers, counted with the thinnest layers, see \ref SliceDataStorage::getMinLayerThickness
+};
+
 class SliceMeshStorage : public SettingsMessenger // passes on settings from a Mesh object
 {
 public:
     std::vector<SliceLayer> layers;
 
+    MeshLayerSettings layer_settings; //!< The settings read in the per layer computations, see \ref SliceMeshStorage::resolveLayerSettings
+
     int layer_nr_max_filled_layer; //!< the layer number of the uppermost layer with content (modified while infill meshes are processed)
+    int layer_nr_min_filled_layer; //!< the layer number of the lowest layer with content after slicing, or the number of layers if there is none. The layers below it stay empty.
 
     std::vector<int> infill_angles; //!< a list of angle values (in degrees) which is cycled through to determine the infill angle of each layer
     std::vector<int> skin_angles; //!< a list of angle values (in degrees) which is cycled through to determine the skin angle of each layer
     SubDivCube* base_subdiv_cube;
+    std::shared_ptr<InfillCache> infill_cache; //!< The infill patterns most recently generated for this mesh, see \ref Infill::generate
+    std::vector<std::bitset<MAX_EXTRUDERS>> extruders_used_per_layer; //!< For each layer the extruders used by this mesh, see \ref SliceDataStorage::computeExtrudersUsedPerLayer. Empty if not computed (yet).
+    int instance_source_mesh_idx; //!< The index of the mesh of which this mesh is a horizontally moved copy, so that its walls, skin and infill are translated from that mesh rather than generated, or -1; see \ref MeshInstances
+    Point instance_offset; //!< The translation from the mesh with index \ref SliceMeshStorage::instance_source_mesh_idx to this mesh
 
     SliceMeshStorage(SettingsBaseVirtual* settings, unsigned int slice_layer_count)
     : SettingsMessenger(settings)
     , layer_nr_max_filled_layer(0)
+    , layer_nr_min_filled_layer(slice_layer_count)
     , base_subdiv_cube(nullptr)
+    , infill_cache(std::make_shared<InfillCache>())
+    , instance_source_mesh_idx(-1)
+    , instance_offset(0, 0)
     {
         layers.resize(slice_layer_count);
     }
 
     virtual ~SliceMeshStorage();
 
+    /*!
+     * Read the settings used while generating the areas of each layer into \ref SliceMeshStorage::layer_settings
+     *
+     * \param storage The storage of which this mesh is part, with the thicknesses of the layers with which the numbers of skin layers are converted
+     */
+    void resolveLayerSettings(const SliceDataStorage& storage);
+
+    /*!
+     * Remove the skin and infill areas, the perimeter gaps and everything derived from them from all layers,
+     * so that they can be generated again from the walls, see \ref FffPolygonGenerator::regenerateAreas
+     */
+    void clearSkinAndInfillAreas();
+
     /*!
      * \param extruder_nr The extruder for which to check
      * \return whether a particular extruder is used by this mesh
@@ -197,6 +347,25 @@ public:
      * \return whether a particular extruder is used by this mesh on a particular layer
      */
     bool getExtruderIsUsed(int extruder_nr, int layer_nr) const;
+
+    /*!
+     * Check the areas of a layer for whether a particular extruder is used by this mesh on it,
+     * rather than looking it up in \ref SliceMeshStorage::extruders_used_per_layer
+     *
+     * While the geometry of the layer is compressed, the extruders which were used when it was compressed are returned.
+     *
+     * \param extruder_nr The extruder for which to check
+     * \param layer_nr the layer for which to check
+     * \return whether a particular extruder is used by this mesh on a particular layer
+     */
+    bool computeExtruderIsUsed(int extruder_nr, int layer_nr) const;
+
+    /*!
+     * Move all areas of all layers in some direction, like \ref SliceLayerPart::translate
+     *
+     * \param translation The direction in which to move the areas
+     */
+    void translate(Point translation);
 };
 
 class SliceDataStorage : public SettingsMessenger, NoCopy
@@ -205,6 +374,7 @@ public:
     MeshGroup* meshgroup; // needed to pass on the per extruder settings.. (TODO: put this somewhere else? Put the per object settings here directly, or a pointer only to the per object settings.)
 
     unsigned int print_layer_count; //!< The total number of layers (except the raft and filler layers)
+    std::vector<coord_t> layer_thicknesses; //!< The thickness of each layer (except the raft and filler layers), which varies with adaptive layer heights
 
     Point3 model_size, model_min, model_max;
     std::vector<SliceMeshStorage> meshes;
@@ -214,6 +384,8 @@ public:
 
     std::vector<CoastingConfig> coasting_config; //!< coasting config per extruder
 
+    std::unique_ptr<const PathConfigStorage> path_configs; //!< The line configs of a layer which isn't slowed down as an initial layer, from which those of each layer are made
+
     SupportStorage support;
 
     Polygons skirt_brim[MAX_EXTRUDERS]; //!< Skirt and brim polygons per extruder, ordered from inner to outer polygons.
@@ -231,6 +403,13 @@ public:
     std::vector<Polygons> oozeShield;        //oozeShield per layer
     Polygons draft_protection_shield; //!< The polygons for a heightened skirt which protects from warping by gusts of wind and acts as a heated chamber.
 
+    std::vector<std::bitset<MAX_EXTRUDERS>> extruders_used_per_layer; //!< The extruders used on each layer, starting at the lowest raft layer, see \ref SliceDataStorage::computeExtrudersUsedPerLayer. Empty if not computed (yet).
+    int extruders_used_first_layer_nr; //!< The layer number of the first element of \ref SliceDataStorage::extruders_used_per_layer
+
+    unsigned int removed_empty_first_layer_count; //!< The number of empty layers removed from the bottom of all meshes and the support, see \ref FffPolygonGenerator::removeEmptyFirstLayers
+
+    bool keep_layer_geometry; //!< Whether \ref SliceDataStorage::releaseLayerGeometry keeps the layers, so that the gcode can be written from them once more, see \ref SliceDataCache
+
     /*!
      * \brief Creates a new slice data storage that stores the slice data of the
      * specified mesh group.
@@ -247,6 +426,27 @@ public:
     {
     }
 
+    /*!
+     * The thickness of the thinnest layer above the first one, which with adaptive layer heights is thinner than layer_height.
+     *
+     * Heights are converted into numbers of layers with it, so that the layers counted span at least that height everywhere.
+     */
+    coord_t getMinLayerThickness() const;
+
+    /*!
+     * The thickness of the thickest layer above the first one, which with adaptive layer heights is thicker than layer_height.
+     */
+    coord_t getMaxLayerThickness() const;
+
+    /*!
+     * Convert a number of layers of layer_height thick, such as the number of top or bottom layers, into the number of layers
+     * which is about as thick where the layers are thinnest, see \ref SliceDataStorage::getMinLayerThickness
+     *
+     * \param layer_count The number of layers of layer_height thick
+     * \return The number of layers, which is \p layer_count itself when all layers are as thick as layer_height
+     */
+    int convertLayerCount(int layer_count) const;
+
     /*!
      * Get all outlines within a given layer.
      * 
@@ -256,6 +456,51 @@ public:
      */
     Polygons getLayerOutlines(int layer_nr, bool include_helper_parts, bool external_polys_only = false) const;
 
+    /*!
+     * Get all outlines within a given layer, optionally offset, computing them only the first time they are requested.
+     *
+     * The support, the combing boundaries and the shields all need the outlines of the same layers, often with the same offset,
+     * so these are cached instead of unioning the outlines of all meshes for each of them.
+     *
+     * This function is thread safe.
+     * The returned reference is valid until \ref SliceDataStorage::invalidateLayerOutlinesCache is called,
+     * which should be done whenever the geometry of the layers or the helper parts changes.
+     *
+     * \param layer_nr the index of the layer for which to get the outlines (negative layer numbers indicate the raft)
+     * \param include_helper_parts whether to include support and prime tower
+     * \param external_polys_only whether to disregard all hole polygons
+     * \param offset The distance by which to offset the outlines (with the default join type)
+     */
+    const Polygons& getLayerOutlinesCached(int layer_nr, bool include_helper_parts, bool external_polys_only = false, coord_t offset = 0) const;
+
+    /*!
+     * Get geometry derived from the layer outlines which is the same for several meshes or stages, computing it only once per layer.
+     *
+     * It's cached along with the outlines, so the same holds: this function is thread safe
+     * and the returned reference is valid until \ref SliceDataStorage::invalidateLayerOutlinesCache is called.
+     *
+     * \param layer_nr the index of the layer for which to get the geometry
+     * \param kind What the geometry is, including the settings it depends on, so that it differs for every different computation
+     * \param compute Computes the geometry of the layer, if it isn't cached yet
+     */
+    const Polygons& getLayerGeometryCached(int layer_nr, const std::string& kind, const std::function<Polygons ()>& compute) const;
+
+    /*!
+     * Clear the outlines cached by \ref SliceDataStorage::getLayerOutlinesCached.
+     *
+     * Not thread safe: should only be called in between the processing stages.
+     */
+    void invalidateLayerOutlinesCache();
+
+    /*!
+     * Compute the outlines of the models (without helper parts and without offset) of all layers at once, in parallel.
+     *
+     * Should be called once the geometry of the layers is final.
+     * From then on \ref SliceDataStorage::getLayerOutlinesCached returns these outlines without locking,
+     * until the cache is invalidated.
+     */
+    void precomputeLayerOutlines();
+
     /*!
      * Collects the second wall of every part, or the outer wall if it has no second, or the outline, if it has no outer wall.
      * 
@@ -281,6 +526,17 @@ public:
      */
     std::vector<bool> getExtrudersUsed(int layer_nr) const;
 
+    /*!
+     * Compute which extruders are used on each layer, by the whole print and by each mesh, for all layers at once, in parallel.
+     *
+     * From then on \ref SliceDataStorage::getExtrudersUsed(int) and \ref SliceMeshStorage::getExtruderIsUsed(int, int)
+     * look the answer up instead of checking the areas of the layer, which the gcode writer does for every layer
+     * and which can't be done anymore once the geometry of a layer has been compressed or released.
+     *
+     * Should be called again whenever the areas of the layers or the helper parts change.
+     */
+    void computeExtrudersUsedPerLayer();
+
     /*!
      * Gets whether prime blob is enabled for the given extruder number.
      *
@@ -289,11 +545,123 @@ public:
      */
     bool getExtruderPrimeBlobEnabled(int extruder_nr) const;
 
+    /*!
+     * Free the geometry of a layer of all meshes and of the support, once no
+     * more layers will be planned which read it.
+     *
+     * The layers themselves remain, so that their print heights can still be used.
+     *
+     * \param layer_nr the layer of which to free the geometry
+     */
+    void releaseLayerGeometry(int layer_nr);
+
+    /*!
+     * Compress the geometry of all layer parts of a layer of all meshes, see \ref SliceLayerPart::compressGeometry
+     *
+     * Only the outlines of the layer can be used until it is decompressed again.
+     *
+     * \param layer_nr the layer of which to compress the geometry
+     */
+    void compressLayerGeometry(int layer_nr);
+
+    /*!
+     * Compress the geometry of all layer parts of a layer of one mesh, see \ref SliceLayerPart::compressGeometry
+     *
+     * The extruders used by the mesh on the layer are kept, since they can't be checked from the areas anymore.
+     * Layers of which the geometry is already compressed are left as they are.
+     * The areas of the layer must be finished, and different layers can be compressed in parallel.
+     *
+     * While the layers are being moved to a temporary file, see \ref SliceDataStorage::startSpillingLayerGeometry,
+     * the compressed geometry is moved there if it doesn't fit in the memory budget anymore.
+     *
+     * \param mesh The mesh of which to compress a layer
+     * \param layer_nr the layer of which to compress the geometry
+     */
+    void compressLayerGeometry(SliceMeshStorage& mesh, int layer_nr);
+
+    /*!
+     * Restore the geometry of a layer compressed by \ref SliceDataStorage::compressLayerGeometry
+     *
+     * Does nothing for the meshes of which the layer isn't compressed.
+     * The geometry moved to the temporary file can only be read back after \ref SliceDataStorage::finishSpillingLayerGeometry.
+     *
+     * \param layer_nr the layer of which to decompress the geometry
+     */
+    void decompressLayerGeometry(int layer_nr);
+
+    /*!
+     * Restore the geometry of all compressed layers, after which the temporary file of \ref SliceDataStorage::startSpillingLayerGeometry is removed,
+     * so that the layers can be compressed and moved to a temporary file again.
+     */
+    void decompressAllLayerGeometry();
+
+    /*!
+     * Get the compressed geometry of a part of a compressed layer, reading it back from the temporary file if it has been moved there.
+     * Can be called from several threads once the layers aren't moved to the temporary file anymore.
+     *
+     * \param layer The compressed layer
+     * \param part_idx The index of the part in the layer
+     * \param[out] compressed_geometry The compressed geometry of the part
+     */
+    void getCompressedGeometry(const SliceLayer& layer, size_t part_idx, std::vector<uint8_t>& compressed_geometry) const;
+
+    /*!
+     * Start moving the compressed geometry of the layers which don't fit in a memory budget to a temporary file,
+     * as each layer is compressed by \ref SliceDataStorage::compressLayerGeometry while the areas are generated.
+     *
+     * The layers are kept in memory in the order in which they're compressed, which is about from the bottom up,
+     * since the bottom layers are decompressed first.
+     *
+     * \param memory_budget The number of bytes of compressed geometry to keep in memory, or zero to keep all of it in memory
+     */
+    void startSpillingLayerGeometry(uint64_t memory_budget);
+
+    /*!
+     * Stop moving layers to the temporary file, so that they can be read back by \ref SliceDataStorage::decompressLayerGeometry.
+     * The layers compressed afterwards are kept in memory.
+     */
+    void finishSpillingLayerGeometry();
+
+    /*!
+     * Take the settings from another meshgroup with the same meshes as the one these areas were generated for.
+     *
+     * The settings of this storage and of its meshes are passed on from \p meshgroup from then on,
+     * and the configs computed from the settings while writing the gcode are reset.
+     *
+     * \param meshgroup The meshgroup to take the settings from
+     */
+    void setMeshGroup(MeshGroup* meshgroup);
+
+    /*!
+     * Remove the generated support areas, so that they can be generated again, see \ref FffPolygonGenerator::regenerateAreas
+     *
+     * Only possible when there are no support meshes or anti overhang meshes, since their areas are added while slicing.
+     */
+    void clearSupportAreas();
+
+    /*!
+     * Remove the prime tower, shields, skirt, brim, raft and the print height statistics, which are computed from the areas of the layers and the support,
+     * so that they can be generated again, see \ref FffPolygonGenerator::regenerateAreas
+     */
+    void clearHelperAreas();
+
 private:
     /*!
      * Construct the retraction_config_per_extruder
      */
     std::vector<RetractionConfig> initializeRetractionConfigs();
+
+    using LayerOutlinesKey = std::tuple<int, bool, bool, coord_t>; //!< layer_nr, include_helper_parts, external_polys_only, offset
+    mutable std::map<LayerOutlinesKey, Polygons> layer_outlines_cache; //!< See \ref SliceDataStorage::getLayerOutlinesCached
+    mutable std::map<std::pair<int, std::string>, Polygons> layer_geometry_cache; //!< See \ref SliceDataStorage::getLayerGeometryCached
+    mutable std::mutex layer_outlines_cache_mutex; //!< Protects \ref SliceDataStorage::layer_outlines_cache and \ref SliceDataStorage::layer_geometry_cache
+    std::vector<Polygons> precomputed_layer_outlines; //!< The outlines of the models per layer, see \ref SliceDataStorage::precomputeLayerOutlines
+
+    std::unique_ptr<SpillFile> layer_geometry_spill; //!< The file with the layers which don't fit in memory, created once the first layer is moved there
+    std::mutex layer_geometry_spill_mutex; //!< Protects the \ref SliceDataStorage::layer_geometry_spill while it's written and the counts of the layers moved there
+    uint64_t layer_geometry_memory_budget = 0; //!< The number of bytes of compressed geometry to keep in memory while layers are moved to the temporary file, or zero when they aren't
+    uint64_t kept_layer_geometry_bytes = 0; //!< The number of bytes of compressed geometry kept in memory while layers are moved to the temporary file
+    int spilled_layer_count = 0; //!< The number of layers of all meshes moved to the temporary file
 };
 
 }//namespace cura
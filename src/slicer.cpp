@@ -1,11 +1,14 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include <stdio.h>
 
-#include <algorithm> // remove_if
+#include <algorithm> // remove_if, merge, lower_bound, upper_bound
+#include <iterator> // back_inserter
 
 #include "utils/gettime.h"
 #include "utils/logoutput.h"
+#include "utils/Profiler.h"
 #include "utils/SparsePointGridInclusive.h"
+#include "utils/ThreadPool.h"
 
 #include "slicer.h"
 
@@ -15,21 +18,23 @@ namespace cura {
 int largest_neglected_gap_first_phase = MM2INT(0.01); //!< distance between two line segments regarded as connected
 int largest_neglected_gap_second_phase = MM2INT(0.02); //!< distance between two line segments regarded as connected
 int max_stitch1 = MM2INT(10.0); //!< maximal distance stitched between open polylines to form polygons
+constexpr unsigned int parallel_stitch_search_polyline_count = 2048; //!< from how many open polylines in a layer the possible stitches are searched for in parallel
+constexpr unsigned int parallel_stitch_search_block_size = 256; //!< the number of polylines of which to search the stitches per task
 
-void SlicerLayer::makeBasicPolygonLoops(Polygons& open_polylines)
+void SlicerLayer::makeBasicPolygonLoops(const Mesh* mesh, Polygons& open_polylines)
 {
     for(unsigned int start_segment_idx = 0; start_segment_idx < segments.size(); start_segment_idx++)
     {
         if (!segments[start_segment_idx].addedToPolygon)
         {
-            makeBasicPolygonLoop(open_polylines, start_segment_idx);
+            makeBasicPolygonLoop(mesh, open_polylines, start_segment_idx);
         }
     }
     //Clear the segmentList to save memory, it is no longer needed after this point.
     segments.clear();
 }
 
-void SlicerLayer::makeBasicPolygonLoop(Polygons& open_polylines, unsigned int start_segment_idx)
+void SlicerLayer::makeBasicPolygonLoop(const Mesh* mesh, Polygons& open_polylines, unsigned int start_segment_idx)
 {
 
     Polygon poly;
@@ -40,7 +45,7 @@ void SlicerLayer::makeBasicPolygonLoop(Polygons& open_polylines, unsigned int st
         SlicerSegment& segment = segments[segment_idx];
         poly.add(segment.end);
         segment.addedToPolygon = true;
-        segment_idx = getNextSegmentIdx(segment, start_segment_idx);
+        segment_idx = getNextSegmentIdx(mesh, segment, start_segment_idx);
         if (segment_idx == static_cast<int>(start_segment_idx))
         { // polyon is closed
             polygons.add(poly);
@@ -53,12 +58,11 @@ void SlicerLayer::makeBasicPolygonLoop(Polygons& open_polylines, unsigned int st
 
 int SlicerLayer::tryFaceNextSegmentIdx(const SlicerSegment& segment, int face_idx, unsigned int start_segment_idx) const
 {
-    decltype(face_idx_to_segment_idx.begin()) it;
-    auto it_end = face_idx_to_segment_idx.end();
-    it = face_idx_to_segment_idx.find(face_idx);
-    if (it != it_end)
+    // The segments are ordered by the index of the face which generated them, so the segment of a face can be found with a binary search.
+    auto it = std::lower_bound(segments.begin(), segments.end(), face_idx, [](const SlicerSegment& segment, int face_idx) { return segment.faceIndex < face_idx; });
+    if (it != segments.end() && it->faceIndex == face_idx)
     {
-        int segment_idx = (*it).second;
+        int segment_idx = it - segments.begin();
         Point p1 = segments[segment_idx].start;
         Point diff = segment.end - p1;
         if (shorterThen(diff, largest_neglected_gap_first_phase))
@@ -78,11 +82,11 @@ int SlicerLayer::tryFaceNextSegmentIdx(const SlicerSegment& segment, int face_id
     return -1;
 }
 
-int SlicerLayer::getNextSegmentIdx(const SlicerSegment& segment, unsigned int start_segment_idx)
+int SlicerLayer::getNextSegmentIdx(const Mesh* mesh, const SlicerSegment& segment, unsigned int start_segment_idx)
 {
     int next_segment_idx = -1;
 
-    bool segment_ended_at_edge = segment.endVertex == nullptr;
+    bool segment_ended_at_edge = segment.endVertexIdx == -1;
     if (segment_ended_at_edge)
     {
         int face_to_try = segment.endOtherFaceIdx;
@@ -96,8 +100,7 @@ int SlicerLayer::getNextSegmentIdx(const SlicerSegment& segment, unsigned int st
     {
         // segment ended at vertex
 
-        const std::vector<uint32_t> &faces_to_try = segment.endVertex->connected_faces;
-        for (int face_to_try : faces_to_try)
+        for (int face_to_try : mesh->getConnectedFaces(segment.endVertexIdx))
         {
             int result_segment_idx =
                 tryFaceNextSegmentIdx(segment, face_to_try, start_segment_idx);
@@ -206,9 +209,9 @@ SlicerLayer::findPossibleStitches(
     };
 
     // Used to find nearby end points within a fixed maximum radius
-    SparsePointGrid<StitchGridVal,StitchGridValLocator> grid_ends(cell_size);
+    SparsePointGrid<StitchGridVal,StitchGridValLocator,MortonGridMap<StitchGridVal>> grid_ends(cell_size);
     // Used to find nearby start points within a fixed maximum radius
-    SparsePointGrid<StitchGridVal,StitchGridValLocator> grid_starts(cell_size);
+    SparsePointGrid<StitchGridVal,StitchGridValLocator,MortonGridMap<StitchGridVal>> grid_starts(cell_size);
 
     // populate grids
 
@@ -243,83 +246,115 @@ SlicerLayer::findPossibleStitches(
     }
 
     // search for nearby end points
-    for(unsigned int polyline_1_idx = 0; polyline_1_idx < open_polylines.size(); polyline_1_idx++)
-    {
-        ConstPolygonRef polyline_1 = open_polylines[polyline_1_idx];
+    // the stitches of each polyline are collected separately, so that they can be searched for in parallel
+    // and still be pushed into the queue in the same order
+    auto find_stitches_of = [&](unsigned int polyline_1_idx, std::vector<PossibleStitch>& stitches)
+        {
+            ConstPolygonRef polyline_1 = open_polylines[polyline_1_idx];
 
-        if (polyline_1.size() < 1) continue;
+            if (polyline_1.size() < 1) return;
 
-        std::vector<StitchGridVal> nearby_ends;
+            // Check for stitches that append polyline_1 onto polyline_0
+            // in natural order.  These are stitches that use the end of
+            // polyline_0 and the start of polyline_1.
+            grid_ends.visitNearby(polyline_1[0], max_dist, [&](const StitchGridVal& nearby_end)
+                {
+                    Point diff = nearby_end.polyline_term_pt - polyline_1[0];
+                    int64_t dist2 = vSize2(diff);
+                    if (dist2 < max_dist2)
+                    {
+                        PossibleStitch poss_stitch;
+                        poss_stitch.dist2 = dist2;
+                        poss_stitch.terminus_0 = Terminus{nearby_end.polyline_idx, true};
+                        poss_stitch.terminus_1 = Terminus{polyline_1_idx, false};
+                        stitches.push_back(poss_stitch);
+                    }
+                    return true;
+                });
 
-        // Check for stitches that append polyline_1 onto polyline_0
-        // in natural order.  These are stitches that use the end of
-        // polyline_0 and the start of polyline_1.
-        nearby_ends = grid_ends.getNearby(polyline_1[0], max_dist);
-        for (const auto& nearby_end : nearby_ends)
-        {
-            Point diff = nearby_end.polyline_term_pt - polyline_1[0];
-            int64_t dist2 = vSize2(diff);
-            if (dist2 < max_dist2)
+            if (allow_reverse)
             {
-                PossibleStitch poss_stitch;
-                poss_stitch.dist2 = dist2;
-                poss_stitch.terminus_0 = Terminus{nearby_end.polyline_idx, true};
-                poss_stitch.terminus_1 = Terminus{polyline_1_idx, false};
-                stitch_queue.push(poss_stitch);
+                // Check for stitches that append polyline_1 onto polyline_0
+                // by reversing order of polyline_1.  These are stitches that
+                // use the end of polyline_0 and the end of polyline_1.
+                grid_ends.visitNearby(polyline_1.back(), max_dist, [&](const StitchGridVal& nearby_end)
+                    {
+                        // Disallow stitching with self with same end point
+                        if (nearby_end.polyline_idx == polyline_1_idx)
+                        {
+                            return true;
+                        }
+
+                        Point diff = nearby_end.polyline_term_pt - polyline_1.back();
+                        int64_t dist2 = vSize2(diff);
+                        if (dist2 < max_dist2)
+                        {
+                            PossibleStitch poss_stitch;
+                            poss_stitch.dist2 = dist2;
+                            poss_stitch.terminus_0 = Terminus{nearby_end.polyline_idx, true};
+                            poss_stitch.terminus_1 = Terminus{polyline_1_idx, true};
+                            stitches.push_back(poss_stitch);
+                        }
+                        return true;
+                    });
+
+                // Check for stitches that append polyline_1 onto polyline_0
+                // by reversing order of polyline_0.  These are stitches that
+                // use the start of polyline_0 and the start of polyline_1.
+                grid_starts.visitNearby(polyline_1[0], max_dist, [&](const StitchGridVal& nearby_start)
+                    {
+                        // Disallow stitching with self with same end point
+                        if (nearby_start.polyline_idx == polyline_1_idx)
+                        {
+                            return true;
+                        }
+
+                        Point diff = nearby_start.polyline_term_pt - polyline_1[0];
+                        int64_t dist2 = vSize2(diff);
+                        if (dist2 < max_dist2)
+                        {
+                            PossibleStitch poss_stitch;
+                            poss_stitch.dist2 = dist2;
+                            poss_stitch.terminus_0 = Terminus{nearby_start.polyline_idx, false};
+                            poss_stitch.terminus_1 = Terminus{polyline_1_idx, false};
+                            stitches.push_back(poss_stitch);
+                        }
+                        return true;
+                    });
             }
-        }
-
-        if (allow_reverse)
+        };
+
+    const unsigned int polyline_count = open_polylines.size();
+    std::vector<PossibleStitch> stitches;
+    if (polyline_count >= parallel_stitch_search_polyline_count)
+    { // a layer with very many open polylines: the threads which are done slicing their own layers can help out here
+        const unsigned int block_count = (polyline_count + parallel_stitch_search_block_size - 1) / parallel_stitch_search_block_size;
+        std::vector<std::vector<PossibleStitch>> block_stitches(block_count);
+        ThreadPool::parallelFor(0, block_count, [&](unsigned int block_idx)
         {
-            // Check for stitches that append polyline_1 onto polyline_0
-            // by reversing order of polyline_1.  These are stitches that
-            // use the end of polyline_0 and the end of polyline_1.
-            nearby_ends = grid_ends.getNearby(polyline_1.back(), max_dist);
-            for (const auto& nearby_end : nearby_ends)
+            const unsigned int block_end = std::min(polyline_count, (block_idx + 1) * parallel_stitch_search_block_size);
+            for (unsigned int polyline_1_idx = block_idx * parallel_stitch_search_block_size; polyline_1_idx < block_end; polyline_1_idx++)
             {
-                // Disallow stitching with self with same end point
-                if (nearby_end.polyline_idx == polyline_1_idx)
-                {
-                    continue;
-                }
-
-                Point diff = nearby_end.polyline_term_pt - polyline_1.back();
-                int64_t dist2 = vSize2(diff);
-                if (dist2 < max_dist2)
-                {
-                    PossibleStitch poss_stitch;
-                    poss_stitch.dist2 = dist2;
-                    poss_stitch.terminus_0 = Terminus{nearby_end.polyline_idx, true};
-                    poss_stitch.terminus_1 = Terminus{polyline_1_idx, true};
-                    stitch_queue.push(poss_stitch);
-                }
+                find_stitches_of(polyline_1_idx, block_stitches[block_idx]);
             }
-
-            // Check for stitches that append polyline_1 onto polyline_0
-            // by reversing order of polyline_0.  These are stitches that
-            // use the start of polyline_0 and the start of polyline_1.
-            std::vector<StitchGridVal> nearby_starts =
-                grid_starts.getNearby(polyline_1[0], max_dist);
-            for (const auto& nearby_start : nearby_starts)
+        });
+        for (const std::vector<PossibleStitch>& block : block_stitches)
+        {
+            for (const PossibleStitch& poss_stitch : block)
             {
-                // Disallow stitching with self with same end point
-                if (nearby_start.polyline_idx == polyline_1_idx)
-                {
-                    continue;
-                }
-
-                Point diff = nearby_start.polyline_term_pt - polyline_1[0];
-                int64_t dist2 = vSize2(diff);
-                if (dist2 < max_dist2)
-                {
-                    PossibleStitch poss_stitch;
-                    poss_stitch.dist2 = dist2;
-                    poss_stitch.terminus_0 = Terminus{nearby_start.polyline_idx, false};
-                    poss_stitch.terminus_1 = Terminus{polyline_1_idx, false};
-                    stitch_queue.push(poss_stitch);
-                }
+                stitch_queue.push(poss_stitch);
             }
         }
+        return stitch_queue;
+    }
+    for (unsigned int polyline_1_idx = 0; polyline_1_idx < polyline_count; polyline_1_idx++)
+    {
+        stitches.clear();
+        find_stitches_of(polyline_1_idx, stitches);
+        for (const PossibleStitch& poss_stitch : stitches)
+        {
+            stitch_queue.push(poss_stitch);
+        }
     }
 
     return stitch_queue;
@@ -543,8 +578,36 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
     // And generate a path over this shortest bit to link up the 2 open polygons.
     // (If these 2 open polygons are the same polygon, then the final result is a closed polyon)
 
+    // The segments of the closed polygons, so that finding where an end of a polyline touches them only looks at the segments nearby.
+    // The polygons made while stitching are added to it before each search.
+    LocToLineGrid polygon_grid(1000);
+    unsigned int indexed_polygon_count = 0;
     while(1)
     {
+        for (; indexed_polygon_count < polygons.size(); indexed_polygon_count++)
+        {
+            for (unsigned int point_idx = 0; point_idx < polygons[indexed_polygon_count].size(); point_idx++)
+            {
+                polygon_grid.insert(PolygonsPointIndex(&polygons, indexed_polygon_count, point_idx));
+            }
+        }
+        // Where the ends of each polyline touch the polygons, and which polylines end on each polygon.
+        // Two polylines can only be connected along a polygon which both touch, so only those are tried.
+        std::vector<ClosePolygonResult> start_on_polygon(open_polylines.size());
+        std::vector<ClosePolygonResult> end_on_polygon(open_polylines.size());
+        std::vector<std::vector<unsigned int>> polylines_ending_on_polygon(polygons.size());
+        for (unsigned int polyline_idx = 0; polyline_idx < open_polylines.size(); polyline_idx++)
+        {
+            ConstPolygonRef polyline = open_polylines[polyline_idx];
+            if (polyline.size() < 1) continue;
+            start_on_polygon[polyline_idx] = findPolygonPointClosestTo(polyline[0], polygon_grid);
+            end_on_polygon[polyline_idx] = findPolygonPointClosestTo(polyline.back(), polygon_grid);
+            if (end_on_polygon[polyline_idx].polygonIdx >= 0)
+            {
+                polylines_ending_on_polygon[end_on_polygon[polyline_idx].polygonIdx].push_back(polyline_idx);
+            }
+        }
+
         unsigned int best_polyline_1_idx = -1;
         unsigned int best_polyline_2_idx = -1;
         GapCloserResult best_result;
@@ -559,7 +622,7 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
             if (polyline_1.size() < 1) continue;
 
             {
-                GapCloserResult res = findPolygonGapCloser(polyline_1[0], polyline_1.back());
+                GapCloserResult res = findPolygonGapCloser(polyline_1[0], polyline_1.back(), start_on_polygon[polyline_1_idx], end_on_polygon[polyline_1_idx]);
                 if (res.len > 0 && res.len < best_result.len)
                 {
                     best_polyline_1_idx = polyline_1_idx;
@@ -568,12 +631,13 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
                 }
             }
 
-            for(unsigned int polyline_2_idx = 0; polyline_2_idx < open_polylines.size(); polyline_2_idx++)
+            if (start_on_polygon[polyline_1_idx].polygonIdx < 0) continue;
+            for(unsigned int polyline_2_idx : polylines_ending_on_polygon[start_on_polygon[polyline_1_idx].polygonIdx])
             {
                 PolygonRef polyline_2 = open_polylines[polyline_2_idx];
-                if (polyline_2.size() < 1 || polyline_1_idx == polyline_2_idx) continue;
+                if (polyline_1_idx == polyline_2_idx) continue;
 
-                GapCloserResult res = findPolygonGapCloser(polyline_1[0], polyline_2.back());
+                GapCloserResult res = findPolygonGapCloser(polyline_1[0], polyline_2.back(), start_on_polygon[polyline_1_idx], end_on_polygon[polyline_2_idx]);
                 if (res.len > 0 && res.len < best_result.len)
                 {
                     best_polyline_1_idx = polyline_1_idx;
@@ -646,11 +710,9 @@ void SlicerLayer::stitch_extensive(Polygons& open_polylines)
     }
 }
 
-GapCloserResult SlicerLayer::findPolygonGapCloser(Point ip0, Point ip1)
+GapCloserResult SlicerLayer::findPolygonGapCloser(Point ip0, Point ip1, const ClosePolygonResult& c1, const ClosePolygonResult& c2) const
 {
     GapCloserResult ret;
-    ClosePolygonResult c1 = findPolygonPointClosestTo(ip0);
-    ClosePolygonResult c2 = findPolygonPointClosestTo(ip1);
     if (c1.polygonIdx < 0 || c1.polygonIdx != c2.polygonIdx)
     {
         ret.len = -1;
@@ -699,15 +761,21 @@ GapCloserResult SlicerLayer::findPolygonGapCloser(Point ip0, Point ip1)
     return ret;
 }
 
-ClosePolygonResult SlicerLayer::findPolygonPointClosestTo(Point input)
+ClosePolygonResult SlicerLayer::findPolygonPointClosestTo(Point input, const LocToLineGrid& polygon_grid) const
 {
     ClosePolygonResult ret;
-    for(unsigned int n=0; n<polygons.size(); n++)
-    {
-        Point p0 = polygons[n][polygons[n].size()-1];
-        for(unsigned int i=0; i<polygons[n].size(); i++)
+    ret.polygonIdx = -1;
+    // the projection is rounded, so segments a bit further than the 100 micron are checked as well
+    polygon_grid.processNearby(input, 200, [&](const PolygonsPointIndex& segment_start)
         {
-            Point p1 = polygons[n][i];
+            const unsigned int n = segment_start.poly_idx;
+            const unsigned int i = (segment_start.point_idx + 1) % polygons[n].size(); // the segment ends at point i, like the segments are numbered by the ClosePolygonResult
+            if (ret.polygonIdx >= 0 && (static_cast<unsigned int>(ret.polygonIdx) < n || (static_cast<unsigned int>(ret.polygonIdx) == n && ret.pointIdx <= i)))
+            { // a segment earlier in the polygons has been found already
+                return true;
+            }
+            const Point p0 = polygons[n][segment_start.point_idx];
+            const Point p1 = polygons[n][i];
 
             //Q = A + Normal( B - A ) * ((( B - A ) dot ( P - A )) / VSize( A - B ));
             Point pDiff = p1 - p0;
@@ -723,35 +791,36 @@ ClosePolygonResult SlicerLayer::findPolygonPointClosestTo(Point input)
                         ret.intersectionPoint = q;
                         ret.polygonIdx = n;
                         ret.pointIdx = i;
-                        return ret;
                     }
                 }
             }
-            p0 = p1;
-        }
-    }
-    ret.polygonIdx = -1;
+            return true;
+        });
     return ret;
 }
 
 void SlicerLayer::makePolygons(const Mesh* mesh, bool keep_none_closed, bool extensive_stitching)
 {
+    Profiler::Zone zone("makePolygons");
     Polygons open_polylines;
 
-    makeBasicPolygonLoops(open_polylines);
+    makeBasicPolygonLoops(mesh, open_polylines);
 
     connectOpenPolylines(open_polylines);
 
     // TODO: (?) for mesh surface mode: connect open polygons. Maybe the above algorithm can create two open polygons which are actually connected when the starting segment is in the middle between the two open polygons.
 
-    if (mesh->getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::NORMAL)
-    { // don't stitch when using (any) mesh surface mode, i.e. also don't stitch when using mixed mesh surface and closed polygons, because then polylines which are supposed to be open will be closed
-        stitch(open_polylines);
-    }
-
-    if (extensive_stitching)
     {
-        stitch_extensive(open_polylines);
+        Profiler::Zone zone("stitch");
+        if (mesh->getSettingAsSurfaceMode("magic_mesh_surface_mode") == ESurfaceMode::NORMAL)
+        { // don't stitch when using (any) mesh surface mode, i.e. also don't stitch when using mixed mesh surface and closed polygons, because then polylines which are supposed to be open will be closed
+            stitch(open_polylines);
+        }
+
+        if (extensive_stitching)
+        {
+            stitch_extensive(open_polylines);
+        }
     }
 
     if (keep_none_closed)
@@ -787,113 +856,251 @@ void SlicerLayer::makePolygons(const Mesh* mesh, bool keep_none_closed, bool ext
 }
 
 
-Slicer::Slicer(Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching)
-: mesh(mesh)
+void Slicer::getFaceLayerRange(const int32_t* vertex_z, const std::vector<int>& slice_z, int32_t& layer_min, int32_t& layer_max)
 {
-    assert(slice_layer_count > 0);
+    const int32_t minZ = std::min(vertex_z[0], std::min(vertex_z[1], vertex_z[2]));
+    const int32_t maxZ = std::max(vertex_z[0], std::max(vertex_z[1], vertex_z[2]));
+    layer_min = std::lower_bound(slice_z.begin(), slice_z.end(), minZ) - slice_z.begin();
+    layer_max = std::upper_bound(slice_z.begin(), slice_z.end(), maxZ) - slice_z.begin() - 1;
+}
 
-    TimeKeeper slice_timer;
+std::vector<int> Slicer::getUniformSliceZ(int initial, int thickness, int slice_layer_count)
+{
+    std::vector<int> slice_z(slice_layer_count);
+    for (int32_t layer_nr = 0; layer_nr < slice_layer_count; layer_nr++)
+    {
+        slice_z[layer_nr] = initial + thickness * layer_nr;
+    }
+    return slice_z;
+}
 
-    layers.resize(slice_layer_count);
+bool Slicer::sliceFace(unsigned int face_idx, const int32_t* vertex_z, int32_t z, SlicerSegment& s) const
+{
+    // Determine how the face is cut using only the heights, so that the vertices are only visited for faces which produce a segment.
+    const int32_t z0 = vertex_z[0];
+    const int32_t z1 = vertex_z[1];
+    const int32_t z2 = vertex_z[2];
+    int start_vertex_idx; // the vertex on the one side of the plane
+    int end_edge_idx;
+    int end_vertex_idx = -1; // the vertex which lies on the plane at the end of the segment, if any
+    if (z0 < z && z1 >= z && z2 >= z)
+    {
+        start_vertex_idx = 0;
+        end_edge_idx = 0;
+        if (z1 == z)
+        {
+            end_vertex_idx = 1;
+        }
+    }
+    else if (z0 > z && z1 < z && z2 < z)
+    {
+        start_vertex_idx = 0;
+        end_edge_idx = 2;
+    }
 
+    else if (z1 < z && z0 >= z && z2 >= z)
+    {
+        start_vertex_idx = 1;
+        end_edge_idx = 1;
+        if (z2 == z)
+        {
+            end_vertex_idx = 2;
+        }
+    }
+    else if (z1 > z && z0 < z && z2 < z)
+    {
+        start_vertex_idx = 1;
+        end_edge_idx = 0;
+    }
 
-    for(int32_t layer_nr = 0; layer_nr < slice_layer_count; layer_nr++)
+    else if (z2 < z && z1 >= z && z0 >= z)
     {
-        layers[layer_nr].z = initial + thickness * layer_nr;
-    }
-
-    for(unsigned int mesh_idx = 0; mesh_idx < mesh->faces.size(); mesh_idx++)
-    {
-        const MeshFace& face = mesh->faces[mesh_idx];
-        const MeshVertex& v0 = mesh->vertices[face.vertex_index[0]];
-        const MeshVertex& v1 = mesh->vertices[face.vertex_index[1]];
-        const MeshVertex& v2 = mesh->vertices[face.vertex_index[2]];
-        Point3 p0 = v0.p;
-        Point3 p1 = v1.p;
-        Point3 p2 = v2.p;
-        int32_t minZ = p0.z;
-        int32_t maxZ = p0.z;
-        if (p1.z < minZ) minZ = p1.z;
-        if (p2.z < minZ) minZ = p2.z;
-        if (p1.z > maxZ) maxZ = p1.z;
-        if (p2.z > maxZ) maxZ = p2.z;
-        int32_t layer_max = (maxZ - initial) / thickness;
-        for(int32_t layer_nr = (minZ - initial) / thickness; layer_nr <= layer_max; layer_nr++)
-        {
-            int32_t z = layer_nr * thickness + initial;
-            if (z < minZ) continue;
-            if (layer_nr < 0) continue;
-
-            SlicerSegment s;
-            s.endVertex = nullptr;
-            int end_edge_idx = -1;
-            if (p0.z < z && p1.z >= z && p2.z >= z)
-            {
-                s = project2D(p0, p2, p1, z);
-                end_edge_idx = 0;
-                if (p1.z == z)
-                {
-                    s.endVertex = &v1;
-                }
-            }
-            else if (p0.z > z && p1.z < z && p2.z < z)
-            {
-                s = project2D(p0, p1, p2, z);
-                end_edge_idx = 2;
+        start_vertex_idx = 2;
+        end_edge_idx = 2;
+        if (z0 == z)
+        {
+            end_vertex_idx = 0;
+        }
+    }
+    else if (z2 > z && z1 < z && z0 < z)
+    {
+        start_vertex_idx = 2;
+        end_edge_idx = 1;
+    }
+    else
+    {
+        //Not all cases create a segment, because a point of a face could create just a dot, and two touching faces
+        //  on the slice would create two segments
+        return false;
+    }
 
-            }
+    const MeshFace& face = mesh->faces[face_idx];
+    const MeshVertex& v0 = mesh->vertices[face.vertex_index[0]];
+    const MeshVertex& v1 = mesh->vertices[face.vertex_index[1]];
+    const MeshVertex& v2 = mesh->vertices[face.vertex_index[2]];
+    const bool below = vertex_z[start_vertex_idx] < z; // whether the lone vertex lies below the plane
+    switch (start_vertex_idx)
+    {
+        case 0:
+            s = below ? project2D(v0.p, v2.p, v1.p, z) : project2D(v0.p, v1.p, v2.p, z);
+            break;
+        case 1:
+            s = below ? project2D(v1.p, v0.p, v2.p, z) : project2D(v1.p, v2.p, v0.p, z);
+            break;
+        default:
+            s = below ? project2D(v2.p, v1.p, v0.p, z) : project2D(v2.p, v0.p, v1.p, z);
+            break;
+    }
+    s.endVertexIdx = (end_vertex_idx == -1) ? -1 : face.vertex_index[end_vertex_idx];
+    s.faceIndex = face_idx;
+    s.endOtherFaceIdx = face.connected_face_index[end_edge_idx];
+    s.addedToPolygon = false;
+    return true;
+}
+
+void Slicer::generateSegments(const std::vector<int>& slice_z)
+{
+    const int32_t slice_layer_count = slice_z.size();
+    const unsigned int face_count = mesh->faces.size();
+
+    // Gather the heights of the vertices of each face in one compact array.
+    // Deciding whether and how a face is cut by a layer only needs these, so the sweep below doesn't have to visit the vertices.
+    std::vector<int32_t> face_vertex_z(face_count * 3);
+    std::vector<int32_t> face_layer_min(face_count);
+    std::vector<int32_t> face_layer_max(face_count);
+    for (unsigned int face_idx = 0; face_idx < face_count; face_idx++)
+    {
+        const MeshFace& face = mesh->faces[face_idx];
+        int32_t* vertex_z = &face_vertex_z[face_idx * 3];
+        for (unsigned int vertex_nr = 0; vertex_nr < 3; vertex_nr++)
+        {
+            vertex_z[vertex_nr] = mesh->vertices[face.vertex_index[vertex_nr]].p.z;
+        }
+        getFaceLayerRange(vertex_z, slice_z, face_layer_min[face_idx], face_layer_max[face_idx]);
+        face_layer_min[face_idx] = std::max(0, face_layer_min[face_idx]);
+        face_layer_max[face_idx] = std::min(slice_layer_count - 1, face_layer_max[face_idx]);
+    }
 
-            else if (p1.z < z && p0.z >= z && p2.z >= z)
+    // Sort the faces on the first layer they intersect.
+    // This is a counting sort, so the faces starting at the same layer remain ordered by their index.
+    std::vector<unsigned int> layer_face_start(slice_layer_count + 1, 0); //!< For each layer the index into faces_by_layer_min of the first face starting at that layer
+    for (unsigned int face_idx = 0; face_idx < face_count; face_idx++)
+    {
+        if (face_layer_min[face_idx] <= face_layer_max[face_idx])
+        {
+            layer_face_start[face_layer_min[face_idx] + 1]++;
+        }
+    }
+    for (int32_t layer_nr = 0; layer_nr < slice_layer_count; layer_nr++)
+    {
+        layer_face_start[layer_nr + 1] += layer_face_start[layer_nr];
+    }
+    std::vector<unsigned int> faces_by_layer_min(layer_face_start.back());
+    {
+        std::vector<unsigned int> insert_idx(layer_face_start.begin(), layer_face_start.end() - 1);
+        for (unsigned int face_idx = 0; face_idx < face_count; face_idx++)
+        {
+            if (face_layer_min[face_idx] <= face_layer_max[face_idx])
             {
-                s = project2D(p1, p0, p2, z);
-                end_edge_idx = 1;
-                if (p2.z == z)
-                {
-                    s.endVertex = &v2;
-                }
+                faces_by_layer_min[insert_idx[face_layer_min[face_idx]]++] = face_idx;
             }
-            else if (p1.z > z && p0.z < z && p2.z < z)
-            {
-                s = project2D(p1, p2, p0, z);
-                end_edge_idx = 0;
+        }
+    }
+
+    // Divide the layers into chunks of consecutive layers, so that each chunk can be swept by a single thread.
+    // For each chunk we record which faces started below it but are still cut by its first layer.
+    const unsigned int thread_count = ThreadPool::getThreadCount();
+    const int32_t chunk_layer_count = std::max(1, slice_layer_count / static_cast<int32_t>(thread_count * 4));
+    const int32_t chunk_count = (slice_layer_count + chunk_layer_count - 1) / chunk_layer_count;
+    std::vector<std::vector<unsigned int>> chunk_initial_active_faces(chunk_count);
+    for (unsigned int face_idx = 0; face_idx < face_count; face_idx++)
+    {
+        if (face_layer_min[face_idx] > face_layer_max[face_idx])
+        {
+            continue;
+        }
+        for (int32_t chunk_idx = face_layer_min[face_idx] / chunk_layer_count + 1; chunk_idx <= face_layer_max[face_idx] / chunk_layer_count; chunk_idx++)
+        {
+            chunk_initial_active_faces[chunk_idx].push_back(face_idx);
+        }
+    }
 
+    // Sweep the layers of each chunk upward, keeping a list of the faces which intersect the current layer.
+    // The active list is kept ordered by face index, so that the segments in each layer end up
+    // in exactly the same order as when all faces would be sliced one after the other.
+    // SlicerLayer::tryFaceNextSegmentIdx relies on the segments being ordered by face index.
+    ThreadPool::parallelFor(0, chunk_count, [&](int32_t chunk_idx)
+    {
+        const int32_t chunk_layer_start = chunk_idx * chunk_layer_count;
+        const int32_t chunk_layer_end = std::min(slice_layer_count, chunk_layer_start + chunk_layer_count);
+        std::vector<unsigned int> active_faces;
+        active_faces.swap(chunk_initial_active_faces[chunk_idx]);
+        std::vector<unsigned int> merged_faces;
+        for (int32_t layer_nr = chunk_layer_start; layer_nr < chunk_layer_end; layer_nr++)
+        {
+            const unsigned int* starting_faces_begin = faces_by_layer_min.data() + layer_face_start[layer_nr];
+            const unsigned int* starting_faces_end = faces_by_layer_min.data() + layer_face_start[layer_nr + 1];
+            if (starting_faces_begin != starting_faces_end)
+            {
+                merged_faces.clear();
+                std::merge(active_faces.begin(), active_faces.end(), starting_faces_begin, starting_faces_end, std::back_inserter(merged_faces));
+                active_faces.swap(merged_faces);
             }
 
-            else if (p2.z < z && p1.z >= z && p0.z >= z)
+            SlicerLayer& layer = layers[layer_nr];
+            for (unsigned int face_idx : active_faces)
             {
-                s = project2D(p2, p1, p0, z);
-                end_edge_idx = 2;
-                if (p0.z == z)
+                SlicerSegment s;
+                if (sliceFace(face_idx, &face_vertex_z[face_idx * 3], layer.z, s))
                 {
-                    s.endVertex = &v0;
+                    layer.segments.push_back(s);
                 }
             }
-            else if (p2.z > z && p1.z < z && p0.z < z)
-            {
-                s = project2D(p2, p0, p1, z);
-                end_edge_idx = 1;
-            }
-            else
-            {
-                //Not all cases create a segment, because a point of a face could create just a dot, and two touching faces
-                //  on the slice would create two segments
-                continue;
-            }
-            layers[layer_nr].face_idx_to_segment_idx.insert(std::make_pair(mesh_idx, layers[layer_nr].segments.size()));
-            s.faceIndex = mesh_idx;
-            s.endOtherFaceIdx = face.connected_face_index[end_edge_idx];
-            s.addedToPolygon = false;
-            layers[layer_nr].segments.push_back(s);
+
+            active_faces.erase(std::remove_if(active_faces.begin(), active_faces.end(), [&face_layer_max, layer_nr](unsigned int face_idx) { return face_layer_max[face_idx] == layer_nr; }), active_faces.end());
         }
+    });
+}
+
+Slicer::Slicer(Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keep_none_closed, bool extensive_stitching)
+: Slicer(mesh, getUniformSliceZ(initial, thickness, slice_layer_count), keep_none_closed, extensive_stitching)
+{
+}
+
+Slicer::Slicer(Mesh* mesh, const std::vector<int>& slice_z, bool keep_none_closed, bool extensive_stitching)
+: mesh(mesh)
+{
+    assert(!slice_z.empty());
+    const int32_t slice_layer_count = slice_z.size();
+
+    Profiler::Zone zone("sliceMesh");
+    TimeKeeper slice_timer;
+
+    layers.resize(slice_layer_count);
+
+
+    for(int32_t layer_nr = 0; layer_nr < slice_layer_count; layer_nr++)
+    {
+        layers[layer_nr].z = slice_z[layer_nr];
     }
+
+    generateSegments(slice_z);
     log("slice of mesh took %.3f seconds\n",slice_timer.restart());
 
-    std::vector<SlicerLayer>& layers_ref = layers; // force layers not to be copied into the threads
-#pragma omp parallel for default(none) shared(mesh,layers_ref) firstprivate(keep_none_closed, extensive_stitching)
-    for(unsigned int layer_nr=0; layer_nr<layers_ref.size(); layer_nr++)
+    // The time to make the polygons of a layer varies wildly: a layer of a broken mesh with thousands of open polylines
+    // can take longer than all other layers together. Start on the layers with the most segments first,
+    // so that the threads don't end up waiting on one expensive layer which was handed out last.
+    std::vector<unsigned int> layers_by_cost(layers.size());
+    for (unsigned int layer_nr = 0; layer_nr < layers.size(); layer_nr++)
     {
-        layers_ref[layer_nr].makePolygons(mesh, keep_none_closed, extensive_stitching);
+        layers_by_cost[layer_nr] = layer_nr;
     }
+    std::stable_sort(layers_by_cost.begin(), layers_by_cost.end(), [this](unsigned int a, unsigned int b) { return layers[a].segments.size() > layers[b].segments.size(); });
+    std::vector<SlicerLayer>& layers_ref = layers; // force layers not to be copied into the threads
+    ThreadPool::parallelFor(0, layers_by_cost.size(), [&](unsigned int order_idx)
+    {
+        layers_ref[layers_by_cost[order_idx]].makePolygons(mesh, keep_none_closed, extensive_stitching);
+    });
 
     mesh->expandXY(mesh->getSettingInMicrons("xy_offset"));
     log("slice make polygons took %.3f seconds\n",slice_timer.restart());
@@ -6,6 +6,7 @@
 
 #include "mesh.h"
 #include "utils/polygon.h"
+#include "utils/polygonUtils.h"
 /*
     The Slicer creates layers of polygons from an optimized 3D model.
     The result of the Slicer is a list of polygons without any order or structure.
@@ -20,8 +21,8 @@ public:
     // The index of the other face connected via the edge that created end
     int endOtherFaceIdx = -1;
     // If end corresponds to a vertex of the mesh, then this is populated
-    // with the vertex that it ended on.
-    const MeshVertex *endVertex = nullptr;
+    // with the index of the vertex that it ended on.
+    int endVertexIdx = -1;
     bool addedToPolygon = false;
 };
 
@@ -46,8 +47,7 @@ public:
 class SlicerLayer
 {
 public:
-    std::vector<SlicerSegment> segments;
-    std::unordered_map<int, int> face_idx_to_segment_idx; // topology
+    std::vector<SlicerSegment> segments; //!< The segments of this layer, ordered by the index of the face they were sliced from. Each face produces at most one segment per layer.
 
     int z = -1;
     Polygons polygons;
@@ -66,27 +66,30 @@ protected:
     /*!
      * Connect the segments into loops which correctly form polygons (don't perform stitching here)
      *
+     * \param[in] mesh The mesh data for which we are connecting sliced segments (The face data is used)
      * \param[in,out] open_polylines The polylines which are stiched, but couldn't be closed into a loop
      */
-    void makeBasicPolygonLoops(Polygons& open_polylines);
+    void makeBasicPolygonLoops(const Mesh* mesh, Polygons& open_polylines);
 
     /*!
      * Connect the segments into a loop, starting from the segment with index \p start_segment_idx
      *
+     * \param[in] mesh The mesh data for which we are connecting sliced segments (The face data is used)
      * \param[in,out] open_polylines The polylines which are stiched, but couldn't be closed into a loop
      * \param[in] start_segment_idx The index into SlicerLayer::segments for the first segment from which to start the polygon loop
      */
-    void makeBasicPolygonLoop(Polygons& open_polylines, unsigned int start_segment_idx);
+    void makeBasicPolygonLoop(const Mesh* mesh, Polygons& open_polylines, unsigned int start_segment_idx);
 
     /*!
      * Get the next segment connected to the end of \p segment.
      * Used to make closed polygon loops.
      * Return ASAP if segment is (also) connected to SlicerLayer::segments[\p start_segment_idx]
      *
+     * \param[in] mesh The mesh data for which we are connecting sliced segments (The face data is used)
      * \param[in] segment The segment from which to start looking for the next
      * \param[in] start_segment_idx The index to the segment which when conected to \p segment will immediately stop looking for further candidates.
      */
-    int getNextSegmentIdx(const SlicerSegment& segment, unsigned int start_segment_idx);
+    int getNextSegmentIdx(const Mesh* mesh, const SlicerSegment& segment, unsigned int start_segment_idx);
 
     /*!
      * Connecting polygons that are not closed yet, as models are not always perfect manifold we need to join some stuff up to get proper polygons.
@@ -107,9 +110,26 @@ protected:
      */
     void stitch(Polygons& open_polylines);
 
-    GapCloserResult findPolygonGapCloser(Point ip0, Point ip1);
+    /*!
+     * Find the shortest way along a polygon between two points which lie on it.
+     *
+     * \param ip0 The first point
+     * \param ip1 The second point
+     * \param c1 Where \p ip0 lies on SlicerLayer::polygons, see \ref SlicerLayer::findPolygonPointClosestTo
+     * \param c2 Where \p ip1 lies on SlicerLayer::polygons
+     * \return The way along the polygon, with a negative length if the points don't lie on the same polygon
+     */
+    GapCloserResult findPolygonGapCloser(Point ip0, Point ip1, const ClosePolygonResult& c1, const ClosePolygonResult& c2) const;
 
-    ClosePolygonResult findPolygonPointClosestTo(Point input);
+    /*!
+     * Find the first segment of SlicerLayer::polygons, in the order of the polygons and their points,
+     * onto which a point projects within 100 micron.
+     *
+     * \param input The point
+     * \param polygon_grid The segments of SlicerLayer::polygons
+     * \return The segment and the projection onto it, with a negative polygon index if there is none
+     */
+    ClosePolygonResult findPolygonPointClosestTo(Point input, const LocToLineGrid& polygon_grid) const;
 
     /*!
      * Try to close up polylines into polygons while they have large gaps in them.
@@ -403,6 +423,9 @@ private:
      * The stitches are returned in a priority_queue that returns them
      * in order from best to worst stitch.
      *
+     * For layers with very many open polylines the search is split over
+     * the threads of the pool, which doesn't change the order of the stitches.
+     *
      * \param open_polylines The polylines to try to stitch together.
      * \param max_dist The maximum distance between end points for an
      *     allowed stitch.
@@ -488,6 +511,21 @@ public:
 
     Slicer(Mesh* mesh, int initial, int thickness, int slice_layer_count, bool keepNoneClosed, bool extensiveStitching);
 
+    /*!
+     * Slice a mesh at the given heights, which needn't be evenly spaced; see \ref AdaptiveLayerHeights
+     *
+     * \param slice_z For each layer the height at which to slice it, in increasing order
+     */
+    Slicer(Mesh* mesh, const std::vector<int>& slice_z, bool keep_none_closed, bool extensive_stitching);
+
+    /*!
+     * Create a slicer for a mesh without slicing it, for layers which have been sliced before; see \ref SliceCache
+     */
+    explicit Slicer(const Mesh* mesh)
+    : mesh(mesh)
+    {
+    }
+
     /*!
      * Linear interpolation
      *
@@ -502,7 +540,7 @@ public:
         return y;
     }
 
-    SlicerSegment project2D(Point3& p0, Point3& p1, Point3& p2, int32_t z) const
+    SlicerSegment project2D(const Point3& p0, const Point3& p1, const Point3& p2, int32_t z) const
     {
         SlicerSegment seg;
 
@@ -515,6 +553,46 @@ public:
     }
 
     void dumpSegmentsToHTML(const char* filename);
+
+protected:
+    /*!
+     * Get the range of layers which could be intersected by a face.
+     *
+     * The range is empty if the face lies between two layers or outside of the sliced layers.
+     *
+     * \param vertex_z The heights of the three vertices of the face
+     * \param slice_z The heights of the layers, in increasing order
+     * \param[out] layer_min The first layer with a height at or above the bottom of the face
+     * \param[out] layer_max The last layer with a height at or below the top of the face
+     */
+    static void getFaceLayerRange(const int32_t* vertex_z, const std::vector<int>& slice_z, int32_t& layer_min, int32_t& layer_max);
+
+    /*!
+     * The heights of evenly spaced layers.
+     */
+    static std::vector<int> getUniformSliceZ(int initial, int thickness, int slice_layer_count);
+
+    /*!
+     * Cut all faces of the mesh by the layers, adding the segments to \ref SlicerLayer::segments
+     *
+     * This is the only step of slicing which visits the faces. Its output, the segments of each layer ordered by face index,
+     * is all that \ref SlicerLayer::makePolygons needs, so this step can be replaced by another implementation of it,
+     * for instance one on another kind of processor, without changing the polygons which are made of the segments.
+     *
+     * \param slice_z The heights of the layers, in increasing order, which have been set as the heights of \ref Slicer::layers
+     */
+    void generateSegments(const std::vector<int>& slice_z);
+
+    /*!
+     * Compute the segment where a face intersects the horizontal plane at height \p z.
+     *
+     * \param face_idx The index of the face in the mesh
+     * \param vertex_z The heights of the three vertices of the face
+     * \param z The height at which to slice the face
+     * \param[out] segment The resulting segment, if any
+     * \return Whether the face produces a segment at this height
+     */
+    bool sliceFace(unsigned int face_idx, const int32_t* vertex_z, int32_t z, SlicerSegment& segment) const;
 };
 
 }//namespace cura
@@ -5,20 +5,80 @@
 #include <cmath> // sqrt
 #include <utility> // pair
 #include <deque>
+#include <functional>
+#include <string> // to_string
 #include <cmath> // round
 
-#ifdef _OPENMP
-#include <omp.h>
-#endif // _OPENMP
-
 #include "support.h"
+#include "TreeSupport.h"
 
 #include "utils/math.h"
+#include "utils/ThreadPool.h"
 #include "progress/Progress.h"
 
 namespace cura 
 {
 
+ModelLayerWindowUnions::ModelLayerWindowUnions(const SliceMeshStorage& mesh, int stride, int count)
+: mesh(mesh)
+, stride(stride)
+, count(count)
+, blocks_per_remainder(mesh.layers.size() / stride / count + 1)
+, blocks(new Block[stride * blocks_per_remainder])
+{
+    assert(stride > 0 && count > 0);
+}
+
+ModelLayerWindowUnions::Block& ModelLayerWindowUnions::getBlock(int remainder, int step, int& block_first_step)
+{
+    const int block_idx = step / count;
+    block_first_step = block_idx * count;
+    return blocks[remainder * blocks_per_remainder + block_idx];
+}
+
+Polygons ModelLayerWindowUnions::getHead(int remainder, int last_step)
+{
+    int first_step;
+    Block& block = getBlock(remainder, last_step, first_step);
+    std::lock_guard<std::mutex> lock(block.mutex);
+    while (first_step + static_cast<int>(block.heads.size()) <= last_step)
+    {
+        const int layer_nr = remainder + (first_step + block.heads.size()) * stride;
+        block.heads.emplace_back(block.heads.empty() ? mesh.layers[layer_nr].getOutlines() : block.heads.back().unionPolygons(mesh.layers[layer_nr].getOutlines()));
+    }
+    return block.heads[last_step - first_step];
+}
+
+Polygons ModelLayerWindowUnions::getTail(int remainder, int first_step)
+{
+    int block_first_step;
+    Block& block = getBlock(remainder, first_step, block_first_step);
+    std::lock_guard<std::mutex> lock(block.mutex);
+    if (block.tails.empty())
+    { // the whole block lies within the window, so all its layers exist
+        block.tails.resize(count);
+        const int block_last_step = block_first_step + count - 1;
+        block.tails.back() = mesh.layers[remainder + block_last_step * stride].getOutlines();
+        for (int step = block_last_step - 1; step >= block_first_step; step--)
+        {
+            block.tails[step - block_first_step] = block.tails[step - block_first_step + 1].unionPolygons(mesh.layers[remainder + step * stride].getOutlines());
+        }
+    }
+    return block.tails[first_step - block_first_step];
+}
+
+Polygons ModelLayerWindowUnions::getUnion(int first_layer_nr)
+{
+    assert(first_layer_nr >= 0 && first_layer_nr + (count - 1) * stride < static_cast<int>(mesh.layers.size()));
+    const int remainder = first_layer_nr % stride;
+    const int first_step = first_layer_nr / stride;
+    if (first_step % count == 0)
+    {
+        return getTail(remainder, first_step);
+    }
+    return getTail(remainder, first_step).unionPolygons(getHead(remainder, first_step + count - 1));
+}
+
 bool AreaSupport::handleSupportModifierMesh(SliceDataStorage& storage, const SettingsBaseVirtual& mesh, const Slicer* slicer)
 {
     if (!mesh.getSettingBoolean("anti_overhang_mesh") && !mesh.getSettingBoolean("support_mesh"))
@@ -27,7 +87,7 @@ bool AreaSupport::handleSupportModifierMesh(SliceDataStorage& storage, const Set
     }
     enum ModifierType { ANTI_OVERHANG, SUPPORT_DROP_DOWN, SUPPORT_VANILLA };
     ModifierType modifier_type = (mesh.getSettingBoolean("anti_overhang_mesh"))? ANTI_OVERHANG : ((mesh.getSettingBoolean("support_mesh_drop_down"))? SUPPORT_DROP_DOWN : SUPPORT_VANILLA);
-    for (unsigned int layer_nr = 0; layer_nr < slicer->layers.size(); layer_nr++)
+    ThreadPool::parallelFor(0, slicer->layers.size(), [&](int layer_nr)
     {
         SupportLayer& support_layer = storage.support.supportLayers[layer_nr];
         const SlicerLayer& slicer_layer = slicer->layers[layer_nr];
@@ -43,7 +103,7 @@ bool AreaSupport::handleSupportModifierMesh(SliceDataStorage& storage, const Set
             support_layer.support_mesh.add(slicer_layer.polygons);
             break;
         }
-    }
+    });
     return true;
 }
 
@@ -53,10 +113,28 @@ Polygons AreaSupport::join(const Polygons& supportLayer_up, Polygons& supportLay
     Polygons joined;
     if (conical_support)
     {
-        Polygons insetted = supportLayer_up.offset(-conical_smallest_breadth/2);
-        Polygons small_parts = supportLayer_up.difference(insetted.offset(conical_smallest_breadth/2+20));
-        joined = supportLayer_this.unionPolygons(supportLayer_up.offset(conical_support_offset))
-                                .unionPolygons(small_parts);
+        // The layers are joined one after the other, so the parts of a layer which only depend on the layer above
+        // are computed at the same time: the small parts in a task of the pool, the conical offset by this thread.
+        Polygons small_parts;
+        const std::function<void ()> compute_small_parts = [&supportLayer_up, &small_parts, conical_smallest_breadth]()
+            {
+                Polygons insetted = supportLayer_up.offset(-conical_smallest_breadth/2);
+                small_parts = supportLayer_up.difference(insetted.offset(conical_smallest_breadth/2+20));
+            };
+        {
+            ThreadPool::TaskGroup small_parts_task;
+            if (ThreadPool::getThreadCount() > 1)
+            {
+                small_parts_task.run(compute_small_parts);
+            }
+            else
+            {
+                compute_small_parts();
+            }
+            joined = supportLayer_this.unionPolygons(supportLayer_up.offset(conical_support_offset));
+            small_parts_task.wait(); // passes on an exception of the task, which the destructor would drop
+        }
+        joined = joined.unionPolygons(small_parts);
     }
     else 
     {
@@ -110,13 +188,14 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int l
         }
     }
     storage.support.layer_nr_max_filled_layer = std::max(storage.support.layer_nr_max_filled_layer, max_layer_nr_support_mesh_filled);
-    for (int layer_nr = 0; layer_nr < max_layer_nr_support_mesh_filled; layer_nr++)
+    // the modifier meshes may reach above the support mesh areas, so all layers are united
+    ThreadPool::parallelFor(0, storage.support.supportLayers.size(), [&](int layer_nr)
     {
-        SupportLayer& support_layer = storage.support.supportLayers[max_layer_nr_support_mesh_filled];
-        support_layer.anti_overhang = support_layer.anti_overhang.unionPolygons();
-        support_layer.support_mesh_drop_down = support_layer.support_mesh_drop_down.unionPolygons();
-        support_layer.support_mesh = support_layer.support_mesh.unionPolygons();
-    }
+        SupportLayer& support_layer = storage.support.supportLayers[layer_nr];
+        support_layer.anti_overhang = support_layer.anti_overhang.unionPolygonsInClusters();
+        support_layer.support_mesh_drop_down = support_layer.support_mesh_drop_down.unionPolygonsInClusters();
+        support_layer.support_mesh = support_layer.support_mesh.unionPolygonsInClusters();
+    });
 
     // initialization of supportAreasPerLayer
     if (layer_count > storage.support.supportLayers.size())
@@ -164,18 +243,25 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, unsigned int l
         }
         std::vector<Polygons> supportAreas;
         supportAreas.resize(layer_count, Polygons());
-        generateSupportAreas(storage, *infill_settings, *roof_settings, *bottom_settings, mesh_idx, layer_count, supportAreas);
+        if (!mesh.getSettingBoolean("support_mesh") && TreeSupport::isEnabled(mesh))
+        {
+            TreeSupport::generateSupportAreas(storage, *infill_settings, mesh_idx, layer_count, supportAreas);
+        }
+        else
+        {
+            generateSupportAreas(storage, *infill_settings, *roof_settings, *bottom_settings, mesh_idx, layer_count, supportAreas);
+        }
 
         for (unsigned int layer_idx = 0; layer_idx < layer_count; layer_idx++)
         {
-            storage.support.supportLayers[layer_idx].supportAreas.add(supportAreas[layer_idx]);
+            storage.support.supportLayers[layer_idx].supportAreas.add(std::move(supportAreas[layer_idx]));
         }
     }
 
     for (unsigned int layer_idx = 0; layer_idx < layer_count ; layer_idx++)
     {
         Polygons& support_areas = storage.support.supportLayers[layer_idx].supportAreas;
-        support_areas = support_areas.unionPolygons();
+        support_areas = support_areas.unionPolygonsInClusters();
     }
 
     // handle support interface
@@ -229,7 +315,7 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, const Settings
         return;
     }
 
-    const int layerThickness = storage.getSettingInMicrons("layer_height");
+    const int layerThickness = storage.getMinLayerThickness(); // with adaptive layer heights the distances are counted in the thinnest layers, so that they're never too small
 
 
     int support_infill_extruder_nr = storage.getSettingAsIndex("support_infill_extruder_nr");
@@ -331,46 +417,47 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, const Settings
     std::vector<Polygons> full_overhang_per_layer;
     xy_disallowed_per_layer.resize(support_layer_count);
     full_overhang_per_layer.resize(support_layer_count);
-    #pragma omp parallel for default(none) shared(xy_disallowed_per_layer, full_overhang_per_layer, support_layer_count, storage, mesh, max_dist_from_lower_layer, tanAngle) schedule(dynamic)
-    for (unsigned int layer_idx = 1; layer_idx < support_layer_count; layer_idx++)
+    ThreadPool::parallelFor(1, support_layer_count, [&](unsigned int layer_idx)
     {
-        Polygons outlines = storage.getLayerOutlines(layer_idx, false);
         if (!is_support_modifier_place_holder)
         { // don't compute overhang for support meshes
             std::pair<Polygons, Polygons> basic_and_full_overhang = computeBasicAndFullOverhang(storage, mesh, layer_idx, max_dist_from_lower_layer);
-            full_overhang_per_layer[layer_idx] = basic_and_full_overhang.second;
+            full_overhang_per_layer[layer_idx] = std::move(basic_and_full_overhang.second);
 
-            Polygons basic_overhang = basic_and_full_overhang.first;
-            if (use_support_xy_distance_overhang)
+            // the parts of the support of a layer which don't depend on the support of the layers above it
+            // are computed here, so that the top-down loop below only has to do the joining
+            Polygons& supportLayer_this = full_overhang_per_layer[layer_idx];
+            if (extension_offset)
+            {
+                supportLayer_this = supportLayer_this.offset(extension_offset);
+            }
+            if (use_towers)
             {
-                Polygons xy_overhang_disallowed = basic_overhang.offset(supportZDistanceTop * tanAngle);
-                Polygons xy_non_overhang_disallowed = outlines.difference(basic_overhang.offset(supportXYDistance)).offset(supportXYDistance);
+                // handle straight walls
+                AreaSupport::handleWallStruts(supportLayer_this, supportMinAreaSqrt, supportTowerDiameter);
+            }
 
-                xy_disallowed_per_layer[layer_idx] = xy_overhang_disallowed.unionPolygons(xy_non_overhang_disallowed.unionPolygons(outlines.offset(support_xy_distance_overhang)));
+            Polygons basic_overhang = std::move(basic_and_full_overhang.first);
+            if (use_support_xy_distance_overhang)
+            {
+                xy_disallowed_per_layer[layer_idx] = computeXYDisallowed(storage, layer_idx, basic_overhang, supportZDistanceTop * tanAngle, supportXYDistance, support_xy_distance_overhang);
             }
         }
         if (is_support_modifier_place_holder || !use_support_xy_distance_overhang)
         {
-            xy_disallowed_per_layer[layer_idx] = outlines.offset(supportXYDistance);
+            xy_disallowed_per_layer[layer_idx] = storage.getLayerOutlinesCached(layer_idx, false, false, supportXYDistance);
         }
-    }
+    });
 
     std::vector<Polygons> towerRoofs;
     Polygons stair_removal; // polygons to subtract from support because of stair-stepping
 
     for (unsigned int layer_idx = support_layer_count - 1 - layerZdistanceTop; layer_idx != (unsigned int) -1 ; layer_idx--)
     {
-        Polygons supportLayer_this = full_overhang_per_layer[layer_idx + layerZdistanceTop];;
-
-        if (extension_offset && !is_support_modifier_place_holder)
-        {
-            supportLayer_this = supportLayer_this.offset(extension_offset);
-        }
+        Polygons supportLayer_this = std::move(full_overhang_per_layer[layer_idx + layerZdistanceTop]); // already extended and with wall struts
 
         if (use_towers && !is_support_modifier_place_holder)
         {
-            // handle straight walls
-            AreaSupport::handleWallStruts(supportLayer_this, supportMinAreaSqrt, supportTowerDiameter);
             // handle towers
             AreaSupport::handleTowers(supportLayer_this, towerRoofs, overhang_points, layer_idx, towerRoofExpansionDistance, supportTowerDiameter, supportMinAreaSqrt, layer_count, z_layer_distance_tower);
         }
@@ -399,7 +486,7 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, const Settings
                         const Polygons& support_layer_above = supportAreas[layer_idx + tower_top_layer_count];
                         Point middle = AABB(poly).getMiddle();
                         bool has_support_above = support_layer_above.inside(middle);
-                        bool has_model_below = storage.getLayerOutlines(layer_idx - tower_top_layer_count - bottom_empty_layer_count, false).inside(middle);
+                        bool has_model_below = storage.getLayerOutlinesCached(layer_idx - tower_top_layer_count - bottom_empty_layer_count, false).inside(middle);
                         if (has_support_above && !has_model_below)
                         {
                             Polygons tiny_tower_here;
@@ -430,7 +517,7 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, const Settings
         // move up from model
         moveUpFromModel(storage, stair_removal, supportLayer_this, layer_idx, bottom_empty_layer_count, bottom_stair_step_layer_count, support_bottom_stair_step_width);
 
-        supportAreas[layer_idx] = supportLayer_this;
+        supportAreas[layer_idx] = std::move(supportLayer_this);
 
         Progress::messageProgress(Progress::Stage::SUPPORT, support_layer_count * (mesh_idx + 1) - layer_idx, support_layer_count * storage.meshes.size());
     }
@@ -478,11 +565,10 @@ void AreaSupport::generateSupportAreas(SliceDataStorage& storage, const Settings
         const int max_checking_layer_idx = std::min(static_cast<int>(storage.support.supportLayers.size())
                                                   , static_cast<int>(support_layer_count - (layerZdistanceTop - 1)));
         const size_t max_checking_idx_size_t = std::max(0, max_checking_layer_idx);
-#pragma omp parallel for default(none) shared(supportAreas, support_layer_count, storage) schedule(dynamic)
-        for (size_t layer_idx = 0; layer_idx < max_checking_idx_size_t; layer_idx++)
+        ThreadPool::parallelFor(0, max_checking_idx_size_t, [&](size_t layer_idx)
         {
-            supportAreas[layer_idx] = supportAreas[layer_idx].difference(storage.getLayerOutlines(layer_idx + layerZdistanceTop - 1, false));
-        }
+            supportAreas[layer_idx] = supportAreas[layer_idx].difference(storage.getLayerOutlinesCached(layer_idx + layerZdistanceTop - 1, false));
+        });
     }
 
     for (unsigned int layer_idx = supportAreas.size() - 1; layer_idx != (unsigned int) std::max(-1, storage.support.layer_nr_max_filled_layer) ; layer_idx--)
@@ -554,7 +640,7 @@ void AreaSupport::moveUpFromModel(const SliceDataStorage& storage, Polygons& sta
     }
 
     int bottom_layer_nr = layer_idx - bottom_empty_layer_count;
-    const Polygons bottom_outline = storage.getLayerOutlines(bottom_layer_nr, false);
+    const Polygons& bottom_outline = storage.getLayerOutlinesCached(bottom_layer_nr, false);
 
     Polygons to_be_removed;
     if (bottom_stair_step_layer_count <= 1)
@@ -566,13 +652,13 @@ void AreaSupport::moveUpFromModel(const SliceDataStorage& storage, Polygons& sta
         to_be_removed = stair_removal.unionPolygons(bottom_outline);
         if (layer_idx % bottom_stair_step_layer_count == 0)
         { // update stairs for next step
-            const Polygons supporting_bottom = storage.getLayerOutlines(bottom_layer_nr - 1, false);
+            const Polygons& supporting_bottom = storage.getLayerOutlinesCached(bottom_layer_nr - 1, false);
             const Polygons allowed_step_width = support_areas.intersection(supporting_bottom).offset(support_bottom_stair_step_width);
 
             int step_bottom_layer_nr = bottom_layer_nr - bottom_stair_step_layer_count + 1;
             if (step_bottom_layer_nr >= 0)
             {
-                const Polygons step_bottom_outline = storage.getLayerOutlines(step_bottom_layer_nr, false);
+                const Polygons& step_bottom_outline = storage.getLayerOutlinesCached(step_bottom_layer_nr, false);
                 stair_removal = step_bottom_outline.intersection(allowed_step_width);
             }
             else
@@ -599,16 +685,11 @@ void AreaSupport::moveUpFromModel(const SliceDataStorage& storage, Polygons& sta
 std::pair<Polygons, Polygons> AreaSupport::computeBasicAndFullOverhang(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const unsigned int layer_idx, const int64_t max_dist_from_lower_layer)
 {
     Polygons supportLayer_supportee = mesh.layers[layer_idx].getOutlines();
-    Polygons supportLayer_supporter = storage.getLayerOutlines(layer_idx-1, false);
-
-    Polygons supportLayer_supported =  supportLayer_supporter.offset(max_dist_from_lower_layer);
+    const Polygons& supportLayer_supported = storage.getLayerOutlinesCached(layer_idx - 1, false, false, max_dist_from_lower_layer);
     Polygons basic_overhang = supportLayer_supportee.difference(supportLayer_supported);
 
     const SupportLayer& support_layer = storage.support.supportLayers[layer_idx];
-    if (support_layer.anti_overhang.size())
-    {
-        basic_overhang = basic_overhang.difference(support_layer.anti_overhang);
-    }
+    basic_overhang = subtractAntiOverhang(basic_overhang, support_layer.anti_overhang);
 
 //     Polygons support_extension = basic_overhang.offset(max_dist_from_lower_layer);
 //     support_extension = support_extension.intersection(supportLayer_supported);
@@ -622,6 +703,22 @@ std::pair<Polygons, Polygons> AreaSupport::computeBasicAndFullOverhang(const Sli
     return std::make_pair(basic_overhang, full_overhang);
 }
 
+Polygons AreaSupport::computeXYDisallowed(const SliceDataStorage& storage, unsigned int layer_idx, const Polygons& basic_overhang, coord_t overhang_offset, coord_t xy_distance, coord_t xy_distance_overhang)
+{
+    const std::function<Polygons ()> compute = [&storage, layer_idx, &basic_overhang, overhang_offset, xy_distance, xy_distance_overhang]()
+        {
+            const Polygons& outlines = storage.getLayerOutlinesCached(layer_idx, false);
+            Polygons xy_overhang_disallowed = basic_overhang.offset(overhang_offset);
+            Polygons xy_non_overhang_disallowed = outlines.difference(basic_overhang.offset(xy_distance)).offset(xy_distance);
+            return xy_overhang_disallowed.unionPolygons(xy_non_overhang_disallowed.unionPolygons(storage.getLayerOutlinesCached(layer_idx, false, false, xy_distance_overhang)));
+        };
+    if (basic_overhang.empty())
+    { // the same for all meshes with the same distances
+        const std::string kind = "support_xy_disallowed " + std::to_string(xy_distance) + " " + std::to_string(xy_distance_overhang);
+        return storage.getLayerGeometryCached(layer_idx, kind, compute);
+    }
+    return compute();
+}
 
 void AreaSupport::detectOverhangPoints(
     const SliceDataStorage& storage,
@@ -636,7 +733,7 @@ void AreaSupport::detectOverhangPoints(
 
     overhang_points.resize(layer_count);
 
-    for (int layer_idx = 1; layer_idx < layer_count; layer_idx++)
+    ThreadPool::parallelFor(1, layer_count, [&](int layer_idx)
     {
         const SliceLayer& layer = mesh.layers[layer_idx];
         for (const SliceLayerPart& part : layer.parts)
@@ -658,7 +755,7 @@ void AreaSupport::detectOverhangPoints(
 
                 if (part_poly.size() > 0)
                 {
-                    Polygons part_poly_recomputed = part_poly.difference(storage.support.supportLayers[layer_idx].anti_overhang);
+                    Polygons part_poly_recomputed = subtractAntiOverhang(part_poly, storage.support.supportLayers[layer_idx].anti_overhang);
                     if (part_poly_recomputed.size() == 0)
                     {
                         continue;
@@ -668,7 +765,7 @@ void AreaSupport::detectOverhangPoints(
                 }
             }
         }
-    }
+    });
 }
 
 
@@ -785,60 +882,117 @@ void AreaSupport::handleWallStruts(
 
 void AreaSupport::generateSupportBottom(SliceDataStorage& storage, const SliceMeshStorage& mesh)
 {
-    const unsigned int bottom_layer_count = round_divide(mesh.getSettingInMicrons("support_bottom_height"), storage.getSettingInMicrons("layer_height")); //Number of layers in support bottom.
+    const unsigned int bottom_layer_count = round_divide(mesh.getSettingInMicrons("support_bottom_height"), storage.getMinLayerThickness()); //Number of layers in support bottom.
     if (bottom_layer_count <= 0)
     {
         return;
     }
-    const unsigned int z_distance_bottom = round_up_divide(mesh.getSettingInMicrons("support_bottom_distance"), storage.getSettingInMicrons("layer_height")); //Number of layers between support bottom and model.
-    const unsigned int skip_layer_count = std::max(1u, round_divide(mesh.getSettingInMicrons("support_interface_skip_height"), storage.getSettingInMicrons("layer_height"))); //Resolution of generating support bottoms above model.
+    const unsigned int z_distance_bottom = round_up_divide(mesh.getSettingInMicrons("support_bottom_distance"), storage.getMinLayerThickness()); //Number of layers between support bottom and model.
+    const unsigned int skip_layer_count = std::max(1u, round_divide(mesh.getSettingInMicrons("support_interface_skip_height"), storage.getMinLayerThickness())); //Resolution of generating support bottoms above model.
     const coord_t bottom_line_width = storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex("support_bottom_extruder_nr"))->getSettingInMicrons("support_bottom_line_width");
 
     const unsigned int scan_count = std::max(1u, (bottom_layer_count - 1) / skip_layer_count); //How many measurements to take to generate bottom areas.
     const float z_skip = std::max(1.0f, float(bottom_layer_count - 1) / float(scan_count)); //How many layers to skip between measurements. Using float for better spread, but this is later rounded.
 
+    // with a whole number of layers between the measurements, the unions of the measured layers are shared by the windows of consecutive layers
+    const int window_stride = z_skip;
+    const int window_count = (bottom_layer_count + window_stride - 1) / window_stride;
+    std::unique_ptr<ModelLayerWindowUnions> window_unions;
+    if (z_skip == std::round(z_skip))
+    {
+        window_unions.reset(new ModelLayerWindowUnions(mesh, window_stride, window_count));
+    }
+
     std::vector<SupportLayer>& support_layers = storage.support.supportLayers;
-    for (unsigned int layer_idx = z_distance_bottom; layer_idx < support_layers.size(); layer_idx++)
+    ThreadPool::parallelFor(z_distance_bottom, support_layers.size(), [&](int layer_idx)
     {
-        const unsigned int bottom_layer_idx_below = std::max(0, int(layer_idx) - int(bottom_layer_count) - int(z_distance_bottom));
+        const int unclamped_bottom_layer_idx_below = int(layer_idx) - int(bottom_layer_count) - int(z_distance_bottom);
+        const unsigned int bottom_layer_idx_below = std::max(0, unclamped_bottom_layer_idx_below);
         Polygons mesh_outlines;
-        for (float layer_idx_below = bottom_layer_idx_below; std::round(layer_idx_below) < (int)(layer_idx - z_distance_bottom); layer_idx_below += z_skip)
+        if (window_unions && unclamped_bottom_layer_idx_below >= 0)
+        {
+            mesh_outlines = window_unions->getUnion(bottom_layer_idx_below);
+        }
+        else
         {
-            mesh_outlines.add(mesh.layers[std::round(layer_idx_below)].getOutlines());
+            for (float layer_idx_below = bottom_layer_idx_below; std::round(layer_idx_below) < (int)(layer_idx - z_distance_bottom); layer_idx_below += z_skip)
+            {
+                mesh_outlines.add(mesh.layers[std::round(layer_idx_below)].getOutlines());
+            }
         }
         Polygons bottoms;
         generateSupportInterfaceLayer(support_layers[layer_idx].supportAreas, mesh_outlines, bottom_line_width, bottoms);
         support_layers[layer_idx].support_bottom.add(bottoms);
-    }
+    });
 }
 
 void AreaSupport::generateSupportRoof(SliceDataStorage& storage, const SliceMeshStorage& mesh)
 {
-    const unsigned int roof_layer_count = round_divide(mesh.getSettingInMicrons("support_roof_height"), storage.getSettingInMicrons("layer_height")); //Number of layers in support roof.
+    const unsigned int roof_layer_count = round_divide(mesh.getSettingInMicrons("support_roof_height"), storage.getMinLayerThickness()); //Number of layers in support roof.
     if (roof_layer_count <= 0)
     {
         return;
     }
-    const unsigned int z_distance_top = round_up_divide(mesh.getSettingInMicrons("support_top_distance"), storage.getSettingInMicrons("layer_height")); //Number of layers between support roof and model.
-    const unsigned int skip_layer_count = std::max(1u, round_divide(mesh.getSettingInMicrons("support_interface_skip_height"), storage.getSettingInMicrons("layer_height"))); //Resolution of generating support roof below model.
+    const unsigned int z_distance_top = round_up_divide(mesh.getSettingInMicrons("support_top_distance"), storage.getMinLayerThickness()); //Number of layers between support roof and model.
+    const unsigned int skip_layer_count = std::max(1u, round_divide(mesh.getSettingInMicrons("support_interface_skip_height"), storage.getMinLayerThickness())); //Resolution of generating support roof below model.
     const coord_t roof_line_width = storage.meshgroup->getExtruderTrain(storage.getSettingAsIndex("support_roof_extruder_nr"))->getSettingInMicrons("support_roof_line_width");
 
     const unsigned int scan_count = std::max(1u, (roof_layer_count - 1) / skip_layer_count); //How many measurements to take to generate roof areas.
     const float z_skip = std::max(1.0f, float(roof_layer_count - 1) / float(scan_count)); //How many layers to skip between measurements. Using float for better spread, but this is later rounded.
 
+    // with a whole number of layers between the measurements, the unions of the measured layers are shared by the windows of consecutive layers
+    const int window_stride = z_skip;
+    const int window_count = (roof_layer_count + window_stride - 1) / window_stride;
+    std::unique_ptr<ModelLayerWindowUnions> window_unions;
+    if (z_skip == std::round(z_skip))
+    {
+        window_unions.reset(new ModelLayerWindowUnions(mesh, window_stride, window_count));
+    }
+
     std::vector<SupportLayer>& support_layers = storage.support.supportLayers;
-    for (unsigned int layer_idx = 0; static_cast<int>(layer_idx) < static_cast<int>(support_layers.size() - z_distance_top); layer_idx++)
+    ThreadPool::parallelFor(0, static_cast<int>(support_layers.size() - z_distance_top), [&](int layer_idx)
     {
-        const unsigned int top_layer_idx_above = std::min(static_cast<unsigned int>(support_layers.size() - 1), layer_idx + roof_layer_count + z_distance_top); //Maximum layer of the model that generates support roof.
+        const unsigned int unclamped_top_layer_idx_above = layer_idx + roof_layer_count + z_distance_top;
+        const unsigned int top_layer_idx_above = std::min(static_cast<unsigned int>(support_layers.size() - 1), unclamped_top_layer_idx_above); //Maximum layer of the model that generates support roof.
         Polygons mesh_outlines;
-        for (float layer_idx_above = top_layer_idx_above; layer_idx_above > layer_idx + z_distance_top; layer_idx_above -= z_skip)
+        if (window_unions && top_layer_idx_above == unclamped_top_layer_idx_above)
+        {
+            mesh_outlines = window_unions->getUnion(top_layer_idx_above - (window_count - 1) * window_stride);
+        }
+        else
         {
-            mesh_outlines.add(mesh.layers[std::round(layer_idx_above)].getOutlines());
+            for (float layer_idx_above = top_layer_idx_above; layer_idx_above > layer_idx + z_distance_top; layer_idx_above -= z_skip)
+            {
+                mesh_outlines.add(mesh.layers[std::round(layer_idx_above)].getOutlines());
+            }
         }
         Polygons roofs;
         generateSupportInterfaceLayer(support_layers[layer_idx].supportAreas, mesh_outlines, roof_line_width, roofs);
         support_layers[layer_idx].support_roof.add(roofs);
+    });
+}
+
+Polygons AreaSupport::subtractAntiOverhang(const Polygons& areas, const Polygons& anti_overhang)
+{
+    if (areas.empty() || anti_overhang.empty())
+    {
+        return areas;
+    }
+    // holes lie within the bounding box of the polygon around them, so they are only left out together with it or when they don't hit the areas
+    const AABB areas_aabb(areas);
+    Polygons near_anti_overhang;
+    for (ConstPolygonRef poly : anti_overhang)
+    {
+        if (areas_aabb.hit(AABB(poly)))
+        {
+            near_anti_overhang.add(poly);
+        }
+    }
+    if (near_anti_overhang.empty())
+    {
+        return areas;
     }
+    return areas.difference(near_anti_overhang);
 }
 
 void AreaSupport::generateSupportInterfaceLayer(Polygons& support_areas, const Polygons colliding_mesh_outlines, const coord_t safety_offset, Polygons& interface_polygons)
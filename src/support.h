@@ -5,6 +5,9 @@
 #ifndef SUPPORT_H
 #define SUPPORT_H
 
+#include <memory> // unique_ptr
+#include <mutex>
+
 #include "sliceDataStorage.h"
 #include "MeshGroup.h"
 #include "commandSocket.h"
@@ -12,6 +15,66 @@
 
 namespace cura {
 
+/*!
+ * The unions of the outlines of a mesh over windows of layers which lie a fixed number of layers apart,
+ * reusing the unions of the overlapping windows of consecutive layers.
+ *
+ * A window holds \p count layers, each \p stride layers above the previous one. The layers with the same remainder
+ * of their number divided by the stride form a sequence, which is divided into blocks of \p count layers.
+ * Like \ref SkinLayerWindowIntersections, the unions from the start of each block up to each of its layers (heads)
+ * and from each of its layers up to the end of the block (tails) are kept, and any window is the tail of one block
+ * united with the head of the next block.
+ *
+ * Windows can be requested from multiple threads at once.
+ */
+class ModelLayerWindowUnions
+{
+public:
+    /*!
+     * \param mesh The mesh of which to unite the outlines
+     * \param stride The number of layers between the layers of a window
+     * \param count The number of layers in a window
+     */
+    ModelLayerWindowUnions(const SliceMeshStorage& mesh, int stride, int count);
+
+    /*!
+     * Get the union of the outlines of the layers \p first_layer_nr, \p first_layer_nr + stride, and so on up to count layers.
+     * The last layer of the window must exist.
+     *
+     * \param first_layer_nr The lowest layer of the window
+     */
+    Polygons getUnion(int first_layer_nr);
+
+private:
+    struct Block
+    {
+        std::mutex mutex; //!< Guards the heads and tails of this block
+        std::vector<Polygons> heads; //!< The union of the first layers of the block, as far as they have been computed
+        std::vector<Polygons> tails; //!< The union of the last layers of the block, once computed
+    };
+
+    const SliceMeshStorage& mesh;
+    const int stride;
+    const int count;
+    const int blocks_per_remainder; //!< The number of blocks of the sequence of layers with the same remainder
+    std::unique_ptr<Block[]> blocks; //!< The blocks of all remainders, those of remainder 0 first
+
+    /*!
+     * Get the block containing the step-th layer of the layers with the given remainder.
+     */
+    Block& getBlock(int remainder, int step, int& block_first_step);
+
+    /*!
+     * Get the union of the first layers of a block, up to and including the layer \p last_step.
+     */
+    Polygons getHead(int remainder, int last_step);
+
+    /*!
+     * Get the union of the last layers of a block, from the layer \p first_step.
+     */
+    Polygons getTail(int remainder, int first_step);
+};
+
 class AreaSupport {
 public:
     /*!
@@ -30,6 +93,41 @@ public:
      * \param layer_count total number of layers
      */
     static void generateSupportAreas(SliceDataStorage& storage, unsigned int layer_count);
+
+    /*!
+     * Compute the basic overhang and full overhang of a layer. 
+     * The basic overhang consists of the parts of this layer which are too far away from the layer below to be supported.
+     * The full overhang consists of the basic overhang extended toward the border of the layer below.
+     * 
+     *             layer 2
+     * layer 1 ______________|
+     * _______|         ^^^^^ basic overhang
+     *         ^^^^^^^^^^^^^^ full overhang
+     * 
+     * \param storage The slice data storage
+     * \param mesh The mesh for which to compute the basic overhangs
+     * \param layer_idx The layer for which to compute the overhang
+     * \param max_dist_from_lower_layer The outward distance from the layer below which can be supported by it
+     * \return a pair of basic overhang and full overhang
+     */
+    static std::pair<Polygons, Polygons> computeBasicAndFullOverhang(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const unsigned int layer_idx, const int64_t max_dist_from_lower_layer);
+
+    /*!
+     * Compute where the support of a layer may not be because it's too close to the model, when the Z distance overrides the X/Y distance.
+     * 
+     * Near the basic overhang the support may be closer to the model, down to \p xy_distance_overhang,
+     * and above the basic overhang it's limited by the top Z distance instead.
+     * Without basic overhang this is the same for all meshes with the same distances, so then it's computed only once per layer.
+     * 
+     * \param storage The slice data storage
+     * \param layer_idx The layer for which to compute the disallowed areas
+     * \param basic_overhang The basic overhang of a mesh in this layer, see \ref AreaSupport::computeBasicAndFullOverhang
+     * \param overhang_offset The distance by which the support stays away from the basic overhang, following from the top Z distance
+     * \param xy_distance The X/Y distance of the support to the model
+     * \param xy_distance_overhang The X/Y distance of the support to the model near the basic overhang
+     * \return The areas where the support may not be
+     */
+    static Polygons computeXYDisallowed(const SliceDataStorage& storage, unsigned int layer_idx, const Polygons& basic_overhang, coord_t overhang_offset, coord_t xy_distance, coord_t xy_distance_overhang);
 private:
     /*!
      * Generate support polygons over all layers for one object.
@@ -143,24 +241,6 @@ private:
         int supportMinAreaSqrt
     );
     
-    /*!
-     * Compute the basic overhang and full overhang of a layer. 
-     * The basic overhang consists of the parts of this layer which are too far away from the layer below to be supported.
-     * The full overhang consists of the basic overhang extended toward the border of the layer below.
-     * 
-     *             layer 2
-     * layer 1 ______________|
-     * _______|         ^^^^^ basic overhang
-     *         ^^^^^^^^^^^^^^ full overhang
-     * 
-     * \param storage The slice data storage
-     * \param mesh The mesh for which to compute the basic overhangs
-     * \param layer_idx The layer for which to compute the overhang
-     * \param max_dist_from_lower_layer The outward distance from the layer below which can be supported by it
-     * \return a pair of basic overhang and full overhang
-     */
-    static std::pair<Polygons, Polygons> computeBasicAndFullOverhang(const SliceDataStorage& storage, const SliceMeshStorage& mesh, const unsigned int layer_idx, const int64_t max_dist_from_lower_layer);
-    
     /*!
      * Adds tower pieces to the current support layer.
      * From below the roof, the towers are added to the normal support layer and handled as normal support area.
@@ -197,6 +277,18 @@ private:
         int supportMinAreaSqrt,
         int supportTowerDiameter
     );
+
+    /*!
+     * Remove the anti overhang areas of a layer from some areas.
+     *
+     * Only the polygons of the anti overhang areas of which the bounding box hits the bounding box of \p areas are subtracted,
+     * so that the blockers elsewhere on the build plate don't slow down the subtraction.
+     *
+     * \param areas The areas from which to remove the anti overhang areas
+     * \param anti_overhang The anti overhang areas of the layer
+     * \return The areas outside of the anti overhang areas
+     */
+    static Polygons subtractAntiOverhang(const Polygons& areas, const Polygons& anti_overhang);
 };
 
 
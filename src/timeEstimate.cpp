@@ -27,6 +27,12 @@ void TimeEstimateCalculator::setFirmwareDefaults(const SettingsBaseVirtual* sett
     max_e_jerk = settings_base->getSettingInMillimetersPerSecond("machine_max_jerk_e");
     minimumfeedrate = settings_base->getSettingInMillimetersPerSecond("machine_minimum_feedrate");
     acceleration = settings_base->getSettingInMillimetersPerSecond("machine_acceleration");
+    lookahead_block_count = settings_base->hasSetting("time_estimate_lookahead_block_count") ? std::max(0, settings_base->getSettingAsCount("time_estimate_lookahead_block_count")) : 0;
+    if (lookahead_block_count > 0)
+    {
+        lookahead_block_count = std::max(2u, lookahead_block_count); // at least one block has to remain after retiring half of them
+        blocks.reserve(lookahead_block_count);
+    }
 }
 
 
@@ -59,6 +65,7 @@ void TimeEstimateCalculator::reset()
 {
     extra_time = 0.0;
     blocks.clear();
+    std::fill(retired_totals.begin(), retired_totals.end(), 0.0);
 }
 
 // Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the 
@@ -219,6 +226,36 @@ void TimeEstimateCalculator::plan(Position newPos, double feedrate, PrintFeature
     calculate_trapezoid_for_block(&block, block.entry_speed/block.nominal_feedrate, safe_speed/block.nominal_feedrate);
     
     blocks.push_back(block);
+
+    if (lookahead_block_count > 0 && blocks.size() >= lookahead_block_count)
+    {
+        retireOldestBlocks();
+    }
+}
+
+// Adds the time it takes to execute the planned trapezoid of a block to the total of its feature.
+static void add_block_time(const TimeEstimateCalculator::Block& block, std::vector<double>& totals)
+{
+    double plateau_distance = block.decelerate_after - block.accelerate_until;
+
+    totals[static_cast<unsigned char>(block.feature)] += acceleration_time_from_distance(block.initial_feedrate, block.accelerate_until, block.acceleration);
+    totals[static_cast<unsigned char>(block.feature)] += plateau_distance / block.nominal_feedrate;
+    totals[static_cast<unsigned char>(block.feature)] += acceleration_time_from_distance(block.final_feedrate, (block.distance - block.decelerate_after), block.acceleration);
+}
+
+void TimeEstimateCalculator::retireOldestBlocks()
+{
+    reverse_pass();
+    forward_pass();
+    recalculate_trapezoids();
+
+    const unsigned int retired_block_count = blocks.size() / 2;
+    for(unsigned int n=0; n<retired_block_count; n++)
+    {
+        add_block_time(blocks[n], retired_totals);
+    }
+    blocks.erase(blocks.begin(), blocks.begin() + retired_block_count);
+    blocks.front().max_entry_speed = blocks.front().entry_speed; // the reverse pass will no longer raise it
 }
 
 std::vector<double> TimeEstimateCalculator::calculate()
@@ -227,16 +264,11 @@ std::vector<double> TimeEstimateCalculator::calculate()
     forward_pass();
     recalculate_trapezoids();
     
-    std::vector<double> totals(static_cast<unsigned char>(PrintFeatureType::NumPrintFeatureTypes), 0.0);
-    totals[static_cast<unsigned char>(PrintFeatureType::NoneType)] = extra_time; // Extra time (pause for minimum layer time, etc) is marked as NoneType
+    std::vector<double> totals = retired_totals;
+    totals[static_cast<unsigned char>(PrintFeatureType::NoneType)] += extra_time; // Extra time (pause for minimum layer time, etc) is marked as NoneType
     for(unsigned int n=0; n<blocks.size(); n++)
     {
-        Block& block = blocks[n];
-        double plateau_distance = block.decelerate_after - block.accelerate_until;
-        
-        totals[static_cast<unsigned char>(block.feature)] += acceleration_time_from_distance(block.initial_feedrate, block.accelerate_until, block.acceleration);
-        totals[static_cast<unsigned char>(block.feature)] += plateau_distance / block.nominal_feedrate;
-        totals[static_cast<unsigned char>(block.feature)] += acceleration_time_from_distance(block.final_feedrate, (block.distance - block.decelerate_after), block.acceleration);
+        add_block_time(blocks[n], totals);
     }
     return totals;
 }
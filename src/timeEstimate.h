@@ -77,6 +77,13 @@ private:
     Position currentPosition;
 
     std::vector<Block> blocks;
+
+    /*!
+     * The number of blocks to plan ahead before the oldest blocks are retired, like the lookahead buffer of the firmware.
+     * If zero, all blocks since the last reset are planned together.
+     */
+    unsigned int lookahead_block_count = 0;
+    std::vector<double> retired_totals = std::vector<double>(static_cast<unsigned char>(PrintFeatureType::NumPrintFeatureTypes), 0.0); //!< The time per feature of the blocks which have been retired from \ref TimeEstimateCalculator::blocks
 public:
     /*!
      * Set the movement configuration of the firmware.
@@ -98,6 +105,13 @@ private:
     void reverse_pass();
     void forward_pass();
     void recalculate_trapezoids();
+
+    /*!
+     * Plan the blocks in the lookahead buffer and retire the oldest half of them, adding their time to \ref TimeEstimateCalculator::retired_totals.
+     * 
+     * The entry speed of the oldest remaining block is fixed from then on, since the retired block before it ends at that speed.
+     */
+    void retireOldestBlocks();
     
     void calculate_trapezoid_for_block(Block *block, double entry_factor, double exit_factor);
     void planner_reverse_pass_kernel(Block *previous, Block *current, Block *next);
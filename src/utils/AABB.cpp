@@ -58,6 +58,17 @@ void AABB::calculate(ConstPolygonRef poly)
     }
 }
 
+std::vector<AABB> AABB::calculatePerPolygon(const Polygons& polys)
+{
+    std::vector<AABB> aabbs;
+    aabbs.reserve(polys.size());
+    for (ConstPolygonRef poly : polys)
+    {
+        aabbs.emplace_back(poly);
+    }
+    return aabbs;
+}
+
 bool AABB::hit(const AABB& other) const
 {
     if (max.X < other.min.X) return false;
@@ -67,6 +78,11 @@ bool AABB::hit(const AABB& other) const
     return true;
 }
 
+bool AABB::contains(const Point& point) const
+{
+    return point.X >= min.X && point.X <= max.X && point.Y >= min.Y && point.Y <= max.Y;
+}
+
 void AABB::include(Point point)
 {
     min.X = std::min(min.X,point.X);
@@ -3,6 +3,8 @@
 #define UTILS_AABB_H
 
 
+#include <vector>
+
 #include "intpoint.h"
 #include "polygon.h"
 
@@ -25,6 +27,14 @@ public:
     void calculate(const Polygons& polys); //!< Calculates the aabb for the given polygons (throws away old min and max data of this aabb)
     void calculate(ConstPolygonRef poly); //!< Calculates the aabb for the given polygon (throws away old min and max data of this aabb)
 
+    /*!
+     * Compute the bounding box of each polygon separately.
+     * 
+     * \param polys The polygons
+     * \return The bounding box of each polygon, in the same order as \p polys
+     */
+    static std::vector<AABB> calculatePerPolygon(const Polygons& polys);
+
     /*!
      * Get the middle of the bounding box
      */
@@ -40,6 +50,14 @@ public:
      */
     bool hit(const AABB& other) const;
 
+    /*!
+     * Check whether a point lies inside this aabb or on its border.
+     * 
+     * \param point The point to check
+     * \return Whether the point lies inside this aabb or on its border
+     */
+    bool contains(const Point& point) const;
+
     /*!
      * \brief Includes the specified point in the bounding box.
      * 
@@ -0,0 +1,44 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "Arena.h"
+
+#include <algorithm> // min
+
+namespace cura
+{
+
+void* Arena::allocateFromNewBlock(size_t bytes, size_t alignment)
+{
+    // new char[] is aligned for any fundamental type, extra space is only needed for larger alignments
+    const size_t size = bytes + ((alignment > alignof(std::max_align_t))? alignment : 0);
+    if (size > block_size / 4)
+    { // a block of its own, so that the rest of the current block can still be used
+        large_blocks.emplace_back(new char[size]);
+        large_bytes += size;
+        char* block = large_blocks.back().get();
+        const size_t start = (alignment - reinterpret_cast<uintptr_t>(block) % alignment) % alignment;
+        return block + start;
+    }
+    if (used_block_count == blocks.size())
+    {
+        blocks.emplace_back(new char[block_size]);
+    }
+    current = blocks[used_block_count++].get();
+    current_size = block_size;
+    current_used = 0;
+    return allocate(bytes, alignment);
+}
+
+void Arena::reset(size_t max_kept_bytes)
+{
+    large_blocks.clear();
+    large_bytes = 0;
+    blocks.resize(std::min(blocks.size(), max_kept_bytes / block_size));
+    used_block_count = 0;
+    current = nullptr;
+    current_used = 0;
+    current_size = 0;
+}
+
+}//namespace cura
@@ -0,0 +1,141 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_ARENA_H
+#define UTILS_ARENA_H
+
+#include <cstddef>
+#include <cstdint> // uintptr_t
+#include <memory>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Memory for many small objects which are all freed at the same time, like the points of the paths of a layer plan.
+ *
+ * Memory is handed out from large blocks by moving a pointer forward, and is only freed when the arena is destroyed or reset.
+ * This replaces thousands of small allocations and frees by a few large ones.
+ *
+ * An arena isn't thread safe, it must only be used by one thread at a time.
+ */
+class Arena : NoCopy
+{
+public:
+    /*!
+     * \param block_size The size of the blocks to hand out memory from.
+     * Larger allocations get a block of their own.
+     */
+    Arena(size_t block_size = 64 * 1024)
+    : block_size(block_size)
+    , current(nullptr)
+    , current_used(0)
+    , current_size(0)
+    , used_block_count(0)
+    , large_bytes(0)
+    {
+    }
+
+    /*!
+     * Get memory which is valid until the arena is reset or destroyed.
+     *
+     * \param bytes The size of the memory
+     * \param alignment The alignment of the memory, which must be a power of two
+     */
+    void* allocate(size_t bytes, size_t alignment)
+    {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(current) + current_used;
+        const size_t start = current_used + (((address + alignment - 1) & ~(alignment - 1)) - address);
+        if (current && start + bytes <= current_size)
+        {
+            current_used = start + bytes;
+            return current + start;
+        }
+        return allocateFromNewBlock(bytes, alignment);
+    }
+
+    /*!
+     * Free all memory handed out.
+     *
+     * The blocks of the regular size are kept to hand out memory from again, up to a limit,
+     * so that an arena which is used again for a similar amount of memory doesn't need to allocate anything.
+     *
+     * \param max_kept_bytes The maximum number of bytes of the blocks kept
+     */
+    void reset(size_t max_kept_bytes);
+
+    /*!
+     * The number of bytes of the blocks allocated, including the blocks kept by Arena::reset.
+     */
+    size_t getMemoryUsage() const
+    {
+        return blocks.size() * block_size + large_bytes;
+    }
+
+private:
+    size_t block_size; //!< The size of the blocks to hand out memory from
+    std::vector<std::unique_ptr<char[]>> blocks; //!< The blocks of the regular size, of which the first Arena::used_block_count are in use
+    std::vector<std::unique_ptr<char[]>> large_blocks; //!< The blocks allocated for a single large allocation each
+    char* current; //!< The block memory is handed out from, or nullptr if none is in use
+    size_t current_used; //!< The number of bytes of the current block handed out
+    size_t current_size; //!< The size of the current block
+    size_t used_block_count; //!< The number of regular blocks from which memory has been handed out
+    size_t large_bytes; //!< The size of the large blocks together
+
+    void* allocateFromNewBlock(size_t bytes, size_t alignment);
+};
+
+/*!
+ * Allocator for the standard containers which takes memory from an Arena.
+ *
+ * Memory isn't freed when the container gives it back, but when the arena is reset or destroyed,
+ * so a container which grows leaves its previous buffers unused in the arena.
+ * Containers must not be used after their arena is reset or destroyed.
+ */
+template<typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    ArenaAllocator(Arena& arena)
+    : arena(&arena)
+    {
+    }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+    : arena(other.arena)
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t)
+    { // freed along with the arena
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const
+    {
+        return arena != other.arena;
+    }
+
+    Arena* arena; //!< The arena to take memory from
+};
+
+}//namespace cura
+
+#endif//UTILS_ARENA_H
@@ -0,0 +1,110 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "AsyncOutputBuffer.h"
+
+#include <algorithm> // max
+
+#include "logoutput.h"
+
+namespace cura
+{
+
+AsyncOutputBuffer::AsyncOutputBuffer(std::streambuf* destination, size_t buffer_size)
+: destination(destination)
+, filling(std::max(static_cast<size_t>(1), buffer_size))
+, writing(filling.size())
+, writing_size(0)
+, failed(false)
+, stopping(false)
+{
+    setp(filling.data(), filling.data() + filling.size());
+    writer = std::thread([this]()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                handed_over.wait(lock, [this]() { return writing_size > 0 || stopping; });
+                if (writing_size == 0)
+                { // stopping, and everything has been written
+                    return;
+                }
+                const std::streamsize size = writing_size;
+                lock.unlock(); // the buffer being written isn't touched by the other thread until writing_size is reset
+                const bool success = this->destination->sputn(writing.data(), size) == size;
+                lock.lock();
+                if (!success && !failed)
+                {
+                    failed = true;
+                    logError("Failed to write the gcode to the output.\n");
+                }
+                writing_size = 0;
+                written.notify_all();
+            }
+        });
+}
+
+AsyncOutputBuffer::~AsyncOutputBuffer()
+{
+    sync();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    handed_over.notify_one();
+    writer.join();
+}
+
+AsyncOutputBuffer::int_type AsyncOutputBuffer::overflow(int_type c)
+{
+    if (!handOver())
+    {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int AsyncOutputBuffer::sync()
+{
+    if (!handOver() || !waitUntilWritten())
+    {
+        return -1;
+    }
+    return destination->pubsync();
+}
+
+bool AsyncOutputBuffer::handOver()
+{
+    const size_t size = pptr() - pbase();
+    std::unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [this]() { return writing_size == 0; });
+    if (failed)
+    {
+        setp(filling.data(), filling.data() + filling.size()); // discard the data, so that the writer doesn't keep waiting on a full buffer
+        return false;
+    }
+    if (size == 0)
+    {
+        return true;
+    }
+    filling.swap(writing);
+    writing_size = size;
+    setp(filling.data(), filling.data() + filling.size());
+    lock.unlock();
+    handed_over.notify_one();
+    return true;
+}
+
+bool AsyncOutputBuffer::waitUntilWritten()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [this]() { return writing_size == 0; });
+    return !failed;
+}
+
+}//namespace cura
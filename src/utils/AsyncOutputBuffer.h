@@ -0,0 +1,81 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_ASYNC_OUTPUT_BUFFER_H
+#define UTILS_ASYNC_OUTPUT_BUFFER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Stream buffer which writes to another stream buffer on a thread of its own, so that slow storage doesn't stall the writer.
+ *
+ * The data is collected in one of two large buffers. When it is full it is handed over to the writing thread,
+ * which writes it to the destination in one go while the other buffer is filled.
+ * Only when the writing thread is still busy with the previous buffer once the next one is full does the writer have to wait.
+ *
+ * Flushing the stream waits until everything written before has reached the destination,
+ * after which the destination can be used directly, for instance to seek in it.
+ *
+ * Use it as the buffer of an std::ostream, which can then be handed to \ref GCodeExport::setOutputStream.
+ */
+class AsyncOutputBuffer : public std::streambuf, NoCopy
+{
+public:
+    /*!
+     * \param destination The stream buffer to write to, which must outlive this buffer and isn't used by anything else until it's flushed
+     * \param buffer_size The size of each of the two buffers
+     */
+    AsyncOutputBuffer(std::streambuf* destination, size_t buffer_size = 4 << 20);
+
+    /*!
+     * Write the remaining data and stop the writing thread.
+     */
+    ~AsyncOutputBuffer();
+
+protected:
+    int_type overflow(int_type c) override;
+
+    /*!
+     * Hand over the data written so far and wait until it has been written to the destination, which is then synced as well.
+     */
+    int sync() override;
+
+private:
+    std::streambuf* destination; //!< Where the data is written to by the writing thread
+    std::vector<char> filling; //!< The buffer which is being filled, which is the put area
+    std::vector<char> writing; //!< The buffer with the data handed over to the writing thread
+    size_t writing_size; //!< The number of bytes in \ref AsyncOutputBuffer::writing which are still to be written, or zero if it's free
+    bool failed; //!< Whether a write to the destination failed, after which all data is discarded
+    bool stopping; //!< Whether the writing thread is to stop once the handed over data has been written
+    std::mutex mutex; //!< Guards \ref AsyncOutputBuffer::writing, writing_size, failed and stopping
+    std::condition_variable handed_over; //!< Notified when data is handed over to the writing thread, or when it's to stop
+    std::condition_variable written; //!< Notified when the writing thread has written the data handed over
+    std::thread writer; //!< The thread writing to the destination
+
+    /*!
+     * Wait until the writing thread is free, and give it the data in the put area.
+     *
+     * \return Whether all data handed over before has been written successfully
+     */
+    bool handOver();
+
+    /*!
+     * Wait until the writing thread has written all data handed over to it.
+     *
+     * \return Whether it has been written successfully
+     */
+    bool waitUntilWritten();
+};
+
+}//namespace cura
+
+#endif//UTILS_ASYNC_OUTPUT_BUFFER_H
@@ -0,0 +1,360 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "BinaryGcode.h"
+
+#include <algorithm> // copy
+#include <cstring> // memchr, memcmp, strchr, strlen
+#include <limits>
+#include <sstream>
+
+#include "string.h" // writeInt2mm, writeDoubleToStream
+
+namespace cura
+{
+
+namespace
+{
+
+constexpr int64_t powers_of_ten[] = { 1, 10, 100, 1000, 10000, 100000 };
+
+constexpr const char feature_type_prefix[] = ";TYPE:";
+
+void writeVarint(uint64_t value, std::string& out)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool readVarint(std::istream& in, uint64_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7)
+    {
+        const int byte = in.get();
+        if (byte == std::char_traits<char>::eof())
+        {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t zigzag(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/*!
+ * Write the value of an axis in the same way as \ref GCodeExport does.
+ *
+ * \return false if the value cannot be written the way GCodeExport writes it
+ */
+bool writeAxis(unsigned int axis, int64_t units, std::ostream& out)
+{
+    const unsigned int decimals = BinaryGcode::axis_decimals[axis];
+    if (decimals == 3)
+    { // coordinates are written as microns
+        if (units < std::numeric_limits<int32_t>::min() || units > std::numeric_limits<int32_t>::max())
+        {
+            return false;
+        }
+        writeInt2mm(static_cast<int32_t>(units), out);
+    }
+    else
+    {
+        writeDoubleToStream(decimals, static_cast<double>(units) / powers_of_ten[decimals], out);
+    }
+    return true;
+}
+
+/*!
+ * Parse a number written by \ref GCodeExport into fixed point units.
+ *
+ * \return false if the number has more decimals than the axis stores, or is out of range
+ */
+bool parseAxis(unsigned int axis, const char* begin, const char* end, int64_t& units)
+{
+    const unsigned int decimals = BinaryGcode::axis_decimals[axis];
+    bool negative = false;
+    if (begin < end && *begin == '-')
+    {
+        negative = true;
+        begin++;
+    }
+    if (begin == end)
+    {
+        return false;
+    }
+    int64_t value = 0;
+    unsigned int digit_count = 0;
+    unsigned int fraction_digits = 0;
+    bool in_fraction = false;
+    for (const char* c = begin; c < end; c++)
+    {
+        if (*c == '.' && !in_fraction)
+        {
+            in_fraction = true;
+            continue;
+        }
+        if (*c < '0' || *c > '9' || ++digit_count > 15)
+        {
+            return false;
+        }
+        if (in_fraction && ++fraction_digits > decimals)
+        {
+            return false;
+        }
+        value = value * 10 + (*c - '0');
+    }
+    value *= powers_of_ten[decimals - fraction_digits];
+    units = negative ? -value : value;
+    return true;
+}
+
+}//namespace
+
+BinaryGcodeEncoder::BinaryGcodeEncoder(std::ostream& destination)
+: destination(destination)
+{
+    for (unsigned int axis = 0; axis < BinaryGcode::axis_count; axis++)
+    {
+        last_value[axis] = 0;
+    }
+    destination.write(BinaryGcode::magic, strlen(BinaryGcode::magic));
+    destination.put(static_cast<char>(BinaryGcode::version));
+}
+
+BinaryGcodeEncoder::~BinaryGcodeEncoder()
+{
+    sync();
+}
+
+BinaryGcodeEncoder::int_type BinaryGcodeEncoder::overflow(int_type ch)
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        return traits_type::not_eof(ch);
+    }
+    const char c = traits_type::to_char_type(ch);
+    xsputn(&c, 1);
+    return ch;
+}
+
+std::streamsize BinaryGcodeEncoder::xsputn(const char* s, std::streamsize count)
+{
+    const char* end = s + count;
+    while (s < end)
+    {
+        const char* new_line = static_cast<const char*>(memchr(s, '\n', end - s));
+        if (!new_line)
+        {
+            line.append(s, end);
+            break;
+        }
+        line.append(s, new_line);
+        encodeLine();
+        line.clear();
+        s = new_line + 1;
+    }
+    return count;
+}
+
+int BinaryGcodeEncoder::sync()
+{
+    if (!line.empty())
+    {
+        writeLiteral(BinaryGcode::LITERAL_FRAGMENT);
+        line.clear();
+    }
+    destination.flush();
+    return destination ? 0 : -1;
+}
+
+void BinaryGcodeEncoder::encodeLine()
+{
+    const bool crlf = !line.empty() && line.back() == '\r';
+    if (!encodeCompact(crlf))
+    {
+        writeLiteral(BinaryGcode::LITERAL_LINE);
+    }
+}
+
+bool BinaryGcodeEncoder::encodeCompact(bool crlf)
+{
+    const char* begin = line.data();
+    const char* end = begin + line.size() - (crlf ? 1 : 0);
+    std::string record;
+
+    if (line.compare(0, strlen(feature_type_prefix), feature_type_prefix) == 0)
+    {
+        const std::string type(begin + strlen(feature_type_prefix), end);
+        for (unsigned int type_idx = 0; type_idx < BinaryGcode::feature_type_count; type_idx++)
+        {
+            if (type == BinaryGcode::feature_types[type_idx])
+            {
+                record.push_back(static_cast<char>(BinaryGcode::FEATURE_TYPE | (crlf ? BinaryGcode::CRLF : 0)));
+                record.push_back(static_cast<char>(type_idx));
+                destination.write(record.data(), record.size());
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (end - begin < 2 || begin[0] != 'G' || (begin[1] != '0' && begin[1] != '1'))
+    {
+        return false;
+    }
+    record.push_back(static_cast<char>((begin[1] == '0' ? BinaryGcode::MOVE_G0 : BinaryGcode::MOVE_G1) | (crlf ? BinaryGcode::CRLF : 0)));
+
+    int64_t new_value[BinaryGcode::axis_count];
+    std::copy(last_value, last_value + BinaryGcode::axis_count, new_value);
+    std::ostringstream check;
+    const char* word = begin + 2;
+    if (word == end)
+    {
+        return false;
+    }
+    while (word < end)
+    {
+        if (*word != ' ' || word + 1 == end)
+        {
+            return false;
+        }
+        word++;
+        const char* letter = strchr(BinaryGcode::axis_letters, *word);
+        if (!letter || !*letter)
+        {
+            return false;
+        }
+        const unsigned int axis = letter - BinaryGcode::axis_letters;
+        const char* number = word + 1;
+        const char* number_end = static_cast<const char*>(memchr(number, ' ', end - number));
+        if (!number_end)
+        {
+            number_end = end;
+        }
+        int64_t units;
+        if (!parseAxis(axis, number, number_end, units))
+        {
+            return false;
+        }
+        // only encode numbers which the decoder writes back exactly the same, e.g. "1.50" or "-0" are stored literally
+        check.str("");
+        if (!writeAxis(axis, units, check) || check.str().compare(0, std::string::npos, number, number_end - number) != 0)
+        {
+            return false;
+        }
+        record.push_back(static_cast<char>(axis | (number_end == end ? BinaryGcode::LAST_WORD : 0)));
+        writeVarint(zigzag(units - new_value[axis]), record);
+        new_value[axis] = units;
+        word = number_end;
+    }
+
+    std::copy(new_value, new_value + BinaryGcode::axis_count, last_value);
+    destination.write(record.data(), record.size());
+    return true;
+}
+
+void BinaryGcodeEncoder::writeLiteral(uint8_t opcode)
+{
+    std::string record;
+    record.push_back(static_cast<char>(opcode));
+    writeVarint(line.size(), record);
+    destination.write(record.data(), record.size());
+    destination.write(line.data(), line.size());
+}
+
+bool BinaryGcode::decode(std::istream& in, std::ostream& out)
+{
+    char header[sizeof(magic)];
+    if (!in.read(header, sizeof(header)) || memcmp(header, magic, sizeof(magic) - 1) != 0 || static_cast<uint8_t>(header[sizeof(magic) - 1]) != version)
+    {
+        return false;
+    }
+
+    int64_t last_value[axis_count] = { 0, 0, 0, 0, 0 };
+    std::string text;
+    while (true)
+    {
+        const int opcode = in.get();
+        if (opcode == std::char_traits<char>::eof())
+        {
+            return true;
+        }
+        const char* new_line = (opcode & CRLF) ? "\r\n" : "\n";
+        switch (opcode & ~CRLF)
+        {
+            case LITERAL_LINE:
+            case LITERAL_FRAGMENT:
+            {
+                uint64_t length;
+                if (!readVarint(in, length))
+                {
+                    return false;
+                }
+                text.resize(length);
+                if (!in.read(&text[0], length))
+                {
+                    return false;
+                }
+                out << text;
+                if (opcode == LITERAL_LINE)
+                {
+                    out << '\n';
+                }
+                break;
+            }
+            case MOVE_G0:
+            case MOVE_G1:
+            {
+                out << (((opcode & ~CRLF) == MOVE_G0) ? "G0" : "G1");
+                int field;
+                do
+                {
+                    field = in.get();
+                    const unsigned int axis = field & ~LAST_WORD;
+                    uint64_t delta;
+                    if (field == std::char_traits<char>::eof() || axis >= axis_count || !readVarint(in, delta))
+                    {
+                        return false;
+                    }
+                    last_value[axis] += unzigzag(delta);
+                    out << ' ' << axis_letters[axis];
+                    writeAxis(axis, last_value[axis], out);
+                } while (!(field & LAST_WORD));
+                out << new_line;
+                break;
+            }
+            case FEATURE_TYPE:
+            {
+                const int type_idx = in.get();
+                if (type_idx == std::char_traits<char>::eof() || static_cast<unsigned int>(type_idx) >= feature_type_count)
+                {
+                    return false;
+                }
+                out << feature_type_prefix << feature_types[type_idx] << new_line;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+}
+
+}//namespace cura
@@ -0,0 +1,126 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_BINARY_GCODE_H
+#define UTILS_BINARY_GCODE_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+namespace cura
+{
+
+/*!
+ * Compact binary representation of the gcode produced by \ref GCodeExport.
+ *
+ * The file starts with the magic bytes "CBGC" followed by a version byte.
+ * After that the file is a sequence of records, each starting with an opcode byte:
+ * - \ref BinaryGcode::LITERAL_LINE : a varint length followed by that many bytes of text, followed by an implicit new line.
+ * - \ref BinaryGcode::LITERAL_FRAGMENT : as a literal line, but without the implicit new line.
+ * - \ref BinaryGcode::MOVE_G0 / \ref BinaryGcode::MOVE_G1 : a move line.
+ *   It is followed by one word per coordinate in the order in which they occurred in the text.
+ *   Each word is a field byte (the axis, with \ref BinaryGcode::LAST_WORD set on the last word of the line)
+ *   followed by the zigzag varint of the difference with the previous value of that axis, in fixed point units.
+ * - \ref BinaryGcode::FEATURE_TYPE : a byte indexing \ref BinaryGcode::feature_types, for the ";TYPE:" comments.
+ *
+ * \ref BinaryGcode::CRLF can be added to the opcode of a move or feature type record when the line was ended with "\r\n".
+ *
+ * Only lines which are reproduced byte for byte by the decoder are encoded; all other lines are stored literally.
+ * This makes decoding lossless, regardless of the flavor or the start and end gcode.
+ */
+namespace BinaryGcode
+{
+constexpr char magic[] = "CBGC";
+constexpr uint8_t version = 1;
+
+constexpr uint8_t LITERAL_LINE = 0x00;
+constexpr uint8_t LITERAL_FRAGMENT = 0x01;
+constexpr uint8_t MOVE_G0 = 0x02;
+constexpr uint8_t MOVE_G1 = 0x03;
+constexpr uint8_t FEATURE_TYPE = 0x04;
+constexpr uint8_t CRLF = 0x80;
+
+constexpr uint8_t LAST_WORD = 0x80;
+
+/*!
+ * The axes which can be encoded in a move, in the order of their field number.
+ */
+constexpr char axis_letters[] = "FXYZE";
+constexpr unsigned int axis_count = 5;
+
+/*!
+ * The number of decimals stored for each axis, in the same order as \ref BinaryGcode::axis_letters.
+ */
+constexpr unsigned int axis_decimals[axis_count] = { 1, 3, 3, 3, 5 };
+
+/*!
+ * The feature type comments which are encoded as a single byte.
+ */
+constexpr const char* feature_types[] = { "WALL-OUTER", "WALL-INNER", "SKIN", "SUPPORT", "SKIRT", "FILL" };
+constexpr unsigned int feature_type_count = sizeof(feature_types) / sizeof(feature_types[0]);
+
+/*!
+ * Decode a binary gcode stream back to the original gcode text.
+ *
+ * \param in The binary gcode
+ * \param out The stream to write the gcode text to
+ * \return Whether the input was a valid binary gcode stream
+ */
+bool decode(std::istream& in, std::ostream& out);
+}
+
+/*!
+ * Stream buffer which converts the gcode text written to it into binary gcode (see \ref BinaryGcode).
+ *
+ * The text is collected per line; every complete line is encoded onto the destination stream.
+ * Use it as the buffer of an std::ostream, which can then be handed to \ref GCodeExport::setOutputStream.
+ */
+class BinaryGcodeEncoder : public std::streambuf
+{
+public:
+    /*!
+     * \param destination The stream to write the binary gcode to. The header is written immediately.
+     */
+    BinaryGcodeEncoder(std::ostream& destination);
+
+    /*!
+     * Writes the unfinished line, if any, and flushes the destination.
+     */
+    ~BinaryGcodeEncoder();
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize count) override;
+
+    /*!
+     * Write the unfinished line as a literal fragment, so that everything written so far ends up in the destination.
+     */
+    int sync() override;
+
+private:
+    std::ostream& destination;
+    std::string line; //!< The text of the current line, without the new line character
+    int64_t last_value[BinaryGcode::axis_count]; //!< The last encoded value of each axis, in fixed point units
+
+    /*!
+     * Encode the current line, which was ended by a new line character.
+     */
+    void encodeLine();
+
+    /*!
+     * Try to encode the current line as a move or feature type record.
+     *
+     * \param crlf Whether the line is ended by "\r\n", in which case \ref BinaryGcodeEncoder::line still contains the '\r'
+     * \return Whether the line could be encoded; if not, nothing has been written
+     */
+    bool encodeCompact(bool crlf);
+
+    void writeLiteral(uint8_t opcode);
+};
+
+}//namespace cura
+
+#endif//UTILS_BINARY_GCODE_H
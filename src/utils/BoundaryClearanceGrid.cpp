@@ -0,0 +1,205 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "BoundaryClearanceGrid.h"
+
+#include <algorithm> // min, max, sort
+#include <utility> // pair
+
+namespace cura
+{
+
+constexpr unsigned int BoundaryClearanceGrid::near_boundary;
+
+BoundaryClearanceGrid::BoundaryClearanceGrid(const Polygons& polygons, const std::vector<unsigned int>& poly_part_idx, unsigned int part_count, coord_t clearance)
+: origin(0, 0)
+, cell_size(1)
+, column_count(0)
+, row_count(0)
+{
+    unsigned int point_count = 0;
+    Point min(0, 0);
+    Point max(0, 0);
+    for (ConstPolygonRef poly : polygons)
+    {
+        for (const Point& point : poly)
+        {
+            if (point_count == 0)
+            {
+                min = max = point;
+            }
+            min.X = std::min(min.X, point.X);
+            min.Y = std::min(min.Y, point.Y);
+            max.X = std::max(max.X, point.X);
+            max.Y = std::max(max.Y, point.Y);
+            point_count++;
+        }
+    }
+    if (point_count == 0)
+    { // no parts, so everything is outside
+        return;
+    }
+    origin = min - Point(clearance, clearance);
+    const coord_t width = max.X + clearance - origin.X + 1;
+    const coord_t height = max.Y + clearance - origin.Y + 1;
+    // cells no smaller than the clearance, since they are marked near a segment by the clearance anyway, but no more than 512 in either direction
+    cell_size = std::max(clearance, std::max(width, height) / 512 + 1);
+    column_count = (width - 1) / cell_size + 1;
+    row_count = (height - 1) / cell_size + 1;
+    cells.assign(column_count * row_count, NO_INDEX);
+
+    const bool all_polygons_in_parts = std::find(poly_part_idx.begin(), poly_part_idx.end(), NO_INDEX) == poly_part_idx.end();
+    if (!all_polygons_in_parts || poly_part_idx.size() != polygons.size())
+    { // the cells can't be classified, so nothing is known
+        cells.assign(cells.size(), near_boundary);
+        return;
+    }
+
+    // mark the cells near each segment, in pieces no longer than a cell so that long diagonal segments don't mark a whole rectangle
+    const auto mark_near = [this, clearance](Point a, Point b)
+        {
+            const int column_end = std::min(column_count - 1, toCell(std::max(a.X, b.X) + clearance + 1, origin.X));
+            const int row_end = std::min(row_count - 1, toCell(std::max(a.Y, b.Y) + clearance + 1, origin.Y));
+            for (int row = std::max(0, toCell(std::min(a.Y, b.Y) - clearance - 1, origin.Y)); row <= row_end; row++)
+            {
+                for (int column = std::max(0, toCell(std::min(a.X, b.X) - clearance - 1, origin.X)); column <= column_end; column++)
+                {
+                    cells[row * column_count + column] = near_boundary;
+                }
+            }
+        };
+    for (ConstPolygonRef poly : polygons)
+    {
+        for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+        {
+            const Point a = poly[point_idx];
+            const Point b = poly[(point_idx + 1) % poly.size()];
+            const int64_t piece_count = vSize(b - a) / cell_size + 1;
+            for (int64_t piece_idx = 0; piece_idx < piece_count; piece_idx++)
+            {
+                mark_near(a + (b - a) * piece_idx / piece_count, a + (b - a) * (piece_idx + 1) / piece_count);
+            }
+        }
+    }
+
+    // the crossings of the boundary with the horizontal line through the middle of each row, with the part of the crossed polygon
+    std::vector<std::vector<std::pair<coord_t, unsigned int>>> row_crossings(row_count);
+    const auto first_row_from = [this](coord_t y)
+        { // the first row of which the middle lies at or above y
+            const coord_t offset = y - origin.Y - cell_size / 2;
+            return std::max(0, (offset <= 0)? -static_cast<int>(-offset / cell_size) : static_cast<int>((offset - 1) / cell_size + 1));
+        };
+    for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
+    {
+        ConstPolygonRef poly = polygons[poly_idx];
+        for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+        {
+            const Point& a = poly[point_idx];
+            const Point& b = poly[(point_idx + 1) % poly.size()];
+            if (a.Y == b.Y)
+            {
+                continue;
+            }
+            const int row_end = std::min(row_count, first_row_from(std::max(a.Y, b.Y)));
+            for (int row = first_row_from(std::min(a.Y, b.Y)); row < row_end; row++)
+            {
+                const coord_t y = origin.Y + row * cell_size + cell_size / 2;
+                row_crossings[row].emplace_back(a.X + (y - a.Y) * (b.X - a.X) / (b.Y - a.Y), poly_part_idx[poly_idx]);
+            }
+        }
+    }
+
+    // a point lies in a part when it lies within an odd number of the polygons of that part
+    std::vector<bool> part_parity(part_count, false);
+    for (int row = 0; row < row_count; row++)
+    {
+        std::vector<std::pair<coord_t, unsigned int>>& crossings = row_crossings[row];
+        std::sort(crossings.begin(), crossings.end());
+        unsigned int current_part = NO_INDEX;
+        unsigned int crossing_idx = 0;
+        for (int column = 0; column < column_count; column++)
+        {
+            const coord_t x = origin.X + column * cell_size + cell_size / 2;
+            for (; crossing_idx < crossings.size() && crossings[crossing_idx].first < x; crossing_idx++)
+            {
+                const unsigned int part_idx = crossings[crossing_idx].second;
+                part_parity[part_idx] = !part_parity[part_idx];
+                if (part_parity[part_idx])
+                {
+                    current_part = part_idx;
+                }
+                else if (current_part == part_idx)
+                {
+                    current_part = NO_INDEX;
+                }
+            }
+            unsigned int& cell = cells[row * column_count + column];
+            if (cell != near_boundary)
+            {
+                cell = current_part;
+            }
+        }
+        for (; crossing_idx < crossings.size(); crossing_idx++)
+        { // each polygon is crossed an even number of times, so this leaves all parities even for the next row
+            part_parity[crossings[crossing_idx].second] = !part_parity[crossings[crossing_idx].second];
+        }
+    }
+}
+
+int BoundaryClearanceGrid::toCell(coord_t coord, coord_t origin_coord) const
+{
+    const coord_t offset = coord - origin_coord;
+    return (offset >= 0)? offset / cell_size : -((-offset - 1) / cell_size) - 1;
+}
+
+unsigned int BoundaryClearanceGrid::getFarPart(Point location) const
+{
+    const int column = toCell(location.X, origin.X);
+    const int row = toCell(location.Y, origin.Y);
+    if (column < 0 || column >= column_count || row < 0 || row >= row_count)
+    { // further than the clearance from the bounding box of the boundary
+        return NO_INDEX;
+    }
+    return cells[row * column_count + column];
+}
+
+unsigned int BoundaryClearanceGrid::getFarPart(Point from, Point to) const
+{
+    const unsigned int part_idx = getFarPart(from);
+    if (part_idx >= near_boundary || getFarPart(to) != part_idx)
+    {
+        return near_boundary;
+    }
+    if (from.Y > to.Y)
+    {
+        std::swap(from, to);
+    }
+    // both end points lie within the grid, so each row in between does as well
+    const int last_row = toCell(to.Y, origin.Y);
+    for (int row = toCell(from.Y, origin.Y); row <= last_row; row++)
+    {
+        // the part of the line segment within this row, widened by a unit against the rounding of the intersections
+        const coord_t min_y = std::max(from.Y, origin.Y + row * cell_size);
+        const coord_t max_y = std::min(to.Y, origin.Y + (row + 1) * cell_size - 1);
+        coord_t min_x = std::min(from.X, to.X);
+        coord_t max_x = std::max(from.X, to.X);
+        if (from.Y != to.Y)
+        {
+            const coord_t x_at_min_y = from.X + (to.X - from.X) * (min_y - from.Y) / (to.Y - from.Y);
+            const coord_t x_at_max_y = from.X + (to.X - from.X) * (max_y - from.Y) / (to.Y - from.Y);
+            min_x = std::min(x_at_min_y, x_at_max_y) - 1;
+            max_x = std::max(x_at_min_y, x_at_max_y) + 1;
+        }
+        const int last_column = std::min(column_count - 1, toCell(max_x, origin.X));
+        for (int column = std::max(0, toCell(min_x, origin.X)); column <= last_column; column++)
+        {
+            if (cells[row * column_count + column] != part_idx)
+            {
+                return near_boundary;
+            }
+        }
+    }
+    return part_idx;
+}
+
+}//namespace cura
@@ -0,0 +1,75 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_BOUNDARY_CLEARANCE_GRID_H
+#define UTILS_BOUNDARY_CLEARANCE_GRID_H
+
+#include <vector>
+
+#include "intpoint.h"
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * A coarse sampling of the signed distance to the boundary of some parts: for each cell of a grid over the parts,
+ * whether all of it lies further than a clearance from the boundary, and if so in which part it lies.
+ *
+ * A point in such a cell is known to be inside or outside without going over the polygons, which is what most
+ * points far from the boundary need to know. The points in the other cells need an exact computation.
+ *
+ * The cells are classified in one pass: the cells near a segment are marked from the segments,
+ * and the others are classified by the crossings of the boundary with the horizontal line through their row.
+ */
+class BoundaryClearanceGrid
+{
+public:
+    static constexpr unsigned int near_boundary = NO_INDEX - 1; //!< The cell may be within the clearance of the boundary
+
+    /*!
+     * \param polygons The boundary of the parts, which must not intersect itself
+     * \param poly_part_idx For each polygon the index of the part it belongs to
+     * \param part_count The number of parts
+     * \param clearance The distance from the boundary beyond which a cell is classified
+     */
+    BoundaryClearanceGrid(const Polygons& polygons, const std::vector<unsigned int>& poly_part_idx, unsigned int part_count, coord_t clearance);
+
+    /*!
+     * Get the part in which a point lies, if it lies further than the clearance from the boundary.
+     *
+     * \param location The point to look up
+     * \return The index of the part, NO_INDEX if the point lies outside of all parts, or \ref BoundaryClearanceGrid::near_boundary
+     * if the point may lie within the clearance from the boundary
+     */
+    unsigned int getFarPart(Point location) const;
+
+    /*!
+     * Get the part in which a whole line segment lies, if it lies further than the clearance from the boundary.
+     *
+     * All cells which the line segment passes through are checked, so a segment between two far points in the same part
+     * which cuts a corner of that part is not mistaken for lying inside it.
+     *
+     * \param from The start of the line segment
+     * \param to The end of the line segment
+     * \return The index of the part, or \ref BoundaryClearanceGrid::near_boundary if the line segment may come within the clearance
+     * from the boundary or lies outside of the parts
+     */
+    unsigned int getFarPart(Point from, Point to) const;
+
+private:
+    Point origin; //!< The corner of the first cell, the minimum of the bounding box of the polygons expanded by the clearance
+    coord_t cell_size; //!< The width and height of each cell
+    int column_count; //!< The number of cells in the x direction
+    int row_count; //!< The number of cells in the y direction
+    std::vector<unsigned int> cells; //!< For each cell, row after row, the part it lies in, NO_INDEX or \ref BoundaryClearanceGrid::near_boundary
+
+    /*!
+     * The column or row of the cell containing a coordinate, which may lie outside of the grid.
+     */
+    int toCell(coord_t coord, coord_t origin_coord) const;
+};
+
+}//namespace cura
+
+#endif//UTILS_BOUNDARY_CLEARANCE_GRID_H
@@ -0,0 +1,55 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "CompactPolygons.h"
+
+#include <cassert>
+#include <limits>
+
+namespace cura
+{
+
+CompactPolygons::CompactPolygons(const Polygons& polygons)
+{
+    coordinates.reserve(polygons.pointCount() * 2);
+    path_ends.reserve(polygons.size());
+    for (ConstPolygonRef polygon : polygons)
+    {
+        for (const Point& point : polygon)
+        {
+            assert(point.X >= std::numeric_limits<int32_t>::min() && point.X <= std::numeric_limits<int32_t>::max());
+            assert(point.Y >= std::numeric_limits<int32_t>::min() && point.Y <= std::numeric_limits<int32_t>::max());
+            coordinates.push_back(static_cast<int32_t>(point.X));
+            coordinates.push_back(static_cast<int32_t>(point.Y));
+        }
+        path_ends.push_back(coordinates.size());
+    }
+}
+
+void CompactPolygons::addTo(Polygons& result) const
+{
+    uint32_t path_start = 0;
+    for (uint32_t path_end : path_ends)
+    {
+        PolygonRef polygon = result.newPoly();
+        (*polygon).reserve((path_end - path_start) / 2);
+        for (uint32_t coordinate_idx = path_start; coordinate_idx < path_end; coordinate_idx += 2)
+        {
+            polygon.emplace_back(coordinates[coordinate_idx], coordinates[coordinate_idx + 1]);
+        }
+        path_start = path_end;
+    }
+}
+
+void CompactPolygons::translate(Point translation)
+{
+    for (unsigned int coordinate_idx = 0; coordinate_idx < coordinates.size(); coordinate_idx += 2)
+    {
+        assert(coordinates[coordinate_idx] + translation.X >= std::numeric_limits<int32_t>::min() && coordinates[coordinate_idx] + translation.X <= std::numeric_limits<int32_t>::max());
+        assert(coordinates[coordinate_idx + 1] + translation.Y >= std::numeric_limits<int32_t>::min() && coordinates[coordinate_idx + 1] + translation.Y <= std::numeric_limits<int32_t>::max());
+        coordinates[coordinate_idx] += translation.X;
+        coordinates[coordinate_idx + 1] += translation.Y;
+    }
+}
+
+}//namespace cura
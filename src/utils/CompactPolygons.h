@@ -0,0 +1,96 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_COMPACT_POLYGONS_H
+#define UTILS_COMPACT_POLYGONS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * Polygons stored with 32 bit coordinates in a single buffer, for polygons which are kept for a long time but are seldom used,
+ * like the print outlines of the layer parts.
+ *
+ * A Polygons has two 64 bit coordinates per point and a separately allocated vector per polygon.
+ * These use half the memory for the points and a single allocation for all polygons together.
+ * They can't be changed or used in computations, but are converted to Polygons on access, so that Clipper still computes with 64 bit coordinates.
+ *
+ * The coordinates must fit in 32 bits, which in microns is more than two kilometers from the origin.
+ */
+class CompactPolygons
+{
+public:
+    CompactPolygons()
+    {
+    }
+
+    /*!
+     * Store a copy of \p polygons.
+     */
+    explicit CompactPolygons(const Polygons& polygons);
+
+    /*!
+     * The number of polygons.
+     */
+    unsigned int size() const
+    {
+        return path_ends.size();
+    }
+
+    /*!
+     * Whether there are no polygons, like \ref Polygons::empty
+     */
+    bool empty() const
+    {
+        return path_ends.empty();
+    }
+
+    /*!
+     * The number of points in all polygons.
+     */
+    unsigned int pointCount() const
+    {
+        return coordinates.size() / 2;
+    }
+
+    /*!
+     * Get the polygons with 64 bit coordinates.
+     */
+    Polygons toPolygons() const
+    {
+        Polygons ret;
+        addTo(ret);
+        return ret;
+    }
+
+    /*!
+     * Add the polygons to \p result, without first making a Polygons of them.
+     */
+    void addTo(Polygons& result) const;
+
+    /*!
+     * Translate all polygons in some direction, like \ref Polygons::translate
+     */
+    void translate(Point translation);
+
+    /*!
+     * Get the number of bytes allocated for the polygons, like \ref Polygons::getMemoryUsage
+     */
+    size_t getMemoryUsage() const
+    {
+        return coordinates.capacity() * sizeof(int32_t) + path_ends.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    std::vector<int32_t> coordinates; //!< The X and Y coordinate of each point of all polygons, one polygon after the other
+    std::vector<uint32_t> path_ends; //!< For each polygon the index in CompactPolygons::coordinates after its last point
+};
+
+}//namespace cura
+
+#endif//UTILS_COMPACT_POLYGONS_H
@@ -0,0 +1,85 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "CompressedGeometry.h"
+
+#include <cassert>
+#include <cstring> // memcpy
+
+namespace cura
+{
+
+void CompressedGeometryWriter::writeUnsigned(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void CompressedGeometryWriter::writeDouble(double value)
+{
+    uint8_t bytes[sizeof(double)];
+    memcpy(bytes, &value, sizeof(double));
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(double));
+}
+
+void CompressedGeometryWriter::writePolygons(const Polygons& polygons)
+{
+    writeUnsigned(polygons.size());
+    for (ConstPolygonRef polygon : polygons)
+    {
+        writeUnsigned(polygon.size());
+        for (const Point& point : polygon)
+        {
+            writeSigned(point.X - last_point.X);
+            writeSigned(point.Y - last_point.Y);
+            last_point = point;
+        }
+    }
+}
+
+uint64_t CompressedGeometryReader::readUnsigned()
+{
+    uint64_t value = 0;
+    for (unsigned int shift = 0; ; shift += 7)
+    {
+        assert(position < buffer.size() && "reading beyond the encoded data");
+        const uint8_t byte = buffer[position++];
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+}
+
+double CompressedGeometryReader::readDouble()
+{
+    assert(position + sizeof(double) <= buffer.size() && "reading beyond the encoded data");
+    double value;
+    memcpy(&value, &buffer[position], sizeof(double));
+    position += sizeof(double);
+    return value;
+}
+
+void CompressedGeometryReader::readPolygons(Polygons& result)
+{
+    const uint64_t polygon_count = readUnsigned();
+    for (uint64_t polygon_idx = 0; polygon_idx < polygon_count; polygon_idx++)
+    {
+        const uint64_t point_count = readUnsigned();
+        PolygonRef polygon = result.newPoly();
+        (*polygon).reserve(point_count);
+        for (uint64_t point_idx = 0; point_idx < point_count; point_idx++)
+        {
+            last_point.X += readSigned();
+            last_point.Y += readSigned();
+            polygon.add(last_point);
+        }
+    }
+}
+
+}//namespace cura
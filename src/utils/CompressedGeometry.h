@@ -0,0 +1,106 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_COMPRESSED_GEOMETRY_H
+#define UTILS_COMPRESSED_GEOMETRY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * Writes numbers and polygons to a byte buffer in a compact encoding, to be read back by a CompressedGeometryReader.
+ *
+ * Numbers are written as variable length integers: seven bits per byte, with the highest bit set on all but the last byte.
+ * Signed numbers are zigzag encoded first, so that small negative numbers are short as well.
+ * Each point is written as its difference to the point written before it, also across polygons,
+ * which for the polygons of a layer part is mostly less than a millimeter and so takes two bytes per coordinate instead of eight.
+ *
+ * The encoding is lossless: the polygons which are read back are exactly the polygons which were written.
+ */
+class CompressedGeometryWriter
+{
+public:
+    /*!
+     * \param buffer The buffer to append the encoded data to
+     */
+    CompressedGeometryWriter(std::vector<uint8_t>& buffer)
+    : buffer(buffer)
+    , last_point(0, 0)
+    {
+    }
+
+    void writeUnsigned(uint64_t value);
+
+    void writeSigned(int64_t value)
+    {
+        writeUnsigned((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    /*!
+     * Write a floating point number as is, without compressing it.
+     */
+    void writeDouble(double value);
+
+    /*!
+     * Write the number of polygons, and for each polygon the number of points followed by the points.
+     */
+    void writePolygons(const Polygons& polygons);
+
+private:
+    std::vector<uint8_t>& buffer; //!< The buffer to append the encoded data to
+    Point last_point; //!< The point written last, to which the next point is written as a difference
+};
+
+/*!
+ * Reads the numbers and polygons written by a CompressedGeometryWriter, in the order in which they were written.
+ */
+class CompressedGeometryReader
+{
+public:
+    /*!
+     * \param buffer The encoded data, which must outlive the reader
+     */
+    CompressedGeometryReader(const std::vector<uint8_t>& buffer)
+    : buffer(buffer)
+    , position(0)
+    , last_point(0, 0)
+    {
+    }
+
+    uint64_t readUnsigned();
+
+    int64_t readSigned()
+    {
+        const uint64_t value = readUnsigned();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    double readDouble();
+
+    /*!
+     * Read polygons and add them to \p result.
+     */
+    void readPolygons(Polygons& result);
+
+    /*!
+     * Whether all data of the buffer has been read.
+     */
+    bool atEnd() const
+    {
+        return position >= buffer.size();
+    }
+
+private:
+    const std::vector<uint8_t>& buffer; //!< The encoded data
+    size_t position; //!< The index in the buffer of the next byte to read
+    Point last_point; //!< The point read last, to which the next point is a difference
+};
+
+}//namespace cura
+
+#endif//UTILS_COMPRESSED_GEOMETRY_H
@@ -0,0 +1,60 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "FlatPolygons.h"
+
+namespace cura
+{
+
+FlatPolygons::FlatPolygons(const Polygons& polygons)
+{
+    points.reserve(polygons.pointCount());
+    path_starts.reserve(polygons.size() + 1);
+    path_starts.push_back(0);
+    for (ConstPolygonRef polygon : polygons)
+    {
+        points.insert(points.end(), polygon.begin(), polygon.end());
+        path_starts.push_back(points.size());
+    }
+}
+
+FlatPolygons::FlatPolygons(const ClipperLib::Paths& paths)
+{
+    size_t point_count = 0;
+    for (const ClipperLib::Path& path : paths)
+    {
+        point_count += path.size();
+    }
+    points.reserve(point_count);
+    path_starts.reserve(paths.size() + 1);
+    path_starts.push_back(0);
+    for (const ClipperLib::Path& path : paths)
+    {
+        points.insert(points.end(), path.begin(), path.end());
+        path_starts.push_back(points.size());
+    }
+}
+
+Polygons FlatPolygons::toPolygons() const
+{
+    Polygons ret;
+    for (ConstFlatPolygonRef polygon : *this)
+    {
+        PolygonRef result = ret.newPoly();
+        (*result).assign(polygon.begin(), polygon.end());
+    }
+    return ret;
+}
+
+ClipperLib::Paths FlatPolygons::toPaths() const
+{
+    ClipperLib::Paths ret;
+    ret.reserve(size());
+    for (ConstFlatPolygonRef polygon : *this)
+    {
+        ret.emplace_back(polygon.begin(), polygon.end());
+    }
+    return ret;
+}
+
+}//namespace cura
@@ -0,0 +1,185 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_FLAT_POLYGONS_H
+#define UTILS_FLAT_POLYGONS_H
+
+#include <vector>
+
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * A read-only view on one polygon of a FlatPolygons, offering the same read access as a ConstPolygonRef.
+ *
+ * It's only valid as long as the FlatPolygons it's taken from isn't changed or destroyed.
+ */
+class ConstFlatPolygonRef
+{
+public:
+    ConstFlatPolygonRef(const Point* first, unsigned int count)
+    : first(first)
+    , count(count)
+    {
+    }
+
+    unsigned int size() const
+    {
+        return count;
+    }
+
+    const Point& operator[](unsigned int index) const
+    {
+        POLY_ASSERT(index < count);
+        return first[index];
+    }
+
+    const Point* begin() const
+    {
+        return first;
+    }
+
+    const Point* end() const
+    {
+        return first + count;
+    }
+
+    const Point& back() const
+    {
+        return first[count - 1];
+    }
+
+private:
+    const Point* first; //!< The first point of the polygon
+    unsigned int count; //!< The number of points of the polygon
+};
+
+/*!
+ * Polygons with all points stored one polygon after the other in a single buffer,
+ * for polygons which are iterated over many times but aren't changed, like the combing boundaries.
+ *
+ * A Polygons has a separately allocated vector per polygon, so iterating over all points jumps through memory from polygon to polygon.
+ * These have a single allocation for all points together and an array with the start of each polygon.
+ * They can't be changed or used in Clipper operations; convert them to and from Polygons or ClipperLib::Paths for that.
+ *
+ * The polygons are in the same order as in the Polygons they're made of, so that polygon indices can be shared between the two.
+ */
+class FlatPolygons
+{
+public:
+    FlatPolygons()
+    : path_starts(1, 0)
+    {
+    }
+
+    /*!
+     * Store a copy of \p polygons.
+     */
+    explicit FlatPolygons(const Polygons& polygons);
+
+    /*!
+     * Store a copy of \p paths.
+     */
+    explicit FlatPolygons(const ClipperLib::Paths& paths);
+
+    /*!
+     * The number of polygons.
+     */
+    unsigned int size() const
+    {
+        return path_starts.size() - 1;
+    }
+
+    /*!
+     * Whether there are no polygons, like \ref Polygons::empty
+     */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /*!
+     * The number of points in all polygons.
+     */
+    unsigned int pointCount() const
+    {
+        return points.size();
+    }
+
+    ConstFlatPolygonRef operator[](unsigned int poly_idx) const
+    {
+        POLY_ASSERT(poly_idx < size());
+        return ConstFlatPolygonRef(points.data() + path_starts[poly_idx], path_starts[poly_idx + 1] - path_starts[poly_idx]);
+    }
+
+    /*!
+     * Iterates over the polygons, so that range-based for loops work as they do on Polygons.
+     */
+    class const_iterator
+    {
+    public:
+        const_iterator(const FlatPolygons& polygons, unsigned int poly_idx)
+        : polygons(polygons)
+        , poly_idx(poly_idx)
+        {
+        }
+
+        ConstFlatPolygonRef operator*() const
+        {
+            return polygons[poly_idx];
+        }
+
+        const_iterator& operator++()
+        {
+            poly_idx++;
+            return *this;
+        }
+
+        bool operator!=(const const_iterator& other) const
+        {
+            return poly_idx != other.poly_idx;
+        }
+
+    private:
+        const FlatPolygons& polygons; //!< The polygons iterated over
+        unsigned int poly_idx; //!< The index of the current polygon
+    };
+
+    const_iterator begin() const
+    {
+        return const_iterator(*this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(*this, size());
+    }
+
+    /*!
+     * Get a copy of the polygons as Polygons.
+     */
+    Polygons toPolygons() const;
+
+    /*!
+     * Get a copy of the polygons as Clipper paths.
+     */
+    ClipperLib::Paths toPaths() const;
+
+    /*!
+     * Get the number of bytes allocated for the polygons, like \ref Polygons::getMemoryUsage
+     */
+    size_t getMemoryUsage() const
+    {
+        return points.capacity() * sizeof(Point) + path_starts.capacity() * sizeof(unsigned int);
+    }
+
+private:
+    std::vector<Point> points; //!< The points of all polygons, one polygon after the other
+    std::vector<unsigned int> path_starts; //!< For each polygon the index in FlatPolygons::points of its first point, followed by the total number of points
+};
+
+}//namespace cura
+
+#endif//UTILS_FLAT_POLYGONS_H
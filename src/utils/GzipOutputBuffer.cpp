@@ -0,0 +1,160 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifdef GZIP
+
+#include "GzipOutputBuffer.h"
+
+#include <algorithm> // min
+#include <limits> // numeric_limits
+
+#include "logoutput.h"
+
+namespace cura
+{
+
+static constexpr int gzip_window_bits = 15 + 16; //!< The default window size, with a gzip rather than a zlib wrapper
+
+GzipOutputBuffer::GzipOutputBuffer(std::streambuf* destination, int level)
+: destination(destination)
+, initialized(false)
+, member_empty(true)
+, output(1 << 18)
+{
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    initialized = deflateInit2(&stream, level, Z_DEFLATED, gzip_window_bits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    if (!initialized)
+    {
+        logError("Failed to set up the gzip compression of the gcode.\n");
+    }
+}
+
+GzipOutputBuffer::~GzipOutputBuffer()
+{
+    if (initialized)
+    {
+        finishMember();
+        deflateEnd(&stream);
+    }
+}
+
+bool GzipOutputBuffer::finishMember()
+{
+    if (!initialized)
+    {
+        return false;
+    }
+    if (member_empty)
+    {
+        return true;
+    }
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+    const bool success = deflateAll(Z_FINISH);
+    deflateReset(&stream);
+    member_empty = true;
+    return success && destination->pubsync() == 0;
+}
+
+std::string GzipOutputBuffer::compressStored(const std::string& data)
+{
+    z_stream stored;
+    stored.zalloc = Z_NULL;
+    stored.zfree = Z_NULL;
+    stored.opaque = Z_NULL;
+    if (deflateInit2(&stored, Z_NO_COMPRESSION, Z_DEFLATED, gzip_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return std::string();
+    }
+    std::string member(deflateBound(&stored, data.size()), '\0');
+    stored.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stored.avail_in = data.size();
+    stored.next_out = reinterpret_cast<Bytef*>(&member[0]);
+    stored.avail_out = member.size();
+    const bool success = deflate(&stored, Z_FINISH) == Z_STREAM_END;
+    member.resize(member.size() - stored.avail_out);
+    deflateEnd(&stored);
+    return success ? member : std::string();
+}
+
+GzipOutputBuffer::int_type GzipOutputBuffer::overflow(int_type ch)
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        return traits_type::not_eof(ch);
+    }
+    const char c = traits_type::to_char_type(ch);
+    return (xsputn(&c, 1) == 1) ? ch : traits_type::eof();
+}
+
+std::streamsize GzipOutputBuffer::xsputn(const char* s, std::streamsize count)
+{
+    if (!initialized)
+    {
+        return 0;
+    }
+    std::streamsize done = 0;
+    while (done < count)
+    { // zlib takes at most an unsigned int of input at a time
+        const uInt chunk_size = static_cast<uInt>(std::min(count - done, static_cast<std::streamsize>(std::numeric_limits<uInt>::max())));
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(s + done));
+        stream.avail_in = chunk_size;
+        if (!deflateAll(Z_NO_FLUSH))
+        {
+            return done;
+        }
+        done += chunk_size;
+    }
+    if (count > 0)
+    {
+        member_empty = false;
+    }
+    return count;
+}
+
+int GzipOutputBuffer::sync()
+{
+    if (!initialized)
+    {
+        return -1;
+    }
+    if (!member_empty)
+    {
+        stream.next_in = Z_NULL;
+        stream.avail_in = 0;
+        if (!deflateAll(Z_SYNC_FLUSH))
+        {
+            return -1;
+        }
+    }
+    return destination->pubsync();
+}
+
+bool GzipOutputBuffer::deflateAll(int flush)
+{
+    while (true)
+    {
+        stream.next_out = output.data();
+        stream.avail_out = output.size();
+        const int result = deflate(&stream, flush);
+        if (result == Z_STREAM_ERROR)
+        {
+            return false;
+        }
+        const std::streamsize size = output.size() - stream.avail_out;
+        if (size > 0 && destination->sputn(reinterpret_cast<const char*>(output.data()), size) != size)
+        {
+            return false;
+        }
+        if (result == Z_STREAM_END || (stream.avail_in == 0 && stream.avail_out > 0))
+        { // all input has been consumed, and for a flush all output has been written since there was room left
+            return true;
+        }
+    }
+}
+
+}//namespace cura
+
+#endif//GZIP
@@ -0,0 +1,89 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_GZIP_OUTPUT_BUFFER_H
+#define UTILS_GZIP_OUTPUT_BUFFER_H
+
+#ifdef GZIP
+
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Stream buffer which compresses the data written to it into gzip format onto another stream buffer.
+ *
+ * The compressed data consists of gzip members, which decompress as a whole to the concatenation of their contents.
+ * A new member can be started with \ref GzipOutputBuffer::finishMember, so that data can be inserted between the members,
+ * such as a header compressed with \ref GzipOutputBuffer::compressStored which can be overwritten afterwards.
+ *
+ * It is meant to be the destination of an \ref AsyncOutputBuffer, so that the compression runs on the writing thread.
+ */
+class GzipOutputBuffer : public std::streambuf, NoCopy
+{
+public:
+    /*!
+     * \param destination The stream buffer to write the compressed data to, which must outlive this buffer
+     * \param level The zlib compression level, from 1 (fastest) to 9 (smallest)
+     */
+    GzipOutputBuffer(std::streambuf* destination, int level = 6);
+
+    /*!
+     * Finish the last gzip member.
+     */
+    ~GzipOutputBuffer();
+
+    /*!
+     * Finish the current gzip member, so that the data written after it starts a new one.
+     *
+     * Does nothing if nothing has been written to the current member.
+     *
+     * \return Whether the compressed data could be written
+     */
+    bool finishMember();
+
+    /*!
+     * Store data as a gzip member without compressing it, so that its size only depends on the size of the data.
+     * A member with the same size of data can then overwrite it in place.
+     *
+     * \param data The data to store
+     * \return The gzip member
+     */
+    static std::string compressStored(const std::string& data);
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize count) override;
+
+    /*!
+     * Write out all data compressed so far, ending at a byte boundary so that a reader can decompress everything written before.
+     */
+    int sync() override;
+
+private:
+    std::streambuf* destination; //!< Where the compressed data is written to
+    z_stream stream; //!< The state of the compression of the current member
+    bool initialized; //!< Whether the compression could be set up; if not, all writes fail
+    bool member_empty; //!< Whether nothing has been written to the current member yet
+    std::vector<unsigned char> output; //!< The buffer the compressed data is written to before it's passed on to the destination
+
+    /*!
+     * Compress the data given to \ref GzipOutputBuffer::stream and write out the compressed data.
+     *
+     * \param flush The zlib flush mode
+     * \return Whether the compressed data could be written
+     */
+    bool deflateAll(int flush);
+};
+
+}//namespace cura
+
+#endif//GZIP
+
+#endif//UTILS_GZIP_OUTPUT_BUFFER_H
@@ -0,0 +1,82 @@
+/** Copyright (C) 2017 Ultimaker - Released under terms of the AGPLv3 License */
+#include "IndexedListPolygon.h"
+
+namespace cura
+{
+
+IndexedListPolygon::IndexedListPolygon(ConstPolygonRef poly)
+: first(0)
+, vertex_count(poly.size())
+{
+    const unsigned int size = poly.size();
+    // reserve some room for the points inserted while editing, so that they seldom cause a reallocation
+    const unsigned int capacity = size + size / 2 + 4;
+    points.reserve(capacity);
+    next_idx.reserve(capacity);
+    prev_idx.reserve(capacity);
+    removed.reserve(capacity);
+    for (unsigned int point_idx = 0; point_idx < size; point_idx++)
+    {
+        points.push_back(poly[point_idx]);
+        next_idx.push_back((point_idx + 1 < size)? point_idx + 1 : 0);
+        prev_idx.push_back((point_idx > 0)? point_idx - 1 : size - 1);
+        removed.push_back(false);
+    }
+}
+
+void IndexedListPolygon::remove(unsigned int idx)
+{
+    assert(!removed[idx]);
+    next_idx[prev_idx[idx]] = next_idx[idx];
+    prev_idx[next_idx[idx]] = prev_idx[idx];
+    if (idx == first)
+    {
+        first = next_idx[idx];
+    }
+    removed[idx] = true;
+    vertex_count--;
+}
+
+unsigned int IndexedListPolygon::insertPointNonDuplicate(unsigned int before, unsigned int after, const Point to_insert)
+{
+    if (to_insert == p(before))
+    {
+        return before;
+    }
+    else if (to_insert == p(after))
+    {
+        return after;
+    }
+    else
+    {
+        const unsigned int idx = points.size();
+        points.push_back(to_insert);
+        next_idx.push_back(after);
+        prev_idx.push_back(prev_idx[after]);
+        removed.push_back(false);
+        next_idx[prev_idx[after]] = idx;
+        prev_idx[after] = idx;
+        if (after == first)
+        { // inserted before the start of the polygon
+            first = idx;
+        }
+        vertex_count++;
+        return idx;
+    }
+}
+
+void IndexedListPolygon::toPolygon(PolygonRef result) const
+{
+    if (vertex_count == 0)
+    {
+        return;
+    }
+    unsigned int idx = first;
+    do
+    {
+        result.add(points[idx]);
+        idx = next_idx[idx];
+    } while (idx != first);
+}
+
+}//namespace cura
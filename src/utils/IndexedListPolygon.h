@@ -0,0 +1,103 @@
+/** Copyright (C) 2017 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_INDEXED_LIST_POLYGON_H
+#define UTILS_INDEXED_LIST_POLYGON_H
+
+#include <cassert>
+#include <vector>
+
+#include "intpoint.h"
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * A polygon represented as a circular doubly linked list stored in flat arrays,
+ * for editing a polygon in place without allocating a list node per vertex.
+ *
+ * Vertices are referred to by their index into the arrays, which stays valid while other vertices are inserted or removed.
+ * Removed vertices are unlinked and marked as removed, but their storage isn't reused.
+ *
+ * Like iterating over a ListPolygon from its begin, the vertices are traversed starting from IndexedListPolygon::getFirst.
+ * A vertex inserted right before the first vertex becomes the first vertex
+ * and removing the first vertex makes the vertex after it the first.
+ */
+class IndexedListPolygon
+{
+public:
+    /*!
+     * Convert a polygon to an indexed list polygon.
+     *
+     * \param poly The polygon to convert
+     */
+    IndexedListPolygon(ConstPolygonRef poly);
+
+    /*!
+     * Get the location of a vertex
+     */
+    Point& p(unsigned int idx)
+    {
+        assert(!removed[idx]);
+        return points[idx];
+    }
+
+    //! The vertex after \p idx (wrapping around at the end)
+    unsigned int next(unsigned int idx) const
+    {
+        return next_idx[idx];
+    }
+
+    //! The vertex before \p idx (wrapping around at the beginning)
+    unsigned int prev(unsigned int idx) const
+    {
+        return prev_idx[idx];
+    }
+
+    //! The vertex from which to traverse the polygon
+    unsigned int getFirst() const
+    {
+        return first;
+    }
+
+    //! The number of vertices which haven't been removed
+    unsigned int size() const
+    {
+        return vertex_count;
+    }
+
+    /*!
+     * Remove a vertex from the polygon
+     *
+     * \param idx The vertex to remove
+     */
+    void remove(unsigned int idx);
+
+    /*!
+     * Insert a point if it's not a duplicate of the point before or the point after.
+     *
+     * \param before The vertex before the point to insert
+     * \param after The vertex after the point to insert
+     * \param to_insert The point to insert in between \p before and \p after
+     * \return The newly inserted vertex, or \p before or \p after in case to_insert was already in the polygon
+     */
+    unsigned int insertPointNonDuplicate(unsigned int before, unsigned int after, const Point to_insert);
+
+    /*!
+     * Add the remaining vertices to a polygon, starting from IndexedListPolygon::getFirst
+     *
+     * \param result The polygon to add the vertices to
+     */
+    void toPolygon(PolygonRef result) const;
+
+private:
+    std::vector<Point> points; //!< The location of each vertex
+    std::vector<unsigned int> next_idx; //!< For each vertex the vertex after it
+    std::vector<unsigned int> prev_idx; //!< For each vertex the vertex before it
+    std::vector<bool> removed; //!< For each vertex whether it has been removed
+    unsigned int first; //!< The vertex from which to traverse the polygon
+    unsigned int vertex_count; //!< The number of vertices which haven't been removed
+};
+
+}//namespace cura
+
+#endif//UTILS_INDEXED_LIST_POLYGON_H
@@ -0,0 +1,319 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "InstructionSet.h"
+
+#include <algorithm> // copy, min
+#include <cstring> // strcmp
+
+#include "linearAlg2D.h"
+
+// This file is compiled without contracting multiplications and additions into fused multiply-adds (see CMakeLists.txt),
+// so that the levels which have them round the same as the baseline.
+
+namespace cura
+{
+
+InstructionSet::Level InstructionSet::getLevel()
+{
+    return level();
+}
+
+const char* InstructionSet::getLevelName()
+{
+    switch (level())
+    {
+        case Level::AVX2:
+            return "avx2";
+        case Level::AVX512:
+            return "avx512";
+        case Level::BASELINE:
+        default:
+            return "baseline";
+    }
+}
+
+bool InstructionSet::setLevel(const char* name)
+{
+    Level requested;
+    if (strcmp(name, "baseline") == 0)
+    {
+        requested = Level::BASELINE;
+    }
+    else if (strcmp(name, "avx2") == 0)
+    {
+        requested = Level::AVX2;
+    }
+    else if (strcmp(name, "avx512") == 0)
+    {
+        requested = Level::AVX512;
+    }
+    else
+    {
+        return false;
+    }
+    if (static_cast<int>(requested) > static_cast<int>(detect()))
+    {
+        return false;
+    }
+    level() = requested;
+    return true;
+}
+
+InstructionSet::Level InstructionSet::detect()
+{
+#ifdef INSTRUCTION_SET_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl"))
+    {
+        return Level::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return Level::AVX2;
+    }
+#endif
+    return Level::BASELINE;
+}
+
+InstructionSet::Level& InstructionSet::level()
+{
+    static Level level = detect();
+    return level;
+}
+
+namespace VectorKernels
+{
+
+namespace
+{
+
+/*!
+ * The kernel of \ref VectorKernels::transform, which is compiled for each level by inlining it into a function with the target of that level.
+ *
+ * The points are transformed in blocks into a local buffer, so that the compiler knows the results don't overlap the input
+ * and vectorizes the loop, even when transforming in place.
+ */
+inline __attribute__((always_inline)) void transformImpl(const double matrix[4], const ClipperLib::IntPoint* points, ClipperLib::IntPoint* result, size_t count)
+{
+    constexpr size_t block_size = 256;
+    const double m0 = matrix[0], m1 = matrix[1], m2 = matrix[2], m3 = matrix[3];
+    ClipperLib::cInt xs[block_size];
+    ClipperLib::cInt ys[block_size];
+    for (size_t block_start = 0; block_start < count; block_start += block_size)
+    {
+        const size_t block_count = std::min(block_size, count - block_start);
+        const ClipperLib::IntPoint* block = points + block_start;
+        for (size_t point_idx = 0; point_idx < block_count; point_idx++)
+        {
+            const double x = block[point_idx].X;
+            const double y = block[point_idx].Y;
+            xs[point_idx] = x * m0 + y * m1;
+            ys[point_idx] = x * m2 + y * m3;
+        }
+        for (size_t point_idx = 0; point_idx < block_count; point_idx++)
+        {
+            result[block_start + point_idx] = ClipperLib::IntPoint(xs[point_idx], ys[point_idx]);
+        }
+    }
+}
+
+/*!
+ * The exact test of an edge of ClipperLib::PointInPolygon.
+ *
+ * \return 1 if the edge crosses the horizontal half line to the right of the point, 0 if it doesn't and -1 if the point is on the edge
+ */
+inline __attribute__((always_inline)) int testEdgeClipper(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint& p0, const ClipperLib::IntPoint& p1)
+{
+    if (p1.Y == point.Y && (p1.X == point.X || (p0.Y == point.Y && ((p1.X > point.X) == (p0.X < point.X)))))
+    {
+        return -1;
+    }
+    if ((p0.Y < point.Y) == (p1.Y < point.Y))
+    {
+        return 0;
+    }
+    const bool p0_right = p0.X >= point.X;
+    const bool p1_right = p1.X > point.X;
+    if (p0_right && p1_right)
+    {
+        return 1;
+    }
+    if (!p0_right && !p1_right)
+    {
+        return 0;
+    }
+    const double d = static_cast<double>(p0.X - point.X) * (p1.Y - point.Y) - static_cast<double>(p1.X - point.X) * (p0.Y - point.Y);
+    if (!d)
+    {
+        return -1;
+    }
+    return (d > 0) == (p1.Y > p0.Y);
+}
+
+/*!
+ * The exact test of an edge of ConstPolygonRef::_inside.
+ *
+ * \return 1 if the edge lies to the right of the point, 0 if it doesn't and -1 if the point is on the edge
+ */
+inline __attribute__((always_inline)) int testEdgeRightOf(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint& p0, const ClipperLib::IntPoint& p1)
+{
+    const short comp = LinearAlg2D::pointLiesOnTheRightOfLine(point, p0, p1);
+    return (comp == 0) ? -1 : (comp == 1);
+}
+
+/*!
+ * The kernel of \ref VectorKernels::pointInPolygon and \ref VectorKernels::countEdgesRightOf, which is compiled for each level by inlining it into a function with the target of that level.
+ *
+ * Both edge tests only count an edge or find the point on it if the edge reaches the horizontal line through the point.
+ * Whether any edge of a block of edges reaches that line is found by counting the vertices above and below the line,
+ * in a loop of comparisons which the compiler vectorizes.
+ * The edges of the blocks of which none does are skipped, and the others are tested exactly, one by one.
+ * The edges are tested in the same order as ClipperLib::PointInPolygon does, ending with the edge from the last vertex to the first.
+ *
+ * \tparam test_edge The exact test of an edge from its first to its second vertex
+ * \param count The number of vertices, at least one
+ * \return The number of edges which count, or -1 if the point is on an edge
+ */
+template<int (*test_edge)(const ClipperLib::IntPoint&, const ClipperLib::IntPoint&, const ClipperLib::IntPoint&)>
+inline __attribute__((always_inline)) int countEdgesImpl(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count)
+{
+    constexpr size_t block_size = 32;
+    const ClipperLib::cInt y = point.Y;
+    int edge_count = 0;
+    for (size_t block_start = 1; block_start < count; block_start += block_size)
+    {
+        const size_t block_end = std::min(block_start + block_size, count);
+        // no edge of the block reaches the line if all of its vertices lie on the same side of the line
+        size_t below_count = 0;
+        size_t above_count = 0;
+        for (size_t vertex_idx = block_start - 1; vertex_idx < block_end; vertex_idx++)
+        {
+            below_count += path[vertex_idx].Y < y;
+            above_count += path[vertex_idx].Y > y;
+        }
+        const size_t block_vertex_count = block_end - block_start + 1;
+        if (below_count == block_vertex_count || above_count == block_vertex_count)
+        {
+            continue;
+        }
+        for (size_t vertex_idx = block_start; vertex_idx < block_end; vertex_idx++)
+        {
+            const int result = test_edge(point, path[vertex_idx - 1], path[vertex_idx]);
+            if (result == -1)
+            {
+                return -1;
+            }
+            edge_count += result;
+        }
+    }
+    const int result = test_edge(point, path[count - 1], path[0]);
+    if (result == -1)
+    {
+        return -1;
+    }
+    return edge_count + result;
+}
+
+#ifdef INSTRUCTION_SET_DISPATCH
+__attribute__((target("avx2"))) void transformAvx2(const double matrix[4], const ClipperLib::IntPoint* points, ClipperLib::IntPoint* result, size_t count)
+{
+    transformImpl(matrix, points, result, count);
+}
+
+__attribute__((target("avx512f,avx512dq,avx512vl"))) void transformAvx512(const double matrix[4], const ClipperLib::IntPoint* points, ClipperLib::IntPoint* result, size_t count)
+{
+    transformImpl(matrix, points, result, count);
+}
+
+__attribute__((target("avx2"))) int pointInPolygonAvx2(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count)
+{
+    return countEdgesImpl<testEdgeClipper>(point, path, count);
+}
+
+__attribute__((target("avx512f,avx512dq,avx512vl"))) int pointInPolygonAvx512(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count)
+{
+    return countEdgesImpl<testEdgeClipper>(point, path, count);
+}
+
+__attribute__((target("avx2"))) int countEdgesRightOfAvx2(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count)
+{
+    return countEdgesImpl<testEdgeRightOf>(point, path, count);
+}
+
+__attribute__((target("avx512f,avx512dq,avx512vl"))) int countEdgesRightOfAvx512(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count)
+{
+    return countEdgesImpl<testEdgeRightOf>(point, path, count);
+}
+#endif
+
+} // anonymous namespace
+
+void transform(const double matrix[4], const ClipperLib::IntPoint* points, ClipperLib::IntPoint* result, size_t count)
+{
+#ifdef INSTRUCTION_SET_DISPATCH
+    switch (InstructionSet::getLevel())
+    {
+        case InstructionSet::Level::AVX512:
+            transformAvx512(matrix, points, result, count);
+            return;
+        case InstructionSet::Level::AVX2:
+            transformAvx2(matrix, points, result, count);
+            return;
+        case InstructionSet::Level::BASELINE:
+            break;
+    }
+#endif
+    transformImpl(matrix, points, result, count);
+}
+
+int pointInPolygon(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count)
+{
+    if (count < 3)
+    {
+        return 0;
+    }
+    int edge_count;
+#ifdef INSTRUCTION_SET_DISPATCH
+    switch (InstructionSet::getLevel())
+    {
+        case InstructionSet::Level::AVX512:
+            edge_count = pointInPolygonAvx512(point, path, count);
+            break;
+        case InstructionSet::Level::AVX2:
+            edge_count = pointInPolygonAvx2(point, path, count);
+            break;
+        case InstructionSet::Level::BASELINE:
+        default:
+            edge_count = countEdgesImpl<testEdgeClipper>(point, path, count);
+            break;
+    }
+#else
+    edge_count = countEdgesImpl<testEdgeClipper>(point, path, count);
+#endif
+    return (edge_count == -1) ? -1 : edge_count % 2;
+}
+
+int countEdgesRightOf(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+#ifdef INSTRUCTION_SET_DISPATCH
+    switch (InstructionSet::getLevel())
+    {
+        case InstructionSet::Level::AVX512:
+            return countEdgesRightOfAvx512(point, path, count);
+        case InstructionSet::Level::AVX2:
+            return countEdgesRightOfAvx2(point, path, count);
+        case InstructionSet::Level::BASELINE:
+            break;
+    }
+#endif
+    return countEdgesImpl<testEdgeRightOf>(point, path, count);
+}
+
+} // namespace VectorKernels
+
+}//namespace cura
@@ -0,0 +1,114 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_INSTRUCTION_SET_H
+#define UTILS_INSTRUCTION_SET_H
+
+#include <cstddef> // size_t
+#include <clipper/clipper.hpp>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define INSTRUCTION_SET_DISPATCH //!< Whether the vectorized kernels are compiled for several instruction sets, of which one is chosen at runtime
+#endif
+
+namespace cura
+{
+
+/*!
+ * The instruction set used by the vectorized kernels of the engine.
+ *
+ * The kernels are compiled for each level, so that a single binary uses the widest vectors of the machine it runs on.
+ * The level is detected when it's first used, and can be overridden with InstructionSet::setLevel, e.g. to compare the levels in a benchmark.
+ *
+ * Only on x86 compilers which support function target attributes are there levels beyond the baseline.
+ */
+class InstructionSet
+{
+public:
+    enum class Level
+    {
+        BASELINE, //!< The instruction set the engine is compiled for
+        AVX2, //!< 256 bit vectors of integers and doubles
+        AVX512 //!< 512 bit vectors, including the conversions between 64 bit integers and doubles
+    };
+
+    /*!
+     * Get the level used by the kernels.
+     */
+    static Level getLevel();
+
+    /*!
+     * Get the name of the level used by the kernels, as accepted by InstructionSet::setLevel.
+     */
+    static const char* getLevelName();
+
+    /*!
+     * Use another level than the detected one.
+     *
+     * Must be called before the kernels are used by several threads.
+     *
+     * \param name The name of the level: baseline, avx2 or avx512
+     * \return Whether the level is known and supported by this machine; if not, the level is left unchanged
+     */
+    static bool setLevel(const char* name);
+
+private:
+    /*!
+     * The widest level this machine supports.
+     */
+    static Level detect();
+
+    /*!
+     * The level used by the kernels, detected on first use.
+     */
+    static Level& level();
+};
+
+/*!
+ * Kernels which process ranges of points, in the instruction set chosen by InstructionSet.
+ */
+namespace VectorKernels
+{
+    /*!
+     * Multiply each point with a 2x2 matrix, truncating the coordinates of the results to integers.
+     *
+     * Gives exactly the same results at every level.
+     *
+     * \param matrix The matrix in row-major order
+     * \param points The first of the points
+     * \param[out] result Where to store the first of the results; may be \p points itself
+     * \param count The number of points
+     */
+    void transform(const double matrix[4], const ClipperLib::IntPoint* points, ClipperLib::IntPoint* result, size_t count);
+
+    /*!
+     * Find whether a point lies inside a closed polygon, with the crossing number test of ClipperLib::PointInPolygon.
+     *
+     * Only the edges which reach the horizontal line through the point can cross that line or contain the point.
+     * The edges are checked for that in blocks, with vector comparisons, and only the edges of the blocks which have such edges are tested exactly.
+     *
+     * Gives exactly the same results as ClipperLib::PointInPolygon at every level.
+     *
+     * \param point The point to test
+     * \param path The first vertex of the polygon
+     * \param count The number of vertices of the polygon
+     * \return 1 if the point is inside, 0 if it's outside and -1 if it's on the border of the polygon
+     */
+    int pointInPolygon(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count);
+
+    /*!
+     * Count the edges of a closed polygon which lie to the right of a point, as decided by LinearAlg2D::pointLiesOnTheRightOfLine.
+     *
+     * Skips the edges which don't reach the horizontal line through the point in the same way as VectorKernels::pointInPolygon.
+     *
+     * \param point The point to test
+     * \param path The first vertex of the polygon
+     * \param count The number of vertices of the polygon
+     * \return The number of edges to the right of the point, or -1 if the point is on the border of the polygon
+     */
+    int countEdgesRightOf(const ClipperLib::IntPoint& point, const ClipperLib::IntPoint* path, size_t count);
+}
+
+}//namespace cura
+
+#endif//UTILS_INSTRUCTION_SET_H
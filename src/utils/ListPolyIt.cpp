@@ -29,9 +29,6 @@ void ListPolyIt::convertPolygonToList(ConstPolygonRef poly, ListPolygon& result)
         result.push_back(p);
 #ifdef DEBUG
         // usually polygons shouldn't have such degenerate verts
-        // in PolygonProximityLinker (where this function is (also) used) it is
-        // required to not have degenerate verts, because verts are mapped
-        // to links, but if two different verts are at the same place the mapping fails.
         assert(p != last);
         last = p;
 #endif // DEBUG
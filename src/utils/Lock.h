@@ -3,50 +3,27 @@
 #define UTILS_LOCK_H
 
 
-#ifdef _OPENMP
-    #include <omp.h>
-#endif // _OPENMP
+#include <mutex>
 
 
 class Lock
 {
 public:
-    Lock()
-    {
-#ifdef _OPENMP
-        omp_init_lock(&lock_object);
-#endif // _OPENMP
-    }
-    ~Lock()
-    {
-#ifdef _OPENMP
-        omp_destroy_lock(&lock_object);
-#endif // _OPENMP
-    }
     void lock()
     {
-#ifdef _OPENMP
-        omp_set_lock(&lock_object);
-#endif // _OPENMP
+        lock_object.lock();
     }
     void unlock()
     {
-#ifdef _OPENMP
-        omp_unset_lock(&lock_object);
-#endif // _OPENMP
+        lock_object.unlock();
     }
     int test_lock()
     {
-        int ret = 1;
-#ifdef _OPENMP
-        ret = omp_test_lock(&lock_object);
-#endif // _OPENMP
-        return ret;
+        return lock_object.try_lock();
     }
+    Lock() = default;
 private:
-#ifdef _OPENMP
-    omp_lock_t lock_object;
-#endif // _OPENMP
+    std::mutex lock_object;
     Lock(const Lock&) = delete;
     Lock& operator=(const Lock&) = delete;
 };
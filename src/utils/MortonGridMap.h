@@ -0,0 +1,238 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_MORTON_GRID_MAP_H
+#define UTILS_MORTON_GRID_MAP_H
+
+#include <algorithm> // sort, lower_bound
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility> // pair
+#include <vector>
+
+#include "intpoint.h"
+
+namespace cura
+{
+
+/*!
+ * Map from grid cells to elements, storing all elements in a single array sorted on the Morton code (Z-order) of their cell.
+ *
+ * This is an alternative to the std::unordered_multimap used by \ref SparseGrid.
+ * The elements of a cell are contiguous and cells which are close to each other are mostly close in memory,
+ * so looking up the cells around a location doesn't chase pointers through the nodes of a hash map.
+ *
+ * The elements of a cell are visited newest first, in the same order as the std::unordered_multimap of libstdc++ does,
+ * so that switching between the two doesn't change the outcome of algorithms which depend on the order of the elements in a cell.
+ *
+ * Inserted elements are collected and only sorted into the array when the map is queried,
+ * so the map is meant for grids which are first filled and then queried.
+ * Inserting elements after a query is correct, but costs a merge on the next query.
+ * Concurrent queries are safe; inserting concurrently with anything else is not.
+ *
+ * \tparam Elem The element type to store
+ */
+template<class Elem>
+class MortonGridMap
+{
+public:
+    using value_type = std::pair<Point, Elem>;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    MortonGridMap()
+    : is_sorted(true)
+    {
+    }
+
+    MortonGridMap(const MortonGridMap& other)
+    : sorted_codes(other.sorted_codes)
+    , sorted(other.sorted)
+    , unsorted(other.unsorted)
+    , is_sorted(other.is_sorted.load())
+    {
+    }
+
+    MortonGridMap& operator=(const MortonGridMap& other)
+    {
+        sorted_codes = other.sorted_codes;
+        sorted = other.sorted;
+        unsorted = other.unsorted;
+        is_sorted = other.is_sorted.load();
+        return *this;
+    }
+
+    /*!
+     * Only there to be interchangeable with std::unordered_multimap. The array doesn't have a load factor.
+     */
+    void max_load_factor(float)
+    {
+    }
+
+    void reserve(size_t elem_count)
+    {
+        unsorted.reserve(elem_count);
+    }
+
+    void emplace(const Point& cell, const Elem& elem)
+    {
+        unsorted.emplace_back(cell, elem);
+        is_sorted = false;
+    }
+
+    /*!
+     * Get all elements of a cell, newest first.
+     */
+    std::pair<const_iterator, const_iterator> equal_range(const Point& cell) const
+    {
+        sort();
+        const uint64_t code = mortonCode(cell);
+        auto code_it = std::lower_bound(sorted_codes.begin(), sorted_codes.end(), code);
+        const_iterator begin = sorted.begin() + (code_it - sorted_codes.begin());
+        const_iterator end = begin;
+        for (; code_it != sorted_codes.end() && *code_it == code; ++code_it, ++end)
+        {
+            if (end->first != cell)
+            { // a cell too far away from the origin to get a unique code shares it with this cell
+                return equalRangeSlow(cell, begin, code);
+            }
+        }
+        return std::make_pair(begin, end);
+    }
+
+    const_iterator begin() const
+    {
+        sort();
+        return sorted.begin();
+    }
+
+    const_iterator end() const
+    {
+        sort();
+        return sorted.end();
+    }
+
+    size_t size() const
+    {
+        return sorted.size() + unsorted.size();
+    }
+
+private:
+    mutable std::vector<uint64_t> sorted_codes; //!< The Morton code of the cell of each element in \ref MortonGridMap::sorted
+    mutable std::vector<value_type> sorted; //!< The elements sorted on the code of their cell and newest first within a cell
+    mutable std::vector<value_type> unsorted; //!< The elements inserted since the last sort, oldest first
+    mutable std::atomic<bool> is_sorted; //!< Whether \ref MortonGridMap::unsorted is empty
+    mutable std::mutex sort_mutex; //!< Makes sure only one of the concurrent queries sorts the elements
+
+    /*!
+     * Interleave the bits of the lower 32 bits of the (offset) coordinates.
+     *
+     * Grid coordinates are generally much smaller than 2^31, so the code is unique for each cell.
+     */
+    static uint64_t mortonCode(const Point& cell)
+    {
+        return spreadBits(static_cast<uint32_t>(cell.X + 0x80000000LL)) | (spreadBits(static_cast<uint32_t>(cell.Y + 0x80000000LL)) << 1);
+    }
+
+    static uint64_t spreadBits(uint32_t value)
+    {
+        uint64_t x = value;
+        x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+        x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+        x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        x = (x | (x << 2)) & 0x3333333333333333ULL;
+        x = (x | (x << 1)) & 0x5555555555555555ULL;
+        return x;
+    }
+
+    /*!
+     * Find the elements of a cell among the elements of all cells with the same code.
+     *
+     * \param code_begin The first element with the code of \p cell
+     */
+    std::pair<const_iterator, const_iterator> equalRangeSlow(const Point& cell, const_iterator code_begin, uint64_t code) const
+    {
+        const_iterator begin = code_begin;
+        while (begin != sorted.end() && sorted_codes[begin - sorted.begin()] == code && begin->first != cell)
+        {
+            ++begin;
+        }
+        const_iterator end = begin;
+        while (end != sorted.end() && sorted_codes[end - sorted.begin()] == code && end->first == cell)
+        {
+            ++end;
+        }
+        return std::make_pair(begin, end);
+    }
+
+    /*!
+     * Sort the elements which were inserted since the last query into the array.
+     */
+    void sort() const
+    {
+        if (is_sorted.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(sort_mutex);
+        if (is_sorted.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        // newest first within a cell; the cells with the same code (if any) are kept together by sorting on the cell as well
+        // the code of each new element is computed once, rather than in every comparison
+        std::vector<std::pair<uint64_t, size_t>> order; // the code and the index in the unsorted elements
+        order.reserve(unsorted.size());
+        for (size_t elem_idx = 0; elem_idx < unsorted.size(); elem_idx++)
+        {
+            order.emplace_back(mortonCode(unsorted[elem_idx].first), elem_idx);
+        }
+        std::sort(order.begin(), order.end(), [this](const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b)
+        {
+            if (a.first != b.first)
+            {
+                return a.first < b.first;
+            }
+            const Point& cell_a = unsorted[a.second].first;
+            const Point& cell_b = unsorted[b.second].first;
+            if (cell_a != cell_b)
+            {
+                return cell_a.X < cell_b.X || (cell_a.X == cell_b.X && cell_a.Y < cell_b.Y);
+            }
+            return a.second > b.second; // newest first
+        });
+        auto isBefore = [](uint64_t code_a, const Point& a, uint64_t code_b, const Point& b)
+        {
+            return code_a < code_b || (code_a == code_b && (a.X < b.X || (a.X == b.X && a.Y < b.Y)));
+        };
+        std::vector<value_type> merged;
+        std::vector<uint64_t> merged_codes;
+        merged.reserve(sorted.size() + unsorted.size());
+        merged_codes.reserve(sorted.size() + unsorted.size());
+        // the new elements come before the older ones of the same cell
+        size_t old_idx = 0;
+        for (const std::pair<uint64_t, size_t>& new_elem : order)
+        {
+            const value_type& elem = unsorted[new_elem.second];
+            while (old_idx < sorted.size() && isBefore(sorted_codes[old_idx], sorted[old_idx].first, new_elem.first, elem.first))
+            {
+                merged.push_back(sorted[old_idx]);
+                merged_codes.push_back(sorted_codes[old_idx]);
+                old_idx++;
+            }
+            merged.push_back(elem);
+            merged_codes.push_back(new_elem.first);
+        }
+        merged.insert(merged.end(), sorted.begin() + old_idx, sorted.end());
+        merged_codes.insert(merged_codes.end(), sorted_codes.begin() + old_idx, sorted_codes.end());
+        sorted.swap(merged);
+        sorted_codes.swap(merged_codes);
+        unsorted.clear();
+        unsorted.shrink_to_fit();
+        is_sorted.store(true, std::memory_order_release);
+    }
+};
+
+}//namespace cura
+
+#endif//UTILS_MORTON_GRID_MAP_H
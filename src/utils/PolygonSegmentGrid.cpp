@@ -0,0 +1,172 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "PolygonSegmentGrid.h"
+
+#include <algorithm> // min, max
+#include <cmath> // sqrt
+#include <functional>
+#include <limits>
+
+#include "linearAlg2D.h"
+
+namespace cura
+{
+
+PolygonSegmentGrid::PolygonSegmentGrid(ConstPolygonRef polygon)
+: polygon(polygon)
+, origin(0, 0)
+, cell_size(1)
+, column_count(0)
+, row_count(0)
+, cell_starts(1, 0)
+{
+    const unsigned int segment_count = polygon.size();
+    if (segment_count == 0)
+    {
+        return;
+    }
+    Point max = polygon[0];
+    origin = polygon[0];
+    for (const Point& point : polygon)
+    {
+        origin.X = std::min(origin.X, point.X);
+        origin.Y = std::min(origin.Y, point.Y);
+        max.X = std::max(max.X, point.X);
+        max.Y = std::max(max.Y, point.Y);
+    }
+    const coord_t width = max.X - origin.X + 1;
+    const coord_t height = max.Y - origin.Y + 1;
+    // about as many cells as segments, also when the polygon is long and thin
+    cell_size = std::max(static_cast<coord_t>(std::sqrt(static_cast<double>(width) * height / segment_count)), std::max(width, height) / segment_count + 1);
+    column_count = (width - 1) / cell_size + 1;
+    row_count = (height - 1) / cell_size + 1;
+
+    // count the segments of each cell, then store them in the order of the cells
+    const auto for_each_cell = [this, segment_count](unsigned int segment_idx, const std::function<void (unsigned int)>& function)
+        {
+            const Point& start = this->polygon[segment_idx];
+            const Point& end = this->polygon[(segment_idx + 1) % segment_count];
+            const int column_end = toCell(std::max(start.X, end.X), origin.X);
+            const int row_end = toCell(std::max(start.Y, end.Y), origin.Y);
+            for (int row = toCell(std::min(start.Y, end.Y), origin.Y); row <= row_end; row++)
+            {
+                for (int column = toCell(std::min(start.X, end.X), origin.X); column <= column_end; column++)
+                {
+                    function(row * column_count + column);
+                }
+            }
+        };
+    cell_starts.assign(column_count * row_count + 1, 0);
+    for (unsigned int segment_idx = 0; segment_idx < segment_count; segment_idx++)
+    {
+        for_each_cell(segment_idx, [this](unsigned int cell_idx) { cell_starts[cell_idx + 1]++; });
+    }
+    for (unsigned int cell_idx = 0; cell_idx + 1 < cell_starts.size(); cell_idx++)
+    {
+        cell_starts[cell_idx + 1] += cell_starts[cell_idx];
+    }
+    cell_segments.resize(cell_starts.back());
+    std::vector<unsigned int> cell_fill(cell_starts.begin(), cell_starts.end() - 1);
+    for (unsigned int segment_idx = 0; segment_idx < segment_count; segment_idx++)
+    {
+        for_each_cell(segment_idx, [this, &cell_fill, segment_idx](unsigned int cell_idx) { cell_segments[cell_fill[cell_idx]++] = segment_idx; });
+    }
+}
+
+int PolygonSegmentGrid::toCell(coord_t coord, coord_t origin_coord) const
+{
+    const coord_t offset = coord - origin_coord;
+    return (offset >= 0)? offset / cell_size : -((-offset - 1) / cell_size) - 1;
+}
+
+unsigned int PolygonSegmentGrid::findClosestSegment(Point from) const
+{
+    const unsigned int segment_count = polygon.size();
+    if (segment_count == 0)
+    {
+        return 0;
+    }
+    // the closest point on a segment is rounded, so a segment outside the visited cells may seem slightly closer than it is
+    constexpr coord_t rounding_margin = 10;
+
+    const int column = toCell(from.X, origin.X);
+    const int row = toCell(from.Y, origin.Y);
+    int64_t best_score = std::numeric_limits<int64_t>::max();
+    unsigned int best_segment_idx = 0;
+    const auto check_cell = [&](int cell_column, int cell_row)
+        {
+            const unsigned int cell_idx = cell_row * column_count + cell_column;
+            for (unsigned int idx = cell_starts[cell_idx]; idx < cell_starts[cell_idx + 1]; idx++)
+            {
+                const unsigned int segment_idx = cell_segments[idx];
+                const Point closest = LinearAlg2D::getClosestOnLineSegment(from, polygon[segment_idx], polygon[(segment_idx + 1) % segment_count]);
+                const int64_t score = vSize2(from - closest);
+                if (score < best_score || (score == best_score && segment_idx < best_segment_idx))
+                { // like PolygonUtils::findClosest, the first of the segments at the same distance
+                    best_score = score;
+                    best_segment_idx = segment_idx;
+                }
+            }
+        };
+    // the rings closer to the point than the grid don't contain any cells
+    const int first_ring = std::max({0, -column, column - (column_count - 1), -row, row - (row_count - 1)});
+    for (int ring = first_ring; ; ring++)
+    {
+        const int column_min = column - ring;
+        const int column_max = column + ring;
+        const int row_min = row - ring;
+        const int row_max = row + ring;
+        for (int cell_row = std::max(row_min, 0); cell_row <= std::min(row_max, row_count - 1); cell_row++)
+        {
+            if (cell_row == row_min || cell_row == row_max)
+            {
+                for (int cell_column = std::max(column_min, 0); cell_column <= std::min(column_max, column_count - 1); cell_column++)
+                {
+                    check_cell(cell_column, cell_row);
+                }
+            }
+            else
+            { // only the sides of the ring
+                if (column_min >= 0)
+                {
+                    check_cell(column_min, cell_row);
+                }
+                if (column_max < column_count && column_max != column_min)
+                {
+                    check_cell(column_max, cell_row);
+                }
+            }
+        }
+        if (column_min <= 0 && row_min <= 0 && column_max >= column_count - 1 && row_max >= row_count - 1)
+        { // all cells have been checked
+            break;
+        }
+        if (best_score < std::numeric_limits<int64_t>::max())
+        { // the segments which haven't been checked lie outside of the square of the rings checked so far
+            const coord_t distance_to_unchecked = std::min({
+                from.X - (origin.X + column_min * cell_size), origin.X + (column_max + 1) * cell_size - from.X,
+                from.Y - (origin.Y + row_min * cell_size), origin.Y + (row_max + 1) * cell_size - from.Y}) - rounding_margin;
+            if (distance_to_unchecked > 0 && best_score < distance_to_unchecked * distance_to_unchecked)
+            {
+                break;
+            }
+        }
+    }
+    return best_segment_idx;
+}
+
+Point PolygonSegmentGrid::findClosestPoint(Point from) const
+{
+    const unsigned int segment_count = polygon.size();
+    if (segment_count == 0)
+    {
+        return from;
+    }
+    const unsigned int segment_idx = findClosestSegment(from);
+    const Point closest = LinearAlg2D::getClosestOnLineSegment(from, polygon[segment_idx], polygon[(segment_idx + 1) % segment_count]);
+    // like PolygonUtils::findClosest, keep the first point unless a segment is strictly closer
+    return (vSize2(from - closest) < vSize2(from - polygon[0]))? closest : polygon[0];
+}
+
+}//namespace cura
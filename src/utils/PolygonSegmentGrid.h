@@ -0,0 +1,70 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_POLYGON_SEGMENT_GRID_H
+#define UTILS_POLYGON_SEGMENT_GRID_H
+
+#include <vector>
+
+#include "intpoint.h"
+#include "polygon.h"
+
+namespace cura
+{
+
+/*!
+ * A grid over the segments of a single polygon, to find the segment closest to a point without going over all segments.
+ *
+ * The cells are stored in a flat array, each with the indices of the segments whose bounding box overlaps it,
+ * so building the grid is a couple of passes over the points without allocating per cell.
+ * A query looks at the cells in rings around the point until no unvisited segment can be closer.
+ *
+ * The polygon must not be changed or destroyed as long as the grid is used.
+ */
+class PolygonSegmentGrid
+{
+public:
+    /*!
+     * \param polygon The polygon of which to index the segments, including the closing segment from the last point to the first
+     */
+    explicit PolygonSegmentGrid(ConstPolygonRef polygon);
+
+    /*!
+     * Find the segment of the polygon closest to a point.
+     *
+     * This gives the same result as the point index of PolygonUtils::findClosest without a penalty function,
+     * including the choice between segments at the same distance.
+     *
+     * \param from The point to which to find the closest segment
+     * \return The index of the first point of the closest segment, or 0 if the polygon is empty
+     */
+    unsigned int findClosestSegment(Point from) const;
+
+    /*!
+     * Find the point on the polygon closest to a point.
+     *
+     * This gives the same location as PolygonUtils::findClosest without a penalty function.
+     *
+     * \param from The point to which to find the closest point
+     * \return The closest point on the polygon, or \p from if the polygon is empty
+     */
+    Point findClosestPoint(Point from) const;
+
+private:
+    ConstPolygonRef polygon; //!< The polygon of which the segments are indexed
+    Point origin; //!< The corner of the first cell, the minimum of the bounding box of the polygon
+    coord_t cell_size; //!< The width and height of each cell
+    int column_count; //!< The number of cells in the x direction
+    int row_count; //!< The number of cells in the y direction
+    std::vector<unsigned int> cell_starts; //!< For each cell the index in \ref PolygonSegmentGrid::cell_segments of its first segment, and one more for the end of the last cell
+    std::vector<unsigned int> cell_segments; //!< The segments of each cell, one cell after the other
+
+    /*!
+     * The column or row of the cell containing a coordinate, which may lie outside of the grid.
+     */
+    int toCell(coord_t coord, coord_t origin_coord) const;
+};
+
+}//namespace cura
+
+#endif//UTILS_POLYGON_SEGMENT_GRID_H
@@ -0,0 +1,422 @@
+/** Copyright (C) 2017 Ultimaker - Released under terms of the AGPLv3 License */
+#include "Profiler.h"
+
+#include <algorithm> // max
+#include <cstdio>
+#include <cstdlib> // malloc
+#include <cstring> // memset
+#include <map>
+#include <new>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "logoutput.h"
+
+namespace cura
+{
+
+#ifdef __linux__
+namespace
+{
+//! The perf_event configurations of the hardware events, in the order of Profiler::counter_names
+const uint64_t counter_configs[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+/*!
+ * Start counting a hardware event of the calling thread in user space, on any CPU.
+ *
+ * \param config The event
+ * \param group_fd The counter with which to read this one, or -1 to start a new group
+ * \return The file descriptor of the counter, or -1 if the event can't be counted
+ */
+int openCounter(uint64_t config, int group_fd)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1; // allowed without privileges for perf_event_paranoid up to 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+}//namespace
+#endif
+
+bool Profiler::enabled = false;
+std::string Profiler::output_file;
+bool Profiler::counters_enabled = false;
+std::array<bool, Profiler::counter_count> Profiler::counter_available = {{false, false, false, false}};
+const char* const Profiler::counter_names[Profiler::counter_count] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+Profiler::Clock::time_point Profiler::start_time;
+std::mutex Profiler::threads_mutex;
+std::vector<std::unique_ptr<Profiler::ThreadEvents>> Profiler::threads;
+thread_local uint64_t Profiler::thread_allocation_count = 0;
+thread_local uint64_t Profiler::thread_allocated_bytes = 0;
+thread_local unsigned int Profiler::geometry_operation_depth = 0;
+
+void Profiler::enable(const std::string& output_file)
+{
+    Profiler::output_file = output_file;
+    start_time = Clock::now();
+    enabled = true;
+}
+
+bool Profiler::enableHardwareCounters()
+{
+    bool any_available = false;
+#ifdef __linux__
+    for (unsigned int counter_idx = 0; counter_idx < counter_count; counter_idx++)
+    {
+        const int fd = openCounter(counter_configs[counter_idx], -1);
+        counter_available[counter_idx] = fd >= 0;
+        any_available |= counter_available[counter_idx];
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+#endif
+    if (!any_available)
+    {
+        logWarning("Hardware event counters are not available, the profile only includes the time and the allocations of each stage.\n");
+    }
+    counters_enabled = any_available;
+    return any_available;
+}
+
+Profiler::HardwareCounters::HardwareCounters()
+: group_fd(-1)
+, opened_count(0)
+{
+    fds.fill(-1);
+    value_idx.fill(-1);
+}
+
+Profiler::HardwareCounters::~HardwareCounters()
+{
+#ifdef __linux__
+    for (int fd : fds)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+#endif
+}
+
+void Profiler::HardwareCounters::open()
+{
+#ifdef __linux__
+    for (unsigned int counter_idx = 0; counter_idx < counter_count; counter_idx++)
+    {
+        if (!counter_available[counter_idx])
+        {
+            continue;
+        }
+        fds[counter_idx] = openCounter(counter_configs[counter_idx], group_fd);
+        if (fds[counter_idx] < 0)
+        {
+            continue;
+        }
+        if (group_fd < 0)
+        {
+            group_fd = fds[counter_idx];
+        }
+        value_idx[counter_idx] = opened_count;
+        opened_count++;
+    }
+#endif
+}
+
+Profiler::CounterValues Profiler::HardwareCounters::read() const
+{
+    CounterValues values;
+    values.fill(0);
+#ifdef __linux__
+    if (group_fd < 0)
+    {
+        return values;
+    }
+    uint64_t group_values[1 + counter_count]; // the number of counters followed by their values
+    const ssize_t expected_size = (1 + opened_count) * sizeof(uint64_t);
+    if (::read(group_fd, group_values, sizeof(group_values)) < expected_size)
+    {
+        return values;
+    }
+    for (unsigned int counter_idx = 0; counter_idx < counter_count; counter_idx++)
+    {
+        if (value_idx[counter_idx] >= 0)
+        {
+            values[counter_idx] = group_values[1 + value_idx[counter_idx]];
+        }
+    }
+#endif
+    return values;
+}
+
+std::string Profiler::formatCounters(const CounterValues& counters)
+{
+    std::string formatted;
+    if (!counters_enabled)
+    {
+        return formatted;
+    }
+    char buffer[64];
+    for (unsigned int counter_idx = 0; counter_idx < counter_count; counter_idx++)
+    {
+        if (counter_available[counter_idx])
+        {
+            snprintf(buffer, sizeof(buffer), ", \"%s\": %llu", counter_names[counter_idx], static_cast<unsigned long long>(counters[counter_idx]));
+            formatted += buffer;
+        }
+    }
+    return formatted;
+}
+
+Profiler::ThreadEvents& Profiler::getThreadEvents()
+{
+    static thread_local ThreadEvents* thread_events = nullptr;
+    if (!thread_events)
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        threads.emplace_back(new ThreadEvents());
+        thread_events = threads.back().get();
+        thread_events->thread_idx = threads.size() - 1;
+        if (counters_enabled)
+        {
+            thread_events->counters.open();
+        }
+    }
+    return *thread_events;
+}
+
+void Profiler::startZone(const char* name)
+{
+    ThreadEvents& thread_events = getThreadEvents();
+    CounterValues start_counters;
+    if (counters_enabled)
+    {
+        start_counters = thread_events.counters.read();
+    }
+    else
+    {
+        start_counters.fill(0);
+    }
+    thread_events.active_zones.push_back(ActiveZone{name, Clock::now(), thread_allocation_count, thread_allocated_bytes, start_counters});
+}
+
+void Profiler::endZone()
+{
+    const Clock::time_point end = Clock::now();
+    ThreadEvents& thread_events = getThreadEvents();
+    Event event;
+    if (counters_enabled)
+    {
+        event.counters = thread_events.counters.read();
+    }
+    else
+    {
+        event.counters.fill(0);
+    }
+    const uint64_t end_allocation_count = thread_allocation_count;
+    const uint64_t end_allocated_bytes = thread_allocated_bytes;
+    for (const ActiveZone& active_zone : thread_events.active_zones)
+    {
+        if (!event.path.empty())
+        {
+            event.path += '/';
+        }
+        event.path += active_zone.name;
+    }
+    const ActiveZone& zone = thread_events.active_zones.back();
+    event.name = zone.name;
+    event.start = std::chrono::duration_cast<std::chrono::microseconds>(zone.start - start_time).count();
+    event.duration = std::chrono::duration_cast<std::chrono::microseconds>(end - zone.start).count();
+    event.depth = thread_events.active_zones.size() - 1;
+    event.allocation_count = end_allocation_count - zone.start_allocation_count;
+    event.allocated_bytes = end_allocated_bytes - zone.start_allocated_bytes;
+    for (unsigned int counter_idx = 0; counter_idx < counter_count; counter_idx++)
+    {
+        event.counters[counter_idx] -= zone.start_counters[counter_idx];
+    }
+    thread_events.active_zones.pop_back();
+    thread_events.events.push_back(std::move(event));
+}
+
+void Profiler::countGeometryOperation(const char* name, uint64_t input_point_count, Clock::duration duration)
+{
+    ThreadEvents& thread_events = getThreadEvents();
+    const char* zone_name = thread_events.active_zones.empty()? "" : thread_events.active_zones.back().name;
+    GeometryOperationStats& stats = thread_events.geometry_operations[std::make_pair(zone_name, name)];
+    stats.count++;
+    stats.input_point_count += input_point_count;
+    stats.duration += duration;
+}
+
+bool Profiler::writeReport()
+{
+    if (!enabled)
+    {
+        return false;
+    }
+    FILE* out = fopen(output_file.c_str(), "w");
+    if (!out)
+    {
+        logError("Failed to open %s for the profile.\n", output_file.c_str());
+        return false;
+    }
+    const int64_t total_duration = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time).count();
+
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    struct PathStats
+    {
+        unsigned int count = 0;
+        int64_t duration = 0;
+        uint64_t allocation_count = 0;
+        uint64_t allocated_bytes = 0;
+        CounterValues counters = CounterValues();
+    };
+    std::map<std::string, PathStats> stats_per_path;
+    std::map<std::string, std::map<std::string, GeometryOperationStats>> geometry_operations_per_zone; // merged over the threads
+    std::vector<int64_t> busy_duration_per_thread;
+    fprintf(out, "{\"traceEvents\": [");
+    bool first_event = true;
+    for (const std::unique_ptr<ThreadEvents>& thread_events : threads)
+    {
+        int64_t busy_duration = 0;
+        for (const Event& event : thread_events->events)
+        {
+            fprintf(out, "%s\n{\"name\": \"%s\", \"cat\": \"stage\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, \"pid\": 0, \"tid\": %u, \"args\": {\"path\": \"%s\", \"allocations\": %llu, \"allocated_bytes\": %llu%s}}"
+                , first_event? "" : ","
+                , event.name, static_cast<long long>(event.start), static_cast<long long>(event.duration), thread_events->thread_idx, event.path.c_str()
+                , static_cast<unsigned long long>(event.allocation_count), static_cast<unsigned long long>(event.allocated_bytes), formatCounters(event.counters).c_str());
+            first_event = false;
+            PathStats& stats = stats_per_path[event.path];
+            stats.count++;
+            stats.duration += event.duration;
+            stats.allocation_count += event.allocation_count;
+            stats.allocated_bytes += event.allocated_bytes;
+            for (unsigned int counter_idx = 0; counter_idx < counter_count; counter_idx++)
+            {
+                stats.counters[counter_idx] += event.counters[counter_idx];
+            }
+            if (event.depth == 0)
+            {
+                busy_duration += event.duration;
+            }
+        }
+        busy_duration_per_thread.push_back(busy_duration);
+        for (const std::pair<const std::pair<const char*, const char*>, GeometryOperationStats>& operation : thread_events->geometry_operations)
+        {
+            GeometryOperationStats& stats = geometry_operations_per_zone[operation.first.first][operation.first.second];
+            stats.count += operation.second.count;
+            stats.input_point_count += operation.second.input_point_count;
+            stats.duration += operation.second.duration;
+        }
+    }
+    fprintf(out, "\n],\n\"stages\": {");
+    bool first_stage = true;
+    for (const std::pair<const std::string, PathStats>& path_and_stats : stats_per_path)
+    {
+        const PathStats& stats = path_and_stats.second;
+        std::string counters = formatCounters(stats.counters);
+        if (counter_available[0] && counter_available[1] && stats.counters[0] > 0)
+        { // a low number of instructions per cycle hints at a stage waiting for memory
+            char instructions_per_cycle[48];
+            snprintf(instructions_per_cycle, sizeof(instructions_per_cycle), ", \"instructions_per_cycle\": %.3f", double(stats.counters[1]) / stats.counters[0]);
+            counters += instructions_per_cycle;
+        }
+        fprintf(out, "%s\n\"%s\": {\"count\": %u, \"seconds\": %.6f, \"allocations\": %llu, \"allocated_bytes\": %llu%s}"
+            , first_stage? "" : ","
+            , path_and_stats.first.c_str(), stats.count, stats.duration / 1000000.0
+            , static_cast<unsigned long long>(stats.allocation_count), static_cast<unsigned long long>(stats.allocated_bytes), counters.c_str());
+        first_stage = false;
+    }
+    fprintf(out, "\n},\n\"threads\": [");
+    for (unsigned int thread_idx = 0; thread_idx < busy_duration_per_thread.size(); thread_idx++)
+    {
+        const int64_t busy_duration = busy_duration_per_thread[thread_idx];
+        fprintf(out, "%s\n{\"tid\": %u, \"busy_seconds\": %.6f, \"idle_seconds\": %.6f}"
+            , (thread_idx == 0)? "" : ","
+            , thread_idx, busy_duration / 1000000.0, std::max(int64_t(0), total_duration - busy_duration) / 1000000.0);
+    }
+    fprintf(out, "\n],\n\"geometry_operations\": {");
+    bool first_zone = true;
+    for (const std::pair<const std::string, std::map<std::string, GeometryOperationStats>>& zone_and_operations : geometry_operations_per_zone)
+    {
+        fprintf(out, "%s\n\"%s\": {", first_zone? "" : ",", zone_and_operations.first.empty()? "(none)" : zone_and_operations.first.c_str());
+        first_zone = false;
+        bool first_operation = true;
+        for (const std::pair<const std::string, GeometryOperationStats>& operation : zone_and_operations.second)
+        {
+            const GeometryOperationStats& stats = operation.second;
+            fprintf(out, "%s\"%s\": {\"count\": %llu, \"input_points\": %llu, \"seconds\": %.6f}"
+                , first_operation? "" : ", "
+                , operation.first.c_str(), static_cast<unsigned long long>(stats.count), static_cast<unsigned long long>(stats.input_point_count)
+                , std::chrono::duration_cast<std::chrono::microseconds>(stats.duration).count() / 1000000.0);
+            first_operation = false;
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n},\n\"total_seconds\": %.6f\n}\n", total_duration / 1000000.0);
+    fclose(out);
+    return true;
+}
+
+}//namespace cura
+
+// The global allocation functions are replaced to count the allocations per zone.
+// They allocate with malloc like the default ones, so that a malloc replacement linked in or preloaded is still used.
+
+void* operator new(size_t bytes)
+{
+    cura::Profiler::countAllocation(bytes);
+    void* ret = malloc(bytes > 0 ? bytes : 1);
+    if (!ret)
+    {
+        throw std::bad_alloc();
+    }
+    return ret;
+}
+
+void* operator new[](size_t bytes)
+{
+    return operator new(bytes);
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+    cura::Profiler::countAllocation(bytes);
+    return malloc(bytes > 0 ? bytes : 1);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t& nothrow) noexcept
+{
+    return operator new(bytes, nothrow);
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    free(memory);
+}
@@ -0,0 +1,280 @@
+/** Copyright (C) 2017 Ultimaker - Released under terms of the AGPLv3 License */
+#ifndef UTILS_PROFILER_H
+#define UTILS_PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility> // pair
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * Records how long the stages of the engine take and on which thread they run, and writes them to a report.
+ *
+ * Stages are measured with a Profiler::Zone, which is active for as long as it is in scope.
+ * Zones opened while another zone of the same thread is active are nested in it,
+ * so each zone is reported by its path of zone names, e.g. "slice/makePolygons".
+ * The zones opened on the worker threads of a parallel loop start a new path on that thread.
+ *
+ * The report is a Chrome trace file (chrome://tracing), extended with the total time and the count of each path
+ * and with the time each thread was busy in a zone and idle.
+ *
+ * The heap allocations made through operator new during each zone are counted as well, including those of the zones nested in it,
+ * so that the stages which allocate most can be found and the gains of a different memory allocator can be attributed to them.
+ * For this the profiler replaces the global operator new and delete.
+ *
+ * Optionally, the hardware events of each zone are counted per thread as well: cycles, instructions, cache misses and branch misses,
+ * which tell whether a stage is bound by computation or by memory access. This uses perf_event and is only available on Linux.
+ *
+ * The polygon operations, such as the boolean operations and the offsets, are counted with a Profiler::GeometryOperation per thread,
+ * with the number of points they got and the time they took, grouped by the innermost zone they were made in.
+ * This shows which stages repeat the same polygon operations and how much the caches of the results save.
+ *
+ * Profiling is off unless Profiler::enable is called. A zone and an allocation then cost a single check of a flag.
+ */
+class Profiler
+{
+public:
+    /*!
+     * Measures the time from its construction until its destruction as a stage of the profile.
+     */
+    class Zone : NoCopy
+    {
+    public:
+        /*!
+         * Start measuring a stage.
+         *
+         * \param name The name of the stage, which must outlive the profiler, e.g. a string literal
+         */
+        Zone(const char* name)
+        : active(Profiler::enabled)
+        {
+            if (active)
+            {
+                Profiler::startZone(name);
+            }
+        }
+
+        ~Zone()
+        {
+            if (active)
+            {
+                Profiler::endZone();
+            }
+        }
+    private:
+        bool active; //!< Whether profiling was enabled when this zone was started
+    };
+
+    /*!
+     * Counts a polygon operation, with the number of points of its input and the time from its construction until its destruction.
+     *
+     * Operations made as part of another one, such as the union before an offset, are included in the outer operation and aren't counted separately.
+     */
+    class GeometryOperation : NoCopy
+    {
+    public:
+        /*!
+         * Start measuring a polygon operation.
+         *
+         * \param name The name of the operation, which must outlive the profiler, e.g. a string literal
+         * \param count_input_points Returns the number of points of the input of the operation. Only called when profiling is enabled.
+         */
+        template<typename CountPoints>
+        GeometryOperation(const char* name, const CountPoints& count_input_points)
+        : active(Profiler::enabled && geometry_operation_depth == 0)
+        , name(name)
+        , input_point_count(0)
+        {
+            if (active)
+            {
+                geometry_operation_depth++;
+                input_point_count = count_input_points();
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~GeometryOperation()
+        {
+            if (active)
+            {
+                Profiler::countGeometryOperation(name, input_point_count, std::chrono::steady_clock::now() - start);
+                geometry_operation_depth--;
+            }
+        }
+    private:
+        bool active; //!< Whether profiling was enabled when this operation was started and it isn't part of another operation
+        const char* name; //!< The name of the operation
+        uint64_t input_point_count; //!< The number of points of the input
+        std::chrono::steady_clock::time_point start; //!< When the operation started
+    };
+
+    /*!
+     * Start recording zones, which are written to \p output_file by Profiler::writeReport.
+     *
+     * Must be called before any zone is started.
+     */
+    static void enable(const std::string& output_file);
+
+    /*!
+     * Also count the hardware events of each zone, see \ref Profiler
+     *
+     * Must be called after Profiler::enable and before any zone is started.
+     * The events which the system doesn't support or doesn't allow to be counted, see /proc/sys/kernel/perf_event_paranoid, are left out of the report.
+     *
+     * \return Whether any of the events can be counted
+     */
+    static bool enableHardwareCounters();
+
+    /*!
+     * Write all zones recorded so far to the file given to Profiler::enable.
+     *
+     * Must be called when no zones are active anymore.
+     *
+     * \return Whether the report has been written, which is false if profiling wasn't enabled or if the file couldn't be written
+     */
+    static bool writeReport();
+
+    /*!
+     * Count a heap allocation of the current thread, if profiling is enabled. Called by the replaced operator new.
+     *
+     * \param bytes The size of the allocation
+     */
+    static void countAllocation(size_t bytes)
+    {
+        if (enabled)
+        {
+            thread_allocation_count++;
+            thread_allocated_bytes += bytes;
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr unsigned int counter_count = 4; //!< The number of hardware events counted: cycles, instructions, cache misses and branch misses
+    using CounterValues = std::array<uint64_t, counter_count>;
+
+    /*!
+     * The hardware event counters of a single thread
+     */
+    class HardwareCounters
+    {
+    public:
+        HardwareCounters();
+        ~HardwareCounters();
+
+        /*!
+         * Start counting the events of the current thread.
+         */
+        void open();
+
+        /*!
+         * Get the number of events of the current thread since the counters were opened, or zeros for those which couldn't be opened.
+         */
+        CounterValues read() const;
+
+    private:
+        int group_fd; //!< The counter which reads all counters at once, or -1 if none could be opened
+        std::array<int, counter_count> fds; //!< The file descriptor of each counter, or -1
+        std::array<int, counter_count> value_idx; //!< The index of each counter in the values read from the group, or -1
+        unsigned int opened_count; //!< The number of counters in the group
+    };
+
+    /*!
+     * A zone which has been recorded
+     */
+    struct Event
+    {
+        const char* name; //!< The name of the zone
+        std::string path; //!< The names of the zones it was nested in and its own name, separated by '/'
+        int64_t start; //!< The start time relative to when profiling was enabled, in microseconds
+        int64_t duration; //!< The duration in microseconds
+        unsigned int depth; //!< The number of zones it was nested in
+        uint64_t allocation_count; //!< The number of heap allocations during the zone
+        uint64_t allocated_bytes; //!< The number of bytes allocated on the heap during the zone
+        CounterValues counters; //!< The number of hardware events during the zone, if they are counted
+    };
+
+    /*!
+     * A zone which hasn't ended yet
+     */
+    struct ActiveZone
+    {
+        const char* name; //!< The name of the zone
+        Clock::time_point start; //!< When the zone started
+        uint64_t start_allocation_count; //!< The number of allocations of the thread when the zone started
+        uint64_t start_allocated_bytes; //!< The number of bytes allocated by the thread when the zone started
+        CounterValues start_counters; //!< The hardware event counters of the thread when the zone started
+    };
+
+    /*!
+     * The number of polygon operations of a kind, with the total of their input and their duration
+     */
+    struct GeometryOperationStats
+    {
+        uint64_t count = 0; //!< The number of operations
+        uint64_t input_point_count = 0; //!< The total number of points of their input
+        Clock::duration duration = Clock::duration::zero(); //!< Their total duration
+    };
+
+    /*!
+     * The zones of a single thread
+     */
+    struct ThreadEvents
+    {
+        unsigned int thread_idx; //!< The number of the thread in the order in which threads started their first zone
+        std::vector<Event> events; //!< The zones which have ended, in the order in which they ended
+        std::vector<ActiveZone> active_zones; //!< The zones which haven't ended yet, outermost first
+        HardwareCounters counters; //!< The hardware event counters of the thread, if they are counted
+        std::map<std::pair<const char*, const char*>, GeometryOperationStats> geometry_operations; //!< The polygon operations of the thread per name of the innermost zone they were made in, or "", and per name of the operation
+    };
+
+    static bool enabled; //!< Whether zones are recorded
+    static std::string output_file; //!< The file to which to write the report
+    static bool counters_enabled; //!< Whether hardware events are counted
+    static std::array<bool, counter_count> counter_available; //!< For each hardware event whether it could be counted on the thread which enabled the counters
+    static const char* const counter_names[counter_count]; //!< The names of the hardware events in the report
+    static Clock::time_point start_time; //!< When profiling was enabled
+    static std::mutex threads_mutex; //!< Guards Profiler::threads
+    static std::vector<std::unique_ptr<ThreadEvents>> threads; //!< The zones of each thread which has started a zone, owned here so that they outlive their thread
+    static thread_local uint64_t thread_allocation_count; //!< The number of heap allocations of the current thread since profiling was enabled
+    static thread_local uint64_t thread_allocated_bytes; //!< The number of bytes allocated on the heap by the current thread since profiling was enabled
+    static thread_local unsigned int geometry_operation_depth; //!< The number of polygon operations being counted on the current thread, which is at most one
+
+    /*!
+     * Get the zones of the current thread, registering the thread if it starts its first zone.
+     */
+    static ThreadEvents& getThreadEvents();
+
+    /*!
+     * Format the counts of the hardware events which are counted as JSON members, each preceded by a comma.
+     */
+    static std::string formatCounters(const CounterValues& counters);
+
+    static void startZone(const char* name);
+
+    static void endZone();
+
+    /*!
+     * Add a polygon operation to the statistics of the current thread, for the innermost zone of the thread.
+     *
+     * \param name The name of the operation
+     * \param input_point_count The number of points of its input
+     * \param duration How long it took
+     */
+    static void countGeometryOperation(const char* name, uint64_t input_point_count, Clock::duration duration);
+};
+
+}//namespace cura
+
+#endif//UTILS_PROFILER_H
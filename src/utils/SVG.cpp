@@ -0,0 +1,101 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "SVG.h"
+
+#include <memory> // shared_ptr
+
+#include "ThreadPool.h"
+
+namespace cura
+{
+
+/*!
+ * The writes of the files of destroyed SVG objects which may not have finished yet.
+ */
+static ThreadPool::TaskGroup& getBackgroundWrites()
+{
+    static ThreadPool::TaskGroup background_writes; // waits for the writes when the program exits
+    return background_writes;
+}
+
+SVG::SVG(const char* filename, AABB aabb, Point canvas_size)
+: filename(filename)
+, aabb(aabb)
+, aabb_size(aabb.max - aabb.min)
+, border(200,100)
+, canvas_size(canvas_size)
+, scale(std::min(double(canvas_size.X - border.X * 2) / aabb_size.X, double(canvas_size.Y - border.Y * 2) / aabb_size.Y))
+{
+    buffer += "<!DOCTYPE html><html><body>\n";
+    buffer += "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" style=\"width:";
+    appendNumber(canvas_size.X);
+    buffer += "px;height:";
+    appendNumber(canvas_size.Y);
+    buffer += "px\">\n";
+}
+
+SVG::~SVG()
+{
+    buffer += "</svg>\n";
+    buffer += "</body></html>";
+    std::shared_ptr<std::string> contents = std::make_shared<std::string>();
+    contents->swap(buffer);
+    const std::string path = filename;
+    getBackgroundWrites().run([contents, path]()
+        {
+            FILE* out = fopen(path.c_str(), "w");
+            if (!out)
+            {
+                logError("The file %s could not be opened for writing.", path.c_str());
+                return;
+            }
+            fwrite(contents->data(), 1, contents->size(), out);
+            fclose(out);
+        });
+}
+
+void SVG::waitForBackgroundWrites()
+{
+    getBackgroundWrites().wait();
+}
+
+void SVG::appendNumber(int64_t number)
+{
+    char digits[24];
+    char* digit = digits + sizeof(digits);
+    uint64_t magnitude = (number < 0)? -static_cast<uint64_t>(number) : number;
+    do
+    {
+        *--digit = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (number < 0)
+    {
+        *--digit = '-';
+    }
+    buffer.append(digit, digits + sizeof(digits));
+}
+
+void SVG::appendLineStart(const Point& a, const Point& b)
+{
+    buffer += "<line x1=\"";
+    appendNumber(a.X);
+    buffer += "\" y1=\"";
+    appendNumber(a.Y);
+    buffer += "\" x2=\"";
+    appendNumber(b.X);
+    buffer += "\" y2=\"";
+    appendNumber(b.Y);
+}
+
+void SVG::appendTextStart(const Point& p)
+{
+    buffer += "<text x=\"";
+    appendNumber(p.X);
+    buffer += "\" y=\"";
+    appendNumber(p.Y);
+    buffer += "\" style=\"font-size: 10px;\" fill=\"black\">";
+}
+
+}//namespace cura
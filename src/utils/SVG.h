@@ -1,7 +1,8 @@
 #ifndef SVG_H
 #define SVG_H
 
-#include <stdio.h> // for file output
+#include <cstdio> // snprintf
+#include <string>
 
 #include "polygon.h"
 #include "intpoint.h"
@@ -11,6 +12,14 @@
 
 namespace cura {
 
+/*!
+ * Debug output of geometry as an HTML file with an SVG canvas.
+ *
+ * The elements are formatted into a buffer without going through printf for each coordinate,
+ * and the buffer is written to the file in the background when the SVG is destroyed,
+ * so that debug output hardly delays the code which makes it.
+ * Many files can be made in parallel, each by its own SVG object.
+ */
 class SVG : NoCopy
 {
 public:
@@ -43,7 +52,8 @@ private:
     
     
     
-    FILE* out; // the output file
+    std::string filename; // the output file
+    std::string buffer; // the contents of the file, written when done
     const AABB aabb; // the boundary box to display
     const Point aabb_size;
     const Point border;
@@ -51,29 +61,45 @@ private:
     const double scale;
 
 public:
-    SVG(const char* filename, AABB aabb, Point canvas_size = Point(1024 * 4, 1024 * 4))
-    : aabb(aabb)
-    , aabb_size(aabb.max - aabb.min)
-    , border(200,100)
-    , canvas_size(canvas_size)
-    , scale(std::min(double(canvas_size.X - border.X * 2) / aabb_size.X, double(canvas_size.Y - border.Y * 2) / aabb_size.Y))
-    {
-        out = fopen(filename, "w");
-        if(!out)
-        {
-            logError("The file %s could not be opened for writing.",filename);
-        }
-        fprintf(out, "<!DOCTYPE html><html><body>\n");
-        fprintf(out, "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" style=\"width:%llipx;height:%llipx\">\n", canvas_size.X, canvas_size.Y);
-    }
+    SVG(const char* filename, AABB aabb, Point canvas_size = Point(1024 * 4, 1024 * 4));
+
+    /*!
+     * Finish the file and write it in the background; see \ref SVG::waitForBackgroundWrites
+     */
+    ~SVG();
+
+    /*!
+     * Wait until the files of all destroyed SVG objects have been written.
+     */
+    static void waitForBackgroundWrites();
+
+private:
+    /*!
+     * Append an integer to the buffer in decimal notation.
+     */
+    void appendNumber(int64_t number);
 
-    ~SVG()
+    /*!
+     * Append the coordinates of a point to the buffer, separated by a comma.
+     */
+    void appendPoint(const Point& p)
     {
-        fprintf(out, "</svg>\n");
-        fprintf(out, "</body></html>");
-        fclose(out);
+        appendNumber(p.X);
+        buffer += ',';
+        appendNumber(p.Y);
     }
 
+    /*!
+     * Append the start of a line tag with its end points in canvas space, up to the value of the last coordinate.
+     */
+    void appendLineStart(const Point& a, const Point& b);
+
+    /*!
+     * Append the start of a text tag at a point in canvas space, up to where the text goes.
+     */
+    void appendTextStart(const Point& p);
+
+public:
     /*!
      * transform a point in real space to canvas space
      */
@@ -84,7 +110,9 @@ public:
 
     void writeComment(std::string comment)
     {
-        fprintf(out, "<!-- %s -->\n", comment.c_str());
+        buffer += "<!-- ";
+        buffer += comment;
+        buffer += " -->\n";
     }
 
     void writeAreas(const Polygons& polygons, Color color = Color::GRAY, Color outline_color = Color::BLACK) 
@@ -93,39 +121,48 @@ public:
         {
             for(unsigned int j=0;j<parts.size();j++)
             {
-                fprintf(out, "<polygon points=\"");
+                buffer += "<polygon points=\"";
                 for (Point& p : parts[j])
                 {
-                    Point fp = transform(p);
-                    fprintf(out, "%lli,%lli ", fp.X, fp.Y);
+                    appendPoint(transform(p));
+                    buffer += ' ';
                 }
-                if (j == 0)
-                    fprintf(out, "\" style=\"fill:%s;stroke:%s;stroke-width:1\" />\n", toString(color).c_str(), toString(outline_color).c_str());
-                else
-                    fprintf(out, "\" style=\"fill:white;stroke:%s;stroke-width:1\" />\n", toString(outline_color).c_str());
+                buffer += "\" style=\"fill:";
+                buffer += (j == 0)? toString(color) : "white";
+                buffer += ";stroke:";
+                buffer += toString(outline_color);
+                buffer += ";stroke-width:1\" />\n";
             }
         }
     }
 
     void writeAreas(std::vector<Point> polygon,Color color = Color::GRAY,Color outline_color = Color::BLACK)
     {
-        fprintf(out,"<polygon fill=\"%s\" stroke=\"%s\" stroke-width=\"1\" points=\"",toString(color).c_str(),toString(outline_color).c_str()); //The beginning of the polygon tag.
+        buffer += "<polygon fill=\"" + toString(color) + "\" stroke=\"" + toString(outline_color) + "\" stroke-width=\"1\" points=\""; //The beginning of the polygon tag.
         for(Point& point : polygon) //Add every point to the list of points.
         {
-            Point transformed = transform(point);
-            fprintf(out,"%lli,%lli ",transformed.X,transformed.Y);
+            appendPoint(transform(point));
+            buffer += ' ';
         }
-        fprintf(out,"\" />\n"); //The end of the polygon tag.
+        buffer += "\" />\n"; //The end of the polygon tag.
     }
 
     void writePoint(const Point& p, bool write_coords=false, int size = 5, Color color = Color::BLACK)
     {
         Point pf = transform(p);
-        fprintf(out, "<circle cx=\"%lli\" cy=\"%lli\" r=\"%d\" stroke=\"%s\" stroke-width=\"1\" fill=\"%s\" />\n",pf.X, pf.Y, size, toString(color).c_str(), toString(color).c_str());
+        buffer += "<circle cx=\"";
+        appendNumber(pf.X);
+        buffer += "\" cy=\"";
+        appendNumber(pf.Y);
+        buffer += "\" r=\"";
+        appendNumber(size);
+        buffer += "\" stroke=\"" + toString(color) + "\" stroke-width=\"1\" fill=\"" + toString(color) + "\" />\n";
         
         if (write_coords)
         {
-            fprintf(out, "<text x=\"%lli\" y=\"%lli\" style=\"font-size: 10px;\" fill=\"black\">%lli,%lli</text>\n",pf.X, pf.Y, p.X, p.Y);
+            appendTextStart(pf);
+            appendPoint(p);
+            buffer += "</text>\n";
         }
     }
 
@@ -163,21 +200,22 @@ public:
             return;
         }
         
-        Point transformed = transform(polyline[0]); //Element 0 must exist due to the check above.
-        fprintf(out,"<path fill=\"none\" stroke=\"%s\" stroke-width=\"1\" d=\"M%lli,%lli",toString(color).c_str(),transformed.X,transformed.Y); //Write the start of the path tag and the first endpoint.
+        buffer += "<path fill=\"none\" stroke=\"" + toString(color) + "\" stroke-width=\"1\" d=\"M"; //Write the start of the path tag and the first endpoint.
+        appendPoint(transform(polyline[0])); //Element 0 must exist due to the check above.
         for(size_t point = 1;point < polyline.size();point++)
         {
-            transformed = transform(polyline[point]);
-            fprintf(out,"L%lli,%lli",transformed.X,transformed.Y); //Write a line segment to the next point.
+            buffer += 'L'; //Write a line segment to the next point.
+            appendPoint(transform(polyline[point]));
         }
-        fprintf(out,"\" />\n"); //Write the end of the tag.
+        buffer += "\" />\n"; //Write the end of the tag.
     }
 
     void writeLine(const Point& a, const Point& b, Color color = Color::BLACK, int stroke_width = 1)
     {
-        Point fa = transform(a);
-        Point fb = transform(b);
-        fprintf(out, "<line x1=\"%lli\" y1=\"%lli\" x2=\"%lli\" y2=\"%lli\" style=\"stroke:%s;stroke-width:%i\" />\n", fa.X, fa.Y, fb.X, fb.Y, toString(color).c_str(), stroke_width);
+        appendLineStart(transform(a), transform(b));
+        buffer += "\" style=\"stroke:" + toString(color) + ";stroke-width:";
+        appendNumber(stroke_width);
+        buffer += "\" />\n";
     }
     
     /*!
@@ -191,20 +229,27 @@ public:
      */
     void writeDashedLine(const Point& a,const Point& b,Color color = Color::BLACK)
     {
-        Point fa = transform(a);
-        Point fb = transform(b);
-        fprintf(out,"<line x1=\"%lli\" y1=\"%lli\" x2=\"%lli\" y2=\"%lli\" stroke=\"%s\" stroke-width=\"1\" stroke-dasharray=\"5,5\" />\n",fa.X,fa.Y,fb.X,fb.Y,toString(color).c_str());
+        appendLineStart(transform(a), transform(b));
+        buffer += "\" stroke=\"" + toString(color) + "\" stroke-width=\"1\" stroke-dasharray=\"5,5\" />\n";
     }
 
     template<typename... Args>
     void printf(const char* txt, Args&&... args)
     {
-        fprintf(out, txt, args...);
+        const int size = snprintf(nullptr, 0, txt, args...);
+        if (size > 0)
+        {
+            const size_t start = buffer.size();
+            buffer.resize(start + size + 1); // room for the terminating zero written by snprintf
+            snprintf(&buffer[start], size + 1, txt, args...);
+            buffer.resize(start + size);
+        }
     }
     void writeText(Point p, std::string txt)
     {
-        Point pf = transform(p);
-        fprintf(out, "<text x=\"%lli\" y=\"%lli\" style=\"font-size: 10px;\" fill=\"black\">%s</text>\n",pf.X, pf.Y, txt.c_str());
+        appendTextStart(transform(p));
+        buffer += txt;
+        buffer += "</text>\n";
     }
     void writePolygons(const Polygons& polys, Color color = Color::BLACK)
     {
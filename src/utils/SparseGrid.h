@@ -4,6 +4,7 @@
 #define UTILS_SPARSE_GRID_H
 
 #include "intpoint.h"
+#include "MortonGridMap.h"
 
 #include <cassert>
 #include <unordered_map>
@@ -18,8 +19,10 @@ namespace cura {
  * \see SparsePointGrid
  *
  * \tparam ElemT The element type to store.
+ * \tparam GridMapT The map from grid cells to elements. Either a hash map or
+ *    a \ref MortonGridMap for grids which are first filled and then queried.
  */
-template<class ElemT>
+template<class ElemT, class GridMapT = std::unordered_multimap<Point, ElemT>>
 class SparseGrid
 {
 public:
@@ -51,6 +54,17 @@ public:
      */
     std::vector<Elem> getNearby(const Point &query_pt, coord_t radius) const;
 
+    /*! \brief Collects all data within radius of query_pt into a caller supplied buffer.
+     *
+     * The same as \ref SparseGrid::getNearby, but reusing the memory of \p result
+     * so that repeated queries don't allocate.
+     *
+     * \param[in] query_pt The point to search around.
+     * \param[in] radius The search radius.
+     * \param[out] result The elements found. Its previous contents are cleared.
+     */
+    void getNearby(const Point &query_pt, coord_t radius, std::vector<Elem>& result) const;
+
     static const std::function<bool(const Elem&)> no_precondition;
 
     /*!
@@ -81,6 +95,20 @@ public:
     void processNearby(const Point &query_pt, coord_t radius,
                        const std::function<bool (const ElemT&)>& process_func) const;
 
+    /*! \brief Process elements from cells that might contain sought after points.
+     *
+     * The same as \ref SparseGrid::processNearby, but the visitor is called
+     * directly instead of through an std::function, so that it can be inlined.
+     *
+     * \param[in] query_pt The point to search around.
+     * \param[in] radius The search radius.
+     * \param[in] visitor Processes each element.  visitor(elem) is
+     *    called for each element in the cell. Processing stops if it returns false.
+     * \return Whether all cells were processed, i.e. the visitor never returned false.
+     */
+    template<class Visitor>
+    bool visitNearby(const Point &query_pt, coord_t radius, Visitor&& visitor) const;
+
     /*! \brief Process elements from cells that might contain sought after points along a line.
      *
      * Processes elements from cells that cross the line \p query_line.
@@ -98,7 +126,7 @@ public:
 protected:
     using GridPoint = Point;
     using grid_coord_t = coord_t;
-    using GridMap = std::unordered_multimap<GridPoint, Elem>;
+    using GridMap = GridMapT;
 
     /*! \brief Process elements from the cell indicated by \p grid_pt.
      *
@@ -168,8 +196,8 @@ protected:
 
 
 
-#define SGI_TEMPLATE template<class ElemT>
-#define SGI_THIS SparseGrid<ElemT>
+#define SGI_TEMPLATE template<class ElemT, class GridMapT>
+#define SGI_THIS SparseGrid<ElemT, GridMapT>
 
 SGI_TEMPLATE
 SGI_THIS::SparseGrid(coord_t cell_size, size_t elem_reserve, float max_load_factor)
@@ -315,6 +343,13 @@ typename SGI_THIS::grid_coord_t SGI_THIS::nonzero_sign(const grid_coord_t z) con
 SGI_TEMPLATE
 void SGI_THIS::processNearby(const Point &query_pt, coord_t radius,
                              const std::function<bool (const Elem&)>& process_func) const
+{
+    visitNearby(query_pt, radius, process_func);
+}
+
+SGI_TEMPLATE
+template<class Visitor>
+bool SGI_THIS::visitNearby(const Point &query_pt, coord_t radius, Visitor&& visitor) const
 {
     Point min_loc(query_pt.X - radius, query_pt.Y - radius);
     Point max_loc(query_pt.X + radius, query_pt.Y + radius);
@@ -326,14 +361,17 @@ void SGI_THIS::processNearby(const Point &query_pt, coord_t radius,
     {
         for (coord_t grid_x = min_grid.X; grid_x <= max_grid.X; ++grid_x)
         {
-            GridPoint grid_pt(grid_x,grid_y);
-            bool continue_ = processFromCell(grid_pt, process_func);
-            if (!continue_)
+            auto grid_range = m_grid.equal_range(GridPoint(grid_x, grid_y));
+            for (auto iter = grid_range.first; iter != grid_range.second; ++iter)
             {
-                return;
+                if (!visitor(iter->second))
+                {
+                    return false;
+                }
             }
         }
     }
+    return true;
 }
 
 SGI_TEMPLATE
@@ -352,13 +390,19 @@ std::vector<typename SGI_THIS::Elem>
 SGI_THIS::getNearby(const Point &query_pt, coord_t radius) const
 {
     std::vector<Elem> ret;
-    const std::function<bool (const Elem&)> process_func = [&ret](const Elem &elem)
+    getNearby(query_pt, radius, ret);
+    return ret;
+}
+
+SGI_TEMPLATE
+void SGI_THIS::getNearby(const Point &query_pt, coord_t radius, std::vector<Elem>& result) const
+{
+    result.clear();
+    visitNearby(query_pt, radius, [&result](const Elem &elem)
         {
-            ret.push_back(elem);
+            result.push_back(elem);
             return true;
-        };
-    processNearby(query_pt, radius, process_func);
-    return ret;
+        });
 }
 
 SGI_TEMPLATE
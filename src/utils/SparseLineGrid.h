@@ -3,6 +3,7 @@
 #ifndef UTILS_SPARSE_LINE_GRID_H
 #define UTILS_SPARSE_LINE_GRID_H
 
+#include <algorithm> // min
 #include <cassert>
 #include <unordered_map>
 #include <vector>
@@ -11,6 +12,7 @@
 #include "intpoint.h"
 #include "SparseGrid.h"
 #include "SVG.h" // debug
+#include "ThreadPool.h"
 
 namespace cura {
 
@@ -20,9 +22,10 @@ namespace cura {
  * \tparam Locator The functor to get the start and end locations from ElemT.
  *    must have: std::pair<Point, Point> operator()(const ElemT &elem) const
  *    which returns the location associated with val.
+ * \tparam GridMapT The map from grid cells to elements, see \ref SparseGrid.
  */
-template<class ElemT, class Locator>
-class SparseLineGrid : public SparseGrid<ElemT>
+template<class ElemT, class Locator, class GridMapT = std::unordered_multimap<Point, ElemT>>
+class SparseLineGrid : public SparseGrid<ElemT, GridMapT>
 {
 public:
     using Elem = ElemT;
@@ -42,12 +45,22 @@ public:
      */
     void insert(const Elem &elem);
 
+    /*! \brief Inserts many elements into the sparse grid, with the same result as inserting them one by one in order.
+     *
+     * The cells covered by the elements are found in parallel, for blocks of elements,
+     * and the elements are then added to the map of the grid in one go,
+     * which for a \ref MortonGridMap is appending them to a single array.
+     *
+     * \param[in] elems The elements to be inserted.
+     */
+    void insertAll(const std::vector<Elem>& elems);
+
     void debugHTML(std::string filename);
 
     static void debugTest();
 protected:
-    using GridPoint = typename SparseGrid<ElemT>::GridPoint;
-    using grid_coord_t = typename SparseGrid<ElemT>::grid_coord_t;
+    using GridPoint = typename SparseGrid<ElemT, GridMapT>::GridPoint;
+    using grid_coord_t = typename SparseGrid<ElemT, GridMapT>::grid_coord_t;
 
     /*! \brief Accessor for getting locations from elements. */
     Locator m_locator;
@@ -55,12 +68,12 @@ protected:
 
 
 
-#define SGI_TEMPLATE template<class ElemT, class Locator>
-#define SGI_THIS SparseLineGrid<ElemT, Locator>
+#define SGI_TEMPLATE template<class ElemT, class Locator, class GridMapT>
+#define SGI_THIS SparseLineGrid<ElemT, Locator, GridMapT>
 
 SGI_TEMPLATE
 SGI_THIS::SparseLineGrid(coord_t cell_size, size_t elem_reserve, float max_load_factor)
- : SparseGrid<ElemT>(cell_size, elem_reserve, max_load_factor)
+ : SparseGrid<ElemT, GridMapT>(cell_size, elem_reserve, max_load_factor)
 {
 }
 
@@ -68,7 +81,7 @@ SGI_TEMPLATE
 void SGI_THIS::insert(const Elem &elem)
 {
     const std::pair<Point, Point> line = m_locator(elem);
-    using GridMap = std::unordered_multimap<GridPoint, Elem>;
+    using GridMap = typename SparseGrid<ElemT, GridMapT>::GridMap;
     // below is a workaround for the fact that lambda functions cannot access private or protected members
     // first we define a lambda which works on any GridMap and then we bind it to the actual protected GridMap of the parent class
     std::function<bool (GridMap*, const GridPoint)> process_cell_func_ = [&elem, this](GridMap* m_grid, const GridPoint grid_loc)
@@ -80,35 +93,70 @@ void SGI_THIS::insert(const Elem &elem)
     GridMap* m_grid = &(this->m_grid);
     std::function<bool (const GridPoint)> process_cell_func(std::bind(process_cell_func_, m_grid, _1));
 
-    SparseGrid<ElemT>::processLineCells(line, process_cell_func);
+    SparseGrid<ElemT, GridMapT>::processLineCells(line, process_cell_func);
+}
+
+SGI_TEMPLATE
+void SGI_THIS::insertAll(const std::vector<Elem>& elems)
+{
+    constexpr size_t block_size = 4096; // enough elements to outweigh the cost of a task
+    const size_t block_count = (elems.size() + block_size - 1) / block_size;
+    std::vector<std::vector<std::pair<GridPoint, Elem>>> cells_per_block(block_count);
+    ThreadPool::parallelFor(0, static_cast<int>(block_count), [&](int block_idx)
+    {
+        std::vector<std::pair<GridPoint, Elem>>& cells = cells_per_block[block_idx];
+        const size_t block_end = std::min(elems.size(), (block_idx + 1) * block_size);
+        for (size_t elem_idx = block_idx * block_size; elem_idx < block_end; elem_idx++)
+        {
+            const Elem& elem = elems[elem_idx];
+            SparseGrid<ElemT, GridMapT>::processLineCells(m_locator(elem), [&cells, &elem](const GridPoint grid_loc)
+                {
+                    cells.emplace_back(grid_loc, elem);
+                    return true;
+                });
+        }
+    });
+    size_t cell_count = 0;
+    for (const std::vector<std::pair<GridPoint, Elem>>& cells : cells_per_block)
+    {
+        cell_count += cells.size();
+    }
+    this->m_grid.reserve(this->m_grid.size() + cell_count);
+    for (const std::vector<std::pair<GridPoint, Elem>>& cells : cells_per_block)
+    {
+        for (const std::pair<GridPoint, Elem>& cell : cells)
+        {
+            this->m_grid.emplace(cell.first, cell.second);
+        }
+    }
 }
 
 SGI_TEMPLATE
 void SGI_THIS::debugHTML(std::string filename)
 {
     AABB aabb;
-    for (std::pair<GridPoint, ElemT> cell:  SparseGrid<ElemT>::m_grid)
+    for (std::pair<GridPoint, ElemT> cell:  SparseGrid<ElemT, GridMapT>::m_grid)
     {
-        aabb.include(SparseGrid<ElemT>::toLowerCorner(cell.first));
-        aabb.include(SparseGrid<ElemT>::toLowerCorner(cell.first + GridPoint(SparseGrid<ElemT>::nonzero_sign(cell.first.X), SparseGrid<ElemT>::nonzero_sign(cell.first.Y))));
+        aabb.include(SparseGrid<ElemT, GridMapT>::toLowerCorner(cell.first));
+        aabb.include(SparseGrid<ElemT, GridMapT>::toLowerCorner(cell.first + GridPoint(SparseGrid<ElemT, GridMapT>::nonzero_sign(cell.first.X), SparseGrid<ElemT, GridMapT>::nonzero_sign(cell.first.Y))));
     }
     SVG svg(filename.c_str(), aabb);
-    for (std::pair<GridPoint, ElemT> cell:  SparseGrid<ElemT>::m_grid)
+    for (std::pair<GridPoint, ElemT> cell:  SparseGrid<ElemT, GridMapT>::m_grid)
     {
         // doesn't draw cells at x = 0 or y = 0 correctly (should be double size)
-        Point lb = SparseGrid<ElemT>::toLowerCorner(cell.first);
-        Point lt = SparseGrid<ElemT>::toLowerCorner(cell.first + GridPoint(0, SparseGrid<ElemT>::nonzero_sign(cell.first.Y)));
-        Point rt = SparseGrid<ElemT>::toLowerCorner(cell.first + GridPoint(SparseGrid<ElemT>::nonzero_sign(cell.first.X), SparseGrid<ElemT>::nonzero_sign(cell.first.Y)));
-        Point rb = SparseGrid<ElemT>::toLowerCorner(cell.first + GridPoint(SparseGrid<ElemT>::nonzero_sign(cell.first.X), 0));
+        Point lb = SparseGrid<ElemT, GridMapT>::toLowerCorner(cell.first);
+        Point lt = SparseGrid<ElemT, GridMapT>::toLowerCorner(cell.first + GridPoint(0, SparseGrid<ElemT, GridMapT>::nonzero_sign(cell.first.Y)));
+        Point rt = SparseGrid<ElemT, GridMapT>::toLowerCorner(cell.first + GridPoint(SparseGrid<ElemT, GridMapT>::nonzero_sign(cell.first.X), SparseGrid<ElemT, GridMapT>::nonzero_sign(cell.first.Y)));
+        Point rb = SparseGrid<ElemT, GridMapT>::toLowerCorner(cell.first + GridPoint(SparseGrid<ElemT, GridMapT>::nonzero_sign(cell.first.X), 0));
         if (lb.X == 0)
         {
-            lb.X = -SparseGrid<ElemT>::m_cell_size;
-            lt.X = -SparseGrid<ElemT>::m_cell_size;
+            lb.X = -SparseGrid<ElemT, GridMapT>::m_cell_size;
+            lt.X = -SparseGrid<ElemT, GridMapT>::m_cell_size;
         }
         if (lb.Y == 0)
         {
-            lb.Y = -SparseGrid<ElemT>::m_cell_size;
-            rb.Y = -SparseGrid<ElemT>::m_cell_size;
+            lb.Y = -SparseGrid<ElemT, GridMapT>::m_cell_size;
+            rb.Y = -SparseGrid<ElemT, GridMapT>::m_cell_size;
         }
 //         svg.writePoint(lb, true, 1);
         svg.writeLine(lb, lt, SVG::Color::GRAY);
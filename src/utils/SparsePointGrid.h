@@ -18,9 +18,10 @@ namespace cura {
  * \tparam Locator The functor to get the location from ElemT.  Locator
  *    must have: Point operator()(const ElemT &elem) const
  *    which returns the location associated with val.
+ * \tparam GridMapT The map from grid cells to elements, see \ref SparseGrid.
  */
-template<class ElemT, class Locator>
-class SparsePointGrid : public SparseGrid<ElemT>
+template<class ElemT, class Locator, class GridMapT = std::unordered_multimap<Point, ElemT>>
+class SparsePointGrid : public SparseGrid<ElemT, GridMapT>
 {
 public:
     using Elem = ElemT;
@@ -41,7 +42,7 @@ public:
     void insert(const Elem &elem);
 
 protected:
-    using GridPoint = typename SparseGrid<ElemT>::GridPoint;
+    using GridPoint = typename SparseGrid<ElemT, GridMapT>::GridPoint;
 
     /*! \brief Accessor for getting locations from elements. */
     Locator m_locator;
@@ -49,12 +50,12 @@ protected:
 
 
 
-#define SGI_TEMPLATE template<class ElemT, class Locator>
-#define SGI_THIS SparsePointGrid<ElemT, Locator>
+#define SGI_TEMPLATE template<class ElemT, class Locator, class GridMapT>
+#define SGI_THIS SparsePointGrid<ElemT, Locator, GridMapT>
 
 SGI_TEMPLATE
 SGI_THIS::SparsePointGrid(coord_t cell_size, size_t elem_reserve, float max_load_factor)
- : SparseGrid<ElemT>(cell_size, elem_reserve, max_load_factor)
+ : SparseGrid<ElemT, GridMapT>(cell_size, elem_reserve, max_load_factor)
 {
 }
 
@@ -62,9 +63,9 @@ SGI_TEMPLATE
 void SGI_THIS::insert(const Elem &elem)
 {
     Point loc = m_locator(elem);
-    GridPoint grid_loc = SparseGrid<ElemT>::toGridPoint(loc);
+    GridPoint grid_loc = SparseGrid<ElemT, GridMapT>::toGridPoint(loc);
 
-    SparseGrid<ElemT>::m_grid.emplace(grid_loc,elem);
+    SparseGrid<ElemT, GridMapT>::m_grid.emplace(grid_loc,elem);
 }
 
 
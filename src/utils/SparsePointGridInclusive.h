@@ -46,14 +46,15 @@ struct Locatoror
 /*! \brief Sparse grid which can locate spatially nearby values efficiently.
  *
  * \tparam Val The value type to store.
+ * \tparam GridMapT The map from grid cells to elements, see \ref SparseGrid.
  */
-template<class Val>
+template<class Val, class GridMapT = std::unordered_multimap<Point, SparsePointGridInclusiveImpl::SparsePointGridInclusiveElem<Val>>>
 class SparsePointGridInclusive : public SparsePointGrid<SparsePointGridInclusiveImpl::SparsePointGridInclusiveElem<Val>,
-                                             SparsePointGridInclusiveImpl::Locatoror<Val> >
+                                             SparsePointGridInclusiveImpl::Locatoror<Val>, GridMapT>
 {
 public:
     using Base = SparsePointGrid<SparsePointGridInclusiveImpl::SparsePointGridInclusiveElem<Val>,
-                                    SparsePointGridInclusiveImpl::Locatoror<Val> >;
+                                    SparsePointGridInclusiveImpl::Locatoror<Val>, GridMapT>;
 
     /*! \brief Constructs a sparse grid with the specified cell size.
      *
@@ -86,10 +87,33 @@ public:
      */
     std::vector<Val> getNearbyVals(const Point &query_pt, coord_t radius) const;
 
+    /*! \brief Collects all values within radius of query_pt into a caller supplied buffer.
+     *
+     * The same as \ref SparsePointGridInclusive::getNearbyVals, but reusing the memory of \p result.
+     *
+     * \param[in] query_pt The point to search around.
+     * \param[in] radius The search radius.
+     * \param[out] result The values found. Its previous contents are cleared.
+     */
+    void getNearbyVals(const Point &query_pt, coord_t radius, std::vector<Val>& result) const;
+
+    /*! \brief Process all values within radius of query_pt without collecting them.
+     *
+     * See \ref SparseGrid::visitNearby().
+     *
+     * \param[in] query_pt The point to search around.
+     * \param[in] radius The search radius.
+     * \param[in] visitor Processes each value.  visitor(val) is called for
+     *    each value found. Processing stops if it returns false.
+     * \return Whether all values were processed, i.e. the visitor never returned false.
+     */
+    template<class Visitor>
+    bool visitNearbyVals(const Point &query_pt, coord_t radius, Visitor&& visitor) const;
+
 };
 
-#define SG_TEMPLATE template<class Val>
-#define SG_THIS SparsePointGridInclusive<Val>
+#define SG_TEMPLATE template<class Val, class GridMapT>
+#define SG_THIS SparsePointGridInclusive<Val, GridMapT>
 
 SG_TEMPLATE
 SG_THIS::SparsePointGridInclusive(coord_t cell_size, size_t elem_reserve, float max_load_factor) :
@@ -109,13 +133,29 @@ std::vector<Val>
 SG_THIS::getNearbyVals(const Point &query_pt, coord_t radius) const
 {
     std::vector<Val> ret;
-    std::function<bool (const SparsePointGridInclusiveImpl::SparsePointGridInclusiveElem<Val>&)> process_func = [&ret](const typename SG_THIS::Elem &elem)
+    getNearbyVals(query_pt, radius, ret);
+    return ret;
+}
+
+SG_TEMPLATE
+void SG_THIS::getNearbyVals(const Point &query_pt, coord_t radius, std::vector<Val>& result) const
+{
+    result.clear();
+    visitNearbyVals(query_pt, radius, [&result](const Val &val)
         {
-            ret.push_back(elem.val);
+            result.push_back(val);
             return true;
-        };
-    this->processNearby(query_pt, radius, process_func);
-    return ret;
+        });
+}
+
+SG_TEMPLATE
+template<class Visitor>
+bool SG_THIS::visitNearbyVals(const Point &query_pt, coord_t radius, Visitor&& visitor) const
+{
+    return this->visitNearby(query_pt, radius, [&visitor](const typename SG_THIS::Elem &elem)
+        {
+            return visitor(elem.val);
+        });
 }
 
 
@@ -0,0 +1,116 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "SpillFile.h"
+
+#include <cstring> // memcpy
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <sys/mman.h> // mmap
+#include <unistd.h> // sysconf
+#endif
+
+#include "logoutput.h"
+
+namespace cura
+{
+
+SpillFile::SpillFile()
+: file(tmpfile())
+, file_size(0)
+, mapped(nullptr)
+{
+    if (!file)
+    {
+        logWarning("Failed to create a temporary file to move layers to, so they are kept in memory.\n");
+    }
+}
+
+SpillFile::~SpillFile()
+{
+    close();
+}
+
+void SpillFile::close()
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    if (mapped)
+    {
+        munmap(const_cast<uint8_t*>(mapped), file_size);
+    }
+#endif
+    mapped = nullptr;
+    if (file)
+    {
+        fclose(file); // the temporary file is removed when it is closed
+    }
+    file = nullptr;
+}
+
+bool SpillFile::write(const std::vector<uint8_t>& data, uint64_t& offset)
+{
+    if (!file)
+    {
+        return false;
+    }
+    if (!data.empty() && fwrite(data.data(), 1, data.size(), file) != data.size())
+    { // continue after the data written before, which can still be read
+        fseek(file, file_size, SEEK_SET);
+        return false;
+    }
+    offset = file_size;
+    file_size += data.size();
+    return true;
+}
+
+void SpillFile::finishWriting()
+{
+    if (!file || fflush(file) != 0)
+    {
+        return;
+    }
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    if (file_size > 0)
+    {
+        void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (mapping != MAP_FAILED)
+        {
+            mapped = static_cast<const uint8_t*>(mapping);
+        }
+    }
+#endif
+}
+
+bool SpillFile::read(uint64_t offset, uint64_t size, std::vector<uint8_t>& data) const
+{
+    if (!file || offset + size > file_size)
+    {
+        return false;
+    }
+    data.resize(size);
+    if (size == 0)
+    {
+        return true;
+    }
+    if (mapped)
+    {
+        memcpy(data.data(), mapped + offset, size);
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(read_mutex);
+    return fseek(file, offset, SEEK_SET) == 0 && fread(data.data(), 1, size, file) == size;
+}
+
+void SpillFile::prefetch(uint64_t offset, uint64_t size) const
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    if (!mapped || size == 0 || offset + size > file_size)
+    {
+        return;
+    }
+    static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t page_start = offset - offset % page_size;
+    posix_madvise(const_cast<uint8_t*>(mapped) + page_start, offset + size - page_start, POSIX_MADV_WILLNEED);
+#endif
+}
+
+}//namespace cura
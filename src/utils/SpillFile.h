@@ -0,0 +1,96 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_SPILL_FILE_H
+#define UTILS_SPILL_FILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * A temporary file to move data which doesn't fit in memory to, and read it back from.
+ *
+ * All data is written first, after which SpillFile::finishWriting maps the file into memory where that's supported,
+ * so that reading it back is copying from the page cache and the operating system decides what stays in memory.
+ * Where the file can't be mapped, the data is read back with a read per request.
+ *
+ * The file is removed when it is closed, at the latest when the SpillFile is destroyed.
+ */
+class SpillFile : NoCopy
+{
+public:
+    SpillFile();
+
+    ~SpillFile();
+
+    /*!
+     * Whether the temporary file could be created.
+     */
+    bool isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    /*!
+     * Append data to the file. Must be called before SpillFile::finishWriting.
+     *
+     * \param data The data to write
+     * \param[out] offset The position in the file of the data, to read it back with
+     * \return Whether the data has been written, which is false if the disk is full. The data written before can still be read.
+     */
+    bool write(const std::vector<uint8_t>& data, uint64_t& offset);
+
+    /*!
+     * Stop writing and prepare for reading.
+     */
+    void finishWriting();
+
+    /*!
+     * Read data back. Must be called after SpillFile::finishWriting. This function is thread safe.
+     *
+     * \param offset The position of the data, as given by SpillFile::write
+     * \param size The number of bytes to read
+     * \param[out] data The data read, replacing its previous contents
+     * \return Whether the data could be read
+     */
+    bool read(uint64_t offset, uint64_t size, std::vector<uint8_t>& data) const;
+
+    /*!
+     * Tell the operating system that data will be read soon, so that it's read from disk in the background.
+     * Does nothing where the file isn't mapped into memory.
+     *
+     * \param offset The position of the data, as given by SpillFile::write
+     * \param size The number of bytes which will be read
+     */
+    void prefetch(uint64_t offset, uint64_t size) const;
+
+    /*!
+     * The number of bytes written to the file.
+     */
+    uint64_t size() const
+    {
+        return file_size;
+    }
+
+private:
+    FILE* file; //!< The temporary file, or nullptr if it couldn't be created or written
+    uint64_t file_size; //!< The number of bytes written to the file
+    const uint8_t* mapped; //!< The contents of the file mapped into memory, or nullptr if it isn't mapped
+    mutable std::mutex read_mutex; //!< Guards the position in the file while reading without a mapping
+
+    /*!
+     * Unmap and close the file.
+     */
+    void close();
+};
+
+}//namespace cura
+
+#endif//UTILS_SPILL_FILE_H
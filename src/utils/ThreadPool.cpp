@@ -0,0 +1,384 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstdlib> // getenv
+#include <fstream>
+#include <sstream>
+#ifdef __linux__
+    #include <pthread.h> // pthread_setaffinity_np
+    #include <sched.h> // cpu_set_t
+#endif // __linux__
+
+#include "logoutput.h"
+
+namespace cura
+{
+
+std::mutex ThreadPool::instance_mutex;
+ThreadPool* ThreadPool::instance = nullptr;
+unsigned int ThreadPool::configured_thread_count = 0;
+bool ThreadPool::numa_affinity = false;
+std::atomic<bool> ThreadPool::cancelled(false);
+
+namespace
+{
+constexpr unsigned int external_queue = static_cast<unsigned int>(-1); //!< The queue index of the threads which aren't in the pool
+thread_local unsigned int current_queue_idx = external_queue; //!< The index of the queue of the current thread in ThreadPool::queues
+thread_local unsigned int current_thread_limit = 0; //!< The limit on the threads of the current thread, or 0 if there is none
+thread_local unsigned int current_node_idx = 0; //!< The NUMA node to which the current thread is pinned
+}
+
+ThreadPool::TaskGroup::TaskGroup()
+: pending_count(0)
+{
+}
+
+ThreadPool::TaskGroup::~TaskGroup()
+{
+    waitForTasks(); // not rethrowing, since the group may be destroyed because an exception is being thrown already
+}
+
+void ThreadPool::TaskGroup::run(std::function<void ()> task, Priority priority)
+{
+    pending_count++;
+    getInstance().push(Task{std::move(task), this, current_thread_limit}, priority);
+}
+
+void ThreadPool::TaskGroup::wait()
+{
+    waitForTasks();
+    std::exception_ptr task_exception;
+    {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        task_exception.swap(exception);
+    }
+    if (task_exception)
+    {
+        std::rethrow_exception(task_exception);
+    }
+}
+
+void ThreadPool::TaskGroup::waitForTasks()
+{
+    if (pending_count == 0)
+    {
+        std::lock_guard<std::mutex> lock(finished_mutex); // the last task may still be notifying
+        return;
+    }
+    ThreadPool& pool = getInstance();
+    while (true)
+    {
+        Task task;
+        if (pool.take(task, this))
+        {
+            execute(task);
+            continue;
+        }
+        // all tasks are being executed by other threads, unless they add more tasks to this group, which is checked again after a while
+        std::unique_lock<std::mutex> lock(finished_mutex);
+        if (finished.wait_for(lock, std::chrono::milliseconds(1), [this]() { return pending_count == 0; }))
+        {
+            return;
+        }
+    }
+}
+
+ThreadPool::ThreadLimit::ThreadLimit(unsigned int thread_count)
+: previous_limit(current_thread_limit)
+{
+    if (thread_count == 0)
+    {
+        return;
+    }
+    current_thread_limit = std::max(1u, (previous_limit > 0)? std::min(previous_limit, thread_count) : thread_count);
+}
+
+ThreadPool::ThreadLimit::~ThreadLimit()
+{
+    current_thread_limit = previous_limit;
+}
+
+void ThreadPool::setThreadCount(unsigned int thread_count)
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    configured_thread_count = std::max(1u, thread_count);
+    if (instance && instance->thread_count != configured_thread_count)
+    {
+        delete instance;
+        instance = nullptr;
+    }
+}
+
+unsigned int ThreadPool::getThreadCount()
+{
+    unsigned int thread_count;
+    {
+        std::lock_guard<std::mutex> lock(instance_mutex);
+        thread_count = instance ? instance->thread_count : (configured_thread_count > 0) ? configured_thread_count : getDefaultThreadCount();
+    }
+    return (current_thread_limit > 0)? std::min(thread_count, current_thread_limit) : thread_count;
+}
+
+void ThreadPool::setNumaAffinity(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    if (instance && numa_affinity != enabled)
+    {
+        delete instance;
+        instance = nullptr;
+    }
+    numa_affinity = enabled;
+}
+
+void ThreadPool::cancel()
+{
+    cancelled = true;
+}
+
+void ThreadPool::resetCancellation()
+{
+    cancelled = false;
+}
+
+unsigned int ThreadPool::getNodeCount()
+{
+    return getInstance().node_count;
+}
+
+unsigned int ThreadPool::getCurrentNode()
+{
+    return current_node_idx;
+}
+
+unsigned int ThreadPool::getDefaultThreadCount()
+{
+    const char* environment_thread_count = getenv("OMP_NUM_THREADS"); // still honoured, as it used to set the number of threads
+    if (environment_thread_count && atoi(environment_thread_count) > 0)
+    {
+        return atoi(environment_thread_count);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<std::vector<unsigned int>> ThreadPool::getNodeCores()
+{
+    std::vector<std::vector<unsigned int>> node_cores;
+#ifdef __linux__
+    for (unsigned int node_idx = 0; ; node_idx++)
+    {
+        std::ifstream cpu_list("/sys/devices/system/node/node" + std::to_string(node_idx) + "/cpulist");
+        if (!cpu_list)
+        {
+            break;
+        }
+        // the list is formatted like 0-3,8-11
+        std::vector<unsigned int> cores;
+        std::string range;
+        while (std::getline(cpu_list, range, ','))
+        {
+            std::istringstream range_stream(range);
+            unsigned int first;
+            if (!(range_stream >> first))
+            {
+                continue;
+            }
+            unsigned int last = first;
+            if (range_stream.get() == '-')
+            {
+                range_stream >> last;
+            }
+            for (unsigned int core = first; core <= last; core++)
+            {
+                cores.push_back(core);
+            }
+        }
+        if (!cores.empty())
+        {
+            node_cores.push_back(cores);
+        }
+    }
+#endif // __linux__
+    return node_cores;
+}
+
+ThreadPool& ThreadPool::getInstance()
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    if (!instance)
+    {
+        instance = new ThreadPool((configured_thread_count > 0) ? configured_thread_count : getDefaultThreadCount(), numa_affinity);
+    }
+    return *instance;
+}
+
+ThreadPool::ThreadPool(unsigned int thread_count, bool numa_affinity)
+: thread_count(thread_count)
+, node_count(1)
+, queued_count(0)
+, stopping(false)
+{
+    std::vector<std::vector<unsigned int>> node_cores;
+    if (numa_affinity)
+    {
+        node_cores = getNodeCores();
+        if (node_cores.size() > 1)
+        {
+            node_count = std::min(static_cast<unsigned int>(node_cores.size()), thread_count);
+            log("Spreading %u threads over %u NUMA nodes.\n", thread_count, node_count);
+        }
+    }
+    for (unsigned int queue_idx = 0; queue_idx < thread_count; queue_idx++)
+    { // one queue per thread of the pool and one for the other threads
+        queues.emplace_back(new Queue());
+    }
+    for (unsigned int thread_idx = 0; thread_idx + 1 < thread_count; thread_idx++)
+    {
+        // the thread waiting for the tasks counts as the first thread of the first node
+        const unsigned int node_idx = (thread_idx + 1) * node_count / thread_count;
+        threads.emplace_back(&ThreadPool::work, this, thread_idx, node_idx);
+#ifdef __linux__
+        if (node_count > 1)
+        {
+            cpu_set_t cores;
+            CPU_ZERO(&cores);
+            for (unsigned int core : node_cores[node_idx])
+            {
+                CPU_SET(core, &cores);
+            }
+            if (pthread_setaffinity_np(threads.back().native_handle(), sizeof(cores), &cores) != 0)
+            {
+                logWarning("Failed to pin a thread to NUMA node %u.\n", node_idx);
+            }
+        }
+#endif // __linux__
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    task_added.notify_all();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::push(Task&& task, Priority priority)
+{
+    Queue& queue = *queues[std::min(current_queue_idx, static_cast<unsigned int>(queues.size() - 1))];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks[static_cast<int>(priority)].push_back(std::move(task));
+    }
+    queued_count++;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex); // a thread about to sleep either sees the task or gets notified
+    }
+    task_added.notify_one();
+}
+
+bool ThreadPool::take(Task& task, const TaskGroup* group)
+{
+    if (queued_count == 0)
+    {
+        return false;
+    }
+    const unsigned int own_queue_idx = std::min(current_queue_idx, static_cast<unsigned int>(queues.size() - 1));
+    for (unsigned int priority_idx = 0; priority_idx < 2; priority_idx++)
+    {
+        for (unsigned int offset = 0; offset < queues.size(); offset++)
+        {
+            const unsigned int queue_idx = (own_queue_idx + offset) % queues.size();
+            Queue& queue = *queues[queue_idx];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            std::deque<Task>& tasks = queue.tasks[priority_idx];
+            if (tasks.empty())
+            {
+                continue;
+            }
+            if (offset == 0)
+            { // the own queue is handled last in first out, which keeps the memory the last task used warm
+                for (std::deque<Task>::reverse_iterator it = tasks.rbegin(); it != tasks.rend(); ++it)
+                {
+                    if (!group || it->group == group)
+                    {
+                        task = std::move(*it);
+                        tasks.erase(std::next(it).base());
+                        queued_count--;
+                        return true;
+                    }
+                }
+            }
+            else
+            { // steal the oldest task, which is likely to be the largest piece of work left
+                for (std::deque<Task>::iterator it = tasks.begin(); it != tasks.end(); ++it)
+                {
+                    if (!group || it->group == group)
+                    {
+                        task = std::move(*it);
+                        tasks.erase(it);
+                        queued_count--;
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(Task& task)
+{
+    const unsigned int previous_limit = current_thread_limit;
+    current_thread_limit = task.thread_limit;
+    std::exception_ptr task_exception;
+    try
+    {
+        task.function();
+    }
+    catch (...)
+    { // the group still has to know that the task has finished, so the exception is rethrown by the thread waiting for the group
+        task_exception = std::current_exception();
+    }
+    current_thread_limit = previous_limit;
+    TaskGroup& group = *task.group;
+    std::lock_guard<std::mutex> lock(group.finished_mutex); // so that the group isn't destroyed before it has been notified
+    if (task_exception && !group.exception)
+    {
+        group.exception = task_exception;
+    }
+    if (--group.pending_count == 0)
+    {
+        group.finished.notify_all();
+    }
+}
+
+void ThreadPool::work(unsigned int queue_idx, unsigned int node_idx)
+{
+    current_queue_idx = queue_idx;
+    current_node_idx = node_idx;
+    while (true)
+    {
+        Task task;
+        if (take(task, nullptr))
+        {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        task_added.wait(lock, [this]() { return stopping || queued_count > 0; });
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+}//namespace cura
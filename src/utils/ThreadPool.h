@@ -0,0 +1,322 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef UTILS_THREAD_POOL_H
+#define UTILS_THREAD_POOL_H
+
+#include <algorithm> // min
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception> // exception_ptr
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NoCopy.h"
+
+namespace cura
+{
+
+/*!
+ * The threads which run the parallel parts of the engine, shared by all stages.
+ *
+ * Work is given to the pool as tasks in a ThreadPool::TaskGroup, which waits for its tasks to finish.
+ * Each thread has its own queue of tasks. A thread executes the tasks it added itself last in first out,
+ * and when its queue is empty it steals the oldest task of another thread.
+ * Tasks may add tasks themselves, so parallel loops can be nested without starting more threads than the pool has:
+ * a thread waiting for a group executes the tasks of that group meanwhile instead of idling.
+ * It only executes tasks of the group it waits for, so that waiting never ends up depending on the task it interrupted.
+ *
+ * The number of threads is set once with ThreadPool::setThreadCount, by default the OMP_NUM_THREADS environment variable or the number of cores.
+ * The thread calling ThreadPool::TaskGroup::wait counts as one of those threads,
+ * so the pool itself starts one thread less.
+ * A job can be limited to fewer threads with a ThreadPool::ThreadLimit, which also holds for the tasks it adds.
+ *
+ * The threads are started when the pool is first used, so that a process which hasn't used it yet can be forked.
+ *
+ * On machines with several NUMA nodes the threads can be pinned to the cores of the nodes with ThreadPool::setNumaAffinity.
+ * Parallel loops then give each node its own contiguous block of indices, so that the threads of a node mostly work on
+ * neighbouring layers and the memory those layers allocate stays local to that node.
+ */
+class ThreadPool : NoCopy
+{
+public:
+    /*!
+     * The order in which tasks are picked up: all tasks of high priority are executed before any task of normal priority.
+     */
+    enum class Priority
+    {
+        HIGH = 0,
+        NORMAL = 1
+    };
+
+    /*!
+     * Tasks which are waited for together.
+     *
+     * The group waits for its tasks when it is destroyed, so tasks can refer to the variables of the scope of the group.
+     */
+    class TaskGroup : NoCopy
+    {
+        friend class ThreadPool;
+    public:
+        TaskGroup();
+
+        ~TaskGroup();
+
+        /*!
+         * Add a task to be executed by a thread of the pool.
+         *
+         * \param task The function to execute
+         * \param priority Whether to execute it before the tasks of normal priority
+         */
+        void run(std::function<void ()> task, Priority priority = Priority::NORMAL);
+
+        /*!
+         * Wait until all tasks added have finished, executing them in the meanwhile.
+         *
+         * If a task has thrown an exception, the first one is rethrown once all tasks have finished.
+         */
+        void wait();
+
+    private:
+        std::atomic<unsigned int> pending_count; //!< The number of tasks added which haven't finished yet
+        std::mutex finished_mutex; //!< Guards the wait for ThreadPool::TaskGroup::finished and the ThreadPool::TaskGroup::exception
+        std::condition_variable finished; //!< Notified when the last pending task has finished
+        std::exception_ptr exception; //!< The first exception thrown by a task, until it's rethrown by ThreadPool::TaskGroup::wait
+
+        /*!
+         * Wait until all tasks added have finished, executing them in the meanwhile, without rethrowing their exceptions.
+         */
+        void waitForTasks();
+    };
+
+    /*!
+     * Limits the number of threads used by the current thread and the tasks it adds, for as long as it is in scope.
+     *
+     * This way concurrent jobs can each get their share of the threads.
+     */
+    class ThreadLimit : NoCopy
+    {
+    public:
+        /*!
+         * \param thread_count The maximum number of threads, which can't exceed the limit in which it is nested, or 0 to keep that limit
+         */
+        ThreadLimit(unsigned int thread_count);
+
+        ~ThreadLimit();
+
+    private:
+        unsigned int previous_limit; //!< The limit restored when this one goes out of scope
+    };
+
+    /*!
+     * Set the number of threads of the pool, including the thread waiting for the tasks.
+     *
+     * If the pool has started already, its threads are stopped and started again, so no tasks may be running.
+     *
+     * \param thread_count The number of threads, at least 1
+     */
+    static void setThreadCount(unsigned int thread_count);
+
+    /*!
+     * The number of threads which can be used by the current thread: that of the pool, or less if a ThreadPool::ThreadLimit applies.
+     */
+    static unsigned int getThreadCount();
+
+    /*!
+     * Set whether to pin the threads of the pool to the NUMA nodes of the machine, spreading them evenly over the nodes.
+     *
+     * This has no effect on machines with a single node or on systems other than Linux.
+     * If the pool has started already, its threads are stopped and started again, so no tasks may be running.
+     *
+     * \param enabled Whether to pin the threads
+     */
+    static void setNumaAffinity(bool enabled);
+
+    /*!
+     * The number of NUMA nodes over which the threads of the pool are spread: 1 unless the threads are pinned to several nodes.
+     */
+    static unsigned int getNodeCount();
+
+    /*!
+     * The NUMA node of the current thread, counting the threads which aren't in the pool as part of the first node.
+     */
+    static unsigned int getCurrentNode();
+
+    /*!
+     * Let all parallel loops skip their remaining indices, because their results aren't needed any more.
+     *
+     * This holds for the loops running and for those started afterwards, until ThreadPool::resetCancellation is called.
+     * A loop checks before each index, so it stops as soon as each of its threads has finished its current index.
+     * The results of loops which have been cancelled are incomplete, so they have to be discarded.
+     */
+    static void cancel();
+
+    /*!
+     * Whether the parallel loops have been cancelled with ThreadPool::cancel.
+     */
+    static bool isCancelled()
+    {
+        return cancelled.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * Let the parallel loops execute all their indices again, after they have been cancelled with ThreadPool::cancel.
+     */
+    static void resetCancellation();
+
+    /*!
+     * Execute \p body for each index from \p begin to \p end using the threads of the pool.
+     *
+     * The indices are handed out one by one to the threads as they finish the previous one,
+     * so that layers which take longer than others don't leave the other threads idle.
+     * If the threads are spread over several NUMA nodes the range is split into a block per node,
+     * and the threads of a node only help with the blocks of other nodes once their own block is done.
+     * Once the loops are cancelled with ThreadPool::cancel, the indices which haven't been handed out yet are skipped.
+     *
+     * \param begin The first index
+     * \param end The index after the last one
+     * \param body The function to call with each index
+     * \param max_thread_count The maximum number of threads to use, or 0 to use all threads available
+     */
+    template<typename Function>
+    static void parallelFor(int begin, int end, const Function& body, unsigned int max_thread_count = 0)
+    {
+        if (end <= begin)
+        {
+            return;
+        }
+        unsigned int thread_count = std::min(getThreadCount(), static_cast<unsigned int>(end - begin));
+        if (max_thread_count > 0)
+        {
+            thread_count = std::min(thread_count, max_thread_count);
+        }
+        if (thread_count <= 1)
+        {
+            for (int index = begin; index < end && !isCancelled(); index++)
+            {
+                body(index);
+            }
+            return;
+        }
+        const int node_count = std::min(static_cast<int>(getNodeCount()), end - begin);
+        std::unique_ptr<std::atomic<int>[]> next_index(new std::atomic<int>[node_count]); // the next index of the block of each node
+        for (int node_idx = 0; node_idx < node_count; node_idx++)
+        {
+            next_index[node_idx] = begin + static_cast<long long>(end - begin) * node_idx / node_count;
+        }
+        const std::function<void ()> execute_indices = [&next_index, node_count, begin, end, &body]()
+            {
+                const int own_node_idx = getCurrentNode() % node_count;
+                for (int node_offset = 0; node_offset < node_count; node_offset++)
+                { // start with the block of the own node, then help with the blocks of the other nodes
+                    const int node_idx = (own_node_idx + node_offset) % node_count;
+                    const int block_end = begin + static_cast<long long>(end - begin) * (node_idx + 1) / node_count;
+                    for (int index = next_index[node_idx]++; index < block_end && !isCancelled(); index = next_index[node_idx]++)
+                    {
+                        body(index);
+                    }
+                }
+            };
+        TaskGroup group;
+        for (unsigned int task_idx = 1; task_idx < thread_count; task_idx++)
+        {
+            group.run(execute_indices);
+        }
+        execute_indices();
+        group.wait();
+    }
+
+private:
+    /*!
+     * A task added to the pool
+     */
+    struct Task
+    {
+        std::function<void ()> function; //!< The function to execute
+        TaskGroup* group; //!< The group which waits for the task
+        unsigned int thread_limit; //!< The limit on the threads of the thread which added the task, which holds for the task as well
+    };
+
+    /*!
+     * The tasks added by a single thread, by priority
+     */
+    struct Queue
+    {
+        std::mutex mutex; //!< Guards the tasks
+        std::deque<Task> tasks[2]; //!< The tasks of high priority and of normal priority, the last added at the back
+    };
+
+    static std::mutex instance_mutex; //!< Guards ThreadPool::instance and ThreadPool::configured_thread_count
+    static ThreadPool* instance; //!< The pool, once it has been used. It isn't destroyed at exit, since exit may be called by one of its threads.
+    static unsigned int configured_thread_count; //!< The thread count set with ThreadPool::setThreadCount, or 0 if not set
+    static bool numa_affinity; //!< Whether the threads are to be pinned to the NUMA nodes, guarded by ThreadPool::instance_mutex
+    static std::atomic<bool> cancelled; //!< Whether the parallel loops are to skip their remaining indices, see ThreadPool::cancel
+
+    const unsigned int thread_count; //!< The number of threads, including the thread waiting for the tasks
+    unsigned int node_count; //!< The number of NUMA nodes over which the threads are spread
+    std::vector<std::unique_ptr<Queue>> queues; //!< The queue of each thread of the pool, and a last one for the tasks added by other threads
+    std::vector<std::thread> threads; //!< The threads of the pool
+    std::atomic<unsigned int> queued_count; //!< The number of tasks in all queues together
+    std::mutex sleep_mutex; //!< Guards the threads going to sleep when there are no tasks
+    std::condition_variable task_added; //!< Notified when a task is added
+    bool stopping; //!< Whether the threads are to stop, guarded by ThreadPool::sleep_mutex
+
+    /*!
+     * \param thread_count The number of threads, including the thread waiting for the tasks
+     * \param numa_affinity Whether to pin the threads to the NUMA nodes
+     */
+    ThreadPool(unsigned int thread_count, bool numa_affinity);
+
+    ~ThreadPool();
+
+    /*!
+     * Get the pool, starting its threads if this is the first time it's used.
+     */
+    static ThreadPool& getInstance();
+
+    /*!
+     * The number of threads to use if none is set with ThreadPool::setThreadCount.
+     */
+    static unsigned int getDefaultThreadCount();
+
+    /*!
+     * Get the cores of each NUMA node of the machine, or nothing if they are unknown.
+     */
+    static std::vector<std::vector<unsigned int>> getNodeCores();
+
+    /*!
+     * Add a task to the queue of the current thread.
+     */
+    void push(Task&& task, Priority priority);
+
+    /*!
+     * Take a task from the queues: the last one added by this thread, or else the oldest one of another thread.
+     *
+     * \param[out] task The task taken
+     * \param group Only take a task of this group, or any task if nullptr
+     * \return Whether a task has been found
+     */
+    bool take(Task& task, const TaskGroup* group);
+
+    /*!
+     * Execute a task and let its group know that it has finished,
+     * passing an exception thrown by the task on to the group.
+     */
+    static void execute(Task& task);
+
+    /*!
+     * The loop of each thread of the pool: execute tasks and sleep while there are none.
+     *
+     * \param queue_idx The index of the queue of the thread
+     * \param node_idx The NUMA node of the thread
+     */
+    void work(unsigned int queue_idx, unsigned int node_idx);
+};
+
+}//namespace cura
+
+#endif//UTILS_THREAD_POOL_H
@@ -19,6 +19,8 @@ Integer points are used to avoid floating point rounding errors, and because Cli
 
 #include <iostream> // auto-serialization / auto-toString()
 
+#include "InstructionSet.h"
+
 #define INT2MM(n) (double(n) / 1000.0)
 #define INT2MM2(n) (double(n) / 1000000.0)
 #define MM2INT(n) (int64_t(std::round((n) * 1000)))
@@ -283,6 +285,33 @@ public:
     {
         return Point(p.X * matrix[0] + p.Y * matrix[2], p.X * matrix[1] + p.Y * matrix[3]);
     }
+
+    /*!
+     * Apply the matrix to a range of points, with the same outcome as \ref PointMatrix::apply on each of them.
+     *
+     * Uses the widest vectors of the machine, see \ref InstructionSet.
+     *
+     * \param points The first of the points
+     * \param[out] result Where to store the first of the transformed points; may be \p points itself
+     * \param count The number of points
+     */
+    void apply(const Point* points, Point* result, size_t count) const
+    {
+        VectorKernels::transform(matrix, points, result, count);
+    }
+
+    /*!
+     * Apply the inverse of the matrix to a range of points, with the same outcome as \ref PointMatrix::unapply on each of them.
+     *
+     * \param points The first of the points
+     * \param[out] result Where to store the first of the transformed points; may be \p points itself
+     * \param count The number of points
+     */
+    void unapply(const Point* points, Point* result, size_t count) const
+    {
+        const double transposed[4] = { matrix[0], matrix[2], matrix[1], matrix[3] };
+        VectorKernels::transform(transposed, points, result, count);
+    }
 };
 
 class Point3Matrix
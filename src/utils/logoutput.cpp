@@ -1,10 +1,19 @@
 /** Copyright (C) 2013 David Braam - Released under terms of the AGPLv3 License */
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h> // atexit
+
+#include <atomic>
+#include <cstdint> // uintptr_t
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    #include <pthread.h> // pthread_atfork
+#endif
 
-#ifdef _OPENMP
-    #include <omp.h>
-#endif // _OPENMP
 #include "logoutput.h"
 
 namespace cura {
@@ -12,6 +21,211 @@ namespace cura {
 static int verbose_level;
 static bool progressLogging;
 
+namespace
+{
+
+/*!
+ * A formatted message waiting to be written.
+ */
+struct LogMessage
+{
+    LogMessage* next; //!< The message added before this one
+    std::string text; //!< The text to write
+};
+
+/*!
+ * The thread writing the messages to stderr, so that the threads logging them don't wait for the output.
+ */
+struct LogWriter
+{
+    std::mutex mutex; //!< Guards the waiting for new messages and for written messages
+    std::condition_variable message_added; //!< Notified when a message is added
+    std::condition_variable messages_written; //!< Notified when messages have been written
+    std::atomic<unsigned long long> written_count; //!< The number of messages written so far
+};
+
+constexpr unsigned int max_repeat_count = 100; //!< The number of times a warning with the same format is shown before the next ones are suppressed
+constexpr unsigned int repeat_table_size = 256; //!< The number of formats of which the occurrences are counted
+
+std::atomic<LogMessage*> pending_messages(nullptr); //!< The messages not written yet, the last added first
+std::atomic<unsigned long long> added_count(0); //!< The number of messages added so far
+std::atomic<LogWriter*> writer(nullptr); //!< The writer of the current process, started with the first message
+std::atomic<const char*> repeat_formats[repeat_table_size]; //!< The formats of the warnings counted in \ref repeat_counts
+std::atomic<unsigned int> repeat_counts[repeat_table_size]; //!< The number of warnings with each format of \ref repeat_formats
+
+/*!
+ * Write all pending messages in the order in which they were added.
+ *
+ * \return The number of messages written
+ */
+unsigned int writePendingMessages()
+{
+    LogMessage* message = pending_messages.exchange(nullptr);
+    LogMessage* oldest = nullptr;
+    while (message)
+    { // reverse the list, which has the last added message first
+        LogMessage* next = message->next;
+        message->next = oldest;
+        oldest = message;
+        message = next;
+    }
+    unsigned int written_count = 0;
+    while (oldest)
+    {
+        fwrite(oldest->text.data(), 1, oldest->text.size(), stderr);
+        LogMessage* next = oldest->next;
+        delete oldest;
+        oldest = next;
+        written_count++;
+    }
+    if (written_count > 0)
+    {
+        fflush(stderr);
+    }
+    return written_count;
+}
+
+void writeMessages(LogWriter* log_writer)
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(log_writer->mutex);
+            // adding a message doesn't take the lock, so a notification can be missed and the messages are checked again after a while
+            log_writer->message_added.wait_for(lock, std::chrono::milliseconds(20), []() { return pending_messages.load() != nullptr; });
+        }
+        const unsigned int written_count = writePendingMessages();
+        if (written_count > 0)
+        {
+            std::lock_guard<std::mutex> lock(log_writer->mutex);
+            log_writer->written_count += written_count;
+            log_writer->messages_written.notify_all();
+        }
+    }
+}
+
+void forgetWriterAfterFork()
+{ // the thread of the writer doesn't exist in the child process, and its mutex may be locked forever
+    writer = nullptr;
+    // the messages added while forking are written by the parent, and the writer of the child counts its messages from zero
+    LogMessage* message = pending_messages.exchange(nullptr);
+    while (message)
+    {
+        LogMessage* next = message->next;
+        delete message;
+        message = next;
+    }
+    added_count = 0;
+}
+
+/*!
+ * Get the writer, starting it if this process hasn't logged anything yet.
+ */
+LogWriter* getWriter()
+{
+    LogWriter* log_writer = writer.load();
+    if (log_writer)
+    {
+        return log_writer;
+    }
+    LogWriter* new_writer = new LogWriter();
+    new_writer->written_count = 0;
+    if (!writer.compare_exchange_strong(log_writer, new_writer))
+    { // another thread has started it just now
+        delete new_writer;
+        return log_writer;
+    }
+    static std::once_flag exit_handlers_registered;
+    std::call_once(exit_handlers_registered, []()
+        {
+            atexit(flushLog);
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+            pthread_atfork(flushLog, nullptr, forgetWriterAfterFork);
+#endif
+        });
+    std::thread(writeMessages, new_writer).detach(); // it's never stopped, so that messages logged while exiting are written as well
+    return new_writer;
+}
+
+/*!
+ * Format a message into a buffer of the current thread and add it to the messages to be written, without waiting for other threads.
+ */
+void addMessage(const char* prefix, const char* fmt, va_list args)
+{
+    thread_local char buffer[1024];
+    va_list args_copy;
+    va_copy(args_copy, args);
+    const int length = vsnprintf(buffer, sizeof(buffer), fmt, args_copy);
+    va_end(args_copy);
+    LogMessage* message = new LogMessage();
+    message->text = prefix;
+    if (length < 0)
+    {
+        message->text += fmt;
+    }
+    else if (static_cast<unsigned int>(length) < sizeof(buffer))
+    {
+        message->text.append(buffer, length);
+    }
+    else
+    { // too long for the buffer of the thread
+        std::string long_text(length + 1, '\0');
+        vsnprintf(&long_text[0], long_text.size(), fmt, args);
+        long_text.resize(length);
+        message->text += long_text;
+    }
+
+    LogWriter* log_writer = getWriter();
+    message->next = pending_messages.load();
+    while (!pending_messages.compare_exchange_weak(message->next, message))
+    {
+    }
+    added_count++;
+    log_writer->message_added.notify_one();
+}
+
+void addMessageWithArguments(const char* prefix, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    addMessage(prefix, fmt, args);
+    va_end(args);
+}
+
+/*!
+ * Count a warning with the format \p fmt and check whether it has been repeated too often to be shown.
+ *
+ * Messages from a broken mesh can be repeated for thousands of triangles,
+ * so only the first \ref max_repeat_count of the warnings with the same format are shown.
+ *
+ * \return Whether to suppress the message
+ */
+bool isRepeatedTooOften(const char* fmt)
+{
+    const unsigned int start_idx = (reinterpret_cast<uintptr_t>(fmt) >> 3) % repeat_table_size;
+    for (unsigned int offset = 0; offset < repeat_table_size; offset++)
+    {
+        const unsigned int idx = (start_idx + offset) % repeat_table_size;
+        const char* format = repeat_formats[idx].load();
+        if (!format && repeat_formats[idx].compare_exchange_strong(format, fmt))
+        {
+            format = fmt;
+        }
+        if (format == fmt)
+        {
+            const unsigned int count = ++repeat_counts[idx];
+            if (count == max_repeat_count + 1)
+            {
+                addMessageWithArguments("[WARNING] ", "The message above has been repeated %u times, further ones are not shown.\n", max_repeat_count);
+            }
+            return count > max_repeat_count;
+        }
+    }
+    return false; // too many different messages to keep track of
+}
+
+} // namespace
+
 void increaseVerboseLevel()
 {
     verbose_level++;
@@ -22,42 +236,46 @@ void enableProgressLogging()
     progressLogging = true;
 }
 
-void logError(const char* fmt, ...)
+void flushLog()
 {
-    #pragma omp critical
+    LogWriter* log_writer = writer.load();
+    if (!log_writer)
     {
-        va_list args;
-        va_start(args, fmt);
-        fprintf(stderr, "[ERROR] ");
-        vfprintf(stderr, fmt, args);
-        va_end(args);
-        fflush(stderr);
+        return; // nothing has been logged yet
     }
+    const unsigned long long target_count = added_count.load();
+    std::unique_lock<std::mutex> lock(log_writer->mutex);
+    log_writer->message_added.notify_one();
+    log_writer->messages_written.wait_for(lock, std::chrono::seconds(1), [log_writer, target_count]() { return log_writer->written_count >= target_count; });
+}
+
+void logError(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    addMessage("[ERROR] ", fmt, args);
+    va_end(args);
+    flushLog(); // errors are often followed by exiting or by a crash
 }
 
 void logWarning(const char* fmt, ...)
 {
-    #pragma omp critical
+    if (isRepeatedTooOften(fmt))
     {
-        va_list args;
-        va_start(args, fmt);
-        fprintf(stderr, "[WARNING] ");
-        vfprintf(stderr, fmt, args);
-        va_end(args);
-        fflush(stderr);
+        return;
     }
+    va_list args;
+    va_start(args, fmt);
+    addMessage("[WARNING] ", fmt, args);
+    va_end(args);
 }
 
 void logAlways(const char* fmt, ...)
 {
-    #pragma omp critical
-    {
-        va_list args;
-        va_start(args, fmt);
-        vfprintf(stderr, fmt, args);
-        va_end(args);
-        fflush(stderr);
-    }
+    va_list args;
+    va_start(args, fmt);
+    addMessage("", fmt, args);
+    va_end(args);
 }
 
 void log(const char* fmt, ...)
@@ -65,14 +283,10 @@ void log(const char* fmt, ...)
     if (verbose_level < 1)
         return;
 
-    #pragma omp critical
-    {
-        va_list args;
-        va_start(args, fmt);
-        vfprintf(stderr, fmt, args);
-        va_end(args);
-        fflush(stderr);
-    }
+    va_list args;
+    va_start(args, fmt);
+    addMessage("", fmt, args);
+    va_end(args);
 }
 
 void logDebug(const char* fmt, ...)
@@ -81,15 +295,10 @@ void logDebug(const char* fmt, ...)
     {
         return;
     }
-    #pragma omp critical
-    {
-        va_list args;
-        va_start(args, fmt);
-        fprintf(stderr, "[DEBUG] ");
-        vfprintf(stderr, fmt, args);
-        va_end(args);
-        fflush(stderr);
-    }
+    va_list args;
+    va_start(args, fmt);
+    addMessage("[DEBUG] ", fmt, args);
+    va_end(args);
 }
 
 void logProgress(const char* type, int value, int maxValue, float percent)
@@ -97,11 +306,7 @@ void logProgress(const char* type, int value, int maxValue, float percent)
     if (!progressLogging)
         return;
 
-    #pragma omp critical
-    {
-        fprintf(stderr, "Progress:%s:%i:%i \t%f%%\n", type, value, maxValue, percent);
-        fflush(stderr);
-    }
+    addMessageWithArguments("", "Progress:%s:%i:%i \t%f%%\n", type, value, maxValue, percent);
 }
 
 }//namespace cura
@@ -22,6 +22,9 @@ void logDebug(const char* fmt, ...);
 //Report engine progress to interface if any. Only if "enableProgressLogging()" has been called.
 void logProgress(const char* type, int value, int maxValue, float percent);
 
+//Wait until all messages logged so far have been written. The messages are written by a separate thread, so that logging doesn't wait for the output.
+void flushLog();
+
 }//namespace cura
 
 #endif//LOGOUTPUT_H
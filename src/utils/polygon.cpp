@@ -3,9 +3,14 @@
 
 #include "polygon.h"
 
+#include <algorithm> // sort, remove_if
+
+#include "AABB.h"
 #include "linearAlg2D.h" // pointLiesOnTheRightOfLine
 
 #include "ListPolyIt.h"
+#include "IndexedListPolygon.h"
+#include "ThreadPool.h"
 
 namespace cura 
 {
@@ -29,32 +34,21 @@ bool ConstPolygonRef::shorterThan(int64_t check_length) const
 
 bool ConstPolygonRef::_inside(Point p, bool border_result) const
 {
-    const ConstPolygonRef thiss = *this;
-    if (size() < 1)
+    const int crossings = VectorKernels::countEdgesRightOf(p, path->data(), size());
+    if (crossings == -1)
     {
-        return false;
-    }
-    
-    int crossings = 0;
-    Point p0 = back();
-    for(unsigned int n=0; n<size(); n++)
-    {
-        Point p1 = thiss[n];
-        // no tests unless the segment p0-p1 is at least partly at, or to right of, p.X
-        short comp = LinearAlg2D::pointLiesOnTheRightOfLine(p, p0, p1);
-        if (comp == 1)
-        {
-            crossings++;
-        }
-        else if (comp == 0)
-        {
-            return border_result;
-        }
-        p0 = p1;
+        return border_result;
     }
     return (crossings % 2) == 1;
 }
 
+ClipperLib::Clipper& Polygons::getClipper()
+{
+    static thread_local ClipperLib::Clipper clipper(clipper_init);
+    clipper.Clear();
+    return clipper;
+}
+
 bool Polygons::empty() const
 {
     return paths.empty();
@@ -62,19 +56,21 @@ bool Polygons::empty() const
 
 Polygons Polygons::approxConvexHull(int extra_outset)
 {
+    Profiler::GeometryOperation operation("approxConvexHull", [&]() { return pointCount(); });
     constexpr int overshoot = 100000; //10cm (hard-coded value).
 
     Polygons convex_hull;
     //Perform the offset for each polygon one at a time.
     //This is necessary because the polygons may overlap, in which case the offset could end up in an infinite loop.
     //See http://www.angusj.com/delphi/clipper/documentation/Docs/Units/ClipperLib/Classes/ClipperOffset/_Body.htm
-    for (const ClipperLib::Path path : paths)
+    ClipperLib::ClipperOffset offsetter(1.2, 10.0);
+    for (const ClipperLib::Path& path : paths)
     {
         Polygons offset_result;
-        ClipperLib::ClipperOffset offsetter(1.2, 10.0);
+        offsetter.Clear();
         offsetter.AddPath(path, ClipperLib::jtRound, ClipperLib::etClosedPolygon);
         offsetter.Execute(offset_result.paths, overshoot);
-        convex_hull.add(offset_result);
+        convex_hull.add(std::move(offset_result));
     }
     return convex_hull.unionPolygons().offset(-overshoot + extra_outset, ClipperLib::jtRound);
 }
@@ -89,12 +85,42 @@ unsigned int Polygons::pointCount() const
     return count;
 }
 
+size_t Polygons::getMemoryUsage() const
+{
+    size_t bytes = paths.capacity() * sizeof(ClipperLib::Path);
+    for (const ClipperLib::Path& path : paths)
+    {
+        bytes += path.capacity() * sizeof(Point);
+    }
+    return bytes;
+}
+
 bool Polygons::inside(Point p, bool border_result) const
 {
     int poly_count_inside = 0;
     for (const ClipperLib::Path& poly : *this)
     {
-        const int is_inside_this_poly = ClipperLib::PointInPolygon(p, poly);
+        const int is_inside_this_poly = VectorKernels::pointInPolygon(p, poly.data(), poly.size());
+        if (is_inside_this_poly == -1)
+        {
+            return border_result;
+        }
+        poly_count_inside += is_inside_this_poly;
+    }
+    return (poly_count_inside % 2) == 1;
+}
+
+bool Polygons::inside(Point p, const std::vector<AABB>& poly_aabbs, bool border_result) const
+{
+    assert(poly_aabbs.size() == size() && "there should be a bounding box for each polygon");
+    int poly_count_inside = 0;
+    for (unsigned int poly_idx = 0; poly_idx < size(); poly_idx++)
+    {
+        if (!poly_aabbs[poly_idx].contains(p))
+        { // the point is neither inside nor on the border of this polygon
+            continue;
+        }
+        const int is_inside_this_poly = VectorKernels::pointInPolygon(p, paths[poly_idx].data(), paths[poly_idx].size());
         if (is_inside_this_poly == -1)
         {
             return border_result;
@@ -213,18 +239,82 @@ coord_t Polygons::polyLineLength() const
     return length;
 }
 
-Polygons Polygons::offset(int distance, ClipperLib::JoinType join_type, double miter_limit) const
+Polygons Polygons::offset(int distance, ClipperLib::JoinType join_type, double miter_limit) const &
 {
+    Profiler::GeometryOperation operation("offset", [&]() { return pointCount(); });
     Polygons ret;
     ClipperLib::ClipperOffset clipper(miter_limit, 10.0);
-    clipper.AddPaths(unionPolygons().paths, join_type, ClipperLib::etClosedPolygon);
+    if (paths.size() == 1 && ConstPolygonRef(paths[0]).isStrictlyConvex())
+    { // the union would only reorder the vertices
+        ClipperLib::Path poly = paths[0];
+        toUnionForm(poly);
+        clipper.AddPath(poly, join_type, ClipperLib::etClosedPolygon);
+    }
+    else
+    {
+        clipper.AddPaths(unionPolygons().paths, join_type, ClipperLib::etClosedPolygon);
+    }
     clipper.MiterLimit = miter_limit;
     clipper.Execute(ret.paths, distance);
     return ret;
 }
 
+Polygons Polygons::offset(int distance, ClipperLib::JoinType join_type, double miter_limit) &&
+{
+    Profiler::GeometryOperation operation("offset", [&]() { return pointCount(); });
+    if (paths.size() == 1 && ConstPolygonRef(paths[0]).isStrictlyConvex())
+    { // the union would only reorder the vertices
+        toUnionForm(paths[0]);
+    }
+    else
+    { // the same as unionPolygons(), but into the own paths: the clipper has copied them when adding them
+        ClipperLib::Clipper& clipper = getClipper();
+        clipper.AddPaths(paths, ClipperLib::ptSubject, true);
+        clipper.Execute(ClipperLib::ctUnion, paths, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+    }
+    ClipperLib::ClipperOffset clipper(miter_limit, 10.0);
+    clipper.AddPaths(paths, join_type, ClipperLib::etClosedPolygon);
+    clipper.MiterLimit = miter_limit;
+    clipper.Execute(paths, distance);
+    return std::move(*this);
+}
+
+void Polygons::toUnionForm(ClipperLib::Path& poly)
+{
+    if (!ClipperLib::Orientation(poly))
+    {
+        std::reverse(poly.begin(), poly.end());
+    }
+    unsigned int lowest_idx = 0;
+    for (unsigned int point_idx = 1; point_idx < poly.size(); point_idx++)
+    {
+        const Point& p = poly[point_idx];
+        const Point& lowest = poly[lowest_idx];
+        if (p.Y < lowest.Y || (p.Y == lowest.Y && p.X > lowest.X))
+        {
+            lowest_idx = point_idx;
+        }
+    }
+    std::rotate(poly.begin(), poly.begin() + (lowest_idx + 1) % poly.size(), poly.end());
+}
+
+std::vector<Polygons> Polygons::offsetMulti(const std::vector<int>& distances, ClipperLib::JoinType join_type, double miter_limit) const
+{
+    Profiler::GeometryOperation operation("offsetMulti", [&]() { return pointCount(); });
+    std::vector<Polygons> ret(distances.size());
+    ClipperLib::ClipperOffset clipper(miter_limit, 10.0);
+    clipper.AddPaths(unionPolygons().paths, join_type, ClipperLib::etClosedPolygon);
+    clipper.MiterLimit = miter_limit;
+    for (unsigned int distance_idx = 0; distance_idx < distances.size(); distance_idx++)
+    {
+        clipper.Execute(ret[distance_idx].paths, distances[distance_idx]);
+    }
+    return ret;
+}
+
 Polygons ConstPolygonRef::offset(int distance, ClipperLib::JoinType join_type, double miter_limit) const
 {
+    Profiler::GeometryOperation operation("offset", [&]() { return size(); });
     Polygons ret;
     ClipperLib::ClipperOffset clipper(miter_limit, 10.0);
     clipper.AddPath(*path, join_type, ClipperLib::etClosedPolygon);
@@ -233,6 +323,48 @@ Polygons ConstPolygonRef::offset(int distance, ClipperLib::JoinType join_type, d
     return ret;
 }
 
+bool ConstPolygonRef::isStrictlyConvex() const
+{
+    const ClipperLib::Path& poly = *path;
+    if (poly.size() < 3)
+    {
+        return false;
+    }
+    bool turns_left = false;
+    int x_direction_changes = 0; // a polygon which turns the same way at every vertex can still wind around multiple times
+    int64_t last_x_direction = 0;
+    Point prev_edge = poly[0] - poly.back();
+    for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+    {
+        const Point edge = poly[(point_idx + 1) % poly.size()] - poly[point_idx];
+        const int64_t cross = prev_edge.X * edge.Y - prev_edge.Y * edge.X;
+        if (cross == 0)
+        { // collinear or duplicate vertex
+            return false;
+        }
+        if (point_idx == 0)
+        {
+            turns_left = cross > 0;
+        }
+        else if ((cross > 0) != turns_left)
+        {
+            return false;
+        }
+        if (edge.X != 0)
+        {
+            if (last_x_direction != 0 && (edge.X > 0) != (last_x_direction > 0))
+            {
+                x_direction_changes++;
+            }
+            last_x_direction = edge.X;
+        }
+        prev_edge = edge;
+    }
+    // a convex polygon changes x direction twice, which is at most twice when not counting the change from the last edge back to the first
+    // a polygon which winds around twice changes four times, so at least three times when not counting that change
+    return x_direction_changes <= 2;
+}
+
 Polygon Polygons::convexHull() const
 {
     // Implements Andrew's monotone chain convex hull algorithm
@@ -246,14 +378,13 @@ Polygon Polygons::convexHull() const
         num_points += path.size();
     }
 
-    std::vector<IntPoint> all_points;
+    // the points are gathered in a buffer which is reused by all hull computations on the same thread
+    static thread_local std::vector<IntPoint> all_points;
+    all_points.clear();
     all_points.reserve(num_points);
     for (const ClipperLib::Path& path : paths)
     {
-        for (const IntPoint& point : path)
-        {
-            all_points.push_back(point);
-        }
+        all_points.insert(all_points.end(), path.begin(), path.end());
     }
 
     struct HullSort
@@ -314,7 +445,7 @@ Polygon Polygons::convexHull() const
     assert(hull_idx <= hull_points.size());
 
     // Last point is duplicted with first.  It is removed in the resize.
-    hull_points.resize(hull_idx - 2);
+    hull_points.resize(std::max(hull_idx, size_t(1)) - 1);
 
     return hull_poly;
 }
@@ -480,8 +611,9 @@ void PolygonRef::simplify(int smallest_line_segment_squared, int allowed_error_d
 
 Polygons Polygons::getOutsidePolygons() const
 {
+    Profiler::GeometryOperation operation("getOutsidePolygons", [&]() { return pointCount(); });
     Polygons ret;
-    ClipperLib::Clipper clipper(clipper_init);
+    ClipperLib::Clipper& clipper = getClipper();
     ClipperLib::PolyTree poly_tree;
     constexpr bool paths_are_closed_polys = true;
     clipper.AddPaths(paths, ClipperLib::ptSubject, paths_are_closed_polys);
@@ -497,8 +629,9 @@ Polygons Polygons::getOutsidePolygons() const
 
 Polygons Polygons::removeEmptyHoles() const
 {
+    Profiler::GeometryOperation operation("removeEmptyHoles", [&]() { return pointCount(); });
     Polygons ret;
-    ClipperLib::Clipper clipper(clipper_init);
+    ClipperLib::Clipper& clipper = getClipper();
     ClipperLib::PolyTree poly_tree;
     constexpr bool paths_are_closed_polys = true;
     clipper.AddPaths(paths, ClipperLib::ptSubject, paths_are_closed_polys);
@@ -511,8 +644,9 @@ Polygons Polygons::removeEmptyHoles() const
 
 Polygons Polygons::getEmptyHoles() const
 {
+    Profiler::GeometryOperation operation("getEmptyHoles", [&]() { return pointCount(); });
     Polygons ret;
-    ClipperLib::Clipper clipper(clipper_init);
+    ClipperLib::Clipper& clipper = getClipper();
     ClipperLib::PolyTree poly_tree;
     constexpr bool paths_are_closed_polys = true;
     clipper.AddPaths(paths, ClipperLib::ptSubject, paths_are_closed_polys);
@@ -544,7 +678,7 @@ void Polygons::removeEmptyHoles_processPolyTreeNode(const ClipperLib::PolyNode&
     }
 }
 
-bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, ListPolyIt& p2_it, const int64_t shortcut_length)
+bool ConstPolygonRef::smooth_corner_complex(IndexedListPolygon& poly, const Point p1, unsigned int& p0_it, unsigned int& p2_it, const int64_t shortcut_length)
 {
     // walk away from the corner until the shortcut > shortcut_length or it would smooth a piece inward
     // - walk in both directions untill shortcut > shortcut_length 
@@ -563,7 +697,7 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
         const bool backward_has_converged = backward_is_blocked || backward_is_too_far;
         if (forward_has_converged && backward_has_converged)
         {
-            if (forward_is_too_far && backward_is_too_far && vSize2(p0_it.prev().p() - p2_it.next().p()) < shortcut_length2)
+            if (forward_is_too_far && backward_is_too_far && vSize2(poly.p(poly.prev(p0_it)) - poly.p(poly.next(p2_it))) < shortcut_length2)
             {
                 //         o
                 //       /   \                                                  .
@@ -574,8 +708,8 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
                 //       \   /                                                  .
                 //        | |
                 //        o o
-                --p0_it;
-                ++p2_it;
+                p0_it = poly.prev(p0_it);
+                p2_it = poly.next(p2_it);
                 forward_is_too_far = false; // invalidate data
                 backward_is_too_far = false; // invalidate data
                 continue;
@@ -585,8 +719,8 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
                 break;
             }
         }
-        smooth_outward_step(p1, shortcut_length2, p0_it, p2_it, forward_is_blocked, backward_is_blocked, forward_is_too_far, backward_is_too_far);
-        if (p0_it.prev() == p2_it || p0_it == p2_it)
+        smooth_outward_step(poly, p1, shortcut_length2, p0_it, p2_it, forward_is_blocked, backward_is_blocked, forward_is_too_far, backward_is_too_far);
+        if (poly.prev(p0_it) == p2_it || p0_it == p2_it)
         { // stop if we went all the way around the polygon
             // this should only be the case for hole polygons (?)
             if (forward_is_too_far && backward_is_too_far)
@@ -612,7 +746,7 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
         }
     }
 
-    const Point v02 = p2_it.p() - p0_it.p();
+    const Point v02 = poly.p(p2_it) - poly.p(p0_it);
     const int64_t v02_size2 = vSize2(v02);
     // set the following:
     // p0_it = start point of line
@@ -634,18 +768,18 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
         //  0
         const int64_t v02_size = sqrt(v02_size2);
 
-        const ListPolyIt p0_2_it = p0_it.prev();
-        const ListPolyIt p2_2_it = p2_it.next();
-        const Point p2_2 = p2_2_it.p();
-        const Point p0_2 = p0_2_it.p();
+        const unsigned int p0_2_it = poly.prev(p0_it);
+        const unsigned int p2_2_it = poly.next(p2_it);
+        const Point p2_2 = poly.p(p2_2_it);
+        const Point p0_2 = poly.p(p0_2_it);
         const Point v02_2 = p0_2 - p2_2;
         const int64_t v02_2_size = vSize(v02_2);
         float progress = std::min(1.0, INT2MM(shortcut_length - v02_size) / INT2MM(v02_2_size - v02_size)); // account for rounding error when v02_2_size is approx equal to v02_size
         assert(progress >= 0.0f && progress <= 1.0f && "shortcut length must be between last length and new length");
-        const Point new_p0 = p0_it.p() + (p0_2 - p0_it.p()) * progress;
-        p0_it = ListPolyIt::insertPointNonDuplicate(p0_2_it, p0_it, new_p0);
-        const Point new_p2 = p2_it.p() + (p2_2 - p2_it.p()) * progress;
-        p2_it = ListPolyIt::insertPointNonDuplicate(p2_it, p2_2_it, new_p2);
+        const Point new_p0 = poly.p(p0_it) + (p0_2 - poly.p(p0_it)) * progress;
+        p0_it = poly.insertPointNonDuplicate(p0_2_it, p0_it, new_p0);
+        const Point new_p2 = poly.p(p2_it) + (p2_2 - poly.p(p2_it)) * progress;
+        p2_it = poly.insertPointNonDuplicate(p2_it, p2_2_it, new_p2);
     }
     else if (!backward_is_blocked)
     { // forward is blocked, back is open
@@ -658,10 +792,10 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
         //  |a
         //  |
         //  0_2
-        const ListPolyIt p0_2_it = p0_it.prev();
-        const Point p0 = p0_it.p();
-        const Point p0_2 = p0_2_it.p();
-        const Point p2 = p2_it.p();
+        const unsigned int p0_2_it = poly.prev(p0_it);
+        const Point p0 = poly.p(p0_it);
+        const Point p0_2 = poly.p(p0_2_it);
+        const Point p2 = poly.p(p2_it);
         Point new_p0;
         bool success = LinearAlg2D::getPointOnLineWithDist(p2, p0, p0_2, shortcut_length, new_p0);
         // shortcut length must be possible given that last length was ok and new length is too long
@@ -670,7 +804,7 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
 #ifdef ASSERT_INSANE_OUTPUT
             assert(vSize(new_p0) < 300000);
 #endif // #ifdef ASSERT_INSANE_OUTPUT
-            p0_it = ListPolyIt::insertPointNonDuplicate(p0_2_it, p0_it, new_p0);
+            p0_it = poly.insertPointNonDuplicate(p0_2_it, p0_it, new_p0);
         }
         else
         { // if not then a rounding error occured
@@ -687,10 +821,10 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
         //  |   ,-'
         //--0.-'
         //  a
-        const ListPolyIt p2_2_it = p2_it.next();
-        const Point p0 = p0_it.p();
-        const Point p2 = p2_it.p();
-        const Point p2_2 = p2_2_it.p();
+        const unsigned int p2_2_it = poly.next(p2_it);
+        const Point p0 = poly.p(p0_it);
+        const Point p2 = poly.p(p2_it);
+        const Point p2_2 = poly.p(p2_2_it);
         Point new_p2;
         bool success = LinearAlg2D::getPointOnLineWithDist(p0, p2, p2_2, shortcut_length, new_p2);
         // shortcut length must be possible given that last length was ok and new length is too long
@@ -699,7 +833,7 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
 #ifdef ASSERT_INSANE_OUTPUT
             assert(vSize(new_p2) < 300000);
 #endif // #ifdef ASSERT_INSANE_OUTPUT
-            p2_it = ListPolyIt::insertPointNonDuplicate(p2_it, p2_2_it, new_p2);
+            p2_it = poly.insertPointNonDuplicate(p2_it, p2_2_it, new_p2);
         }
         else
         { // if not then a rounding error occured
@@ -719,25 +853,25 @@ bool ConstPolygonRef::smooth_corner_complex(const Point p1, ListPolyIt& p0_it, L
         // both are blocked and p0_it and p2_it are already correct
     }
     // delete all cut off points
-    while (p0_it.next() != p2_it)
+    while (poly.next(p0_it) != p2_it)
     {
-        p0_it.next().remove();
+        poly.remove(poly.next(p0_it));
     }
     return false;
 }
 
-void ConstPolygonRef::smooth_outward_step(const Point p1, const int64_t shortcut_length2, ListPolyIt& p0_it, ListPolyIt& p2_it, bool& forward_is_blocked, bool& backward_is_blocked, bool& forward_is_too_far, bool& backward_is_too_far)
+void ConstPolygonRef::smooth_outward_step(IndexedListPolygon& poly, const Point p1, const int64_t shortcut_length2, unsigned int& p0_it, unsigned int& p2_it, bool& forward_is_blocked, bool& backward_is_blocked, bool& forward_is_too_far, bool& backward_is_too_far)
 {
     const bool forward_has_converged = forward_is_blocked || forward_is_too_far;
     const bool backward_has_converged = backward_is_blocked || backward_is_too_far;
-    const Point p0 = p0_it.p();
-    const Point p2 = p2_it.p();
+    const Point p0 = poly.p(p0_it);
+    const Point p2 = poly.p(p2_it);
     bool walk_forward = !forward_has_converged && (backward_has_converged || (vSize2(p2 - p1) < vSize2(p0 - p1))); // whether to walk along the p1-p2 direction or in the p1-p0 direction
 
     if (walk_forward)
     {
-        const ListPolyIt p2_2_it = p2_it.next();
-        const Point p2_2 = p2_2_it.p();
+        const unsigned int p2_2_it = poly.next(p2_it);
+        const Point p2_2 = poly.p(p2_2_it);
         bool p2_is_left = LinearAlg2D::pointIsLeftOfLine(p2, p0, p2_2) >= 0;
         if (!p2_is_left)
         {
@@ -745,7 +879,7 @@ void ConstPolygonRef::smooth_outward_step(const Point p1, const int64_t shortcut
             return;
         }
 
-        const Point v02_2 = p2_2 - p0_it.p();
+        const Point v02_2 = p2_2 - poly.p(p0_it);
         if (vSize2(v02_2) > shortcut_length2)
         {
             forward_is_too_far = true;
@@ -759,8 +893,8 @@ void ConstPolygonRef::smooth_outward_step(const Point p1, const int64_t shortcut
     }
     else
     {
-        const ListPolyIt p0_2_it = p0_it.prev();
-        const Point p0_2 = p0_2_it.p();
+        const unsigned int p0_2_it = poly.prev(p0_it);
+        const Point p0_2 = poly.p(p0_2_it);
         bool p0_is_left = LinearAlg2D::pointIsLeftOfLine(p0, p0_2, p2) >= 0;
         if (!p0_is_left)
         {
@@ -768,7 +902,7 @@ void ConstPolygonRef::smooth_outward_step(const Point p1, const int64_t shortcut
             return;
         }
 
-        const Point v02_2 = p2_it.p() - p0_2;
+        const Point v02_2 = poly.p(p2_it) - p0_2;
         if (vSize2(v02_2) > shortcut_length2)
         {
             backward_is_too_far = true;
@@ -782,7 +916,7 @@ void ConstPolygonRef::smooth_outward_step(const Point p1, const int64_t shortcut
     }
 }
 
-void ConstPolygonRef::smooth_corner_simple(const Point p0, const Point p1, const Point p2, const ListPolyIt p0_it, const ListPolyIt p1_it, const ListPolyIt p2_it, const Point v10, const Point v12, const Point v02, const int64_t shortcut_length, float cos_angle)
+void ConstPolygonRef::smooth_corner_simple(IndexedListPolygon& poly, const Point p0, const Point p1, const Point p2, const unsigned int p0_it, const unsigned int p1_it, const unsigned int p2_it, const Point v10, const Point v12, const Point v02, const int64_t shortcut_length, float cos_angle)
 {
     //  1----b---->2
     //  ^   /
@@ -797,7 +931,7 @@ void ConstPolygonRef::smooth_corner_simple(const Point p0, const Point p1, const
         || (cos_angle > 0.9999 && LinearAlg2D::getDist2FromLine(p2, p0, p1) < 20 * 20)) // p1 is degenerate
     {
         // handle this separately to avoid rounding problems below in the getPointOnLineWithDist function
-        p1_it.remove();
+        poly.remove(p1_it);
         // don't insert new elements
     }
     else
@@ -821,9 +955,9 @@ void ConstPolygonRef::smooth_corner_simple(const Point p0, const Point p1, const
             assert(vSize(a) < 300000);
             assert(vSize(b) < 300000);
 #endif // #ifdef ASSERT_INSANE_OUTPUT
-            ListPolyIt::insertPointNonDuplicate(p0_it, p1_it, a);
-            ListPolyIt::insertPointNonDuplicate(p1_it, p2_it, b);
-            p1_it.remove();
+            poly.insertPointNonDuplicate(p0_it, p1_it, a);
+            poly.insertPointNonDuplicate(p1_it, p2_it, b);
+            poly.remove(p1_it);
         }
         else if (vSize2(v12) < vSize2(v10))
         {
@@ -836,7 +970,7 @@ void ConstPolygonRef::smooth_corner_simple(const Point p0, const Point p1, const
             //  |a
             //  |
             //  0
-            const Point& b = p2_it.p();
+            const Point& b = poly.p(p2_it);
             Point a;
             bool success = LinearAlg2D::getPointOnLineWithDist(b, p1, p0, shortcut_length, a);
             // v02 has to be longer than ab!
@@ -845,9 +979,9 @@ void ConstPolygonRef::smooth_corner_simple(const Point p0, const Point p1, const
 #ifdef ASSERT_INSANE_OUTPUT
                 assert(vSize(a) < 300000);
 #endif // #ifdef ASSERT_INSANE_OUTPUT
-                ListPolyIt::insertPointNonDuplicate(p0_it, p1_it, a);
+                poly.insertPointNonDuplicate(p0_it, p1_it, a);
             }
-            p1_it.remove();
+            poly.remove(p1_it);
         }
         else
         {
@@ -856,7 +990,7 @@ void ConstPolygonRef::smooth_corner_simple(const Point p0, const Point p1, const
             //  |   ,-'
             //  0.-'
             //  a
-            const Point& a = p0_it.p();
+            const Point& a = poly.p(p0_it);
             Point b;
             bool success = LinearAlg2D::getPointOnLineWithDist(a, p1, p2, shortcut_length, b);
             // v02 has to be longer than ab!
@@ -865,9 +999,9 @@ void ConstPolygonRef::smooth_corner_simple(const Point p0, const Point p1, const
 #ifdef ASSERT_INSANE_OUTPUT
                 assert(vSize(b) < 300000);
 #endif // #ifdef ASSERT_INSANE_OUTPUT
-                ListPolyIt::insertPointNonDuplicate(p1_it, p2_it, b);
+                poly.insertPointNonDuplicate(p1_it, p2_it, b);
             }
-            p1_it.remove();
+            poly.remove(p1_it);
         }
     }
 }
@@ -893,30 +1027,29 @@ void ConstPolygonRef::smooth_outward(float min_angle, int shortcut_length, Polyg
     int shortcut_length2 = shortcut_length * shortcut_length;
     float cos_min_angle = cos(min_angle / 180 * M_PI);
 
-    ListPolygon poly;
-    ListPolyIt::convertPolygonToList(*this, poly);
+    IndexedListPolygon poly(*this);
 
     { // remove duplicate vertices
-        ListPolyIt p1_it(poly, poly.begin());
+        unsigned int p1_it = poly.getFirst();
         do
         {
-            ListPolyIt next = p1_it.next();
-            if (vSize2(p1_it.p() - next.p()) < 10 * 10)
+            const unsigned int next = poly.next(p1_it);
+            if (vSize2(poly.p(p1_it) - poly.p(next)) < 10 * 10)
             {
-                p1_it.remove();
+                poly.remove(p1_it);
             }
             p1_it = next;
-        } while (p1_it != ListPolyIt(poly, poly.begin()));
+        } while (p1_it != poly.getFirst());
     }
 
-    ListPolyIt p1_it(poly, poly.begin());
+    unsigned int p1_it = poly.getFirst();
     do
     {
-        const Point p1 = p1_it.p();
-        ListPolyIt p0_it = p1_it.prev();
-        ListPolyIt p2_it = p1_it.next();
-        const Point p0 = p0_it.p();
-        const Point p2 = p2_it.p();
+        const Point p1 = poly.p(p1_it);
+        unsigned int p0_it = poly.prev(p1_it);
+        unsigned int p2_it = poly.next(p1_it);
+        const Point p0 = poly.p(p0_it);
+        const Point p2 = poly.p(p2_it);
 
         const Point v10 = p0 - p1;
         const Point v12 = p2 - p1;
@@ -925,17 +1058,17 @@ void ConstPolygonRef::smooth_outward(float min_angle, int shortcut_length, Polyg
         if (cos_angle > cos_min_angle && is_left_angle)
         {
             // angle is so sharp that it can be removed
-            Point v02 = p2_it.p() - p0_it.p();
+            Point v02 = poly.p(p2_it) - poly.p(p0_it);
             if (vSize2(v02) >= shortcut_length2)
             {
-                smooth_corner_simple(p0, p1, p2, p0_it, p1_it, p2_it, v10, v12, v02, shortcut_length, cos_angle);
+                smooth_corner_simple(poly, p0, p1, p2, p0_it, p1_it, p2_it, v10, v12, v02, shortcut_length, cos_angle);
             }
             else
             {
-                bool remove_poly = smooth_corner_complex(p1, p0_it, p2_it, shortcut_length); // edits p0_it and p2_it!
+                bool remove_poly = smooth_corner_complex(poly, p1, p0_it, p2_it, shortcut_length); // edits p0_it and p2_it!
                 if (remove_poly)
                 {
-                    // don't convert ListPolygon into result
+                    // don't convert the polygon into result
                     return;
                 }
             }
@@ -944,11 +1077,11 @@ void ConstPolygonRef::smooth_outward(float min_angle, int shortcut_length, Polyg
         }
         else
         {
-            ++p1_it;
+            p1_it = poly.next(p1_it);
         }
-    } while (p1_it != ListPolyIt(poly, poly.begin()));
+    } while (p1_it != poly.getFirst());
 
-    ListPolyIt::convertListPolygonToPolygon(poly, result);
+    poly.toPolygon(result);
 }
 
 Polygons Polygons::smooth_outward(float max_angle, int shortcut_length)
@@ -1153,8 +1286,9 @@ double PolygonsPart::area() const
 
 std::vector<PolygonsPart> Polygons::splitIntoParts(bool unionAll) const
 {
+    Profiler::GeometryOperation operation("splitIntoParts", [&]() { return pointCount(); });
     std::vector<PolygonsPart> ret;
-    ClipperLib::Clipper clipper(clipper_init);
+    ClipperLib::Clipper& clipper = getClipper();
     ClipperLib::PolyTree resultPolyTree;
     clipper.AddPaths(paths, ClipperLib::ptSubject, true);
     if (unionAll)
@@ -1166,6 +1300,169 @@ std::vector<PolygonsPart> Polygons::splitIntoParts(bool unionAll) const
     return ret;
 }
 
+std::vector<PolygonsPart> Polygons::splitIntoPartsByContainment() const
+{
+    constexpr unsigned int max_polygon_count = 1000; // beyond this the sweep of Clipper is faster than checking all pairs
+    if (size() > max_polygon_count)
+    {
+        return splitIntoParts();
+    }
+    const std::vector<AABB> aabbs = AABB::calculatePerPolygon(*this);
+    std::vector<double> areas(size());
+    std::vector<unsigned int> by_area(size());
+    for (unsigned int poly_idx = 0; poly_idx < size(); poly_idx++)
+    {
+        areas[poly_idx] = std::abs(ClipperLib::Area(paths[poly_idx]));
+        by_area[poly_idx] = poly_idx;
+    }
+    std::stable_sort(by_area.begin(), by_area.end(), [&areas](unsigned int a, unsigned int b) { return areas[a] < areas[b]; });
+
+    // the polygon directly around each polygon is the smallest one containing it, since the polygons don't intersect
+    std::vector<unsigned int> parent(size(), NO_INDEX);
+    for (unsigned int order_idx = 0; order_idx < by_area.size(); order_idx++)
+    {
+        const unsigned int poly_idx = by_area[order_idx];
+        const AABB& aabb = aabbs[poly_idx];
+        for (unsigned int container_order_idx = order_idx + 1; container_order_idx < by_area.size(); container_order_idx++)
+        {
+            const unsigned int container_idx = by_area[container_order_idx];
+            const AABB& container_aabb = aabbs[container_idx];
+            if (aabb.min.X < container_aabb.min.X || aabb.min.Y < container_aabb.min.Y || aabb.max.X > container_aabb.max.X || aabb.max.Y > container_aabb.max.Y)
+            {
+                continue;
+            }
+            // the polygon lies inside or outside of the other as a whole, which any vertex not on the other tells
+            int inside = -1;
+            for (unsigned int point_idx = 0; point_idx < paths[poly_idx].size() && inside == -1; point_idx++)
+            {
+                inside = VectorKernels::pointInPolygon(paths[poly_idx][point_idx], paths[container_idx].data(), paths[container_idx].size());
+            }
+            if (inside == 1)
+            {
+                parent[poly_idx] = container_idx;
+                break;
+            }
+        }
+    }
+
+    // polygons at an even depth are outlines, the others are holes in the part of their parent
+    std::vector<unsigned int> depth(size(), 0);
+    for (unsigned int order_idx = by_area.size(); order_idx-- > 0;)
+    { // from large to small, so that the depth of the parent is known
+        const unsigned int poly_idx = by_area[order_idx];
+        depth[poly_idx] = (parent[poly_idx] == NO_INDEX)? 0 : depth[parent[poly_idx]] + 1;
+    }
+    std::vector<PolygonsPart> ret;
+    std::vector<unsigned int> part_of_outline(size(), NO_INDEX);
+    for (unsigned int poly_idx = 0; poly_idx < size(); poly_idx++)
+    {
+        if (depth[poly_idx] % 2 == 0)
+        {
+            part_of_outline[poly_idx] = ret.size();
+            ret.emplace_back();
+            ret.back().add(paths[poly_idx]);
+            if (!ret.back()[0].orientation())
+            {
+                ret.back()[0].reverse();
+            }
+        }
+    }
+    for (unsigned int poly_idx = 0; poly_idx < size(); poly_idx++)
+    {
+        if (depth[poly_idx] % 2 == 1)
+        {
+            PolygonsPart& part = ret[part_of_outline[parent[poly_idx]]];
+            part.add(paths[poly_idx]);
+            PolygonRef hole = part[part.size() - 1];
+            if (hole.orientation())
+            {
+                hole.reverse();
+            }
+        }
+    }
+    return ret;
+}
+
+Polygons Polygons::unionPolygonsInClusters() const
+{
+    constexpr unsigned int min_polygon_count = 64; // fewer polygons are united faster in one pass than clustered first
+    if (size() < min_polygon_count)
+    {
+        return unionPolygons();
+    }
+    const std::vector<AABB> aabbs = AABB::calculatePerPolygon(*this);
+
+    // find the clusters of polygons with overlapping bounding boxes by sweeping over the bounding boxes from left to right
+    std::vector<unsigned int> cluster_root(size());
+    for (unsigned int poly_idx = 0; poly_idx < size(); poly_idx++)
+    {
+        cluster_root[poly_idx] = poly_idx;
+    }
+    const auto find_root = [&cluster_root](unsigned int poly_idx) -> unsigned int
+        {
+            while (cluster_root[poly_idx] != poly_idx)
+            {
+                cluster_root[poly_idx] = cluster_root[cluster_root[poly_idx]];
+                poly_idx = cluster_root[poly_idx];
+            }
+            return poly_idx;
+        };
+    std::vector<unsigned int> by_min_x(size());
+    for (unsigned int poly_idx = 0; poly_idx < size(); poly_idx++)
+    {
+        by_min_x[poly_idx] = poly_idx;
+    }
+    std::sort(by_min_x.begin(), by_min_x.end(), [&aabbs](unsigned int a, unsigned int b) { return aabbs[a].min.X < aabbs[b].min.X; });
+    std::vector<unsigned int> active; // the polygons passed by the sweep which may still overlap with the next ones in the x direction
+    for (unsigned int poly_idx : by_min_x)
+    {
+        const AABB& aabb = aabbs[poly_idx];
+        active.erase(std::remove_if(active.begin(), active.end(), [&aabbs, &aabb](unsigned int other_idx) { return aabbs[other_idx].max.X < aabb.min.X; }), active.end());
+        for (unsigned int other_idx : active)
+        {
+            if (aabb.hit(aabbs[other_idx]))
+            {
+                const unsigned int root = find_root(poly_idx);
+                const unsigned int other_root = find_root(other_idx);
+                cluster_root[std::max(root, other_root)] = std::min(root, other_root);
+            }
+        }
+        active.push_back(poly_idx);
+    }
+
+    // the clusters in the order of their first polygon, so that the result doesn't depend on the threads
+    std::vector<unsigned int> cluster_of_root(size(), NO_INDEX);
+    std::vector<Polygons> clusters;
+    for (unsigned int poly_idx = 0; poly_idx < size(); poly_idx++)
+    {
+        unsigned int& cluster_idx = cluster_of_root[find_root(poly_idx)];
+        if (cluster_idx == NO_INDEX)
+        {
+            cluster_idx = clusters.size();
+            clusters.emplace_back();
+        }
+        clusters[cluster_idx].add(paths[poly_idx]);
+    }
+    if (clusters.size() == 1)
+    {
+        return unionPolygons();
+    }
+
+    ThreadPool::parallelFor(0, clusters.size(), [&clusters](int cluster_idx)
+    {
+        clusters[cluster_idx] = clusters[cluster_idx].unionPolygons();
+    });
+    Polygons ret;
+    for (Polygons& cluster : clusters)
+    {
+        for (ClipperLib::Path& path : cluster.paths)
+        {
+            ret.paths.emplace_back(std::move(path));
+        }
+    }
+    return ret;
+}
+
 void Polygons::splitIntoParts_processPolyTreeNode(ClipperLib::PolyNode* node, std::vector<PolygonsPart>& ret) const
 {
     for(int n=0; n<node->ChildCount(); n++)
@@ -1226,9 +1523,10 @@ PolygonsPart PartsView::assemblePartContaining(unsigned int poly_idx, unsigned i
 
 PartsView Polygons::splitIntoPartsView(bool unionAll)
 {
+    Profiler::GeometryOperation operation("splitIntoPartsView", [&]() { return pointCount(); });
     Polygons reordered;
     PartsView partsView(*this);
-    ClipperLib::Clipper clipper(clipper_init);
+    ClipperLib::Clipper& clipper = getClipper();
     ClipperLib::PolyTree resultPolyTree;
     clipper.AddPaths(paths, ClipperLib::ptSubject, true);
     if (unionAll)
@@ -13,10 +13,13 @@
 #include <cmath> // fabs
 #include <limits> // int64_t.min
 #include <list>
+#include <iterator> // std::make_move_iterator
 
 #include <initializer_list>
+#include <utility> // std::move
 
 #include "intpoint.h"
+#include "Profiler.h"
 
 #define CHECK_POLY_ACCESS
 #ifdef CHECK_POLY_ACCESS
@@ -28,12 +31,14 @@
 namespace cura {
 
 
+class AABB;
 class PartsView;
 class Polygons;
 class Polygon;
 class PolygonRef;
 
 class ListPolyIt;
+class IndexedListPolygon;
 
 typedef std::list<Point> ListPolygon; //!< A polygon represented by a linked list instead of a vector
 typedef std::vector<ListPolygon> ListPolygons; //!< Polygons represented by a vector of linked lists instead of a vector of vectors
@@ -113,6 +118,13 @@ public:
 
     Polygons offset(int distance, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) const;
 
+    /*!
+     * Check whether this polygon is convex, without collinear or duplicate vertices.
+     *
+     * Both orientations are accepted.
+     */
+    bool isStrictlyConvex() const;
+
     int64_t polygonLength() const
     {
         int64_t length = 0;
@@ -214,14 +226,14 @@ public:
     bool _inside(Point p, bool border_result = false) const;
 
     /*!
-     * Clipper function.
+     * Clipper function, computed with the vectorized VectorKernels::pointInPolygon, which gives the same results.
      * Returns false if outside, true if inside; if the point lies exactly on the border, will return 'border_result'.
      * 
      * http://www.angusj.com/delphi/clipper/documentation/Docs/Units/ClipperLib/Functions/PointInPolygon.htm
      */
     bool inside(Point p, bool border_result = false) const
     {
-        int res = ClipperLib::PointInPolygon(p, *path);
+        int res = VectorKernels::pointInPolygon(p, path->data(), path->size());
         if (res == -1)
         {
             return border_result;
@@ -267,19 +279,20 @@ private:
      * 
      * Auxiliary function for \ref smooth_outward
      * 
+     * \param poly The polygon being smoothed
      * \param p0 The point before the corner
      * \param p1 The corner
      * \param p2 The point after the corner
-     * \param p0_it Iterator to the point before the corner
-     * \param p1_it Iterator to the corner
-     * \param p2_it Iterator to the point after the corner
+     * \param p0_it The vertex before the corner
+     * \param p1_it The corner vertex
+     * \param p2_it The vertex after the corner
      * \param v10 Vector from \p p1 to \p p0
      * \param v12 Vector from \p p1 to \p p2
      * \param v02 Vector from \p p0 to \p p2
      * \param shortcut_length The desired length ofthe shortcutting line
      * \param cos_angle The cosine on the angle in L 012
      */
-    static void smooth_corner_simple(const Point p0, const Point p1, const Point p2, const ListPolyIt p0_it, const ListPolyIt p1_it, const ListPolyIt p2_it, const Point v10, const Point v12, const Point v02, const int64_t shortcut_length, float cos_angle);
+    static void smooth_corner_simple(IndexedListPolygon& poly, const Point p0, const Point p1, const Point p2, const unsigned int p0_it, const unsigned int p1_it, const unsigned int p2_it, const Point v10, const Point v12, const Point v02, const int64_t shortcut_length, float cos_angle);
 
     /*!
      * Smooth out a complex corner where the shortcut bypasses more than two line segments
@@ -289,13 +302,14 @@ private:
      * \warning This function might try to remove the whole polygon
      * Error code -1 means the whole polygon should be removed (which means it is a hole polygon)
      * 
+     * \param poly The polygon being smoothed
      * \param p1 The corner point
-     * \param[in,out] p0_it Iterator to the last point checked before \p p1 to consider cutting off
-     * \param[in,out] p2_it Iterator to the last point checked after \p p1 to consider cutting off
+     * \param[in,out] p0_it The last vertex checked before \p p1 to consider cutting off
+     * \param[in,out] p2_it The last vertex checked after \p p1 to consider cutting off
      * \param shortcut_length The desired length ofthe shortcutting line
      * \return Whether this whole polygon whould be removed by the smoothing
      */
-    static bool smooth_corner_complex(const Point p1, ListPolyIt& p0_it, ListPolyIt& p2_it, const int64_t shortcut_length);
+    static bool smooth_corner_complex(IndexedListPolygon& poly, const Point p1, unsigned int& p0_it, unsigned int& p2_it, const int64_t shortcut_length);
 
     /*!
      * Try to take a step away from the corner point in order to take a bigger shortcut.
@@ -304,16 +318,17 @@ private:
      * 
      * Auxiliary function for \ref smooth_outward
      * 
+     * \param[in,out] poly The polygon being smoothed
      * \param[in] p1 The corner point
      * \param[in] shortcut_length2 The square of the desired length ofthe shortcutting line
-     * \param[in,out] p0_it Iterator to the previously checked point somewhere beyond \p p1. Updated for the next iteration.
-     * \param[in,out] p2_it Iterator to the previously checked point somewhere before \p p1. Updated for the next iteration.
+     * \param[in,out] p0_it The previously checked vertex somewhere beyond \p p1. Updated for the next iteration.
+     * \param[in,out] p2_it The previously checked vertex somewhere before \p p1. Updated for the next iteration.
      * \param[in,out] forward_is_blocked Whether trying another step forward is blocked by the smoothing outward condition. Updated for the next iteration.
      * \param[in,out] backward_is_blocked Whether trying another step backward is blocked by the smoothing outward condition. Updated for the next iteration.
      * \param[in,out] forward_is_too_far Whether trying another step forward is blocked by the shortcut length condition. Updated for the next iteration.
      * \param[in,out] backward_is_too_far Whether trying another step backward is blocked by the shortcut length condition. Updated for the next iteration.
      */
-    static void smooth_outward_step(const Point p1, const int64_t shortcut_length2, ListPolyIt& p0_it, ListPolyIt& p2_it, bool& forward_is_blocked, bool& backward_is_blocked, bool& forward_is_too_far, bool& backward_is_too_far);
+    static void smooth_outward_step(IndexedListPolygon& poly, const Point p1, const int64_t shortcut_length2, unsigned int& p0_it, unsigned int& p2_it, bool& forward_is_blocked, bool& backward_is_blocked, bool& forward_is_too_far, bool& backward_is_too_far);
 };
 
 
@@ -463,6 +478,11 @@ public:
 
     unsigned int pointCount() const; //!< Return the amount of points in all polygons
 
+    /*!
+     * Get the number of bytes allocated for the polygons and their points, including the unused capacity.
+     */
+    size_t getMemoryUsage() const;
+
     PolygonRef operator[] (unsigned int index)
     {
         POLY_ASSERT(index < size() && index <= std::numeric_limits<int>::max());
@@ -528,8 +548,19 @@ public:
     }
     void add(const Polygons& other)
     {
-        for(unsigned int n=0; n<other.paths.size(); n++)
-            paths.push_back(other.paths[n]);
+        paths.insert(paths.end(), other.paths.begin(), other.paths.end()); // grows the capacity geometrically, unlike reserving the exact size, which makes adding in a loop quadratic
+    }
+    /*!
+     * Add all polygons of \p other, taking over their point data instead of copying it.
+     */
+    void add(Polygons&& other)
+    {
+        if (paths.empty())
+        {
+            paths = std::move(other.paths);
+            return;
+        }
+        paths.insert(paths.end(), std::make_move_iterator(other.paths.begin()), std::make_move_iterator(other.paths.end()));
     }
     /*!
      * Add a 'polygon' consisting of two points
@@ -562,14 +593,27 @@ public:
     Polygons() {}
 
     Polygons(const Polygons& other) { paths = other.paths; }
+    Polygons(Polygons&& other) noexcept : paths(std::move(other.paths)) {} //!< Takes over the point data of the temporary results of polygon operations instead of copying it
     Polygons& operator=(const Polygons& other) { paths = other.paths; return *this; }
+    Polygons& operator=(Polygons&& other) noexcept { paths = std::move(other.paths); return *this; }
 
     bool operator==(const Polygons& other) const =delete;
 
+    /*!
+     * Whether the other polygons are exactly the same: the same polygons in the same order, each with the same vertices in the same order.
+     * 
+     * Polygons which cover the same area but start at another vertex or with the polygons in another order are not identical.
+     */
+    bool isIdentical(const Polygons& other) const
+    {
+        return paths == other.paths;
+    }
+
     Polygons difference(const Polygons& other) const
     {
+        Profiler::GeometryOperation operation("difference", [&]() { return pointCount() + other.pointCount(); });
         Polygons ret;
-        ClipperLib::Clipper clipper(clipper_init);
+        ClipperLib::Clipper& clipper = getClipper();
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.AddPaths(other.paths, ClipperLib::ptClip, true);
         clipper.Execute(ClipperLib::ctDifference, ret.paths);
@@ -577,8 +621,9 @@ public:
     }
     Polygons unionPolygons(const Polygons& other) const
     {
+        Profiler::GeometryOperation operation("union", [&]() { return pointCount() + other.pointCount(); });
         Polygons ret;
-        ClipperLib::Clipper clipper(clipper_init);
+        ClipperLib::Clipper& clipper = getClipper();
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.AddPaths(other.paths, ClipperLib::ptSubject, true);
         clipper.Execute(ClipperLib::ctUnion, ret.paths, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
@@ -591,10 +636,21 @@ public:
     {
         return unionPolygons(Polygons());
     }
+    /*!
+     * Union all polygons with each other, like \ref Polygons::unionPolygons(), but cluster by cluster in parallel.
+     *
+     * The polygons are clustered by their overlapping bounding boxes. Clusters whose bounding boxes don't overlap can't affect
+     * each other, so the union of each cluster is computed on its own and the results are concatenated.
+     * Clusters whose bounding boxes overlap are always united as one, since a polygon of one may be a hole in a polygon of the other.
+     * This speeds up the union of the many separate parts of a build plate with many models.
+     * The result covers the same area as that of \ref Polygons::unionPolygons(), though the polygons may be in another order.
+     */
+    Polygons unionPolygonsInClusters() const;
     Polygons intersection(const Polygons& other) const
     {
+        Profiler::GeometryOperation operation("intersection", [&]() { return pointCount() + other.pointCount(); });
         Polygons ret;
-        ClipperLib::Clipper clipper(clipper_init);
+        ClipperLib::Clipper& clipper = getClipper();
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.AddPaths(other.paths, ClipperLib::ptClip, true);
         clipper.Execute(ClipperLib::ctIntersection, ret.paths);
@@ -607,8 +663,9 @@ public:
      */
     ClipperLib::PolyTree lineSegmentIntersection(const Polygons& other) const
     {
+        Profiler::GeometryOperation operation("lineSegmentIntersection", [&]() { return pointCount() + other.pointCount(); });
         ClipperLib::PolyTree ret;
-        ClipperLib::Clipper clipper(clipper_init);
+        ClipperLib::Clipper& clipper = getClipper();
         clipper.AddPaths(paths, ClipperLib::ptClip, true);
         clipper.AddPaths(other.paths, ClipperLib::ptSubject, false);
         clipper.Execute(ClipperLib::ctIntersection, ret);
@@ -616,18 +673,60 @@ public:
     }
     Polygons xorPolygons(const Polygons& other) const
     {
+        Profiler::GeometryOperation operation("xor", [&]() { return pointCount() + other.pointCount(); });
         Polygons ret;
-        ClipperLib::Clipper clipper(clipper_init);
+        ClipperLib::Clipper& clipper = getClipper();
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.AddPaths(other.paths, ClipperLib::ptClip, true);
         clipper.Execute(ClipperLib::ctXor, ret.paths);
         return ret;
     }
 
-    Polygons offset(int distance, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) const;
+    Polygons offset(int distance, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) const &;
+
+    /*!
+     * Offset a temporary, such as the result of another polygon operation, without copying it.
+     *
+     * The storage of the temporary is reused for the intermediate union and for the result.
+     */
+    Polygons offset(int distance, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) &&;
+private:
+    /*!
+     * Get the clipper of the current thread, cleared for a new operation.
+     *
+     * Constructing a new clipper for every polygon operation reallocates its internal buffers every time.
+     * The clipper returned here keeps them between operations instead.
+     * It must not be used anymore once another polygon operation is started on the same thread.
+     */
+    static ClipperLib::Clipper& getClipper();
+
+    /*!
+     * Bring a strictly convex polygon into the form in which the union of it alone would return it,
+     * i.e. counter-clockwise and starting after its lowest vertex (the rightmost one if there are two).
+     *
+     * Offsetting the result gives exactly the same as \ref Polygons::offset would for this polygon,
+     * which unions the polygons before offsetting them. This way simple convex outlines skip that union.
+     *
+     * \param[in,out] poly The strictly convex polygon to bring into the form of the union
+     */
+    static void toUnionForm(ClipperLib::Path& poly);
+public:
+
+    /*!
+     * Offset these polygons by several distances at once.
+     *
+     * The union and the setup of the offset are only computed once for all distances,
+     * so this is cheaper than calling \ref Polygons::offset for each distance separately,
+     * while giving exactly the same results.
+     *
+     * \param distances The offset distances
+     * \return The offsetted polygons for each of the \p distances, in the same order
+     */
+    std::vector<Polygons> offsetMulti(const std::vector<int>& distances, ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miter_limit = 1.2) const;
 
     Polygons offsetPolyLine(int distance, ClipperLib::JoinType joinType = ClipperLib::jtMiter) const
     {
+        Profiler::GeometryOperation operation("offsetPolyLine", [&]() { return pointCount(); });
         Polygons ret;
         double miterLimit = 1.2;
         ClipperLib::ClipperOffset clipper(miterLimit, 10.0);
@@ -651,6 +750,19 @@ public:
      */
     bool inside(Point p, bool border_result = false) const;
 
+    /*!
+     * Check if we are inside the polygon, skipping the polygons of which the bounding box doesn't contain the point.
+     * 
+     * Gives the same result as \ref Polygons::inside(Point, bool) const,
+     * but is faster for polygons consisting of many parts or holes, when the bounding boxes are reused for many points.
+     * 
+     * \param p The point for which to check if it is inside this polygon
+     * \param poly_aabbs The bounding box of each polygon, see \ref AABB::calculatePerPolygon
+     * \param border_result What to return when the point is exactly on the border
+     * \return Whether the point \p p is inside this polygon (or \p border_result when it is on the border)
+     */
+    bool inside(Point p, const std::vector<AABB>& poly_aabbs, bool border_result = false) const;
+
     /*!
      * Check if we are inside the polygon. We do this by tracing from the point towards the positive X direction,
      * every line we cross increments the crossings counter. If we have an even number of crossings then we are not inside the polygon.
@@ -771,6 +883,17 @@ public:
      * Each PolygonsPart in the result has an outline as first polygon, whereas the rest are holes.
      */
     std::vector<PolygonsPart> splitIntoParts(bool unionAll = false) const;
+
+    /*!
+     * Split up the polygons into groups according to the even-odd rule, like \ref Polygons::splitIntoParts,
+     * but from which polygons contain which, without a boolean operation.
+     *
+     * The polygons must not intersect each other or themselves, though they may touch at vertices,
+     * as is the case for the result of a Clipper operation. The outlines are made counter-clockwise and the holes clockwise.
+     * The parts are ordered by their outlines and the holes of a part are ordered as in these polygons.
+     * Many polygons are split up by \ref Polygons::splitIntoParts after all, since finding which contain which takes quadratic time.
+     */
+    std::vector<PolygonsPart> splitIntoPartsByContainment() const;
 private:
     /*!
      * recursive part of \ref Polygons::removeEmptyHoles and \ref Polygons::getEmptyHoles
@@ -917,8 +1040,9 @@ public:
 
     Polygons processEvenOdd() const
     {
+        Profiler::GeometryOperation operation("processEvenOdd", [&]() { return pointCount(); });
         Polygons ret;
-        ClipperLib::Clipper clipper(clipper_init);
+        ClipperLib::Clipper& clipper = getClipper();
         clipper.AddPaths(paths, ClipperLib::ptSubject, true);
         clipper.Execute(ClipperLib::ctUnion, ret.paths);
         return ret;
@@ -972,11 +1096,24 @@ public:
 
     void applyMatrix(const PointMatrix& matrix)
     {
-        for(unsigned int i=0; i<paths.size(); i++)
+        for (ClipperLib::Path& path : paths)
+        {
+            matrix.apply(path.data(), path.data(), path.size());
+        }
+    }
+
+    /*!
+     * Translate all polygons in some direction.
+     *
+     * \param translation The direction in which to move the polygons
+     */
+    void translate(Point translation)
+    {
+        for (ClipperLib::Path& path : paths)
         {
-            for(unsigned int j=0; j<paths[i].size(); j++)
+            for (Point& p : path)
             {
-                paths[i][j] = matrix.apply(paths[i][j]);
+                p += translation;
             }
         }
     }
@@ -689,9 +689,10 @@ PolygonsPointIndex PolygonUtils::findNearestVert(const Point from, const Polygon
     for (unsigned int poly_idx = 0; poly_idx < polys.size(); poly_idx++)
     {
         ConstPolygonRef poly = polys[poly_idx];
-        for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+        const unsigned int point_idx = findNearestVert(from, poly);
+        if (point_idx < poly.size())
         {
-            int64_t dist2 = vSize2(poly[point_idx] - from);
+            const int64_t dist2 = vSize2(poly[point_idx] - from);
             if (dist2 < best_dist2)
             {
                 best_dist2 = dist2;
@@ -704,40 +705,38 @@ PolygonsPointIndex PolygonUtils::findNearestVert(const Point from, const Polygon
 
 unsigned int PolygonUtils::findNearestVert(const Point from, ConstPolygonRef poly)
 {
+    // first the smallest distance, in a loop without branches which the compiler can vectorize, then the first vertex at that distance
     int64_t best_dist2 = std::numeric_limits<int64_t>::max();
-    unsigned int closest_vert_idx = -1;
     for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
     {
-        int64_t dist2 = vSize2(poly[point_idx] - from);
-        if (dist2 < best_dist2)
+        best_dist2 = std::min(best_dist2, vSize2(poly[point_idx] - from));
+    }
+    for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+    {
+        if (vSize2(poly[point_idx] - from) == best_dist2)
         {
-            best_dist2 = dist2;
-            closest_vert_idx = point_idx;
+            return point_idx;
         }
     }
-    return closest_vert_idx;
+    return -1;
 }
 
 
 LocToLineGrid* PolygonUtils::createLocToLineGrid(const Polygons& polygons, int square_size)
 {
-    unsigned int n_points = 0;
-    for (const auto& poly : polygons)
-    {
-        n_points += poly.size();
-    }
-
-    LocToLineGrid* ret = new LocToLineGrid(square_size, n_points);
-
+    std::vector<PolygonsPointIndex> segments;
+    segments.reserve(polygons.pointCount());
     for (unsigned int poly_idx = 0; poly_idx < polygons.size(); poly_idx++)
     {
         ConstPolygonRef poly = polygons[poly_idx];
         for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
         {
-            ret->insert(PolygonsPointIndex(&polygons, poly_idx, point_idx));
+            segments.emplace_back(&polygons, poly_idx, point_idx);
         }
-
     }
+
+    LocToLineGrid* ret = new LocToLineGrid(square_size);
+    ret->insertAll(segments);
     return ret;
 }
 
@@ -753,28 +752,26 @@ std::optional<ClosestPolygonPoint> PolygonUtils::findClose(
     const LocToLineGrid& loc_to_line,
     const std::function<int(Point)>& penalty_function)
 {
-    std::vector<PolygonsPointIndex> near_lines =
-        loc_to_line.getNearby(from, loc_to_line.getCellSize());
-
     Point best(0, 0);
 
     int64_t closest_dist2_score = std::numeric_limits<int64_t>::max();
     PolygonsPointIndex best_point_poly_idx(nullptr, NO_INDEX, NO_INDEX);
-    for (PolygonsPointIndex& point_poly_index : near_lines)
-    {
-        ConstPolygonRef poly = polygons[point_poly_index.poly_idx];
-        const Point& p1 = poly[point_poly_index.point_idx];
-        const Point& p2 = poly[(point_poly_index.point_idx + 1) % poly.size()];
-
-        Point closest_here = LinearAlg2D::getClosestOnLineSegment(from, p1 ,p2);
-        int64_t dist2_score = vSize2(from - closest_here) + penalty_function(closest_here);
-        if (dist2_score < closest_dist2_score)
+    loc_to_line.visitNearby(from, loc_to_line.getCellSize(), [&](const PolygonsPointIndex& point_poly_index)
         {
-            best = closest_here;
-            closest_dist2_score = dist2_score;
-            best_point_poly_idx = point_poly_index;
-        }
-    }
+            ConstPolygonRef poly = polygons[point_poly_index.poly_idx];
+            const Point& p1 = poly[point_poly_index.point_idx];
+            const Point& p2 = poly[(point_poly_index.point_idx + 1) % poly.size()];
+
+            Point closest_here = LinearAlg2D::getClosestOnLineSegment(from, p1 ,p2);
+            int64_t dist2_score = vSize2(from - closest_here) + penalty_function(closest_here);
+            if (dist2_score < closest_dist2_score)
+            {
+                best = closest_here;
+                closest_dist2_score = dist2_score;
+                best_point_poly_idx = point_poly_index;
+            }
+            return true;
+        });
     if (best_point_poly_idx.poly_idx == NO_INDEX)
     {
         return std::optional<ClosestPolygonPoint>();
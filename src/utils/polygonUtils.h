@@ -61,7 +61,7 @@ struct PolygonsPointIndexSegmentLocator
     }
 };
 
-typedef SparseLineGrid<PolygonsPointIndex, PolygonsPointIndexSegmentLocator> LocToLineGrid;
+typedef SparseLineGrid<PolygonsPointIndex, PolygonsPointIndexSegmentLocator, MortonGridMap<PolygonsPointIndex>> LocToLineGrid;
 
 class PolygonUtils 
 {
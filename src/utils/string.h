@@ -5,6 +5,8 @@
 #define UTILS_STRING_H
 
 #include <ctype.h>
+#include <cmath> // fabs, floor, signbit
+#include <cstdint>
 #include <cstdio> // sprintf
 #include <sstream> // ostringstream
 
@@ -29,6 +31,8 @@ static inline int stringcasecompare(const char* a, const char* b)
 /*!
  * Efficient conversion of micron integer type to millimeter string.
  * 
+ * The digits are generated with integer arithmetic into a local buffer, which is written to \p ss at once.
+ * 
  * The integer type is half the size of the normal integer type because of implementation details.
  * However, half the integer type should suffice, because we made the basic coord_t twice as big as necessary
  * so as to support multiplication within the same integer type.
@@ -38,62 +42,41 @@ static inline int stringcasecompare(const char* a, const char* b)
  */
 static inline void writeInt2mm(const int32_t coord, std::ostream& ss)
 {
-    constexpr size_t buffer_size = 24;
+    constexpr size_t buffer_size = 16;
     char buffer[buffer_size];
-    int char_count = sprintf(buffer, "%d", coord); // we haven't found any way for the windows compiler to accept formatting of a coord_t, so it has to be int32_t instead
-#ifdef DEBUG
-    if (char_count + 1 >= int(buffer_size)) // + 1 for the null character
-    {
-        logError("Cannot write %ld to buffer of size %i", coord, buffer_size);
-    }
-    if (char_count < 0)
+    char* const end = buffer + buffer_size;
+    char* start = end; // the digits are written from back to front
+    uint32_t magnitude = (coord < 0) ? -static_cast<uint32_t>(coord) : static_cast<uint32_t>(coord);
+    uint32_t whole = magnitude / 1000;
+    uint32_t fraction = magnitude % 1000;
+    if (fraction != 0)
     {
-        logError("Encoding error while writing %ld", coord);
-    }
-#endif // DEBUG
-    int end_pos = char_count; // the first character not to write any more
-    int trailing_zeros = 1;
-    while (trailing_zeros < 4 && buffer[char_count - trailing_zeros] == '0')
-    {
-        trailing_zeros++;
-    }
-    trailing_zeros--;
-    end_pos = char_count - trailing_zeros;
-    if (trailing_zeros == 3)
-    { // no need to write the decimal dot
-        buffer[char_count - trailing_zeros] = '\0';
-        ss << buffer;
-        return;
-    }
-    if (char_count <= 3)
-    {
-        int start = 0; // where to start writing from the buffer
-        if (coord < 0)
-        {
-            ss << '-';
-            start = 1;
+        int decimal_count = 3;
+        while (fraction % 10 == 0)
+        { // strip trailing zeros
+            fraction /= 10;
+            decimal_count--;
         }
-        ss << "0.";
-        for (int nulls = char_count - start; nulls < 3; nulls++)
-        { // fill up to 3 decimals with zeros
-            ss << '0';
+        for (int decimal = 0; decimal < decimal_count; decimal++)
+        {
+            *--start = '0' + fraction % 10;
+            fraction /= 10;
         }
-        buffer[char_count - trailing_zeros] = '\0';
-        ss << (static_cast<char*>(buffer) + start);
+        *--start = '.';
     }
-    else
+    if (whole != 0 || coord >= 0 || magnitude < 100)
+    { // negative values from -0.999 up to -0.1 have always been written without the zero before the decimal dot
+        do
+        {
+            *--start = '0' + whole % 10;
+            whole /= 10;
+        } while (whole != 0);
+    }
+    if (coord < 0)
     {
-        char prev = '.';
-        int pos;
-        for (pos = char_count - 3; pos <= end_pos; pos++)
-        { // shift all characters and insert the decimal dot
-            char next_prev = buffer[pos];
-            buffer[pos] = prev;
-            prev = next_prev;
-        }
-        buffer[pos] = '\0';
-        ss << buffer;
+        *--start = '-';
     }
+    ss.write(start, end - start);
 }
 
 /*!
@@ -115,6 +98,9 @@ struct MMtoStream
  * 
  * writes with \p precision digits after the decimal dot, but removes trailing zeros
  * 
+ * Rounds the value to a whole number of units of the last digit and writes the digits with integer arithmetic.
+ * Values which are too large for that, or which lie too close to halfway between two outputs to round reliably that way, are written with sprintf.
+ * 
  * \warning only works with precision up to 9 and input up to 10^14
  * 
  * \param precision The number of (non-zero) digits after the decimal dot
@@ -123,6 +109,51 @@ struct MMtoStream
  */
 static inline void writeDoubleToStream(const unsigned int precision, const double coord, std::ostream& ss)
 {
+    constexpr double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    if (precision < sizeof(powers_of_ten) / sizeof(powers_of_ten[0]))
+    {
+        const double scaled = std::fabs(coord) * powers_of_ten[precision];
+        if (scaled < 1e15) // also false for NaN
+        {
+            const double whole_units = std::floor(scaled);
+            const double remainder = scaled - whole_units;
+            const double rounding_margin = scaled * 4.5e-16; // about two units in the last place of scaled
+            if (std::fabs(remainder - 0.5) > rounding_margin)
+            {
+                uint64_t units = static_cast<uint64_t>(whole_units) + ((remainder > 0.5) ? 1 : 0);
+                constexpr size_t buffer_size = 32;
+                char buffer[buffer_size];
+                char* const end = buffer + buffer_size;
+                char* start = end; // the digits are written from back to front
+                unsigned int decimal_count = precision;
+                while (decimal_count > 0 && units % 10 == 0)
+                { // strip trailing zeros
+                    units /= 10;
+                    decimal_count--;
+                }
+                for (unsigned int decimal = 0; decimal < decimal_count; decimal++)
+                {
+                    *--start = '0' + units % 10;
+                    units /= 10;
+                }
+                if (decimal_count > 0)
+                {
+                    *--start = '.';
+                }
+                do
+                {
+                    *--start = '0' + units % 10;
+                    units /= 10;
+                } while (units != 0);
+                if (std::signbit(coord))
+                {
+                    *--start = '-';
+                }
+                ss.write(start, end - start);
+                return;
+            }
+        }
+    }
     char format[5] = "%.xF"; // write a float with [x] digits after the dot
     format[2] = '0' + precision; // set [x]
     constexpr size_t buffer_size = 400;
@@ -1,227 +1,303 @@
 /** Copyright (C) 2016 Ultimaker - Released under terms of the AGPLv3 License */
 #include "wallOverlap.h"
 
-#include <cmath> // isfinite
-#include <sstream>
+#include <algorithm> // sort, unique, lower_bound
+#include <cmath> // abs
 
-#include "utils/AABB.h" // for debug output svg html
-#include "utils/SVG.h"
-
-namespace cura 
+namespace cura
 {
 
-WallOverlapComputation::WallOverlapComputation(Polygons& polygons, int line_width)
-: overlap_linker(polygons, line_width)
-, line_width(line_width)
-{ 
+namespace
+{
 
+/*!
+ * The key of a cell of the uniform grid used to find the segments near each other.
+ * Keys of the cells in one column of the grid are consecutive.
+ */
+uint64_t cellKey(int64_t cell_x, int64_t cell_y)
+{
+    return (uint64_t(uint32_t(cell_x + 0x80000000LL)) << 32) | uint32_t(cell_y + 0x80000000LL);
 }
 
-
-float WallOverlapComputation::getFlow(const Point& from, const Point& to)
+int64_t toCellCoord(coord_t coord, coord_t cell_size)
 {
-    using Point2LinkIt = PolygonProximityLinker::Point2Link::iterator;
+    return (coord >= 0)? coord / cell_size : -((-coord - 1) / cell_size) - 1;
+}
 
-    if (!overlap_linker.isLinked(from))
-    { // [from] is not linked
-        return 1;
+/*!
+ * Integrate the overlap width alongside a part of a line segment,
+ * where the two lines don't cross each other.
+ *
+ * \param length The length of the part of the line segment
+ * \param dist_start The distance to the other line segment at the start of the part
+ * \param dist_end The distance to the other line segment at the end of the part
+ * \param line_width The line width of both lines
+ * \return The overlap area
+ */
+double integrateOverlapWidth(double length, double dist_start, double dist_end, double line_width)
+{
+    const double width_start = line_width - dist_start;
+    const double width_end = line_width - dist_end;
+    if (width_start <= 0 && width_end <= 0)
+    {
+        return 0;
     }
-    const std::pair<Point2LinkIt, Point2LinkIt> to_links = overlap_linker.getLinks(to);
-    if (to_links.first == to_links.second)
-    { // [to] is not linked
-        return 1;
+    if (width_start >= 0 && width_end >= 0)
+    {
+        return length * (width_start + width_end) / 2;
     }
+    // the lines diverge to beyond the line width halfway: only a triangle overlaps
+    const double width = std::max(width_start, width_end);
+    const double overlap_length = length * width / (width_start > 0? width_start - width_end : width_end - width_start);
+    return overlap_length * width / 2;
+}
 
-    int64_t overlap_area = 0;
-    // note that we don't need to loop over all from_links, because they are handled in the previous getFlow(.) call (or in the very last)
-    for (Point2LinkIt to_link_it = to_links.first; to_link_it != to_links.second; ++to_link_it)
-    {
-        const ProximityPointLink& to_link = to_link_it->second;
-        ListPolyIt to_it = to_link.a;
-        ListPolyIt to_other_it = to_link.b;
-        if (to_link.a.p() != to)
-        {
-            assert(to_link.b.p() == to && "Either part of the link should be the point in the link!");
-            std::swap(to_it, to_other_it);
-        }
-        ListPolyIt from_it = to_it.prev();
+}//namespace
 
-        if (from_it.p() != from)
+WallOverlapComputation::WallOverlapComputation(const Polygons& polygons, int line_width)
+: line_width(line_width)
+, last_segment_idx(0)
+{
+    for (ConstPolygonRef poly : polygons)
+    {
+        if (poly.size() < 2)
         {
-            logWarning("Polygon has multiple verts at the same place: (%lli, %lli); PolygonProximityLinker fails in such a case!\n", from.X, from.Y);
+            continue;
         }
-
-        ListPolyIt to_other_next_it = to_other_it.next(); // move towards [from]; the lines on the other side move in the other direction
-        //           to  from
-        //   o<--o<--T<--F
-        //   |       :   :
-        //   v       :   :
-        //   o-->o-->o-->o
-        //           ,   ,
-        //           ;   to_other_next
-        //           to other
-
-        bool are_in_same_general_direction = dot(from - to, to_other_it.p() - to_other_next_it.p()) > 0;
-        // handle multiple points  linked to [to]
-        //   o<<<T<<<F
-        //     / |
-        //    /  |
-        //   o>>>o>>>o
-        //   ,   ,
-        //   ;   to other next
-        //   to other
-        if (!are_in_same_general_direction)
+        const unsigned int first_segment_idx = segments.size();
+        for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
         {
-            overlap_area += handlePotentialOverlap(to_it, to_it, to_link, to_other_next_it, to_other_it);
+            const unsigned int next_point_idx = (point_idx + 1 < poly.size())? point_idx + 1 : 0;
+            segments.emplace_back(poly[point_idx], poly[next_point_idx]);
+            next_segment_idx.push_back(first_segment_idx + next_point_idx);
         }
+    }
+    if (segments.empty())
+    {
+        return;
+    }
 
-        // handle multiple points  linked to [to_other]
-        //   o<<<T<<<F
-        //       |  /
-        //       | /
-        //   o>>>o>>>o
-        bool all_are_in_same_general_direction = are_in_same_general_direction && dot(from - to, to_other_it.prev().p() - to_other_it.p()) > 0;
-        if (!all_are_in_same_general_direction)
+    for (const std::pair<unsigned int, unsigned int>& pair : findCandidatePairs())
+    {
+        const int64_t area = getApproxOverlapArea(pair.first, pair.second);
+        if (area > 0)
         {
-            overlap_area += handlePotentialOverlap(from_it, to_it, to_link, to_other_it, to_other_it);
+            links.push_back(SegmentLink{pair.first, pair.second, area});
+            links.push_back(SegmentLink{pair.second, pair.first, area});
         }
+    }
+    if (links.empty())
+    { // the common case: no walls are close to each other, so all flows are normal
+        segments.clear();
+        next_segment_idx.clear();
+        return;
+    }
+    std::sort(links.begin(), links.end());
 
-        // handle normal case where the segment from-to overlaps with another segment
-        //   o<<<T<<<F
-        //       |   |
-        //       |   |
-        //   o>>>o>>>o
-        //       ,   ,
-        //       ;   to other next
-        //       to other
-        if (!are_in_same_general_direction)
+    segment_links_start.resize(segments.size() + 1);
+    unsigned int link_idx = 0;
+    for (unsigned int segment_idx = 0; segment_idx <= segments.size(); segment_idx++)
+    {
+        while (link_idx < links.size() && links[link_idx].segment_idx < segment_idx)
         {
-            overlap_area += handlePotentialOverlap(from_it, to_it, to_link, to_other_next_it, to_other_it);
+            link_idx++;
         }
+        segment_links_start[segment_idx] = link_idx;
     }
 
-    int64_t normal_area = vSize(from - to) * line_width;
-    float ratio = float(normal_area - overlap_area) / normal_area;
-    // clamp the ratio because overlap compensation might be faulty because
-    // WallOverlapComputation::getApproxOverlapArea only gives roughly accurate results
-    return std::min(1.0f, std::max(0.0f, ratio));
-}
-
-int64_t WallOverlapComputation::handlePotentialOverlap(const ListPolyIt from_it, const ListPolyIt to_it, const ProximityPointLink& to_link, const ListPolyIt from_other_it, const ListPolyIt to_other_it)
-{
-    if (from_it == to_other_it && from_it == from_other_it)
-    { // don't compute overlap with a line and itself
-        return 0;
-    }
-    const ProximityPointLink* from_link = overlap_linker.getLink(from_it, from_other_it);
-    if (!from_link)
+    segment_starts.reserve(segments.size());
+    for (unsigned int segment_idx = 0; segment_idx < segments.size(); segment_idx++)
     {
-        return 0;
+        segment_starts.emplace_back(segments[segment_idx].first, segment_idx);
     }
-    if (!getIsPassed(to_link, *from_link))
-    { // check whether the segment is already passed
-        setIsPassed(to_link, *from_link);
-        return 0;
-    }
-    return getApproxOverlapArea(from_it.p(), to_it.p(), to_link.dist, to_other_it.p(), from_other_it.p(), from_link->dist);
+    std::sort(segment_starts.begin(), segment_starts.end(),
+        [](const std::pair<Point, unsigned int>& a, const std::pair<Point, unsigned int>& b)
+        {
+            return a.first.X < b.first.X || (a.first.X == b.first.X && (a.first.Y < b.first.Y || (a.first.Y == b.first.Y && a.second < b.second)));
+        });
+
+    passed.resize(segments.size(), false);
 }
 
-int64_t WallOverlapComputation::getApproxOverlapArea(const Point from, const Point to, const int64_t to_dist, const Point other_from, const Point other_to, const int64_t from_dist)
+std::vector<std::pair<unsigned int, unsigned int>> WallOverlapComputation::findCandidatePairs() const
 {
-    const int64_t overlap_width_2 = line_width * 2 - from_dist - to_dist; //Twice the width of the overlap area, perpendicular to the lines.
-
-    // check whether the line segment overlaps with the point if one of the line segments is just a point
-    if (from == to)
+    // Each segment is registered in each cell in which it has a sample point, with the samples at most half a cell apart.
+    // Two segments closer than the line width to each other then have samples less than one cell apart,
+    // so they are registered in the same or in neighboring cells.
+    const coord_t cell_size = line_width * 2;
+    std::vector<std::pair<uint64_t, unsigned int>> cell_segments; // the cell key and the segment index for each registration
+    cell_segments.reserve(segments.size() * 2);
+    for (unsigned int segment_idx = 0; segment_idx < segments.size(); segment_idx++)
     {
-        if (LinearAlg2D::pointIsProjectedBeyondLine(from, other_from, other_to) != 0)
+        const Point from = segments[segment_idx].first;
+        const Point vec = segments[segment_idx].second - from;
+        const int64_t sample_count = vSize(vec) / line_width + 1;
+        uint64_t last_key = 0;
+        for (int64_t sample_idx = 0; sample_idx <= sample_count; sample_idx++)
         {
-            return 0;
+            const Point sample = from + Point(vec.X * sample_idx / sample_count, vec.Y * sample_idx / sample_count);
+            const uint64_t key = cellKey(toCellCoord(sample.X, cell_size), toCellCoord(sample.Y, cell_size));
+            if (sample_idx == 0 || key != last_key)
+            {
+                cell_segments.emplace_back(key, segment_idx);
+                last_key = key;
+            }
         }
-        const int64_t overlap_length_2 = vSize(other_to - other_from); //Twice the length of the overlap area, alongside the lines.
-        return overlap_length_2 * overlap_width_2 / 4; //Area = width * height.
     }
-    if (other_from == other_to)
+    std::sort(cell_segments.begin(), cell_segments.end());
+    cell_segments.erase(std::unique(cell_segments.begin(), cell_segments.end()), cell_segments.end());
+
+    const auto key_less = [](const std::pair<uint64_t, unsigned int>& elem, uint64_t key)
+    {
+        return elem.first < key;
+    };
+    std::vector<std::pair<unsigned int, unsigned int>> pairs;
+    const auto add_pairs = [this, &pairs, &cell_segments](unsigned int segment_idx, unsigned int begin, unsigned int end)
     {
-        if (LinearAlg2D::pointIsProjectedBeyondLine(other_from, from, to) != 0)
+        for (unsigned int elem_idx = begin; elem_idx < end; elem_idx++)
         {
-            return 0;
+            const unsigned int other_segment_idx = cell_segments[elem_idx].second;
+            if (other_segment_idx != segment_idx && canOverlap(segment_idx, other_segment_idx))
+            {
+                pairs.emplace_back(std::min(segment_idx, other_segment_idx), std::max(segment_idx, other_segment_idx));
+            }
         }
-        const int64_t overlap_length_2 = vSize(from - to); //Twice the length of the overlap area, alongside the lines.
-        return overlap_length_2 * overlap_width_2 / 4; //Area = width * height.
+    };
+    for (unsigned int elem_idx = 0; elem_idx < cell_segments.size(); elem_idx++)
+    {
+        const uint64_t key = cell_segments[elem_idx].first;
+        const unsigned int segment_idx = cell_segments[elem_idx].second;
+        // visit half of the neighboring cells, the other half visits this cell
+        // the rest of this cell and the next cell in the same column are consecutive
+        const unsigned int column_end = std::lower_bound(cell_segments.begin() + elem_idx, cell_segments.end(), key + 2, key_less) - cell_segments.begin();
+        add_pairs(segment_idx, elem_idx + 1, column_end);
+        // the three cells in the next column next to this cell are consecutive
+        const uint64_t next_column_key = key + (uint64_t(1) << 32);
+        const unsigned int next_column_begin = std::lower_bound(cell_segments.begin() + column_end, cell_segments.end(), next_column_key - 1, key_less) - cell_segments.begin();
+        const unsigned int next_column_end = std::lower_bound(cell_segments.begin() + next_column_begin, cell_segments.end(), next_column_key + 2, key_less) - cell_segments.begin();
+        add_pairs(segment_idx, next_column_begin, next_column_end);
     }
+    // most segments only share cells with the segments connected to them, so usually only few pairs remain
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    return pairs;
+}
 
-    short from_rel = LinearAlg2D::pointIsProjectedBeyondLine(from, other_from, other_to);
-    short to_rel = LinearAlg2D::pointIsProjectedBeyondLine(to, other_from, other_to);
-    short other_from_rel = LinearAlg2D::pointIsProjectedBeyondLine(other_from, from, to);
-    short other_to_rel = LinearAlg2D::pointIsProjectedBeyondLine(other_to, from, to);
-    if (from_rel != 0 && to_rel == from_rel && other_from_rel != 0 && other_to_rel == other_from_rel)
+bool WallOverlapComputation::canOverlap(unsigned int segment_idx, unsigned int other_segment_idx) const
+{
+    if (next_segment_idx[segment_idx] == other_segment_idx || next_segment_idx[other_segment_idx] == segment_idx)
+    { // connected segments only overlap at the corner, which isn't compensated for
+        return false;
+    }
+    const Point dir = segments[segment_idx].second - segments[segment_idx].first;
+    const Point other_dir = segments[other_segment_idx].second - segments[other_segment_idx].first;
+    return dot(dir, other_dir) < 0; // walls overlapping each other run in opposite directions
+}
+
+int64_t WallOverlapComputation::getApproxOverlapArea(unsigned int segment_idx, unsigned int other_segment_idx) const
+{
+    const Point from = segments[segment_idx].first;
+    const Point to = segments[segment_idx].second;
+    const Point other_from = segments[other_segment_idx].first;
+    const Point other_to = segments[other_segment_idx].second;
+    const double length = vSize(to - from);
+    const double other_length = vSize(other_to - other_from);
+    if (length == 0 || other_length == 0)
     {
-        // both segments project fully beyond or before each other
-        // for example:             or:
-        // O<------O   .            O------>O
-        //         :   :                     \_
-        //         '   O------->O             O------>O
         return 0;
     }
 
-    if (from_rel != 0 && from_rel == other_from_rel && to_rel == 0 && other_to_rel == 0)
+    // the part of the segment alongside the other segment
+    const double other_from_proj = dot(other_from - from, to - from) / length;
+    const double other_to_proj = dot(other_to - from, to - from) / length;
+    const double start = std::max(0.0, std::min(other_from_proj, other_to_proj));
+    const double end = std::min(length, std::max(other_from_proj, other_to_proj));
+    if (end <= start)
     {
-        // only ends of line segments overlap
-        //
-        //       to_proj
-        //         ^^^^^
-        //         O<--+----O
-        //         :   :
-        //   O-----+-->O
-        //         ,,,,,
-        //         other_to_proj
-        const Point other_vec = other_from - other_to;
-        const int64_t to_proj = dot(to - other_to, other_vec) / vSize(other_vec);
+        return 0;
+    }
 
-        const Point vec = from - to;
-        const int64_t other_to_proj = dot(other_to - to, vec) / vSize(vec);
+    // the signed distances to the other segment at the start and end of that part
+    const Point other_vec = other_to - other_from;
+    const Point vec = to - from;
+    const double from_dist = (double(other_vec.X) * (from.Y - other_from.Y) - double(other_vec.Y) * (from.X - other_from.X)) / other_length;
+    const double dist_change = (double(other_vec.X) * vec.Y - double(other_vec.Y) * vec.X) / other_length / length; // per unit of length along the segment
+    const double start_dist = from_dist + dist_change * start;
+    const double end_dist = from_dist + dist_change * end;
 
-        const int64_t overlap_length_2 = to_proj + other_to_proj; //Twice the length of the overlap area, alongside the lines.
-        return overlap_length_2 * overlap_width_2 / 4; //Area = width * height.
+    double area;
+    if ((start_dist < 0) != (end_dist < 0) && start_dist != 0 && end_dist != 0)
+    { // the lines cross each other
+        const double crossing = (end - start) * start_dist / (start_dist - end_dist);
+        area = integrateOverlapWidth(crossing, std::abs(start_dist), 0, line_width)
+            + integrateOverlapWidth(end - start - crossing, 0, std::abs(end_dist), line_width);
     }
-    if (to_rel != 0 && to_rel == other_to_rel && from_rel == 0 && other_from_rel == 0)
+    else
     {
-        // only beginnings of line segments overlap
-        //
-        //           from_proj
-        //           ^^^^^
-        //      O<---+---O
-        //           :   :
-        //           O---+---->O
-        //           ,,,,,
-        // other_from_proj
-        const Point other_vec = other_to - other_from;
-        const int64_t from_proj = dot(from - other_from, other_vec) / vSize(other_vec);
-
-        const Point vec = to - from;
-        const int64_t other_from_proj = dot(other_from - from, vec) / vSize(vec);
-
-        const int64_t overlap_length_2 = from_proj + other_from_proj; //Twice the length of the overlap area, alongside the lines.
-        return overlap_length_2 * overlap_width_2 / 4; //Area = width * height.
+        area = integrateOverlapWidth(end - start, std::abs(start_dist), std::abs(end_dist), line_width);
     }
-
-    //More complex case.
-    const Point from_middle = other_to + from; // don't divide by two just yet
-    const Point to_middle = other_from + to; // don't divide by two just yet
-
-    const int64_t overlap_length_2 = vSize(from_middle - to_middle); //(An approximation of) twice the length of the overlap area, alongside the lines.
-    return overlap_length_2 * overlap_width_2 / 4; //Area = width * height.
+    return area;
 }
 
-bool WallOverlapComputation::getIsPassed(const ProximityPointLink& link_a, const ProximityPointLink& link_b)
+bool WallOverlapComputation::findSegment(const Point& from, const Point& to, unsigned int& segment_idx) const
 {
-    return passed_links.find(SymmetricPair<ProximityPointLink>(link_a, link_b)) != passed_links.end();
+    auto it = std::lower_bound(segment_starts.begin(), segment_starts.end(), from,
+        [](const std::pair<Point, unsigned int>& elem, const Point& p)
+        {
+            return elem.first.X < p.X || (elem.first.X == p.X && elem.first.Y < p.Y);
+        });
+    bool found = false;
+    for (; it != segment_starts.end() && it->first == from; ++it)
+    {
+        if (segments[it->second].second == to)
+        {
+            segment_idx = it->second;
+            found = true;
+            if (!passed[segment_idx])
+            { // polygons can have the same segment twice, so prefer the one not laid down yet
+                break;
+            }
+        }
+    }
+    return found;
 }
 
-void WallOverlapComputation::setIsPassed(const ProximityPointLink& link_a, const ProximityPointLink& link_b)
+float WallOverlapComputation::getFlow(const Point& from, const Point& to)
 {
-    passed_links.emplace(link_a, link_b);
-}
+    if (segments.empty())
+    {
+        return 1;
+    }
+    unsigned int segment_idx = next_segment_idx[last_segment_idx];
+    if (segments[segment_idx].first != from || segments[segment_idx].second != to || passed[segment_idx])
+    { // not continuing along the polygon of the last segment
+        if (!findSegment(from, to, segment_idx))
+        {
+            return 1;
+        }
+    }
+    last_segment_idx = segment_idx;
 
+    int64_t overlap_area = 0;
+    for (unsigned int link_idx = segment_links_start[segment_idx]; link_idx < segment_links_start[segment_idx + 1]; link_idx++)
+    {
+        const SegmentLink& link = links[link_idx];
+        if (passed[link.other_segment_idx])
+        { // the overlap area has already been laid down with the other segment
+            overlap_area += link.area;
+        }
+    }
+    passed[segment_idx] = true;
+    if (overlap_area == 0)
+    {
+        return 1;
+    }
+
+    int64_t normal_area = vSize(from - to) * line_width;
+    float ratio = float(normal_area - overlap_area) / normal_area;
+    // clamp the ratio because overlap compensation might be faulty because
+    // WallOverlapComputation::getApproxOverlapArea only gives roughly accurate results
+    return std::min(1.0f, std::max(0.0f, ratio));
+}
 
-}//namespace cura 
+}//namespace cura
@@ -3,59 +3,66 @@
 #define WALL_OVERLAP_H
 
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
-#include <list>
-
-#include <functional> // hash function object
+#include <utility> // pair
 
 #include "utils/intpoint.h"
 #include "utils/polygon.h"
-#include "utils/linearAlg2D.h"
-#include "utils/SymmetricPair.h"
-
-#include "utils/ProximityPointLink.h"
-#include "utils/PolygonProximityLinker.h"
 
-namespace cura 
+namespace cura
 {
 
 /*!
  * Class for computing and compensating for overlapping (outer) wall lines.
- * The overlapping area is approximated with connected trapzoids.
- * All places where the wall is closer than the nozzle width to another piece of wall are recorded.
- * The area of a trapezoid is then the length between two such locations multiplied by the average overlap at the two locations.
- * 
- * The amount of overlap between two locations is recorded in a link, so that we can look up the overlap at a given point in the polygon.
- * A link always occurs between a point already on a polygon and either another point of a polygon or a point on a line segment of a polygon.
- * In the latter case we insert the point into the polygon so that we can later look up by how much to reduce the extrusion at the corresponding line segment.
- * 
- * At the end of a sequence of trapezoids the overlap area generally ends with a residual triangle.
- * Therefore points are introduced on the line segments involved and a link is created with overlap zero.
- * 
- * \see PolygonProximityLinker
- * 
- * Each point on the polygons then maps to a link, so that we can easily look up which links corresponds 
- * to the current line segment being produced when producing gcode.
- * 
+ *
+ * All pairs of line segments of the walls which are closer than the line width to each other are recorded in a link,
+ * together with the approximate area by which the two lines overlap.
+ * The overlap area between two line segments is computed along the part of the one segment which lies alongside the other,
+ * where the width of the overlap is the line width minus the distance between the two segments.
+ *
  * When producing gcode, the first line crossing the overlap area is laid down normally and the second line is reduced by the overlap amount.
- * For this reason the function WallOverlapComputation::getFlow changes the internal state of the PolygonProximityLinker.
- * 
- * The main functionality of this class is performed by the constructor, by calling the constructor of PolygonProximityLinker.
+ * For this reason the function WallOverlapComputation::getFlow changes the internal state of the WallOverlapComputation.
+ *
+ * All data is stored in flat arrays indexed by segment:
+ * candidate pairs of segments are found by sorting the segments on the cells of a uniform grid they pass through,
+ * and the links of each segment are stored contiguously, so that computing the flow of a segment only visits its own links.
+ *
+ * The main functionality of this class is performed by the constructor.
  * The adjustment during gcode generation is made with the help of WallOverlapComputation::getFlow
  */
 class WallOverlapComputation
 {
-    PolygonProximityLinker overlap_linker;
+    /*!
+     * A link from one segment to another segment it overlaps with
+     */
+    struct SegmentLink
+    {
+        unsigned int segment_idx; //!< The segment which overlaps with the other segment
+        unsigned int other_segment_idx; //!< The segment overlapped by \ref SegmentLink::segment_idx
+        int64_t area; //!< The approximate overlap area between the two segments
+
+        bool operator<(const SegmentLink& other) const
+        {
+            return segment_idx < other.segment_idx;
+        }
+    };
+
     int64_t line_width;
 
-    std::unordered_set<SymmetricPair<ProximityPointLink>> passed_links;
+    std::vector<std::pair<Point, Point>> segments; //!< The start and end point of each line segment of all polygons
+    std::vector<unsigned int> next_segment_idx; //!< For each segment the next segment in the same polygon
+
+    std::vector<SegmentLink> links; //!< The links of all segments, sorted on WallOverlapComputation::SegmentLink::segment_idx; each overlap occurs twice, once for each segment
+    std::vector<unsigned int> segment_links_start; //!< For each segment the index of its first link in WallOverlapComputation::links, followed by the total number of links
+
+    std::vector<std::pair<Point, unsigned int>> segment_starts; //!< The start point of each segment together with the segment index, sorted on the point
+    std::vector<bool> passed; //!< For each segment whether it has already been laid down
+    unsigned int last_segment_idx; //!< The segment of which the flow was computed last, from which the next segment is found without a search
 public:
     /*!
      * Compute the flow for a given line segment in the wall.
-     * 
+     *
      * \warning the first time this function is called it returns a different thing than the second, because the second time it thinks it already passed this segment once.
-     * 
+     *
      * \param from The beginning of the line segment
      * \param to The ending of the line segment
      * \return a value between zero and one representing the reduced flow of the line segment
@@ -66,36 +73,34 @@ public:
      * Computes the neccesary priliminaries in order to efficiently compute the flow when generatign gcode paths.
      * \param polygons The wall polygons for which to compute the overlaps
      */
-    WallOverlapComputation(Polygons& polygons, int lineWidth);
+    WallOverlapComputation(const Polygons& polygons, int lineWidth);
 
 private:
     /*!
-     * Check whether \p from_it and \p from_other_it are connected and if so,
-     * return the overlap area between those and the link \p to_link
-     * 
-     * This presupposes that \p to_link and the link from \p from_it to \p from_other_it forms a single overlap quadrilateral
-     * 
-     * from_other         to_other
-     *          o<--------o
-     *          ?         :
-     *          ?         :
-     *          ?         :
-     *          o-------->o
-     *       from         to
-     * 
-     * \param from_it The first point possibly invovled in the second link
-     * \param to_it The first point of \p to_link connected to \p from_it
-     * \param to_link The first link involved in the overlap: from \p from_it to \p to_it
-     * \param from_other_it The second point possibly involved in the second link
-     * \param to_other_it The second point of \p to_link connected to \p from_other_it
-     * \return The overlap area between the two links, or zero if there was no such link
+     * Find all pairs of segments which lie close enough to each other to possibly overlap
+     * and which pass WallOverlapComputation::canOverlap.
+     *
+     * \return The pairs of segment indices, with the lowest index first; each pair occurs once
      */
-    int64_t handlePotentialOverlap(const ListPolyIt from_it, const ListPolyIt to_it, const ProximityPointLink& to_link, const ListPolyIt from_other_it, const ListPolyIt to_other_it);
+    std::vector<std::pair<unsigned int, unsigned int>> findCandidatePairs() const;
 
     /*!
-     * Compute the approximate overlap area between two line segments
-     * or between a line segment and a point when one of the line segments has the same start as end point.
-     * 
+     * Cheap check whether two segments could overlap in a way which is compensated for, regardless of their distance.
+     *
+     * Connected segments and segments running in the same general direction don't count as overlapping.
+     *
+     * \param segment_idx The one segment
+     * \param other_segment_idx The other segment
+     * \return Whether the segments could overlap
+     */
+    bool canOverlap(unsigned int segment_idx, unsigned int other_segment_idx) const;
+
+    /*!
+     * Compute the approximate overlap area between two line segments.
+     *
+     * The part of \p segment_idx alongside \p other_segment_idx is the part between the projections of the end points of the other segment.
+     * Along that part the overlap width is the line width minus the distance to the other segment.
+     *
      *   other_to         other_from
      *          o<--------o
      *          :         :
@@ -107,36 +112,22 @@ private:
      *          :         :
      *          o-------->o
      *       from         to
-     * 
-     * \param from The starting point of the one line segment
-     * \param to the end point of the one line segment
-     * \param to_dist The distance between \p to and \p to_other
-     * \param other_from The starting point of the other line segment (across the overlap of \p to)
-     * \param other_to The end point of the other line segment (across the overlap of \p from)
-     * \param from_dist The distance between \p from and \p from_other
+     *
+     * \param segment_idx The one segment
+     * \param other_segment_idx The other segment
+     * \return The overlap area
      */
-    int64_t getApproxOverlapArea(const Point from, const Point to, const int64_t to_dist, const Point other_from, const Point other_to, const int64_t from_dist);
+    int64_t getApproxOverlapArea(unsigned int segment_idx, unsigned int other_segment_idx) const;
 
     /*!
-     * Check whether an overlap segment between two consecutive links is already passed
-     * 
-     * \note \p link_a and \p link_b are assumed to be consecutive
-     * 
-     * \param link_a the one link of the overlap area
-     * \param link_b the other link of the overlap area
-     * \return whether the link has already been passed once
-     */
-    bool getIsPassed(const ProximityPointLink& link_a, const ProximityPointLink& link_b);
-
-    /*!
-     * Mark an overlap area between two consecutive links as being passed once already.
-     * 
-     * \note \p link_a and \p link_b are assumed to be consecutive
-     * 
-     * \param link_a the one link of the overlap area
-     * \param link_b the other link of the overlap area
+     * Find the segment going from \p from to \p to
+     *
+     * \param from The beginning of the line segment
+     * \param to The ending of the line segment
+     * \param[out] segment_idx The index of the segment found
+     * \return Whether there is such a segment
      */
-    void setIsPassed(const ProximityPointLink& link_a, const ProximityPointLink& link_b);
+    bool findSegment(const Point& from, const Point& to, unsigned int& segment_idx) const;
 };
 
 
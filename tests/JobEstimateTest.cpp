@@ -0,0 +1,60 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "JobEstimateTest.h"
+
+#include "../src/FffGcodeWriter.h"
+#include "../src/FffPolygonGenerator.h"
+#include "../src/JobEstimate.h"
+#include "../src/MeshGroup.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(JobEstimateTest);
+
+void JobEstimateTest::setUp()
+{
+    //Do nothing.
+}
+
+void JobEstimateTest::tearDown()
+{
+    //Do nothing.
+}
+
+void JobEstimateTest::layerGeometryMemoryBudgetTest()
+{
+    layerGeometryMemoryBudgetAssert(false);
+}
+
+void JobEstimateTest::flattenedLayerGeometryMemoryBudgetTest()
+{
+    layerGeometryMemoryBudgetAssert(true);
+}
+
+void JobEstimateTest::layerGeometryMemoryBudgetAssert(bool flatten_first)
+{
+    SettingsBase processor; // stands in for the FffProcessor, the parent of the mesh groups
+    MeshGroup meshgroup(&processor);
+    if (flatten_first)
+    {
+        meshgroup.flattenSettings();
+    }
+    JobEstimate::setLayerGeometryMemoryBudget(meshgroup, 300);
+    if (!flatten_first)
+    {
+        meshgroup.flattenSettings();
+    }
+
+    FffGcodeWriter gcode_writer(&processor);
+    gcode_writer.setParent(&meshgroup); // like FffProcessor does while a mesh group is sliced
+    CPPUNIT_ASSERT_MESSAGE("The gcode writer must find the memory budget.", gcode_writer.hasSetting("layer_geometry_memory_budget"));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The gcode writer must find the memory budget given.", 300, gcode_writer.getSettingAsCount("layer_geometry_memory_budget"));
+
+    FffPolygonGenerator polygon_generator(&processor); // spills the layers as their areas are generated
+    polygon_generator.setParent(&meshgroup);
+    CPPUNIT_ASSERT_MESSAGE("The polygon generator must find the memory budget.", polygon_generator.hasSetting("layer_geometry_memory_budget"));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The polygon generator must find the memory budget given.", 300, polygon_generator.getSettingAsCount("layer_geometry_memory_budget"));
+}
+
+}
@@ -0,0 +1,52 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef JOB_ESTIMATE_TEST_H
+#define JOB_ESTIMATE_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+namespace cura
+{
+
+class JobEstimateTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(JobEstimateTest);
+    CPPUNIT_TEST(layerGeometryMemoryBudgetTest);
+    CPPUNIT_TEST(flattenedLayerGeometryMemoryBudgetTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether the memory budget a mesh group is admitted with reaches the gcode writer slicing it.
+     */
+    void layerGeometryMemoryBudgetTest();
+
+    /*!
+     * \brief Test whether the memory budget reaches the gcode writer when it's given after the settings of the mesh group are flattened.
+     */
+    void flattenedLayerGeometryMemoryBudgetTest();
+
+private:
+    /*!
+     * \brief Performs the actual assertion: give a mesh group a budget, and check which budget the gcode writer finds.
+     *
+     * \param flatten_first Whether the settings of the mesh group are flattened before it gets the budget
+     */
+    void layerGeometryMemoryBudgetAssert(bool flatten_first);
+};
+
+}
+
+#endif //JOB_ESTIMATE_TEST_H
@@ -0,0 +1,262 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "MeshInstancesTest.h"
+
+#include "../src/MeshGroup.h"
+#include "../src/MeshInstances.h"
+#include "../src/slicer.h"
+#include "../src/sliceDataStorage.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(MeshInstancesTest);
+
+void MeshInstancesTest::setUp()
+{
+    settings.setSetting("infill_mesh", "false");
+    settings.setSetting("cutting_mesh", "false");
+    settings.setSetting("support_mesh", "false");
+    settings.setSetting("anti_overhang_mesh", "false");
+    settings.setSetting("mold_enabled", "false");
+    settings.setSetting("multiple_mesh_overlap", "0");
+    settings.setSetting("xy_offset", "0");
+    settings.setSetting("magic_mesh_surface_mode", "normal");
+    settings.setSetting("wall_line_count", "2");
+    settings.setSetting("mesh_position_x", "0");
+}
+
+void MeshInstancesTest::tearDown()
+{
+    //Do nothing.
+}
+
+void MeshInstancesTest::addCube(MeshGroup& meshgroup, Point3 min, int32_t size)
+{
+    meshgroup.meshes.emplace_back(&meshgroup);
+    Mesh& mesh = meshgroup.meshes.back();
+    std::vector<Point3> corners;
+    for (int corner_idx = 0; corner_idx < 8; corner_idx++)
+    {
+        corners.push_back(min + Point3((corner_idx & 1) * size, ((corner_idx >> 1) & 1) * size, ((corner_idx >> 2) & 1) * size));
+    }
+    // the corners of each face in counter-clockwise order seen from the outside, by index (x + 2y + 4z)
+    const int faces[12][3] = {{0, 2, 3}, {0, 3, 1}, {4, 5, 7}, {4, 7, 6}, {0, 1, 5}, {0, 5, 4}, {2, 6, 7}, {2, 7, 3}, {0, 4, 6}, {0, 6, 2}, {1, 3, 7}, {1, 7, 5}};
+    for (const int* face : faces)
+    {
+        mesh.addFace(corners[face[0]], corners[face[1]], corners[face[2]]);
+    }
+    mesh.finish();
+}
+
+void MeshInstancesTest::addPyramid(MeshGroup& meshgroup, Point3 min, int32_t size)
+{
+    meshgroup.meshes.emplace_back(&meshgroup);
+    Mesh& mesh = meshgroup.meshes.back();
+    Point3 corners[5] = {min, min + Point3(size, 0, 0), min + Point3(size, size, 0), min + Point3(0, size, 0), min + Point3(size / 2, size / 2, size)};
+    // the corners of each face in counter-clockwise order seen from the outside
+    const int faces[6][3] = {{0, 3, 2}, {0, 2, 1}, {0, 1, 4}, {1, 2, 4}, {2, 3, 4}, {3, 0, 4}};
+    for (const int* face : faces)
+    {
+        mesh.addFace(corners[face[0]], corners[face[1]], corners[face[2]]);
+    }
+    mesh.finish();
+}
+
+SliceLayerPart MeshInstancesTest::generatePart(const PolygonsPart& outline)
+{
+    SliceLayerPart part;
+    part.outline = outline;
+    part.boundaryBox.calculate(outline);
+    part.insets.push_back(outline.offset(-200));
+    part.insets.push_back(part.insets.back().offset(-400));
+    part.print_outline = CompactPolygons(part.insets.front().offset(200));
+    part.perimeter_gaps = part.insets.front().offset(-200).difference(part.insets.back().offset(200));
+    for (const PolygonsPart& skin_outline : part.insets.back().offset(-200).splitIntoParts())
+    {
+        part.skin_parts.emplace_back();
+        SkinPart& skin_part = part.skin_parts.back();
+        skin_part.outline = skin_outline;
+        skin_part.insets.push_back(skin_outline.offset(-200));
+        skin_part.perimeter_gaps = skin_outline.difference(skin_part.insets.back().offset(200));
+    }
+    part.infill_area = part.insets.back().offset(-400);
+    part.infill_area_own = part.infill_area.offset(-100);
+    part.infill_area_per_combine_per_density.emplace_back();
+    part.infill_area_per_combine_per_density.back().push_back(part.infill_area.offset(-100));
+    part.infill_area_per_combine_per_density.back().push_back(part.infill_area.offset(-300));
+    part.spaghetti_infill_volumes.emplace_back(part.infill_area, 1.0);
+    return part;
+}
+
+void MeshInstancesTest::assertSameParts(const SliceLayerPart& expected, const SliceLayerPart& actual)
+{
+    CPPUNIT_ASSERT_MESSAGE("The bounding box should be translated.", expected.boundaryBox.min == actual.boundaryBox.min && expected.boundaryBox.max == actual.boundaryBox.max);
+    CPPUNIT_ASSERT_MESSAGE("The outline should be translated.", expected.outline.isIdentical(actual.outline));
+    CPPUNIT_ASSERT_MESSAGE("The printed outline should be translated.", expected.print_outline.toPolygons().isIdentical(actual.print_outline.toPolygons()));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The number of walls should be the same.", expected.insets.size(), actual.insets.size());
+    for (unsigned int inset_idx = 0; inset_idx < expected.insets.size(); inset_idx++)
+    {
+        CPPUNIT_ASSERT_MESSAGE("The walls should be translated.", expected.insets[inset_idx].isIdentical(actual.insets[inset_idx]));
+    }
+    CPPUNIT_ASSERT_MESSAGE("The gaps between the walls should be translated.", expected.perimeter_gaps.isIdentical(actual.perimeter_gaps));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The number of skin parts should be the same.", expected.skin_parts.size(), actual.skin_parts.size());
+    for (unsigned int skin_part_idx = 0; skin_part_idx < expected.skin_parts.size(); skin_part_idx++)
+    {
+        const SkinPart& expected_skin_part = expected.skin_parts[skin_part_idx];
+        const SkinPart& actual_skin_part = actual.skin_parts[skin_part_idx];
+        CPPUNIT_ASSERT_MESSAGE("The skin should be translated.", expected_skin_part.outline.isIdentical(actual_skin_part.outline));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("The number of skin walls should be the same.", expected_skin_part.insets.size(), actual_skin_part.insets.size());
+        for (unsigned int inset_idx = 0; inset_idx < expected_skin_part.insets.size(); inset_idx++)
+        {
+            CPPUNIT_ASSERT_MESSAGE("The skin walls should be translated.", expected_skin_part.insets[inset_idx].isIdentical(actual_skin_part.insets[inset_idx]));
+        }
+        CPPUNIT_ASSERT_MESSAGE("The gaps between the skin walls should be translated.", expected_skin_part.perimeter_gaps.isIdentical(actual_skin_part.perimeter_gaps));
+    }
+    CPPUNIT_ASSERT_MESSAGE("The infill should be translated.", expected.infill_area.isIdentical(actual.infill_area));
+    CPPUNIT_ASSERT_MESSAGE("The own infill should be translated.", bool(expected.infill_area_own) == bool(actual.infill_area_own) && (!expected.infill_area_own || expected.infill_area_own->isIdentical(*actual.infill_area_own)));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The number of infill combinations should be the same.", expected.infill_area_per_combine_per_density.size(), actual.infill_area_per_combine_per_density.size());
+    for (unsigned int density_idx = 0; density_idx < expected.infill_area_per_combine_per_density.size(); density_idx++)
+    {
+        const std::vector<Polygons>& expected_per_combine = expected.infill_area_per_combine_per_density[density_idx];
+        const std::vector<Polygons>& actual_per_combine = actual.infill_area_per_combine_per_density[density_idx];
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("The number of combined infill layers should be the same.", expected_per_combine.size(), actual_per_combine.size());
+        for (unsigned int combine_idx = 0; combine_idx < expected_per_combine.size(); combine_idx++)
+        {
+            CPPUNIT_ASSERT_MESSAGE("The infill of each density should be translated.", expected_per_combine[combine_idx].isIdentical(actual_per_combine[combine_idx]));
+        }
+    }
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The number of spaghetti infill volumes should be the same.", expected.spaghetti_infill_volumes.size(), actual.spaghetti_infill_volumes.size());
+    for (unsigned int volume_idx = 0; volume_idx < expected.spaghetti_infill_volumes.size(); volume_idx++)
+    {
+        CPPUNIT_ASSERT_MESSAGE("The spaghetti infill areas should be translated.", expected.spaghetti_infill_volumes[volume_idx].first.isIdentical(actual.spaghetti_infill_volumes[volume_idx].first));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("The spaghetti infill volumes should stay the same.", expected.spaghetti_infill_volumes[volume_idx].second, actual.spaghetti_infill_volumes[volume_idx].second);
+    }
+}
+
+void MeshInstancesTest::translatedCopyTest()
+{
+    MeshGroup meshgroup(&settings);
+    addCube(meshgroup, Point3(0, 0, 0), 10000);
+    addCube(meshgroup, Point3(20000, 5000, 0), 10000);
+    addCube(meshgroup, Point3(-15001, -20000, 0), 10000);
+    meshgroup.meshes[1].setSetting("mesh_position_x", "20"); // the position has already been applied to the vertices
+
+    const MeshInstances instances = MeshInstances::find(meshgroup);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Both moved cubes should be copies.", 2u, instances.getCopyCount());
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The first cube isn't a copy.", -1, instances.getSourceMeshIdx(0));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The second cube is a copy of the first.", 0, instances.getSourceMeshIdx(1));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The third cube is a copy of the first.", 0, instances.getSourceMeshIdx(2));
+    CPPUNIT_ASSERT_MESSAGE("The offset of a copy is its translation from the first cube.", instances.getOffset(1) == Point(20000, 5000));
+    CPPUNIT_ASSERT_MESSAGE("The offset of a copy is its translation from the first cube.", instances.getOffset(2) == Point(-15001, -20000));
+}
+
+void MeshInstancesTest::otherTransformationTest()
+{
+    MeshGroup meshgroup(&settings);
+    addCube(meshgroup, Point3(0, 0, 0), 10000);
+    addCube(meshgroup, Point3(20000, 0, 1000), 10000); // moved up
+    addCube(meshgroup, Point3(40000, 0, 0), 10001); // scaled
+    addPyramid(meshgroup, Point3(60000, 0, 0), 10000);
+    addPyramid(meshgroup, Point3(80000, 0, 0), 10000);
+    meshgroup.meshes.back().vertices.back().p.x += 1; // the apex moved
+
+    const MeshInstances instances = MeshInstances::find(meshgroup);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Only horizontally translated meshes are copies.", 0u, instances.getCopyCount());
+}
+
+void MeshInstancesTest::otherSettingsTest()
+{
+    MeshGroup meshgroup(&settings);
+    for (int mesh_idx = 0; mesh_idx < 4; mesh_idx++)
+    {
+        addCube(meshgroup, Point3(mesh_idx * 20000, 0, 0), 10000);
+    }
+    meshgroup.meshes[1].setSetting("wall_line_count", "3");
+    meshgroup.meshes[2].setSetting("infill_mesh", "true");
+
+    const MeshInstances instances = MeshInstances::find(meshgroup);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A mesh with other settings isn't a copy.", -1, instances.getSourceMeshIdx(1));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("An infill mesh isn't a copy.", -1, instances.getSourceMeshIdx(2));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The mesh with the same settings is a copy.", 0, instances.getSourceMeshIdx(3));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Only the mesh with the same settings is a copy.", 1u, instances.getCopyCount());
+}
+
+void MeshInstancesTest::nearbyMeshTest()
+{
+    MeshGroup meshgroup(&settings);
+    addCube(meshgroup, Point3(0, 0, 0), 10000);
+    addCube(meshgroup, Point3(9000, 0, 0), 10000); // overlapping the first cube
+    addCube(meshgroup, Point3(30000, 0, 0), 10000); // close to the fourth cube, counting the overlap of the meshes
+    addCube(meshgroup, Point3(40500, 0, 0), 10000);
+    addCube(meshgroup, Point3(60000, 0, 0), 10000);
+    meshgroup.meshes[3].setSetting("multiple_mesh_overlap", "0.6"); // reaching the third cube
+    addCube(meshgroup, Point3(80000, 0, 0), 10000);
+
+    const MeshInstances instances = MeshInstances::find(meshgroup);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A mesh overlapping another mesh isn't a source of copies.", -1, instances.getSourceMeshIdx(0));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A mesh overlapping another mesh isn't a copy.", -1, instances.getSourceMeshIdx(1));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A mesh within the overlap of another mesh isn't a copy.", -1, instances.getSourceMeshIdx(2));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A mesh with other settings isn't a copy.", -1, instances.getSourceMeshIdx(3));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The first separate mesh isn't a copy.", -1, instances.getSourceMeshIdx(4));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The second separate mesh is a copy of the first.", 4, instances.getSourceMeshIdx(5));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Only the separate meshes are copies.", 1u, instances.getCopyCount());
+}
+
+void MeshInstancesTest::translatedSlicesTest()
+{
+    MeshGroup meshgroup(&settings);
+    addPyramid(meshgroup, Point3(0, 0, 0), 10000);
+    addPyramid(meshgroup, Point3(30000, -7001, 0), 10000);
+    const MeshInstances instances = MeshInstances::find(meshgroup);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The second pyramid is a copy of the first.", 0, instances.getSourceMeshIdx(1));
+
+    constexpr int layer_count = 50;
+    Slicer source_slicer(&meshgroup.meshes[0], 100, 200, layer_count, false, false);
+    Slicer copy_slicer(&meshgroup.meshes[1], 100, 200, layer_count, false, false);
+    Slicer* translated_slicer = MeshInstances::translateSlices(source_slicer, &meshgroup.meshes[1], instances.getOffset(1));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The copy should have as many layers as the source.", copy_slicer.layers.size(), translated_slicer->layers.size());
+    for (unsigned int layer_nr = 0; layer_nr < copy_slicer.layers.size(); layer_nr++)
+    {
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("The layers should be at the same height.", copy_slicer.layers[layer_nr].z, translated_slicer->layers[layer_nr].z);
+        CPPUNIT_ASSERT_MESSAGE("The translated layer should be the same as the one sliced from the copy.", copy_slicer.layers[layer_nr].polygons.isIdentical(translated_slicer->layers[layer_nr].polygons));
+        CPPUNIT_ASSERT_MESSAGE("The translated open polylines should be the same as those sliced from the copy.", copy_slicer.layers[layer_nr].openPolylines.isIdentical(translated_slicer->layers[layer_nr].openPolylines));
+    }
+    delete translated_slicer;
+}
+
+void MeshInstancesTest::translatedPartsTest()
+{
+    MeshGroup meshgroup(&settings);
+    addPyramid(meshgroup, Point3(0, 0, 0), 10000);
+    addPyramid(meshgroup, Point3(30000, -7001, 0), 10000);
+    const MeshInstances instances = MeshInstances::find(meshgroup);
+
+    constexpr int layer_count = 50;
+    Slicer source_slicer(&meshgroup.meshes[0], 100, 200, layer_count, false, false);
+    Slicer copy_slicer(&meshgroup.meshes[1], 100, 200, layer_count, false, false);
+    SliceMeshStorage source(&meshgroup.meshes[0], layer_count);
+    SliceMeshStorage copy(&meshgroup.meshes[1], layer_count);
+    copy.instance_source_mesh_idx = instances.getSourceMeshIdx(1);
+    copy.instance_offset = instances.getOffset(1);
+    for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        for (const PolygonsPart& outline : source_slicer.layers[layer_nr].polygons.splitIntoParts())
+        {
+            source.layers[layer_nr].parts.push_back(generatePart(outline));
+        }
+    }
+
+    MeshInstances::translateAreas(source, copy);
+    for (unsigned int layer_nr = 0; layer_nr < layer_count; layer_nr++)
+    {
+        const std::vector<PolygonsPart> copy_outlines = copy_slicer.layers[layer_nr].polygons.splitIntoParts();
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("The copy should have as many parts as the source.", copy_outlines.size(), copy.layers[layer_nr].parts.size());
+        for (unsigned int part_idx = 0; part_idx < copy_outlines.size(); part_idx++)
+        {
+            assertSameParts(generatePart(copy_outlines[part_idx]), copy.layers[layer_nr].parts[part_idx]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,115 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef MESH_INSTANCES_TEST_H
+#define MESH_INSTANCES_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/settings/settings.h"
+#include "../src/utils/intpoint.h"
+
+namespace cura
+{
+
+class MeshGroup;
+class PolygonsPart;
+class SliceLayerPart;
+
+class MeshInstancesTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(MeshInstancesTest);
+    CPPUNIT_TEST(translatedCopyTest);
+    CPPUNIT_TEST(otherTransformationTest);
+    CPPUNIT_TEST(otherSettingsTest);
+    CPPUNIT_TEST(nearbyMeshTest);
+    CPPUNIT_TEST(translatedSlicesTest);
+    CPPUNIT_TEST(translatedPartsTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether meshes moved horizontally by whole microns are found to be copies of the first of them.
+     */
+    void translatedCopyTest();
+
+    /*!
+     * \brief Test whether meshes moved vertically, scaled or with a vertex moved aren't copies.
+     */
+    void otherTransformationTest();
+
+    /*!
+     * \brief Test whether meshes with other settings than their position, or of another kind than normal meshes, aren't copies.
+     */
+    void otherSettingsTest();
+
+    /*!
+     * \brief Test whether copies near another mesh, which could change their areas, aren't copies.
+     */
+    void nearbyMeshTest();
+
+    /*!
+     * \brief Test whether the translated layers of the source mesh are the same as those sliced from the copy.
+     */
+    void translatedSlicesTest();
+
+    /*!
+     * \brief Test whether the translated parts of the source mesh are the same as those generated for the copy.
+     */
+    void translatedPartsTest();
+
+private:
+    /*!
+     * \brief The settings of the meshes, which all meshes of the tests inherit.
+     */
+    SettingsBase settings;
+
+    /*!
+     * \brief Add a cube to a mesh group.
+     *
+     * \param meshgroup The mesh group to add the cube to
+     * \param min The corner of the cube with the lowest coordinates
+     * \param size The length of the sides of the cube
+     */
+    void addCube(MeshGroup& meshgroup, Point3 min, int32_t size);
+
+    /*!
+     * \brief Add a pyramid with a square base to a mesh group, of which the layers all differ.
+     *
+     * \param meshgroup The mesh group to add the pyramid to
+     * \param min The corner of the base with the lowest coordinates
+     * \param size The length of the sides of the base and the height
+     */
+    void addPyramid(MeshGroup& meshgroup, Point3 min, int32_t size);
+
+    /*!
+     * \brief Generate a part the way the walls, skin and infill would be generated, each derived from the outline.
+     *
+     * \param outline The outline of the part
+     * \return The part
+     */
+    SliceLayerPart generatePart(const PolygonsPart& outline);
+
+    /*!
+     * \brief Check whether two parts have the same areas.
+     *
+     * \param expected The part generated for the copy
+     * \param actual The part translated from the source mesh
+     */
+    void assertSameParts(const SliceLayerPart& expected, const SliceLayerPart& actual);
+};
+
+}
+
+#endif // MESH_INSTANCES_TEST_H
@@ -0,0 +1,212 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "WallOverlapTest.h"
+
+#include "../src/wallOverlap.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(WallOverlapTest);
+
+void WallOverlapTest::setUp()
+{
+    //Do nothing.
+}
+
+void WallOverlapTest::tearDown()
+{
+    //Do nothing.
+}
+
+std::vector<std::vector<float>> WallOverlapTest::getFlows(const Polygons& polygons)
+{
+    WallOverlapComputation wall_overlap_computation(polygons, line_width);
+    std::vector<std::vector<float>> flows;
+    for (ConstPolygonRef poly : polygons)
+    {
+        flows.emplace_back();
+        for (unsigned int point_idx = 0; point_idx < poly.size(); point_idx++)
+        {
+            flows.back().push_back(wall_overlap_computation.getFlow(poly[point_idx], poly[(point_idx + 1) % poly.size()]));
+        }
+    }
+    return flows;
+}
+
+void WallOverlapTest::noOverlapTest()
+{
+    Polygons squares;
+    PolygonRef square = squares.newPoly();
+    square.add(Point(0, 0));
+    square.add(Point(10000, 0));
+    square.add(Point(10000, 10000));
+    square.add(Point(0, 10000));
+    PolygonRef far_square = squares.newPoly();
+    far_square.add(Point(20000, 0));
+    far_square.add(Point(30000, 0));
+    far_square.add(Point(30000, 10000));
+    far_square.add(Point(20000, 10000));
+
+    for (const std::vector<float>& poly_flows : getFlows(squares))
+    {
+        for (float flow : poly_flows)
+        {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE("Walls which don't overlap should get the full flow.", 1.0f, flow);
+        }
+    }
+}
+
+void WallOverlapTest::thinPolygonTest()
+{
+    // A polygon of a quarter of the line width wide, so that its long sides overlap by three quarters of the line width.
+    Polygons thin;
+    PolygonRef thin_poly = thin.newPoly();
+    thin_poly.add(Point(0, 0));
+    thin_poly.add(Point(10000, 0));
+    thin_poly.add(Point(10000, line_width / 4));
+    thin_poly.add(Point(0, line_width / 4));
+
+    const std::vector<float> flows = getFlows(thin)[0];
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The first side is laid down normally.", 1.0f, flows[0]);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The short side only touches the long sides at its corners.", 1.0f, flows[1]);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The second side should leave out the three quarters already laid down.", 0.25, flows[2], maximum_error);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The short side only touches the long sides at its corners.", 1.0f, flows[3]);
+
+    // Laying down the same wall again finds all of it passed.
+    WallOverlapComputation wall_overlap_computation(thin, line_width);
+    for (unsigned int point_idx = 0; point_idx < thin_poly.size(); point_idx++)
+    {
+        wall_overlap_computation.getFlow(thin_poly[point_idx], thin_poly[(point_idx + 1) % thin_poly.size()]);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The first side overlaps with the second side once that has been passed.", 0.25, wall_overlap_computation.getFlow(thin_poly[0], thin_poly[1]), maximum_error);
+}
+
+void WallOverlapTest::neighbouringPolygonsTest()
+{
+    // Two squares a quarter of the line width apart; the right side of the one runs up alongside the left side of the other running down.
+    Polygons squares;
+    PolygonRef left = squares.newPoly();
+    left.add(Point(0, 0));
+    left.add(Point(1000, 0));
+    left.add(Point(1000, 1000));
+    left.add(Point(0, 1000));
+    PolygonRef right = squares.newPoly();
+    right.add(Point(1000 + line_width / 4, 1000));
+    right.add(Point(1000 + line_width / 4, 0));
+    right.add(Point(2000 + line_width / 4, 0));
+    right.add(Point(2000 + line_width / 4, 1000));
+
+    std::vector<std::vector<float>> flows = getFlows(squares);
+    for (float flow : flows[0])
+    {
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("The walls laid down first get the full flow.", 1.0f, flow);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The side alongside the other polygon should leave out the overlap.", 0.25, flows[1][0], maximum_error);
+    for (unsigned int segment_idx = 1; segment_idx < flows[1].size(); segment_idx++)
+    {
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("The other sides don't overlap.", 1.0f, flows[1][segment_idx]);
+    }
+
+    // In the other order, the side of the other polygon is reduced.
+    Polygons reversed_squares;
+    reversed_squares.add(squares[1]);
+    reversed_squares.add(squares[0]);
+    flows = getFlows(reversed_squares);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The wall laid down first gets the full flow.", 1.0f, flows[0][0]);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The side alongside the other polygon should leave out the overlap.", 0.25, flows[1][1], maximum_error);
+}
+
+void WallOverlapTest::partialOverlapTest()
+{
+    // As in neighbouringPolygonsTest, but with the second square moved up by half its size, so that the sides are alongside each other for half their length.
+    Polygons squares;
+    PolygonRef left = squares.newPoly();
+    left.add(Point(0, 0));
+    left.add(Point(1000, 0));
+    left.add(Point(1000, 1000));
+    left.add(Point(0, 1000));
+    PolygonRef right = squares.newPoly();
+    right.add(Point(1000 + line_width / 4, 1500));
+    right.add(Point(1000 + line_width / 4, 500));
+    right.add(Point(2000 + line_width / 4, 500));
+    right.add(Point(2000 + line_width / 4, 1500));
+
+    const std::vector<std::vector<float>> flows = getFlows(squares);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Only the half alongside the other side should be reduced.", 1.0 - 0.75 / 2, flows[1][0], maximum_error);
+
+    // Two sides crossing each other in the middle, which are twice the line width apart at their ends.
+    // On each side of the crossing they overlap in a triangle, a line width wide at the crossing and a quarter of their length long.
+    Polygons crossing;
+    PolygonRef rising = crossing.newPoly();
+    rising.add(Point(0, 0));
+    rising.add(Point(10000, line_width * 2));
+    rising.add(Point(20000, -10000));
+    PolygonRef falling = crossing.newPoly();
+    falling.add(Point(10000, 0));
+    falling.add(Point(0, line_width * 2));
+    falling.add(Point(-10000, 10000));
+    const std::vector<std::vector<float>> crossing_flows = getFlows(crossing);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Crossing sides should be reduced by the overlap around the crossing.", 0.75, crossing_flows[1][0], maximum_error);
+}
+
+void WallOverlapTest::sameDirectionTest()
+{
+    // The top of a hole right below the bottom of a polygon runs in the same direction.
+    Polygons polys;
+    PolygonRef poly = polys.newPoly();
+    poly.add(Point(0, 0));
+    poly.add(Point(10000, 0));
+    poly.add(Point(10000, 10000));
+    poly.add(Point(0, 10000));
+    PolygonRef hole = polys.newPoly();
+    hole.add(Point(0, -line_width / 4));
+    hole.add(Point(10000, -line_width / 4));
+    hole.add(Point(10000, -10000));
+    hole.add(Point(0, -10000));
+
+    for (const std::vector<float>& poly_flows : getFlows(polys))
+    {
+        for (float flow : poly_flows)
+        {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE("Walls in the same direction aren't compensated for.", 1.0f, flow);
+        }
+    }
+}
+
+void WallOverlapTest::degenerateTest()
+{
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Without walls every segment gets the full flow.", 1.0f, WallOverlapComputation(Polygons(), line_width).getFlow(Point(0, 0), Point(1000, 0)));
+
+    // A single vertex and a thin polygon with a duplicate vertex.
+    Polygons polys;
+    polys.newPoly().add(Point(5000, 5000));
+    PolygonRef thin_poly = polys.newPoly();
+    thin_poly.add(Point(0, 0));
+    thin_poly.add(Point(10000, 0));
+    thin_poly.add(Point(10000, 0));
+    thin_poly.add(Point(10000, line_width / 4));
+    thin_poly.add(Point(0, line_width / 4));
+
+    const std::vector<std::vector<float>> flows = getFlows(polys);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A single vertex has no overlap.", 1.0f, flows[0][0]);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A segment of zero length has no overlap.", 1.0f, flows[1][1]);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The duplicate vertex shouldn't affect the overlap of the sides.", 0.25, flows[1][3], maximum_error);
+}
+
+void WallOverlapTest::unknownSegmentTest()
+{
+    Polygons thin;
+    PolygonRef thin_poly = thin.newPoly();
+    thin_poly.add(Point(0, 0));
+    thin_poly.add(Point(10000, 0));
+    thin_poly.add(Point(10000, line_width / 4));
+    thin_poly.add(Point(0, line_width / 4));
+
+    WallOverlapComputation wall_overlap_computation(thin, line_width);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The first side is laid down normally.", 1.0f, wall_overlap_computation.getFlow(thin_poly[0], thin_poly[1]));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A segment which isn't part of the walls gets the full flow.", 1.0f, wall_overlap_computation.getFlow(Point(0, line_width / 4), Point(10000, line_width / 4)));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The walls continue after the unknown segment.", 0.25, wall_overlap_computation.getFlow(thin_poly[2], thin_poly[3]), maximum_error);
+}
+
+}
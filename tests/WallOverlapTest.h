@@ -0,0 +1,97 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef WALL_OVERLAP_TEST_H
+#define WALL_OVERLAP_TEST_H
+
+#include <vector>
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/polygon.h"
+
+namespace cura
+{
+
+class WallOverlapTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(WallOverlapTest);
+    CPPUNIT_TEST(noOverlapTest);
+    CPPUNIT_TEST(thinPolygonTest);
+    CPPUNIT_TEST(neighbouringPolygonsTest);
+    CPPUNIT_TEST(partialOverlapTest);
+    CPPUNIT_TEST(sameDirectionTest);
+    CPPUNIT_TEST(degenerateTest);
+    CPPUNIT_TEST(unknownSegmentTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether walls far apart from each other keep their full flow.
+     */
+    void noOverlapTest();
+
+    /*!
+     * \brief Test whether the second side of a polygon thinner than the line width is reduced by the overlap with the first side.
+     */
+    void thinPolygonTest();
+
+    /*!
+     * \brief Test whether the overlap between the walls of two polygons next to each other is found.
+     */
+    void neighbouringPolygonsTest();
+
+    /*!
+     * \brief Test whether only the part of a segment alongside the other segment counts as overlap.
+     */
+    void partialOverlapTest();
+
+    /*!
+     * \brief Test whether walls running in the same direction close to each other aren't compensated for.
+     */
+    void sameDirectionTest();
+
+    /*!
+     * \brief Test empty polygons, polygons of a single vertex and segments of zero length.
+     */
+    void degenerateTest();
+
+    /*!
+     * \brief Test whether a segment which isn't part of the walls gets the full flow.
+     */
+    void unknownSegmentTest();
+
+private:
+    /*!
+     * \brief The line width of the walls.
+     */
+    static const int line_width = 400;
+
+    /*!
+     * \brief The maximum allowed error in the flow.
+     */
+    static constexpr float maximum_error = 0.01;
+
+    /*!
+     * \brief Computes the flow of each segment of the polygons, in the order in which they would be printed.
+     *
+     * \param polygons The walls
+     * \return The flow of each segment of each polygon
+     */
+    std::vector<std::vector<float>> getFlows(const Polygons& polygons);
+};
+
+}
+
+#endif // WALL_OVERLAP_TEST_H
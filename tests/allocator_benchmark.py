@@ -0,0 +1,100 @@
+#!/usr/bin/python3
+
+## allocator_benchmark.py
+# The allocator_benchmark.py script compares memory allocators by slicing the reference models of benchmark.py with each of them.
+# The engine is run with each allocator preloaded, so a single build of the engine is compared with itself
+# and the only difference between the runs is the malloc used. The system allocator is always included, as the reference.
+# For each model the wall time of each allocator is reported relative to the system allocator,
+# together with the stages which allocate most, from the allocation counts of the profile of the engine,
+# so that the gains can be attributed to those stages.
+
+import argparse
+import json
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import benchmark
+
+
+## Parse the allocators given on the command line.
+#
+#   \param specifications The allocators as "name=library".
+#   \return The name and the library of each allocator, starting with the system allocator, which has no library.
+def parseAllocators(specifications):
+    allocators = [("system", None)]
+    for specification in specifications:
+        name, separator, library = specification.partition("=")
+        if not separator or not name or not library:
+            raise ValueError("Allocator '%s' isn't given as name=library" % specification)
+        if not os.path.exists(library):
+            raise ValueError("The library of allocator '%s' doesn't exist: %s" % (name, library))
+        allocators.append((name, library))
+    return allocators
+
+
+def main():
+    parser = argparse.ArgumentParser(description = "CuraEngine allocator benchmark script")
+    parser.add_argument("json", type = str, help = "Machine JSON file to use")
+    parser.add_argument("engine", type = str, help = "Engine executable")
+    parser.add_argument("--allocator", type = str, action = "append", default = [], help = "An allocator to compare with the system allocator, as name=library, e.g. tcmalloc=/usr/lib/libtcmalloc.so. Can be given several times")
+    parser.add_argument("--benchmarks", type = str, nargs = "+", choices = sorted(benchmark.BENCHMARKS.keys()), default = sorted(benchmark.BENCHMARKS.keys()), help = "The benchmarks to run")
+    parser.add_argument("--settings", type = str, help = "JSON file with a dictionary of extra settings for all benchmarks")
+    parser.add_argument("--threads", type = int, default = 0, help = "The number of threads of the engine, or 0 for its default")
+    parser.add_argument("--repetitions", type = int, default = 3, help = "The number of times each benchmark is run with each allocator")
+    parser.add_argument("--stages", type = int, default = 5, help = "The number of stages which allocate most to report for each benchmark")
+    parser.add_argument("--work-dir", type = str, default = "benchmarks", help = "Directory for the models, the profiles and the gcode")
+    parser.add_argument("--output", type = str, help = "File to write the results of each allocator to")
+    args = parser.parse_args()
+
+    try:
+        allocators = parseAllocators(args.allocator)
+    except ValueError as error:
+        print(error)
+        sys.exit(1)
+    settings = {}
+    if args.settings:
+        with open(args.settings, "r") as f:
+            settings = json.load(f)
+
+    results = {} # per allocator, per benchmark
+    failed = False
+    for name, library in allocators:
+        print("Allocator: %s" % name)
+        runner = benchmark.BenchmarkRunner(args.json, args.engine, settings, args.work_dir, args.threads, args.repetitions, library)
+        results[name] = {}
+        for benchmark_name in args.benchmarks:
+            result = runner.run(benchmark_name)
+            results[name][benchmark_name] = result
+            if result is None:
+                failed = True
+                continue
+            print("  %-25s wall time: %.3fs, peak memory: %.1fMB" % (benchmark_name, result["wall_seconds"], result["peak_memory_mb"]))
+
+    print("Comparison with the system allocator:")
+    for benchmark_name in args.benchmarks:
+        reference = results["system"][benchmark_name]
+        if reference is None:
+            continue
+        print("Benchmark: %s" % benchmark_name)
+        for name, _ in allocators[1:]:
+            result = results[name][benchmark_name]
+            if result is None:
+                continue
+            print("  %-12s wall time %.3fx, peak memory %.3fx" % (name, result["wall_seconds"] / max(reference["wall_seconds"], 1e-6), result["peak_memory_mb"] / max(reference["peak_memory_mb"], 1e-6)))
+        # the innermost stages which allocate most, with the time each allocator spends in them
+        allocations = reference["stage_allocations"]
+        leaves = [path for path in allocations if not any(other.startswith(path + "/") for other in allocations)]
+        for path in sorted(leaves, key = lambda path: -allocations[path])[:args.stages]:
+            times = ", ".join("%s %.3fs" % (name, results[name][benchmark_name]["stage_seconds"].get(path, 0)) for name, _ in allocators if results[name][benchmark_name] is not None)
+            print("    %-50s %10d allocations: %s" % (path, allocations[path], times))
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent = 4, sort_keys = True)
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,317 @@
+#!/usr/bin/python3
+
+## benchmark.py
+# The benchmark.py script measures the throughput of the CuraEngine on a set of reference models.
+# The models are generated by this script, so that every run slices exactly the same meshes:
+# * organic_scan: a bumpy closed surface, like a 3D scan, with support
+# * mechanical_extrusion: a toothed ring, like an extruded gear
+# * many_small_islands: a plate full of small pins
+# * tall_thin_vase: a tall surface of revolution, sliced in spiralize mode
+# * multi_extruder: two models on two extruders with a prime tower
+# For each model the wall time, the peak memory use and the time and the heap allocations of each stage are reported,
+# see the --profile option of the engine. The median over several repetitions is reported,
+# so that results can be compared from run to run.
+# When given a baseline of an earlier run, the script fails if a benchmark has become slower or uses more memory than allowed.
+
+import argparse
+import json
+import math
+import os
+import random
+import statistics
+import struct
+import subprocess
+import sys
+import time
+
+
+## Collects the triangles of a mesh and writes them to a binary STL file.
+class Mesh:
+    def __init__(self):
+        self._triangles = []
+
+    ## Add a triangle, with its vertices in counter-clockwise order seen from the outside.
+    def addTriangle(self, v0, v1, v2):
+        self._triangles.append((v0, v1, v2))
+
+    ## Add a quadrilateral as two triangles, with its vertices in counter-clockwise order seen from the outside.
+    def addQuad(self, v0, v1, v2, v3):
+        self.addTriangle(v0, v1, v2)
+        self.addTriangle(v0, v2, v3)
+
+    def saveSTL(self, filename):
+        with open(filename, "wb") as f:
+            f.write(b"CuraEngine benchmark model".ljust(80, b" "))
+            f.write(struct.pack("<I", len(self._triangles)))
+            for v0, v1, v2 in self._triangles:
+                f.write(struct.pack("<3f", 0, 0, 0)) # the engine computes the normals itself
+                for vertex in (v0, v1, v2):
+                    f.write(struct.pack("<3f", *vertex))
+                f.write(struct.pack("<H", 0))
+
+
+## Add a closed surface of revolution around the vertical axis through (center_x, center_y).
+#
+#   \param radius_function The radius as a function of the angle and the height.
+#   \param heights The heights of the rings of vertices, from bottom to top.
+#   \param segment_count The number of vertices in each ring.
+def addRevolution(mesh, center_x, center_y, radius_function, heights, segment_count):
+    rings = []
+    for z in heights:
+        ring = []
+        for segment_idx in range(segment_count):
+            angle = 2 * math.pi * segment_idx / segment_count
+            radius = radius_function(angle, z)
+            ring.append((center_x + radius * math.cos(angle), center_y + radius * math.sin(angle), z))
+        rings.append(ring)
+    for ring_idx in range(len(rings) - 1):
+        lower = rings[ring_idx]
+        upper = rings[ring_idx + 1]
+        for segment_idx in range(segment_count):
+            next_idx = (segment_idx + 1) % segment_count
+            mesh.addQuad(lower[segment_idx], lower[next_idx], upper[next_idx], upper[segment_idx])
+    bottom_center = (center_x, center_y, heights[0])
+    top_center = (center_x, center_y, heights[-1])
+    for segment_idx in range(segment_count):
+        next_idx = (segment_idx + 1) % segment_count
+        mesh.addTriangle(bottom_center, rings[0][next_idx], rings[0][segment_idx])
+        mesh.addTriangle(top_center, rings[-1][segment_idx], rings[-1][next_idx])
+
+
+## Add a vertical ring with a round hole around (center_x, center_y).
+#
+#   \param outer_radius_function The outer radius as a function of the angle.
+def addRingExtrusion(mesh, center_x, center_y, outer_radius_function, inner_radius, height, segment_count):
+    def vertex(radius, angle, z):
+        return (center_x + radius * math.cos(angle), center_y + radius * math.sin(angle), z)
+    for segment_idx in range(segment_count):
+        angle = 2 * math.pi * segment_idx / segment_count
+        next_angle = 2 * math.pi * (segment_idx + 1) / segment_count
+        outer_radius = outer_radius_function(angle)
+        next_outer_radius = outer_radius_function(next_angle)
+        outer_bottom = (vertex(outer_radius, angle, 0), vertex(next_outer_radius, next_angle, 0))
+        outer_top = (vertex(outer_radius, angle, height), vertex(next_outer_radius, next_angle, height))
+        inner_bottom = (vertex(inner_radius, angle, 0), vertex(inner_radius, next_angle, 0))
+        inner_top = (vertex(inner_radius, angle, height), vertex(inner_radius, next_angle, height))
+        mesh.addQuad(outer_bottom[0], outer_bottom[1], outer_top[1], outer_top[0])
+        mesh.addQuad(inner_bottom[1], inner_bottom[0], inner_top[0], inner_top[1])
+        mesh.addQuad(inner_top[0], outer_top[0], outer_top[1], inner_top[1])
+        mesh.addQuad(inner_bottom[0], inner_bottom[1], outer_bottom[1], outer_bottom[0])
+
+
+def createOrganicScan():
+    mesh = Mesh()
+    rng = random.Random(1)
+    bumps = [(rng.uniform(0.5, 3), rng.randint(2, 9), rng.uniform(0, 2 * math.pi), rng.uniform(0.05, 0.3)) for _ in range(12)]
+    height = 80
+    def radius(angle, z):
+        t = z / height
+        profile = 30 * math.sin(math.pi * t) ** 0.7 + 0.5
+        bumpiness = sum(amplitude * math.sin(frequency * angle + phase + z * z_frequency) for amplitude, frequency, phase, z_frequency in bumps)
+        return max(0.5, profile + bumpiness * math.sin(math.pi * t))
+    heights = [height * layer_idx / 400 for layer_idx in range(401)]
+    addRevolution(mesh, 100, 100, radius, heights, 360)
+    return [mesh]
+
+
+def createMechanicalExtrusion():
+    mesh = Mesh()
+    tooth_count = 48
+    def outer_radius(angle):
+        tooth_phase = (angle * tooth_count / (2 * math.pi)) % 1
+        return 40 if tooth_phase < 0.5 else 36
+    addRingExtrusion(mesh, 100, 100, outer_radius, 15, 20, tooth_count * 16)
+    return [mesh]
+
+
+def createManySmallIslands():
+    mesh = Mesh()
+    for x_idx in range(24):
+        for y_idx in range(24):
+            addRevolution(mesh, 30 + x_idx * 6, 30 + y_idx * 6, lambda angle, z: 1.5, [0, 5], 24)
+    return [mesh]
+
+
+def createTallThinVase():
+    mesh = Mesh()
+    height = 200
+    radius = lambda angle, z: 15 + 5 * math.sin(z / height * 3 * math.pi) + 0.5 * math.sin(8 * angle)
+    addRevolution(mesh, 100, 100, radius, [height * ring_idx / 200 for ring_idx in range(201)], 256)
+    return [mesh]
+
+
+def createMultiExtruder():
+    first = Mesh()
+    addRevolution(first, 80, 100, lambda angle, z: 15 + 3 * math.cos(5 * angle), [z * 0.5 for z in range(81)], 180)
+    second = Mesh()
+    addRingExtrusion(second, 130, 100, lambda angle: 15, 8, 30, 180)
+    return [first, second]
+
+
+_multi_extruder_mesh_settings = {"extruder_nr": 1, "wall_0_extruder_nr": 1, "wall_x_extruder_nr": 1, "infill_extruder_nr": 1, "top_bottom_extruder_nr": 1}
+
+## The reference benchmarks: the function generating the models, the settings for all models
+#  and the settings of each separate model.
+BENCHMARKS = {
+    "organic_scan": (createOrganicScan, {"support_enable": "True"}, [{}]),
+    "mechanical_extrusion": (createMechanicalExtrusion, {}, [{}]),
+    "many_small_islands": (createManySmallIslands, {}, [{}]),
+    "tall_thin_vase": (createTallThinVase, {"magic_spiralize": "True"}, [{}]),
+    "multi_extruder": (createMultiExtruder, {"machine_extruder_count": 2, "prime_tower_enable": "True"}, [{}, _multi_extruder_mesh_settings]),
+}
+
+
+## Runs the benchmarks and keeps their results.
+class BenchmarkRunner:
+    ## \param preload A shared library to preload into the engine, e.g. another malloc, or None.
+    def __init__(self, definition_filename, engine_filename, settings, work_dir, threads, repetitions, preload = None):
+        self._definition = definition_filename
+        self._engine = engine_filename
+        self._settings = settings
+        self._work_dir = work_dir
+        self._threads = threads
+        self._repetitions = repetitions
+        self._env = dict(os.environ)
+        if preload:
+            self._env["LD_PRELOAD"] = os.path.abspath(preload)
+        os.makedirs(work_dir, exist_ok = True)
+
+    ## Get the STL files of the models of a benchmark, generating them if they don't exist yet.
+    def _getModelFiles(self, name, create_function, model_count):
+        filenames = [os.path.join(self._work_dir, "%s_%d.stl" % (name, model_idx)) for model_idx in range(model_count)]
+        if not all(os.path.exists(filename) for filename in filenames):
+            for mesh, filename in zip(create_function(), filenames):
+                mesh.saveSTL(filename)
+        return filenames
+
+    def _createCommand(self, model_filenames, settings, mesh_settings, profile_filename):
+        cmd = [self._engine, "slice", "-j", self._definition]
+        if self._threads > 0:
+            cmd += ["-m%d" % self._threads]
+        all_settings = dict(self._settings)
+        all_settings.update(settings)
+        for key, value in all_settings.items():
+            cmd += ["-s", "%s=%s" % (key, value)]
+        for model_filename, model_settings in zip(model_filenames, mesh_settings):
+            if "extruder_nr" in model_settings:
+                cmd += ["-e%d" % model_settings["extruder_nr"]]
+            cmd += ["-l", model_filename]
+            for key, value in model_settings.items():
+                cmd += ["-s", "%s=%s" % (key, value)]
+        cmd += ["-o", os.path.join(self._work_dir, "output.gcode"), "--profile", profile_filename]
+        return cmd
+
+    ## Slice the models of a benchmark once.
+    #
+    #   \return The wall time in seconds, the peak memory use in MB, the seconds spent in each stage
+    #   and the heap allocations of each stage, or None if the engine failed.
+    def _runOnce(self, cmd, profile_filename):
+        start = time.monotonic()
+        p = subprocess.Popen(cmd, stdin = subprocess.DEVNULL, stdout = subprocess.DEVNULL, stderr = subprocess.PIPE, env = self._env)
+        stderr = p.stderr.read()
+        _, status, usage = os.wait4(p.pid, 0) # unlike Popen.wait this also gives the resource usage of the engine
+        wall_seconds = time.monotonic() - start
+        p.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1 # already waited for
+        if p.returncode != 0:
+            print("Execution failed: %s" % (" ".join(cmd)))
+            print("\n".join(stderr.decode("utf-8", "replace").split("\n")[-5:]))
+            return None
+        peak_memory = usage.ru_maxrss / 1024 # kilobytes on Linux
+        with open(profile_filename, "r") as f:
+            stages = json.load(f)["stages"]
+        stage_seconds = {path: stats["seconds"] for path, stats in stages.items()}
+        stage_allocations = {path: stats.get("allocations", 0) for path, stats in stages.items()}
+        return wall_seconds, peak_memory, stage_seconds, stage_allocations
+
+    ## Run a benchmark several times.
+    #
+    #   \return The median wall time, peak memory use and time of each stage and the allocations of each stage,
+    #   the largest of all runs, or None if the engine failed.
+    def run(self, name):
+        create_function, settings, mesh_settings = BENCHMARKS[name]
+        model_filenames = self._getModelFiles(name, create_function, len(mesh_settings))
+        profile_filename = os.path.join(self._work_dir, "%s_profile.json" % name)
+        cmd = self._createCommand(model_filenames, settings, mesh_settings, profile_filename)
+        runs = []
+        for repetition in range(self._repetitions):
+            result = self._runOnce(cmd, profile_filename)
+            if result is None:
+                return None
+            runs.append(result)
+        stage_paths = set()
+        for _, _, stage_seconds, _ in runs:
+            stage_paths.update(stage_seconds.keys())
+        return {
+            "wall_seconds": statistics.median([wall_seconds for wall_seconds, _, _, _ in runs]),
+            "peak_memory_mb": statistics.median([peak_memory for _, peak_memory, _, _ in runs]),
+            "stage_seconds": {path: statistics.median([stage_seconds.get(path, 0) for _, _, stage_seconds, _ in runs]) for path in sorted(stage_paths)},
+            "stage_allocations": {path: max([stage_allocations.get(path, 0) for _, _, _, stage_allocations in runs]) for path in sorted(stage_paths)}
+        }
+
+
+## Compare the results to those of an earlier run.
+#
+#   \return The regressions found, as messages.
+def findRegressions(results, baseline, time_tolerance, memory_tolerance):
+    regressions = []
+    for name, result in results.items():
+        if name not in baseline or result is None:
+            continue
+        base = baseline[name]
+        if result["wall_seconds"] > base["wall_seconds"] * (1 + time_tolerance):
+            regressions.append("%s: wall time %.3fs, was %.3fs" % (name, result["wall_seconds"], base["wall_seconds"]))
+        if result["peak_memory_mb"] > base["peak_memory_mb"] * (1 + memory_tolerance):
+            regressions.append("%s: peak memory %.1fMB, was %.1fMB" % (name, result["peak_memory_mb"], base["peak_memory_mb"]))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description = "CuraEngine benchmark script")
+    parser.add_argument("json", type = str, help = "Machine JSON file to use")
+    parser.add_argument("engine", type = str, help = "Engine executable")
+    parser.add_argument("--benchmarks", type = str, nargs = "+", choices = sorted(BENCHMARKS.keys()), default = sorted(BENCHMARKS.keys()), help = "The benchmarks to run")
+    parser.add_argument("--settings", type = str, help = "JSON file with a dictionary of extra settings for all benchmarks")
+    parser.add_argument("--threads", type = int, default = 0, help = "The number of threads of the engine, or 0 for its default")
+    parser.add_argument("--repetitions", type = int, default = 3, help = "The number of times each benchmark is run")
+    parser.add_argument("--preload", type = str, help = "Shared library to preload into the engine, e.g. libtcmalloc.so to benchmark another malloc")
+    parser.add_argument("--work-dir", type = str, default = "benchmarks", help = "Directory for the models, the profiles and the gcode")
+    parser.add_argument("--output", type = str, help = "File to write the results to, which can be used as the baseline of later runs")
+    parser.add_argument("--baseline", type = str, help = "Results of an earlier run to compare with")
+    parser.add_argument("--time-tolerance", type = float, default = 0.1, help = "The fraction by which the wall time may exceed the baseline")
+    parser.add_argument("--memory-tolerance", type = float, default = 0.1, help = "The fraction by which the peak memory use may exceed the baseline")
+    args = parser.parse_args()
+
+    settings = {}
+    if args.settings:
+        with open(args.settings, "r") as f:
+            settings = json.load(f)
+    runner = BenchmarkRunner(args.json, args.engine, settings, args.work_dir, args.threads, args.repetitions, args.preload)
+    results = {}
+    failed = False
+    for name in args.benchmarks:
+        print("Benchmark: %s" % name)
+        result = runner.run(name)
+        results[name] = result
+        if result is None:
+            failed = True
+            continue
+        print("  wall time: %.3fs, peak memory: %.1fMB" % (result["wall_seconds"], result["peak_memory_mb"]))
+        for path, seconds in result["stage_seconds"].items():
+            print("  %-50s %.3fs %10d allocations" % (path, seconds, result["stage_allocations"][path]))
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent = 4, sort_keys = True)
+    if args.baseline:
+        with open(args.baseline, "r") as f:
+            baseline = json.load(f)
+        regressions = findRegressions(results, baseline, args.time_tolerance, args.memory_tolerance)
+        for regression in regressions:
+            print("Regression: %s" % regression)
+        failed = failed or len(regressions) > 0
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
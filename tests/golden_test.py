@@ -0,0 +1,164 @@
+#!/usr/bin/python3
+
+## golden_test.py
+# The golden_test.py script checks that a change to the CuraEngine leaves its output alone, by comparing digests of each layer with those of a baseline.
+# The reference models of benchmark.py are sliced once each, and for each layer two sets of digests are recorded:
+# * plan: the hash of the planned paths of each feature type, as written by the --layer-digests option of the engine,
+#   which covers the points, the line widths, the speeds and the flows of the paths
+# * gcode: the hash of the gcode of each feature type, split at the ;LAYER: and ;TYPE: comments of the gcode
+# Run with --output to record a baseline, and with --baseline to compare with it. For each model that differs,
+# the first layer which differs and the feature types which differ in it are reported.
+
+import argparse
+import hashlib
+import json
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import benchmark
+
+
+## Comments which differ between builds of the same output.
+_IGNORED_COMMENTS = (";Generated with", ";GENERATOR.VERSION:")
+
+
+## Read the digests of the planned paths written by the engine.
+#
+#   \return A list with for each layer, in the order in which they are written, its number and the digest of each feature type.
+def readPlanDigests(filename):
+    layers = []
+    with open(filename, "r") as f:
+        for line in f:
+            if line.strip():
+                layer = json.loads(line)
+                layers.append({"layer": str(layer["layer"]), "features": layer["features"]})
+    return layers
+
+
+## Hash the gcode of each feature type in each layer.
+#
+#   The gcode before the first layer is reported as the layer "header",
+#   and the gcode of a layer before its first ;TYPE: comment as the feature "layer_start".
+#
+#   \return A list with for each layer, in the order of the gcode, its number and the digest of each feature type.
+def hashGcode(filename):
+    layers = [{"layer": "header", "features": {}}]
+    hashes = {"layer_start": hashlib.sha1()}
+    feature = "layer_start"
+    def finishLayer():
+        layers[-1]["features"] = {name: digest.hexdigest()[:16] for name, digest in hashes.items()}
+    with open(filename, "rb") as f:
+        for line in f:
+            if line.startswith(b";LAYER:"):
+                finishLayer()
+                layers.append({"layer": line[len(";LAYER:"):].strip().decode("utf-8", "replace"), "features": {}})
+                hashes = {"layer_start": hashlib.sha1()}
+                feature = "layer_start"
+                continue
+            if line.startswith(b";TYPE:"):
+                feature = line[len(";TYPE:"):].strip().decode("utf-8", "replace").lower()
+                hashes.setdefault(feature, hashlib.sha1())
+            if any(line.startswith(comment.encode("utf-8")) for comment in _IGNORED_COMMENTS):
+                continue
+            hashes[feature].update(line)
+    finishLayer()
+    return layers
+
+
+## Slice the models of a benchmark once and record the digests of its output.
+#
+#   \return The plan and gcode digests per layer, or None if the engine failed.
+def runBenchmark(runner, name, work_dir):
+    create_function, settings, mesh_settings = benchmark.BENCHMARKS[name]
+    model_filenames = runner._getModelFiles(name, create_function, len(mesh_settings))
+    profile_filename = os.path.join(work_dir, "%s_profile.json" % name)
+    digests_filename = os.path.join(work_dir, "%s_digests.jsonl" % name)
+    cmd = runner._createCommand(model_filenames, settings, mesh_settings, profile_filename) + ["--layer-digests", digests_filename]
+    p = subprocess.run(cmd, stdin = subprocess.DEVNULL, stdout = subprocess.DEVNULL, stderr = subprocess.PIPE)
+    if p.returncode != 0:
+        print("Execution failed: %s" % (" ".join(cmd)))
+        print("\n".join(p.stderr.decode("utf-8", "replace").split("\n")[-5:]))
+        return None
+    return {
+        "plan": readPlanDigests(digests_filename),
+        "gcode": hashGcode(os.path.join(work_dir, "output.gcode"))
+    }
+
+
+## Find the first layer in which two lists of layer digests differ.
+#
+#   \return A message telling the first layer which differs and its feature types which differ, or None if they are the same.
+def findFirstDifference(layers, base_layers):
+    for layer_idx in range(max(len(layers), len(base_layers))):
+        if layer_idx >= len(layers):
+            return "layer %s is missing, the baseline has %d layers instead of %d" % (base_layers[layer_idx]["layer"], len(base_layers), len(layers))
+        if layer_idx >= len(base_layers):
+            return "layer %s is new, the baseline has %d layers instead of %d" % (layers[layer_idx]["layer"], len(base_layers), len(layers))
+        layer = layers[layer_idx]
+        base_layer = base_layers[layer_idx]
+        if layer == base_layer:
+            continue
+        if layer["layer"] != base_layer["layer"]:
+            return "layer %s is written where the baseline has layer %s" % (layer["layer"], base_layer["layer"])
+        features = sorted(set(layer["features"].keys()) | set(base_layer["features"].keys()))
+        differing = [feature for feature in features if layer["features"].get(feature) != base_layer["features"].get(feature)]
+        different_layer_count = sum(1 for other, base in zip(layers[layer_idx:], base_layers[layer_idx:]) if other != base)
+        return "layer %s differs in %s; %d layers differ from there on" % (layer["layer"], ", ".join(differing), different_layer_count)
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description = "CuraEngine golden output test script")
+    parser.add_argument("json", type = str, help = "Machine JSON file to use")
+    parser.add_argument("engine", type = str, help = "Engine executable")
+    parser.add_argument("--benchmarks", type = str, nargs = "+", choices = sorted(benchmark.BENCHMARKS.keys()), default = sorted(benchmark.BENCHMARKS.keys()), help = "The models to slice")
+    parser.add_argument("--settings", type = str, help = "JSON file with a dictionary of extra settings for all models")
+    parser.add_argument("--threads", type = int, default = 0, help = "The number of threads of the engine, or 0 for its default")
+    parser.add_argument("--work-dir", type = str, default = "golden", help = "Directory for the models, the digests and the gcode")
+    parser.add_argument("--output", type = str, help = "File to write the digests to, which can be used as the baseline of later runs")
+    parser.add_argument("--baseline", type = str, help = "Digests of an earlier run to compare with")
+    args = parser.parse_args()
+
+    settings = {}
+    if args.settings:
+        with open(args.settings, "r") as f:
+            settings = json.load(f)
+    runner = benchmark.BenchmarkRunner(args.json, args.engine, settings, args.work_dir, args.threads, 1)
+    baseline = None
+    if args.baseline:
+        with open(args.baseline, "r") as f:
+            baseline = json.load(f)
+
+    results = {}
+    failed = False
+    for name in args.benchmarks:
+        result = runBenchmark(runner, name, args.work_dir)
+        results[name] = result
+        if result is None:
+            failed = True
+            continue
+        if baseline is None:
+            print("%s: %d layers" % (name, len(result["plan"])))
+            continue
+        if name not in baseline or baseline[name] is None:
+            print("%s: not in the baseline" % name)
+            continue
+        differences = [(kind, findFirstDifference(result[kind], baseline[name][kind])) for kind in ("plan", "gcode")]
+        differences = [(kind, difference) for kind, difference in differences if difference is not None]
+        if not differences:
+            print("%s: the same as the baseline" % name)
+        for kind, difference in differences:
+            print("%s: the %s differs from the baseline: %s" % (name, kind, difference))
+            failed = True
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent = 1, sort_keys = True)
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
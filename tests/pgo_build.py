@@ -0,0 +1,149 @@
+#!/usr/bin/python3
+
+## pgo_build.py
+# The pgo_build.py script builds the CuraEngine with profile-guided and link-time optimization and reports the speedup.
+# It takes three builds, each in its own directory under the work directory:
+# * reference: a plain build, to compare with
+# * optimized: first built with PGO=generate, so that the engine records a profile of where it spends its time,
+#   then the benchmark models of benchmark.py are sliced with it as the training set,
+#   and then it's built again in the same directory with PGO=use and link-time optimization
+# Finally the models are sliced with the reference and the optimized engine, and the speedup of each model is reported.
+#
+# The profile is reproducible: it's recorded from scratch each time, from the same generated models,
+# with a fixed number of threads and with settings which don't depend on the machine.
+# A description of how it was recorded is stored next to it in training.json.
+
+import argparse
+import glob
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import benchmark
+
+
+## Configure and build the engine in a directory.
+#
+#   \param cmake_args The arguments of cmake besides the source and build directory.
+def build(source_dir, build_dir, cmake_args, jobs):
+    os.makedirs(build_dir, exist_ok = True)
+    subprocess.check_call(["cmake", source_dir] + cmake_args, cwd = build_dir)
+    subprocess.check_call(["cmake", "--build", ".", "--target", "CuraEngine", "--", "-j%d" % jobs], cwd = build_dir)
+    return os.path.join(build_dir, "CuraEngine")
+
+
+## Get the compiler which cmake chose for a build directory.
+def getCompilerId(build_dir):
+    with open(os.path.join(build_dir, "CMakeCache.txt"), "r") as f:
+        for line in f:
+            if line.startswith("CMAKE_CXX_COMPILER:"):
+                compiler = line.strip().partition("=")[2]
+                return "Clang" if "clang" in os.path.basename(compiler) else "GNU"
+    return "GNU"
+
+
+## Slice the training set with the instrumented engine, so that it records its profile.
+#
+#   \return Whether all models could be sliced.
+def train(engine, definition, settings, benchmarks, work_dir, threads):
+    runner = benchmark.BenchmarkRunner(definition, engine, settings, work_dir, threads, 1)
+    success = True
+    for name in benchmarks:
+        print("Training: %s" % name)
+        if runner.run(name) is None:
+            success = False
+    return success
+
+
+## Merge the raw profiles of the runs of an engine built by clang into the file PGO=use reads.
+def mergeClangProfiles(profile_dir):
+    raw_profiles = sorted(glob.glob(os.path.join(profile_dir, "*.profraw")))
+    subprocess.check_call(["llvm-profdata", "merge", "-output", os.path.join(profile_dir, "default.profdata")] + raw_profiles)
+
+
+def main():
+    parser = argparse.ArgumentParser(description = "CuraEngine profile-guided optimization build script")
+    parser.add_argument("source", type = str, help = "Source directory of the engine")
+    parser.add_argument("json", type = str, help = "Machine JSON file to use")
+    parser.add_argument("--benchmarks", type = str, nargs = "+", choices = sorted(benchmark.BENCHMARKS.keys()), default = sorted(benchmark.BENCHMARKS.keys()), help = "The benchmarks to train on and to compare with")
+    parser.add_argument("--settings", type = str, help = "JSON file with a dictionary of extra settings for all benchmarks")
+    parser.add_argument("--threads", type = int, default = 1, help = "The number of threads of the engine, for training and comparing")
+    parser.add_argument("--repetitions", type = int, default = 3, help = "The number of times each benchmark is run by each engine to compare them")
+    parser.add_argument("--build-type", type = str, default = "Release", help = "The CMAKE_BUILD_TYPE of both builds")
+    parser.add_argument("--cmake-arg", type = str, action = "append", default = [], help = "An extra argument of cmake for both builds, e.g. --cmake-arg=-DENABLE_ARCUS=OFF. Can be given several times")
+    parser.add_argument("--jobs", type = int, default = os.cpu_count() or 1, help = "The number of parallel build jobs")
+    parser.add_argument("--no-lto", action = "store_true", help = "Build the optimized engine without link-time optimization")
+    parser.add_argument("--work-dir", type = str, default = "pgo", help = "Directory for the builds, the profile, the models and the gcode")
+    parser.add_argument("--output", type = str, help = "File to write the results of both engines to")
+    args = parser.parse_args()
+
+    source_dir = os.path.abspath(args.source)
+    definition = os.path.abspath(args.json)
+    work_dir = os.path.abspath(args.work_dir)
+    profile_dir = os.path.join(work_dir, "profile")
+    models_dir = os.path.join(work_dir, "models")
+    settings = {}
+    if args.settings:
+        with open(args.settings, "r") as f:
+            settings = json.load(f)
+    common_args = ["-DCMAKE_BUILD_TYPE=%s" % args.build_type] + args.cmake_arg
+
+    reference_engine = build(source_dir, os.path.join(work_dir, "reference"), common_args + ["-DPGO=off", "-DENABLE_LTO=OFF"], args.jobs)
+
+    # The profile is matched to the object files by their path, so both passes are built in the same directory.
+    optimized_dir = os.path.join(work_dir, "optimized")
+    optimized_args = common_args + ["-DPGO_PROFILE_DIR=%s" % profile_dir, "-DENABLE_LTO=%s" % ("OFF" if args.no_lto else "ON")]
+    shutil.rmtree(profile_dir, ignore_errors = True)
+    os.makedirs(profile_dir)
+    instrumented_engine = build(source_dir, optimized_dir, optimized_args + ["-DPGO=generate"], args.jobs)
+    if not train(instrumented_engine, definition, settings, args.benchmarks, models_dir, args.threads):
+        print("Training failed")
+        sys.exit(1)
+    compiler_id = getCompilerId(optimized_dir)
+    if compiler_id == "Clang":
+        mergeClangProfiles(profile_dir)
+    with open(os.path.join(profile_dir, "training.json"), "w") as f:
+        json.dump({"compiler": compiler_id, "build_type": args.build_type, "cmake_args": args.cmake_arg, "benchmarks": args.benchmarks, "settings": settings, "threads": args.threads}, f, indent = 4, sort_keys = True)
+    optimized_engine = build(source_dir, optimized_dir, optimized_args + ["-DPGO=use"], args.jobs)
+
+    results = {}
+    failed = False
+    for name, engine in (("reference", reference_engine), ("optimized", optimized_engine)):
+        print("Engine: %s" % name)
+        runner = benchmark.BenchmarkRunner(definition, engine, settings, models_dir, args.threads, args.repetitions)
+        results[name] = {}
+        for benchmark_name in args.benchmarks:
+            result = runner.run(benchmark_name)
+            results[name][benchmark_name] = result
+            if result is None:
+                failed = True
+                continue
+            print("  %-25s wall time: %.3fs, peak memory: %.1fMB" % (benchmark_name, result["wall_seconds"], result["peak_memory_mb"]))
+
+    print("Speedup of the optimized engine:")
+    speedups = []
+    for benchmark_name in args.benchmarks:
+        reference = results["reference"][benchmark_name]
+        optimized = results["optimized"][benchmark_name]
+        if reference is None or optimized is None:
+            continue
+        speedup = reference["wall_seconds"] / max(optimized["wall_seconds"], 1e-6)
+        speedups.append(speedup)
+        print("  %-25s %.3fx" % (benchmark_name, speedup))
+    if speedups:
+        print("  %-25s %.3fx" % ("geometric mean", math.exp(sum(math.log(speedup) for speedup in speedups) / len(speedups))))
+    print("Optimized engine: %s" % optimized_engine)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent = 4, sort_keys = True)
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,104 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "SettingsTest.h"
+
+#include <cstdio> // remove
+#include <cstdlib> // mkstemp
+#include <fstream>
+#include <unistd.h> // close
+
+#include "../src/settings/settings.h"
+#include "../src/settings/SettingRegistry.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(SettingsTest);
+
+void SettingsTest::setUp()
+{
+    //Do nothing.
+}
+
+void SettingsTest::tearDown()
+{
+    //Do nothing.
+}
+
+void SettingsTest::flattenedInheritanceTest()
+{
+    SettingsBase root;
+    root.setSetting("test_root_setting", "1");
+    root.setSetting("test_overridden_setting", "2");
+    SettingsBase group(&root);
+    group.setSetting("test_overridden_setting", "3");
+    SettingsBase mesh(&group);
+    group.flattenSettings();
+    mesh.flattenSettings();
+
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A setting of the root must be inherited.", std::string("1"), mesh.getSettingString("test_root_setting"));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The setting of the nearest ancestor must be found.", std::string("3"), mesh.getSettingString("test_overridden_setting"));
+
+    root.setSetting("test_root_setting", "4");
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A value changed in an ancestor after flattening must be seen.", std::string("4"), mesh.getSettingString("test_root_setting"));
+
+    mesh.setSetting("test_root_setting", "5");
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The own setting of an object must be found first.", std::string("5"), mesh.getSettingString("test_root_setting"));
+    CPPUNIT_ASSERT_MESSAGE("A setting which isn't given anywhere must not be found.", !mesh.hasSetting("test_missing_setting"));
+}
+
+void SettingsTest::flattenedLaterAncestorSettingTest()
+{
+    SettingsBase root;
+    SettingsBase group(&root);
+    SettingsBase mesh(&group);
+    group.flattenSettings();
+    mesh.flattenSettings();
+
+    root.setSetting("test_later_setting", "1");
+    CPPUNIT_ASSERT_MESSAGE("A setting the root gets after flattening must be found in its child.", group.hasSetting("test_later_setting"));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A setting the root gets after flattening must be found in its grandchild.", std::string("1"), mesh.getSettingString("test_later_setting"));
+
+    group.setSetting("test_later_group_setting", "2");
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A setting the parent gets after flattening must be found.", std::string("2"), mesh.getSettingString("test_later_group_setting"));
+}
+
+void SettingsTest::typedValuesTest()
+{
+    char filename[] = "/tmp/settings_test_XXXXXX";
+    const int file_descriptor = mkstemp(filename);
+    CPPUNIT_ASSERT_MESSAGE("A temporary definition file must be created.", file_descriptor >= 0);
+    close(file_descriptor);
+    std::ofstream(filename) << "{\"settings\": {"
+        "\"test_typed_length\": {\"label\": \"Length\", \"type\": \"float\", \"default_value\": \"1.5\"},"
+        "\"test_typed_count\": {\"label\": \"Count\", \"type\": \"int\", \"default_value\": \"3\"},"
+        "\"test_typed_enabled\": {\"label\": \"Enabled\", \"type\": \"bool\", \"default_value\": \"True\"}"
+        "}}";
+    SettingsBase root;
+    const int error = SettingRegistry::getInstance()->loadJSONsettings(filename, &root);
+    std::remove(filename);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The definition file must be loaded.", 0, error);
+    SettingsBase group(&root);
+    SettingsBase mesh(&group);
+    group.flattenSettings();
+    mesh.flattenSettings();
+
+    CPPUNIT_ASSERT_MESSAGE("The value of a registered setting must be cached.", mesh.findTypedSettingValue("test_typed_length") != nullptr);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A length must be read from the cache.", coord_t(1500), mesh.getSettingInMicrons("test_typed_length"));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A count must be read from the cache.", 3, mesh.getSettingAsCount("test_typed_count"));
+    CPPUNIT_ASSERT_MESSAGE("A boolean must be read from the cache.", mesh.getSettingBoolean("test_typed_enabled"));
+
+    root.setSetting("test_typed_length", "2.5");
+    CPPUNIT_ASSERT_MESSAGE("A value changed in an ancestor must not be read from the cache.", mesh.findTypedSettingValue("test_typed_length") == nullptr);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A value changed in an ancestor must be seen.", coord_t(2500), mesh.getSettingInMicrons("test_typed_length"));
+    mesh.setSetting("test_typed_count", "7");
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("A value given to the object itself must be seen.", 7, mesh.getSettingAsCount("test_typed_count"));
+    CPPUNIT_ASSERT_MESSAGE("Other settings must still be read from the cache.", mesh.findTypedSettingValue("test_typed_enabled") != nullptr);
+
+    mesh.flattenSettings();
+    CPPUNIT_ASSERT_MESSAGE("Flattening again must cache the changed values.", mesh.findTypedSettingValue("test_typed_count") != nullptr);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The changed length must be cached.", coord_t(2500), mesh.getSettingInMicrons("test_typed_length"));
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The changed count must be cached.", 7, mesh.getSettingAsCount("test_typed_count"));
+}
+
+}
@@ -0,0 +1,50 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef SETTINGS_TEST_H
+#define SETTINGS_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+namespace cura
+{
+
+class SettingsTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SettingsTest);
+    CPPUNIT_TEST(flattenedInheritanceTest);
+    CPPUNIT_TEST(flattenedLaterAncestorSettingTest);
+    CPPUNIT_TEST(typedValuesTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether a flattened settings object finds the same values as before flattening, its own settings first and changed values included.
+     */
+    void flattenedInheritanceTest();
+
+    /*!
+     * \brief Test whether a flattened settings object finds the settings which its ancestors only got after it was flattened.
+     */
+    void flattenedLaterAncestorSettingTest();
+
+    /*!
+     * \brief Test whether the values of registered settings are parsed when flattening, and parsed again once changed.
+     */
+    void typedValuesTest();
+};
+
+}
+
+#endif //SETTINGS_TEST_H
@@ -0,0 +1,80 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "ArenaTest.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(ArenaTest);
+
+void ArenaTest::setUp()
+{
+    //Do nothing.
+}
+
+void ArenaTest::tearDown()
+{
+    //Do nothing.
+}
+
+void ArenaTest::alignmentTest()
+{
+    Arena arena(1024);
+    char* first = static_cast<char*>(arena.allocate(3, 1));
+    memset(first, 1, 3);
+    char* second = static_cast<char*>(arena.allocate(16, 8));
+    CPPUNIT_ASSERT_EQUAL(uintptr_t(0), reinterpret_cast<uintptr_t>(second) % 8);
+    CPPUNIT_ASSERT(second >= first + 3);
+    memset(second, 2, 16);
+    char* large = static_cast<char*>(arena.allocate(5000, 8)); // larger than a block
+    CPPUNIT_ASSERT_EQUAL(uintptr_t(0), reinterpret_cast<uintptr_t>(large) % 8);
+    memset(large, 3, 5000);
+    char* third = static_cast<char*>(arena.allocate(8, 8)); // still from the first block
+    CPPUNIT_ASSERT(third >= second + 16 && third < first + 1024);
+    CPPUNIT_ASSERT_EQUAL(char(1), first[2]);
+    CPPUNIT_ASSERT_EQUAL(char(2), second[15]);
+    CPPUNIT_ASSERT_EQUAL(size_t(1024 + 5000), arena.getMemoryUsage());
+}
+
+void ArenaTest::vectorTest()
+{
+    Arena arena(256);
+    std::vector<int, ArenaAllocator<int>> first{ArenaAllocator<int>(arena)};
+    std::vector<int, ArenaAllocator<int>> second{ArenaAllocator<int>(arena)};
+    for (int value = 0; value < 1000; value++)
+    {
+        first.push_back(value);
+        second.push_back(-value);
+    }
+    for (int value = 0; value < 1000; value++)
+    {
+        CPPUNIT_ASSERT_EQUAL(value, first[value]);
+        CPPUNIT_ASSERT_EQUAL(-value, second[value]);
+    }
+}
+
+void ArenaTest::resetTest()
+{
+    Arena arena(1024);
+    CPPUNIT_ASSERT_EQUAL(size_t(0), arena.getMemoryUsage());
+    for (unsigned int allocation_idx = 0; allocation_idx < 6; allocation_idx++)
+    {
+        arena.allocate(200, 4); // five in a block
+    }
+    arena.allocate(2000, 4);
+    CPPUNIT_ASSERT_EQUAL(size_t(2 * 1024 + 2000), arena.getMemoryUsage());
+    arena.reset(1024);
+    CPPUNIT_ASSERT_EQUAL(size_t(1024), arena.getMemoryUsage());
+    const char* first = static_cast<char*>(arena.allocate(200, 4)); // from the block kept
+    CPPUNIT_ASSERT_EQUAL(size_t(1024), arena.getMemoryUsage());
+    arena.reset(1024);
+    CPPUNIT_ASSERT(first == arena.allocate(200, 4));
+    arena.reset(0);
+    CPPUNIT_ASSERT_EQUAL(size_t(0), arena.getMemoryUsage());
+}
+
+}
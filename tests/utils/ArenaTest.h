@@ -0,0 +1,52 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef ARENA_TEST_H
+#define ARENA_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/Arena.h"
+
+namespace cura
+{
+
+class ArenaTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ArenaTest);
+    CPPUNIT_TEST(alignmentTest);
+    CPPUNIT_TEST(vectorTest);
+    CPPUNIT_TEST(resetTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether allocations are aligned and don't overlap, including allocations larger than a block.
+     */
+    void alignmentTest();
+
+    /*!
+     * \brief Test whether vectors keep their contents while growing in an arena.
+     */
+    void vectorTest();
+
+    /*!
+     * \brief Test whether resetting keeps the blocks up to the limit to allocate from again.
+     */
+    void resetTest();
+};
+
+}
+
+#endif //ARENA_TEST_H
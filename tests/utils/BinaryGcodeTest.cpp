@@ -0,0 +1,100 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "BinaryGcodeTest.h"
+
+#include <sstream>
+#include <../src/utils/BinaryGcode.h>
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(BinaryGcodeTest);
+
+void BinaryGcodeTest::setUp()
+{
+    //Do nothing.
+}
+
+void BinaryGcodeTest::tearDown()
+{
+    //Do nothing.
+}
+
+void BinaryGcodeTest::roundTripMovesTest()
+{
+    roundTripAssert(
+        "G0 F9000 X106.958 Y99.754 Z0.3\n"
+        ";TYPE:WALL-INNER\n"
+        "G1 F1800 X107.456 Y100.164 E0.02145\n"
+        "G1 X-.5 Y-12.25 E12.5\n"
+        "G1 F2700 E7.5\n"
+        "G1 X107.5 Y100 Z2.3 F1200\n"
+        ";TYPE:SKIN\n"
+        "G0 X0 Y0\n");
+}
+
+void BinaryGcodeTest::roundTripLiteralsTest()
+{
+    roundTripAssert(
+        ";FLAVOR:Marlin\n"
+        "M104 S200\n"
+        "\n"
+        ";TYPE:SOMETHING-ELSE\n"
+        "G1 X1.0001 Y2\n" // too many decimals
+        "G1 X1.50\n" // not the way GCodeExport writes it
+        "G1 Z-0\n"
+        "G1 X1 ;comment\n"
+        "G1  X1\n"
+        "G1 A0.5\n"
+        "G0\n"
+        "G28\n");
+}
+
+void BinaryGcodeTest::roundTripCrlfTest()
+{
+    roundTripAssert("G1 F1500 X1 Y2 E0.1\r\n;TYPE:FILL\r\nM107\r\n");
+}
+
+void BinaryGcodeTest::roundTripUnfinishedLineTest()
+{
+    roundTripAssert("G1 X1 Y2\nG1 X3 Y4");
+}
+
+void BinaryGcodeTest::compressionTest()
+{
+    std::ostringstream gcode;
+    for (int i = 0; i < 100; i++)
+    {
+        gcode << "G1 X" << (100 + i) << ".125 Y" << (100 - i) << ".5 E" << i << ".12345\n";
+    }
+    const std::string binary = encode(gcode.str());
+    CPPUNIT_ASSERT_MESSAGE("Binary gcode must be smaller than the text.", binary.size() * 2 < gcode.str().size());
+}
+
+void BinaryGcodeTest::invalidInputTest()
+{
+    std::istringstream in("G1 X1 Y2\n");
+    std::ostringstream out;
+    CPPUNIT_ASSERT_MESSAGE("Text gcode must not be accepted as binary gcode.", !BinaryGcode::decode(in, out));
+}
+
+std::string BinaryGcodeTest::encode(const std::string& gcode)
+{
+    std::ostringstream binary;
+    {
+        BinaryGcodeEncoder encoder(binary);
+        std::ostream text(&encoder);
+        text << gcode;
+    }
+    return binary.str();
+}
+
+void BinaryGcodeTest::roundTripAssert(const std::string& gcode)
+{
+    std::istringstream binary(encode(gcode));
+    std::ostringstream decoded;
+    CPPUNIT_ASSERT_MESSAGE("Decoding binary gcode failed.", BinaryGcode::decode(binary, decoded));
+    CPPUNIT_ASSERT_EQUAL(gcode, decoded.str());
+}
+
+}
@@ -0,0 +1,80 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef BINARY_GCODE_TEST_H
+#define BINARY_GCODE_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+namespace cura
+{
+
+class BinaryGcodeTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(BinaryGcodeTest);
+    CPPUNIT_TEST(roundTripMovesTest);
+    CPPUNIT_TEST(roundTripLiteralsTest);
+    CPPUNIT_TEST(roundTripCrlfTest);
+    CPPUNIT_TEST(roundTripUnfinishedLineTest);
+    CPPUNIT_TEST(compressionTest);
+    CPPUNIT_TEST(invalidInputTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether move lines as written by GCodeExport are decoded exactly.
+     */
+    void roundTripMovesTest();
+
+    /*!
+     * \brief Test whether lines which can't be encoded compactly are decoded exactly.
+     */
+    void roundTripLiteralsTest();
+
+    /*!
+     * \brief Test whether windows line endings are preserved.
+     */
+    void roundTripCrlfTest();
+
+    /*!
+     * \brief Test whether text after the last new line is preserved.
+     */
+    void roundTripUnfinishedLineTest();
+
+    /*!
+     * \brief Test whether move lines take less space than their text.
+     */
+    void compressionTest();
+
+    /*!
+     * \brief Test whether decoding fails on something which isn't binary gcode.
+     */
+    void invalidInputTest();
+
+private:
+    /*!
+     * \brief Encode the gcode and return the binary data.
+     */
+    std::string encode(const std::string& gcode);
+
+    /*!
+     * \brief Encode and decode the gcode and assert that the result equals the original.
+     */
+    void roundTripAssert(const std::string& gcode);
+};
+
+}
+
+#endif //BINARY_GCODE_TEST_H
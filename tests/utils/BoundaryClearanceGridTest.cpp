@@ -0,0 +1,147 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "BoundaryClearanceGridTest.h"
+
+#include <cmath>
+
+#include "../src/utils/polygonUtils.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(BoundaryClearanceGridTest);
+
+void BoundaryClearanceGridTest::setUp()
+{
+    //Do nothing.
+}
+
+void BoundaryClearanceGridTest::tearDown()
+{
+    //Do nothing.
+}
+
+void BoundaryClearanceGridTest::partsWithHolesTest()
+{
+    Polygons polygons;
+    PolygonRef outer = polygons.newPoly();
+    outer.emplace_back(0, 0);
+    outer.emplace_back(100000, 0);
+    outer.emplace_back(100000, 100000);
+    outer.emplace_back(0, 100000);
+    PolygonRef hole = polygons.newPoly();
+    hole.emplace_back(20000, 20000);
+    hole.emplace_back(20000, 80000);
+    hole.emplace_back(80000, 80000);
+    hole.emplace_back(80000, 20000);
+    PolygonRef island = polygons.newPoly();
+    island.emplace_back(40000, 40000);
+    island.emplace_back(60000, 40000);
+    island.emplace_back(60000, 60000);
+    island.emplace_back(40000, 60000);
+    PolygonRef other = polygons.newPoly();
+    other.emplace_back(130000, 10000);
+    other.emplace_back(170000, 50000);
+    other.emplace_back(130000, 90000);
+    assertClassifiedCorrectly(polygons, 1000);
+}
+
+void BoundaryClearanceGridTest::circleTest()
+{
+    Polygons polygons;
+    PolygonRef circle = polygons.newPoly();
+    constexpr int point_count = 3000;
+    for (int point_idx = 0; point_idx < point_count; point_idx++)
+    {
+        const double angle = 2 * M_PI * point_idx / point_count;
+        circle.emplace_back(50000 * std::cos(angle), 50000 * std::sin(angle));
+    }
+    PolygonRef diagonal = polygons.newPoly(); // a thin diagonal part
+    diagonal.emplace_back(60000, 0);
+    diagonal.emplace_back(160000, 100000);
+    diagonal.emplace_back(159000, 101000);
+    diagonal.emplace_back(59000, 1000);
+    assertClassifiedCorrectly(polygons, 300);
+}
+
+void BoundaryClearanceGridTest::emptyTest()
+{
+    const Polygons empty;
+    const BoundaryClearanceGrid grid(empty, std::vector<unsigned int>(), 0, 1000);
+    CPPUNIT_ASSERT_EQUAL(NO_INDEX, grid.getFarPart(Point(100, 200)));
+}
+
+void BoundaryClearanceGridTest::assertClassifiedCorrectly(Polygons polygons, coord_t clearance)
+{
+    const PartsView parts_view = polygons.splitIntoPartsView(); // reorders the polygons
+    std::vector<unsigned int> poly_part_idx(polygons.size(), NO_INDEX);
+    std::vector<PolygonsPart> parts;
+    for (unsigned int part_idx = 0; part_idx < parts_view.size(); part_idx++)
+    {
+        parts.emplace_back(parts_view.assemblePart(part_idx));
+        for (unsigned int poly_idx : parts_view[part_idx])
+        {
+            poly_part_idx[poly_idx] = part_idx;
+        }
+    }
+    const BoundaryClearanceGrid grid(polygons, poly_part_idx, parts_view.size(), clearance);
+
+    const AABB aabb(polygons);
+    const coord_t step = std::max(aabb.max.X - aabb.min.X, aabb.max.Y - aabb.min.Y) / 97 + 1;
+    std::vector<Point> locations;
+    unsigned int far_count = 0;
+    unsigned int classified_count = 0;
+    for (coord_t x = aabb.min.X - 20000; x <= aabb.max.X + 20000; x += step)
+    {
+        for (coord_t y = aabb.min.Y - 20000; y <= aabb.max.Y + 20000; y += step)
+        {
+            const Point location(x, y);
+            locations.push_back(location);
+            const ClosestPolygonPoint closest = PolygonUtils::findClosest(location, polygons);
+            const bool is_far = vSize(closest.location - location) > clearance;
+            unsigned int part_idx = NO_INDEX;
+            for (unsigned int candidate_idx = 0; candidate_idx < parts.size(); candidate_idx++)
+            {
+                if (parts[candidate_idx].inside(location))
+                {
+                    part_idx = candidate_idx;
+                }
+            }
+            const unsigned int far_part_idx = grid.getFarPart(location);
+            if (far_part_idx != BoundaryClearanceGrid::near_boundary)
+            {
+                CPPUNIT_ASSERT_MESSAGE("A classified location must lie further than the clearance from the boundary.", is_far);
+                CPPUNIT_ASSERT_EQUAL(part_idx, far_part_idx);
+                classified_count++;
+            }
+            far_count += is_far;
+        }
+    }
+    CPPUNIT_ASSERT_MESSAGE("Most locations far from the boundary should be classified.", classified_count * 2 > far_count);
+
+    // line segments between the locations, which must lie in the part along their whole length
+    unsigned int far_segment_count = 0;
+    for (unsigned int from_idx = 0; from_idx < locations.size(); from_idx += 173)
+    {
+        for (unsigned int to_idx = from_idx % 181; to_idx < locations.size(); to_idx += 181)
+        {
+            const Point from = locations[from_idx];
+            const Point to = locations[to_idx];
+            const unsigned int far_part_idx = grid.getFarPart(from, to);
+            if (far_part_idx == BoundaryClearanceGrid::near_boundary)
+            {
+                continue;
+            }
+            far_segment_count++;
+            for (int sample_idx = 0; sample_idx <= 10; sample_idx++)
+            {
+                const Point sample = from + (to - from) * sample_idx / 10;
+                CPPUNIT_ASSERT_MESSAGE("A classified line segment must lie in its part.", parts[far_part_idx].inside(sample));
+                CPPUNIT_ASSERT_MESSAGE("A classified line segment must lie further than the clearance from the boundary.", vSize(PolygonUtils::findClosest(sample, polygons).location - sample) > clearance);
+            }
+        }
+    }
+    CPPUNIT_ASSERT_MESSAGE("Some line segments should be classified.", far_segment_count > 0);
+}
+
+}
@@ -0,0 +1,58 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef BOUNDARY_CLEARANCE_GRID_TEST_H
+#define BOUNDARY_CLEARANCE_GRID_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/BoundaryClearanceGrid.h"
+
+namespace cura
+{
+
+class BoundaryClearanceGridTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(BoundaryClearanceGridTest);
+    CPPUNIT_TEST(partsWithHolesTest);
+    CPPUNIT_TEST(circleTest);
+    CPPUNIT_TEST(emptyTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test a square with a hole containing an island, next to another square.
+     */
+    void partsWithHolesTest();
+
+    /*!
+     * \brief Test a circle with many points, of which many cells lie near a long diagonal segment.
+     */
+    void circleTest();
+
+    /*!
+     * \brief Test whether everything lies outside of no polygons.
+     */
+    void emptyTest();
+
+private:
+    /*!
+     * \brief Assert that each point the grid classifies lies in that part and far from the boundary, and that most far points are classified, and likewise for line segments between them.
+     */
+    void assertClassifiedCorrectly(Polygons polygons, coord_t clearance);
+};
+
+}
+
+#endif //BOUNDARY_CLEARANCE_GRID_TEST_H
@@ -0,0 +1,99 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "CompactPolygonsTest.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(CompactPolygonsTest);
+
+void CompactPolygonsTest::setUp()
+{
+    //Do nothing.
+}
+
+void CompactPolygonsTest::tearDown()
+{
+    //Do nothing.
+}
+
+void CompactPolygonsTest::roundTripTest()
+{
+    Polygons polygons;
+    PolygonRef square = polygons.newPoly();
+    square.emplace_back(0, 0);
+    square.emplace_back(1000, 0);
+    square.emplace_back(1000, 1000);
+    square.emplace_back(0, 1000);
+    polygons.newPoly(); // an empty polygon is kept
+    PolygonRef far = polygons.newPoly();
+    far.emplace_back(-2000000000, 2000000000);
+    far.emplace_back(2000000000, -2000000000);
+    far.emplace_back(-123456, -654321);
+
+    const CompactPolygons compact(polygons);
+    CPPUNIT_ASSERT_EQUAL(polygons.size(), compact.size());
+    CPPUNIT_ASSERT_EQUAL(polygons.pointCount(), compact.pointCount());
+    CPPUNIT_ASSERT(!compact.empty());
+    assertIdentical(polygons, compact.toPolygons());
+}
+
+void CompactPolygonsTest::emptyTest()
+{
+    const CompactPolygons compact = CompactPolygons(Polygons());
+    CPPUNIT_ASSERT(compact.empty());
+    CPPUNIT_ASSERT_EQUAL(0u, compact.size());
+    CPPUNIT_ASSERT(compact.toPolygons().empty());
+    CPPUNIT_ASSERT(CompactPolygons().empty());
+}
+
+void CompactPolygonsTest::addToTest()
+{
+    Polygons first;
+    PolygonRef triangle = first.newPoly();
+    triangle.emplace_back(0, 0);
+    triangle.emplace_back(100, 0);
+    triangle.emplace_back(0, 100);
+    Polygons second;
+    PolygonRef line = second.newPoly();
+    line.emplace_back(500, 500);
+    line.emplace_back(600, 700);
+
+    Polygons result = first;
+    CompactPolygons(second).addTo(result);
+
+    Polygons expected = first;
+    expected.add(second);
+    assertIdentical(expected, result);
+}
+
+void CompactPolygonsTest::memoryUsageTest()
+{
+    Polygons polygons;
+    for (int polygon_idx = 0; polygon_idx < 10; polygon_idx++)
+    {
+        PolygonRef polygon = polygons.newPoly();
+        for (int point_idx = 0; point_idx < 100; point_idx++)
+        {
+            polygon.emplace_back(polygon_idx * 1000 + point_idx, point_idx * 10);
+        }
+    }
+    const CompactPolygons compact(polygons);
+    CPPUNIT_ASSERT(compact.getMemoryUsage() * 2 <= polygons.getMemoryUsage());
+}
+
+void CompactPolygonsTest::assertIdentical(const Polygons& expected, const Polygons& actual)
+{
+    CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+    for (unsigned int polygon_idx = 0; polygon_idx < expected.size(); polygon_idx++)
+    {
+        CPPUNIT_ASSERT_EQUAL(expected[polygon_idx].size(), actual[polygon_idx].size());
+        for (unsigned int point_idx = 0; point_idx < expected[polygon_idx].size(); point_idx++)
+        {
+            CPPUNIT_ASSERT_EQUAL(expected[polygon_idx][point_idx].X, actual[polygon_idx][point_idx].X);
+            CPPUNIT_ASSERT_EQUAL(expected[polygon_idx][point_idx].Y, actual[polygon_idx][point_idx].Y);
+        }
+    }
+}
+
+}
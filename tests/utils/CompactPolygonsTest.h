@@ -0,0 +1,64 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef COMPACT_POLYGONS_TEST_H
+#define COMPACT_POLYGONS_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/CompactPolygons.h"
+
+namespace cura
+{
+
+class CompactPolygonsTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(CompactPolygonsTest);
+    CPPUNIT_TEST(roundTripTest);
+    CPPUNIT_TEST(emptyTest);
+    CPPUNIT_TEST(addToTest);
+    CPPUNIT_TEST(memoryUsageTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether the polygons are the same after storing them, including negative and large coordinates and empty polygons.
+     */
+    void roundTripTest();
+
+    /*!
+     * \brief Test whether storing no polygons gives no polygons.
+     */
+    void emptyTest();
+
+    /*!
+     * \brief Test whether the polygons are appended to the polygons already present.
+     */
+    void addToTest();
+
+    /*!
+     * \brief Test whether the stored polygons take less memory than the original.
+     */
+    void memoryUsageTest();
+
+private:
+    /*!
+     * \brief Assert that two polygons have the same points in the same order.
+     */
+    void assertIdentical(const Polygons& expected, const Polygons& actual);
+};
+
+}
+
+#endif //COMPACT_POLYGONS_TEST_H
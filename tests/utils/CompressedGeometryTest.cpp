@@ -0,0 +1,117 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "CompressedGeometryTest.h"
+
+#include <limits>
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(CompressedGeometryTest);
+
+void CompressedGeometryTest::setUp()
+{
+    //Do nothing.
+}
+
+void CompressedGeometryTest::tearDown()
+{
+    //Do nothing.
+}
+
+void CompressedGeometryTest::numbersTest()
+{
+    const std::vector<uint64_t> unsigned_numbers = {0, 1, 127, 128, 300, std::numeric_limits<uint64_t>::max()};
+    const std::vector<int64_t> signed_numbers = {0, -1, 1, -64, 64, -1000000, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()};
+    std::vector<uint8_t> buffer;
+    CompressedGeometryWriter writer(buffer);
+    for (uint64_t number : unsigned_numbers)
+    {
+        writer.writeUnsigned(number);
+    }
+    for (int64_t number : signed_numbers)
+    {
+        writer.writeSigned(number);
+    }
+    writer.writeDouble(0.1);
+
+    CompressedGeometryReader reader(buffer);
+    for (uint64_t number : unsigned_numbers)
+    {
+        CPPUNIT_ASSERT_EQUAL(number, reader.readUnsigned());
+    }
+    for (int64_t number : signed_numbers)
+    {
+        CPPUNIT_ASSERT_EQUAL(number, reader.readSigned());
+    }
+    CPPUNIT_ASSERT_EQUAL(0.1, reader.readDouble());
+    CPPUNIT_ASSERT(reader.atEnd());
+}
+
+void CompressedGeometryTest::polygonsTest()
+{
+    Polygons first;
+    PolygonRef square = first.newPoly();
+    square.emplace_back(0, 0);
+    square.emplace_back(1000, 0);
+    square.emplace_back(1000, 1000);
+    square.emplace_back(0, 1000);
+    first.newPoly();
+    PolygonRef far = first.newPoly();
+    far.emplace_back(-2000000000000, 2000000000000);
+    far.emplace_back(2000000000000, -2000000000000);
+    Polygons second;
+    PolygonRef triangle = second.newPoly();
+    triangle.emplace_back(-5000, 7000);
+    triangle.emplace_back(3000, -2000);
+    triangle.emplace_back(-123456, -654321);
+
+    std::vector<uint8_t> buffer;
+    CompressedGeometryWriter writer(buffer);
+    writer.writePolygons(first);
+    writer.writeSigned(-1);
+    writer.writePolygons(Polygons());
+    writer.writePolygons(second);
+
+    CompressedGeometryReader reader(buffer);
+    Polygons first_result;
+    reader.readPolygons(first_result);
+    assertIdentical(first, first_result);
+    CPPUNIT_ASSERT_EQUAL(int64_t(-1), reader.readSigned());
+    Polygons empty_result;
+    reader.readPolygons(empty_result);
+    CPPUNIT_ASSERT(empty_result.empty());
+    Polygons second_result;
+    reader.readPolygons(second_result);
+    assertIdentical(second, second_result);
+    CPPUNIT_ASSERT(reader.atEnd());
+}
+
+void CompressedGeometryTest::sizeTest()
+{
+    Polygons polygons;
+    PolygonRef polygon = polygons.newPoly();
+    for (int point_idx = 0; point_idx < 1000; point_idx++)
+    {
+        polygon.emplace_back(100000 + point_idx * 50, 100000 + (point_idx % 10) * 30);
+    }
+    std::vector<uint8_t> buffer;
+    CompressedGeometryWriter(buffer).writePolygons(polygons);
+    CPPUNIT_ASSERT(buffer.size() <= 4 * polygon.size() + 16);
+}
+
+void CompressedGeometryTest::assertIdentical(const Polygons& expected, const Polygons& actual)
+{
+    CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+    for (unsigned int polygon_idx = 0; polygon_idx < expected.size(); polygon_idx++)
+    {
+        CPPUNIT_ASSERT_EQUAL(expected[polygon_idx].size(), actual[polygon_idx].size());
+        for (unsigned int point_idx = 0; point_idx < expected[polygon_idx].size(); point_idx++)
+        {
+            CPPUNIT_ASSERT_EQUAL(expected[polygon_idx][point_idx].X, actual[polygon_idx][point_idx].X);
+            CPPUNIT_ASSERT_EQUAL(expected[polygon_idx][point_idx].Y, actual[polygon_idx][point_idx].Y);
+        }
+    }
+}
+
+}
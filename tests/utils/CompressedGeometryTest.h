@@ -0,0 +1,58 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef COMPRESSED_GEOMETRY_TEST_H
+#define COMPRESSED_GEOMETRY_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/CompressedGeometry.h"
+
+namespace cura
+{
+
+class CompressedGeometryTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(CompressedGeometryTest);
+    CPPUNIT_TEST(numbersTest);
+    CPPUNIT_TEST(polygonsTest);
+    CPPUNIT_TEST(sizeTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether numbers are read back as written, including the extremes of their range.
+     */
+    void numbersTest();
+
+    /*!
+     * \brief Test whether polygons are read back as written, including empty polygons, in between other numbers.
+     */
+    void polygonsTest();
+
+    /*!
+     * \brief Test whether a polygon with points close together takes a few bytes per point.
+     */
+    void sizeTest();
+
+private:
+    /*!
+     * \brief Assert that two polygons have the same points in the same order.
+     */
+    void assertIdentical(const Polygons& expected, const Polygons& actual);
+};
+
+}
+
+#endif //COMPRESSED_GEOMETRY_TEST_H
@@ -0,0 +1,98 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "FlatPolygonsTest.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(FlatPolygonsTest);
+
+void FlatPolygonsTest::setUp()
+{
+    polygons.clear();
+    PolygonRef square = polygons.newPoly();
+    square.emplace_back(0, 0);
+    square.emplace_back(1000, 0);
+    square.emplace_back(1000, 1000);
+    square.emplace_back(0, 1000);
+    polygons.newPoly();
+    PolygonRef triangle = polygons.newPoly();
+    triangle.emplace_back(-5000, 7000);
+    triangle.emplace_back(3000, -2000);
+    triangle.emplace_back(-123456, -654321);
+}
+
+void FlatPolygonsTest::tearDown()
+{
+    //Do nothing.
+}
+
+void FlatPolygonsTest::viewTest()
+{
+    const FlatPolygons flat(polygons);
+    CPPUNIT_ASSERT_EQUAL(polygons.size(), flat.size());
+    CPPUNIT_ASSERT_EQUAL(polygons.pointCount(), flat.pointCount());
+    unsigned int polygon_idx = 0;
+    for (ConstFlatPolygonRef polygon : flat)
+    {
+        ConstPolygonRef original = polygons[polygon_idx];
+        CPPUNIT_ASSERT_EQUAL(original.size(), polygon.size());
+        unsigned int point_idx = 0;
+        for (const Point& point : polygon)
+        {
+            CPPUNIT_ASSERT(point == original[point_idx]);
+            CPPUNIT_ASSERT(point == flat[polygon_idx][point_idx]);
+            point_idx++;
+        }
+        CPPUNIT_ASSERT_EQUAL(original.size(), point_idx);
+        if (original.size() > 0)
+        {
+            CPPUNIT_ASSERT(polygon.back() == original.back());
+        }
+        polygon_idx++;
+    }
+    CPPUNIT_ASSERT_EQUAL(polygons.size(), polygon_idx);
+}
+
+void FlatPolygonsTest::roundTripTest()
+{
+    assertIdentical(polygons, FlatPolygons(polygons).toPolygons());
+}
+
+void FlatPolygonsTest::pathsTest()
+{
+    ClipperLib::Paths paths;
+    for (ConstPolygonRef polygon : polygons)
+    {
+        paths.emplace_back(polygon.begin(), polygon.end());
+    }
+    const ClipperLib::Paths result = FlatPolygons(paths).toPaths();
+    CPPUNIT_ASSERT(paths == result);
+}
+
+void FlatPolygonsTest::emptyTest()
+{
+    const FlatPolygons flat = FlatPolygons(Polygons());
+    CPPUNIT_ASSERT(flat.empty());
+    CPPUNIT_ASSERT_EQUAL(0u, flat.size());
+    CPPUNIT_ASSERT_EQUAL(0u, flat.pointCount());
+    CPPUNIT_ASSERT(flat.toPolygons().empty());
+    CPPUNIT_ASSERT(FlatPolygons().empty());
+    CPPUNIT_ASSERT(!(flat.begin() != flat.end()));
+}
+
+void FlatPolygonsTest::assertIdentical(const Polygons& expected, const Polygons& actual)
+{
+    CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+    for (unsigned int polygon_idx = 0; polygon_idx < expected.size(); polygon_idx++)
+    {
+        CPPUNIT_ASSERT_EQUAL(expected[polygon_idx].size(), actual[polygon_idx].size());
+        for (unsigned int point_idx = 0; point_idx < expected[polygon_idx].size(); point_idx++)
+        {
+            CPPUNIT_ASSERT_EQUAL(expected[polygon_idx][point_idx].X, actual[polygon_idx][point_idx].X);
+            CPPUNIT_ASSERT_EQUAL(expected[polygon_idx][point_idx].Y, actual[polygon_idx][point_idx].Y);
+        }
+    }
+}
+
+}
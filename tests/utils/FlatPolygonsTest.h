@@ -0,0 +1,66 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef FLAT_POLYGONS_TEST_H
+#define FLAT_POLYGONS_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/FlatPolygons.h"
+
+namespace cura
+{
+
+class FlatPolygonsTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(FlatPolygonsTest);
+    CPPUNIT_TEST(viewTest);
+    CPPUNIT_TEST(roundTripTest);
+    CPPUNIT_TEST(pathsTest);
+    CPPUNIT_TEST(emptyTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether the views on the polygons give the same points as the original polygons, also when iterating over them.
+     */
+    void viewTest();
+
+    /*!
+     * \brief Test whether converting back to Polygons gives the original polygons, including empty polygons.
+     */
+    void roundTripTest();
+
+    /*!
+     * \brief Test whether converting from and to Clipper paths gives the original paths.
+     */
+    void pathsTest();
+
+    /*!
+     * \brief Test whether storing no polygons gives no polygons.
+     */
+    void emptyTest();
+
+private:
+    Polygons polygons; //!< A square, an empty polygon and a triangle
+
+    /*!
+     * \brief Assert that two polygons have the same points in the same order.
+     */
+    void assertIdentical(const Polygons& expected, const Polygons& actual);
+};
+
+}
+
+#endif //FLAT_POLYGONS_TEST_H
@@ -0,0 +1,74 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "PolygonSegmentGridTest.h"
+
+#include <cmath>
+
+#include "../src/utils/polygonUtils.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(PolygonSegmentGridTest);
+
+void PolygonSegmentGridTest::setUp()
+{
+    //Do nothing.
+}
+
+void PolygonSegmentGridTest::tearDown()
+{
+    //Do nothing.
+}
+
+void PolygonSegmentGridTest::circleTest()
+{
+    Polygon circle;
+    constexpr int point_count = 5000;
+    for (int point_idx = 0; point_idx < point_count; point_idx++)
+    {
+        const double angle = 2 * M_PI * point_idx / point_count;
+        const coord_t radius = 50000 + (point_idx % 7) * 30; // slightly wobbly, like a real wall
+        circle.emplace_back(radius * std::cos(angle), radius * std::sin(angle));
+    }
+    assertSameAsFindClosest(circle, 200000);
+}
+
+void PolygonSegmentGridTest::thinTest()
+{
+    Polygon thin;
+    for (coord_t x = 0; x <= 100000; x += 1000)
+    {
+        thin.emplace_back(x, 0);
+    }
+    for (coord_t x = 100000; x >= 0; x -= 1000)
+    {
+        thin.emplace_back(x, 400 + x / 10000);
+    }
+    assertSameAsFindClosest(thin, 150000);
+}
+
+void PolygonSegmentGridTest::emptyTest()
+{
+    const Polygon empty;
+    const PolygonSegmentGrid grid(empty);
+    CPPUNIT_ASSERT_EQUAL(0u, grid.findClosestSegment(Point(100, 200)));
+}
+
+void PolygonSegmentGridTest::assertSameAsFindClosest(ConstPolygonRef polygon, coord_t spread)
+{
+    const PolygonSegmentGrid grid(polygon);
+    constexpr int steps = 40;
+    for (int x_step = 0; x_step <= steps; x_step++)
+    {
+        for (int y_step = 0; y_step <= steps; y_step++)
+        {
+            const Point from(-spread + 2 * spread * x_step / steps + 7 * y_step, -spread + 2 * spread * y_step / steps - 3 * x_step);
+            const ClosestPolygonPoint closest = PolygonUtils::findClosest(from, polygon);
+            CPPUNIT_ASSERT_EQUAL(closest.point_idx, grid.findClosestSegment(from));
+            CPPUNIT_ASSERT(closest.location == grid.findClosestPoint(from));
+        }
+    }
+}
+
+}
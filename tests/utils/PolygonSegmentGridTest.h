@@ -0,0 +1,58 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef POLYGON_SEGMENT_GRID_TEST_H
+#define POLYGON_SEGMENT_GRID_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/PolygonSegmentGrid.h"
+
+namespace cura
+{
+
+class PolygonSegmentGridTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(PolygonSegmentGridTest);
+    CPPUNIT_TEST(circleTest);
+    CPPUNIT_TEST(thinTest);
+    CPPUNIT_TEST(emptyTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether the closest segment of a wall with many points is the one PolygonUtils::findClosest finds, from inside and far outside.
+     */
+    void circleTest();
+
+    /*!
+     * \brief Test whether the closest segment of a long and thin polygon is the one PolygonUtils::findClosest finds.
+     */
+    void thinTest();
+
+    /*!
+     * \brief Test whether an empty polygon gives the first index.
+     */
+    void emptyTest();
+
+private:
+    /*!
+     * \brief Assert that the grid finds the same segment and closest point as PolygonUtils::findClosest for a number of points spread around the polygon.
+     */
+    void assertSameAsFindClosest(ConstPolygonRef polygon, coord_t spread);
+};
+
+}
+
+#endif //POLYGON_SEGMENT_GRID_TEST_H
@@ -3,10 +3,28 @@
 
 #include "PolygonTest.h"
 
+#include <random>
+
+#include "../src/utils/InstructionSet.h"
+#include "../src/utils/linearAlg2D.h"
+
 namespace cura
 {
     CPPUNIT_TEST_SUITE_REGISTRATION(PolygonTest);
 
+namespace
+{
+double totalArea(const Polygons& polygons)
+{
+    double area = 0;
+    for (ConstPolygonRef poly : polygons)
+    {
+        area += poly.area();
+    }
+    return area;
+}
+}
+
 void PolygonTest::setUp()
 {
     test_square.emplace_back(0, 0);
@@ -77,6 +95,142 @@ void PolygonTest::polygonOffsetBugTest()
     }
 }
 
+void PolygonTest::polygonOffsetTemporaryTest()
+{
+    Polygons polys;
+    polys.add(pointy_square);
+    polys.add(triangle);
+    const Polygons offsetted = polys.offset(20);
+    const Polygons offsetted_temporary = Polygons(polys).offset(20);
+
+    CPPUNIT_ASSERT_MESSAGE("Offsetting a temporary gives a different number of polygons!", offsetted.size() == offsetted_temporary.size());
+    for (unsigned int poly_idx = 0; poly_idx < offsetted.size(); poly_idx++)
+    {
+        CPPUNIT_ASSERT_MESSAGE("Offsetting a temporary gives a different polygon!", offsetted[poly_idx].size() == offsetted_temporary[poly_idx].size());
+        for (unsigned int point_idx = 0; point_idx < offsetted[poly_idx].size(); point_idx++)
+        {
+            CPPUNIT_ASSERT_MESSAGE("Offsetting a temporary gives a different point!", offsetted[poly_idx][point_idx] == offsetted_temporary[poly_idx][point_idx]);
+        }
+    }
+}
+
+void PolygonTest::polygonOffsetMultiTest()
+{
+    Polygons polys;
+    polys.add(pointy_square);
+    polys.add(triangle);
+    const std::vector<int> distances = {-20, 0, 35};
+    const std::vector<Polygons> offsetted = polys.offsetMulti(distances);
+
+    CPPUNIT_ASSERT_MESSAGE("Offsetting by multiple distances doesn't give a result per distance!", offsetted.size() == distances.size());
+    for (unsigned int distance_idx = 0; distance_idx < distances.size(); distance_idx++)
+    {
+        const Polygons offsetted_single = polys.offset(distances[distance_idx]);
+        CPPUNIT_ASSERT_MESSAGE("Offsetting by multiple distances gives a different number of polygons!", offsetted[distance_idx].size() == offsetted_single.size());
+        for (unsigned int poly_idx = 0; poly_idx < offsetted_single.size(); poly_idx++)
+        {
+            CPPUNIT_ASSERT_MESSAGE("Offsetting by multiple distances gives a different polygon!", offsetted[distance_idx][poly_idx].size() == offsetted_single[poly_idx].size());
+            for (unsigned int point_idx = 0; point_idx < offsetted_single[poly_idx].size(); point_idx++)
+            {
+                CPPUNIT_ASSERT_MESSAGE("Offsetting by multiple distances gives a different point!", offsetted[distance_idx][poly_idx][point_idx] == offsetted_single[poly_idx][point_idx]);
+            }
+        }
+    }
+}
+
+void PolygonTest::polygonOffsetConvexTest()
+{
+    CPPUNIT_ASSERT_MESSAGE("Square is not recognized as convex!", test_square.isStrictlyConvex());
+    CPPUNIT_ASSERT_MESSAGE("Triangle is not recognized as convex!", triangle.isStrictlyConvex());
+    CPPUNIT_ASSERT_MESSAGE("Pointy square is recognized as convex!", !pointy_square.isStrictlyConvex());
+    Polygon collinear;
+    collinear.emplace_back(0, 0);
+    collinear.emplace_back(100, 0);
+    collinear.emplace_back(100, 100);
+    collinear.emplace_back(0, 100);
+    collinear.emplace_back(0, 50);
+    CPPUNIT_ASSERT_MESSAGE("Polygon with a collinear vertex is recognized as strictly convex!", !collinear.isStrictlyConvex());
+    Polygon pentagram;
+    for (int point_idx = 0; point_idx < 5; point_idx++)
+    {
+        const double angle = 4 * M_PI * point_idx / 5;
+        pentagram.emplace_back(1000 * std::cos(angle), 1000 * std::sin(angle));
+    }
+    CPPUNIT_ASSERT_MESSAGE("Pentagram is recognized as convex!", !pentagram.isStrictlyConvex());
+
+    // the fast path for convex polygons must give exactly what the union followed by the offset gives, regardless of the start vertex and orientation
+    Polygon hexagon;
+    for (int point_idx = 0; point_idx < 6; point_idx++)
+    {
+        const double angle = 2 * M_PI * point_idx / 6 + 0.1;
+        hexagon.emplace_back(1000 * std::cos(angle), 1000 * std::sin(angle));
+    }
+    for (const ClipperLib::JoinType join_type : {ClipperLib::jtMiter, ClipperLib::jtRound})
+    {
+        for (const int distance : {-300, -5, 5, 300})
+        {
+            for (unsigned int start_idx = 0; start_idx < hexagon.size(); start_idx++)
+            {
+                for (const bool reversed : {false, true})
+                {
+                    ClipperLib::Path path = *hexagon;
+                    std::rotate(path.begin(), path.begin() + start_idx, path.end());
+                    if (reversed)
+                    {
+                        std::reverse(path.begin(), path.end());
+                    }
+                    ClipperLib::Paths unioned;
+                    ClipperLib::Clipper clipper;
+                    clipper.AddPath(path, ClipperLib::ptSubject, true);
+                    clipper.Execute(ClipperLib::ctUnion, unioned, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+                    ClipperLib::Paths expected;
+                    ClipperLib::ClipperOffset clipper_offset(1.2, 10.0);
+                    clipper_offset.AddPaths(unioned, join_type, ClipperLib::etClosedPolygon);
+                    clipper_offset.Execute(expected, distance);
+
+                    Polygons polys;
+                    PolygonRef poly = polys.newPoly();
+                    for (const Point& p : path)
+                    {
+                        poly.add(p);
+                    }
+                    const Polygons offsetted = polys.offset(distance, join_type);
+
+                    CPPUNIT_ASSERT_MESSAGE("Offsetting a convex polygon gives a different number of polygons than Clipper!", offsetted.size() == expected.size());
+                    for (unsigned int poly_idx = 0; poly_idx < expected.size(); poly_idx++)
+                    {
+                        CPPUNIT_ASSERT_MESSAGE("Offsetting a convex polygon gives a different polygon than Clipper!", *offsetted[poly_idx] == expected[poly_idx]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void PolygonTest::polygonIsIdenticalTest()
+{
+    Polygons polys;
+    polys.add(test_square);
+    polys.add(triangle);
+    Polygons same;
+    same.add(test_square);
+    same.add(triangle);
+    CPPUNIT_ASSERT_MESSAGE("Polygons with the same vertices are not identical!", polys.isIdentical(same));
+
+    Polygons reordered;
+    reordered.add(triangle);
+    reordered.add(test_square);
+    CPPUNIT_ASSERT_MESSAGE("Polygons in another order are identical!", !polys.isIdentical(reordered));
+
+    Polygons rotated;
+    rotated.add(test_square);
+    PolygonRef rotated_triangle = rotated.newPoly();
+    for (unsigned int point_idx = 1; point_idx <= triangle.size(); point_idx++)
+    {
+        rotated_triangle.add(triangle[point_idx % triangle.size()]);
+    }
+    CPPUNIT_ASSERT_MESSAGE("Polygons starting at another vertex are identical!", !polys.isIdentical(rotated));
+}
 
 void PolygonTest::isOutsideTest()
 {
@@ -112,6 +266,178 @@ void PolygonTest::isInsideTest()
 
 }
 
+void PolygonTest::insideSameAsClipperTest()
+{
+    // small coordinates, so that many points lie on vertices and on horizontal, vertical and diagonal edges
+    std::mt19937 random(1);
+    std::uniform_int_distribution<coord_t> coord(0, 20);
+    std::vector<Polygon> polys;
+    for (unsigned int vertex_count : {3, 4, 5, 10, 31, 32, 33, 34, 64, 65, 100, 200})
+    {
+        for (unsigned int poly_idx = 0; poly_idx < 5; poly_idx++)
+        {
+            Polygon poly;
+            for (unsigned int vertex_idx = 0; vertex_idx < vertex_count; vertex_idx++)
+            {
+                poly.add(Point(coord(random), coord(random)));
+            }
+            polys.push_back(poly);
+        }
+    }
+
+    const std::string detected_level = InstructionSet::getLevelName();
+    for (const char* level : {"baseline", "avx2", "avx512"})
+    {
+        if (!InstructionSet::setLevel(level))
+        {
+            continue;
+        }
+        for (const Polygon& polygon : polys)
+        {
+            const ConstPolygonRef poly(polygon);
+            for (coord_t x = -1; x <= 21; x++)
+            {
+                for (coord_t y = -1; y <= 21; y++)
+                {
+                    const Point p(x, y);
+                    const int clipper_result = ClipperLib::PointInPolygon(p, *poly);
+                    CPPUNIT_ASSERT_EQUAL_MESSAGE(std::string("PointInPolygon differs at level ") + level, clipper_result, VectorKernels::pointInPolygon(p, (*poly).data(), poly.size()));
+                    CPPUNIT_ASSERT_EQUAL(clipper_result == 1 || clipper_result == -1, poly.inside(p, true));
+                    CPPUNIT_ASSERT_EQUAL(clipper_result == 1, poly.inside(p, false));
+
+                    // the scalar loop ConstPolygonRef::_inside used to run
+                    int crossings = 0;
+                    bool on_border = false;
+                    Point p0 = poly.back();
+                    for (const Point& p1 : *poly)
+                    {
+                        const short comp = LinearAlg2D::pointLiesOnTheRightOfLine(p, p0, p1);
+                        crossings += (comp == 1);
+                        on_border |= (comp == 0);
+                        p0 = p1;
+                    }
+                    CPPUNIT_ASSERT_EQUAL_MESSAGE(std::string("_inside differs at level ") + level, on_border || crossings % 2 == 1, poly._inside(p, true));
+                    CPPUNIT_ASSERT_EQUAL_MESSAGE(std::string("_inside differs at level ") + level, !on_border && crossings % 2 == 1, poly._inside(p, false));
+                }
+            }
+        }
+    }
+    InstructionSet::setLevel(detected_level.c_str());
+}
+
+void PolygonTest::convexHullTest()
+{
+    Polygons pointy_squares;
+    pointy_squares.add(pointy_square);
+    Polygon hull = pointy_squares.convexHull();
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The hull of the pointy square should be the square with the upper spike.", size_t(5), hull.size());
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The hull should be the square with the triangle on top of it.", 100.0 * 100.0 + 100.0 * 80.0 / 2, hull.area());
+    for (const Point& p : pointy_square)
+    {
+        CPPUNIT_ASSERT_MESSAGE("A point of the polygon is outside of its hull.", hull.inside(p, true));
+    }
+
+    // The hull of several polygons, computed right after another hull, which must not leave points behind.
+    Polygons separate_polys;
+    separate_polys.add(triangle);
+    PolygonRef far_square = separate_polys.newPoly();
+    for (const Point& p : test_square)
+    {
+        far_square.add(p + Point(0, 1000));
+    }
+    Polygon combined_hull = separate_polys.convexHull();
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("The hull of the triangle and the square should have the outer corners of both.", size_t(5), combined_hull.size());
+    CPPUNIT_ASSERT_MESSAGE("The hull should contain the points of both polygons.", combined_hull.inside(Point(300, 0), true) && combined_hull.inside(Point(0, 1100), true));
+    CPPUNIT_ASSERT_MESSAGE("The hull should contain the space between the polygons.", combined_hull.inside(Point(150, 500)));
+    CPPUNIT_ASSERT_MESSAGE("The hull shouldn't contain the points of the previous hull.", !combined_hull.inside(Point(50, 180)));
+}
+
+void PolygonTest::smoothOutwardTest()
+{
+    Polygons square;
+    square.add(test_square);
+    Polygons smoothed_square = Polygons(square).smooth_outward(60, 2000);
+    CPPUNIT_ASSERT_MESSAGE("A convex polygon has no inner corners to smooth out.", smoothed_square.size() == 1 && smoothed_square[0].size() == 4 && totalArea(smoothed_square.difference(square)) == 0 && totalArea(square.difference(smoothed_square)) == 0);
+
+    // A square with a narrow notch of 3.8 degrees reaching down from the top side.
+    Polygons notched;
+    PolygonRef notched_poly = notched.newPoly();
+    notched_poly.add(Point(0, 0));
+    notched_poly.add(Point(10000, 0));
+    notched_poly.add(Point(10000, 10000));
+    notched_poly.add(Point(5200, 10000));
+    notched_poly.add(Point(5000, 4000));
+    notched_poly.add(Point(4800, 10000));
+    notched_poly.add(Point(0, 10000));
+    Polygons smoothed = Polygons(notched).smooth_outward(60, 300); // the notch is wider than the shortcut at the neighbouring vertices, so the corner is cut off directly
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Smoothing shouldn't split or remove the polygon.", size_t(1), smoothed.size());
+    CPPUNIT_ASSERT_MESSAGE("Smoothing outward may only add area.", totalArea(notched.difference(smoothed)) < maximum_error * maximum_error);
+    CPPUNIT_ASSERT_MESSAGE("The tip of the notch should be cut off.", smoothed.inside(Point(5000, 4100)));
+    CPPUNIT_ASSERT_MESSAGE("The shortcut should be about as long as requested, leaving the rest of the notch.", !smoothed.inside(Point(5000, 9900)));
+    for (const Point& p : smoothed[0])
+    {
+        CPPUNIT_ASSERT_MESSAGE("The tip of the notch is still a vertex.", p != Point(5000, 4000));
+    }
+
+    // A notch which is wider than the maximum angle stays.
+    Polygons wide_notched;
+    PolygonRef wide_notched_poly = wide_notched.newPoly();
+    wide_notched_poly.add(Point(0, 0));
+    wide_notched_poly.add(Point(10000, 0));
+    wide_notched_poly.add(Point(10000, 10000));
+    wide_notched_poly.add(Point(8000, 10000));
+    wide_notched_poly.add(Point(5000, 7000));
+    wide_notched_poly.add(Point(2000, 10000));
+    wide_notched_poly.add(Point(0, 10000));
+    Polygons wide_smoothed = Polygons(wide_notched).smooth_outward(60, 2000);
+    CPPUNIT_ASSERT_MESSAGE("A corner of 90 degrees shouldn't be smoothed out with a maximum angle of 60 degrees.", wide_smoothed.size() == 1 && wide_smoothed[0].size() == 7 && totalArea(wide_smoothed.difference(wide_notched)) == 0);
+
+    // Degenerate polygons.
+    Polygons line;
+    line.addLine(Point(0, 0), Point(1000, 0));
+    CPPUNIT_ASSERT_MESSAGE("A polygon of two vertices should be removed.", Polygons(line).smooth_outward(60, 2000).empty());
+    Polygons duplicate_points;
+    PolygonRef duplicate_points_poly = duplicate_points.newPoly();
+    duplicate_points_poly.add(Point(0, 0));
+    duplicate_points_poly.add(Point(0, 0));
+    duplicate_points_poly.add(Point(10000, 0));
+    duplicate_points_poly.add(Point(10000, 10000));
+    duplicate_points_poly.add(Point(0, 10000));
+    Polygons deduplicated = Polygons(duplicate_points).smooth_outward(60, 2000);
+    CPPUNIT_ASSERT_MESSAGE("Duplicate vertices should be removed without changing the shape.", deduplicated.size() == 1 && deduplicated[0].size() == 4 && totalArea(deduplicated) == totalArea(duplicate_points));
+}
+
+void PolygonTest::smoothOutwardComplexTest()
+{
+    // A notch made of more than two segments, so that a shortcut of the requested length bypasses several of them.
+    Polygons notched;
+    PolygonRef notched_poly = notched.newPoly();
+    notched_poly.add(Point(0, 0));
+    notched_poly.add(Point(10000, 0));
+    notched_poly.add(Point(10000, 10000));
+    notched_poly.add(Point(5100, 10000));
+    notched_poly.add(Point(5050, 8000));
+    notched_poly.add(Point(5000, 6000));
+    notched_poly.add(Point(4950, 8000));
+    notched_poly.add(Point(4900, 10000));
+    notched_poly.add(Point(0, 10000));
+    Polygons smoothed = Polygons(notched).smooth_outward(60, 2000);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("Smoothing shouldn't split or remove the polygon.", size_t(1), smoothed.size());
+    CPPUNIT_ASSERT_MESSAGE("Smoothing outward may only add area.", totalArea(notched.difference(smoothed)) < maximum_error * maximum_error);
+    CPPUNIT_ASSERT_MESSAGE("The tip of the notch should be cut off.", smoothed.inside(Point(5000, 6100)));
+    CPPUNIT_ASSERT_MESSAGE("The vertices of the notch beyond the shortcut should be removed.", smoothed[0].size() < notched_poly.size());
+
+    // A hole which is entirely a sharp corner is removed.
+    Polygons sliver;
+    PolygonRef sliver_poly = sliver.newPoly();
+    sliver_poly.add(Point(0, 0));
+    sliver_poly.add(Point(100, 3000));
+    sliver_poly.add(Point(0, 6000));
+    sliver_poly.add(Point(-100, 3000));
+    sliver_poly.reverse();
+    CPPUNIT_ASSERT_MESSAGE("Smoothing a thin sliver hole should remove it.", Polygons(sliver).smooth_outward(60, 2000).empty());
+}
+
 
 
 
@@ -20,8 +20,16 @@ class PolygonTest : public CppUnit::TestFixture
     CPPUNIT_TEST_SUITE(PolygonTest);
     CPPUNIT_TEST(polygonOffsetTest);
     CPPUNIT_TEST(polygonOffsetBugTest);
+    CPPUNIT_TEST(polygonOffsetTemporaryTest);
+    CPPUNIT_TEST(polygonOffsetMultiTest);
+    CPPUNIT_TEST(polygonOffsetConvexTest);
+    CPPUNIT_TEST(polygonIsIdenticalTest);
     CPPUNIT_TEST(isOutsideTest);
     CPPUNIT_TEST(isInsideTest);
+    CPPUNIT_TEST(insideSameAsClipperTest);
+    CPPUNIT_TEST(convexHullTest);
+    CPPUNIT_TEST(smoothOutwardTest);
+    CPPUNIT_TEST(smoothOutwardComplexTest);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -44,9 +52,23 @@ public:
     //These are the actual test cases. The name of the function sort of describes what it tests but I refuse to document all of these, sorry.
     void polygonOffsetTest();
     void polygonOffsetBugTest();
+    void polygonOffsetTemporaryTest();
+    void polygonOffsetMultiTest();
+    void polygonOffsetConvexTest();
+    void polygonIsIdenticalTest();
     void isOutsideTest();
     void isInsideTest();
 
+    /*!
+     * \brief Test whether the vectorized point-in-polygon tests give the same results as the scalar ones at each instruction set level,
+     * including on the borders of the polygons.
+     */
+    void insideSameAsClipperTest();
+
+    void convexHullTest();
+    void smoothOutwardTest();
+    void smoothOutwardComplexTest();
+
 
 private:
     /*!
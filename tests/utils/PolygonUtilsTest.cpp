@@ -248,7 +248,7 @@ void PolygonUtilsTest::findCloseAssert(const PolygonRef poly, Point close_to, Po
 {
     Polygons polys;
     polys.add(poly);
-    SparseLineGrid<PolygonsPointIndex, PolygonsPointIndexSegmentLocator>* loc_to_line = PolygonUtils::createLocToLineGrid(polys, cell_size);
+    LocToLineGrid* loc_to_line = PolygonUtils::createLocToLineGrid(polys, cell_size);
     
     std::optional<ClosestPolygonPoint> cpp;
     if (penalty_function)
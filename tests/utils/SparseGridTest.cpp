@@ -180,6 +180,32 @@ void SparseGridTest::getNearestSameTest()
     getNearestAssert(input, Point(100, 100), 10, new Point(100, 100));
 }
 
+void SparseGridTest::mortonGridMapOrderTest()
+{
+    //The Morton backend must visit the same elements in the same order as the hash map, also when inserting after a query.
+    constexpr coord_t grid_size = 10;
+    SparsePointGridInclusive<unsigned int> hash_grid(grid_size);
+    SparsePointGridInclusive<unsigned int, MortonGridMap<SparsePointGridInclusiveImpl::SparsePointGridInclusiveElem<unsigned int>>> morton_grid(grid_size);
+    for (unsigned int round = 0; round < 2; round++)
+    {
+        for (unsigned int point_idx = 0; point_idx < 500; point_idx++)
+        {
+            const Point point(((point_idx * 7919) % 397) - 200, ((point_idx * 104729) % 401) - 200);
+            hash_grid.insert(point, round * 500 + point_idx);
+            morton_grid.insert(point, round * 500 + point_idx);
+        }
+        for (coord_t x = -200; x <= 200; x += 17)
+        {
+            for (coord_t y = -200; y <= 200; y += 13)
+            {
+                std::stringstream ss;
+                ss << "The Morton grid map found other values near " << Point(x, y) << " than the hash map.";
+                CPPUNIT_ASSERT_MESSAGE(ss.str(), hash_grid.getNearbyVals(Point(x, y), grid_size) == morton_grid.getNearbyVals(Point(x, y), grid_size));
+            }
+        }
+    }
+}
+
 void SparseGridTest::getNearbyAssert(
     const std::vector<Point>& registered_points,
     Point target, const coord_t grid_size,
@@ -27,6 +27,7 @@ class SparseGridTest : public CppUnit::TestFixture
     CPPUNIT_TEST(getNearestFilterTest);
     CPPUNIT_TEST(getNearestNoneTest);
     CPPUNIT_TEST(getNearestSameTest);
+    CPPUNIT_TEST(mortonGridMapOrderTest);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -53,6 +54,7 @@ public:
     void getNearestFilterTest();
     void getNearestNoneTest();
     void getNearestSameTest();
+    void mortonGridMapOrderTest();
 
 private:
     /*!
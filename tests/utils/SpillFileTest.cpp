@@ -0,0 +1,62 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "SpillFileTest.h"
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(SpillFileTest);
+
+void SpillFileTest::setUp()
+{
+    //Do nothing.
+}
+
+void SpillFileTest::tearDown()
+{
+    //Do nothing.
+}
+
+void SpillFileTest::readBackTest()
+{
+    SpillFile file;
+    CPPUNIT_ASSERT(file.isOpen());
+    const std::vector<uint8_t> first = {1, 2, 3};
+    const std::vector<uint8_t> empty;
+    std::vector<uint8_t> second(10000);
+    for (unsigned int byte_idx = 0; byte_idx < second.size(); byte_idx++)
+    {
+        second[byte_idx] = byte_idx * 7;
+    }
+    uint64_t first_offset;
+    uint64_t empty_offset;
+    uint64_t second_offset;
+    CPPUNIT_ASSERT(file.write(first, first_offset));
+    CPPUNIT_ASSERT(file.write(empty, empty_offset));
+    CPPUNIT_ASSERT(file.write(second, second_offset));
+    CPPUNIT_ASSERT_EQUAL(uint64_t(first.size() + second.size()), file.size());
+    file.finishWriting();
+
+    std::vector<uint8_t> result;
+    file.prefetch(second_offset, second.size());
+    CPPUNIT_ASSERT(file.read(second_offset, second.size(), result));
+    CPPUNIT_ASSERT(result == second);
+    CPPUNIT_ASSERT(file.read(first_offset, first.size(), result));
+    CPPUNIT_ASSERT(result == first);
+    CPPUNIT_ASSERT(file.read(empty_offset, 0, result));
+    CPPUNIT_ASSERT(result.empty());
+}
+
+void SpillFileTest::outOfRangeTest()
+{
+    SpillFile file;
+    uint64_t offset;
+    CPPUNIT_ASSERT(file.write(std::vector<uint8_t>(100, 5), offset));
+    file.finishWriting();
+    std::vector<uint8_t> result;
+    CPPUNIT_ASSERT(!file.read(50, 51, result));
+    CPPUNIT_ASSERT(file.read(50, 50, result));
+    CPPUNIT_ASSERT(result == std::vector<uint8_t>(50, 5));
+}
+
+}
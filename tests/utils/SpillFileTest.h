@@ -0,0 +1,46 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef SPILL_FILE_TEST_H
+#define SPILL_FILE_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/SpillFile.h"
+
+namespace cura
+{
+
+class SpillFileTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SpillFileTest);
+    CPPUNIT_TEST(readBackTest);
+    CPPUNIT_TEST(outOfRangeTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether data is read back as written, in another order than it was written and including empty data.
+     */
+    void readBackTest();
+
+    /*!
+     * \brief Test whether reading beyond the data written fails.
+     */
+    void outOfRangeTest();
+};
+
+}
+
+#endif //SPILL_FILE_TEST_H
@@ -168,6 +168,14 @@ void StringTest::writeDoubleToStreamTestLow()
 {
     writeDoubleToStreamAssert(0.00000001d);
 }
+void StringTest::writeDoubleToStreamTestHalfway()
+{
+    writeDoubleToStreamAssert(0.125, 2); // exactly halfway between two outputs
+}
+void StringTest::writeDoubleToStreamTestPrecision5()
+{
+    writeDoubleToStreamAssert(-1234.567891, 5);
+}
 
 
 void StringTest::writeDoubleToStreamAssert(double in, unsigned int precision)
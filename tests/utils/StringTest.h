@@ -44,6 +44,8 @@ class StringTest : public CppUnit::TestFixture
     CPPUNIT_TEST(writeDoubleToStreamTestLowest);
     CPPUNIT_TEST(writeDoubleToStreamTestLowestNeg);
     CPPUNIT_TEST(writeDoubleToStreamTestLow);
+    CPPUNIT_TEST(writeDoubleToStreamTestHalfway);
+    CPPUNIT_TEST(writeDoubleToStreamTestPrecision5);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -95,6 +97,8 @@ public:
     void writeDoubleToStreamTestLowest();
     void writeDoubleToStreamTestLowestNeg();
     void writeDoubleToStreamTestLow();
+    void writeDoubleToStreamTestHalfway();
+    void writeDoubleToStreamTestPrecision5();
 
 private:
 
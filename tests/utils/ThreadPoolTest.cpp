@@ -0,0 +1,147 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include "ThreadPoolTest.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace cura
+{
+    CPPUNIT_TEST_SUITE_REGISTRATION(ThreadPoolTest);
+
+void ThreadPoolTest::setUp()
+{
+    ThreadPool::setThreadCount(4);
+}
+
+void ThreadPoolTest::tearDown()
+{
+    //Do nothing.
+}
+
+void ThreadPoolTest::parallelForTest()
+{
+    std::vector<std::atomic<int>> visit_count(1000);
+    for (std::atomic<int>& count : visit_count)
+    {
+        count = 0;
+    }
+    ThreadPool::parallelFor(0, visit_count.size(), [&](int index)
+    {
+        visit_count[index]++;
+    });
+    for (unsigned int index = 0; index < visit_count.size(); index++)
+    {
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("Each index must be handled once.", 1, visit_count[index].load());
+    }
+
+    int called_count = 0;
+    ThreadPool::parallelFor(5, 5, [&](int) { called_count++; });
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("An empty range must not call the body.", 0, called_count);
+}
+
+void ThreadPoolTest::nestedParallelForTest()
+{
+    constexpr int outer_count = 20;
+    constexpr int inner_count = 50;
+    std::vector<std::atomic<int>> sums(outer_count);
+    for (std::atomic<int>& sum : sums)
+    {
+        sum = 0;
+    }
+    ThreadPool::parallelFor(0, outer_count, [&](int outer_idx)
+    {
+        ThreadPool::parallelFor(0, inner_count, [&](int inner_idx)
+        {
+            sums[outer_idx] += inner_idx;
+        });
+    });
+    for (int outer_idx = 0; outer_idx < outer_count; outer_idx++)
+    {
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("Each inner loop must be complete.", inner_count * (inner_count - 1) / 2, sums[outer_idx].load());
+    }
+}
+
+void ThreadPoolTest::threadLimitTest()
+{
+    CPPUNIT_ASSERT_EQUAL(4u, ThreadPool::getThreadCount());
+    {
+        ThreadPool::ThreadLimit limit(2);
+        CPPUNIT_ASSERT_EQUAL(2u, ThreadPool::getThreadCount());
+        {
+            ThreadPool::ThreadLimit wider_limit(3);
+            CPPUNIT_ASSERT_EQUAL_MESSAGE("A nested limit can't exceed the limit it is nested in.", 2u, ThreadPool::getThreadCount());
+        }
+        {
+            ThreadPool::ThreadLimit no_limit(0);
+            CPPUNIT_ASSERT_EQUAL_MESSAGE("A limit of 0 must keep the limit it is nested in.", 2u, ThreadPool::getThreadCount());
+        }
+        std::atomic<unsigned int> max_task_thread_count(0);
+        ThreadPool::TaskGroup group;
+        for (int task_idx = 0; task_idx < 10; task_idx++)
+        {
+            group.run([&max_task_thread_count]()
+                {
+                    const unsigned int thread_count = ThreadPool::getThreadCount();
+                    unsigned int seen = max_task_thread_count;
+                    while (thread_count > seen && !max_task_thread_count.compare_exchange_weak(seen, thread_count))
+                    {
+                    }
+                });
+        }
+        group.wait();
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("The limit must hold for the tasks added within its scope.", 2u, max_task_thread_count.load());
+    }
+    CPPUNIT_ASSERT_EQUAL(4u, ThreadPool::getThreadCount());
+}
+
+void ThreadPoolTest::taskExceptionTest()
+{
+    constexpr int task_count = 100;
+    std::atomic<int> finished_count(0);
+    ThreadPool::TaskGroup group;
+    for (int task_idx = 0; task_idx < task_count; task_idx++)
+    {
+        group.run([&finished_count, task_idx]()
+            {
+                finished_count++;
+                if (task_idx % 10 == 3)
+                {
+                    throw std::runtime_error("task failed");
+                }
+            });
+    }
+    bool thrown = false;
+    try
+    {
+        group.wait();
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CPPUNIT_ASSERT_MESSAGE("The exception of a task must be rethrown by the wait.", thrown);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE("All tasks must have finished before the exception is rethrown.", task_count, finished_count.load());
+    group.wait(); // the exception has been handled already, so this must not throw
+
+    thrown = false;
+    try
+    {
+        ThreadPool::parallelFor(0, 1000, [](int index)
+        {
+            if (index == 500)
+            {
+                throw std::runtime_error("index failed");
+            }
+        });
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CPPUNIT_ASSERT_MESSAGE("The exception of an index must be rethrown by the parallel loop.", thrown);
+}
+
+}
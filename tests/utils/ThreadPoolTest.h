@@ -0,0 +1,58 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#ifndef THREAD_POOL_TEST_H
+#define THREAD_POOL_TEST_H
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/utils/ThreadPool.h"
+
+namespace cura
+{
+
+class ThreadPoolTest : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ThreadPoolTest);
+    CPPUNIT_TEST(parallelForTest);
+    CPPUNIT_TEST(nestedParallelForTest);
+    CPPUNIT_TEST(threadLimitTest);
+    CPPUNIT_TEST(taskExceptionTest);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    /*!
+     * \brief Sets up the test suite to prepare for testing.
+     */
+    void setUp();
+
+    /*!
+     * \brief Tears down the test suite when testing is done.
+     */
+    void tearDown();
+
+    /*!
+     * \brief Test whether a parallel loop handles each index exactly once.
+     */
+    void parallelForTest();
+
+    /*!
+     * \brief Test whether parallel loops within parallel loops complete without needing more threads.
+     */
+    void nestedParallelForTest();
+
+    /*!
+     * \brief Test whether a thread limit applies to the tasks added within its scope and is lifted afterwards, and whether a limit of 0 keeps the limit around it.
+     */
+    void threadLimitTest();
+
+    /*!
+     * \brief Test whether an exception thrown by a task is rethrown by the wait for its group once all tasks have finished, and only once.
+     */
+    void taskExceptionTest();
+};
+
+}
+
+#endif //THREAD_POOL_TEST_H
@@ -0,0 +1,434 @@
+//Copyright (c) 2017 Ultimaker B.V.
+//CuraEngine is released under the terms of the AGPLv3 or higher.
+
+#include <chrono>
+#include <cmath> // cos, sin
+#include <cstdio>
+#include <cstdlib> // strtol, strtod
+#include <cstring> // strcmp, strstr
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/infill.h"
+#include "../src/pathOrderOptimizer.h"
+#include "../src/utils/InstructionSet.h"
+#include "../src/utils/intpoint.h"
+#include "../src/utils/linearAlg2D.h"
+#include "../src/utils/polygon.h"
+#include "../src/utils/polygonUtils.h"
+#include "../src/utils/SparsePointGridInclusive.h"
+
+/*!
+ * Microbenchmarks of the primitives which take most of the slicing time.
+ *
+ * Each benchmark prepares its input for a given input size and then times a single operation on it,
+ * which is repeated until the minimal measuring time has passed.
+ *
+ * usage: UtilsBenchmark [-f <name filter>] [-s <size>[,<size>...]] [-t <minimal seconds per measurement>] [-c] [-i <instruction set level>]
+ *   -f Only run the benchmarks of which the name contains the filter
+ *   -s Run with these input sizes instead of the default sizes of each benchmark
+ *   -t The minimal time to repeat each operation for, 0.2 seconds by default
+ *   -c Output comma separated values
+ *   -i Run the vectorized kernels for this level instead of the widest the machine supports: baseline, avx2 or avx512
+ */
+
+namespace cura
+{
+
+namespace
+{
+
+double min_measure_seconds = 0.2;
+bool output_csv = false;
+
+/*!
+ * Repeat an operation until the minimal measuring time has passed and report the average time it took.
+ */
+void measure(const std::string& name, unsigned int size, const std::function<void ()>& operation)
+{
+    using Clock = std::chrono::steady_clock;
+    operation(); // warm up the caches and the allocator
+    unsigned int iteration_count = 0;
+    const Clock::time_point start = Clock::now();
+    double seconds = 0;
+    do
+    {
+        operation();
+        iteration_count++;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < min_measure_seconds);
+    const double microseconds_per_iteration = seconds * 1000000 / iteration_count;
+    if (output_csv)
+    {
+        printf("%s,%u,%u,%.3f\n", name.c_str(), size, iteration_count, microseconds_per_iteration);
+    }
+    else
+    {
+        printf("%-32s size %8u %10u iterations %14.3f us\n", name.c_str(), size, iteration_count, microseconds_per_iteration);
+    }
+    fflush(stdout);
+}
+
+/*!
+ * A closed polygon with \p vertex_count vertices around \p center, with a wavy and slightly noisy radius, like a sliced organic model.
+ */
+Polygon createBumpyCircle(std::mt19937& random, Point center, coord_t radius, unsigned int vertex_count)
+{
+    std::uniform_real_distribution<double> noise(-0.005, 0.005);
+    Polygon poly;
+    for (unsigned int vertex_idx = 0; vertex_idx < vertex_count; vertex_idx++)
+    {
+        const double angle = 2 * M_PI * vertex_idx / vertex_count;
+        const double vertex_radius = radius * (0.9 + 0.05 * std::sin(7 * angle) + 0.05 * std::sin(13 * angle + 1) + noise(random));
+        poly.add(center + Point(vertex_radius * std::cos(angle), vertex_radius * std::sin(angle)));
+    }
+    return poly;
+}
+
+/*!
+ * \p poly_count small polygons spread randomly over a square, like the parts of a plate with many models.
+ */
+Polygons createScatteredPolygons(std::mt19937& random, unsigned int poly_count, coord_t area_size, coord_t poly_radius)
+{
+    std::uniform_int_distribution<coord_t> coord(0, area_size);
+    Polygons result;
+    for (unsigned int poly_idx = 0; poly_idx < poly_count; poly_idx++)
+    {
+        result.add(createBumpyCircle(random, Point(coord(random), coord(random)), poly_radius, 16));
+    }
+    return result;
+}
+
+std::vector<Point> createRandomPoints(std::mt19937& random, unsigned int point_count, coord_t min_coord, coord_t max_coord)
+{
+    std::uniform_int_distribution<coord_t> coord(min_coord, max_coord);
+    std::vector<Point> points;
+    for (unsigned int point_idx = 0; point_idx < point_count; point_idx++)
+    {
+        points.emplace_back(coord(random), coord(random));
+    }
+    return points;
+}
+
+/*!
+ * A benchmark, which prepares and measures the operation for a given input size
+ */
+struct Benchmark
+{
+    const char* name;
+    std::vector<unsigned int> default_sizes;
+    std::function<void (const std::string& name, unsigned int size)> run;
+};
+
+void benchmarkOffset(const std::string& name, unsigned int vertex_count)
+{
+    std::mt19937 random(1);
+    Polygons polys;
+    polys.add(createBumpyCircle(random, Point(0, 0), 50000, vertex_count));
+    measure(name, vertex_count, [&polys]()
+        {
+            Polygons result = polys.offset(-400);
+        });
+}
+
+void benchmarkUnion(const std::string& name, unsigned int poly_count)
+{
+    std::mt19937 random(1);
+    const Polygons polys = createScatteredPolygons(random, poly_count, 200000, 5000);
+    measure(name, poly_count, [&polys]()
+        {
+            Polygons result = polys.unionPolygons();
+        });
+}
+
+void benchmarkInside(const std::string& name, unsigned int vertex_count)
+{
+    std::mt19937 random(1);
+    const Polygon poly = createBumpyCircle(random, Point(0, 0), 50000, vertex_count);
+    const std::vector<Point> points = createRandomPoints(random, 1000, -50000, 50000);
+    measure(name, vertex_count, [&poly, &points]()
+        {
+            unsigned int inside_count = 0;
+            for (const Point& p : points)
+            {
+                inside_count += ConstPolygonRef(poly)._inside(p);
+            }
+            volatile unsigned int result = inside_count;
+            (void)result;
+        });
+}
+
+/*!
+ * Benchmark the Clipper point-in-polygon test, as computed by VectorKernels::pointInPolygon.
+ */
+void benchmarkInsideClipper(const std::string& name, unsigned int vertex_count)
+{
+    std::mt19937 random(1);
+    const Polygon poly = createBumpyCircle(random, Point(0, 0), 50000, vertex_count);
+    const std::vector<Point> points = createRandomPoints(random, 1000, -50000, 50000);
+    measure(name, vertex_count, [&poly, &points]()
+        {
+            unsigned int inside_count = 0;
+            for (const Point& p : points)
+            {
+                inside_count += ConstPolygonRef(poly).inside(p);
+            }
+            volatile unsigned int result = inside_count;
+            (void)result;
+        });
+}
+
+/*!
+ * Benchmark the scalar point-in-polygon test of Clipper itself, to compare VectorKernels::pointInPolygon with.
+ */
+void benchmarkPointInPolygon(const std::string& name, unsigned int vertex_count)
+{
+    std::mt19937 random(1);
+    const Polygon poly = createBumpyCircle(random, Point(0, 0), 50000, vertex_count);
+    const std::vector<Point> points = createRandomPoints(random, 1000, -50000, 50000);
+    const ClipperLib::Path& path = *ConstPolygonRef(poly);
+    measure(name, vertex_count, [&path, &points]()
+        {
+            unsigned int inside_count = 0;
+            for (const Point& p : points)
+            {
+                inside_count += ClipperLib::PointInPolygon(p, path) == 1;
+            }
+            volatile unsigned int result = inside_count;
+            (void)result;
+        });
+}
+
+void benchmarkFindClosest(const std::string& name, unsigned int poly_count)
+{
+    std::mt19937 random(1);
+    const Polygons polys = createScatteredPolygons(random, poly_count, 200000, 5000);
+    const std::vector<Point> points = createRandomPoints(random, 100, 0, 200000);
+    measure(name, poly_count, [&polys, &points]()
+        {
+            for (const Point& p : points)
+            {
+                ClosestPolygonPoint result = PolygonUtils::findClosest(p, polys);
+                (void)result;
+            }
+        });
+}
+
+void benchmarkMoveInside2(const std::string& name, unsigned int poly_count)
+{
+    std::mt19937 random(1);
+    const Polygons polys = createScatteredPolygons(random, poly_count, 200000, 5000);
+    const std::vector<Point> points = createRandomPoints(random, 100, 0, 200000);
+    measure(name, poly_count, [&polys, &points]()
+        {
+            for (Point p : points)
+            {
+                ClosestPolygonPoint result = PolygonUtils::moveInside2(polys, p, 400);
+                (void)result;
+            }
+        });
+}
+
+void benchmarkSparsePointGridInsert(const std::string& name, unsigned int point_count)
+{
+    std::mt19937 random(1);
+    const std::vector<Point> points = createRandomPoints(random, point_count, 0, 200000);
+    measure(name, point_count, [&points]()
+        {
+            SparsePointGridInclusive<unsigned int> grid(2000);
+            for (unsigned int point_idx = 0; point_idx < points.size(); point_idx++)
+            {
+                grid.insert(points[point_idx], point_idx);
+            }
+        });
+}
+
+void benchmarkSparsePointGridQuery(const std::string& name, unsigned int point_count)
+{
+    std::mt19937 random(1);
+    const std::vector<Point> points = createRandomPoints(random, point_count, 0, 200000);
+    SparsePointGridInclusive<unsigned int> grid(2000);
+    for (unsigned int point_idx = 0; point_idx < points.size(); point_idx++)
+    {
+        grid.insert(points[point_idx], point_idx);
+    }
+    const std::vector<Point> queries = createRandomPoints(random, 1000, 0, 200000);
+    std::vector<unsigned int> nearby;
+    measure(name, point_count, [&grid, &queries, &nearby]()
+        {
+            for (const Point& query : queries)
+            {
+                nearby.clear();
+                grid.getNearbyVals(query, 2000, nearby);
+            }
+        });
+}
+
+void benchmarkLinearAlg2D(const std::string& name, unsigned int segment_count)
+{
+    std::mt19937 random(1);
+    const std::vector<Point> points = createRandomPoints(random, segment_count * 3, -100000, 100000);
+    measure(name, segment_count, [&points]()
+        {
+            int64_t sum = 0;
+            for (unsigned int point_idx = 0; point_idx + 2 < points.size(); point_idx += 3)
+            {
+                const Point& a = points[point_idx];
+                const Point& b = points[point_idx + 1];
+                const Point& c = points[point_idx + 2];
+                sum += LinearAlg2D::getDist2FromLineSegment(a, b, c);
+                sum += LinearAlg2D::pointIsLeftOfLine(b, a, c);
+                sum += LinearAlg2D::getClosestOnLineSegment(b, a, c).X;
+            }
+            volatile int64_t result = sum;
+            (void)result;
+        });
+}
+
+void benchmarkPathOrderOptimizer(const std::string& name, unsigned int poly_count)
+{
+    std::mt19937 random(1);
+    const Polygons polys = createScatteredPolygons(random, poly_count, 200000, 2000);
+    measure(name, poly_count, [&polys]()
+        {
+            PathOrderOptimizer order_optimizer(Point(0, 0));
+            order_optimizer.addPolygons(polys);
+            order_optimizer.optimize();
+        });
+}
+
+/*!
+ * Benchmark generating the infill of a pattern in a bumpy circle.
+ *
+ * The size is the diameter of the circle in mm.
+ */
+std::function<void (const std::string& name, unsigned int size)> benchmarkInfill(EFillMethod pattern)
+{
+    return [pattern](const std::string& name, unsigned int diameter)
+    {
+        std::mt19937 random(1);
+        Polygons outline;
+        outline.add(createBumpyCircle(random, Point(0, 0), diameter * 1000 / 2, 500));
+        measure(name, diameter, [&outline, pattern]()
+            {
+                constexpr int line_width = 400;
+                constexpr int line_distance = 2000;
+                constexpr int infill_overlap = 0;
+                constexpr double fill_angle = 45;
+                constexpr int64_t z = 10000;
+                constexpr int64_t shift = 0;
+                Infill infill(pattern, outline, 0, line_width, line_distance, infill_overlap, fill_angle, z, shift);
+                Polygons result_polygons;
+                Polygons result_lines;
+                infill.generate(result_polygons, result_lines);
+            });
+    };
+}
+
+std::vector<unsigned int> parseSizes(const char* str)
+{
+    std::vector<unsigned int> sizes;
+    char* end = const_cast<char*>(str);
+    while (*end)
+    {
+        sizes.push_back(std::strtol(end, &end, 10));
+        if (*end == ',')
+        {
+            end++;
+        }
+        else if (*end)
+        {
+            break;
+        }
+    }
+    return sizes;
+}
+
+}//namespace
+
+}//namespace cura
+
+using namespace cura;
+
+int main(int argc, char** argv)
+{
+    const char* filter = "";
+    std::vector<unsigned int> sizes;
+    for (int argn = 1; argn < argc; argn++)
+    {
+        if (strcmp(argv[argn], "-f") == 0 && argn + 1 < argc)
+        {
+            filter = argv[++argn];
+        }
+        else if (strcmp(argv[argn], "-s") == 0 && argn + 1 < argc)
+        {
+            sizes = parseSizes(argv[++argn]);
+        }
+        else if (strcmp(argv[argn], "-t") == 0 && argn + 1 < argc)
+        {
+            min_measure_seconds = std::strtod(argv[++argn], nullptr);
+        }
+        else if (strcmp(argv[argn], "-c") == 0)
+        {
+            output_csv = true;
+        }
+        else if (strcmp(argv[argn], "-i") == 0 && argn + 1 < argc)
+        {
+            if (!InstructionSet::setLevel(argv[++argn]))
+            {
+                fprintf(stderr, "Instruction set level %s is unknown or not supported by this machine.\n", argv[argn]);
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-f <name filter>] [-s <size>[,<size>...]] [-t <minimal seconds per measurement>] [-c] [-i <instruction set level>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const std::vector<unsigned int> vertex_counts = {100, 1000, 10000};
+    const std::vector<unsigned int> poly_counts = {10, 100, 1000};
+    const std::vector<unsigned int> point_counts = {1000, 10000, 100000};
+    const std::vector<unsigned int> diameters = {10, 50, 200};
+    const std::vector<Benchmark> benchmarks = {
+        {"Polygons::offset", vertex_counts, benchmarkOffset},
+        {"Polygons::unionPolygons", poly_counts, benchmarkUnion},
+        {"ConstPolygonRef::_inside", vertex_counts, benchmarkInside},
+        {"ConstPolygonRef::inside", vertex_counts, benchmarkInsideClipper},
+        {"ClipperLib::PointInPolygon", vertex_counts, benchmarkPointInPolygon},
+        {"PolygonUtils::findClosest", poly_counts, benchmarkFindClosest},
+        {"PolygonUtils::moveInside2", poly_counts, benchmarkMoveInside2},
+        {"SparsePointGridInclusive::insert", point_counts, benchmarkSparsePointGridInsert},
+        {"SparsePointGridInclusive::query", point_counts, benchmarkSparsePointGridQuery},
+        {"LinearAlg2D", point_counts, benchmarkLinearAlg2D},
+        {"PathOrderOptimizer::optimize", poly_counts, benchmarkPathOrderOptimizer},
+        {"Infill::generate lines", diameters, benchmarkInfill(EFillMethod::LINES)},
+        {"Infill::generate grid", diameters, benchmarkInfill(EFillMethod::GRID)},
+        {"Infill::generate triangles", diameters, benchmarkInfill(EFillMethod::TRIANGLES)},
+        {"Infill::generate cubic", diameters, benchmarkInfill(EFillMethod::CUBIC)},
+        {"Infill::generate tetrahedral", diameters, benchmarkInfill(EFillMethod::TETRAHEDRAL)},
+        {"Infill::generate concentric", diameters, benchmarkInfill(EFillMethod::CONCENTRIC)},
+        {"Infill::generate concentric 3D", diameters, benchmarkInfill(EFillMethod::CONCENTRIC_3D)},
+        {"Infill::generate zigzag", diameters, benchmarkInfill(EFillMethod::ZIG_ZAG)},
+    };
+
+    if (output_csv)
+    {
+        printf("name,size,iterations,microseconds\n");
+    }
+    for (const Benchmark& benchmark : benchmarks)
+    {
+        if (!strstr(benchmark.name, filter))
+        {
+            continue;
+        }
+        for (unsigned int size : sizes.empty()? benchmark.default_sizes : sizes)
+        {
+            benchmark.run(benchmark.name, size);
+        }
+    }
+    return 0;
+}